@@ -23,6 +23,11 @@ pub struct Madt {
 }
 
 impl Madt {
+	/// Returns the physical address of the local interrupt controller.
+	pub fn get_local_apic_addr(&self) -> u32 {
+		self.local_apic_addr
+	}
+
 	/// Executes the given closure for each entry in the MADT.
 	pub fn foreach_entry<F: Fn(&EntryHeader)>(&self, f: F) {
 		let entries_len = self.header.get_length() as usize - ENTRIES_OFF;
@@ -66,3 +71,34 @@ impl EntryHeader {
 		self.length
 	}
 }
+
+/// Processor Local APIC flag: the processor is enabled.
+const PROCESSOR_ENABLED: u32 = 0b01;
+/// Processor Local APIC flag: the processor can be enabled.
+const PROCESSOR_ONLINE_CAPABLE: u32 = 0b10;
+
+/// An MADT entry describing a processor and its local interrupt controller (type `0`).
+#[repr(C, packed)]
+pub struct ProcessorLocalApic {
+	/// The entry's header.
+	header: EntryHeader,
+
+	/// The processor's ID.
+	acpi_processor_id: u8,
+	/// The processor's local APIC ID.
+	apic_id: u8,
+	/// The processor's flags.
+	flags: u32,
+}
+
+impl ProcessorLocalApic {
+	/// Returns the ID of the processor's local APIC.
+	pub fn get_apic_id(&self) -> u8 {
+		self.apic_id
+	}
+
+	/// Tells whether the processor can be used.
+	pub fn is_usable(&self) -> bool {
+		self.flags & (PROCESSOR_ENABLED | PROCESSOR_ONLINE_CAPABLE) != 0
+	}
+}
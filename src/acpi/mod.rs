@@ -6,6 +6,8 @@
 //! RSDT, referring to every other available tables.
 
 use core::intrinsics::wrapping_add;
+use crate::cpu::apic;
+use crate::cpu::smp;
 use data::ACPIData;
 use fadt::Fadt;
 use madt::Madt;
@@ -93,10 +95,17 @@ pub fn init() {
 
 	if let Some(data) = data {
 		if let Some(madt) = data.get_table::<Madt>() {
+			apic::set_base(madt.get_local_apic_addr() as _);
+
 			// Registering CPU cores
 			madt.foreach_entry(| e: &madt::EntryHeader | match e.get_type() {
 				0 => {
-					// TODO Register a new CPU
+					let entry = unsafe {
+						&*(e as *const _ as *const madt::ProcessorLocalApic)
+					};
+					if entry.is_usable() {
+						smp::register_core(entry.get_apic_id());
+					}
 				},
 
 				_ => {},
@@ -0,0 +1,231 @@
+//! Benchmarks measure the time taken by kernel features, to compare the performance of the kernel
+//! across changes. They run on boot when the `debug_bench` option is enabled, then the kernel
+//! halts.
+//!
+//! The results are printed and written on the serial port COM1, one line per benchmark with the
+//! format `bench <name> <iterations> <cycles> <total_ns> <ns_per_op>`. If the TSC is not
+//! calibrated, durations in nanoseconds are zero.
+//!
+//! Benchmarks run in kernelspace. System calls are issued through the `int 0x80` entry from there,
+//! which measures the round trip without the privilege change. The cost of each system call is
+//! given by the file `syscalls` of the procfs when the `debug_syscall_stats` option is enabled.
+
+use core::arch::asm;
+use core::fmt::Write;
+use crate::cpu;
+use crate::device::serial;
+use crate::errno::Errno;
+use crate::errno;
+use crate::file::FileContent;
+use crate::file::fcache;
+use crate::file::path::Path;
+use crate::file::pipe::PipeBuffer;
+use crate::gdt;
+use crate::memory::buddy;
+use crate::memory::malloc;
+use crate::process::mem_space::MapConstraint;
+use crate::process::mem_space::MemSpace;
+use crate::process::mem_space;
+use crate::time::tsc;
+use crate::trace;
+use crate::util::IO;
+use crate::util::container::string::String;
+
+/// The size of the buffer used by I/O benchmarks, in bytes.
+const IO_BUFF_SIZE: usize = 4096;
+/// The size of the file used by file benchmarks, in bytes.
+const FILE_SIZE: usize = 64 * IO_BUFF_SIZE;
+/// The number of pages of the memory space used by the fork benchmark.
+const FORK_PAGES: usize = 256;
+/// The name of the file used by file benchmarks, located at the root of the filesystem.
+const FILE_NAME: &[u8] = b".bench";
+/// The ID of the system call used by the system call benchmark. `break` is not implemented and
+/// returns directly.
+const SYSCALL_ID: u32 = 0x011;
+
+/// Writes the line `line` on the console and the serial port.
+fn output(line: &String) {
+	crate::println!("{}", line);
+
+	if let Some(port) = serial::get(serial::COM1) {
+		let mut guard = port.lock();
+		let serial = guard.get_mut();
+		serial.write(line.as_bytes());
+		serial.write(b"\n");
+	}
+}
+
+/// Runs the benchmark `name`, calling `f` for `iterations` iterations, then writes the result.
+/// `f` takes the index of the iteration.
+/// If an iteration fails, the benchmark is stopped and the error is written instead.
+fn run<F: FnMut(usize) -> Result<(), Errno>>(name: &str, iterations: usize, mut f: F) {
+	let begin = cpu::rdtsc();
+	let mut res = Ok(());
+	for i in 0..iterations {
+		res = f(i);
+		if res.is_err() {
+			break;
+		}
+	}
+	let cycles = cpu::rdtsc() - begin;
+
+	let mut line = String::new();
+	let res = match res {
+		Ok(()) => {
+			let ns = if tsc::is_calibrated() {
+				tsc::cycles_to_ns(cycles)
+			} else {
+				0
+			};
+			write!(line, "bench {} {} {} {} {}", name, iterations, cycles, ns,
+				ns / iterations as u64)
+		},
+
+		Err(e) => write!(line, "bench {} failed: {}", name, e),
+	};
+	if res.is_ok() {
+		output(&line);
+	}
+}
+
+/// Measures allocations with the malloc allocator.
+fn bench_malloc() -> Result<(), Errno> {
+	run("malloc", 10000, | _ | {
+		unsafe {
+			let ptr = malloc::alloc(64)?;
+			malloc::free(ptr);
+		}
+
+		Ok(())
+	});
+
+	Ok(())
+}
+
+/// Measures allocations of frames with the buddy allocator.
+fn bench_buddy() -> Result<(), Errno> {
+	run("buddy", 10000, | _ | {
+		let ptr = buddy::alloc_kernel(0)?;
+		buddy::free_kernel(ptr, 0);
+
+		Ok(())
+	});
+
+	Ok(())
+}
+
+/// Measures the round trip of a system call through the `int 0x80` entry.
+fn bench_syscall() -> Result<(), Errno> {
+	run("syscall", 10000, | _ | {
+		let ret: u32;
+		unsafe {
+			asm!("int 0x80", inlateout("eax") SYSCALL_ID => ret);
+		}
+
+		if ret as i32 == -errno::ENOSYS {
+			Ok(())
+		} else {
+			Err(errno!(EINVAL))
+		}
+	});
+
+	// Returning from the system call loads the data segment of userspace
+	unsafe {
+		asm!("mov ds, {0:x}", "mov es, {0:x}", in(reg) gdt::KERNEL_DS);
+	}
+
+	Ok(())
+}
+
+/// Measures the forking of a memory space, which happens on each `fork` system call.
+fn bench_fork() -> Result<(), Errno> {
+	let mut mem_space = MemSpace::new()?;
+	let flags = mem_space::MAPPING_FLAG_WRITE | mem_space::MAPPING_FLAG_USER
+		| mem_space::MAPPING_FLAG_NOLAZY;
+	mem_space.map(MapConstraint::None, FORK_PAGES, flags, None, 0)?;
+
+	run("mem_space_fork", 100, | _ | {
+		mem_space.fork()?;
+		Ok(())
+	});
+
+	Ok(())
+}
+
+/// Measures the transfer of data through a pipe.
+fn bench_pipe() -> Result<(), Errno> {
+	let mut pipe = PipeBuffer::new()?;
+	pipe.update_end_count(false, false);
+	pipe.update_end_count(true, false);
+
+	let mut buff = [0; IO_BUFF_SIZE];
+	run("pipe", 10000, | _ | {
+		let len = pipe.write(&buff)?;
+		pipe.read(&mut buff[..len]);
+
+		Ok(())
+	});
+
+	Ok(())
+}
+
+/// Measures writes and reads of a file on the root filesystem.
+/// The file is removed afterwards.
+fn bench_file() -> Result<(), Errno> {
+	let file_mutex = {
+		let mutex = fcache::get();
+		let mut guard = mutex.lock();
+		let fcache = guard.get_mut().as_mut().ok_or_else(|| errno!(ENOENT))?;
+
+		let root_mutex = fcache.get_file_from_path(&Path::root(), 0, 0, true)?;
+		let mut root_guard = root_mutex.lock();
+		let root = root_guard.get_mut();
+
+		fcache.create_file(root, String::from(FILE_NAME)?, 0, 0, 0o600, FileContent::Regular)?
+	};
+
+	{
+		let mut file_guard = file_mutex.lock();
+		let file = file_guard.get_mut();
+
+		let mut buff = [0; IO_BUFF_SIZE];
+		let count = FILE_SIZE / IO_BUFF_SIZE;
+		run("file_write", count, | i | {
+			file.write((i * IO_BUFF_SIZE) as _, &buff)?;
+			Ok(())
+		});
+		run("file_read", count, | i | {
+			file.read((i * IO_BUFF_SIZE) as _, &mut buff)?;
+			Ok(())
+		});
+	}
+
+	let mutex = fcache::get();
+	let mut guard = mutex.lock();
+	let fcache = guard.get_mut().as_mut().ok_or_else(|| errno!(ENOENT))?;
+	let file_guard = file_mutex.lock();
+	fcache.remove_file(file_guard.get(), 0, 0)
+}
+
+/// Runs every benchmarks, then dumps the recorded trace events on the serial port.
+/// This function must be called once memory management, processes memory spaces and files
+/// management have been initialized.
+pub fn run_all() {
+	crate::println!("Running benchmarks...");
+
+	let benches: [(&str, fn() -> Result<(), Errno>); 6] = [
+		("malloc", bench_malloc),
+		("buddy", bench_buddy),
+		("syscall", bench_syscall),
+		("mem_space_fork", bench_fork),
+		("pipe", bench_pipe),
+		("file", bench_file),
+	];
+	for (name, f) in benches {
+		if let Err(e) = f() {
+			crate::println!("Benchmark `{}` cannot be run: {}", name, e);
+		}
+	}
+
+	trace::dump_serial();
+}
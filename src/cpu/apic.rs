@@ -0,0 +1,210 @@
+//! The Local APIC (Advanced Programmable Interrupt Controller) is the interrupt controller of each
+//! CPU core. It allows cores to send each other Inter-Processor Interrupts (IPI), which are used
+//! to start other cores and to notify them of events.
+//!
+//! External interrupts are still handled by the PIC, which is connected to the Local APIC of the
+//! bootstrap core in virtual wire mode.
+
+use core::ffi::c_void;
+use core::mem::MaybeUninit;
+use core::ptr;
+use crate::errno::Errno;
+use crate::idt;
+use crate::memory::mmio::MMIO;
+
+/// The default physical address of the Local APIC registers.
+pub const DEFAULT_BASE: usize = 0xfee00000;
+
+/// Register: Local APIC ID.
+const REG_ID: usize = 0x20;
+/// Register: Task Priority.
+const REG_TPR: usize = 0x80;
+/// Register: End Of Interrupt.
+const REG_EOI: usize = 0xb0;
+/// Register: Spurious Interrupt Vector.
+const REG_SPURIOUS: usize = 0xf0;
+/// Register: Interrupt Command, low half.
+const REG_ICR_LOW: usize = 0x300;
+/// Register: Interrupt Command, high half.
+const REG_ICR_HIGH: usize = 0x310;
+/// Register: Local Vector Table entry for the timer.
+const REG_LVT_TIMER: usize = 0x320;
+/// Register: Local Vector Table entry for LINT0.
+const REG_LVT_LINT0: usize = 0x350;
+/// Register: Local Vector Table entry for LINT1.
+const REG_LVT_LINT1: usize = 0x360;
+/// Register: Timer initial count.
+const REG_TIMER_INITIAL: usize = 0x380;
+/// Register: Timer current count.
+const REG_TIMER_CURRENT: usize = 0x390;
+/// Register: Timer divide configuration.
+const REG_TIMER_DIVIDE: usize = 0x3e0;
+
+/// The Model Specific Register holding the deadline of the timer in TSC-deadline mode.
+const MSR_TSC_DEADLINE: u32 = 0x6e0;
+
+/// Spurious register flag: enables the Local APIC.
+const SPURIOUS_ENABLE: u32 = 1 << 8;
+/// The interrupt vector for spurious interrupts.
+const SPURIOUS_VECTOR: u32 = idt::APIC_SPURIOUS as _;
+
+/// LVT entry: the interrupt is masked.
+const LVT_MASKED: u32 = 1 << 16;
+/// LVT entry: delivery mode NMI.
+const LVT_NMI: u32 = 0b100 << 8;
+/// LVT entry: delivery mode ExtINT, forwarding the interrupts of the PIC.
+const LVT_EXTINT: u32 = 0b111 << 8;
+/// LVT timer entry: the timer fires when the TSC reaches the value of `MSR_TSC_DEADLINE`. If not
+/// set, the timer fires once its count reaches zero.
+const LVT_TIMER_TSC_DEADLINE: u32 = 0b10 << 17;
+
+/// Timer divide configuration: the count is decremented every 16 bus cycles.
+const TIMER_DIVIDE_16: u32 = 0b0011;
+
+/// ICR delivery mode: fixed, delivering the given vector.
+pub const ICR_FIXED: u32 = 0b000 << 8;
+/// ICR delivery mode: INIT.
+pub const ICR_INIT: u32 = 0b101 << 8;
+/// ICR delivery mode: Start-Up.
+pub const ICR_STARTUP: u32 = 0b110 << 8;
+/// ICR flag: the delivery of the previous IPI is pending.
+const ICR_PENDING: u32 = 1 << 12;
+/// ICR flag: level assert.
+pub const ICR_ASSERT: u32 = 1 << 14;
+/// ICR flag: level triggered.
+pub const ICR_LEVEL: u32 = 1 << 15;
+/// ICR destination shorthand: every cores except the current one.
+const ICR_ALL_EXCLUDING_SELF: u32 = 0b11 << 18;
+
+/// The physical address of the Local APIC registers.
+static mut BASE: usize = DEFAULT_BASE;
+/// The mapping of the registers. Initialized by `init`.
+static mut REGS: MaybeUninit<MMIO> = MaybeUninit::uninit();
+/// Tells whether the Local APIC registers are mapped.
+static mut MAPPED: bool = false;
+
+/// Sets the physical address of the Local APIC registers, as given by ACPI.
+/// This function must be called before `init`.
+pub fn set_base(base: usize) {
+	unsafe { // Safe because called only once at boot
+		BASE = base;
+	}
+}
+
+/// Tells whether the Local APIC can be used.
+pub fn is_enabled() -> bool {
+	unsafe { // Safe because set only once at boot
+		MAPPED
+	}
+}
+
+/// Returns a pointer to the register at offset `off`.
+fn get_reg(off: usize) -> *mut u32 {
+	unsafe { // Safe because the registers are mapped before being used
+		(REGS.assume_init_ref().get_virt_begin() as usize + off) as *mut u32
+	}
+}
+
+/// Reads the register at offset `off`.
+fn read(off: usize) -> u32 {
+	unsafe { // Safe because the register is mapped
+		ptr::read_volatile(get_reg(off))
+	}
+}
+
+/// Writes `val` to the register at offset `off`.
+fn write(off: usize, val: u32) {
+	unsafe { // Safe because the register is mapped
+		ptr::write_volatile(get_reg(off), val);
+	}
+}
+
+/// Maps the Local APIC registers. The registers are at the same address for every cores.
+/// This function must be called only once, on the bootstrap core.
+pub fn map() -> Result<(), Errno> {
+	unsafe { // Safe because called only once at boot
+		REGS.write(MMIO::new(BASE as *mut c_void, 1)?);
+		MAPPED = true;
+	}
+
+	Ok(())
+}
+
+/// Enables the Local APIC of the current core.
+/// `bsp` tells whether the current core is the bootstrap core, which receives the interrupts of
+/// the PIC.
+pub fn enable(bsp: bool) {
+	write(REG_TPR, 0);
+	if bsp {
+		write(REG_LVT_LINT0, LVT_EXTINT);
+	} else {
+		write(REG_LVT_LINT0, LVT_MASKED);
+	}
+	write(REG_LVT_LINT1, LVT_NMI);
+	write(REG_SPURIOUS, SPURIOUS_ENABLE | SPURIOUS_VECTOR);
+}
+
+/// Returns the ID of the Local APIC of the current core.
+pub fn get_id() -> u8 {
+	(read(REG_ID) >> 24) as _
+}
+
+/// Sets up the timer of the current core in one-shot mode, firing the interrupt `vector`.
+/// The timer is stopped until it is armed.
+/// If `deadline` is true, the timer is set up in TSC-deadline mode, which must be supported.
+pub fn timer_setup(vector: u8, deadline: bool) {
+	write(REG_TIMER_INITIAL, 0);
+	write(REG_TIMER_DIVIDE, TIMER_DIVIDE_16);
+	if deadline {
+		write(REG_LVT_TIMER, LVT_TIMER_TSC_DEADLINE | vector as u32);
+	} else {
+		write(REG_LVT_TIMER, vector as u32);
+	}
+}
+
+/// Arms the timer of the current core in one-shot mode to fire after `count` timer ticks. If
+/// `count` is zero, the timer is stopped.
+pub fn timer_oneshot(count: u32) {
+	write(REG_TIMER_INITIAL, count);
+}
+
+/// Returns the remaining count of the timer of the current core in one-shot mode.
+pub fn timer_current() -> u32 {
+	read(REG_TIMER_CURRENT)
+}
+
+/// Arms the timer of the current core in TSC-deadline mode to fire once the TSC reaches `tsc`. If
+/// `tsc` is zero, the timer is stopped.
+pub fn timer_deadline(tsc: u64) {
+	unsafe { // Safe because the timer is set up in TSC-deadline mode
+		crate::cpu::wrmsr(MSR_TSC_DEADLINE, tsc);
+	}
+}
+
+/// Signals the end of the interrupt currently being handled. This must be called only for
+/// interrupts issued by the Local APIC, such as IPIs.
+#[no_mangle]
+pub extern "C" fn apic_end_of_interrupt() {
+	write(REG_EOI, 0);
+}
+
+/// Waits until the previous IPI has been delivered.
+fn wait_delivery() {
+	while read(REG_ICR_LOW) & ICR_PENDING != 0 {
+		core::hint::spin_loop();
+	}
+}
+
+/// Sends an IPI to the core whose Local APIC has ID `apic_id`.
+/// `flags` are the delivery mode and flags, and `vector` is the interrupt vector.
+pub fn send_ipi(apic_id: u8, flags: u32, vector: u8) {
+	wait_delivery();
+	write(REG_ICR_HIGH, (apic_id as u32) << 24);
+	write(REG_ICR_LOW, flags | vector as u32);
+}
+
+/// Sends an IPI with vector `vector` to every cores except the current one.
+pub fn broadcast_ipi(vector: u8) {
+	wait_delivery();
+	write(REG_ICR_LOW, ICR_ALL_EXCLUDING_SELF | ICR_FIXED | vector as u32);
+}
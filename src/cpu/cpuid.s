@@ -3,6 +3,12 @@
  */
 
 .global cpuid_has_sse
+.global cpuid_has_sse2
+.global cpuid_has_erms
+.global cpuid_has_pge
+.global cpuid_has_sep
+.global cpuid_has_tsc_deadline
+.global cpuid_pmu_version
 .global get_hwcap
 
 .section .text
@@ -19,6 +25,117 @@ cpuid_has_sse:
 	pop %ebx
 	ret
 
+cpuid_has_sse2:
+	push %ebx
+
+	mov $0x1, %eax
+	cpuid
+	shr $26, %edx
+	and $0x1, %edx
+	mov %edx, %eax
+
+	pop %ebx
+	ret
+
+/*
+ * Tells whether the CPU supports global pages, which are not flushed from the
+ * TLB when switching the page directory.
+ */
+cpuid_has_pge:
+	push %ebx
+
+	mov $0x1, %eax
+	cpuid
+	shr $13, %edx
+	and $0x1, %edx
+	mov %edx, %eax
+
+	pop %ebx
+	ret
+
+/*
+ * Tells whether the CPU supports the `sysenter` and `sysexit` instructions.
+ */
+cpuid_has_sep:
+	push %ebx
+
+	mov $0x1, %eax
+	cpuid
+	shr $11, %edx
+	and $0x1, %edx
+	mov %edx, %eax
+
+	pop %ebx
+	ret
+
+/*
+ * Tells whether the timer of the Local APIC supports the TSC-deadline mode.
+ */
+cpuid_has_tsc_deadline:
+	push %ebx
+
+	mov $0x1, %eax
+	cpuid
+	shr $24, %ecx
+	and $0x1, %ecx
+	mov %ecx, %eax
+
+	pop %ebx
+	ret
+
+/*
+ * Tells whether the CPU supports Enhanced REP MOVSB/STOSB. The feature is
+ * reported in the structured extended feature flags (leaf 0x7), which might
+ * not be supported by the CPU.
+ */
+cpuid_has_erms:
+	push %ebx
+
+	xor %eax, %eax
+	cpuid
+	cmp $0x7, %eax
+	jb cpuid_has_erms_no
+
+	mov $0x7, %eax
+	xor %ecx, %ecx
+	cpuid
+	shr $9, %ebx
+	and $0x1, %ebx
+	mov %ebx, %eax
+
+	pop %ebx
+	ret
+
+cpuid_has_erms_no:
+	xor %eax, %eax
+	pop %ebx
+	ret
+
+/*
+ * Returns the version of the architectural performance monitoring unit, or
+ * zero if not supported. The version is reported in leaf 0xa, which might not
+ * be supported by the CPU.
+ */
+cpuid_pmu_version:
+	push %ebx
+
+	xor %eax, %eax
+	cpuid
+	cmp $0xa, %eax
+	jb cpuid_pmu_version_no
+
+	mov $0xa, %eax
+	cpuid
+	and $0xff, %eax
+
+	pop %ebx
+	ret
+
+cpuid_pmu_version_no:
+	xor %eax, %eax
+	pop %ebx
+	ret
+
 get_hwcap:
 	push %ebx
 
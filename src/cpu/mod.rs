@@ -1,5 +1,7 @@
 //! This module implements CPU-specific features.
 
+pub mod apic;
+pub mod smp;
 pub mod sse;
 
 use core::ffi::c_void;
@@ -7,6 +9,18 @@ use core::ffi::c_void;
 extern "C" {
 	/// Tells whether the CPU has SSE.
 	fn cpuid_has_sse() -> bool;
+	/// Tells whether the CPU has SSE2.
+	fn cpuid_has_sse2() -> bool;
+	/// Tells whether the CPU supports Enhanced REP MOVSB/STOSB.
+	fn cpuid_has_erms() -> bool;
+	/// Tells whether the CPU supports global pages.
+	fn cpuid_has_pge() -> bool;
+	/// Tells whether the CPU supports the `sysenter` and `sysexit` instructions.
+	fn cpuid_has_sep() -> bool;
+	/// Tells whether the Local APIC timer supports the TSC-deadline mode.
+	fn cpuid_has_tsc_deadline() -> bool;
+	/// Returns the version of the architectural Performance Monitoring Unit.
+	fn cpuid_pmu_version() -> u32;
 
 	/// Returns HWCAP bitmask for ELF.
 	pub fn get_hwcap() -> u32;
@@ -26,3 +40,91 @@ extern "C" {
 	/// Sets the content of the %cr4 register.
 	pub fn cr4_set(flags: u32);
 }
+
+/// Tells whether the CPU supports Enhanced REP MOVSB/STOSB (ERMS), making `rep movsb` and
+/// `rep stosb` the fastest way to copy or fill large chunks of memory.
+pub fn has_erms() -> bool {
+	unsafe {
+		cpuid_has_erms()
+	}
+}
+
+/// Tells whether the CPU supports global pages (PGE), which stay in the TLB when the page
+/// directory is switched.
+pub fn has_pge() -> bool {
+	unsafe {
+		cpuid_has_pge()
+	}
+}
+
+/// Tells whether the CPU supports the `sysenter` and `sysexit` instructions (SEP), allowing to
+/// issue system calls without going through the IDT.
+pub fn has_sep() -> bool {
+	unsafe {
+		cpuid_has_sep()
+	}
+}
+
+/// Tells whether the timer of the Local APIC can fire when the Time Stamp Counter reaches a given
+/// deadline (TSC-deadline mode), which doesn't require to calibrate the timer itself.
+pub fn has_tsc_deadline() -> bool {
+	unsafe {
+		cpuid_has_tsc_deadline()
+	}
+}
+
+/// Returns the version of the architectural Performance Monitoring Unit (PMU), allowing to count
+/// events such as retired instructions. If zero, the CPU doesn't have one.
+pub fn pmu_version() -> u8 {
+	unsafe {
+		cpuid_pmu_version() as _
+	}
+}
+
+/// Enables global pages if supported. Since the value of %cr4 is copied to the other CPU cores
+/// when they are started, this has to be done before.
+pub fn enable_pge() {
+	if has_pge() {
+		unsafe {
+			cr4_set(cr4_get() | 0b10000000);
+		}
+	}
+}
+
+/// Writes the value `val` to the Model Specific Register `msr`.
+///
+/// # Safety
+///
+/// Model Specific Registers control the behaviour of the CPU. Writing an invalid value or to a
+/// register that doesn't exist is undefined.
+#[inline(always)]
+pub unsafe fn wrmsr(msr: u32, val: u64) {
+	core::arch::asm!("wrmsr", in("ecx") msr, in("eax") val as u32, in("edx") (val >> 32) as u32);
+}
+
+/// Returns the value of the CPU's Time Stamp Counter.
+#[inline(always)]
+pub fn rdtsc() -> u64 {
+	let lo: u32;
+	let hi: u32;
+
+	unsafe {
+		core::arch::asm!("rdtsc", out("eax") lo, out("edx") hi);
+	}
+
+	((hi as u64) << 32) | (lo as u64)
+}
+
+/// Returns the value of the performance counter `counter` of the current core.
+/// The CPU must have an architectural Performance Monitoring Unit.
+#[inline(always)]
+pub fn rdpmc(counter: u32) -> u64 {
+	let lo: u32;
+	let hi: u32;
+
+	unsafe {
+		core::arch::asm!("rdpmc", in("ecx") counter, out("eax") lo, out("edx") hi);
+	}
+
+	((hi as u64) << 32) | (lo as u64)
+}
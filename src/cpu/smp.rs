@@ -0,0 +1,272 @@
+//! Symmetric MultiProcessing (SMP) allows the kernel to run on several CPU cores at the same time.
+//!
+//! Cores are enumerated by ACPI. At boot, only the bootstrap core (BSP) runs. It starts the other
+//! cores, called Application Processors (APs), using the INIT and Start-Up IPIs, which make them
+//! run the trampoline (see `trampoline.s`) that brings them into the kernel.
+//!
+//! Each started core is given an index, from `0` for the bootstrap core to `cores_count() - 1`.
+//! Per-core structures are arrays indexed by this value, given by `get_core_id`.
+
+use core::ffi::c_void;
+use core::ptr;
+use core::sync::atomic::AtomicU32;
+use core::sync::atomic::Ordering;
+use crate::cpu::apic;
+use crate::cpu;
+use crate::errno::Errno;
+use crate::gdt;
+use crate::idt;
+use crate::io;
+use crate::memory::buddy;
+use crate::memory::vmem::tlb;
+use crate::memory::vmem;
+use crate::memory;
+use crate::process::tss;
+
+/// The maximum number of cores supported by the kernel.
+pub const MAX_CORES: usize = 16;
+
+/// The physical address at which the trampoline is copied. This value must match the one in
+/// `trampoline.s`.
+const TRAMPOLINE_PHYS: usize = 0x8000;
+/// The order of the frames allocated for the boot stack of an AP.
+const AP_STACK_ORDER: buddy::FrameOrder = 3;
+/// The maximum time to wait for an AP to start, in microseconds.
+const AP_START_TIMEOUT: u32 = 100000;
+
+extern "C" {
+	static smp_trampoline_begin: u8;
+	static smp_trampoline_params: u8;
+	static smp_trampoline_end: u8;
+}
+
+/// The parameters of the trampoline. The layout must match the one in `trampoline.s`.
+#[repr(C)]
+struct TrampolineParams {
+	/// The value of %cr0.
+	cr0: u32,
+	/// The value of %cr3.
+	cr3: u32,
+	/// The value of %cr4.
+	cr4: u32,
+	/// The top of the stack.
+	stack: u32,
+	/// The address of the function to jump to.
+	entry: u32,
+	/// The index of the core.
+	core: u32,
+}
+
+/// The APIC IDs of the cores reported by ACPI.
+static mut DETECTED: [u8; MAX_CORES] = [0; MAX_CORES];
+/// The number of cores reported by ACPI.
+static mut DETECTED_COUNT: usize = 0;
+
+/// The APIC ID of each started core, by core index.
+static mut APIC_IDS: [u8; MAX_CORES] = [0; MAX_CORES];
+/// The number of started cores.
+static mut CORES_COUNT: usize = 1;
+/// Bitmask of cores that are online.
+static ONLINE: AtomicU32 = AtomicU32::new(1);
+
+/// Registers a core reported by ACPI with the given APIC ID `apic_id`.
+/// If too many cores are registered, the others are ignored.
+pub fn register_core(apic_id: u8) {
+	unsafe { // Safe because called only at boot, by the bootstrap core
+		if DETECTED_COUNT < MAX_CORES {
+			DETECTED[DETECTED_COUNT] = apic_id;
+			DETECTED_COUNT += 1;
+		}
+	}
+}
+
+/// Returns the index of the current core.
+#[inline(always)]
+pub fn get_core_id() -> usize {
+	gdt::get_current_core()
+}
+
+/// Returns the number of started cores.
+pub fn cores_count() -> usize {
+	unsafe { // Safe because only modified at boot
+		CORES_COUNT
+	}
+}
+
+/// Returns the bitmask of online cores.
+pub fn get_online_mask() -> u32 {
+	ONLINE.load(Ordering::Acquire)
+}
+
+/// Tells whether other cores than the current one are online.
+pub fn is_multicore() -> bool {
+	get_online_mask() & !(1 << get_core_id()) != 0
+}
+
+/// Sends the IPI `vector` to the core with index `core`.
+pub fn send_ipi(core: usize, vector: u8) {
+	let apic_id = unsafe { // Safe because only modified at boot
+		APIC_IDS[core]
+	};
+	apic::send_ipi(apic_id, apic::ICR_FIXED, vector);
+}
+
+/// Sends the IPI `vector` to every online cores except the current one.
+pub fn broadcast_ipi(vector: u8) {
+	if is_multicore() {
+		apic::broadcast_ipi(vector);
+	}
+}
+
+/// Waits for approximately `us` microseconds.
+/// Since no timer is available when starting cores, the function relies on the fact that an
+/// access to port `0x80` takes about one microsecond.
+fn udelay(us: u32) {
+	for _ in 0..us {
+		unsafe {
+			io::outb(0x80, 0);
+		}
+	}
+}
+
+/// Returns the trampoline's parameters in memory.
+fn get_trampoline_params() -> *mut TrampolineParams {
+	unsafe {
+		let off = &smp_trampoline_params as *const u8 as usize
+			- &smp_trampoline_begin as *const u8 as usize;
+		memory::kern_to_virt((TRAMPOLINE_PHYS + off) as _) as _
+	}
+}
+
+/// Starts the AP with APIC ID `apic_id`, giving it the index `core`.
+/// The function returns true if the core has started.
+fn start_ap(apic_id: u8, core: usize) -> Result<bool, Errno> {
+	let stack = buddy::alloc_kernel(AP_STACK_ORDER)?;
+	let stack_top = stack as usize + (memory::PAGE_SIZE << AP_STACK_ORDER);
+
+	unsafe {
+		ptr::write_volatile(get_trampoline_params(), TrampolineParams {
+			cr0: cpu::cr0_get(),
+			cr3: cpu::cr3_get() as _,
+			cr4: cpu::cr4_get(),
+			stack: stack_top as _,
+			entry: ap_main as usize as _,
+			core: core as _,
+		});
+	}
+
+	apic::send_ipi(apic_id, apic::ICR_INIT | apic::ICR_ASSERT | apic::ICR_LEVEL, 0);
+	udelay(200);
+	apic::send_ipi(apic_id, apic::ICR_INIT | apic::ICR_LEVEL, 0);
+	udelay(10000);
+
+	let vector = (TRAMPOLINE_PHYS / memory::PAGE_SIZE) as u8;
+	let online = | | get_online_mask() & (1 << core) != 0;
+	for _ in 0..2 {
+		apic::send_ipi(apic_id, apic::ICR_STARTUP, vector);
+		udelay(200);
+		if online() {
+			break;
+		}
+	}
+
+	for _ in 0..(AP_START_TIMEOUT / 100) {
+		if online() {
+			return Ok(true);
+		}
+		udelay(100);
+	}
+
+	buddy::free_kernel(stack, AP_STACK_ORDER);
+	Ok(false)
+}
+
+/// Initializes SMP and starts every cores reported by ACPI.
+/// This function must be called only once, by the bootstrap core, after ACPI initialization.
+pub fn init() -> Result<(), Errno> {
+	let detected = unsafe { // Safe because called only at boot, by the bootstrap core
+		&DETECTED[..DETECTED_COUNT]
+	};
+	if detected.is_empty() {
+		return Ok(());
+	}
+
+	apic::map()?;
+	apic::enable(true);
+	let bsp_id = apic::get_id();
+	unsafe { // Safe because called only at boot, by the bootstrap core
+		APIC_IDS[0] = bsp_id;
+	}
+	tlb::set_current_page_dir(unsafe {
+		cpu::cr3_get()
+	});
+	tlb::init()?;
+
+	// Mapping the trampoline at its physical address, since the AP enables paging while running
+	// it
+	let trampoline_phys = TRAMPOLINE_PHYS as *const c_void;
+	{
+		let mut vmem_guard = crate::get_vmem().lock();
+		let vmem = vmem_guard.get_mut().as_mut().unwrap();
+		vmem.map(trampoline_phys, trampoline_phys, vmem::x86::FLAG_WRITE)?;
+	}
+	unsafe {
+		let begin = &smp_trampoline_begin as *const u8;
+		let len = &smp_trampoline_end as *const u8 as usize - begin as usize;
+		ptr::copy_nonoverlapping(begin, memory::kern_to_virt(trampoline_phys) as _, len);
+	}
+
+	for apic_id in detected.iter().filter(| id | **id != bsp_id) {
+		let core = cores_count();
+		if core >= MAX_CORES {
+			break;
+		}
+
+		unsafe { // Safe because the core is not started yet
+			APIC_IDS[core] = *apic_id;
+		}
+		if start_ap(*apic_id, core)? {
+			unsafe { // Safe because called only at boot, by the bootstrap core
+				CORES_COUNT += 1;
+			}
+		} else {
+			crate::println!("CPU core with APIC ID {} failed to start", apic_id);
+		}
+	}
+
+	let mut vmem_guard = crate::get_vmem().lock();
+	let vmem = vmem_guard.get_mut().as_mut().unwrap();
+	vmem.unmap(trampoline_phys)?;
+
+	Ok(())
+}
+
+/// The entry point of APs, called by the trampoline with the core's index `core`.
+/// Interrupts are disabled and the core uses the kernel's virtual memory context.
+#[no_mangle]
+extern "C" fn ap_main(core: usize) -> ! {
+	unsafe {
+		gdt::init_core(core);
+	}
+	idt::load();
+
+	tss::init();
+	tss::flush();
+	// Allowing the kernel loop to be entered on this stack until a process is run
+	let mut sp: usize;
+	unsafe {
+		core::arch::asm!("mov {}, esp", out(reg) sp);
+	}
+	let tss = tss::get();
+	tss.ss0 = gdt::KERNEL_DS as _;
+	tss.esp0 = sp as _;
+	idt::init_sysenter();
+
+	apic::enable(false);
+	tlb::set_current_page_dir(unsafe {
+		cpu::cr3_get()
+	});
+
+	ONLINE.fetch_or(1 << core, Ordering::Release);
+	crate::enter_loop();
+}
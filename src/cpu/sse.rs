@@ -7,6 +7,13 @@ pub fn is_present() -> bool {
 	}
 }
 
+/// Tells whether the CPU has SSE2.
+pub fn has_sse2() -> bool {
+	unsafe {
+		super::cpuid_has_sse2()
+	}
+}
+
 /// Enables SSE.
 pub fn enable() {
 	unsafe {
@@ -0,0 +1,111 @@
+/*
+ * This file implements the trampoline used to start Application Processors
+ * (APs).
+ *
+ * The code is copied to the physical address `TRAMPOLINE_PHYS` before sending
+ * the Start-Up IPI, which makes the AP begin executing it in real mode. The
+ * trampoline switches to protected mode, enables paging with the same control
+ * registers as the bootstrap core, then jumps to the kernel.
+ *
+ * The parameters at the end of the trampoline are written by the bootstrap
+ * core before starting each AP.
+ */
+
+.global smp_trampoline_begin
+.global smp_trampoline_params
+.global smp_trampoline_end
+
+/*
+ * The physical address at which the trampoline is copied. It must be page
+ * aligned and below 1MB since it is given to the AP as a page number.
+ */
+.set TRAMPOLINE_PHYS,	0x8000
+
+/*
+ * Offsets of the parameters.
+ */
+.set PARAM_CR0,		0
+.set PARAM_CR3,		4
+.set PARAM_CR4,		8
+.set PARAM_STACK,	12
+.set PARAM_ENTRY,	16
+.set PARAM_CORE,	20
+
+/*
+ * Physical addresses of the symbols of the trampoline once copied.
+ */
+.set PHYS_PROTECTED,	(TRAMPOLINE_PHYS + (trampoline_protected - smp_trampoline_begin))
+.set PHYS_GDT,			(TRAMPOLINE_PHYS + (trampoline_gdt - smp_trampoline_begin))
+.set PHYS_PARAMS,		(TRAMPOLINE_PHYS + (smp_trampoline_params - smp_trampoline_begin))
+
+.section .text
+
+.code16
+smp_trampoline_begin:
+	cli
+	cld
+
+	mov %cs, %ax
+	mov %ax, %ds
+
+	lgdtl (trampoline_gdt_desc - smp_trampoline_begin)
+
+	mov %cr0, %eax
+	or $1, %eax
+	mov %eax, %cr0
+
+	ljmpl $0x8, $PHYS_PROTECTED
+
+.code32
+trampoline_protected:
+	mov $0x10, %ax
+	mov %ax, %ds
+	mov %ax, %es
+	mov %ax, %ss
+	xor %ax, %ax
+	mov %ax, %fs
+	mov %ax, %gs
+
+	mov $PHYS_PARAMS, %ebx
+
+	mov PARAM_CR4(%ebx), %eax
+	mov %eax, %cr4
+	mov PARAM_CR3(%ebx), %eax
+	mov %eax, %cr3
+	mov PARAM_CR0(%ebx), %eax
+	mov %eax, %cr0
+
+	mov PARAM_STACK(%ebx), %esp
+	xor %ebp, %ebp
+
+	push PARAM_CORE(%ebx)
+	push $0
+	mov PARAM_ENTRY(%ebx), %eax
+	jmp *%eax
+
+/*
+ * A flat GDT with the same code and data segments as the kernel's GDT, used
+ * until the AP loads its own GDT.
+ */
+.align 8
+trampoline_gdt:
+	.quad 0
+	.quad 0x00cf9a000000ffff
+	.quad 0x00cf92000000ffff
+
+trampoline_gdt_desc:
+	.word trampoline_gdt_desc - trampoline_gdt - 1
+	.long PHYS_GDT
+
+/*
+ * The parameters of the trampoline.
+ */
+.align 4
+smp_trampoline_params:
+	.long 0 # cr0
+	.long 0 # cr3
+	.long 0 # cr4
+	.long 0 # stack
+	.long 0 # entry
+	.long 0 # core
+smp_trampoline_end:
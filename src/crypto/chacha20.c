@@ -3,35 +3,77 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <util/libc/libc.h>
+
+// The size of a ChaCha20 block in bytes.
+#define BLOCK_SIZE	64
+
 /// Constants used in the algorithm's state.
 static const uint32_t CONSTANTS[4] = {
 	0x61707865, 0x3320646e, 0x79622d32, 0x6b206574
 };
 
-// Performs the quarter round operation on `a`, `b`, `c` and `d`.
-static inline void quarter_round(uint32_t *a, uint32_t *b, uint32_t *c,
-	uint32_t *d)
+// The state of a ChaCha20 stream, allowing to encode data in several chunks.
+// This structure is shared with the Rust code and must keep the same layout.
+struct chacha20_ctx
 {
-	*a += *b;
-	*d ^= *a;
-	*d = (*d << 16) | (*d >> (32 - 16));
+	// The key.
+	uint32_t key[8];
+	// The nonces.
+	uint32_t nonce[3];
+	// The counter of the next block to be generated.
+	uint32_t counter;
+	// The last generated block of key stream.
+	uint8_t stream[BLOCK_SIZE];
+	// The offset of the first unused byte in `stream`.
+	uint32_t stream_off;
+};
 
-	*c += *d;
-	*b ^= *c;
-	*b = (*b << 12) | (*b >> (32 - 12));
+// Vector of four 32 bits words, used by the SSE2 variant.
+typedef uint32_t v4u32 __attribute__((vector_size(16)));
+// Same as `v4u32`, but allowing unaligned accesses.
+typedef uint32_t v4u32_u
+	__attribute__((vector_size(16), aligned(1), may_alias));
+// 32 bits word allowing unaligned accesses.
+typedef uint32_t u32_u __attribute__((aligned(1), may_alias));
 
-	*a += *b;
-	*d ^= *a;
-	*d = (*d << 8) | (*d >> (32 - 8));
+// Rotates the 32 bits words in `x` to the left by `n` bits.
+#define ROTL(x, n)	(((x) << (n)) | ((x) >> (32 - (n))))
 
-	*c += *d;
-	*b ^= *c;
-	*b = (*b << 7) | (*b >> (32 - 7));
-}
+// Performs the quarter round operation on `a`, `b`, `c` and `d`.
+// The macro works on both scalars and vectors.
+#define QUARTER_ROUND(a, b, c, d)\
+	do\
+	{\
+		a += b;\
+		d = ROTL(d ^ a, 16);\
+		c += d;\
+		b = ROTL(b ^ c, 12);\
+		a += b;\
+		d = ROTL(d ^ a, 8);\
+		c += d;\
+		b = ROTL(b ^ c, 7);\
+	} while (0)
+
+// Performs the 20 rounds of the algorithm on the state `x`.
+// The macro works on both scalars and vectors.
+#define ROUNDS(x)\
+	for (size_t i = 0; i < 10; ++i)\
+	{\
+		QUARTER_ROUND(x[0], x[4], x[8],  x[12]);\
+		QUARTER_ROUND(x[1], x[5], x[9],  x[13]);\
+		QUARTER_ROUND(x[2], x[6], x[10], x[14]);\
+		QUARTER_ROUND(x[3], x[7], x[11], x[15]);\
+		QUARTER_ROUND(x[0], x[5], x[10], x[15]);\
+		QUARTER_ROUND(x[1], x[6], x[11], x[12]);\
+		QUARTER_ROUND(x[2], x[7], x[8],  x[13]);\
+		QUARTER_ROUND(x[3], x[4], x[9],  x[14]);\
+	}
 
-// Generates a ChaCha20 block.
-// TODO doc
-static void get_block(uint32_t *k, uint32_t b, uint32_t *n, uint32_t *out)
+// Generates the ChaCha20 block with key `k`, counter `b` and nonces `n`, and
+// writes it into `out`.
+static void get_block(const uint32_t *k, uint32_t b, const uint32_t *n,
+	uint32_t *out)
 {
 	const uint32_t init_s[16] = {
 		CONSTANTS[0], CONSTANTS[1], CONSTANTS[2], CONSTANTS[3],
@@ -42,48 +84,139 @@ static void get_block(uint32_t *k, uint32_t b, uint32_t *n, uint32_t *out)
 
 	for (size_t i = 0; i < 16; ++i)
 		out[i] = init_s[i];
-	for (size_t i = 0; i < 10; ++i)
-	{
-		quarter_round(&out[0], &out[4], &out[8],  &out[12]);
-		quarter_round(&out[1], &out[5], &out[9],  &out[13]);
-		quarter_round(&out[2], &out[6], &out[10], &out[14]);
-		quarter_round(&out[3], &out[7], &out[11], &out[15]);
-		quarter_round(&out[0], &out[5], &out[10], &out[15]);
-		quarter_round(&out[1], &out[6], &out[11], &out[12]);
-		quarter_round(&out[2], &out[7], &out[8],  &out[13]);
-		quarter_round(&out[3], &out[4], &out[9],  &out[14]);
-	}
+	ROUNDS(out);
 	for (size_t i = 0; i < 16; ++i)
 		out[i] += init_s[i];
 }
 
-// Encodes the given data in `buff` using ChaCha20, with the given key `k` and
-// the given nonces `n`.
-// `len` is the length of the buffer in bytes.
-// `k` and `n` must have 8 and 3 elements respectively.
-// It is important that nonces are not repeated for the same key.
-// `out` is the buffer which will contain the result. Its length must be
-// `ceil(len / 64) * 64`.
-void chacha20_encode(uint8_t *buff, size_t len, uint32_t *k, uint32_t *n,
-	uint8_t *out)
+// Writes the 16 bytes of key stream `ks` at `out`, XORed with the data at `in`.
+// If `in` is NULL, the key stream is written as is.
+SSE2_FN
+static inline void store16(const uint8_t *in, uint8_t *out, v4u32 ks)
+{
+	if (in)
+		ks ^= *((const v4u32_u *) in);
+	*((v4u32_u *) out) = ks;
+}
+
+// Encodes `count` groups of four consecutive blocks from `in` into `out`
+// using SSE2 registers, starting at the counter of the context `ctx`.
+// If `in` is NULL, the key stream is written as is.
+//
+// Each vector holds the same word of the state for four blocks, so that the
+// four blocks are computed at once. The words are then transposed back to be
+// stored in order.
+//
+// The stack is realigned on entry since spilled vectors require 16 bytes
+// alignment, which the callers don't guarantee.
+SSE2_FN __attribute__((force_align_arg_pointer))
+static void blocks4_sse2(struct chacha20_ctx *ctx, const uint8_t *in,
+	uint8_t *out, size_t count)
 {
-	for (size_t i = 0; i < len / 64; ++i)
+	const uint32_t *k = ctx->key;
+	const uint32_t *n = ctx->nonce;
+	const uint32_t c = ctx->counter;
+	v4u32 s[16] = {
+		{ CONSTANTS[0], CONSTANTS[0], CONSTANTS[0], CONSTANTS[0] },
+		{ CONSTANTS[1], CONSTANTS[1], CONSTANTS[1], CONSTANTS[1] },
+		{ CONSTANTS[2], CONSTANTS[2], CONSTANTS[2], CONSTANTS[2] },
+		{ CONSTANTS[3], CONSTANTS[3], CONSTANTS[3], CONSTANTS[3] },
+		{ k[0], k[0], k[0], k[0] }, { k[1], k[1], k[1], k[1] },
+		{ k[2], k[2], k[2], k[2] }, { k[3], k[3], k[3], k[3] },
+		{ k[4], k[4], k[4], k[4] }, { k[5], k[5], k[5], k[5] },
+		{ k[6], k[6], k[6], k[6] }, { k[7], k[7], k[7], k[7] },
+		{ c, c + 1, c + 2, c + 3 },
+		{ n[0], n[0], n[0], n[0] }, { n[1], n[1], n[1], n[1] },
+		{ n[2], n[2], n[2], n[2] }
+	};
+	v4u32 x[16];
+	v4u32 t0, t1, t2, t3;
+
+	for (; count > 0; --count)
 	{
-		uint8_t key_stream[64];
-		get_block(k, i, n, (uint32_t *) &key_stream);
+		for (size_t i = 0; i < 16; ++i)
+			x[i] = s[i];
+		ROUNDS(x);
+		for (size_t i = 0; i < 16; ++i)
+			x[i] += s[i];
 
-		for (size_t j = 0; j < 64; ++j)
-			out[i * 64 + j] = buff[i * 64 + j] ^ key_stream[j];
+		for (size_t i = 0; i < 16; i += 4)
+		{
+			t0 = __builtin_shuffle(x[i], x[i + 1], (v4u32) { 0, 4, 1, 5 });
+			t1 = __builtin_shuffle(x[i], x[i + 1], (v4u32) { 2, 6, 3, 7 });
+			t2 = __builtin_shuffle(x[i + 2], x[i + 3], (v4u32) { 0, 4, 1, 5 });
+			t3 = __builtin_shuffle(x[i + 2], x[i + 3], (v4u32) { 2, 6, 3, 7 });
+			store16(in ? in + i * 4 : NULL, out + i * 4,
+				__builtin_shuffle(t0, t2, (v4u32) { 0, 1, 4, 5 }));
+			store16(in ? in + BLOCK_SIZE + i * 4 : NULL,
+				out + BLOCK_SIZE + i * 4,
+				__builtin_shuffle(t0, t2, (v4u32) { 2, 3, 6, 7 }));
+			store16(in ? in + 2 * BLOCK_SIZE + i * 4 : NULL,
+				out + 2 * BLOCK_SIZE + i * 4,
+				__builtin_shuffle(t1, t3, (v4u32) { 0, 1, 4, 5 }));
+			store16(in ? in + 3 * BLOCK_SIZE + i * 4 : NULL,
+				out + 3 * BLOCK_SIZE + i * 4,
+				__builtin_shuffle(t1, t3, (v4u32) { 2, 3, 6, 7 }));
+		}
+
+		s[12] += (v4u32) { 4, 4, 4, 4 };
+		if (in)
+			in += 4 * BLOCK_SIZE;
+		out += 4 * BLOCK_SIZE;
 	}
+	ctx->counter = s[12][0];
+}
+
+// Encodes one block from `in` into `out` one word at a time, using the
+// counter of the context `ctx`.
+// If `in` is NULL, the key stream is written as is.
+static void block_word(struct chacha20_ctx *ctx, const uint8_t *in,
+	uint8_t *out)
+{
+	uint32_t ks[16];
 
-	if (len % 64 != 0)
+	get_block(ctx->key, ctx->counter++, ctx->nonce, ks);
+	for (size_t i = 0; i < 16; ++i)
 	{
-		const size_t i = len / 64;
+		if (in)
+			ks[i] ^= ((const u32_u *) in)[i];
+		((u32_u *) out)[i] = ks[i];
+	}
+}
 
-		uint8_t key_stream[64];
-		get_block(k, i, n, (uint32_t *) &key_stream);
+// Encodes the `len` bytes of data in `in` using the stream `ctx`, and writes
+// the result into `out`, which must be at least `len` bytes long. `in` and
+// `out` may be the same buffer.
+// If `in` is NULL, the key stream is written as is.
+//
+// The stream continues where the previous call stopped, so that encoding data
+// in several chunks gives the same result as encoding it at once.
+void chacha20_stream(struct chacha20_ctx *ctx, const uint8_t *in, size_t len,
+	uint8_t *out)
+{
+	size_t i = 0;
+	size_t groups;
 
-		for (size_t j = 0; j < (len - (i * 64)); ++j)
-			out[i * 64 + j] = buff[i * 64 + j] ^ key_stream[j];
+	// Using the remaining key stream from the previous call
+	for (; i < len && ctx->stream_off < BLOCK_SIZE; ++i)
+		out[i] = (in ? in[i] : 0) ^ ctx->stream[ctx->stream_off++];
+
+	if (libc_features & LIBC_FEATURE_SSE2)
+	{
+		groups = (len - i) / (4 * BLOCK_SIZE);
+		if (groups > 0)
+			blocks4_sse2(ctx, in ? in + i : NULL, out + i, groups);
+		i += groups * 4 * BLOCK_SIZE;
+	}
+	for (; i + BLOCK_SIZE <= len; i += BLOCK_SIZE)
+		block_word(ctx, in ? in + i : NULL, out + i);
+
+	// Keeping the rest of the last block for the next call
+	if (i < len)
+	{
+		block_word(ctx, NULL, ctx->stream);
+		ctx->stream_off = 0;
+		for (; i < len; ++i)
+			out[i] = (in ? in[i] : 0) ^ ctx->stream[ctx->stream_off++];
 	}
 }
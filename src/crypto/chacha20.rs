@@ -1,32 +1,135 @@
 //! Implementation of the ChaCha20 algorithm according to RFC 8439.
 
+use core::ptr::null;
+
+/// The size of a ChaCha20 block in bytes.
+const BLOCK_SIZE: usize = 64;
+
 extern "C" {
-	fn chacha20_encode(buff: *const u8, len: usize, k: *const u32, n: *const u32, out: *mut u8);
+	fn chacha20_stream(ctx: *mut ChaCha20, buff: *const u8, len: usize, out: *mut u8);
+}
+
+/// A ChaCha20 stream, allowing to encode data in several chunks without reallocating.
+///
+/// Encoding data in several chunks gives the same result as encoding it at once.
+///
+/// The structure is shared with the C code, which implements the algorithm.
+#[repr(C)]
+pub struct ChaCha20 {
+	/// The key.
+	key: [u32; 8],
+	/// The nonces.
+	nonce: [u32; 3],
+	/// The counter of the next block to be generated.
+	counter: u32,
+	/// The last generated block of key stream.
+	stream: [u8; BLOCK_SIZE],
+	/// The offset of the first unused byte in `stream`.
+	stream_off: u32,
+}
+
+impl ChaCha20 {
+	/// Creates a new stream with the given key `k`, the given nonces `n` and the counter of the
+	/// first block `counter`.
+	/// It is important that nonces are not repeated for the same key.
+	pub fn new(k: &[u32; 8], n: &[u32; 3], counter: u32) -> Self {
+		Self {
+			key: *k,
+			nonce: *n,
+			counter,
+
+			stream: [0; BLOCK_SIZE],
+			stream_off: BLOCK_SIZE as _,
+		}
+	}
+
+	/// Encodes the data in `buff` and writes the result into `out`.
+	/// If `out` is smaller than `buff`, the function panics.
+	pub fn encode(&mut self, buff: &[u8], out: &mut [u8]) {
+		assert!(out.len() >= buff.len());
+
+		unsafe {
+			chacha20_stream(self, buff.as_ptr(), buff.len(), out.as_mut_ptr());
+		}
+	}
+
+	/// Encodes the data in `buff` in place.
+	pub fn encode_in_place(&mut self, buff: &mut [u8]) {
+		unsafe {
+			chacha20_stream(self, buff.as_ptr(), buff.len(), buff.as_mut_ptr());
+		}
+	}
+
+	/// Fills `out` with the next bytes of the key stream.
+	pub fn keystream(&mut self, out: &mut [u8]) {
+		unsafe {
+			chacha20_stream(self, null(), out.len(), out.as_mut_ptr());
+		}
+	}
 }
 
 /// Encodes the given data in `buff` using ChaCha20, with the given key `k` and the given nonces
 /// `n`.
 /// It is important that nonces are not repeated for the same key.
-/// `out` is the buffer which will contain the result. Its length must be
-/// `ceil(buff.len() / 64) * 64`.
+/// `out` is the buffer which will contain the result. Its length must be at least `buff.len()`.
 pub fn encode(buff: &[u8], k: &[u32; 8], n: &[u32; 3], out: &mut [u8]) {
-	unsafe {
-		chacha20_encode(buff.as_ptr(), buff.len(), k.as_ptr(), n.as_ptr(), out.as_mut_ptr());
-	}
+	ChaCha20::new(k, n, 0).encode(buff, out);
 }
 
-// TODO Use with C code
-/*#[cfg(test)]
+#[cfg(test)]
 mod test {
 	use super::*;
 
+	/// Returns the key and nonces of the test vectors of RFC 8439.
+	fn rfc_params() -> ([u32; 8], [u32; 3]) {
+		let mut key = [0; 8];
+		for (i, k) in key.iter_mut().enumerate() {
+			let b = (i * 4) as u32;
+			*k = b | ((b + 1) << 8) | ((b + 2) << 16) | ((b + 3) << 24);
+		}
+
+		(key, [0, 0x4a000000, 0])
+	}
+
 	#[test_case]
-	fn quarter_round0() {
-		let (a, b, c, d) = quarter_round(0x11111111, 0x01020304, 0x9b8d6f43, 0x01234567);
+	fn chacha20_rfc8439() {
+		let (key, nonce) = rfc_params();
+		let plaintext = b"Ladies and Gentlemen of the class of '99: If I could offer you only one \
+tip for the future, sunscreen would be it.";
+		let expected: [u8; 114] = [
+			0x6e, 0x2e, 0x35, 0x9a, 0x25, 0x68, 0xf9, 0x80, 0x41, 0xba, 0x07, 0x28, 0xdd, 0x0d,
+			0x69, 0x81, 0xe9, 0x7e, 0x7a, 0xec, 0x1d, 0x43, 0x60, 0xc2, 0x0a, 0x27, 0xaf, 0xcc,
+			0xfd, 0x9f, 0xae, 0x0b, 0xf9, 0x1b, 0x65, 0xc5, 0x52, 0x47, 0x33, 0xab, 0x8f, 0x59,
+			0x3d, 0xab, 0xcd, 0x62, 0xb3, 0x57, 0x16, 0x39, 0xd6, 0x24, 0xe6, 0x51, 0x52, 0xab,
+			0x8f, 0x53, 0x0c, 0x35, 0x9f, 0x08, 0x61, 0xd8, 0x07, 0xca, 0x0d, 0xbf, 0x50, 0x0d,
+			0x6a, 0x61, 0x56, 0xa3, 0x8e, 0x08, 0x8a, 0x22, 0xb6, 0x5e, 0x52, 0xbc, 0x51, 0x4d,
+			0x16, 0xcc, 0xf8, 0x06, 0x81, 0x8c, 0xe9, 0x1a, 0xb7, 0x79, 0x37, 0x36, 0x5a, 0xf9,
+			0x0b, 0xbf, 0x74, 0xa3, 0x5b, 0xe6, 0xb4, 0x0b, 0x8e, 0xed, 0xf2, 0x78, 0x5e, 0x42,
+			0x87, 0x4d,
+		];
 
-		assert_eq!(a, 0xea2a92f4);
-		assert_eq!(b, 0xcb1cf8ce);
-		assert_eq!(c, 0x4581472e);
-		assert_eq!(d, 0x5881c4bb);
+		let mut out = [0; 114];
+		ChaCha20::new(&key, &nonce, 1).encode(plaintext, &mut out);
+		assert_eq!(out, expected);
 	}
-}*/
+
+	#[test_case]
+	fn chacha20_chunks() {
+		let (key, nonce) = rfc_params();
+
+		// Key stream generated at once, using the 4-way variant when available
+		let mut expected = [0; 1024];
+		ChaCha20::new(&key, &nonce, 0).keystream(&mut expected);
+
+		for chunk in [1, 7, 64, 100, 256, 300] {
+			let mut stream = ChaCha20::new(&key, &nonce, 0);
+			let mut out = [0; 1024];
+			for c in out.chunks_mut(chunk) {
+				c.fill(0);
+				stream.encode_in_place(c);
+			}
+
+			assert_eq!(out, expected);
+		}
+	}
+}
@@ -1,55 +1,402 @@
 //! This module implements randomness functions.
+//!
+//! Entropy is collected from the timing of external interrupts (keyboard, PIT, disks) into the
+//! entropy buffer. The entropy is then used to seed a Cryptographically Secure PseudoRandom Number
+//! Generator (CSPRNG) based on ChaCha20, which produces random bytes without allocating memory.
+//!
+//! The timing of an interrupt is only partially unpredictable. Thus, each interrupt is credited
+//! with a fraction of a bit of entropy, and the bytes of the buffer are folded together into the
+//! key of a generator once enough entropy has been credited.
+//!
+//! Data written by userspace is mixed into the buffer without being credited, since its content
+//! may be known by an attacker.
 
-use crate::crypto::chacha20;
-use crate::memory::malloc;
+use core::cmp::min;
+use crate::cpu::smp;
+use crate::cpu;
+use crate::crypto::chacha20::ChaCha20;
+use crate::errno::Errno;
+use crate::process::wait_queue::WaitQueue;
+use crate::util::lock::IntMutex;
+
+/// The maximum number of bytes produced for a single request.
+pub const MAX_REQUEST_SIZE: usize = 32 * 1024 * 1024;
+/// The maximum number of bytes produced for a single request on the random source.
+pub const RANDOM_MAX_REQUEST_SIZE: usize = 256;
 
 /// The size of the entropy buffer in bytes.
 const ENTROPY_BUFFER_SIZE: usize = 32768;
+/// The number of credit units in a bit of entropy.
+const CREDIT_PER_BIT: usize = 64;
+/// The entropy credited for each interrupt, in credit units. This is 1/16 of a bit.
+const INTERRUPT_CREDIT: usize = CREDIT_PER_BIT / 16;
+
+/// The size of the key stream buffer of a CSPRNG in bytes. This is a multiple of the size of four
+/// ChaCha20 blocks so that refilling the buffer uses the 4-way variant.
+const KEYSTREAM_BUFFER_SIZE: usize = 512;
+/// The size of a ChaCha20 key in bytes.
+const KEY_SIZE: usize = 32;
+/// The nonce used to refill the key stream buffer of a CSPRNG. Since the key changes each time a
+/// stream is used, nonces can remain the same.
+const REFILL_NONCE: u32 = 0;
+/// The nonce used to write large requests directly with the key stream.
+const DIRECT_NONCE: u32 = 1;
+/// The number of bytes a CSPRNG produces before taking new entropy from the entropy buffer.
+const RESEED_INTERVAL: usize = 65536;
+/// The number of bytes produced while the CSPRNG of a core is locked. Since interrupts are
+/// disabled meanwhile, large requests are produced by chunks.
+pub const CHUNK_SIZE: usize = 4096;
+
+/// Buffer storing input bytes for random number generators.
+struct EntropyBuffer {
+	/// The buffer.
+	buff: [u8; ENTROPY_BUFFER_SIZE],
+	/// The offset of the first available byte in the buffer.
+	start: usize,
+	/// The number of available bytes in the buffer.
+	len: usize,
+	/// When the buffer is full, the offset from `start` of the next byte into which new data is
+	/// mixed.
+	mix: usize,
+	/// The entropy contained in the available bytes, in credit units.
+	credit: usize,
+}
+
+/// The entropy buffer, storing input bytes for random number generators.
+static ENTROPY_BUFFER: IntMutex<EntropyBuffer> = IntMutex::new(EntropyBuffer {
+	buff: [0; ENTROPY_BUFFER_SIZE],
+	start: 0,
+	len: 0,
+	mix: 0,
+	credit: 0,
+});
+
+/// The queue of processes waiting for enough entropy to seed their generator.
+static ENTROPY_QUEUE: WaitQueue = WaitQueue::new();
+
+/// Returns the credit required to fill `len` bytes with entropy.
+fn credit_for(len: usize) -> usize {
+	len * 8 * CREDIT_PER_BIT
+}
+
+/// Feeds data `data` to the random number generators, crediting `credit` units of entropy.
+/// If the entropy buffer is full, the data is mixed into the available bytes.
+fn feed(data: &[u8], credit: usize) {
+	let ready = {
+		let mut guard = ENTROPY_BUFFER.lock();
+		let entropy = guard.get_mut();
 
-// /// The entropy buffer, storing input bytes for random number generators.
-// TODO static ENTROPY_BUFFER: IMutex<> = IMutex::new();
+		for b in data {
+			if entropy.len < ENTROPY_BUFFER_SIZE {
+				let i = (entropy.start + entropy.len) % ENTROPY_BUFFER_SIZE;
+				entropy.buff[i] = *b;
+				entropy.len += 1;
+			} else {
+				let i = (entropy.start + entropy.mix) % ENTROPY_BUFFER_SIZE;
+				entropy.buff[i] ^= *b;
+				entropy.mix = (entropy.mix + 1) % ENTROPY_BUFFER_SIZE;
+			}
+		}
 
-/// Feeds data `data` to the random number generators.
-/// If the entropy buffer is already full, the data is ignored.
-pub fn feed_entropy(_data: &[u8]) {
-	// TODO
-	todo!();
+		// The bytes cannot contain more entropy than their size
+		let was_ready = entropy.credit >= credit_for(KEY_SIZE);
+		entropy.credit = min(entropy.credit + credit, credit_for(entropy.len));
+		!was_ready && entropy.credit >= credit_for(KEY_SIZE)
+	};
+
+	if ready {
+		ENTROPY_QUEUE.wake_all();
+	}
 }
 
-/// Consomes entropy from the buffer to fill the given `buf`.
-/// If the size of `buf` exceeds the size of the entropy buffer, the function returns None.
-pub fn consume_entropy(_buf: &mut [u8]) -> Option<()> {
-	// TODO
-	todo!();
+/// Feeds data `data`, provided by userspace, to the random number generators. The data is mixed
+/// into the entropy buffer but no entropy is credited for it.
+pub fn feed_entropy(data: &[u8]) {
+	feed(data, 0);
+}
+
+/// Feeds the timing of the interrupt `id` to the random number generators.
+/// This function is meant to be called on interrupts triggered by external events, since their
+/// timing is hard to predict.
+pub fn feed_interrupt(id: u32) {
+	// The low bits of the timestamp are the least predictable
+	let timestamp = (cpu::rdtsc() as u32) ^ (id << 24);
+	feed(&timestamp.to_ne_bytes(), INTERRUPT_CREDIT);
+}
+
+/// Tells whether enough entropy has been credited to fill `len` bytes.
+fn has_entropy(len: usize) -> bool {
+	ENTROPY_BUFFER.lock().get().credit >= credit_for(len)
+}
+
+/// Consumes the bytes of the entropy buffer, folding them into the given `buf`.
+/// If `insecure` is false and not enough entropy has been credited to fill `buf`, the buffer is
+/// left untouched.
+/// The function returns true if enough entropy has been credited to fill `buf`.
+pub fn consume_entropy(buf: &mut [u8], insecure: bool) -> bool {
+	let mut guard = ENTROPY_BUFFER.lock();
+	let entropy = guard.get_mut();
+
+	let enough = entropy.credit >= credit_for(buf.len());
+	if buf.is_empty() || (!enough && !insecure) {
+		return enough;
+	}
+
+	for i in 0..entropy.len {
+		buf[i % buf.len()] ^= entropy.buff[entropy.start];
+		entropy.start = (entropy.start + 1) % ENTROPY_BUFFER_SIZE;
+	}
+	entropy.len = 0;
+	entropy.mix = 0;
+	entropy.credit = 0;
+	enough
 }
 
 /// Trait representing a PseudoRandom Number Generator.
 pub trait PRNG {
 	/// Fills the given buffer `buf` with random bytes.
 	/// If not enough entropy is available at the moment, the function may return None.
-	fn rand(buf: &mut [u8]) -> Option<()>;
+	fn rand(&mut self, buf: &mut [u8]) -> Option<()>;
 }
 
 /// Random bytes generator using ChaCha20.
-struct ChaCha20Rand {}
+///
+/// The generator uses fast key erasure: each time the key stream buffer is refilled, its first
+/// bytes are used as the next key and erased, so that previous outputs cannot be recovered from
+/// the state of the generator.
+struct ChaCha20Rand {
+	/// The current key.
+	key: [u8; KEY_SIZE],
+	/// Tells whether the generator has been seeded with enough entropy.
+	seeded: bool,
 
-impl PRNG for ChaCha20Rand {
-	fn rand(buf: &mut [u8]) -> Option<()> {
-		let mut b = malloc::Alloc::<u8>::new_default(buf.len()).ok()?;
-		consume_entropy(b.as_slice_mut())?;
+	/// Buffer of key stream bytes.
+	buff: [u8; KEYSTREAM_BUFFER_SIZE],
+	/// The offset of the first unused byte in `buff`.
+	off: usize,
+
+	/// The number of bytes produced since the last reseed.
+	produced: usize,
+}
+
+impl ChaCha20Rand {
+	/// Creates a new generator, which is not seeded.
+	const fn new() -> Self {
+		Self {
+			key: [0; KEY_SIZE],
+			seeded: false,
+
+			buff: [0; KEYSTREAM_BUFFER_SIZE],
+			off: KEYSTREAM_BUFFER_SIZE,
+
+			produced: 0,
+		}
+	}
+
+	/// Returns a ChaCha20 stream using the current key and the given nonce `nonce`.
+	fn stream(&self, nonce: u32) -> ChaCha20 {
+		let mut key = [0; 8];
+		for (k, b) in key.iter_mut().zip(self.key.chunks(4)) {
+			*k = u32::from_ne_bytes([b[0], b[1], b[2], b[3]]);
+		}
+
+		ChaCha20::new(&key, &[nonce, 0, 0], 0)
+	}
+
+	/// Mixes new entropy into the key.
+	/// If `insecure` is true, the function mixes whatever entropy is available. Otherwise, it
+	/// requires an entire key of entropy.
+	/// The function returns true if enough entropy has been mixed to consider the generator
+	/// seeded.
+	fn reseed(&mut self, insecure: bool) -> bool {
+		let mut entropy = [0; KEY_SIZE];
+		let enough = consume_entropy(&mut entropy, insecure);
+		if !enough && !insecure {
+			return false;
+		}
+
+		if !enough {
+			// Adding the current time to have different outputs on each boot
+			let timestamp = cpu::rdtsc().to_ne_bytes();
+			for (e, t) in entropy.iter_mut().zip(timestamp) {
+				*e ^= t;
+			}
+		}
+
+		for (k, e) in self.key.iter_mut().zip(entropy) {
+			*k ^= e;
+		}
+		self.off = KEYSTREAM_BUFFER_SIZE;
+		self.produced = 0;
+
+		enough
+	}
 
-		let key: [u32; 8] = [0; 8]; // TODO Fill with entropy buffer
-		let nonces: [u32; 3] = [0; 3]; // TODO Fill with entropy buffer
-		// TODO On fail, feed the entropy back to the buffer to avoid waste
+	/// Refills the key stream buffer and changes the key.
+	fn refill(&mut self) {
+		self.stream(REFILL_NONCE).keystream(&mut self.buff);
+		self.key.copy_from_slice(&self.buff[..KEY_SIZE]);
+		self.buff[..KEY_SIZE].fill(0);
+		self.off = KEY_SIZE;
+	}
+
+	/// Fills the given buffer `buf` with random bytes.
+	/// If `insecure` is true, the bytes are produced even if the generator hasn't been seeded with
+	/// enough entropy yet.
+	/// If the generator cannot produce bytes, the function returns None.
+	fn fill(&mut self, buf: &mut [u8], insecure: bool) -> Option<()> {
+		if !self.seeded || self.produced >= RESEED_INTERVAL {
+			// Failing to reseed an already seeded generator is not an issue
+			self.seeded = self.reseed(insecure || self.seeded) || self.seeded;
+		}
+		if !self.seeded && !insecure {
+			return None;
+		}
+
+		if buf.len() > KEYSTREAM_BUFFER_SIZE {
+			// Large requests are directly written with the key stream. A different nonce is used
+			// so that the output doesn't contain the next key
+			self.stream(DIRECT_NONCE).keystream(buf);
+			self.refill();
+		} else {
+			let mut i = 0;
+			while i < buf.len() {
+				if self.off >= KEYSTREAM_BUFFER_SIZE {
+					self.refill();
+				}
+
+				let len = min(buf.len() - i, KEYSTREAM_BUFFER_SIZE - self.off);
+				let src = &mut self.buff[self.off..(self.off + len)];
+				buf[i..(i + len)].copy_from_slice(src);
+				// Erasing used bytes
+				src.fill(0);
 
-		chacha20::encode(b.as_slice(), &key, &nonces, buf);
+				self.off += len;
+				i += len;
+			}
+		}
+
+		self.produced += buf.len();
 		Some(())
 	}
 }
 
+impl PRNG for ChaCha20Rand {
+	fn rand(&mut self, buf: &mut [u8]) -> Option<()> {
+		self.fill(buf, false)
+	}
+}
+
+/// The CSPRNG of each CPU core, by core index. The entropy buffer's lock is taken only to reseed
+/// them.
+static CPU_RAND: [IntMutex<ChaCha20Rand>; smp::MAX_CORES] = {
+	const INIT: IntMutex<ChaCha20Rand> = IntMutex::new(ChaCha20Rand::new());
+	[INIT; smp::MAX_CORES]
+};
+
 /// Fills the given buffer `buf` with random bytes using from the preferred source.
 /// If not enough entropy is available at the moment, the function returns None.
-pub fn rand(_buf: &mut [u8]) -> Option<()> {
-	// TODO
-	None
+pub fn rand(buf: &mut [u8]) -> Option<()> {
+	for chunk in buf.chunks_mut(CHUNK_SIZE) {
+		CPU_RAND[smp::get_core_id()].lock().get_mut().rand(chunk)?;
+	}
+	Some(())
+}
+
+/// Tells whether `rand` can produce bytes on the current core.
+pub fn is_ready() -> bool {
+	CPU_RAND[smp::get_core_id()].lock().get().seeded || has_entropy(KEY_SIZE)
+}
+
+/// Makes the current process sleep until `rand` can produce bytes.
+/// If a signal is pending, the function returns EINTR.
+pub fn wait_ready() -> Result<(), Errno> {
+	ENTROPY_QUEUE.wait_until_interruptible(is_ready, None)?;
+	Ok(())
+}
+
+/// Same as `rand`, except the function produces random bytes even if not enough entropy has been
+/// collected yet. In this case, the output might not have a sufficient quality.
+pub fn rand_insecure(buf: &mut [u8]) {
+	for chunk in buf.chunks_mut(CHUNK_SIZE) {
+		CPU_RAND[smp::get_core_id()].lock().get_mut().fill(chunk, true);
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+	use crate::idt;
+
+	#[test_case]
+	fn rand_differs() {
+		let mut b0 = [0u8; 64];
+		let mut b1 = [0u8; 64];
+		rand_insecure(&mut b0);
+		rand_insecure(&mut b1);
+
+		assert_ne!(b0, [0; 64]);
+		assert_ne!(b0, b1);
+	}
+
+	#[test_case]
+	fn rand_interrupt_credit0() {
+		// Real interrupts would feed the buffer too
+		idt::wrap_disable_interrupts(|| {
+			// Emptying the buffer
+			let mut key = [0; KEY_SIZE];
+			consume_entropy(&mut key, true);
+
+			// A single interrupt is not enough to seed a generator
+			feed_interrupt(0x21);
+			assert!(!has_entropy(1));
+			assert!(!consume_entropy(&mut key, false));
+
+			for _ in 0..(credit_for(KEY_SIZE) / INTERRUPT_CREDIT - 1) {
+				feed_interrupt(0x21);
+			}
+			assert!(!has_entropy(KEY_SIZE));
+			feed_interrupt(0x21);
+			assert!(has_entropy(KEY_SIZE));
+			assert!(consume_entropy(&mut key, false));
+			assert!(!has_entropy(1));
+		});
+	}
+
+	#[test_case]
+	fn rand_user_credit0() {
+		idt::wrap_disable_interrupts(|| {
+			let mut key = [0; KEY_SIZE];
+			consume_entropy(&mut key, true);
+
+			// Known data written by userspace must not seed a generator, even if it fills the
+			// buffer
+			let data = [0x42; 4096];
+			for _ in 0..(ENTROPY_BUFFER_SIZE / data.len() + 1) {
+				feed_entropy(&data);
+			}
+			assert!(!has_entropy(1));
+
+			// Interrupts are still mixed into the full buffer and credited
+			let mix = ENTROPY_BUFFER.lock().get().mix;
+			feed_interrupt(0x21);
+			{
+				let guard = ENTROPY_BUFFER.lock();
+				assert_eq!(guard.get().mix, mix + 4);
+				assert_eq!(guard.get().credit, INTERRUPT_CREDIT);
+			}
+
+			consume_entropy(&mut key, true);
+		});
+	}
+
+	#[test_case]
+	fn rand_large() {
+		let mut b0 = [0u8; 1024];
+		let mut b1 = [0u8; 1024];
+		rand_insecure(&mut b0);
+		rand_insecure(&mut b1);
+
+		assert_ne!(b0, b1);
+	}
 }
@@ -14,6 +14,8 @@ pub struct BAR {
 	type_: u8,
 	/// Tells whether the memory is prefetchable.
 	prefetchable: bool,
+	/// Tells whether the BAR is in I/O space instead of memory space.
+	io: bool,
 }
 
 impl BAR {
@@ -48,6 +50,7 @@ impl BAR {
 
 				type_,
 				prefetchable: value & 0b1000 != 0,
+				io: false,
 			})
 		} else {
 			Some(Self {
@@ -56,6 +59,7 @@ impl BAR {
 
 				type_: 0,
 				prefetchable: false,
+				io: true,
 			})
 		}
 	}
@@ -83,4 +87,10 @@ impl BAR {
 	pub fn is_prefetchable(&self) -> bool {
 		self.prefetchable
 	}
+
+	/// Tells whether the BAR is in I/O space. If so, the address is a port.
+	#[inline(always)]
+	pub fn is_io(&self) -> bool {
+		self.io
+	}
 }
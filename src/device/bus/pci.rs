@@ -24,6 +24,9 @@ const CONFIG_ADDRESS_PORT: u16 = 0xcf8;
 /// The port used to retrieve the devices informations.
 const CONFIG_DATA_PORT: u16 = 0xcfc;
 
+/// Command register flag: the device can initiate DMA transfers.
+const COMMAND_BUS_MASTER: u16 = 0b100;
+
 /// Device class: Unclassified
 pub const CLASS_UNCLASSIFIED: u16 = 0x00;
 /// Device class: Mass Storage Controller
@@ -253,6 +256,21 @@ impl PhysicalDevice for PCIDevice {
 	fn get_bar(&self, n: u8) -> Option<BAR> {
 		BAR::from_pci(self, n)
 	}
+
+	fn get_interrupt_line(&self) -> Option<u8> {
+		let n = (self.info[11] & 0xff) as u8;
+
+		if n != 0xff {
+			Some(n)
+		} else {
+			None
+		}
+	}
+
+	fn enable_bus_master(&self) {
+		let command = self.command | COMMAND_BUS_MASTER;
+		write_word(self.bus, self.device, self.function, 0x04, command);
+	}
 }
 
 /// Reads 16 bits from the PCI register specified by `bus`, `device`, `func` and `off`.
@@ -270,6 +288,22 @@ fn read_word(bus: u8, device: u8, func: u8, off: u8) -> u16 {
 	((val >> ((off & 2) * 8)) & 0xffff) as _
 }
 
+/// Writes the 16 bits value `val` to the PCI register specified by `bus`, `device`, `func` and
+/// `off`.
+fn write_word(bus: u8, device: u8, func: u8, off: u8, val: u16) {
+	// The PCI address
+	let addr = ((bus as u32) << 16) | ((device as u32) << 11) | ((func as u32) << 8)
+		| ((off as u32) & 0xfc) | 0x80000000;
+	let shift = (off & 2) * 8;
+
+	unsafe {
+		io::outl(CONFIG_ADDRESS_PORT, addr);
+		let old = io::inl(CONFIG_DATA_PORT);
+		let new = (old & !(0xffff << shift)) | ((val as u32) << shift);
+		io::outl(CONFIG_DATA_PORT, new);
+	}
+}
+
 /// Reads a device's data and writes it into `data`.
 fn read_data(bus: u8, device: u8, func: u8, data: &mut [u32; 16]) {
 	for (i, d) in data.iter_mut().enumerate() {
@@ -3,7 +3,7 @@
 use core::cmp::min;
 use core::ffi::c_void;
 use core::mem::ManuallyDrop;
-use crate::crypto::rand::rand;
+use crate::crypto::rand;
 use crate::device::Device;
 use crate::device::DeviceHandle;
 use crate::device::tty::TTYDeviceHandle;
@@ -128,16 +128,17 @@ impl IO for RandomDeviceHandle {
 	}
 
 	fn read(&mut self, _offset: u64, buff: &mut [u8]) -> Result<u64, Errno> {
-		if rand(buff).is_some() {
-			Ok(buff.len() as _)
+		let len = min(buff.len(), rand::RANDOM_MAX_REQUEST_SIZE);
+		if rand::rand(&mut buff[..len]).is_some() {
+			Ok(len as _)
 		} else {
 			Ok(0)
 		}
 	}
 
-	fn write(&mut self, _offset: u64, _buff: &[u8]) -> Result<u64, Errno> {
-		// TODO Feed entropy?
-		todo!();
+	fn write(&mut self, _offset: u64, buff: &[u8]) -> Result<u64, Errno> {
+		rand::feed_entropy(buff);
+		Ok(buff.len() as _)
 	}
 }
 
@@ -158,14 +159,15 @@ impl IO for URandomDeviceHandle {
 		0
 	}
 
-	fn read(&mut self, _offset: u64, _buff: &mut [u8]) -> Result<u64, Errno> {
-		// TODO
-		todo!();
+	fn read(&mut self, _offset: u64, buff: &mut [u8]) -> Result<u64, Errno> {
+		let len = min(buff.len(), rand::MAX_REQUEST_SIZE);
+		rand::rand_insecure(&mut buff[..len]);
+		Ok(len as _)
 	}
 
-	fn write(&mut self, _offset: u64, _buff: &[u8]) -> Result<u64, Errno> {
-		// TODO Feed entropy?
-		todo!();
+	fn write(&mut self, _offset: u64, buff: &[u8]) -> Result<u64, Errno> {
+		rand::feed_entropy(buff);
+		Ok(buff.len() as _)
 	}
 }
 
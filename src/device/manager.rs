@@ -33,6 +33,14 @@ pub trait PhysicalDevice {
 	/// Returns the `n`'th BAR.
 	/// If the BAR doesn't exist, the function returns None.
 	fn get_bar(&self, n: u8) -> Option<BAR>;
+
+	/// Returns the legacy IRQ used by the device.
+	/// If the device doesn't use an IRQ, the function returns None.
+	fn get_interrupt_line(&self) -> Option<u8>;
+
+	/// Allows the device to initiate DMA transfers on the bus. If not applicable, the function
+	/// does nothing.
+	fn enable_bus_master(&self);
 }
 
 /// Trait representing a structure managing the link between physical devices and device files.
@@ -20,6 +20,9 @@ use crate::errno::Errno;
 use crate::errno;
 use crate::file::FileContent;
 use crate::file::Mode;
+use crate::file::epoll::EPOLLIN;
+use crate::file::epoll::EPOLLOUT;
+use crate::file::epoll::PollQueue;
 use crate::file::fcache::FCache;
 use crate::file::fcache;
 use crate::file::path::Path;
@@ -51,6 +54,15 @@ pub trait DeviceHandle: IO {
 	/// `argp` is a pointer to the argument.
 	fn ioctl(&mut self, mem_space: IntSharedPtr<MemSpace>, request: u32, argp: *const c_void)
 		-> Result<u32, Errno>;
+
+	/// Returns the events currently available on the device, as a mask of epoll events.
+	fn poll(&mut self) -> u32 {
+		EPOLLIN | EPOLLOUT
+	}
+
+	/// Calls `f` with the queue of the epoll watches registered on the device.
+	/// Devices that are always ready don't have a queue, in which case `f` is not called.
+	fn with_poll_queue(&mut self, _f: &mut dyn FnMut(&mut PollQueue)) {}
 }
 
 /// Structure representing a device, either a block device or a char device. Each device has a
@@ -250,6 +262,14 @@ impl IO for Device {
 	fn write(&mut self, offset: u64, buff: &[u8]) -> Result<u64, Errno> {
 		self.handle.write(offset, buff)
 	}
+
+	fn readahead(&mut self, offset: u64, size: u64) {
+		self.handle.readahead(offset, size);
+	}
+
+	fn sync(&mut self) -> Result<(), Errno> {
+		self.handle.sync()
+	}
 }
 
 impl Drop for Device {
@@ -0,0 +1,1005 @@
+//! The Advanced Host Controller Interface (AHCI) is the interface of SATA controllers.
+//!
+//! The controller's registers are accessed through MMIO, at the address given by its sixth BAR
+//! (ABAR). Each port of the controller can be attached to a drive, and has:
+//! - a command list of up to 32 command slots, each pointing to a command table which contains
+//! the command's FIS and the Physical Region Descriptor Table (PRDT) describing the memory to
+//! transfer
+//! - an area in which the controller copies the FISes received from the drive
+//!
+//! A command is issued by setting the bit of its slot in the port's Command Issue register. If
+//! the drive supports Native Command Queueing (NCQ), reads and writes are sent as queued
+//! commands, allowing up to 32 requests to be in flight at the same time, which the drive may
+//! complete in any order. Else, requests are performed one at a time.
+//!
+//! The controller raises an interrupt when commands complete, waking up the processes waiting on
+//! the port. The completed commands are found by comparing the slots in use with the slots that
+//! are still set in the Command Issue and SATA Active registers.
+
+use core::cmp::min;
+use core::mem::ManuallyDrop;
+use core::mem::size_of;
+use core::ptr;
+use core::sync::atomic::AtomicU32;
+use core::sync::atomic::AtomicUsize;
+use core::sync::atomic::Ordering;
+use core::sync::atomic;
+use crate::device::manager::PhysicalDevice;
+use crate::device::storage::Request;
+use crate::device::storage::RequestTag;
+use crate::device::storage::StorageInterface;
+use crate::errno::Errno;
+use crate::errno;
+use crate::event::InterruptResult;
+use crate::event::InterruptResultAction;
+use crate::event;
+use crate::idt::pic;
+use crate::memory::buddy;
+use crate::memory::mmio::MMIO;
+use crate::memory;
+use crate::process::wait_queue::WaitQueue;
+use crate::util::boxed::Box;
+use crate::util::container::vec::Vec;
+use crate::util::math;
+
+/// The maximum number of controllers handled by the driver.
+const MAX_CONTROLLERS: usize = 4;
+/// The maximum number of ports on a controller.
+const MAX_PORTS: usize = 32;
+/// The maximum number of command slots on a port.
+const MAX_SLOTS: usize = 32;
+/// The size of the controller's registers in bytes.
+const ABAR_SIZE: usize = 0x1100;
+
+/// The size of a sector in bytes.
+const SECTOR_SIZE: u64 = 512;
+/// The maximum number of sectors transferred by a single command.
+const MAX_SECTORS: u64 = 65536;
+/// The interrupt vector of the first IRQ.
+const IRQ_VECTOR_BEGIN: usize = 0x20;
+/// The number of register reads after which waiting for the controller fails.
+const TIMEOUT: usize = 1000000;
+
+/// Register: Host Capabilities.
+const REG_CAP: usize = 0x00;
+/// Register: Global Host Control.
+const REG_GHC: usize = 0x04;
+/// Register: Interrupt Status.
+const REG_IS: usize = 0x08;
+/// Register: Ports Implemented.
+const REG_PI: usize = 0x0c;
+/// The offset of the registers of the first port.
+const PORTS_OFFSET: usize = 0x100;
+/// The size of the registers of a port.
+const PORT_REGS_SIZE: usize = 0x80;
+
+/// Capability: offset of the number of command slots, minus one.
+const CAP_NCS_SHIFT: u32 = 8;
+/// Capability: the controller supports NCQ.
+const CAP_SNCQ: u32 = 1 << 30;
+
+/// Global control: interrupts are enabled.
+const GHC_IE: u32 = 1 << 1;
+/// Global control: the controller works in AHCI mode.
+const GHC_AE: u32 = 1 << 31;
+
+/// Port register: Command List Base Address.
+const PX_CLB: usize = 0x00;
+/// Port register: Command List Base Address, upper 32 bits.
+const PX_CLBU: usize = 0x04;
+/// Port register: FIS Base Address.
+const PX_FB: usize = 0x08;
+/// Port register: FIS Base Address, upper 32 bits.
+const PX_FBU: usize = 0x0c;
+/// Port register: Interrupt Status.
+const PX_IS: usize = 0x10;
+/// Port register: Interrupt Enable.
+const PX_IE: usize = 0x14;
+/// Port register: Command and Status.
+const PX_CMD: usize = 0x18;
+/// Port register: Task File Data.
+const PX_TFD: usize = 0x20;
+/// Port register: Signature.
+const PX_SIG: usize = 0x24;
+/// Port register: SATA Status.
+const PX_SSTS: usize = 0x28;
+/// Port register: SATA Error.
+const PX_SERR: usize = 0x30;
+/// Port register: SATA Active, the slots of queued commands that haven't completed.
+const PX_SACT: usize = 0x34;
+/// Port register: Command Issue, the slots of commands that haven't completed.
+const PX_CI: usize = 0x38;
+
+/// Port command: the port processes the command list.
+const PX_CMD_ST: u32 = 1 << 0;
+/// Port command: forces the drive's busy flags to be cleared.
+const PX_CMD_CLO: u32 = 1 << 3;
+/// Port command: received FISes are copied to memory.
+const PX_CMD_FRE: u32 = 1 << 4;
+/// Port command: the FIS receive engine is running.
+const PX_CMD_FR: u32 = 1 << 14;
+/// Port command: the command list engine is running.
+const PX_CMD_CR: u32 = 1 << 15;
+
+/// Port interrupt: a Device to Host Register FIS has been received.
+const PX_IS_DHRS: u32 = 1 << 0;
+/// Port interrupt: a PIO Setup FIS has been received.
+const PX_IS_PSS: u32 = 1 << 1;
+/// Port interrupt: a DMA Setup FIS has been received.
+const PX_IS_DSS: u32 = 1 << 2;
+/// Port interrupt: a Set Device Bits FIS has been received, signalling completed queued
+/// commands.
+const PX_IS_SDBS: u32 = 1 << 3;
+/// Port interrupt: the interface had a non-fatal error.
+const PX_IS_IFS: u32 = 1 << 27;
+/// Port interrupt: the controller had a data error.
+const PX_IS_HBDS: u32 = 1 << 28;
+/// Port interrupt: the controller had a fatal error.
+const PX_IS_HBFS: u32 = 1 << 29;
+/// Port interrupt: the drive reported an error.
+const PX_IS_TFES: u32 = 1 << 30;
+/// Port interrupts signalling an error.
+const PX_IS_ERR: u32 = PX_IS_IFS | PX_IS_HBDS | PX_IS_HBFS | PX_IS_TFES;
+
+/// Task file status: the drive is busy.
+const TFD_BSY: u32 = 0x80;
+/// Task file status: the drive is ready to transfer data.
+const TFD_DRQ: u32 = 0x08;
+
+/// SATA status: a drive is present and communication is established.
+const SSTS_DET_PRESENT: u32 = 3;
+/// SATA status: the interface is active.
+const SSTS_IPM_ACTIVE: u32 = 1;
+/// The signature of a SATA drive.
+const SIG_ATA: u32 = 0x00000101;
+
+/// FIS type: Register, Host to Device.
+const FIS_TYPE_REG_H2D: u8 = 0x27;
+/// FIS flag: the FIS contains a command.
+const FIS_COMMAND: u8 = 0x80;
+/// Device field: the offset is an LBA.
+const DEVICE_LBA: u8 = 0x40;
+/// Device field of queued commands: Forced Unit Access, the write completes only when the data
+/// is on the medium.
+const DEVICE_FUA: u8 = 0x80;
+
+/// Command header flag: the command writes to the drive.
+const HEADER_WRITE: u16 = 1 << 6;
+
+/// ATA command: identifies the drive.
+const COMMAND_IDENTIFY: u8 = 0xec;
+/// ATA command: reads sectors using 48 bits LBA.
+const COMMAND_READ_DMA_EXT: u8 = 0x25;
+/// ATA command: writes sectors using 48 bits LBA.
+const COMMAND_WRITE_DMA_EXT: u8 = 0x35;
+/// ATA command: writes sectors using 48 bits LBA, bypassing the drive's cache.
+const COMMAND_WRITE_DMA_FUA_EXT: u8 = 0x3d;
+/// ATA command: queued read.
+const COMMAND_READ_FPDMA_QUEUED: u8 = 0x60;
+/// ATA command: queued write.
+const COMMAND_WRITE_FPDMA_QUEUED: u8 = 0x61;
+/// ATA command: flushes the drive's cache.
+const COMMAND_CACHE_FLUSH_EXT: u8 = 0xea;
+
+/// The number of PRDT entries in a command table.
+const PRDT_ENTRIES: usize = 8;
+/// The maximum size of the region described by a PRD.
+const PRD_MAX_SIZE: usize = 0x400000;
+/// The order of the frame containing the command list and the received FISes.
+const CMD_LIST_ORDER: buddy::FrameOrder = 0;
+/// The offset of the received FISes in the frame of the command list.
+const FIS_OFFSET: usize = 1024;
+/// The order of the frames containing the command tables.
+const TABLES_ORDER: buddy::FrameOrder = 1;
+
+/// A command header, in the command list of a port.
+#[repr(C)]
+struct CommandHeader {
+	/// The length of the command FIS in dwords, and flags.
+	flags: u16,
+	/// The number of entries in the PRDT.
+	prdt_len: u16,
+	/// The number of bytes transferred, updated by the controller.
+	prd_byte_count: u32,
+	/// The physical address of the command table.
+	table: u32,
+	/// The upper 32 bits of the physical address of the command table.
+	table_upper: u32,
+
+	/// Reserved.
+	_reserved: [u32; 4],
+}
+
+/// A Physical Region Descriptor, describing a region of physical memory to transfer.
+#[repr(C)]
+struct Prd {
+	/// The physical address of the region.
+	addr: u32,
+	/// The upper 32 bits of the physical address of the region.
+	addr_upper: u32,
+	/// Reserved.
+	_reserved: u32,
+	/// The size of the region in bytes, minus one.
+	count: u32,
+}
+
+/// A command table, pointed to by a command header.
+#[repr(C)]
+struct CommandTable {
+	/// The command FIS.
+	fis: [u8; 64],
+	/// The ATAPI command.
+	atapi_command: [u8; 16],
+	/// Reserved.
+	_reserved: [u8; 48],
+
+	/// The regions of memory to transfer.
+	prdt: [Prd; PRDT_ENTRIES],
+}
+
+/// A Register FIS, Host to Device, sending a command to the drive.
+#[repr(C)]
+#[derive(Default)]
+struct FisRegH2D {
+	/// The type of the FIS.
+	type_: u8,
+	/// Port multiplier and flags.
+	flags: u8,
+	/// The command.
+	command: u8,
+	/// The low byte of the Features field.
+	feature_low: u8,
+
+	/// Bytes 0 to 2 of the LBA.
+	lba_low: [u8; 3],
+	/// The Device field.
+	device: u8,
+
+	/// Bytes 3 to 5 of the LBA.
+	lba_high: [u8; 3],
+	/// The high byte of the Features field.
+	feature_high: u8,
+
+	/// The low byte of the Count field.
+	count_low: u8,
+	/// The high byte of the Count field.
+	count_high: u8,
+	/// Isochronous command completion.
+	icc: u8,
+	/// The Control field.
+	control: u8,
+
+	/// Reserved.
+	_reserved: [u8; 4],
+}
+
+impl FisRegH2D {
+	/// Creates a FIS for the command `command` at sector `lba`.
+	/// `device` is the value of the Device field.
+	/// `feature` and `count` are the values of the Features and Count fields.
+	fn new(command: u8, lba: u64, device: u8, feature: u16, count: u16) -> Self {
+		Self {
+			type_: FIS_TYPE_REG_H2D,
+			flags: FIS_COMMAND,
+			command,
+			feature_low: (feature & 0xff) as _,
+
+			lba_low: [(lba & 0xff) as _, ((lba >> 8) & 0xff) as _, ((lba >> 16) & 0xff) as _],
+			device,
+
+			lba_high: [
+				((lba >> 24) & 0xff) as _,
+				((lba >> 32) & 0xff) as _,
+				((lba >> 40) & 0xff) as _
+			],
+			feature_high: (feature >> 8) as _,
+
+			count_low: (count & 0xff) as _,
+			count_high: (count >> 8) as _,
+
+			..Default::default()
+		}
+	}
+}
+
+/// The interrupts of each port of each controller, accumulated by the interrupt handler until
+/// the port's interface handles them.
+static EVENTS: [[AtomicU32; MAX_PORTS]; MAX_CONTROLLERS] = {
+	const ZERO: AtomicU32 = AtomicU32::new(0);
+	const PORTS: [AtomicU32; MAX_PORTS] = [ZERO; MAX_PORTS];
+	[PORTS; MAX_CONTROLLERS]
+};
+/// The processes waiting for the completion of commands, for each port of each controller.
+static WAIT_QUEUES: [[WaitQueue; MAX_PORTS]; MAX_CONTROLLERS] = {
+	const QUEUE: WaitQueue = WaitQueue::new();
+	const PORTS: [WaitQueue; MAX_PORTS] = [QUEUE; MAX_PORTS];
+	[PORTS; MAX_CONTROLLERS]
+};
+/// The number of controllers that have been initialized.
+static CONTROLLERS_COUNT: AtomicUsize = AtomicUsize::new(0);
+
+/// Reads the register at offset `off` from the registers at `base`.
+unsafe fn reg_read(base: *mut u8, off: usize) -> u32 {
+	ptr::read_volatile(base.add(off) as *const u32)
+}
+
+/// Writes the value `val` to the register at offset `off` from the registers at `base`.
+unsafe fn reg_write(base: *mut u8, off: usize, val: u32) {
+	ptr::write_volatile(base.add(off) as *mut u32, val);
+}
+
+/// Returns the base of the registers of the port `port` of the controller with registers at
+/// `abar`.
+fn get_port_regs(abar: *mut u8, port: usize) -> *mut u8 {
+	unsafe {
+		abar.add(PORTS_OFFSET + port * PORT_REGS_SIZE)
+	}
+}
+
+/// Handles an interrupt from the controller of index `index`, with registers at `abar`.
+fn irq_handler(abar: *mut u8, index: usize) {
+	unsafe {
+		let is = reg_read(abar, REG_IS);
+
+		for port in (0..MAX_PORTS).filter(| p | is & (1 << p) != 0) {
+			let regs = get_port_regs(abar, port);
+			let port_is = reg_read(regs, PX_IS);
+			reg_write(regs, PX_IS, port_is);
+
+			EVENTS[index][port].fetch_or(port_is, Ordering::Release);
+			WAIT_QUEUES[index][port].wake_all();
+		}
+
+		reg_write(abar, REG_IS, is);
+	}
+}
+
+/// Structure representing an AHCI controller.
+pub struct AHCIController {
+	/// The beginning of the controller's registers.
+	abar: *mut u8,
+	/// The index of the controller, used to find the interrupts of its ports.
+	index: usize,
+	/// Tells whether the controller's interrupts are handled.
+	irq: bool,
+}
+
+impl AHCIController {
+	/// Creates a new instance from the given PhysicalDevice.
+	/// If the controller cannot be used, the function returns None.
+	pub fn new(dev: &dyn PhysicalDevice) -> Option<Self> {
+		let bar = dev.get_bar(5)?;
+		let phys = bar.get_physical_address() as usize;
+		if bar.is_io() || phys == 0 {
+			return None;
+		}
+
+		let index = CONTROLLERS_COUNT.fetch_add(1, Ordering::AcqRel);
+		if index >= MAX_CONTROLLERS {
+			return None;
+		}
+
+		let begin = phys & !(memory::PAGE_SIZE - 1);
+		let pages = math::ceil_division(phys - begin + ABAR_SIZE, memory::PAGE_SIZE);
+		let mmio = MMIO::new(begin as _, pages).ok()?;
+		let abar = unsafe {
+			(mmio.get_virt_begin() as *mut u8).add(phys - begin)
+		};
+		dev.enable_bus_master();
+
+		// The mapping of the registers is kept by the interrupt handler
+		let irq = dev.get_interrupt_line().filter(| irq | *irq < 16);
+		match irq {
+			Some(irq) => {
+				let hook = event::register_callback(IRQ_VECTOR_BEGIN + irq as usize, 0,
+					move | _, _, _, _ | {
+						let _ = &mmio;
+						irq_handler(abar, index);
+
+						InterruptResult::new(false, InterruptResultAction::Resume)
+					}).ok()?;
+				let _ = ManuallyDrop::new(hook);
+				pic::enable_irq(irq);
+			},
+
+			None => {
+				let _ = ManuallyDrop::new(mmio);
+			},
+		}
+
+		Some(Self {
+			abar,
+			index,
+			irq: irq.is_some(),
+		})
+	}
+
+	/// Enables the controller's interrupts and detects all disks on the controller.
+	pub fn detect_all(&self) -> Result<Vec<Box<dyn StorageInterface>>, Errno> {
+		let abar = self.abar;
+		let (cap, implemented) = unsafe {
+			let mut ghc = reg_read(abar, REG_GHC) | GHC_AE;
+			if self.irq {
+				ghc |= GHC_IE;
+			}
+			reg_write(abar, REG_GHC, ghc);
+
+			(reg_read(abar, REG_CAP), reg_read(abar, REG_PI))
+		};
+		let slots_count = (((cap >> CAP_NCS_SHIFT) & 0x1f) + 1) as usize;
+		let ncq = cap & CAP_SNCQ != 0;
+
+		let mut interfaces: Vec<Box<dyn StorageInterface>> = Vec::new();
+		for port in (0..MAX_PORTS).filter(| p | implemented & (1 << p) != 0) {
+			let regs = get_port_regs(abar, port);
+			let events = &EVENTS[self.index][port];
+			let wait_queue = self.irq.then(|| &WAIT_QUEUES[self.index][port]);
+
+			let interface = AHCIInterface::new(regs, events, wait_queue, slots_count, ncq)?;
+			if let Some(interface) = interface {
+				interfaces.push(Box::new(interface)?)?;
+			}
+		}
+
+		Ok(interfaces)
+	}
+}
+
+/// Structure representing the interface of a drive attached to a port of an AHCI controller.
+pub struct AHCIInterface {
+	/// The port's registers.
+	regs: *mut u8,
+	/// The interrupts of the port received by the interrupt handler.
+	events: &'static AtomicU32,
+	/// The queue of processes waiting for the port's interrupts. If None, interrupts are not
+	/// handled and the port is polled.
+	wait_queue: Option<&'static WaitQueue>,
+
+	/// The command list, followed by the area for received FISes.
+	cmd_list: *mut CommandHeader,
+	/// The command tables, one for each slot.
+	tables: *mut CommandTable,
+
+	/// The number of slots that can be used at the same time.
+	depth: usize,
+	/// Tells whether reads and writes are queued commands.
+	ncq: bool,
+	/// Tells whether the drive supports writes bypassing its cache, for non-queued commands.
+	fua: bool,
+	/// The number of sectors on the drive.
+	sectors_count: u64,
+
+	/// The slots of the submitted requests that haven't been waited for.
+	used: u32,
+	/// The slots of the requests that have completed.
+	done: u32,
+	/// The slots of the requests that have failed.
+	failed: u32,
+	/// The slots of the requests that are writes.
+	writes: u32,
+}
+
+impl AHCIInterface {
+	/// Creates an interface for the port with registers `regs`, if a drive is attached to it.
+	/// `events` is the accumulator of the port's interrupts.
+	/// `wait_queue` is the queue of processes waiting for the port's interrupts.
+	/// `slots_count` is the number of command slots of the controller.
+	/// `ncq` tells whether the controller supports NCQ.
+	fn new(regs: *mut u8, events: &'static AtomicU32, wait_queue: Option<&'static WaitQueue>,
+		slots_count: usize, ncq: bool) -> Result<Option<Self>, Errno> {
+		let (ssts, sig) = unsafe {
+			(reg_read(regs, PX_SSTS), reg_read(regs, PX_SIG))
+		};
+		let det = ssts & 0xf;
+		let ipm = (ssts >> 8) & 0xf;
+		if det != SSTS_DET_PRESENT || ipm != SSTS_IPM_ACTIVE || sig != SIG_ATA {
+			return Ok(None);
+		}
+
+		let cmd_list = buddy::alloc_kernel(CMD_LIST_ORDER)?;
+		let tables = match buddy::alloc_kernel(TABLES_ORDER) {
+			Ok(tables) => tables,
+			Err(e) => {
+				buddy::free_kernel(cmd_list, CMD_LIST_ORDER);
+				return Err(e);
+			},
+		};
+		unsafe {
+			ptr::write_bytes(cmd_list as *mut u8, 0, memory::PAGE_SIZE << CMD_LIST_ORDER);
+			ptr::write_bytes(tables as *mut u8, 0, memory::PAGE_SIZE << TABLES_ORDER);
+		}
+
+		let mut s = Self {
+			regs,
+			events,
+			wait_queue,
+
+			cmd_list: cmd_list as _,
+			tables: tables as _,
+
+			depth: 1,
+			ncq: false,
+			fua: false,
+			sectors_count: 0,
+
+			used: 0,
+			done: 0,
+			failed: 0,
+			writes: 0,
+		};
+
+		if !s.stop() {
+			return Ok(None);
+		}
+		unsafe {
+			let cmd_list_phys = memory::kern_to_phys(cmd_list) as u32;
+			reg_write(regs, PX_CLB, cmd_list_phys);
+			reg_write(regs, PX_CLBU, 0);
+			reg_write(regs, PX_FB, cmd_list_phys + FIS_OFFSET as u32);
+			reg_write(regs, PX_FBU, 0);
+
+			reg_write(regs, PX_SERR, u32::MAX);
+			reg_write(regs, PX_IS, u32::MAX);
+			reg_write(regs, PX_IE, PX_IS_DHRS | PX_IS_PSS | PX_IS_DSS | PX_IS_SDBS | PX_IS_ERR);
+		}
+		s.start();
+
+		let mut data: [u16; 256] = [0; 256];
+		let fis = FisRegH2D::new(COMMAND_IDENTIFY, 0, 0, 0, 0);
+		if s.run_command(&fis, data.as_mut_ptr() as _, size_of::<[u16; 256]>(), false).is_err() {
+			return Ok(None);
+		}
+
+		// The drive is accessed only with commands using 48 bits LBA
+		let lba48 = data[83] & (1 << 10) != 0;
+		if !lba48 {
+			return Ok(None);
+		}
+
+		s.ncq = ncq && data[76] & (1 << 8) != 0;
+		s.depth = if s.ncq {
+			min(slots_count, (data[75] & 0x1f) as usize + 1)
+		} else {
+			1
+		};
+		s.fua = data[84] & (1 << 6) != 0;
+		s.sectors_count = (data[100] as u64) | ((data[101] as u64) << 16)
+			| ((data[102] as u64) << 32) | ((data[103] as u64) << 48);
+
+		Ok(Some(s))
+	}
+
+	/// Tells whether reads and writes are sent as queued commands.
+	pub fn is_ncq(&self) -> bool {
+		self.ncq
+	}
+
+	/// Waits until the bits `mask` of the port register at offset `off` are clear.
+	/// If the timeout is reached, the function returns false.
+	fn wait_clear(&self, off: usize, mask: u32) -> bool {
+		(0..TIMEOUT).any(| _ | unsafe {
+			reg_read(self.regs, off) & mask == 0
+		})
+	}
+
+	/// Stops the processing of the command list. Commands that haven't completed are dropped.
+	/// If the port doesn't stop, the function returns false.
+	fn stop(&self) -> bool {
+		unsafe {
+			let cmd = reg_read(self.regs, PX_CMD);
+			reg_write(self.regs, PX_CMD, cmd & !PX_CMD_ST);
+		}
+		if !self.wait_clear(PX_CMD, PX_CMD_CR) {
+			return false;
+		}
+
+		unsafe {
+			let cmd = reg_read(self.regs, PX_CMD);
+			reg_write(self.regs, PX_CMD, cmd & !PX_CMD_FRE);
+		}
+		self.wait_clear(PX_CMD, PX_CMD_FR)
+	}
+
+	/// Starts the processing of the command list.
+	fn start(&self) {
+		if !self.wait_clear(PX_TFD, TFD_BSY | TFD_DRQ) {
+			// The drive is stuck, forcing its busy flags to be cleared
+			unsafe {
+				let cmd = reg_read(self.regs, PX_CMD);
+				reg_write(self.regs, PX_CMD, cmd | PX_CMD_CLO);
+			}
+			self.wait_clear(PX_CMD, PX_CMD_CLO);
+		}
+
+		unsafe {
+			let cmd = reg_read(self.regs, PX_CMD);
+			reg_write(self.regs, PX_CMD, cmd | PX_CMD_FRE | PX_CMD_ST);
+		}
+	}
+
+	/// Restarts the port after an error.
+	fn recover(&mut self) {
+		self.stop();
+		unsafe {
+			reg_write(self.regs, PX_SERR, u32::MAX);
+			reg_write(self.regs, PX_IS, u32::MAX);
+		}
+		self.events.store(0, Ordering::Release);
+		self.start();
+	}
+
+	/// Updates the state of the submitted requests, from the interrupts and the port's
+	/// registers.
+	fn update(&mut self) {
+		let (is, pending) = unsafe {
+			let is = reg_read(self.regs, PX_IS);
+			reg_write(self.regs, PX_IS, is);
+			let pending = reg_read(self.regs, PX_SACT) | reg_read(self.regs, PX_CI);
+
+			(is | self.events.swap(0, Ordering::AcqRel), pending)
+		};
+
+		let in_flight = self.used & !self.done;
+		if is & PX_IS_ERR != 0 {
+			// After an error, the commands that haven't completed are aborted by the drive
+			self.failed |= in_flight & pending;
+			self.done |= in_flight;
+			self.recover();
+		} else {
+			self.done |= in_flight & !pending;
+		}
+	}
+
+	/// Fills the command at slot `slot`.
+	/// `fis` is the command's FIS.
+	/// `phys` and `len` are the physical address and the size of the memory to transfer.
+	/// `write` tells whether the memory is written to the drive.
+	fn setup_slot(&mut self, slot: usize, fis: &FisRegH2D, phys: usize, len: usize, write: bool) {
+		let table = unsafe {
+			&mut *self.tables.add(slot)
+		};
+		unsafe {
+			ptr::copy_nonoverlapping(fis as *const _ as *const u8, table.fis.as_mut_ptr(),
+				size_of::<FisRegH2D>());
+		}
+
+		let mut prdt_len = 0;
+		let mut off = 0;
+		while off < len {
+			let size = min(len - off, PRD_MAX_SIZE);
+			table.prdt[prdt_len] = Prd {
+				addr: (phys + off) as _,
+				addr_upper: 0,
+				_reserved: 0,
+				count: (size - 1) as _,
+			};
+
+			prdt_len += 1;
+			off += size;
+		}
+
+		let header = unsafe {
+			&mut *self.cmd_list.add(slot)
+		};
+		let fis_len = (size_of::<FisRegH2D>() / size_of::<u32>()) as u16;
+		header.flags = fis_len | if write {
+			HEADER_WRITE
+		} else {
+			0
+		};
+		header.prdt_len = prdt_len as _;
+		header.prd_byte_count = 0;
+		header.table = memory::kern_to_phys(table as *const _ as _) as _;
+		header.table_upper = 0;
+	}
+
+	/// Issues the command at slot `slot`.
+	/// `queued` tells whether the command is a queued command.
+	fn issue(&mut self, slot: usize, queued: bool) {
+		atomic::fence(Ordering::SeqCst);
+
+		let bit = 1 << slot;
+		self.used |= bit;
+		unsafe {
+			if queued {
+				reg_write(self.regs, PX_SACT, bit);
+			}
+			reg_write(self.regs, PX_CI, bit);
+		}
+	}
+
+	/// Runs the non-queued command with FIS `fis`, waiting for its completion. No other command
+	/// must be in flight.
+	/// `buf` and `len` are the kernel memory to transfer.
+	/// `write` tells whether the memory is written to the drive.
+	fn run_command(&mut self, fis: &FisRegH2D, buf: *mut u8, len: usize, write: bool)
+		-> Result<(), Errno> {
+		debug_assert_eq!(self.used, 0);
+
+		let phys = memory::kern_to_phys(buf as _) as usize;
+		self.setup_slot(0, fis, phys, len, write);
+		self.issue(0, false);
+		self.complete(0)
+	}
+
+	/// Flushes the drive's cache. No other command must be in flight.
+	fn cache_flush(&mut self) -> Result<(), Errno> {
+		let fis = FisRegH2D::new(COMMAND_CACHE_FLUSH_EXT, 0, DEVICE_LBA, 0, 0);
+		self.run_command(&fis, ptr::null_mut(), 0, false)
+	}
+
+	/// Transfers `size` sectors at offset `offset`, keeping as many requests in flight as
+	/// possible, and waits for completion.
+	/// `buf` is the buffer to transfer.
+	/// `write` tells whether the buffer is written to the drive.
+	fn transfer(&mut self, buf: *mut u8, offset: u64, size: u64, write: bool)
+		-> Result<(), Errno> {
+		let mut tags: [RequestTag; MAX_SLOTS] = [0; MAX_SLOTS];
+		let mut first = 0;
+		let mut count = 0;
+
+		let mut result = Ok(());
+		let mut i = 0;
+		loop {
+			if result.is_ok() && i < size && count < self.depth {
+				let n = min(size - i, MAX_SECTORS);
+				let req = Request {
+					buf: unsafe {
+						buf.add((i * SECTOR_SIZE) as usize)
+					},
+					offset: offset + i,
+					size: n,
+					write,
+				};
+
+				// Safe because the buffer is not used until every requests complete
+				match unsafe { self.submit(&req) } {
+					Ok(Some(tag)) => {
+						tags[(first + count) % MAX_SLOTS] = tag;
+						count += 1;
+					},
+					Ok(None) => {},
+					Err(e) => result = Err(e),
+				}
+
+				i += n;
+				continue;
+			}
+			if count == 0 {
+				break;
+			}
+
+			let tag = tags[first];
+			first = (first + 1) % MAX_SLOTS;
+			count -= 1;
+			if let Err(e) = self.complete(tag) {
+				result = Err(e);
+			}
+		}
+
+		result
+	}
+}
+
+impl StorageInterface for AHCIInterface {
+	fn get_block_size(&self) -> u64 {
+		SECTOR_SIZE
+	}
+
+	fn get_blocks_count(&self) -> u64 {
+		self.sectors_count
+	}
+
+	fn read(&mut self, buf: &mut [u8], offset: u64, size: u64) -> Result<(), Errno> {
+		debug_assert!((buf.len() as u64) >= size * SECTOR_SIZE);
+		self.transfer(buf.as_mut_ptr(), offset, size, false)
+	}
+
+	fn write(&mut self, buf: &[u8], offset: u64, size: u64) -> Result<(), Errno> {
+		debug_assert!((buf.len() as u64) >= size * SECTOR_SIZE);
+		self.transfer(buf.as_ptr() as _, offset, size, true)
+	}
+
+	fn get_queue_depth(&self) -> usize {
+		self.depth
+	}
+
+	unsafe fn submit(&mut self, req: &Request) -> Result<Option<RequestTag>, Errno> {
+		if req.size == 0 || req.size > MAX_SECTORS
+			|| req.offset >= self.sectors_count || req.offset + req.size > self.sectors_count {
+			return Err(errno!(EINVAL));
+		}
+		// The memory is transferred by the controller, thus it must be physically contiguous
+		let buf = req.buf as usize;
+		if buf < memory::PROCESS_END as usize || buf % 2 != 0 {
+			return Err(errno!(EINVAL));
+		}
+
+		self.update();
+		let slots = ((1u64 << self.depth) - 1) as u32;
+		let free = !self.used & slots;
+		if free == 0 {
+			return Err(errno!(EAGAIN));
+		}
+		let slot = free.trailing_zeros() as usize;
+
+		// A count of 65536 sectors is encoded as zero
+		let count = (req.size % MAX_SECTORS) as u16;
+		let fis = if self.ncq {
+			let (command, device) = if req.write {
+				(COMMAND_WRITE_FPDMA_QUEUED, DEVICE_LBA | DEVICE_FUA)
+			} else {
+				(COMMAND_READ_FPDMA_QUEUED, DEVICE_LBA)
+			};
+			FisRegH2D::new(command, req.offset, device, count, (slot << 3) as _)
+		} else {
+			let command = match (req.write, self.fua) {
+				(false, _) => COMMAND_READ_DMA_EXT,
+				(true, false) => COMMAND_WRITE_DMA_EXT,
+				(true, true) => COMMAND_WRITE_DMA_FUA_EXT,
+			};
+			FisRegH2D::new(command, req.offset, DEVICE_LBA, 0, count)
+		};
+
+		let phys = memory::kern_to_phys(req.buf as _) as usize;
+		let len = (req.size * SECTOR_SIZE) as usize;
+		self.setup_slot(slot, &fis, phys, len, req.write);
+		if req.write {
+			self.writes |= 1 << slot;
+		}
+		self.issue(slot, self.ncq);
+
+		Ok(Some(slot as _))
+	}
+
+	fn complete(&mut self, tag: RequestTag) -> Result<(), Errno> {
+		let bit = 1 << tag;
+		if self.used & bit == 0 {
+			return Err(errno!(EINVAL));
+		}
+
+		loop {
+			self.update();
+			if self.done & bit != 0 {
+				break;
+			}
+
+			let events = self.events;
+			match self.wait_queue {
+				Some(queue) => queue.wait_until(|| events.load(Ordering::Acquire) != 0),
+				None => core::hint::spin_loop(),
+			}
+		}
+
+		let failed = self.failed & bit != 0;
+		let write = self.writes & bit != 0;
+		self.used &= !bit;
+		self.done &= !bit;
+		self.failed &= !bit;
+		self.writes &= !bit;
+		if failed {
+			return Err(errno!(EIO));
+		}
+
+		// Queued writes and FUA writes reach the medium before completing
+		if write && !self.ncq && !self.fua {
+			self.cache_flush()?;
+		}
+		Ok(())
+	}
+}
+
+impl Drop for AHCIInterface {
+	fn drop(&mut self) {
+		self.stop();
+
+		buddy::free_kernel(self.cmd_list as _, CMD_LIST_ORDER);
+		buddy::free_kernel(self.tables as _, TABLES_ORDER);
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	/// The accumulator of interrupts of the test interface, which never receives any.
+	static TEST_EVENTS: AtomicU32 = AtomicU32::new(0);
+
+	/// Returns an interface using NCQ with `depth` slots, whose port registers are the memory at
+	/// `regs` instead of a controller's.
+	fn test_interface(regs: *mut u8, depth: usize) -> AHCIInterface {
+		let cmd_list = buddy::alloc_kernel(CMD_LIST_ORDER).unwrap();
+		let tables = buddy::alloc_kernel(TABLES_ORDER).unwrap();
+		unsafe {
+			ptr::write_bytes(cmd_list as *mut u8, 0, memory::PAGE_SIZE << CMD_LIST_ORDER);
+			ptr::write_bytes(tables as *mut u8, 0, memory::PAGE_SIZE << TABLES_ORDER);
+		}
+
+		AHCIInterface {
+			regs,
+			events: &TEST_EVENTS,
+			wait_queue: None,
+
+			cmd_list: cmd_list as _,
+			tables: tables as _,
+
+			depth,
+			ncq: true,
+			fua: false,
+			sectors_count: 1024,
+
+			used: 0,
+			done: 0,
+			failed: 0,
+			writes: 0,
+		}
+	}
+
+	/// Returns the value of the port register at offset `off` in `regs`.
+	fn get_reg(regs: &[u32], off: usize) -> u32 {
+		regs[off / size_of::<u32>()]
+	}
+
+	/// Sets the value `val` to the port register at offset `off` in `regs`, as the controller
+	/// would.
+	fn set_reg(regs: &mut [u32], off: usize, val: u32) {
+		regs[off / size_of::<u32>()] = val;
+	}
+
+	#[test_case]
+	fn ahci_fis0() {
+		let lba = 0x123456789abc;
+		let fis = FisRegH2D::new(COMMAND_READ_FPDMA_QUEUED, lba, DEVICE_LBA, 300, 5 << 3);
+		assert_eq!(fis.type_, FIS_TYPE_REG_H2D);
+		assert_eq!(fis.command, COMMAND_READ_FPDMA_QUEUED);
+		assert_eq!(fis.lba_low, [0xbc, 0x9a, 0x78]);
+		assert_eq!(fis.lba_high, [0x56, 0x34, 0x12]);
+		assert_eq!((fis.feature_low, fis.feature_high), (44, 1));
+		assert_eq!((fis.count_low, fis.count_high), (5 << 3, 0));
+	}
+
+	#[test_case]
+	fn ahci_queue0() {
+		let mut regs = [0u32; PORT_REGS_SIZE / size_of::<u32>()];
+		let mut interface = test_interface(regs.as_mut_ptr() as _, 4);
+		let buf = buddy::alloc_kernel(0).unwrap() as *mut u8;
+
+		// Two requests are in flight at the same time, in different slots
+		let mut tags = [0; 2];
+		for (i, tag) in tags.iter_mut().enumerate() {
+			let req = Request {
+				buf: unsafe { buf.add(i * 2 * SECTOR_SIZE as usize) },
+				offset: 100 + i as u64 * 2,
+				size: 2,
+				write: false,
+			};
+			*tag = unsafe { interface.submit(&req) }.unwrap().unwrap();
+		}
+		assert_eq!(tags, [0, 1]);
+		assert_eq!(get_reg(&regs, PX_SACT), 0b10);
+		assert_eq!(get_reg(&regs, PX_CI), 0b10);
+
+		// The command of the second request is a queued read of two sectors at offset 102
+		let table = unsafe { &*interface.tables.add(1) };
+		assert_eq!(table.fis[2], COMMAND_READ_FPDMA_QUEUED);
+		assert_eq!(table.fis[3], 2);
+		assert_eq!(table.fis[4], 102);
+		assert_eq!(table.fis[12], 1 << 3);
+		let header = unsafe { &*interface.cmd_list.add(1) };
+		assert_eq!(header.prdt_len, 1);
+		assert_eq!(table.prdt[0].count, 2 * SECTOR_SIZE as u32 - 1);
+
+		// The controller completes the second request, then reports an error on the first one
+		set_reg(&mut regs, PX_SACT, 0b01);
+		set_reg(&mut regs, PX_CI, 0b01);
+		set_reg(&mut regs, PX_IS, PX_IS_TFES);
+		assert!(interface.complete(tags[1]).is_ok());
+		assert_eq!(interface.complete(tags[0]).unwrap_err(), errno!(EIO));
+		assert_eq!(interface.used, 0);
+
+		// Completing a request that is not in flight is invalid
+		assert!(interface.complete(tags[0]).is_err());
+
+		buddy::free_kernel(buf as _, 0);
+	}
+}
@@ -1,209 +1,936 @@
-//! This module implements storage caches, allowing to cache disk sectors to avoid unnecessary
-//! accesses to the storage device.
-
+//! The buffer cache keeps recently used storage blocks in memory to avoid unnecessary accesses to
+//! storage devices. Every storage device registers itself on the cache, and blocks are identified
+//! by the device's ID and their offset on the device.
+//!
+//! When the cache is full, the Least Recently Used (LRU) block that is clean is evicted. Dirty
+//! blocks met while looking for it are written back, so that they can be evicted later.
+//!
+//! Writes are not forwarded to the device immediately: the modified blocks are marked as dirty
+//! and written back later, either:
+//! - when evicted
+//! - when too many blocks are dirty
+//! - periodically, every `FLUSH_INTERVAL` nanoseconds, by the flush thread (see `init_flush`),
+//! even if the cache is not accessed
+//! - when requested with `sync` (by the `sync` and `fsync` system calls for example)
+//!
+//! Sequential reads can prefetch the next blocks using `readahead`, which loads contiguous missing
+//! blocks with a single request to the device.
+//!
+//! Requests to a device go through its request queue (see `queue`), which sorts and merges
+//! requests. The cache is not locked while requests are performed:
+//! - blocks that are being loaded or written back are marked as in flight and a request on each
+//! of them is added to the queue of their device
+//! - if no process is running the queue of the device, the current process runs it, until no
+//! request is pending anymore. Requests added by other processes meanwhile are performed by the
+//! next batch, along with the others
+//! - processes needing an in flight block sleep until its request completes
+
+use core::cmp::min;
+use crate::device::storage::Request;
 use crate::device::storage::StorageInterface;
+use crate::device::storage::queue::RequestQueue;
+use crate::device::storage::queue;
 use crate::errno::Errno;
+use crate::errno;
 use crate::memory::malloc;
-use crate::util::boxed::Box;
+use crate::process::Process;
+use crate::process::wait_queue::WaitQueue;
+use crate::time;
 use crate::util::container::hashmap::HashMap;
-use crate::util::container::ring_buffer::RingBuffer;
+use crate::util::container::vec::Vec;
+use crate::util::lock::Mutex;
+use crate::util::lock::MutexGuard;
+use crate::util::math;
+
+/// The maximum number of blocks in the cache.
+const CAPACITY: usize = 2048;
+/// The number of buckets of the blocks' hash map.
+const BUCKETS_COUNT: usize = 1021;
+/// The number of dirty blocks above which every dirty blocks are written back.
+const DIRTY_THRESHOLD: usize = CAPACITY / 4;
+/// The interval between each periodic write back, in nanoseconds.
+const FLUSH_INTERVAL: u64 = 5000000000;
+/// The maximum number of blocks loaded by a single request to a device.
+const MAX_BATCH: u64 = 32;
+
+/// The index of a slot in the cache, used as a link for the LRU list.
+type Slot = usize;
+/// The null link of the LRU list.
+const NO_SLOT: Slot = usize::MAX;
+
+/// The ID of a device registered on the cache.
+pub type DeviceID = u32;
+
+/// Statistics of the buffer cache.
+#[derive(Clone, Copy, Debug, Default)]
+pub struct Stats {
+	/// The number of accesses to a block that was in the cache.
+	pub hits: usize,
+	/// The number of accesses to a block that was not in the cache.
+	pub misses: usize,
+	/// The number of blocks requested by readahead.
+	pub readahead: usize,
+	/// The number of blocks written back to their device.
+	pub writebacks: usize,
+}
 
-/// Structure representing a cached sector.
-struct CachedSector {
-	/// Tells whether the sector has been written.
-	written: bool,
+/// The state of the I/O on a block.
+#[derive(Clone, Copy, Debug, PartialEq)]
+enum BlockState {
+	/// No request is in flight on the block.
+	Ready,
+	/// The block is being read from the device. Its content is undefined.
+	Loading,
+	/// The block is being written back to the device. Its content can be read, but not
+	/// modified.
+	WritingBack,
+}
 
-	/// The sector's data.
+/// A block in the cache.
+struct Block {
+	/// The device the block belongs to.
+	dev: DeviceID,
+	/// The offset of the block on the device.
+	index: u64,
+	/// Tells whether the block has been modified since it was read from or written to the
+	/// device.
+	dirty: bool,
+	/// The state of the I/O on the block.
+	state: BlockState,
+	/// The error of the last request on the block, if it failed. If the block is clean, the
+	/// block could not be loaded and its content is undefined.
+	error: Option<Errno>,
+
+	/// The block's data.
 	data: malloc::Alloc<u8>,
+
+	/// The previous block in the LRU list, more recently used.
+	prev: Slot,
+	/// The next block in the LRU list, less recently used.
+	next: Slot,
+}
+
+/// A device registered on the cache.
+struct CacheDevice {
+	/// The device's interface.
+	interface: *mut dyn StorageInterface,
+	/// The device's request queue.
+	queue: RequestQueue,
+	/// The slot of the block of each request of the queue, in the order they were added.
+	slots: Vec<Slot>,
+	/// Tells whether a process is running the queue.
+	running: bool,
 }
 
-/// Structure representing a storage cache. The number of sectors and their size is fixed at
-/// initialization.
-/// The cache needs to be flushed before being dropped. Otherwise, the updated data shall be lost.
-pub struct StorageCache {
-	/// The size of a sector in bytes.
-	sector_size: usize,
+/// The state of the buffer cache.
+struct BufferCache {
+	/// The registered devices, by ID.
+	devices: Vec<CacheDevice>,
+
+	/// The blocks in the cache, by slot.
+	blocks: Vec<Block>,
+	/// The slot of each block in the cache, by device and offset.
+	slots: HashMap<(DeviceID, u64), Slot>,
+
+	/// The most recently used block.
+	lru_head: Slot,
+	/// The least recently used block.
+	lru_tail: Slot,
 
-	/// Cached sectors.
-	sectors: HashMap<u64, CachedSector>,
+	/// The number of dirty blocks.
+	dirty_count: usize,
+	/// The number of blocks with a request in flight.
+	in_flight: usize,
 
-	/// Fifo storing sector indexes. When the fifo is full, the oldest sector shall be discarded
-	/// from the cache.
-	fifo: RingBuffer<u64>,
+	/// The statistics of the cache.
+	stats: Stats,
 }
 
-impl StorageCache {
-	/// Creates a new instance.
-	/// `count` is maximum number of sectors the cache can contain.
-	/// `size` is the size of a sector in bytes.
-	pub fn new(count: usize, size: usize) -> Result<Self, Errno> {
-		Ok(Self {
-			sector_size: size,
+/// The guard of the locked buffer cache.
+type CacheGuard = MutexGuard<'static, BufferCache, true>;
 
-			sectors: HashMap::new(),
+/// The buffer cache.
+static CACHE: Mutex<BufferCache> = Mutex::new(BufferCache {
+	devices: Vec::new(),
 
-			fifo: RingBuffer::new(count)?,
-		})
+	blocks: Vec::new(),
+	slots: HashMap::with_buckets(BUCKETS_COUNT),
+
+	lru_head: NO_SLOT,
+	lru_tail: NO_SLOT,
+
+	dirty_count: 0,
+	in_flight: 0,
+
+	stats: Stats {
+		hits: 0,
+		misses: 0,
+		readahead: 0,
+		writebacks: 0,
+	},
+});
+
+/// The queue of processes waiting for in flight blocks. It is woken up each time a batch of
+/// requests completes.
+static COMPLETION_QUEUE: WaitQueue = WaitQueue::new();
+
+impl BufferCache {
+	/// Returns the interface of the device `dev`.
+	fn get_device(&mut self, dev: DeviceID) -> &mut dyn StorageInterface {
+		unsafe { // Safe because registered devices are never removed
+			&mut *self.devices[dev as usize].interface
+		}
+	}
+
+	/// Removes the block at slot `slot` from the LRU list.
+	fn lru_unlink(&mut self, slot: Slot) {
+		let Block {
+			prev,
+			next,
+			..
+		} = self.blocks[slot];
+
+		if prev != NO_SLOT {
+			self.blocks[prev].next = next;
+		} else {
+			self.lru_head = next;
+		}
+		if next != NO_SLOT {
+			self.blocks[next].prev = prev;
+		} else {
+			self.lru_tail = prev;
+		}
 	}
 
-	/// Tells whether the cache is full.
-	pub fn is_full(&self) -> bool {
-		self.sectors.len() >= self.fifo.get_size()
+	/// Inserts the block at slot `slot` at the beginning of the LRU list.
+	fn lru_push_front(&mut self, slot: Slot) {
+		let head = self.lru_head;
+
+		self.blocks[slot].prev = NO_SLOT;
+		self.blocks[slot].next = head;
+		if head != NO_SLOT {
+			self.blocks[head].prev = slot;
+		} else {
+			self.lru_tail = slot;
+		}
+		self.lru_head = slot;
 	}
 
-	/// Reads the sector with index `sector` and writes its content into the buffer `buff`.
-	pub fn read(&mut self, sector: u64, buff: &mut [u8]) -> Result<Option<()>, Errno> {
-		if let Some(CachedSector { data, .. }) = self.sectors.get(&sector) {
-			buff.copy_from_slice(data.as_slice());
-			Ok(Some(()))
+	/// Inserts the block at slot `slot` at the end of the LRU list.
+	fn lru_tail_insert(&mut self, slot: Slot) {
+		let tail = self.lru_tail;
+
+		self.blocks[slot].prev = tail;
+		self.blocks[slot].next = NO_SLOT;
+		if tail != NO_SLOT {
+			self.blocks[tail].next = slot;
 		} else {
-			Ok(None)
+			self.lru_head = slot;
 		}
+		self.lru_tail = slot;
 	}
 
-	/// Writes the sector with index `sector` with the content of the buffer `buff`.
-	/// `flush_hook` is a function used to write a sector to the disk. It is called in case the
-	/// cache needs to free up a slot for a sector.
-	pub fn write(&mut self, sector: u64, buff: &[u8]) -> Result<Option<()>, Errno> {
-		if let Some(CachedSector { written, data, .. }) = self.sectors.get_mut(&sector) {
-			data.as_slice_mut().copy_from_slice(buff);
-			*written = true;
-			Ok(Some(()))
+	/// Marks the block at slot `slot` as the most recently used.
+	fn touch(&mut self, slot: Slot) {
+		if self.lru_head != slot {
+			self.lru_unlink(slot);
+			self.lru_push_front(slot);
+		}
+	}
+
+	/// Tells whether the block of device `dev` at offset `index` is in flight. If `write` is
+	/// true, a block being written back is also considered in flight.
+	/// If the block is not in the cache, the function returns false.
+	fn is_in_flight(&self, dev: DeviceID, index: u64, write: bool) -> bool {
+		self.slots.get(&(dev, index)).map_or(false, | slot | {
+			match self.blocks[*slot].state {
+				BlockState::Ready => false,
+				BlockState::Loading => true,
+				BlockState::WritingBack => write,
+			}
+		})
+	}
+
+	/// Adds a request on the block at slot `slot` to the queue of its device and marks the block
+	/// as in flight. `write` tells whether the block is written back or loaded.
+	/// The request is performed on the next call to `dispatch`.
+	fn push_request(&mut self, slot: Slot, write: bool) -> Result<(), Errno> {
+		let block = &mut self.blocks[slot];
+		let req = Request {
+			buf: block.data.as_slice_mut().as_mut_ptr(),
+			offset: block.index,
+			size: 1,
+			write,
+		};
+
+		let device = &mut self.devices[block.dev as usize];
+		device.slots.push(slot)?;
+		// Safe because the block is not accessed until the request completes
+		if let Err(e) = unsafe { device.queue.push(req) } {
+			device.slots.pop();
+			return Err(e);
+		}
+
+		block.state = if write {
+			BlockState::WritingBack
 		} else {
+			BlockState::Loading
+		};
+		self.in_flight += 1;
+		Ok(())
+	}
+
+	/// Updates the block at slot `slot` with the result `result` of its request.
+	fn complete(&mut self, slot: Slot, result: Result<(), Errno>) {
+		let block = &mut self.blocks[slot];
+		if block.state == BlockState::WritingBack && result.is_ok() {
+			block.dirty = false;
+			self.dirty_count -= 1;
+			self.stats.writebacks += 1;
+		}
+
+		block.state = BlockState::Ready;
+		block.error = result.err();
+		self.in_flight -= 1;
+	}
+
+	/// Removes the block at slot `slot` from the cache. The slot is placed at the end of the LRU
+	/// list to be reused first.
+	/// The block must not be in flight.
+	fn remove_block(&mut self, slot: Slot) {
+		let block = &mut self.blocks[slot];
+		if block.dirty {
+			block.dirty = false;
+			self.dirty_count -= 1;
+		}
+		self.slots.remove(&(block.dev, block.index));
+		block.dev = DeviceID::MAX;
+		block.error = None;
+
+		self.lru_unlink(slot);
+		self.lru_tail_insert(slot);
+	}
+
+	/// Returns the least recently used block that can be evicted, which is neither in flight nor
+	/// dirty. Dirty blocks met before are written back to be evicted later.
+	/// If no block can be evicted, the function returns None when requests are in flight, since
+	/// their completion may make a block available. Otherwise, it returns an error.
+	fn find_victim(&mut self) -> Result<Option<Slot>, Errno> {
+		let mut slot = self.lru_tail;
+		while slot != NO_SLOT {
+			let block = &self.blocks[slot];
+			let prev = block.prev;
+
+			if block.state == BlockState::Ready {
+				if !block.dirty {
+					return Ok(Some(slot));
+				}
+				// Blocks that failed to be written back are retried by the next flush only. On
+				// failure, the block remains dirty
+				if block.error.is_none() {
+					let _ = self.push_request(slot, true);
+				}
+			}
+			slot = prev;
+		}
+
+		if self.in_flight > 0 {
 			Ok(None)
+		} else {
+			Err(errno!(ENOMEM))
 		}
 	}
 
-	/// Inserts a new sector in the cache. If no space is left, the cache frees up slots of other
-	/// sectors to retrieve space.
-	/// Sectors that have been freed up are written to the disk using `flush_hook`.
-	/// `sector` is the index of the sector.
-	/// `buff` is a buffer containing the sector's data.
-	pub fn insert<F>(&mut self, sector: u64, buff: &[u8], mut flush_hook: F) -> Result<(), Errno>
-		where F: FnMut(u64, &[u8]) -> Result<(), Errno> {
-		// Freeing some slots if needed
-		if self.is_full() {
-			let mut sector_indexes: [u64; 16] = Default::default();
-			let n = self.fifo.read(&mut sector_indexes);
+	/// Tells whether a slot can be allocated, or whether waiting for a slot is pointless because
+	/// no request is in flight.
+	fn can_alloc(&self) -> bool {
+		self.blocks.len() < CAPACITY
+			|| self.in_flight == 0
+			|| self.blocks.iter().any(| b | b.state == BlockState::Ready && !b.dirty)
+	}
 
-			for i in &sector_indexes[..n] {
-				let sector = self.sectors.remove(i).unwrap();
-				if sector.written {
-					flush_hook(*i, sector.data.as_slice())?;
+	/// Returns a free slot for a block of device `dev` at offset `index`, evicting the least
+	/// recently used clean block if the cache is full. The content of the returned block is
+	/// undefined.
+	/// The block is inserted at the beginning of the LRU list.
+	/// If every block is in flight or dirty, the function returns None.
+	fn alloc_slot(&mut self, dev: DeviceID, index: u64) -> Result<Option<Slot>, Errno> {
+		let block_size = self.get_device(dev).get_block_size() as usize;
+
+		let slot = if self.blocks.len() < CAPACITY {
+			self.blocks.push(Block {
+				dev,
+				index,
+				dirty: false,
+				state: BlockState::Ready,
+				error: None,
+
+				data: malloc::Alloc::new_default(block_size)?,
+
+				prev: NO_SLOT,
+				next: NO_SLOT,
+			})?;
+			self.blocks.len() - 1
+		} else {
+			let Some(slot) = self.find_victim()? else {
+				return Ok(None);
+			};
+			self.lru_unlink(slot);
+
+			let block = &mut self.blocks[slot];
+			self.slots.remove(&(block.dev, block.index));
+			block.dev = DeviceID::MAX;
+			block.error = None;
+			if block.data.len() != block_size {
+				// Safe because the block's content is not used anymore
+				if let Err(e) = unsafe { block.data.realloc_default(block_size) } {
+					// Putting the block back as the least recently used, without content
+					self.lru_tail_insert(slot);
+					return Err(e);
 				}
 			}
+			block.dev = dev;
+			block.index = index;
+			slot
+		};
+
+		if let Err(e) = self.slots.insert((dev, index), slot) {
+			self.blocks[slot].dev = DeviceID::MAX;
+			self.lru_tail_insert(slot);
+			return Err(e);
 		}
+		self.lru_push_front(slot);
+		Ok(Some(slot))
+	}
+
+	/// Returns the number of contiguous blocks of device `dev`, starting at offset `index`, that
+	/// are not in the cache. The function stops counting at `max`.
+	fn missing_count(&self, dev: DeviceID, index: u64, max: u64) -> u64 {
+		(0..max)
+			.take_while(| i | self.slots.get(&(dev, index + i)).is_none())
+			.count() as _
+	}
 
-		let mut alloc = malloc::Alloc::<u8>::new_default(self.sector_size)?;
-		alloc.as_slice_mut().copy_from_slice(buff);
+	/// Marks the block at slot `slot` as dirty.
+	fn set_dirty(&mut self, slot: Slot) {
+		if !self.blocks[slot].dirty {
+			self.blocks[slot].dirty = true;
+			self.dirty_count += 1;
+		}
+	}
 
-		self.sectors.insert(sector, CachedSector {
-			written: false,
+	/// Checks that the range of `size` bytes at offset `offset` is in the bounds of device `dev`.
+	/// The function returns the size of a block on the device.
+	fn check_bounds(&mut self, dev: DeviceID, offset: u64, size: usize) -> Result<u64, Errno> {
+		let interface = self.get_device(dev);
+		let block_size = interface.get_block_size();
+		let blocks_count = interface.get_blocks_count();
 
-			data: alloc,
-		})?;
-		self.fifo.write(&[sector]);
+		let blk_end = math::ceil_division(offset + size as u64, block_size);
+		if blk_end > blocks_count {
+			return Err(errno!(EINVAL));
+		}
 
-		Ok(())
+		Ok(block_size)
 	}
+}
+
+/// Runs the request queues of the devices that have pending requests and that are not run by
+/// another process, until none is left. `guard` is the guard of the cache, which is unlocked
+/// while requests are performed. The function returns the guard of the cache locked again.
+fn dispatch(mut guard: CacheGuard) -> CacheGuard {
+	loop {
+		let cache = guard.get_mut();
+		let Some(dev) = cache.devices.iter()
+			.position(| d | !d.running && !d.queue.is_empty()) else {
+			return guard;
+		};
+
+		let device = &mut cache.devices[dev];
+		device.running = true;
+		let mut batch = device.queue.take();
+		let mut slots = Vec::new();
+		core::mem::swap(&mut slots, &mut device.slots);
+		let interface = device.interface;
+		drop(guard);
+
+		// Safe because registered devices are never removed and the queue of a device is run by
+		// a single process at a time
+		let interface = unsafe {
+			&mut *interface
+		};
+		let result = batch.run(interface, | i, r | {
+			CACHE.lock().get_mut().complete(slots[i], r);
+		});
 
-	/// Flushes the cache, writing every updated sectors to the disk.
-	/// Sectors that have been updated are written to the disk using `flush_hook`.
-	/// On error, flushing is not completed.
-	pub fn flush<F>(&mut self, mut flush_hook: F) -> Result<(), Errno>
-		where F: FnMut(u64, &[u8]) -> Result<(), Errno> {
-		// Writing updated sectors
-		for (index, sector) in self.sectors.iter() {
-			if sector.written {
-				flush_hook(*index, sector.data.as_slice())?;
+		guard = CACHE.lock();
+		let cache = guard.get_mut();
+		if let Err(e) = result {
+			// No request has been performed
+			for slot in slots.iter() {
+				cache.complete(*slot, Err(e));
 			}
 		}
+		let device = &mut cache.devices[dev];
+		device.queue.put_back(batch);
+		device.running = false;
 
-		self.sectors.clear();
-		self.fifo.clear();
-		Ok(())
+		COMPLETION_QUEUE.wake_all();
 	}
 }
 
-/// Structure representing a storage interface wrapped into a cache.
-/// On drop, the cache is flushed to the storage device. When flushing fails, data is lost.
-pub struct CachedStorageInterface {
-	/// The wrapped interface.
-	storage_interface: Box<dyn StorageInterface>,
-
-	/// The cache.
-	cache: StorageCache,
+/// Performs the pending requests, then unlocks the cache and makes the current process sleep
+/// until `cond` returns true.
+/// `guard` is the guard of the cache. The function returns the guard of the cache locked again.
+fn wait<F: FnMut(&BufferCache) -> bool>(guard: CacheGuard, mut cond: F) -> CacheGuard {
+	drop(dispatch(guard));
+	COMPLETION_QUEUE.wait_until(|| cond(CACHE.lock().get()));
+	CACHE.lock()
 }
 
-impl CachedStorageInterface {
-	/// Creates a new instance.
-	/// `storage_interface` is the interface to wrap.
-	/// `sectors_count` is the maximum number of sectors in the cache.
-	pub fn new(storage_interface: Box<dyn StorageInterface>, sectors_count: usize)
-		-> Result<Self, Errno> {
-		let sector_size = storage_interface.get_block_size() as _;
+/// Returns the slot of the block of device `dev` at offset `index`. `guard` is the guard of the
+/// cache, which is unlocked while waiting for the device. The function returns the guard of the
+/// cache locked again along with the slot.
+/// If the block is not in the cache, it is loaded along with the following missing blocks, up to
+/// `batch` blocks in total.
+/// If `fill` is false, the block is not read from the device when missing, leaving its content
+/// undefined.
+/// If `write` is true, the function also waits for the end of the block's write back, so that the
+/// block can be modified.
+fn get_slot(mut guard: CacheGuard, dev: DeviceID, index: u64, batch: u64, fill: bool,
+	write: bool) -> Result<(CacheGuard, Slot), Errno> {
+	let mut counted = false;
+	loop {
+		let cache = guard.get_mut();
+		if cache.is_in_flight(dev, index, write) {
+			if !counted {
+				cache.stats.misses += 1;
+				counted = true;
+			}
+			guard = wait(guard, | c | !c.is_in_flight(dev, index, write));
+			continue;
+		}
 
-		Ok(Self {
-			storage_interface,
+		if let Some(slot) = cache.slots.get(&(dev, index)).copied() {
+			let block = &cache.blocks[slot];
+			if let (Some(e), false) = (block.error, block.dirty) {
+				// The block could not be loaded. Removing it so that the next access retries
+				cache.remove_block(slot);
+				return Err(e);
+			}
 
-			cache: StorageCache::new(sectors_count, sector_size)?,
-		})
+			if !counted {
+				cache.stats.hits += 1;
+			}
+			cache.touch(slot);
+			return Ok((guard, slot));
+		}
+		if !counted {
+			cache.stats.misses += 1;
+			counted = true;
+		}
+
+		if !fill {
+			if let Some(slot) = cache.alloc_slot(dev, index)? {
+				return Ok((guard, slot));
+			}
+			guard = wait(guard, BufferCache::can_alloc);
+			continue;
+		}
+
+		// Requesting the missing blocks of the batch
+		let count = cache.missing_count(dev, index, batch);
+		let mut result = Ok(0);
+		for j in 0..count {
+			let slot = match cache.alloc_slot(dev, index + j) {
+				Ok(Some(slot)) => slot,
+				Ok(None) => break,
+
+				Err(e) => {
+					result = Err(e);
+					break;
+				},
+			};
+			if let Err(e) = cache.push_request(slot, false) {
+				cache.remove_block(slot);
+				result = Err(e);
+				break;
+			}
+			result = Ok(j + 1);
+		}
+
+		match result {
+			// No slot is available
+			Ok(0) => guard = wait(guard, BufferCache::can_alloc),
+			Ok(_) => guard = dispatch(guard),
+
+			// Performing the requests of the batch even if the first block fails
+			Err(e) => {
+				drop(dispatch(guard));
+				return Err(e);
+			},
+		}
 	}
 }
 
-impl StorageInterface for CachedStorageInterface {
-	fn get_block_size(&self) -> u64 {
-		self.storage_interface.get_block_size()
+/// Writes back every dirty blocks of the device `dev` and waits for the completion. If `dev` is
+/// None, the blocks of every devices are written back. `guard` is the guard of the cache.
+/// If a block cannot be written back, the function returns an error.
+fn flush(mut guard: CacheGuard, dev: Option<DeviceID>) -> Result<(), Errno> {
+	let cache = guard.get_mut();
+	if cache.dirty_count == 0 {
+		return Ok(());
 	}
 
-	fn get_blocks_count(&self) -> u64 {
-		self.storage_interface.get_blocks_count()
+	let mut dirty = Vec::with_capacity(cache.dirty_count)?;
+	for (slot, block) in cache.blocks.iter().enumerate() {
+		if block.dirty && dev.map_or(true, | dev | dev == block.dev) {
+			dirty.push(((block.dev, block.index), slot))?;
+		}
 	}
 
-	fn read(&mut self, buf: &mut [u8], offset: u64, size: u64) -> Result<(), Errno> {
-		let block_size = self.get_block_size();
+	let mut result = Ok(());
+	for (_, slot) in dirty.iter() {
+		// Blocks that are already being written back are waited for
+		if cache.blocks[*slot].state != BlockState::Ready {
+			continue;
+		}
 
-		for i in 0..size {
-			let buf_begin = (block_size * i) as usize;
-			let buf_end = (block_size * (i + 1)) as usize;
-			let buf = &mut buf[buf_begin..buf_end];
+		if let Err(e) = cache.push_request(*slot, true) {
+			result = Err(e);
+			break;
+		}
+	}
 
-			if self.cache.read(offset + i, buf)?.is_none() {
-				self.storage_interface.read(buf, offset + i, 1)?;
+	guard = wait(guard, | c | {
+		dirty.iter().all(| ((dev, index), _) | !c.is_in_flight(*dev, *index, true))
+	});
 
-				self.cache.insert(offset + i, buf, | off, buf | {
-					self.storage_interface.write(buf, off, 1)
-				})?;
-			}
+	let cache = guard.get_mut();
+	for (key, slot) in dirty.iter() {
+		if cache.slots.get(key) != Some(slot) || !cache.blocks[*slot].dirty {
+			continue;
+		}
+		if let Some(e) = cache.blocks[*slot].error.take() {
+			result = Err(e);
 		}
+	}
+	result
+}
 
+/// Writes back dirty blocks if too many blocks are dirty. Otherwise, performs the pending
+/// requests. `guard` is the guard of the cache.
+fn flush_if_needed(guard: CacheGuard) -> Result<(), Errno> {
+	if guard.get().dirty_count >= DIRTY_THRESHOLD {
+		flush(guard, None)
+	} else {
+		drop(dispatch(guard));
 		Ok(())
 	}
+}
 
-	fn write(&mut self, buf: &[u8], offset: u64, size: u64) -> Result<(), Errno> {
-		let block_size = self.get_block_size();
+/// Registers the storage interface `interface` on the cache and returns its ID.
+/// The interface must remain valid as long as the kernel is running.
+pub fn register_device(interface: *mut dyn StorageInterface) -> Result<DeviceID, Errno> {
+	let mut guard = CACHE.lock();
+	let cache = guard.get_mut();
+
+	cache.devices.push(CacheDevice {
+		interface,
+		queue: RequestQueue::new(),
+		slots: Vec::new(),
+		running: false,
+	})?;
+	Ok((cache.devices.len() - 1) as _)
+}
 
-		for i in 0..size {
-			let buf_begin = (block_size * i) as usize;
-			let buf_end = (block_size * (i + 1)) as usize;
-			let buf = &buf[buf_begin..buf_end];
+/// Reads bytes from the device `dev` at offset `offset`, writing the data to `buf`.
+/// If the offset and size are out of bounds, the function returns an error.
+pub fn read_bytes(dev: DeviceID, buf: &mut [u8], offset: u64) -> Result<u64, Errno> {
+	let mut guard = CACHE.lock();
+	let block_size = guard.get_mut().check_bounds(dev, offset, buf.len())?;
+
+	let mut i = 0;
+	while i < buf.len() {
+		let off = offset + i as u64;
+		let index = off / block_size;
+		let inner_off = (off % block_size) as usize;
+		let len = min(buf.len() - i, block_size as usize - inner_off);
+
+		// Missing blocks of the range are loaded together
+		let remaining = math::ceil_division((buf.len() - i + inner_off) as u64, block_size);
+		let slot;
+		(guard, slot) = get_slot(guard, dev, index, min(remaining, MAX_BATCH), true, false)?;
+		let data = guard.get().blocks[slot].data.as_slice();
+		buf[i..(i + len)].copy_from_slice(&data[inner_off..(inner_off + len)]);
+
+		i += len;
+	}
 
-			if self.cache.write(offset + i, buf)?.is_none() {
-				self.cache.insert(offset + i, buf, | off, buf | {
-					self.storage_interface.write(buf, off, 1)
-				})?;
-			}
+	flush_if_needed(guard)?;
+	Ok(buf.len() as _)
+}
+
+/// Writes bytes to the device `dev` at offset `offset`, reading the data from `buf`.
+/// The data is written to the device later (see the module's documentation).
+/// If the offset and size are out of bounds, the function returns an error.
+pub fn write_bytes(dev: DeviceID, buf: &[u8], offset: u64) -> Result<u64, Errno> {
+	let mut guard = CACHE.lock();
+	let block_size = guard.get_mut().check_bounds(dev, offset, buf.len())?;
+
+	let mut i = 0;
+	while i < buf.len() {
+		let off = offset + i as u64;
+		let index = off / block_size;
+		let inner_off = (off % block_size) as usize;
+		let len = min(buf.len() - i, block_size as usize - inner_off);
+
+		// A block that is entirely overwritten doesn't need to be read first
+		let fill = len != block_size as usize;
+		let slot;
+		(guard, slot) = get_slot(guard, dev, index, 1, fill, true)?;
+		let cache = guard.get_mut();
+		let data = cache.blocks[slot].data.as_slice_mut();
+		data[inner_off..(inner_off + len)].copy_from_slice(&buf[i..(i + len)]);
+		cache.blocks[slot].error = None;
+		cache.set_dirty(slot);
+
+		i += len;
+	}
+
+	flush_if_needed(guard)?;
+	Ok(buf.len() as _)
+}
+
+/// Requests the blocks of the device `dev` that cover the range of `size` bytes at offset
+/// `offset`, in prevision of a future read. At most `MAX_BATCH` blocks are requested.
+/// If another process is running the device's queue, the function returns without waiting for
+/// the blocks.
+/// Since readahead is only a hint, errors are ignored.
+pub fn readahead(dev: DeviceID, offset: u64, size: u64) {
+	let mut guard = CACHE.lock();
+	let cache = guard.get_mut();
+	let Ok(block_size) = cache.check_bounds(dev, offset, size as _) else {
+		return;
+	};
+
+	let begin = offset / block_size;
+	let end = min(math::ceil_division(offset + size, block_size), begin + MAX_BATCH);
+
+	// Contiguous missing blocks are merged by the request queue
+	for index in begin..end {
+		if cache.slots.get(&(dev, index)).is_some() {
+			continue;
 		}
 
-		Ok(())
+		let Ok(Some(slot)) = cache.alloc_slot(dev, index) else {
+			break;
+		};
+		if cache.push_request(slot, false).is_err() {
+			cache.remove_block(slot);
+			break;
+		}
+		cache.stats.readahead += 1;
 	}
+
+	drop(dispatch(guard));
 }
 
-impl Drop for CachedStorageInterface {
-	fn drop(&mut self) {
-		let _ = self.cache.flush(| off, buf | {
-			let _ = self.storage_interface.write(buf, off, 1);
+/// Writes back every dirty blocks of the device `dev` to it. If `dev` is None, the blocks of every
+/// devices are written back.
+pub fn sync(dev: Option<DeviceID>) -> Result<(), Errno> {
+	flush(CACHE.lock(), dev)
+}
+
+/// The body of the flush thread, which writes back the dirty blocks every `FLUSH_INTERVAL`
+/// nanoseconds.
+fn flush_thread() -> ! {
+	// The queue is never woken up, the thread only sleeps until the deadline
+	let queue = WaitQueue::new();
+
+	loop {
+		let now = time::get_clock(time::CLOCK_MONOTONIC).unwrap_or(0);
+		queue.wait_until_deadline(|| false, now.saturating_add(FLUSH_INTERVAL));
+
+		// On failure, the blocks remain dirty and are written back at the next flush
+		let _ = sync(None);
+	}
+}
+
+/// Starts the flush thread, which writes back the dirty blocks periodically.
+/// Processes must have been initialized.
+pub fn init_flush() -> Result<(), Errno> {
+	Process::new_kernel_thread(flush_thread)?;
+	Ok(())
+}
+
+/// Returns the statistics of the request queue of the device `dev`.
+pub fn get_queue_stats(dev: DeviceID) -> queue::Stats {
+	CACHE.lock().get().devices[dev as usize].queue.get_stats()
+}
+
+/// Returns the statistics of the buffer cache.
+pub fn get_stats() -> Stats {
+	CACHE.lock().get().stats
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	/// The size of a block of the test disk, in bytes.
+	const TEST_BLOCK_SIZE: usize = 16;
+	/// The number of blocks of the test disk.
+	const TEST_BLOCKS_COUNT: usize = CAPACITY + 64;
+
+	/// A storage interface keeping its blocks in memory and counting the requests it receives.
+	struct TestDisk {
+		/// The content of the disk.
+		data: [u8; TEST_BLOCK_SIZE * TEST_BLOCKS_COUNT],
+		/// The number of received read requests.
+		reads: usize,
+		/// The number of received write requests.
+		writes: usize,
+	}
+
+	impl StorageInterface for TestDisk {
+		fn get_block_size(&self) -> u64 {
+			TEST_BLOCK_SIZE as _
+		}
+
+		fn get_blocks_count(&self) -> u64 {
+			TEST_BLOCKS_COUNT as _
+		}
+
+		fn read(&mut self, buf: &mut [u8], offset: u64, size: u64) -> Result<(), Errno> {
+			let begin = offset as usize * TEST_BLOCK_SIZE;
+			let len = size as usize * TEST_BLOCK_SIZE;
+			buf[..len].copy_from_slice(&self.data[begin..(begin + len)]);
+			self.reads += 1;
 			Ok(())
-		});
+		}
+
+		fn write(&mut self, buf: &[u8], offset: u64, size: u64) -> Result<(), Errno> {
+			let begin = offset as usize * TEST_BLOCK_SIZE;
+			let len = size as usize * TEST_BLOCK_SIZE;
+			self.data[begin..(begin + len)].copy_from_slice(&buf[..len]);
+			self.writes += 1;
+			Ok(())
+		}
+	}
+
+	/// The test disk. Each test uses its own range of blocks.
+	static mut DISK: TestDisk = TestDisk {
+		data: [0; TEST_BLOCK_SIZE * TEST_BLOCKS_COUNT],
+		reads: 0,
+		writes: 0,
+	};
+	/// The ID of the test disk on the cache.
+	static mut DISK_ID: Option<DeviceID> = None;
+
+	/// Returns the ID of the test disk, registering it on the first call.
+	fn get_disk() -> DeviceID {
+		unsafe {
+			*DISK_ID.get_or_insert_with(|| register_device(&mut DISK).unwrap())
+		}
+	}
+
+	/// Returns the content of the block at offset `index` of the test disk.
+	fn disk_block(index: usize) -> &'static [u8] {
+		let begin = index * TEST_BLOCK_SIZE;
+		unsafe {
+			&DISK.data[begin..(begin + TEST_BLOCK_SIZE)]
+		}
+	}
+
+	#[test_case]
+	fn buffer_cache_hit0() {
+		let dev = get_disk();
+		let offset = (TEST_BLOCK_SIZE * 2) as u64;
+		unsafe {
+			DISK.data[(offset as usize)..(offset as usize + TEST_BLOCK_SIZE)].fill(0x42);
+		}
+
+		let mut buf = [0; TEST_BLOCK_SIZE];
+		let stats = get_stats();
+		read_bytes(dev, &mut buf, offset).unwrap();
+		assert_eq!(get_stats().misses, stats.misses + 1);
+		assert_eq!(get_stats().hits, stats.hits);
+		assert!(buf.iter().all(| b | *b == 0x42));
+
+		// The disk is not read again on a hit
+		unsafe {
+			DISK.data[(offset as usize)..(offset as usize + TEST_BLOCK_SIZE)].fill(0);
+		}
+		read_bytes(dev, &mut buf, offset).unwrap();
+		assert_eq!(get_stats().misses, stats.misses + 1);
+		assert_eq!(get_stats().hits, stats.hits + 1);
+		assert!(buf.iter().all(| b | *b == 0x42));
+	}
+
+	#[test_case]
+	fn buffer_cache_write_back0() {
+		let dev = get_disk();
+		let index = 8;
+		let buf = [0xaa; TEST_BLOCK_SIZE];
+
+		let writes = unsafe { DISK.writes };
+		write_bytes(dev, &buf, (index * TEST_BLOCK_SIZE) as _).unwrap();
+		assert_eq!(unsafe { DISK.writes }, writes);
+		assert!(disk_block(index).iter().all(| b | *b == 0));
+
+		sync(Some(dev)).unwrap();
+		assert_eq!(unsafe { DISK.writes }, writes + 1);
+		assert_eq!(disk_block(index), &buf);
+
+		// A clean block is not written again
+		sync(Some(dev)).unwrap();
+		assert_eq!(unsafe { DISK.writes }, writes + 1);
+	}
+
+	#[test_case]
+	fn buffer_cache_evict0() {
+		let dev = get_disk();
+		let index = 16;
+		let buf = [0xbb; TEST_BLOCK_SIZE];
+		write_bytes(dev, &buf, (index * TEST_BLOCK_SIZE) as _).unwrap();
+
+		// Filling the cache with other blocks to evict the dirty block
+		let mut chunk = [0; TEST_BLOCK_SIZE * MAX_BATCH as usize];
+		for i in (0..CAPACITY).step_by(MAX_BATCH as _) {
+			read_bytes(dev, &mut chunk, ((64 + i) * TEST_BLOCK_SIZE) as _).unwrap();
+		}
+		assert_eq!(disk_block(index), &buf);
+
+		let stats = get_stats();
+		let mut buf = [0; TEST_BLOCK_SIZE];
+		read_bytes(dev, &mut buf, (index * TEST_BLOCK_SIZE) as _).unwrap();
+		assert_eq!(get_stats().misses, stats.misses + 1);
+		assert!(buf.iter().all(| b | *b == 0xbb));
+	}
+
+	#[test_case]
+	fn buffer_cache_merge0() {
+		let dev = get_disk();
+
+		// While another process runs the queue, requests of several callers are only queued
+		CACHE.lock().get_mut().devices[dev as usize].running = true;
+		readahead(dev, (32 * TEST_BLOCK_SIZE) as _, (4 * TEST_BLOCK_SIZE) as _);
+		readahead(dev, (36 * TEST_BLOCK_SIZE) as _, (4 * TEST_BLOCK_SIZE) as _);
+		assert!(CACHE.lock().get().is_in_flight(dev, 32, false));
+		assert!(CACHE.lock().get().is_in_flight(dev, 39, false));
+
+		// The next batch serves them with a single request
+		let reads = unsafe { DISK.reads };
+		CACHE.lock().get_mut().devices[dev as usize].running = false;
+		drop(dispatch(CACHE.lock()));
+		assert_eq!(unsafe { DISK.reads }, reads + 1);
+		assert!(!CACHE.lock().get().is_in_flight(dev, 32, false));
+
+		let stats = get_stats();
+		let mut buf = [0; 8 * TEST_BLOCK_SIZE];
+		read_bytes(dev, &mut buf, (32 * TEST_BLOCK_SIZE) as _).unwrap();
+		assert_eq!(get_stats().hits, stats.hits + 8);
+		assert_eq!(unsafe { DISK.reads }, reads + 1);
 	}
 }
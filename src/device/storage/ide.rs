@@ -31,6 +31,8 @@ pub struct IDEController {
 
 	/// Addresses to access the IDE controller.
 	io_addresses: [BAR; 4],
+	/// The base port of the bus master registers, if the controller supports DMA.
+	bus_master: Option<u16>,
 }
 
 impl IDEController {
@@ -40,8 +42,17 @@ impl IDEController {
 		debug_assert_eq!(dev.get_class(), pci::CLASS_MASS_STORAGE_CONTROLLER);
 		debug_assert_eq!(dev.get_subclass(), 0x01);
 
+		let prog_if = dev.get_prog_if();
+		let bus_master = dev.get_bar(4)
+			.filter(| bar | prog_if & 0b10000000 != 0 && bar.is_io())
+			.map(| bar | bar.get_physical_address() as u16)
+			.filter(| port | *port != 0);
+		if bus_master.is_some() {
+			dev.enable_bus_master();
+		}
+
 		Self {
-			prog_if: dev.get_prog_if(),
+			prog_if,
 
 			io_addresses: [
 				dev.get_bar(0).unwrap(),
@@ -49,6 +60,7 @@ impl IDEController {
 				dev.get_bar(2).unwrap(),
 				dev.get_bar(3).unwrap(),
 			],
+			bus_master,
 		}
 	}
 
@@ -109,16 +121,12 @@ impl IDEController {
 	/// `slave` tells whether the disk is the slave disk.
 	pub fn detect(&self, secondary: bool, slave: bool)
 		-> Result<Option<Box<dyn StorageInterface>>, Errno> {
-		// TODO Add support for DMA and SATA
-
-		if let Ok(interface) = PATAInterface::new(secondary, slave) {
-			let interface = Box::new(interface)?;
-
-			// Wrapping the interface into a cached interface
-			// TODO Use a constant for the sectors count
-			//let interface = Box::new(CachedStorageInterface::new(interface, 1024)?)?;
+		// TODO Add support for SATA
 
-			Ok(Some(interface))
+		if let Ok(interface) = PATAInterface::new(secondary, slave, self.bus_master) {
+			// Caching is done by the buffer cache when the interface is added to the storage
+			// manager
+			Ok(Some(Box::new(interface)?))
 		} else {
 			Ok(None)
 		}
@@ -1,13 +1,16 @@
 //! This module implements storage drivers.
 
+pub mod ahci;
 pub mod cache;
 pub mod ide;
 pub mod mbr;
 pub mod pata;
+pub mod queue;
 pub mod ramdisk;
 
 use core::cmp::min;
 use core::ffi::c_void;
+use core::slice;
 use crate::device::Device;
 use crate::device::DeviceHandle;
 use crate::device::DeviceType;
@@ -16,6 +19,7 @@ use crate::device::id::MajorBlock;
 use crate::device::id;
 use crate::device::manager::DeviceManager;
 use crate::device::manager::PhysicalDevice;
+use crate::device::storage::ahci::AHCIController;
 use crate::device::storage::ide::IDEController;
 use crate::device;
 use crate::errno::Errno;
@@ -40,8 +44,28 @@ const STORAGE_MODE: Mode = 0o660;
 /// The maximum number of partitions in a disk.
 const MAX_PARTITIONS: u32 = 16;
 
+/// The tag identifying a request submitted asynchronously to a storage interface.
+pub type RequestTag = u32;
+
+/// A request to read or write blocks, submitted asynchronously to a storage interface.
+pub struct Request {
+	/// The buffer to read the data into, or to write the data from. Its size must be at least
+	/// `size` blocks.
+	pub buf: *mut u8,
+	/// The offset of the first block on the storage.
+	pub offset: u64,
+	/// The number of blocks.
+	pub size: u64,
+	/// Tells whether the request is a write.
+	pub write: bool,
+}
+
 /// Trait representing a storage interface. A storage block is the atomic unit for I/O access on
 /// the storage device.
+///
+/// Blocks can be accessed either synchronously with `read` and `write`, or asynchronously by
+/// submitting requests with `submit` and then waiting for their completion with `complete`.
+/// Interfaces that cannot queue requests perform them directly on submission.
 pub trait StorageInterface {
 	/// Returns the size of the storage blocks in bytes.
 	/// This value must always stay the same.
@@ -57,6 +81,38 @@ pub trait StorageInterface {
 	/// If the offset and size are out of bounds, the function returns an error.
 	fn write(&mut self, buf: &[u8], offset: u64, size: u64) -> Result<(), Errno>;
 
+	/// Returns the maximum number of requests that can be in flight at the same time.
+	fn get_queue_depth(&self) -> usize {
+		1
+	}
+
+	/// Submits the request `req`.
+	/// If the request is queued, the function returns its tag, which must then be given to
+	/// `complete`.
+	/// If the request has been performed before returning, the function returns None.
+	/// If the queue is full, the function returns EAGAIN.
+	///
+	/// # Safety
+	///
+	/// The request's buffer must remain valid and must not be accessed until the request has
+	/// completed.
+	unsafe fn submit(&mut self, req: &Request) -> Result<Option<RequestTag>, Errno> {
+		let len = (req.size * self.get_block_size()) as usize;
+		if req.write {
+			self.write(slice::from_raw_parts(req.buf, len), req.offset, req.size)?;
+		} else {
+			self.read(slice::from_raw_parts_mut(req.buf, len), req.offset, req.size)?;
+		}
+
+		Ok(None)
+	}
+
+	/// Waits for the completion of the request with tag `tag` and returns its result. The tag
+	/// can be reused by another request afterwards.
+	fn complete(&mut self, _tag: RequestTag) -> Result<(), Errno> {
+		Ok(())
+	}
+
 	// Unit testing is done through ramdisk testing
 	/// Reads bytes from storage at offset `offset`, writing the data to `buf`.
 	/// If the offset and size are out of bounds, the function returns an error.
@@ -254,6 +310,8 @@ pub mod partition {
 pub struct StorageDeviceHandle {
 	/// A reference to the storage interface.
 	interface: *mut dyn StorageInterface, // TODO Use a weak ptr?
+	/// The ID of the storage interface on the buffer cache.
+	cache_id: cache::DeviceID,
 
 	/// The offset to the beginning of the partition in bytes.
 	partition_offset: u64,
@@ -266,12 +324,14 @@ impl StorageDeviceHandle {
 	/// the partition number is `0`, the device file is linked to the entire device instead of a
 	/// partition.
 	/// `interface` is the storage interface.
+	/// `cache_id` is the ID of the storage interface on the buffer cache.
 	/// `partition_offset` is the offset to the beginning of the partition in bytes.
 	/// `partition_size` is the size of the partition in bytes.
-	pub fn new(interface: *mut dyn StorageInterface, partition_offset: u64,
-		partition_size: u64) -> Self {
+	pub fn new(interface: *mut dyn StorageInterface, cache_id: cache::DeviceID,
+		partition_offset: u64, partition_size: u64) -> Self {
 		Self {
 			interface,
+			cache_id,
 
 			partition_offset,
 			partition_size,
@@ -298,19 +358,19 @@ impl IO for StorageDeviceHandle {
 	}
 
 	fn read(&mut self, offset: u64, buff: &mut [u8]) -> Result<u64, Errno> {
-		let interface = unsafe { // Safe because the pointer is valid
-			&mut *self.interface
-		};
-
-		interface.read_bytes(buff, offset)
+		cache::read_bytes(self.cache_id, buff, offset)
 	}
 
 	fn write(&mut self, offset: u64, buff: &[u8]) -> Result<u64, Errno> {
-		let interface = unsafe { // Safe because the pointer is valid
-			&mut *self.interface
-		};
+		cache::write_bytes(self.cache_id, buff, offset)
+	}
+
+	fn readahead(&mut self, offset: u64, size: u64) {
+		cache::readahead(self.cache_id, offset, size);
+	}
 
-		interface.write_bytes(buff, offset)
+	fn sync(&mut self) -> Result<(), Errno> {
+		cache::sync(Some(self.cache_id))
 	}
 }
 
@@ -353,9 +413,12 @@ impl StorageManager {
 		let main_path = Path::from_str(prefix.as_bytes(), false)?;
 		// The total size of the interface in bytes
 		let total_size = block_size * storage.get_blocks_count();
+		// Accesses to device files go through the buffer cache
+		let cache_id = cache::register_device(storage.as_mut_ptr())?;
 
 		// Creating the main device file
-		let main_handle = StorageDeviceHandle::new(storage.as_mut_ptr(), 0, total_size);
+		let main_handle = StorageDeviceHandle::new(storage.as_mut_ptr(), cache_id, 0,
+			total_size);
 		let main_device = Device::new(major, storage_id * MAX_PARTITIONS, main_path, STORAGE_MODE,
 			DeviceType::Block, main_handle)?;
 		device::register_device(main_device)?;
@@ -375,7 +438,7 @@ impl StorageManager {
 			let size = partition.get_size() * block_size;
 
 			// Creating the partition's device file
-			let handle = StorageDeviceHandle::new(storage.as_mut_ptr(), off, size);
+			let handle = StorageDeviceHandle::new(storage.as_mut_ptr(), cache_id, off, size);
 			let device = Device::new(major, storage_id * MAX_PARTITIONS + i as u32, path,
 				STORAGE_MODE, DeviceType::Block, handle)?;
 			device::register_device(device)?;
@@ -500,12 +563,8 @@ impl DeviceManager for StorageManager {
 			let secondary = (i & 0b10) != 0;
 			let slave = (i & 0b01) != 0;
 
-			if let Ok(dev) = PATAInterface::new(secondary, slave) {
-				let interface = Box::new(dev)?;
-				// TODO Use a constant for the sectors count
-				let cached_interface = CachedStorageInterface::new(interface, 128)?;
-
-				self.add(Box::new(cached_interface)?)?;
+			if let Ok(dev) = PATAInterface::new(secondary, slave, None) {
+				self.add(Box::new(dev)?)?;
 			}
 		}*/
 
@@ -532,6 +591,21 @@ impl DeviceManager for StorageManager {
 				});
 			}
 
+			// SATA controller
+			0x06 if dev.get_prog_if() == 0x01 => {
+				let Some(ahci) = AHCIController::new(dev) else {
+					return;
+				};
+				oom::wrap(|| {
+					let mut interfaces = ahci.detect_all()?;
+					for _ in 0..interfaces.len() {
+						self.add(interfaces.pop().unwrap())?;
+					}
+
+					Ok(())
+				});
+			}
+
 			// TODO Handle other controller types
 
 			_ => {},
@@ -10,13 +10,35 @@
 //! - Select the drive (with the dedicated command)
 //! - Identify it to retrieve informations, such as whether the drives support LBA48
 //!
-//! TODO
+//! Sectors are addressed with LBA28 when possible, or with LBA48 beyond the first 128GiB of the
+//! disk and for large transfers, since a LBA48 command can transfer up to 65536 sectors.
+//!
+//! If the IDE controller supports bus mastering, data is transferred by DMA: the controller
+//! copies between the disk and the physical memory regions listed in a Physical Region
+//! Descriptor Table (PRDT), then raises an interrupt on completion. Else, data is transferred by
+//! PIO.
 
 // TODO Add support for third and fourth bus
 
 use core::cmp::min;
+use core::mem::ManuallyDrop;
+use core::mem::size_of;
+use core::ptr;
+use core::sync::atomic::AtomicBool;
+use core::sync::atomic::AtomicU16;
+use core::sync::atomic::Ordering;
 use crate::errno::Errno;
+use crate::event::InterruptResult;
+use crate::event::InterruptResultAction;
+use crate::event;
+use crate::idt::pic;
 use crate::io;
+use crate::memory::buddy;
+use crate::memory::memmap;
+use crate::memory;
+use crate::process::regs::Regs;
+use crate::process::wait_queue::WaitQueue;
+use crate::util::lock::Mutex;
 use super::StorageInterface;
 
 /// The beginning of the port range for the primary ATA bus.
@@ -61,10 +83,24 @@ const SELECT_SLAVE: u8 = 0xb0;
 
 /// Reads sectors from the disk.
 const COMMAND_READ_SECTORS: u8 = 0x20;
+/// Reads sectors from the disk using LBA48.
+const COMMAND_READ_SECTORS_EXT: u8 = 0x24;
+/// Reads sectors from the disk using DMA.
+const COMMAND_READ_DMA: u8 = 0xc8;
+/// Reads sectors from the disk using DMA and LBA48.
+const COMMAND_READ_DMA_EXT: u8 = 0x25;
 /// Writes sectors on the disk.
 const COMMAND_WRITE_SECTORS: u8 = 0x30;
+/// Writes sectors on the disk using LBA48.
+const COMMAND_WRITE_SECTORS_EXT: u8 = 0x34;
+/// Writes sectors on the disk using DMA.
+const COMMAND_WRITE_DMA: u8 = 0xca;
+/// Writes sectors on the disk using DMA and LBA48.
+const COMMAND_WRITE_DMA_EXT: u8 = 0x35;
 /// Flush cache command.
 const COMMAND_CACHE_FLUSH: u8 = 0xe7;
+/// Flush cache command for LBA48.
+const COMMAND_CACHE_FLUSH_EXT: u8 = 0xea;
 /// Identifies the selected drive.
 const COMMAND_IDENTIFY: u8 = 0xec;
 
@@ -101,8 +137,264 @@ const STATUS_BSY: u8 = 0b10000000;
 /// The size of a sector in bytes.
 const SECTOR_SIZE: u64 = 512;
 
-// TODO Synchronize both master and slave disks so that another thread cannot trigger a select
-// while operating on a drive
+/// The IRQ of the primary ATA bus.
+const PRIMARY_IRQ: u8 = 14;
+/// The IRQ of the secondary ATA bus.
+const SECONDARY_IRQ: u8 = 15;
+/// The interrupt vector of the first IRQ.
+const IRQ_VECTOR_BEGIN: usize = 0x20;
+
+/// The first sector that cannot be addressed with LBA28.
+const LBA28_LIMIT: u64 = 1 << 28;
+/// The maximum number of sectors transferred by a LBA28 command.
+const LBA28_MAX_SECTORS: usize = 256;
+/// The maximum number of sectors transferred by a LBA48 command.
+const LBA48_MAX_SECTORS: usize = 65536;
+
+/// Offset to the bus master command register.
+const BM_COMMAND_OFFSET: u16 = 0;
+/// Offset to the bus master status register.
+const BM_STATUS_OFFSET: u16 = 2;
+/// Offset to the bus master PRDT address register.
+const BM_PRDT_OFFSET: u16 = 4;
+/// The offset of the bus master registers of the secondary bus from the ones of the primary.
+const BM_SECONDARY_OFFSET: u16 = 8;
+
+/// Bus master command: starts the transfer.
+const BM_COMMAND_START: u8 = 0b00000001;
+/// Bus master command: the transfer writes to memory.
+const BM_COMMAND_READ: u8 = 0b00001000;
+
+/// Bus master status: a transfer is in progress.
+const BM_STATUS_ACTIVE: u8 = 0b00000001;
+/// Bus master status: the transfer failed.
+const BM_STATUS_ERR: u8 = 0b00000010;
+/// Bus master status: the drive raised an interrupt.
+const BM_STATUS_IRQ: u8 = 0b00000100;
+/// Bus master status: bits telling whether drives are DMA capable, preserved on write.
+const BM_STATUS_CAPABLE: u8 = 0b01100000;
+
+/// The flag marking the last entry of a PRDT.
+const PRD_EOT: u16 = 0x8000;
+/// The maximum size of the region described by a PRD. A region cannot cross a boundary of this
+/// size either.
+const PRD_MAX_SIZE: usize = 0x10000;
+/// The maximum number of entries in a PRDT, which is stored in a single page.
+const PRDT_MAX_ENTRIES: usize = memory::PAGE_SIZE / size_of::<Prd>();
+/// The order of the frame used as a bounce buffer for DMA transfers.
+const BOUNCE_ORDER: buddy::FrameOrder = 5;
+
+/// A Physical Region Descriptor, describing a region of physical memory for a DMA transfer.
+#[repr(C)]
+struct Prd {
+	/// The physical address of the region.
+	addr: u32,
+	/// The size of the region in bytes. Zero means 64KiB.
+	size: u16,
+	/// Flags.
+	flags: u16,
+}
+
+/// The state of an ATA bus, shared by the drives on it.
+#[derive(Clone, Copy)]
+struct Bus {
+	/// Tells whether the bus has been initialized.
+	init: bool,
+
+	/// The PRDT used for DMA transfers, if the bus supports DMA.
+	prdt: *mut Prd,
+	/// The buffer used for DMA transfers when the caller's buffer is not in the kernel's memory.
+	bounce: *mut u8,
+}
+
+/// The state of each bus.
+static BUSES: [Mutex<Bus>; 2] = {
+	const INIT: Mutex<Bus> = Mutex::new(Bus {
+		init: false,
+
+		prdt: ptr::null_mut(),
+		bounce: ptr::null_mut(),
+	});
+	[INIT; 2]
+};
+/// The base port of the bus master registers of each bus. If zero, the bus doesn't support DMA.
+static BUS_MASTER_PORTS: [AtomicU16; 2] = [AtomicU16::new(0), AtomicU16::new(0)];
+/// Tells, for each bus, whether the current DMA transfer has completed.
+static DMA_COMPLETE: [AtomicBool; 2] = [AtomicBool::new(false), AtomicBool::new(false)];
+/// The processes waiting for the completion of a DMA transfer, for each bus.
+static DMA_WAIT: [WaitQueue; 2] = [WaitQueue::new(), WaitQueue::new()];
+/// Tells, for each bus, whether a drive on it is running a command. Acquiring a bus prevents the
+/// other drive from being selected while a command is running.
+///
+/// Unlike a spin lock, waiting for a bus sleeps, since DMA transfers sleep until completion.
+static BUS_BUSY: [AtomicBool; 2] = [AtomicBool::new(false), AtomicBool::new(false)];
+/// The processes waiting for a bus to be released, for each bus.
+static BUS_WAIT: [WaitQueue; 2] = [WaitQueue::new(), WaitQueue::new()];
+
+/// A bus acquired with `acquire_bus`, released when dropped.
+struct BusGuard {
+	/// The index of the bus.
+	bus: usize,
+}
+
+impl Drop for BusGuard {
+	fn drop(&mut self) {
+		BUS_BUSY[self.bus].store(false, Ordering::Release);
+		BUS_WAIT[self.bus].wake_all();
+	}
+}
+
+/// Acquires the bus `bus`, sleeping until the command running on it, if any, is over.
+fn acquire_bus(bus: usize) -> BusGuard {
+	BUS_WAIT[bus].wait_until(|| {
+		BUS_BUSY[bus].compare_exchange(false, true, Ordering::Acquire, Ordering::Relaxed).is_ok()
+	});
+	BusGuard {
+		bus,
+	}
+}
+
+/// Tells whether the `len` bytes at `ptr` are entirely in the kernel's direct mapping of the
+/// physical memory, in which case they are physically contiguous.
+fn is_direct_mapped(ptr: *const u8, len: usize) -> bool {
+	let mem_info = memmap::get_info();
+	let main_size = mem_info.phys_main_pages * memory::PAGE_SIZE;
+	let phys_end = mem_info.phys_main_begin as usize + main_size;
+	let end = min(phys_end, memory::get_kernelspace_size());
+
+	let Some(phys) = (ptr as usize).checked_sub(memory::PROCESS_END as usize) else {
+		return false;
+	};
+	phys.checked_add(len).map_or(false, | phys_buf_end | phys_buf_end <= end)
+}
+
+/// Handles an interrupt of an ATA bus.
+fn irq_handler(id: u32, _code: u32, _regs: &mut Regs, _ring: u32) -> InterruptResult {
+	let secondary = id as usize == IRQ_VECTOR_BEGIN + SECONDARY_IRQ as usize;
+	let bus = secondary as usize;
+
+	let bm = BUS_MASTER_PORTS[bus].load(Ordering::Acquire);
+	if bm != 0 {
+		unsafe {
+			let status = io::inb(bm + BM_STATUS_OFFSET);
+			if status & BM_STATUS_IRQ != 0 {
+				io::outb(bm + BM_STATUS_OFFSET, (status & BM_STATUS_CAPABLE) | BM_STATUS_IRQ);
+				DMA_COMPLETE[bus].store(true, Ordering::Release);
+				DMA_WAIT[bus].wake_all();
+			}
+		}
+	}
+
+	// Reading the status acknowledges the interrupt on the drive
+	let base = if !secondary {
+		PRIMARY_ATA_BUS_PORT_BEGIN
+	} else {
+		SECONDARY_ATA_BUS_PORT_BEGIN
+	};
+	unsafe {
+		io::inb(base + STATUS_REGISTER_OFFSET);
+	}
+
+	InterruptResult::new(false, InterruptResultAction::Resume)
+}
+
+/// Initializes the bus `bus` if not already done.
+/// `bus_master` is the base port of the bus master registers of the IDE controller. If None, DMA
+/// is not available.
+fn init_bus(bus: &mut Bus, secondary: bool, bus_master: Option<u16>) -> Result<(), Errno> {
+	if bus.init {
+		return Ok(());
+	}
+
+	if let Some(bm) = bus_master {
+		let prdt = buddy::alloc_kernel(0)?;
+		let bounce = match buddy::alloc_kernel(BOUNCE_ORDER) {
+			Ok(bounce) => bounce,
+			Err(e) => {
+				buddy::free_kernel(prdt, 0);
+				return Err(e);
+			},
+		};
+		bus.prdt = prdt as _;
+		bus.bounce = bounce as _;
+
+		let bm = bm + if secondary {
+			BM_SECONDARY_OFFSET
+		} else {
+			0
+		};
+		BUS_MASTER_PORTS[secondary as usize].store(bm, Ordering::Release);
+	}
+
+	let irq = if secondary {
+		SECONDARY_IRQ
+	} else {
+		PRIMARY_IRQ
+	};
+	let hook = event::register_callback(IRQ_VECTOR_BEGIN + irq as usize, 0, irq_handler)?;
+	let _ = ManuallyDrop::new(hook);
+	pic::enable_irq(irq);
+
+	bus.init = true;
+	Ok(())
+}
+
+/// Fills the PRDT `prdt` with the regions describing the `len` bytes of physical memory at
+/// address `phys`, splitting them on 64KiB boundaries.
+/// The function returns the number of used entries.
+///
+/// # Safety
+///
+/// The PRDT must have enough entries for the regions.
+unsafe fn fill_prdt(prdt: *mut Prd, phys: usize, len: usize) -> usize {
+	let end = phys + len;
+	let mut addr = phys;
+	let mut i = 0;
+	while addr < end {
+		let boundary = (addr / PRD_MAX_SIZE + 1) * PRD_MAX_SIZE;
+		let len = min(end, boundary) - addr;
+
+		let flags = if min(end, boundary) == end {
+			PRD_EOT
+		} else {
+			0
+		};
+		ptr::write_volatile(prdt.add(i), Prd {
+			addr: addr as _,
+			// A size of 64KiB is encoded as zero
+			size: (len % PRD_MAX_SIZE) as _,
+			flags,
+		});
+
+		addr += len;
+		i += 1;
+	}
+
+	i
+}
+
+/// The buffer of a transfer.
+enum TransferBuffer<'a> {
+	/// The transfer reads from the disk into the buffer.
+	Read(&'a mut [u8]),
+	/// The transfer writes the buffer to the disk.
+	Write(&'a [u8]),
+}
+
+impl<'a> TransferBuffer<'a> {
+	/// Returns the pointer to the beginning of the buffer.
+	fn as_ptr(&self) -> *const u8 {
+		match self {
+			Self::Read(buf) => buf.as_ptr(),
+			Self::Write(buf) => buf.as_ptr(),
+		}
+	}
+
+	/// Tells whether the transfer is a write.
+	fn is_write(&self) -> bool {
+		matches!(self, Self::Write(_))
+	}
+}
 
 /// Structure representing a PATA interface. An instance is associated with a unique disk.
 pub struct PATAInterface {
@@ -113,6 +405,8 @@ pub struct PATAInterface {
 
 	/// Tells whether the drive supports LBA48.
 	lba48: bool,
+	/// Tells whether transfers are done by DMA.
+	dma: bool,
 
 	/// The number of sectors on the disk.
 	sectors_count: u64,
@@ -122,16 +416,27 @@ impl PATAInterface {
 	/// Creates a new instance. On error, the function returns a string telling the cause.
 	/// `secondary` tells whether the disk is on the secondary bus.
 	/// `slave` tells whether the disk is the slave disk.
-	pub fn new(secondary: bool, slave: bool) -> Result<Self, &'static str> {
+	/// `bus_master` is the base port of the bus master registers of the IDE controller. If None,
+	/// transfers are done by PIO.
+	pub fn new(secondary: bool, slave: bool, bus_master: Option<u16>)
+		-> Result<Self, &'static str> {
 		let mut s = Self {
 			secondary,
 			slave,
 
 			lba48: false,
+			dma: false,
 
 			sectors_count: 0,
 		};
+
+		let _bus = acquire_bus(secondary as usize);
+		let mut bus_guard = BUSES[secondary as usize].lock();
+		let bus = bus_guard.get_mut();
 		s.identify()?;
+		init_bus(bus, secondary, bus_master).map_err(| _ | "Cannot initialize the bus")?;
+		s.dma &= !bus.prdt.is_null();
+
 		Ok(s)
 	}
 
@@ -150,6 +455,11 @@ impl PATAInterface {
 		self.lba48
 	}
 
+	/// Tells whether transfers are done by DMA.
+	pub fn is_dma(&self) -> bool {
+		self.dma
+	}
+
 	/// Returns the port for the register at offset `offset`.
 	fn get_register_port(&self, offset: u16) -> u16 {
 		(if !self.secondary {
@@ -233,24 +543,58 @@ impl PATAInterface {
 	}
 
 	/// Flushes the drive's cache. The device is assumed to be selected.
-	fn cache_flush(&self) {
-		self.send_command(COMMAND_CACHE_FLUSH);
+	/// `lba48` tells whether the LBA48 version of the command must be used.
+	fn cache_flush(&self, lba48: bool) {
+		self.send_command(if lba48 {
+			COMMAND_CACHE_FLUSH_EXT
+		} else {
+			COMMAND_CACHE_FLUSH
+		});
 		self.wait_busy();
 	}
 
 	/// Sets the number `count` of sectors to read/write. The device is assumed to be selected.
-	fn set_sectors_count(&self, count: u16) {
+	fn set_sectors_count(&self, count: u8) {
 		unsafe {
-			io::outw(SECTORS_COUNT_REGISTER_OFFSET, count);
+			io::outb(self.get_register_port(SECTORS_COUNT_REGISTER_OFFSET), count);
 		}
 	}
 
-	/// Sets the LBA offset `offset`. The device is assumed to be selected.
+	/// Sets the low 24 bits of the LBA offset `offset`. The device is assumed to be selected.
 	fn set_lba(&self, offset: u64) {
 		unsafe {
-			io::outw(LBA_LO_REGISTER_OFFSET, ((offset >> 32) & 0xffff) as _);
-			io::outw(LBA_MID_REGISTER_OFFSET, ((offset >> 16) & 0xffff) as _);
-			io::outw(LBA_HI_REGISTER_OFFSET, (offset & 0xffff) as _);
+			io::outb(self.get_register_port(LBA_LO_REGISTER_OFFSET), (offset & 0xff) as _);
+			io::outb(self.get_register_port(LBA_MID_REGISTER_OFFSET), ((offset >> 8) & 0xff) as _);
+			io::outb(self.get_register_port(LBA_HI_REGISTER_OFFSET), ((offset >> 16) & 0xff) as _);
+		}
+	}
+
+	/// Sets up the registers for a transfer of `count` sectors at offset `offset`. The device is
+	/// assumed to be selected.
+	/// `lba48` tells whether LBA48 is used.
+	fn setup_transfer(&self, offset: u64, count: usize, lba48: bool) {
+		let slave = (self.slave as u8) << 4;
+		let drive_port = self.get_register_port(DRIVE_REGISTER_OFFSET);
+
+		if lba48 {
+			debug_assert!(count <= LBA48_MAX_SECTORS);
+
+			unsafe {
+				io::outb(drive_port, 0x40 | slave);
+			}
+			// The high bytes are written first
+			self.set_sectors_count(((count >> 8) & 0xff) as _);
+			self.set_lba(offset >> 24);
+			self.set_sectors_count((count & 0xff) as _);
+			self.set_lba(offset);
+		} else {
+			debug_assert!(count <= LBA28_MAX_SECTORS);
+
+			unsafe {
+				io::outb(drive_port, 0xe0 | slave | ((offset >> 24) & 0x0f) as u8);
+			}
+			self.set_sectors_count((count & 0xff) as _);
+			self.set_lba(offset);
 		}
 	}
 
@@ -317,13 +661,12 @@ impl PATAInterface {
 
 		let data_port = self.get_register_port(DATA_REGISTER_OFFSET);
 		let mut data: [u16; 256] = [0; 256];
-		for d in data.iter_mut() {
-			*d = unsafe {
-				io::inw(data_port)
-			};
+		unsafe {
+			io::insw(data_port, data.as_mut_ptr(), data.len());
 		}
 
 		let lba48_support = data[83] & (1 << 10) != 0;
+		let dma_support = data[49] & (1 << 8) != 0;
 		let lba28_size = (data[60] as u32) | ((data[61] as u32) << 16);
 		let lba48_size = (data[100] as u64) | ((data[101] as u64) << 16)
 			| ((data[102] as u64) << 32) | ((data[103] as u64) << 48);
@@ -333,6 +676,7 @@ impl PATAInterface {
 		}
 
 		self.lba48 = lba48_support;
+		self.dma = dma_support;
 		self.sectors_count = if lba48_support {
 			lba48_size
 		} else {
@@ -357,124 +701,191 @@ impl PATAInterface {
 		}
 	}
 
-	/// Reads `size` blocks from storage at block offset `offset`, writing the data to `buf`.
-	/// The function uses LBA28, thus the offset is assumed to be in range.
-	fn read28(&self, buf: &mut [u8], offset: u64, size: usize) -> Result<(), Errno> {
-		self.select(false);
+	/// Returns whether a transfer of at most `size` sectors at offset `offset` must use LBA48,
+	/// along with the maximum number of sectors a single command can transfer.
+	/// If the offset cannot be addressed by the drive, the function returns an error.
+	fn get_addressing(&self, offset: u64, size: usize) -> Result<(bool, usize), Errno> {
+		let count = min(size, LBA28_MAX_SECTORS);
+		if offset + count as u64 <= LBA28_LIMIT && (!self.lba48 || size <= LBA28_MAX_SECTORS) {
+			Ok((false, LBA28_MAX_SECTORS))
+		} else if self.lba48 {
+			Ok((true, LBA48_MAX_SECTORS))
+		} else {
+			Err(crate::errno!(EINVAL))
+		}
+	}
 
+	/// Transfers `count` sectors at offset `offset` by PIO. The device is assumed to be selected.
+	/// `buf` is the buffer to transfer.
+	/// `lba48` tells whether LBA48 is used.
+	fn pio_transfer(&self, buf: &mut TransferBuffer, offset: u64, count: usize, lba48: bool)
+		-> Result<(), Errno> {
 		let data_port = self.get_register_port(DATA_REGISTER_OFFSET);
+		let words = SECTOR_SIZE as usize / size_of::<u16>();
+
+		self.setup_transfer(offset, count, lba48);
+		self.send_command(match (buf.is_write(), lba48) {
+			(false, false) => COMMAND_READ_SECTORS,
+			(false, true) => COMMAND_READ_SECTORS_EXT,
+			(true, false) => COMMAND_WRITE_SECTORS,
+			(true, true) => COMMAND_WRITE_SECTORS_EXT,
+		});
+
+		for i in 0..count {
+			self.wait_io()?;
+
+			let off = i * SECTOR_SIZE as usize;
+			match buf {
+				TransferBuffer::Read(buf) => unsafe {
+					io::insw(data_port, buf[off..].as_mut_ptr() as _, words);
+				},
+
+				TransferBuffer::Write(buf) => unsafe {
+					io::outsw(data_port, buf[off..].as_ptr() as _, words);
+				},
+			}
+		}
 
-		let mut i = 0;
-		while i < size {
-			// The number of blocks for this iteration
-			let count = min(size - i, 256);
+		if buf.is_write() {
+			self.cache_flush(lba48);
+		}
+		Ok(())
+	}
 
-			unsafe {
-				let drive = if self.slave {
-					0xf0
-				} else {
-					0xe0
-				} | ((offset >> 24) & 0x0f) as u8;
-				let lo_lba = (offset & 0xff) as u8;
-				let mid_lba = ((offset >> 8) & 0xff) as u8;
-				let hi_lba = ((offset >> 16) & 0xff) as u8;
-
-				io::outb(self.get_register_port(DRIVE_REGISTER_OFFSET), drive);
-				io::outb(self.get_register_port(SECTORS_COUNT_REGISTER_OFFSET), count as _);
-				io::outb(self.get_register_port(LBA_LO_REGISTER_OFFSET), lo_lba);
-				io::outb(self.get_register_port(LBA_MID_REGISTER_OFFSET), mid_lba);
-				io::outb(self.get_register_port(LBA_HI_REGISTER_OFFSET), hi_lba);
+	/// Transfers at most `count` sectors at offset `offset` by DMA. The device is assumed to be
+	/// selected.
+	/// `bus` is the bus of the drive.
+	/// `buf` is the buffer to transfer.
+	/// `lba48` tells whether LBA48 is used.
+	/// The function returns the number of transferred sectors.
+	fn dma_transfer(&self, bus: &Bus, buf: &mut TransferBuffer, offset: u64, count: usize,
+		lba48: bool) -> Result<usize, Errno> {
+		let bus_index = self.secondary as usize;
+		let bm = BUS_MASTER_PORTS[bus_index].load(Ordering::Acquire);
+
+		// The caller's buffer is used directly if the transferred part is entirely in the kernel's
+		// direct mapping, which is physically contiguous. Else, the bounce buffer is used
+		// A region may need an additional entry to cross a boundary
+		let direct_max = (PRDT_MAX_ENTRIES - 1) * PRD_MAX_SIZE / SECTOR_SIZE as usize;
+		let direct_count = min(count, direct_max);
+		let direct = buf.as_ptr() as usize % 2 == 0
+			&& is_direct_mapped(buf.as_ptr(), direct_count * SECTOR_SIZE as usize);
+		let (phys, count) = if direct {
+			(memory::kern_to_phys(buf.as_ptr() as _) as usize, direct_count)
+		} else {
+			let max = (memory::PAGE_SIZE << BOUNCE_ORDER) / SECTOR_SIZE as usize;
+			let count = min(count, max);
+
+			if let TransferBuffer::Write(buf) = buf {
+				let len = count * SECTOR_SIZE as usize;
+				unsafe {
+					ptr::copy_nonoverlapping(buf.as_ptr(), bus.bounce, len);
+				}
 			}
+			(memory::kern_to_phys(bus.bounce as _) as usize, count)
+		};
 
-			self.send_command(COMMAND_READ_SECTORS);
+		unsafe {
+			fill_prdt(bus.prdt, phys, count * SECTOR_SIZE as usize);
+		}
 
-			for j in 0..count {
-				self.wait_io()?;
+		let command = if buf.is_write() {
+			0
+		} else {
+			BM_COMMAND_READ
+		};
+		unsafe {
+			io::outl(bm + BM_PRDT_OFFSET, memory::kern_to_phys(bus.prdt as _) as _);
+			io::outb(bm + BM_COMMAND_OFFSET, command);
+			let status = io::inb(bm + BM_STATUS_OFFSET);
+			io::outb(bm + BM_STATUS_OFFSET,
+				(status & BM_STATUS_CAPABLE) | BM_STATUS_IRQ | BM_STATUS_ERR);
+		}
+		DMA_COMPLETE[bus_index].store(false, Ordering::Release);
+
+		self.setup_transfer(offset, count, lba48);
+		self.send_command(match (buf.is_write(), lba48) {
+			(false, false) => COMMAND_READ_DMA,
+			(false, true) => COMMAND_READ_DMA_EXT,
+			(true, false) => COMMAND_WRITE_DMA,
+			(true, true) => COMMAND_WRITE_DMA_EXT,
+		});
+		unsafe {
+			io::outb(bm + BM_COMMAND_OFFSET, command | BM_COMMAND_START);
+		}
 
-				for k in 0..256 {
-					let index = ((i + j) * 256 + k) * 2;
-					debug_assert!(index + 1 < buf.len());
+		// Sleeping until completion. The status is also polled in case the interrupt is missed
+		let complete = &DMA_COMPLETE[bus_index];
+		DMA_WAIT[bus_index].wait_until(|| {
+			let status = unsafe {
+				io::inb(bm + BM_STATUS_OFFSET)
+			};
+
+			complete.load(Ordering::Acquire)
+				|| status & (BM_STATUS_IRQ | BM_STATUS_ERR) != 0
+				|| status & BM_STATUS_ACTIVE == 0
+		});
+		complete.store(false, Ordering::Release);
+		let bm_status = unsafe {
+			io::inb(bm + BM_STATUS_OFFSET)
+		};
 
-					let word = unsafe {
-						io::inw(data_port)
-					};
+		unsafe {
+			io::outb(bm + BM_COMMAND_OFFSET, command);
+			io::outb(bm + BM_STATUS_OFFSET,
+				(bm_status & BM_STATUS_CAPABLE) | BM_STATUS_IRQ | BM_STATUS_ERR);
+		}
+		self.wait_busy();
+		if bm_status & BM_STATUS_ERR != 0 || self.get_status() & (STATUS_ERR | STATUS_DF) != 0 {
+			return Err(crate::errno!(EIO));
+		}
 
-					buf[index] = (word & 0xff) as _;
-					buf[index + 1] = ((word >> 8) & 0xff) as _;
+		if let TransferBuffer::Read(buf) = buf {
+			if !direct {
+				let len = count * SECTOR_SIZE as usize;
+				unsafe {
+					ptr::copy_nonoverlapping(bus.bounce, buf.as_mut_ptr(), len);
 				}
 			}
-
-			i += count;
+		} else {
+			self.cache_flush(lba48);
 		}
 
-		Ok(())
-	}
-
-	/// Reads `size` blocks from storage at block offset `offset`, writing the data to `buf`.
-	/// The function uses LBA48.
-	fn read48(&self, _buf: &mut [u8], _offset: u64, _size: usize) -> Result<(), Errno> {
-		// TODO
-		todo!();
+		Ok(count)
 	}
 
-	/// Writes `size` blocks to storage at block offset `offset`, reading the data from `buf`.
-	/// The function uses LBA28, thus the offset is assumed to be in range.
-	fn write28(&self, buf: &[u8], offset: u64, size: usize) -> Result<(), Errno> {
+	/// Transfers `size` sectors at offset `offset`, splitting the transfer into as few commands as
+	/// possible.
+	/// `buf` is the buffer to transfer.
+	fn transfer(&self, mut buf: TransferBuffer, offset: u64, size: usize) -> Result<(), Errno> {
+		// The bus is acquired with a sleeping lock since DMA transfers sleep until completion. Its
+		// state doesn't change once initialized, so a copy is used
+		let _bus = acquire_bus(self.secondary as usize);
+		let bus = *BUSES[self.secondary as usize].lock().get();
 		self.select(false);
 
-		let data_port = self.get_register_port(DATA_REGISTER_OFFSET);
-
 		let mut i = 0;
 		while i < size {
-			// The number of blocks for this iteration
-			let count = min(size - i, 256);
-
-			unsafe {
-				let drive = if self.slave {
-					0xf0
-				} else {
-					0xe0
-				} | ((offset >> 24) & 0x0f) as u8;
-				let lo_lba = (offset & 0xff) as u8;
-				let mid_lba = ((offset >> 8) & 0xff) as u8;
-				let hi_lba = ((offset >> 16) & 0xff) as u8;
-
-				io::outb(self.get_register_port(DRIVE_REGISTER_OFFSET), drive);
-				io::outb(self.get_register_port(SECTORS_COUNT_REGISTER_OFFSET), count as _);
-				io::outb(self.get_register_port(LBA_LO_REGISTER_OFFSET), lo_lba);
-				io::outb(self.get_register_port(LBA_MID_REGISTER_OFFSET), mid_lba);
-				io::outb(self.get_register_port(LBA_HI_REGISTER_OFFSET), hi_lba);
-			}
-
-			self.send_command(COMMAND_WRITE_SECTORS);
-
-			for j in 0..count {
-				self.wait_io()?;
-
-				for k in 0..256 {
-					let index = ((i + j) * 256 + k) * 2;
-					debug_assert!(index + 1 < buf.len());
-					let word = ((buf[index + 1] as u16) << 8) | (buf[index] as u16);
-
-					unsafe {
-						io::outw(data_port, word)
-					}
-				}
-			}
+			let (lba48, max) = self.get_addressing(offset + i as u64, size - i)?;
+			let count = min(size - i, max);
+
+			// The remaining part of the buffer
+			let off = i * SECTOR_SIZE as usize;
+			let mut b = match &mut buf {
+				TransferBuffer::Read(buf) => TransferBuffer::Read(&mut buf[off..]),
+				TransferBuffer::Write(buf) => TransferBuffer::Write(&buf[off..]),
+			};
 
-			self.cache_flush();
-			i += count;
+			i += if self.dma {
+				self.dma_transfer(&bus, &mut b, offset + i as u64, count, lba48)?
+			} else {
+				self.pio_transfer(&mut b, offset + i as u64, count, lba48)?;
+				count
+			};
 		}
 
 		Ok(())
 	}
-
-	/// Writes `size` blocks to storage at block offset `offset`, reading the data from `buf`.
-	/// The function uses LBA48.
-	fn write48(&self, _buf: &[u8], _offset: u64, _size: usize) -> Result<(), Errno> {
-		// TODO
-		todo!();
-	}
 }
 
 impl StorageInterface for PATAInterface {
@@ -489,28 +900,110 @@ impl StorageInterface for PATAInterface {
 	fn read(&mut self, buf: &mut [u8], offset: u64, size: u64) -> Result<(), Errno> {
 		debug_assert!((buf.len() as u64) >= size * SECTOR_SIZE);
 
-		if offset >= self.sectors_count || offset + size >= self.sectors_count {
+		if offset >= self.sectors_count || offset + size > self.sectors_count {
 			return Err(crate::errno!(EINVAL));
 		}
 
-		if (offset + size) < (1 << 29) - 1 {
-			self.read28(buf, offset, size as _)
-		} else {
-			self.read48(buf, offset, size as _)
-		}
+		let len = (size * SECTOR_SIZE) as usize;
+		self.transfer(TransferBuffer::Read(&mut buf[..len]), offset, size as _)
 	}
 
 	fn write(&mut self, buf: &[u8], offset: u64, size: u64) -> Result<(), Errno> {
 		debug_assert!((buf.len() as u64) >= size * SECTOR_SIZE);
 
-		if offset >= self.sectors_count || offset + size >= self.sectors_count {
+		if offset >= self.sectors_count || offset + size > self.sectors_count {
 			return Err(crate::errno!(EINVAL));
 		}
 
-		if (offset + size) < (1 << 29) - 1 {
-			self.write28(buf, offset, size as _)
-		} else {
-			self.write48(buf, offset, size as _)
+		let len = (size * SECTOR_SIZE) as usize;
+		self.transfer(TransferBuffer::Write(&buf[..len]), offset, size as _)
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+	use crate::util::container::vec::Vec;
+
+	/// Returns an interface for a drive that is not probed.
+	fn test_interface(lba48: bool) -> PATAInterface {
+		PATAInterface {
+			secondary: false,
+			slave: false,
+
+			lba48,
+			dma: false,
+
+			sectors_count: 1 << 32,
 		}
 	}
+
+	/// Returns the commands used by `transfer` for `size` sectors at offset `offset`, each with
+	/// its offset, its number of sectors and whether it uses LBA48.
+	fn split(interface: &PATAInterface, offset: u64, size: usize)
+		-> Result<Vec<(u64, usize, bool)>, Errno> {
+		let mut commands = Vec::new();
+		let mut i = 0;
+		while i < size {
+			let (lba48, max) = interface.get_addressing(offset + i as u64, size - i)?;
+			let count = min(size - i, max);
+			commands.push((offset + i as u64, count, lba48))?;
+			i += count;
+		}
+		Ok(commands)
+	}
+
+	#[test_case]
+	fn pata_addressing0() {
+		// Without LBA48, transfers are split into LBA28 commands
+		let interface = test_interface(false);
+		assert_eq!(split(&interface, 0, 600).unwrap().as_slice(),
+			&[(0, 256, false), (256, 256, false), (512, 88, false)]);
+		assert!(split(&interface, LBA28_LIMIT - 1, 2).is_err());
+
+		// Large transfers and transfers past the LBA28 limit use LBA48
+		let interface = test_interface(true);
+		assert_eq!(split(&interface, 0, 16).unwrap().as_slice(), &[(0, 16, false)]);
+		assert_eq!(split(&interface, 0, 70000).unwrap().as_slice(),
+			&[(0, 65536, true), (65536, 4464, true)]);
+		assert_eq!(split(&interface, LBA28_LIMIT - 1, 2).unwrap().as_slice(),
+			&[(LBA28_LIMIT - 1, 2, true)]);
+	}
+
+	#[test_case]
+	fn pata_prdt0() {
+		let mut prdt: [Prd; 4] = unsafe { core::mem::zeroed() };
+
+		// A region inside a 64KiB window
+		let count = unsafe { fill_prdt(prdt.as_mut_ptr(), 0x10200, 1024) };
+		assert_eq!(count, 1);
+		assert_eq!((prdt[0].addr, prdt[0].size, prdt[0].flags), (0x10200, 1024, PRD_EOT));
+
+		// A region crossing two boundaries, with a whole 64KiB region encoded as zero
+		let count = unsafe { fill_prdt(prdt.as_mut_ptr(), 0x1fe00, 0x10400) };
+		assert_eq!(count, 3);
+		assert_eq!((prdt[0].addr, prdt[0].size, prdt[0].flags), (0x1fe00, 0x200, 0));
+		assert_eq!((prdt[1].addr, prdt[1].size, prdt[1].flags), (0x20000, 0, 0));
+		assert_eq!((prdt[2].addr, prdt[2].size, prdt[2].flags), (0x30000, 0x200, PRD_EOT));
+	}
+
+	#[test_case]
+	fn pata_direct_mapped0() {
+		let buf = buddy::alloc_kernel(0).unwrap() as *const u8;
+		assert!(is_direct_mapped(buf, memory::PAGE_SIZE));
+		buddy::free_kernel(buf as _, 0);
+
+		// Userspace memory is not mapped by the kernel
+		assert!(!is_direct_mapped(memory::ALLOC_BEGIN as _, SECTOR_SIZE as _));
+
+		// A buffer going past the end of the physical memory
+		let mem_info = memmap::get_info();
+		let main_size = mem_info.phys_main_pages * memory::PAGE_SIZE;
+		let end = min(mem_info.phys_main_begin as usize + main_size,
+			memory::get_kernelspace_size());
+		let last = memory::kern_to_virt((end - SECTOR_SIZE as usize) as _) as *const u8;
+		assert!(is_direct_mapped(last, SECTOR_SIZE as _));
+		assert!(!is_direct_mapped(last, 2 * SECTOR_SIZE as usize));
+		assert!(!is_direct_mapped(last, usize::MAX));
+	}
 }
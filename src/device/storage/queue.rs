@@ -0,0 +1,373 @@
+//! The request queue sits between the buffer cache and the storage drivers. Requests added to
+//! the queue of a device are performed together when the queue is run:
+//! - requests are served in a single sweep in the order of their offset, starting from the
+//! offset following the last served request and wrapping around to the lowest offset (C-LOOK
+//! elevator), which limits seeking
+//! - requests on contiguous blocks are merged into a single request to the device, through a
+//! contiguous buffer
+//! - up to the device's queue depth of requests are kept in flight
+//!
+//! Waiting for the completion of a request is handled by the device's driver, which puts the
+//! calling process to sleep until the device's interrupt when possible.
+//!
+//! A queue can be run while new requests are added: `take` moves the pending requests to a batch
+//! that is run on its own, and the requests added meanwhile are served by the next batch.
+
+use core::cmp::max;
+use core::ptr;
+use crate::device::storage::Request;
+use crate::device::storage::RequestTag;
+use crate::device::storage::StorageInterface;
+use crate::errno::Errno;
+use crate::memory::malloc;
+use crate::trace::EventType;
+use crate::trace;
+use crate::util::container::vec::Vec;
+
+/// The maximum size of a merged request, in bytes.
+const MAX_MERGE_SIZE: u64 = 65536;
+
+/// Statistics of a request queue.
+#[derive(Clone, Copy, Debug, Default)]
+pub struct Stats {
+	/// The number of requests added to the queue.
+	pub requests: usize,
+	/// The number of requests sent to the device.
+	pub dispatched: usize,
+}
+
+/// A request sent to the device, made of one or several merged requests of the queue.
+struct Dispatch {
+	/// The request sent to the device.
+	req: Request,
+	/// The range of the merged requests in the dispatch order.
+	begin: usize,
+	/// The end of the range of the merged requests in the dispatch order.
+	end: usize,
+
+	/// The buffer of the request, if several requests are merged.
+	buf: Option<malloc::Alloc<u8>>,
+	/// The tag of the request, if in flight.
+	tag: Option<RequestTag>,
+}
+
+/// The queue of requests of a storage device.
+pub struct RequestQueue {
+	/// The requests waiting to be performed.
+	pending: Vec<Request>,
+	/// The offset following the last served request.
+	head: u64,
+
+	/// The statistics of the queue.
+	stats: Stats,
+}
+
+impl RequestQueue {
+	/// Creates a new instance.
+	pub const fn new() -> Self {
+		Self {
+			pending: Vec::new(),
+			head: 0,
+
+			stats: Stats {
+				requests: 0,
+				dispatched: 0,
+			},
+		}
+	}
+
+	/// Returns the statistics of the queue.
+	pub fn get_stats(&self) -> Stats {
+		self.stats
+	}
+
+	/// Adds the request `req` to the queue. The request is performed on the next call to `run`.
+	///
+	/// # Safety
+	///
+	/// The request's buffer must remain valid and must not be accessed until the queue has been
+	/// run.
+	pub unsafe fn push(&mut self, req: Request) -> Result<(), Errno> {
+		self.pending.push(req)?;
+		self.stats.requests += 1;
+		Ok(())
+	}
+
+	/// Removes every pending requests without performing them.
+	pub fn clear(&mut self) {
+		self.pending.clear();
+	}
+
+	/// Tells whether the queue has no pending request.
+	pub fn is_empty(&self) -> bool {
+		self.pending.is_empty()
+	}
+
+	/// Moves the pending requests to a new queue, which starts its sweep at the same offset.
+	/// This allows to run the requests without holding the lock of this queue, so that new
+	/// requests can be added meanwhile. Once run, the new queue must be given back to `put_back`.
+	pub fn take(&mut self) -> Self {
+		let mut batch = Self::new();
+		core::mem::swap(&mut batch.pending, &mut self.pending);
+		batch.head = self.head;
+		batch
+	}
+
+	/// Updates the position of the sweep and the statistics with the ones of `batch`, a queue
+	/// returned by `take` that has been run.
+	pub fn put_back(&mut self, batch: Self) {
+		self.head = batch.head;
+		self.stats.dispatched += batch.stats.dispatched;
+	}
+
+	/// Returns the order in which the pending requests are served, as indexes in the pending
+	/// list.
+	fn get_order(&self) -> Result<Vec<usize>, Errno> {
+		let mut order = Vec::with_capacity(self.pending.len())?;
+		for i in 0..self.pending.len() {
+			order.push(i)?;
+		}
+
+		// Requests following the head come first, then the sweep restarts from the lowest offset
+		let head = self.head;
+		let pending = &self.pending;
+		order.sort_unstable_by_key(| i | {
+			let offset = pending[*i].offset;
+			(offset < head, offset)
+		});
+		Ok(order)
+	}
+
+	/// Returns the dispatch starting at position `begin` in the order `order`, merging
+	/// contiguous requests.
+	/// `block_size` is the size of a block on the device.
+	fn get_dispatch(&self, order: &[usize], begin: usize, block_size: u64) -> Dispatch {
+		let first = &self.pending[order[begin]];
+		let max_blocks = max(MAX_MERGE_SIZE / block_size, 1);
+
+		let mut end = begin + 1;
+		let mut size = first.size;
+		while end < order.len() {
+			let req = &self.pending[order[end]];
+			let contiguous = req.offset == first.offset + size && req.write == first.write;
+			if !contiguous || size + req.size > max_blocks {
+				break;
+			}
+
+			size += req.size;
+			end += 1;
+		}
+
+		Dispatch {
+			req: Request {
+				buf: first.buf,
+				offset: first.offset,
+				size,
+				write: first.write,
+			},
+			begin,
+			end,
+
+			buf: None,
+			tag: None,
+		}
+	}
+
+	/// Copies the data of the requests merged in `dispatch` from or to the dispatch's buffer.
+	/// `order` is the dispatch order.
+	/// `block_size` is the size of a block on the device.
+	/// `to_buf` tells whether data is copied to the dispatch's buffer.
+	fn copy_merged(&self, dispatch: &mut Dispatch, order: &[usize], block_size: u64,
+		to_buf: bool) {
+		let Some(buf) = &mut dispatch.buf else {
+			return;
+		};
+
+		let mut off = 0;
+		for i in order[dispatch.begin..dispatch.end].iter() {
+			let req = &self.pending[*i];
+			let len = (req.size * block_size) as usize;
+			let merged = buf.as_slice_mut()[off..].as_mut_ptr();
+
+			unsafe { // Safe because the requests' buffers remain valid until the end of `run`
+				if to_buf {
+					ptr::copy_nonoverlapping(req.buf, merged, len);
+				} else {
+					ptr::copy_nonoverlapping(merged, req.buf, len);
+				}
+			}
+			off += len;
+		}
+	}
+
+	/// Waits for the completion of the dispatch `dispatch`, then calls `f` for each merged
+	/// request.
+	fn complete<F: FnMut(usize, Result<(), Errno>)>(&self, interface: &mut dyn StorageInterface,
+		mut dispatch: Dispatch, order: &[usize], f: &mut F) {
+		let result = match dispatch.tag {
+			Some(tag) => interface.complete(tag),
+			None => Ok(()),
+		};
+		trace::record(EventType::BlockComplete, dispatch.req.offset as _,
+			result.is_err() as _);
+
+		if result.is_ok() && !dispatch.req.write {
+			let block_size = interface.get_block_size();
+			self.copy_merged(&mut dispatch, order, block_size, false);
+		}
+		for i in order[dispatch.begin..dispatch.end].iter() {
+			f(*i, result);
+		}
+	}
+
+	/// Performs every pending requests on the device `interface` and waits for their
+	/// completion. For each request, the function calls `f` with the index of the request in
+	/// the order in which requests were added since the last run, and its result.
+	/// If the function cannot allocate memory for merging, requests are not merged.
+	pub fn run<F>(&mut self, interface: &mut dyn StorageInterface, mut f: F)
+		-> Result<(), Errno> where F: FnMut(usize, Result<(), Errno>) {
+		if self.pending.is_empty() {
+			return Ok(());
+		}
+
+		let block_size = interface.get_block_size();
+		let depth = max(interface.get_queue_depth(), 1);
+		let (order, mut in_flight) = match (self.get_order(), Vec::with_capacity(depth)) {
+			(Ok(order), Ok(in_flight)) => (order, in_flight),
+			(Err(e), _) | (_, Err(e)) => {
+				self.pending.clear();
+				return Err(e);
+			},
+		};
+
+		// Dispatches are completed in the order of submission
+		let mut i = 0;
+		while i < order.len() {
+			let mut dispatch = self.get_dispatch(order.as_slice(), i, block_size);
+			if dispatch.end - dispatch.begin > 1 {
+				let len = (dispatch.req.size * block_size) as usize;
+				match malloc::Alloc::<u8>::new_default(len) {
+					Ok(mut buf) => {
+						dispatch.req.buf = buf.as_slice_mut().as_mut_ptr();
+						dispatch.buf = Some(buf);
+					},
+
+					// Falling back to dispatching the first request alone
+					Err(_) => {
+						dispatch.end = dispatch.begin + 1;
+						dispatch.req.size = self.pending[order[i]].size;
+					},
+				}
+			}
+			if dispatch.req.write {
+				self.copy_merged(&mut dispatch, order.as_slice(), block_size, true);
+			}
+			i = dispatch.end;
+
+			if in_flight.len() >= depth {
+				let d = in_flight.remove(0);
+				self.complete(interface, d, order.as_slice(), &mut f);
+			}
+
+			let size = dispatch.req.size as u32 | ((dispatch.req.write as u32) << 31);
+			trace::record(EventType::BlockSubmit, dispatch.req.offset as _, size);
+
+			// Safe because the buffer remains valid until completion
+			match unsafe { interface.submit(&dispatch.req) } {
+				Ok(tag) => {
+					self.head = dispatch.req.offset + dispatch.req.size;
+					self.stats.dispatched += 1;
+
+					dispatch.tag = tag;
+					// Cannot fail since the capacity is already allocated
+					in_flight.push(dispatch).unwrap();
+				},
+
+				Err(e) => {
+					for j in order.as_slice()[dispatch.begin..dispatch.end].iter() {
+						f(*j, Err(e));
+					}
+				},
+			}
+		}
+
+		while !in_flight.is_empty() {
+			let d = in_flight.remove(0);
+			self.complete(interface, d, order.as_slice(), &mut f);
+		}
+
+		self.pending.clear();
+		Ok(())
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	/// A storage interface recording the requests it receives, filling each block with its
+	/// offset on reads.
+	struct RecordDisk {
+		/// The offset and size of each received request.
+		requests: Vec<(u64, u64)>,
+	}
+
+	impl StorageInterface for RecordDisk {
+		fn get_block_size(&self) -> u64 {
+			512
+		}
+
+		fn get_blocks_count(&self) -> u64 {
+			64
+		}
+
+		fn read(&mut self, buf: &mut [u8], offset: u64, size: u64) -> Result<(), Errno> {
+			self.requests.push((offset, size))?;
+			for i in 0..size {
+				let begin = (i * 512) as usize;
+				buf[begin..(begin + 512)].fill((offset + i) as u8);
+			}
+			Ok(())
+		}
+
+		fn write(&mut self, _buf: &[u8], offset: u64, size: u64) -> Result<(), Errno> {
+			self.requests.push((offset, size))?;
+			Ok(())
+		}
+	}
+
+	#[test_case]
+	fn request_queue_merge0() {
+		let mut disk = RecordDisk {
+			requests: Vec::new(),
+		};
+		let mut queue = RequestQueue::new();
+		queue.head = 8;
+
+		let mut bufs = [[0u8; 512]; 4];
+		let offsets = [5, 10, 3, 4];
+		for (buf, offset) in bufs.iter_mut().zip(offsets.iter()) {
+			unsafe {
+				queue.push(Request {
+					buf: buf.as_mut_ptr(),
+					offset: *offset,
+					size: 1,
+					write: false,
+				}).unwrap();
+			}
+		}
+
+		let mut completed = 0;
+		queue.run(&mut disk, | _, r | {
+			assert!(r.is_ok());
+			completed += 1;
+		}).unwrap();
+
+		assert_eq!(completed, 4);
+		// The sweep serves the request after the head first, then merged contiguous requests
+		assert_eq!(disk.requests.as_slice(), &[(10, 1), (3, 3)]);
+		for (buf, offset) in bufs.iter().zip(offsets.iter()) {
+			assert!(buf.iter().all(| b | *b == *offset as u8));
+		}
+	}
+}
@@ -4,6 +4,9 @@ use core::ffi::c_void;
 use crate::device::DeviceHandle;
 use crate::errno::Errno;
 use crate::errno;
+use crate::file::epoll::EPOLLIN;
+use crate::file::epoll::EPOLLOUT;
+use crate::file::epoll::PollQueue;
 use crate::process::Process;
 use crate::process::mem_space::MemSpace;
 use crate::process::mem_space::ptr::SyscallPtr;
@@ -111,6 +114,26 @@ impl DeviceHandle for TTYDeviceHandle {
 			_ => Err(errno!(EINVAL)),
 		}
 	}
+
+	fn poll(&mut self) -> u32 {
+		let Some(tty_mutex) = self.get_tty() else {
+			return 0;
+		};
+		let tty_guard = tty_mutex.lock();
+
+		if tty_guard.get().get_available_size() > 0 {
+			EPOLLIN | EPOLLOUT
+		} else {
+			EPOLLOUT
+		}
+	}
+
+	fn with_poll_queue(&mut self, f: &mut dyn FnMut(&mut PollQueue)) {
+		if let Some(tty_mutex) = self.get_tty() {
+			let mut tty_guard = tty_mutex.lock();
+			f(tty_guard.get_mut().get_poll_queue());
+		}
+	}
 }
 
 impl IO for TTYDeviceHandle {
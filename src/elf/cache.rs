@@ -0,0 +1,220 @@
+//! Loading an ELF program requires the informations of its headers. To avoid reading and parsing
+//! the whole image each time the same program is executed, these informations are kept in a
+//! cache, indexed by the file in the page cache.
+//!
+//! An entry is valid as long as the file keeps the same size and timestamp of last modification.
+//! The page cache also removes the entry of a file when its content changes.
+//!
+//! The lock of the cache is never held while acquiring another lock.
+
+use crate::elf::ELF32ELFHeader;
+use crate::elf::ELF32ProgramHeader;
+use crate::elf::parser::ELFParser;
+use crate::errno::Errno;
+use crate::file::page_cache::FileKey;
+use crate::time::unit::Timestamp;
+use crate::util::FailableClone;
+use crate::util::container::hashmap::HashMap;
+use crate::util::container::vec::Vec;
+use crate::util::lock::Mutex;
+
+/// The maximum number of entries in the cache.
+const CAPACITY: usize = 64;
+
+/// Informations on an ELF program, required to load it into a memory space.
+pub struct ELFInfo {
+	/// The size of the file in bytes.
+	size: u64,
+	/// The timestamp of the last modification of the file.
+	mtime: Timestamp,
+
+	/// The ELF header.
+	header: ELF32ELFHeader,
+	/// The program headers.
+	segments: Vec<ELF32ProgramHeader>,
+	/// The path to the interpreter, if present.
+	interp: Option<Vec<u8>>,
+	/// Tells whether the kernel has to perform relocations when loading the program.
+	relocation: bool,
+}
+
+impl ELFInfo {
+	/// Gathers the informations of the program parsed by `parser`.
+	/// `size` is the size of the file in bytes.
+	/// `mtime` is the timestamp of the last modification of the file.
+	pub fn new(parser: &ELFParser, size: u64, mtime: Timestamp) -> Result<Self, Errno> {
+		let mut segments = Vec::new();
+		let mut res = Ok(());
+		parser.foreach_segments(| seg | {
+			res = segments.push(seg.clone());
+			res.is_ok()
+		});
+		res?;
+
+		let interp = match parser.get_interpreter_path() {
+			Some(path) => {
+				let mut p = Vec::with_capacity(path.len())?;
+				for b in path {
+					p.push(*b)?;
+				}
+
+				Some(p)
+			},
+
+			None => None,
+		};
+
+		// Relocations are performed by the interpreter if present
+		let mut relocation = false;
+		if interp.is_none() {
+			parser.foreach_rel(| _, _ | {
+				relocation = true;
+				false
+			});
+			parser.foreach_rela(| _, _ | {
+				relocation = true;
+				false
+			});
+		}
+
+		Ok(Self {
+			size,
+			mtime,
+
+			header: parser.get_header().clone(),
+			segments,
+			interp,
+			relocation,
+		})
+	}
+
+	/// Returns the ELF header.
+	pub fn get_header(&self) -> &ELF32ELFHeader {
+		&self.header
+	}
+
+	/// Returns the program headers.
+	pub fn get_segments(&self) -> &[ELF32ProgramHeader] {
+		self.segments.as_slice()
+	}
+
+	/// Returns the path to the interpreter. If the program doesn't have an interpreter, the
+	/// function returns None.
+	pub fn get_interpreter_path(&self) -> Option<&[u8]> {
+		self.interp.as_ref().map(| p | p.as_slice())
+	}
+
+	/// Tells whether the kernel has to perform relocations on the program when loading it, which
+	/// requires its image.
+	pub fn needs_relocation(&self) -> bool {
+		self.relocation
+	}
+}
+
+impl FailableClone for ELFInfo {
+	fn failable_clone(&self) -> Result<Self, Errno> {
+		let mut segments = Vec::with_capacity(self.segments.len())?;
+		for seg in self.segments.iter() {
+			segments.push(seg.clone())?;
+		}
+
+		Ok(Self {
+			size: self.size,
+			mtime: self.mtime,
+
+			header: self.header.clone(),
+			segments,
+			interp: self.interp.as_ref().map(| p | p.failable_clone()).transpose()?,
+			relocation: self.relocation,
+		})
+	}
+}
+
+/// The cache, by file.
+static CACHE: Mutex<HashMap<FileKey, ELFInfo>> = Mutex::new(HashMap::with_buckets(64));
+
+/// Returns the informations on the program in the file with key `key`.
+/// `size` and `mtime` are the current size and timestamp of last modification of the file.
+/// If the file isn't in the cache or if its entry is outdated, the function returns None.
+pub fn get(key: &FileKey, size: u64, mtime: Timestamp) -> Result<Option<ELFInfo>, Errno> {
+	let guard = CACHE.lock();
+	match guard.get().get(key) {
+		Some(info) if info.size == size && info.mtime == mtime => Ok(Some(info.failable_clone()?)),
+		_ => Ok(None),
+	}
+}
+
+/// Inserts the informations `info` on the program in the file with key `key`.
+/// If the cache is full, another entry is evicted.
+pub fn insert(key: FileKey, info: &ELFInfo) -> Result<(), Errno> {
+	let info = info.failable_clone()?;
+
+	let mut guard = CACHE.lock();
+	let cache = guard.get_mut();
+
+	if cache.len() >= CAPACITY && cache.get(&key).is_none() {
+		let victim = cache.iter().next().map(| (k, _) | *k);
+		if let Some(victim) = victim {
+			cache.remove(&victim);
+		}
+	}
+	cache.insert(key, info)?;
+
+	Ok(())
+}
+
+/// Removes the entry of the file with key `key` from the cache, if present.
+pub fn invalidate(key: &FileKey) {
+	CACHE.lock().get_mut().remove(key);
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	/// The mountpoint of the files used by tests, which doesn't exist.
+	const TEST_MOUNTPOINT: u32 = u32::MAX;
+
+	/// Returns informations on a program for a file of size `size`, modified at `mtime`.
+	fn test_info(size: u64, mtime: Timestamp) -> ELFInfo {
+		ELFInfo {
+			size,
+			mtime,
+
+			header: unsafe { core::mem::zeroed() },
+			segments: Vec::new(),
+			interp: None,
+			relocation: false,
+		}
+	}
+
+	#[test_case]
+	fn elf_cache_validity0() {
+		let key = (TEST_MOUNTPOINT, 1);
+		insert(key, &test_info(4096, 10)).unwrap();
+
+		assert!(get(&key, 4096, 10).unwrap().is_some());
+		// An entry is outdated when the file changes
+		assert!(get(&key, 4096, 11).unwrap().is_none());
+		assert!(get(&key, 8192, 10).unwrap().is_none());
+		assert!(get(&(TEST_MOUNTPOINT, 2), 4096, 10).unwrap().is_none());
+
+		invalidate(&key);
+		assert!(get(&key, 4096, 10).unwrap().is_none());
+	}
+
+	#[test_case]
+	fn elf_cache_capacity0() {
+		for inode in 0..(CAPACITY as u64 * 2) {
+			insert((TEST_MOUNTPOINT, inode), &test_info(inode, 0)).unwrap();
+			assert!(CACHE.lock().get().len() <= CAPACITY);
+		}
+		// The last inserted entry is never the one evicted
+		let last = CAPACITY as u64 * 2 - 1;
+		assert!(get(&(TEST_MOUNTPOINT, last), last, 0).unwrap().is_some());
+
+		for inode in 0..(CAPACITY as u64 * 2) {
+			invalidate(&(TEST_MOUNTPOINT, inode));
+		}
+	}
+}
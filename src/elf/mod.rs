@@ -2,8 +2,10 @@
 //! systems. This module implements a parser allowing to handle this format, including the kernel
 //! image itself.
 
+pub mod cache;
 pub mod parser;
 pub mod relocation;
+pub mod symbols;
 
 use core::cmp::max;
 use core::cmp::min;
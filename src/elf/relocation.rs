@@ -6,7 +6,7 @@ use crate::elf::ELF32Sym;
 use crate::elf;
 
 /// The name of the symbol pointing to the global offset table.
-const GOT_SYM: &str = "_GLOBAL_OFFSET_TABLE_";
+pub const GOT_SYM: &str = "_GLOBAL_OFFSET_TABLE_";
 
 /// Trait implemented for relocation objects.
 pub trait Relocation {
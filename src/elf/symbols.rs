@@ -0,0 +1,244 @@
+//! The kernel's symbols are required to resolve the symbols of kernel modules. Looking them up in
+//! the symbol table of the kernel image requires to go through every symbols, thus an index is
+//! built once at boot.
+//!
+//! The index follows the layout of the GNU hash table of ELF dynamic objects:
+//! - A Bloom filter, which discards most lookups of missing symbols without reading the table
+//! - Buckets, each referring to the first of its symbols in the table
+//! - The symbols, sorted by bucket, along with their hashes. The lowest bit of a hash is set on
+//! the last symbol of each bucket
+//!
+//! Symbols with the same name are kept in their order in the kernel image, which makes lookups
+//! return the same symbol as a search in the symbol table.
+
+use core::ffi::c_void;
+use crate::elf::ELF32SectionHeader;
+use crate::elf::ELF32Sym;
+use crate::elf::SHT_SYMTAB;
+use crate::elf;
+use crate::errno::Errno;
+use crate::memory;
+use crate::multiboot;
+use crate::util::FailableClone;
+use crate::util::container::vec::Vec;
+use crate::util::lock::Mutex;
+
+/// The average number of symbols per bucket.
+const SYMBOLS_PER_BUCKET: usize = 4;
+/// The number of symbols per word of the Bloom filter.
+const SYMBOLS_PER_BLOOM_WORD: usize = 8;
+/// The shift applied on the hash of a symbol to get the second bit to set in the Bloom filter.
+const BLOOM_SHIFT: u32 = 6;
+/// The value of a bucket without symbols.
+const EMPTY_BUCKET: u32 = u32::MAX;
+
+/// Returns the hash of the symbol name `name`, as computed for GNU hash tables.
+fn hash(name: &[u8]) -> u32 {
+	name.iter().fold(5381u32, | h, c | h.wrapping_mul(33).wrapping_add(*c as u32))
+}
+
+/// Returns the bits of the Bloom filter's word to be set for the hash `h`.
+fn bloom_mask(h: u32) -> u32 {
+	(1 << (h % 32)) | (1 << ((h >> BLOOM_SHIFT) % 32))
+}
+
+/// A hashed index of the kernel's symbols.
+struct SymbolIndex {
+	/// The section containing the names of symbols.
+	strtab: &'static ELF32SectionHeader,
+
+	/// The Bloom filter.
+	bloom: Vec<u32>,
+	/// The index of the first symbol of each bucket.
+	buckets: Vec<u32>,
+	/// The hashes of symbols, with the end of bucket bit.
+	hashes: Vec<u32>,
+	/// The symbols, sorted by bucket.
+	symbols: Vec<&'static ELF32Sym>,
+}
+
+impl SymbolIndex {
+	/// Builds the index for the kernel's ELF sections.
+	/// `sections` is a pointer to the ELF sections of the kernel in the virtual memory.
+	/// `sections_count` is the number of sections in the kernel.
+	/// `shndx` is the index of the section containing section names.
+	/// `entsize` is the size of section entries.
+	/// If the kernel doesn't have a symbol table, the function returns None.
+	fn new(sections: *const c_void, sections_count: usize, shndx: usize, entsize: usize)
+		-> Result<Option<Self>, Errno> {
+		let Some(strtab) = elf::get_section(sections, sections_count, shndx, entsize,
+			b".strtab") else {
+			return Ok(None);
+		};
+
+		// Gathering defined symbols with a name, in the order of the symbol table
+		let mut entries: Vec<(u32, &'static ELF32Sym)> = Vec::new();
+		let mut res = Ok(());
+		elf::foreach_sections(sections, sections_count, shndx, entsize,
+			| hdr: &ELF32SectionHeader, _name: &[u8] | {
+				if hdr.sh_type != SHT_SYMTAB {
+					return true;
+				}
+
+				let ptr = memory::kern_to_virt(hdr.sh_addr as _) as *const u8;
+				debug_assert!(hdr.sh_entsize > 0);
+
+				let mut i: usize = 0;
+				while i < hdr.sh_size as usize {
+					let sym = unsafe {
+						&*(ptr.add(i) as *const ELF32Sym)
+					};
+
+					if sym.st_name != 0 && sym.is_defined() {
+						let name = elf::get_symbol_name(strtab, sym.st_name);
+						res = entries.push((hash(name), sym));
+						if res.is_err() {
+							return false;
+						}
+					}
+
+					i += hdr.sh_entsize as usize;
+				}
+
+				true
+			});
+		res?;
+
+		let buckets_count = entries.len() / SYMBOLS_PER_BUCKET + 1;
+		let bloom_size = (entries.len() / SYMBOLS_PER_BLOOM_WORD + 1).next_power_of_two();
+
+		// Filling the Bloom filter and counting the symbols of each bucket
+		let mut bloom = Vec::new();
+		bloom.resize(bloom_size)?;
+		let mut buckets = Vec::new();
+		buckets.resize(buckets_count)?;
+		for (h, _) in entries.iter() {
+			bloom[(*h as usize / 32) % bloom_size] |= bloom_mask(*h);
+			buckets[*h as usize % buckets_count] += 1;
+		}
+
+		// Turning the counts into the index of the first symbol of each bucket
+		let mut off = 0;
+		for b in buckets.iter_mut() {
+			let count = *b;
+			*b = off;
+			off += count;
+		}
+
+		// Placing symbols in their bucket, keeping their order
+		let mut hashes = Vec::new();
+		hashes.resize(entries.len())?;
+		let mut symbols = Vec::with_capacity(entries.len())?;
+		for (_, sym) in entries.iter() {
+			symbols.push(*sym)?;
+		}
+		let mut next = buckets.failable_clone()?;
+		for (h, sym) in entries.iter() {
+			let b = *h as usize % buckets_count;
+			let i = next[b] as usize;
+			next[b] += 1;
+
+			hashes[i] = *h & !1;
+			symbols[i] = *sym;
+		}
+
+		// Marking the last symbol of each bucket and empty buckets
+		for b in 0..buckets_count {
+			let end = next[b];
+			if end == buckets[b] {
+				buckets[b] = EMPTY_BUCKET;
+			} else {
+				hashes[end as usize - 1] |= 1;
+			}
+		}
+
+		Ok(Some(Self {
+			strtab,
+
+			bloom,
+			buckets,
+			hashes,
+			symbols,
+		}))
+	}
+
+	/// Returns the symbol with name `name`. If the symbol doesn't exist, the function returns
+	/// None.
+	fn get(&self, name: &[u8]) -> Option<&'static ELF32Sym> {
+		let h = hash(name);
+
+		let word = self.bloom[(h as usize / 32) % self.bloom.len()];
+		let mask = bloom_mask(h);
+		if word & mask != mask {
+			return None;
+		}
+
+		let first = self.buckets[h as usize % self.buckets.len()];
+		if first == EMPTY_BUCKET {
+			return None;
+		}
+
+		for i in (first as usize)..self.symbols.len() {
+			let sym_hash = self.hashes[i];
+			if (sym_hash ^ h) & !1 == 0 {
+				let sym = self.symbols[i];
+				if elf::get_symbol_name(self.strtab, sym.st_name) == name {
+					return Some(sym);
+				}
+			}
+
+			if sym_hash & 1 != 0 {
+				break;
+			}
+		}
+
+		None
+	}
+}
+
+/// The index of the kernel's symbols. If None, the index has not been built.
+static INDEX: Mutex<Option<SymbolIndex>> = Mutex::new(None);
+
+/// Builds the index of the kernel's symbols from the ELF sections given by the bootloader.
+/// This function must be called once at boot, after memory management has been initialized.
+pub fn init() -> Result<(), Errno> {
+	let boot_info = multiboot::get_boot_info();
+	let index = SymbolIndex::new(memory::kern_to_virt(boot_info.elf_sections),
+		boot_info.elf_num as usize, boot_info.elf_shndx as usize,
+		boot_info.elf_entsize as usize)?;
+
+	*INDEX.lock().get_mut() = index;
+	Ok(())
+}
+
+/// Returns the kernel symbol with the name `name`. If the symbol doesn't exist, the function
+/// returns None.
+/// If the index has not been built, the symbol table is searched instead.
+pub fn get(name: &[u8]) -> Option<&'static ELF32Sym> {
+	if let Some(index) = INDEX.lock().get().as_ref() {
+		return index.get(name);
+	}
+
+	let boot_info = multiboot::get_boot_info();
+	elf::get_kernel_symbol(memory::kern_to_virt(boot_info.elf_sections),
+		boot_info.elf_num as usize, boot_info.elf_shndx as usize,
+		boot_info.elf_entsize as usize, name)
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	#[test_case]
+	fn symbols_index0() {
+		let boot_info = multiboot::get_boot_info();
+		let linear = | name: &[u8] | elf::get_kernel_symbol(
+			memory::kern_to_virt(boot_info.elf_sections), boot_info.elf_num as usize,
+			boot_info.elf_shndx as usize, boot_info.elf_entsize as usize, name);
+
+		for name in [&b"kernel_main"[..], b"kernel_wait", b"__maestro_missing_symbol"] {
+			let expected = linear(name).map(| sym | sym as *const ELF32Sym);
+			assert_eq!(get(name).map(| sym | sym as *const ELF32Sym), expected);
+		}
+	}
+}
@@ -3,6 +3,7 @@
 
 use core::ffi::c_void;
 use core::mem::MaybeUninit;
+use crate::crypto::rand;
 use crate::errno::Errno;
 use crate::idt::pic;
 use crate::idt;
@@ -58,6 +59,11 @@ fn get_error_message(i: u32) -> &'static str {
 	}
 }
 
+/// The IDs of the interrupts whose timing is used as a source of entropy: the PIT, the keyboard
+/// and the ATA disks.
+#[cfg(config_general_arch = "x86")]
+const ENTROPY_INTERRUPTS: [u32; 4] = [0x20, 0x21, 0x2e, 0x2f];
+
 /// The action to execute after the interrupt handler has returned.
 pub enum InterruptResultAction {
 	/// Resumes execution of the code where it was interrupted.
@@ -99,7 +105,7 @@ struct CallbackWrapper {
 	/// Third argument: `regs` the values of the registers when the interruption was triggered.
 	/// Fourth argument: `ring` tells the ring at which the code was running.
 	/// The return value tells which action to perform next.
-	callback: Box<dyn FnMut(u32, u32, &Regs, u32) -> InterruptResult>,
+	callback: Box<dyn FnMut(u32, u32, &mut Regs, u32) -> InterruptResult>,
 }
 
 /// Structure used to detect whenever the object owning the callback is destroyed, allowing to
@@ -156,7 +162,7 @@ pub fn init() {
 ///
 /// If the `id` is invalid or if an allocation fails, the function shall return an error.
 pub fn register_callback<T>(id: usize, priority: u32, callback: T) -> Result<CallbackHook, Errno>
-	where T: 'static + FnMut(u32, u32, &Regs, u32) -> InterruptResult {
+	where T: 'static + FnMut(u32, u32, &mut Regs, u32) -> InterruptResult {
 	debug_assert!(id < idt::ENTRIES_COUNT);
 
 	idt::wrap_disable_interrupts(|| {
@@ -232,7 +238,12 @@ pub unsafe extern "C" fn unlock_callbacks(id: usize) {
 /// `regs` is the state of the registers at the moment of the interrupt.
 /// `ring` tells the ring at which the code was running.
 #[no_mangle]
-pub extern "C" fn event_handler(id: u32, code: u32, ring: u32, regs: &Regs) {
+pub extern "C" fn event_handler(id: u32, code: u32, ring: u32, regs: &mut Regs) {
+	// Done before calling the callbacks since some of them never return
+	if ENTROPY_INTERRUPTS.contains(&id) {
+		rand::feed_interrupt(id);
+	}
+
 	let action = {
 		let mut guard = unsafe {
 			&mut CALLBACKS.assume_init_mut()[id as usize]
@@ -248,7 +259,7 @@ pub extern "C" fn event_handler(id: u32, code: u32, ring: u32, regs: &Regs) {
 		};
 
 		for i in 0..callbacks.len() {
-			let result = (callbacks[i].callback)(id, code, regs, ring);
+			let result = (callbacks[i].callback)(id, code, &mut *regs, ring);
 			last_action = result.action;
 			if result.skip_next {
 				break;
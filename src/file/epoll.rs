@@ -0,0 +1,509 @@
+//! epoll is an event notification facility allowing to wait for events on a set of file
+//! descriptors, called the interest list.
+//!
+//! Unlike `select` and `poll`, the objects that can be watched (pipes, sockets and TTYs) keep the
+//! list of the watches registered on them and notify them when their state changes. A notified
+//! watch is pushed on the ready list of its instance, thus waiting for events costs as much as
+//! the number of file descriptors that may be ready instead of the number of watched file
+//! descriptors.
+//!
+//! Locks are always taken in the following order: instance, watched object, watch, ready list.
+//! Thus, the state of a watched object is never checked while holding the lock of a watch.
+
+use core::fmt;
+use core::ptr;
+use crate::errno::Errno;
+use crate::file::open_file::FDTarget;
+use crate::file::open_file::O_CLOEXEC;
+use crate::file::open_file::OpenFile;
+use crate::process::wait_queue::WaitQueue;
+use crate::time;
+use crate::util::container::hashmap::HashMap;
+use crate::util::container::vec::Vec;
+use crate::util::ptr::IntSharedPtr;
+use crate::util::ptr::SharedPtr;
+use crate::util::ptr::WeakPtr;
+
+/// The file can be read.
+pub const EPOLLIN: u32 = 0x001;
+/// There is an exceptional condition on the file.
+pub const EPOLLPRI: u32 = 0x002;
+/// The file can be written.
+pub const EPOLLOUT: u32 = 0x004;
+/// An error occurred on the file. This event is always reported.
+pub const EPOLLERR: u32 = 0x008;
+/// The other end of the file has been closed. This event is always reported.
+pub const EPOLLHUP: u32 = 0x010;
+/// Equivalent to EPOLLIN.
+pub const EPOLLRDNORM: u32 = 0x040;
+/// Equivalent to EPOLLOUT.
+pub const EPOLLWRNORM: u32 = 0x100;
+/// The watch is disabled after reporting an event, until it is modified.
+pub const EPOLLONESHOT: u32 = 1 << 30;
+/// Events are reported only when the state of the file changes instead of as long as the state
+/// lasts.
+pub const EPOLLET: u32 = 1 << 31;
+
+/// `epoll_create1` flag: sets the close-on-exec flag on the new file descriptor.
+pub const EPOLL_CLOEXEC: i32 = O_CLOEXEC;
+
+/// `epoll_ctl` operation: adds a file descriptor to the interest list.
+pub const EPOLL_CTL_ADD: i32 = 1;
+/// `epoll_ctl` operation: removes a file descriptor from the interest list.
+pub const EPOLL_CTL_DEL: i32 = 2;
+/// `epoll_ctl` operation: changes the events watched on a file descriptor.
+pub const EPOLL_CTL_MOD: i32 = 3;
+
+/// The events that are reported even if not requested.
+const ALWAYS_REPORTED: u32 = EPOLLERR | EPOLLHUP;
+/// The flags of a watch that are not events.
+const WATCH_FLAGS: u32 = EPOLLET | EPOLLONESHOT;
+
+/// An event, as exchanged with userspace.
+#[repr(C, packed)]
+#[derive(Clone, Copy)]
+pub struct EPollEvent {
+	/// The mask of events.
+	pub events: u32,
+	/// The data associated with the file descriptor.
+	pub data: u64,
+}
+
+/// The ready list of an epoll instance.
+struct ReadyList {
+	/// The watches that may be ready, in the order in which they have been notified.
+	watches: Vec<WeakPtr<Watch, false>>,
+	/// Tells whether a notification has been lost because of a memory allocation failure. In
+	/// that case, the whole interest list is checked on the next wait.
+	overflow: bool,
+
+	/// The queue of processes waiting for events.
+	queue: WaitQueue,
+}
+
+impl ReadyList {
+	/// Tells whether there may be events to report.
+	fn is_pending(&self) -> bool {
+		!self.watches.is_empty() || self.overflow
+	}
+
+	/// Removes the watch `watch` from the list.
+	fn remove(&mut self, watch: &IntSharedPtr<Watch>) {
+		self.watches.retain(| w | !is_watch(w, watch));
+	}
+}
+
+/// A file descriptor in the interest list of an epoll instance.
+pub struct Watch {
+	/// The open file description the watch has been created for. The pointer only identifies the
+	/// open file and must not be dereferenced.
+	open_file: *const OpenFile,
+	/// The target of the open file.
+	target: FDTarget,
+	/// Tells whether the open file can be read from.
+	read: bool,
+	/// Tells whether the open file can be written to.
+	write: bool,
+
+	/// The requested events, with the EPOLLET and EPOLLONESHOT flags.
+	events: u32,
+	/// The data associated with the file descriptor.
+	data: u64,
+
+	/// Tells whether the watch is in the ready list.
+	queued: bool,
+	/// Tells whether the open file has been closed, in which case the watch doesn't report events
+	/// anymore.
+	closed: bool,
+
+	/// The ready list of the instance.
+	ready: IntSharedPtr<ReadyList>,
+}
+
+impl Watch {
+	/// Tells whether the watch can report events.
+	fn is_enabled(&self) -> bool {
+		!self.closed && self.events & !WATCH_FLAGS != 0
+	}
+
+	/// Pushes the watch on the ready list of its instance if it isn't already, then wakes up the
+	/// processes waiting on the instance.
+	/// `this` is a weak pointer to the watch itself.
+	fn enqueue(&mut self, this: &WeakPtr<Watch, false>) {
+		if self.queued {
+			return;
+		}
+
+		let mut guard = self.ready.lock();
+		let ready = guard.get_mut();
+		if ready.watches.push(this.clone()).is_ok() {
+			self.queued = true;
+		} else {
+			ready.overflow = true;
+		}
+		ready.queue.wake_all();
+	}
+}
+
+/// Tells whether the weak pointer `w` points to the watch `watch`.
+fn is_watch(w: &WeakPtr<Watch, false>, watch: &IntSharedPtr<Watch>) -> bool {
+	w.get().map(| m | ptr::eq(m, watch.as_ref())).unwrap_or(false)
+}
+
+/// The list of the watches registered on an object that can be watched by epoll instances.
+pub struct PollQueue {
+	/// The registered watches.
+	watches: Vec<WeakPtr<Watch, false>>,
+}
+
+impl PollQueue {
+	/// Creates a new empty queue.
+	pub const fn new() -> Self {
+		Self {
+			watches: Vec::new(),
+		}
+	}
+
+	/// Registers the watch `watch`.
+	pub fn add(&mut self, watch: &IntSharedPtr<Watch>) -> Result<(), Errno> {
+		self.watches.push(watch.new_weak())
+	}
+
+	/// Unregisters the watch `watch`.
+	pub fn remove(&mut self, watch: &IntSharedPtr<Watch>) {
+		self.watches.retain(| w | w.get().is_some() && !is_watch(w, watch));
+	}
+
+	/// Unregisters the watches created for the open file `open_file`, which is being closed.
+	pub fn close(&mut self, open_file: *const OpenFile) {
+		self.watches.retain(| w | {
+			let Some(mutex) = w.get() else {
+				return false;
+			};
+
+			let mut guard = mutex.lock();
+			let watch = guard.get_mut();
+			if watch.open_file == open_file {
+				watch.closed = true;
+				false
+			} else {
+				true
+			}
+		});
+	}
+
+	/// Notifies the registered watches that the events `events` may have happened on the object.
+	/// This function can be called from an interrupt handler.
+	pub fn notify(&mut self, events: u32) {
+		for w in self.watches.iter() {
+			let Some(mutex) = w.get() else {
+				continue;
+			};
+
+			let mut guard = mutex.lock();
+			let watch = guard.get_mut();
+			if watch.is_enabled() && (watch.events | ALWAYS_REPORTED) & events != 0 {
+				watch.enqueue(w);
+			}
+		}
+	}
+}
+
+impl fmt::Debug for PollQueue {
+	fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+		write!(f, "PollQueue {{ watches: {} }}", self.watches.len())
+	}
+}
+
+/// An epoll instance.
+pub struct EPoll {
+	/// The interest list, by file descriptor.
+	interest: HashMap<u32, IntSharedPtr<Watch>>,
+	/// The ready list.
+	ready: IntSharedPtr<ReadyList>,
+}
+
+impl EPoll {
+	/// Creates a new instance with an empty interest list.
+	pub fn new() -> Result<Self, Errno> {
+		Ok(Self {
+			interest: HashMap::new(),
+			ready: IntSharedPtr::new(ReadyList {
+				watches: Vec::new(),
+				overflow: false,
+
+				queue: WaitQueue::new(),
+			})?,
+		})
+	}
+
+	/// Adds the file descriptor `fd`, pointing to the open file `open_file`, to the interest list.
+	/// `events` is the mask of events to watch, with the EPOLLET and EPOLLONESHOT flags.
+	/// `data` is the data to be reported with the events.
+	/// If the file descriptor is already in the interest list, the function returns EEXIST.
+	/// If the file cannot be watched, the function returns EPERM.
+	pub fn add(&mut self, fd: u32, open_file: &OpenFile, events: u32, data: u64)
+		-> Result<(), Errno> {
+		if let Some(watch) = self.interest.get(&fd) {
+			// The file descriptor may have been closed and reused meanwhile
+			if !watch.lock().get().closed {
+				return Err(errno!(EEXIST));
+			}
+			self.remove(fd)?;
+		}
+
+		let target = open_file.get_target().clone();
+		let watch = IntSharedPtr::new(Watch {
+			open_file: open_file as *const _,
+			target: target.clone(),
+			read: open_file.can_read(),
+			write: open_file.can_write(),
+
+			events,
+			data,
+
+			queued: false,
+			closed: false,
+
+			ready: self.ready.clone(),
+		})?;
+		target.add_watch(&watch)?;
+		if let Err(e) = self.interest.insert(fd, watch.clone()) {
+			target.remove_watch(&watch);
+			return Err(e);
+		}
+
+		// Queueing the watch to check the initial state of the file on the next wait
+		watch.lock().get_mut().enqueue(&watch.new_weak());
+		Ok(())
+	}
+
+	/// Changes the events watched on the file descriptor `fd` to `events` and its data to `data`.
+	/// If the file descriptor is not in the interest list, the function returns ENOENT.
+	pub fn modify(&mut self, fd: u32, events: u32, data: u64) -> Result<(), Errno> {
+		let watch = self.interest.get(&fd).ok_or_else(|| errno!(ENOENT))?;
+
+		let mut guard = watch.lock();
+		let w = guard.get_mut();
+		if w.closed {
+			return Err(errno!(ENOENT));
+		}
+		w.events = events;
+		w.data = data;
+		w.enqueue(&watch.new_weak());
+
+		Ok(())
+	}
+
+	/// Removes the file descriptor `fd` from the interest list.
+	/// If the file descriptor is not in the interest list, the function returns ENOENT.
+	pub fn remove(&mut self, fd: u32) -> Result<(), Errno> {
+		let watch = self.interest.remove(&fd).ok_or_else(|| errno!(ENOENT))?;
+		self.release(&watch);
+
+		Ok(())
+	}
+
+	/// Unregisters the watch `watch` from its object and from the ready list, so that it is freed
+	/// with its last strong reference.
+	fn release(&self, watch: &IntSharedPtr<Watch>) {
+		let (target, closed) = {
+			let guard = watch.lock();
+			let w = guard.get();
+			(w.target.clone(), w.closed)
+		};
+		if !closed {
+			target.remove_watch(watch);
+		}
+		self.ready.lock().get_mut().remove(watch);
+	}
+
+	/// Returns the ready list of the instance, after queueing every watches if notifications have
+	/// been lost.
+	fn get_ready_list(&self) -> IntSharedPtr<ReadyList> {
+		let overflow = {
+			let mut guard = self.ready.lock();
+			let ready = guard.get_mut();
+			let overflow = ready.overflow;
+			ready.overflow = false;
+			overflow
+		};
+		if overflow {
+			for (_, watch) in self.interest.iter() {
+				let weak = watch.new_weak();
+				watch.lock().get_mut().enqueue(&weak);
+			}
+		}
+
+		self.ready.clone()
+	}
+}
+
+impl fmt::Debug for EPoll {
+	fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+		write!(f, "EPoll {{ interest: {} }}", self.interest.len())
+	}
+}
+
+impl Drop for EPoll {
+	fn drop(&mut self) {
+		for (_, watch) in self.interest.iter() {
+			self.release(watch);
+		}
+	}
+}
+
+/// Fills `events` with the events that happened on the epoll instance `epoll`.
+/// The function returns the number of events written, which is zero if no event happened.
+pub fn collect(epoll: &SharedPtr<EPoll>, events: &mut [EPollEvent]) -> usize {
+	let ready = epoll.lock().get().get_ready_list();
+
+	let watches = {
+		let mut guard = ready.lock();
+		let mut watches = Vec::new();
+		core::mem::swap(&mut guard.get_mut().watches, &mut watches);
+		watches
+	};
+
+	let mut n = 0;
+	let mut i = 0;
+	while i < watches.len() && n < events.len() {
+		let w = &watches[i];
+		i += 1;
+		let Some(mutex) = w.get() else {
+			continue;
+		};
+
+		let (target, read, write, mask, data) = {
+			let mut guard = mutex.lock();
+			let watch = guard.get_mut();
+			watch.queued = false;
+			if !watch.is_enabled() {
+				continue;
+			}
+
+			(watch.target.clone(), watch.read, watch.write, watch.events, watch.data)
+		};
+		let happened = target.poll(read, write) & ((mask & !WATCH_FLAGS) | ALWAYS_REPORTED);
+		if happened == 0 {
+			continue;
+		}
+
+		events[n] = EPollEvent {
+			events: happened,
+			data,
+		};
+		n += 1;
+
+		let mut guard = mutex.lock();
+		let watch = guard.get_mut();
+		if mask & EPOLLONESHOT != 0 {
+			watch.events &= WATCH_FLAGS;
+		} else if mask & EPOLLET == 0 {
+			// Level-triggered watches are reported as long as the state lasts
+			watch.enqueue(w);
+		}
+	}
+
+	// Putting back the watches that have not been checked
+	for w in &watches.as_slice()[i..] {
+		let Some(mutex) = w.get() else {
+			continue;
+		};
+
+		let mut guard = mutex.lock();
+		let watch = guard.get_mut();
+		watch.queued = false;
+		watch.enqueue(w);
+	}
+
+	n
+}
+
+/// Waits for events on the epoll instance `epoll` and writes them to `events`.
+/// `timeout` is the maximum time to wait in milliseconds. If None, the function waits until an
+/// event happens.
+/// The function returns the number of events written. If a signal is received while waiting, the
+/// function returns EINTR.
+pub fn wait(epoll: &SharedPtr<EPoll>, events: &mut [EPollEvent], timeout: Option<u64>)
+	-> Result<usize, Errno> {
+	let deadline = timeout.map(| timeout | {
+		let start = time::get_clock(time::CLOCK_MONOTONIC).unwrap_or(0);
+		start.saturating_add(timeout.saturating_mul(1000000))
+	});
+
+	let ready = epoll.lock().get().ready.clone();
+	let queue = unsafe {
+		// The queue is synchronized by itself and lives as long as the ready list
+		&ready.get().get_payload().queue
+	};
+	loop {
+		let n = collect(epoll, events);
+		if n > 0 {
+			return Ok(n);
+		}
+
+		if !queue.wait_until_interruptible(|| ready.lock().get().is_pending(), deadline)? {
+			return Ok(0);
+		}
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+	use crate::file::open_file::O_RDONLY;
+	use crate::file::open_file::O_WRONLY;
+	use crate::file::pipe::PipeBuffer;
+
+	#[test_case]
+	fn epoll_pipe0() {
+		let pipe = SharedPtr::new(PipeBuffer::new().unwrap()).unwrap();
+		let reader = OpenFile::new(O_RDONLY, FDTarget::Pipe(pipe.clone())).unwrap();
+		let _writer = OpenFile::new(O_WRONLY, FDTarget::Pipe(pipe.clone())).unwrap();
+
+		let epoll = SharedPtr::new(EPoll::new().unwrap()).unwrap();
+		epoll.lock().get_mut().add(0, &reader, EPOLLIN, 42).unwrap();
+		let mut events = [EPollEvent {
+			events: 0,
+			data: 0,
+		}; 4];
+		assert_eq!(collect(&epoll, &mut events), 0);
+
+		pipe.lock().get_mut().write(b"abc").unwrap();
+		assert_eq!(collect(&epoll, &mut events), 1);
+		let EPollEvent { events: ev, data } = events[0];
+		assert_eq!(ev, EPOLLIN);
+		assert_eq!(data, 42);
+		// Level-triggered watches are reported as long as there is data to read
+		assert_eq!(collect(&epoll, &mut events), 1);
+
+		let mut buf = [0; 3];
+		pipe.lock().get_mut().read(&mut buf);
+		assert_eq!(collect(&epoll, &mut events), 0);
+	}
+
+	#[test_case]
+	fn epoll_wait_timeout0() {
+		let pipe = SharedPtr::new(PipeBuffer::new().unwrap()).unwrap();
+		let reader = OpenFile::new(O_RDONLY, FDTarget::Pipe(pipe.clone())).unwrap();
+		let _writer = OpenFile::new(O_WRONLY, FDTarget::Pipe(pipe.clone())).unwrap();
+
+		let epoll = SharedPtr::new(EPoll::new().unwrap()).unwrap();
+		epoll.lock().get_mut().add(0, &reader, EPOLLIN, 42).unwrap();
+		let mut events = [EPollEvent {
+			events: 0,
+			data: 0,
+		}; 4];
+
+		// The deadline is reached without events
+		assert_eq!(wait(&epoll, &mut events, Some(0)).unwrap(), 0);
+		if time::get_clock(time::CLOCK_MONOTONIC).is_some() {
+			assert_eq!(wait(&epoll, &mut events, Some(1)).unwrap(), 0);
+		}
+
+		pipe.lock().get_mut().write(b"abc").unwrap();
+		assert_eq!(wait(&epoll, &mut events, Some(0)).unwrap(), 1);
+		assert_eq!(wait(&epoll, &mut events, None).unwrap(), 1);
+	}
+}
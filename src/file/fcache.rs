@@ -1,4 +1,10 @@
 //! The files cache stores files in memory to avoid accessing the disk each times.
+//!
+//! Path resolution goes through a cache of directory entries (dentries), each associating the
+//! name of a file in a directory to the file's inode. A dentry can also be negative, recording
+//! that no file with the given name exists in the directory. This avoids reading directories from
+//! the disk when looking up a file that doesn't exist, which happens often when searching a
+//! program in each directory of `PATH`.
 
 use crate::device::Device;
 use crate::errno::Errno;
@@ -7,21 +13,24 @@ use crate::file::File;
 use crate::file::FileContent;
 use crate::file::FileType;
 use crate::file::Gid;
+use crate::file::INode;
 use crate::file::Mode;
 use crate::file::Uid;
 use crate::file::mountpoint::MountPoint;
 use crate::file::mountpoint::MountSource;
 use crate::file::mountpoint;
+use crate::file::page_cache;
 use crate::file::path::Path;
 use crate::limits;
 use crate::util::FailableClone;
+use crate::util::container::hashmap::HashMap;
 use crate::util::container::string::String;
 use crate::util::container::vec::Vec;
 use crate::util::lock::Mutex;
 use crate::util::ptr::SharedPtr;
 
-/// The size of the files pool.
-const FILES_POOL_SIZE: usize = 1024;
+/// The maximum number of entries in the dentries cache.
+const DENTRY_CACHE_CAPACITY: usize = 1024;
 /// The upper bount for the file accesses counter.
 const ACCESSES_UPPER_BOUND: usize = 128;
 
@@ -29,23 +38,160 @@ const ACCESSES_UPPER_BOUND: usize = 128;
 
 /// The access counter allows to count the relative number of accesses count on a file.
 struct AccessCounter {
-	/// The number of accesses to the file relative to the previous file in the pool.
+	/// The number of accesses to the file since the eviction hand last passed on it.
 	/// This number is limited by `ACCESSES_UPPER_BOUND`.
 	accesses_count: usize,
 }
 
+impl AccessCounter {
+	/// Records an access.
+	fn access(&mut self) {
+		self.accesses_count = (self.accesses_count + 1).min(ACCESSES_UPPER_BOUND);
+	}
+
+	/// Ages the counter. If it had already reached zero, the function returns true, telling that
+	/// the entry can be evicted.
+	fn age(&mut self) -> bool {
+		if self.accesses_count == 0 {
+			return true;
+		}
+
+		self.accesses_count /= 2;
+		false
+	}
+}
+
+/// The key of a dentry: the ID of the mountpoint, the inode of the parent directory and the name
+/// of the file.
+type DentryKey = (u32, INode, String);
+
+/// A cached directory entry.
+struct Dentry {
+	/// The key of the entry.
+	key: DentryKey,
+	/// The inode of the file. If None, the entry is negative.
+	inode: Option<INode>,
+	/// The accesses counter, used for eviction.
+	accesses: AccessCounter,
+}
+
+/// The cache of directory entries.
+///
+/// When the cache is full, the entry to evict is chosen by a clock: a hand sweeps the entries and
+/// ages the counter of each entry it passes on, until it finds one that hasn't been accessed
+/// recently.
+struct DentryCache {
+	/// The maximum number of dentries.
+	capacity: usize,
+	/// The dentries.
+	dentries: Vec<Dentry>,
+	/// The index of each dentry in `dentries`, by key.
+	slots: HashMap<DentryKey, usize>,
+	/// The position of the eviction hand in `dentries`.
+	hand: usize,
+}
+
+impl DentryCache {
+	/// Creates a new instance.
+	/// `capacity` is the maximum number of dentries.
+	fn new(capacity: usize) -> Result<Self, Errno> {
+		Ok(Self {
+			capacity,
+			dentries: Vec::with_capacity(capacity)?,
+			slots: HashMap::with_buckets(capacity / 4),
+			hand: 0,
+		})
+	}
+
+	/// Returns the index of the slot for a new entry. If the cache is full, the returned slot is
+	/// the one of the entry to evict.
+	fn alloc_slot(&mut self) -> usize {
+		if self.dentries.len() < self.capacity {
+			return self.dentries.len();
+		}
+
+		// Terminates since each pass halves every counter
+		loop {
+			let i = self.hand;
+			self.hand = (self.hand + 1) % self.dentries.len();
+			if self.dentries[i].accesses.age() {
+				return i;
+			}
+		}
+	}
+
+	/// Sets the entry with key `key` to inode `inode`. If None, the entry is negative.
+	/// Since the cache is only an optimization, the entry is silently dropped if a memory
+	/// allocation fails.
+	fn set(&mut self, key: DentryKey, inode: Option<INode>) {
+		if let Some(i) = self.slots.get(&key) {
+			let dentry = &mut self.dentries[*i];
+			dentry.inode = inode;
+			dentry.accesses.access();
+			return;
+		}
+
+		let map_key = match key.2.failable_clone() {
+			Ok(name) => (key.0, key.1, name),
+			Err(_) => return,
+		};
+		let dentry = Dentry {
+			key,
+			inode,
+			accesses: AccessCounter {
+				accesses_count: 0,
+			},
+		};
+
+		let i = self.alloc_slot();
+		if i < self.dentries.len() {
+			if self.slots.insert(map_key, i).is_err() {
+				return;
+			}
+
+			let old = core::mem::replace(&mut self.dentries[i], dentry);
+			self.slots.remove(&old.key);
+		} else {
+			if self.dentries.push(dentry).is_err() {
+				return;
+			}
+			if self.slots.insert(map_key, i).is_err() {
+				self.dentries.pop();
+			}
+		}
+	}
+
+	/// Returns the inode of the file with key `key`. If the entry is negative, the function
+	/// returns ENOENT.
+	/// On a miss, the function calls `f` to look the file up on the filesystem, then caches the
+	/// result.
+	fn lookup<F: FnOnce() -> Result<INode, Errno>>(&mut self, key: DentryKey, f: F)
+		-> Result<INode, Errno> {
+		if let Some(i) = self.slots.get(&key) {
+			let dentry = &mut self.dentries[*i];
+			dentry.accesses.access();
+			return dentry.inode.ok_or_else(|| errno!(ENOENT));
+		}
+
+		let result = f();
+		match result {
+			Ok(inode) => self.set(key, Some(inode)),
+			Err(e) if e.as_int() == errno::ENOENT => self.set(key, None),
+			Err(_) => {},
+		}
+
+		result
+	}
+}
+
 /// Cache storing files in memory. This cache allows to speedup accesses to the disk. It is
 /// synchronized with the disk when necessary.
 pub struct FCache {
 	/// A pointer to the root mount point.
 	root_mount: SharedPtr<MountPoint>,
 
-	/// A fixed-size pool storing files, sorted by path.
-	files_pool: Vec<File>,
-	/// A pool of the same size as the files pool, storing approximate relative accesses count for
-	/// each files.
-	/// The element at an index is associated to the element in the files pool at the same index.
-	accesses_pool: Vec<AccessCounter>,
+	/// The cache of directory entries.
+	dentries: DentryCache,
 }
 
 impl FCache {
@@ -59,28 +205,14 @@ impl FCache {
 		Ok(Self {
 			root_mount: shared_ptr,
 
-			files_pool: Vec::<File>::with_capacity(FILES_POOL_SIZE)?,
-			accesses_pool: Vec::<AccessCounter>::with_capacity(FILES_POOL_SIZE)?,
+			dentries: DentryCache::new(DENTRY_CACHE_CAPACITY)?,
 		})
 	}
 
-	/// Loads the file with the given path `path`. If the file is already loaded, the behaviour is
-	/// undefined.
-	fn load_file(&mut self, _path: &Path) {
-		let len = self.files_pool.len();
-		if len >= FILES_POOL_SIZE {
-			self.files_pool.pop();
-			self.accesses_pool.pop();
-		}
-
-		// TODO Push file
-	}
-
-	// TODO Use the cache
 	/// Returns a reference to the file at path `path`. If the file doesn't exist, the function
 	/// returns None.
 	/// If the path is relative, the function starts from the root.
-	/// If the file isn't present in the pool, the function shall load it.
+	/// Path components are resolved through the dentries cache.
 	/// `uid` is the User ID of the user creating the file.
 	/// `gid` is the Group ID of the user creating the file.
 	/// `follow_links` is true, the function follows symbolic links.
@@ -105,6 +237,7 @@ impl FCache {
 		let inner_path = path.range_from(mountpoint.get_path().get_elements_count()..)?;
 
 		// The filesystem
+		let mount_id = mountpoint.get_id();
 		let fs = mountpoint.get_filesystem();
 
 		// The root inode
@@ -120,10 +253,12 @@ impl FCache {
 		}
 
 		for i in 0..inner_path.get_elements_count() {
-			inode = fs.get_inode(io, Some(inode), &inner_path[i])?;
+			let name = &inner_path[i];
+			let key = (mount_id, inode, name.failable_clone()?);
+			inode = self.dentries.lookup(key, || fs.get_inode(io, Some(inode), name))?;
 
 			// Checking permissions
-			file = fs.load_file(io, inode, inner_path[i].failable_clone()?)?;
+			file = fs.load_file(io, inode, name.failable_clone()?)?;
 			if i < inner_path.get_elements_count() - 1 && !file.can_read(uid, gid) {
 				return Err(errno!(EPERM));
 			}
@@ -161,7 +296,7 @@ impl FCache {
 	/// Returns a reference to the file at path `path`. If the file doesn't exist, the function
 	/// returns an error.
 	/// If the path is relative, the function starts from the root.
-	/// If the file isn't present in the pool, the function shall load it.
+	/// Path components are resolved through the dentries cache.
 	/// `uid` is the User ID of the user creating the file.
 	/// `gid` is the Group ID of the user creating the file.
 	/// `follow_links` is true, the function follows symbolic links.
@@ -170,7 +305,6 @@ impl FCache {
 		self.get_file_from_path_(path, uid, gid, follow_links, 0)
 	}
 
-	// TODO Use the cache
 	/// Returns a reference to the file `name` located in the directory `parent`. If the file
 	/// doesn't exist, the function returns an error.
 	/// `parent` is the parent directory.
@@ -200,9 +334,12 @@ impl FCache {
 		let io = io_guard.get_mut();
 
 		// The filesystem
+		let mount_id = mountpoint.get_id();
 		let fs = mountpoint.get_filesystem();
 
-		let inode = fs.get_inode(io, Some(parent.get_location().get_inode()), &name)?;
+		let parent_inode = parent.get_location().get_inode();
+		let key = (mount_id, parent_inode, name.failable_clone()?);
+		let inode = self.dentries.lookup(key, || fs.get_inode(io, Some(parent_inode), &name))?;
 		let mut file = fs.load_file(io, inode, name)?;
 
 		if follow_links {
@@ -221,7 +358,6 @@ impl FCache {
 		SharedPtr::new(file)
 	}
 
-	// TODO Use the cache
 	/// Creates a file, adds it to the VFS, then returns it. The file will be located into the
 	/// directory `parent`.
 	/// If `parent` is not a directory, the function returns an error.
@@ -251,6 +387,7 @@ impl FCache {
 		let mut io_guard = io_mutex.lock();
 		let io = io_guard.get_mut();
 
+		let mount_id = mountpoint.get_id();
 		let fs = mountpoint.get_filesystem();
 		if fs.is_readonly() {
 			return Err(errno!(EROFS));
@@ -259,7 +396,9 @@ impl FCache {
 		// The parent directory's inode
 		let parent_inode = parent.get_location().get_inode();
 		// Adding the file to the filesystem
+		let key = (mount_id, parent_inode, name.failable_clone()?);
 		let mut file = fs.add_file(io, parent_inode, name, uid, gid, mode, content)?;
+		self.dentries.set(key, Some(file.get_location().get_inode()));
 
 		// Adding the file to the parent's entries
 		file.set_parent_path(parent.get_path()?);
@@ -268,7 +407,6 @@ impl FCache {
 		SharedPtr::new(file)
 	}
 
-	// TODO Use the cache
 	/// Removes the file `file` from the VFS.
 	/// If the file doesn't exist, the function returns an error.
 	/// If the file is a non-empty directory, the function returns an error.
@@ -286,19 +424,36 @@ impl FCache {
 			return Err(errno!(EPERM));
 		}
 
-		// Getting the mountpoint
-		let mountpoint_mutex = file.get_location().get_mountpoint().ok_or_else(|| errno!(ENOENT))?;
-		let mut mountpoint_guard = mountpoint_mutex.lock();
-		let mountpoint = mountpoint_guard.get_mut();
-
-		// Getting the IO interface
-		let io_mutex = mountpoint.get_source().get_io();
-		let mut io_guard = io_mutex.lock();
-		let io = io_guard.get_mut();
-
-		// Removing the file
-		let fs = mountpoint.get_filesystem();
-		fs.remove_file(io, parent_inode, file.get_name())?;
+		let name = file.get_name();
+		let (mount_id, key) = {
+			// Getting the mountpoint
+			let mountpoint_mutex = file.get_location().get_mountpoint()
+				.ok_or_else(|| errno!(ENOENT))?;
+			let mut mountpoint_guard = mountpoint_mutex.lock();
+			let mountpoint = mountpoint_guard.get_mut();
+
+			// Getting the IO interface
+			let io_mutex = mountpoint.get_source().get_io();
+			let mut io_guard = io_mutex.lock();
+			let io = io_guard.get_mut();
+
+			// The key is allocated first, so that the entry cannot be left positive once the file
+			// is removed
+			let mount_id = mountpoint.get_id();
+			let key = (mount_id, parent_inode, name.failable_clone()?);
+
+			// Removing the file
+			let fs = mountpoint.get_filesystem();
+			fs.remove_file(io, parent_inode, name)?;
+
+			(mount_id, key)
+		};
+		self.dentries.set(key, None);
+
+		// The inode may be reused by another file
+		if file.get_hard_links_count() <= 1 {
+			page_cache::invalidate(mount_id, file.get_location().get_inode());
+		}
 
 		Ok(())
 	}
@@ -312,3 +467,86 @@ static FILES_CACHE: Mutex<Option<FCache>> = Mutex::new(None);
 pub fn get() -> &'static Mutex<Option<FCache>> {
 	&FILES_CACHE
 }
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	/// Returns the key of the file `name` in the root directory of a test mountpoint.
+	fn key(name: &[u8]) -> DentryKey {
+		(0, 2, String::from(name).unwrap())
+	}
+
+	/// Tells whether the entry with key `key` is in the cache `cache`, without accessing it.
+	fn is_cached(cache: &DentryCache, key: &DentryKey) -> bool {
+		cache.slots.get(key).is_some()
+	}
+
+	#[test_case]
+	fn dentry_cache_negative0() {
+		let mut cache = DentryCache::new(DENTRY_CACHE_CAPACITY).unwrap();
+
+		assert!(cache.lookup(key(b"foo"), || Err(errno!(ENOENT))).is_err());
+		assert!(cache.lookup(key(b"foo"), || Ok(42)).is_err());
+
+		cache.set(key(b"foo"), Some(42));
+		assert_eq!(cache.lookup(key(b"foo"), || Err(errno!(ENOENT))).unwrap(), 42);
+	}
+
+	#[test_case]
+	fn dentry_cache_create_remove0() {
+		let mut cache = DentryCache::new(DENTRY_CACHE_CAPACITY).unwrap();
+
+		// A failed lookup makes the entry negative, then `create_file` makes it positive
+		assert!(cache.lookup(key(b"foo"), || Err(errno!(ENOENT))).is_err());
+		cache.set(key(b"foo"), Some(42));
+		assert_eq!(cache.lookup(key(b"foo"), || Err(errno!(ENOENT))).unwrap(), 42);
+
+		// `remove_file` makes it negative again, without looking the file up on the filesystem
+		cache.set(key(b"foo"), None);
+		assert!(cache.lookup(key(b"foo"), || Ok(42)).is_err());
+
+		// Removing a file that isn't cached records a negative entry as well
+		cache.set(key(b"bar"), None);
+		assert!(cache.lookup(key(b"bar"), || Ok(43)).is_err());
+
+		// Each switch updates the entry in place
+		cache.set(key(b"foo"), Some(44));
+		assert_eq!(cache.lookup(key(b"foo"), || Err(errno!(ENOENT))).unwrap(), 44);
+		assert_eq!(cache.dentries.len(), 2);
+		assert_eq!(cache.slots.len(), 2);
+	}
+
+	#[test_case]
+	fn dentry_cache_evict0() {
+		let mut cache = DentryCache::new(4).unwrap();
+		let names: [&[u8]; 7] = [b"a", b"b", b"c", b"d", b"e", b"f", b"g"];
+		for (i, name) in names[..4].iter().enumerate() {
+			cache.set(key(name), Some(i as _));
+		}
+		assert!(cache.lookup(key(b"a"), || Err(errno!(EIO))).is_ok());
+		assert!(cache.lookup(key(b"b"), || Err(errno!(EIO))).is_ok());
+
+		// The hand ages `a` and `b`, which have been accessed, then evicts `c`
+		cache.set(key(b"e"), Some(4));
+		assert!(!is_cached(&cache, &key(b"c")));
+		for name in [&b"a"[..], b"b", b"d", b"e"] {
+			assert!(is_cached(&cache, &key(name)));
+		}
+
+		// Updating a cached entry doesn't evict anything
+		cache.set(key(b"b"), None);
+		assert_eq!(cache.dentries.len(), 4);
+
+		// The hand continues from where it stopped, then evicts `a` since its counter has been
+		// aged to zero
+		cache.set(key(b"f"), Some(5));
+		assert!(!is_cached(&cache, &key(b"d")));
+		cache.set(key(b"g"), Some(6));
+		assert!(!is_cached(&cache, &key(b"a")));
+
+		assert_eq!(cache.dentries.len(), 4);
+		assert_eq!(cache.slots.len(), 4);
+		assert_eq!(cache.lookup(key(b"g"), || Err(errno!(EIO))).unwrap(), 6);
+	}
+}
@@ -195,3 +195,167 @@ impl DirectoryEntry {
 		self.total_size += entry.total_size;
 	}
 }
+
+/// Returns the minimum size of an entry whose name has length `name_length`.
+pub fn get_entry_size(name_length: usize) -> u16 {
+	((8 + name_length + 3) & !3) as _
+}
+
+/// Returns the inode of the entry at offset `off` in the block `blk`.
+fn blk_get_inode(blk: &[u8], off: usize) -> u32 {
+	u32::from_le_bytes([blk[off], blk[off + 1], blk[off + 2], blk[off + 3]])
+}
+
+/// Returns the total size of the entry at offset `off` in the block `blk`.
+fn blk_get_total_size(blk: &[u8], off: usize) -> usize {
+	u16::from_le_bytes([blk[off + 4], blk[off + 5]]) as _
+}
+
+/// Sets the total size of the entry at offset `off` in the block `blk`.
+fn blk_set_total_size(blk: &mut [u8], off: usize, total_size: usize) {
+	blk[(off + 4)..(off + 6)].copy_from_slice(&(total_size as u16).to_le_bytes());
+}
+
+/// Returns the name of the entry at offset `off` in the block `blk`.
+/// `superblock` is the filesystem's superblock.
+pub fn blk_get_name<'a>(blk: &'a [u8], off: usize, superblock: &Superblock) -> &'a [u8] {
+	let mut len = blk[off + 6] as usize;
+	if superblock.required_features & super::REQUIRED_FEATURE_DIRECTORY_TYPE == 0 {
+		len |= (blk[off + 7] as usize) << 8;
+	}
+
+	let begin = off + 8;
+	&blk[begin..min(begin + len, blk.len())]
+}
+
+/// Returns an iterator over the offsets of the entries in the block `blk`, including free ones.
+/// The iteration stops at the first invalid entry.
+pub fn blk_entries(blk: &[u8]) -> impl Iterator<Item = usize> + '_ {
+	let mut off = 0;
+
+	core::iter::from_fn(move || {
+		if off + 8 > blk.len() {
+			return None;
+		}
+
+		let total_size = blk_get_total_size(blk, off);
+		if total_size < 8 || off + total_size > blk.len() {
+			return None;
+		}
+
+		let curr = off;
+		off += total_size;
+		Some(curr)
+	})
+}
+
+/// Returns an iterator over the offsets of the used entries in the block `blk`.
+pub fn blk_used_entries(blk: &[u8]) -> impl Iterator<Item = usize> + '_ {
+	blk_entries(blk).filter(| off | blk_get_inode(blk, *off) != 0)
+}
+
+/// Returns the offset of the entry with name `name` in the block `blk`.
+/// `superblock` is the filesystem's superblock.
+pub fn blk_find(blk: &[u8], superblock: &Superblock, name: &[u8]) -> Option<usize> {
+	blk_used_entries(blk).find(| off | blk_get_name(blk, *off, superblock) == name)
+}
+
+/// Returns the entry at offset `off` in the block `blk`.
+pub fn blk_read(blk: &[u8], off: usize) -> Result<Box<DirectoryEntry>, Errno> {
+	let total_size = blk_get_total_size(blk, off);
+	unsafe { // Safe because the size of the entry has been checked when iterating
+		DirectoryEntry::from(&blk[off..(off + total_size)])
+	}
+}
+
+/// Tells whether the block `blk` contains no used entry.
+pub fn blk_is_empty(blk: &[u8]) -> bool {
+	blk_used_entries(blk).next().is_none()
+}
+
+/// Initializes the block `blk` with a single free entry covering it.
+pub fn blk_init(blk: &mut [u8]) {
+	blk.fill(0);
+	blk_set_total_size(blk, 0, blk.len());
+}
+
+/// Inserts an entry in the block `blk`, using the space of a free entry or the unused space at
+/// the end of a used entry.
+/// `superblock` is the filesystem's superblock.
+/// `inode` is the inode of the entry.
+/// `name` is the name of the entry.
+/// `file_type` is the type of the entry.
+/// If the block doesn't have enough space, the function returns false.
+pub fn blk_insert(blk: &mut [u8], superblock: &Superblock, inode: u32, name: &String,
+	file_type: FileType) -> Result<bool, Errno> {
+	let entry_size = get_entry_size(name.as_bytes().len()) as usize;
+
+	// Looking for an entry with enough space, as its offset, the offset of the space to use and
+	// the size of this space
+	let found = blk_entries(blk).find_map(| off | {
+		let total_size = blk_get_total_size(blk, off);
+		let used = if blk_get_inode(blk, off) == 0 {
+			0
+		} else {
+			get_entry_size(blk_get_name(blk, off, superblock).len()) as usize
+		};
+
+		if total_size - used >= entry_size {
+			Some((off, off + used, total_size - used))
+		} else {
+			None
+		}
+	});
+	let Some((off, new_off, new_size)) = found else {
+		return Ok(false);
+	};
+
+	let entry = DirectoryEntry::new(superblock, inode, new_size as _, file_type, name)?;
+	if new_off != off {
+		blk_set_total_size(blk, off, new_off - off);
+	}
+
+	let bytes = unsafe {
+		slice::from_raw_parts(entry.as_ref() as *const _ as *const u8, 8 + name.as_bytes().len())
+	};
+	blk[new_off..(new_off + new_size)].fill(0);
+	blk[new_off..(new_off + bytes.len())].copy_from_slice(bytes);
+	Ok(true)
+}
+
+/// Removes the entry at offset `off` in the block `blk`. The space of the entry is given to the
+/// previous entry if any. Else, the entry is set free.
+pub fn blk_remove(blk: &mut [u8], off: usize) {
+	let prev = blk_entries(blk).take_while(| o | *o < off).last();
+
+	if let Some(prev) = prev {
+		let total_size = blk_get_total_size(blk, prev) + blk_get_total_size(blk, off);
+		blk_set_total_size(blk, prev, total_size);
+	} else {
+		blk[..4].fill(0);
+	}
+}
+
+/// Fills the block `dst` with the entries of the block `src` at offsets `offs`, packed at the
+/// beginning of the block. The last entry covers the remaining space.
+/// `superblock` is the filesystem's superblock.
+/// If the entries don't fit in the block, the behaviour is undefined.
+pub fn blk_fill<I: Iterator<Item = usize>>(dst: &mut [u8], src: &[u8], offs: I,
+	superblock: &Superblock) {
+	blk_init(dst);
+
+	let mut last = None;
+	let mut dst_off = 0;
+	for off in offs {
+		let len = get_entry_size(blk_get_name(src, off, superblock).len()) as usize;
+		dst[dst_off..(dst_off + len)].copy_from_slice(&src[off..(off + len)]);
+		blk_set_total_size(dst, dst_off, len);
+
+		last = Some(dst_off);
+		dst_off += len;
+	}
+
+	if let Some(last) = last {
+		blk_set_total_size(dst, last, dst.len() - last);
+	}
+}
@@ -0,0 +1,431 @@
+//! The hash tree (htree) indexes the entries of a directory by the hash of their names, allowing
+//! to find an entry by reading a few blocks instead of every blocks of the directory.
+//!
+//! The first block of an indexed directory is the root of the tree. To remain readable by
+//! implementations that don't support the index, it begins with the entries `.` and `..`, the
+//! latter covering the rest of the block, in which the index is stored.
+//! Internal nodes are blocks beginning with a free entry covering the whole block. Leaves are
+//! regular blocks of directory entries.
+//!
+//! A node is an array of entries, each associating a hash to the block of the child node holding
+//! the names whose hash is greater than or equal to it. The hash of the first entry is implicit
+//! and its space stores the number of entries and the capacity of the node instead.
+//!
+//! Since hashes are always even, the lowest bit of the hash of an entry tells that the names with
+//! this hash continue from the previous child.
+
+use core::mem::size_of;
+
+/// Hash function: legacy
+pub const HASH_LEGACY: u8 = 0;
+/// Hash function: half MD4
+pub const HASH_HALF_MD4: u8 = 1;
+/// Hash function: TEA
+pub const HASH_TEA: u8 = 2;
+/// The offset to add to a hash function to get its variant treating name bytes as unsigned.
+pub const HASH_UNSIGNED_OFFSET: u8 = 3;
+
+/// The maximum number of levels of internal nodes below the root.
+pub const MAX_INDIRECT_LEVELS: u8 = 1;
+
+/// The offset of the index's information in the root block.
+const ROOT_INFO_OFF: usize = 24;
+/// The size of the index's information in the root block.
+const ROOT_INFO_LEN: u8 = 8;
+/// The offset of the entries in the root block.
+pub const ROOT_ENTRIES_OFF: usize = ROOT_INFO_OFF + ROOT_INFO_LEN as usize;
+/// The offset of the entries in an internal node block.
+pub const NODE_ENTRIES_OFF: usize = 8;
+
+/// The default seed, used when the superblock doesn't specify one.
+const DEFAULT_SEED: [u32; 4] = [0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476];
+
+/// Reads a 16 bits value at offset `off` in `blk`.
+fn read_u16(blk: &[u8], off: usize) -> u16 {
+	u16::from_le_bytes([blk[off], blk[off + 1]])
+}
+
+/// Writes the 16 bits value `val` at offset `off` in `blk`.
+fn write_u16(blk: &mut [u8], off: usize, val: u16) {
+	blk[off..(off + size_of::<u16>())].copy_from_slice(&val.to_le_bytes());
+}
+
+/// Reads a 32 bits value at offset `off` in `blk`.
+fn read_u32(blk: &[u8], off: usize) -> u32 {
+	u32::from_le_bytes([blk[off], blk[off + 1], blk[off + 2], blk[off + 3]])
+}
+
+/// Writes the 32 bits value `val` at offset `off` in `blk`.
+fn write_u32(blk: &mut [u8], off: usize, val: u32) {
+	blk[off..(off + size_of::<u32>())].copy_from_slice(&val.to_le_bytes());
+}
+
+/// The legacy hash function.
+/// `signed` tells whether name bytes are treated as signed.
+fn legacy_hash(name: &[u8], signed: bool) -> u32 {
+	let mut hash0: u32 = 0x12a3fe2d;
+	let mut hash1: u32 = 0x37abe8f9;
+
+	for b in name {
+		let c = if signed {
+			*b as i8 as i32
+		} else {
+			*b as i32
+		};
+
+		let mut hash = hash1.wrapping_add(hash0 ^ (c.wrapping_mul(7152373) as u32));
+		if hash & 0x80000000 != 0 {
+			hash = hash.wrapping_sub(0x7fffffff);
+		}
+		hash1 = hash0;
+		hash0 = hash;
+	}
+
+	hash0 << 1
+}
+
+/// Fills the buffer `buf` with the beginning of the name `name`, padding it with its length.
+/// `signed` tells whether name bytes are treated as signed.
+fn str_to_hash_buf(name: &[u8], signed: bool, buf: &mut [u32]) {
+	let mut pad = (name.len() as u32) | ((name.len() as u32) << 8);
+	pad |= pad << 16;
+
+	let len = name.len().min(buf.len() * 4);
+	let mut val = pad;
+	let mut i = 0;
+	for (j, b) in name[..len].iter().enumerate() {
+		let c = if signed {
+			*b as i8 as i32 as u32
+		} else {
+			*b as u32
+		};
+
+		val = c.wrapping_add(val << 8);
+		if j % 4 == 3 {
+			buf[i] = val;
+			val = pad;
+			i += 1;
+		}
+	}
+
+	if i < buf.len() {
+		buf[i] = val;
+		i += 1;
+	}
+	buf[i..].fill(pad);
+}
+
+/// The half MD4 transform.
+fn half_md4_transform(buf: &mut [u32; 4], input: &[u32; 8]) {
+	const K2: u32 = 0o13240474631;
+	const K3: u32 = 0o15666365641;
+
+	let f = | x: u32, y: u32, z: u32 | z ^ (x & (y ^ z));
+	let g = | x: u32, y: u32, z: u32 | (x & y).wrapping_add((x ^ y) & z);
+	let h = | x: u32, y: u32, z: u32 | x ^ y ^ z;
+
+	let [mut a, mut b, mut c, mut d] = *buf;
+	macro_rules! round {
+		($f:ident, $a:ident, $b:ident, $c:ident, $d:ident, $x:expr, $s:expr) => {
+			$a = $a.wrapping_add($f($b, $c, $d)).wrapping_add($x).rotate_left($s);
+		};
+	}
+
+	round!(f, a, b, c, d, input[0], 3);
+	round!(f, d, a, b, c, input[1], 7);
+	round!(f, c, d, a, b, input[2], 11);
+	round!(f, b, c, d, a, input[3], 19);
+	round!(f, a, b, c, d, input[4], 3);
+	round!(f, d, a, b, c, input[5], 7);
+	round!(f, c, d, a, b, input[6], 11);
+	round!(f, b, c, d, a, input[7], 19);
+
+	round!(g, a, b, c, d, input[1].wrapping_add(K2), 3);
+	round!(g, d, a, b, c, input[3].wrapping_add(K2), 5);
+	round!(g, c, d, a, b, input[5].wrapping_add(K2), 9);
+	round!(g, b, c, d, a, input[7].wrapping_add(K2), 13);
+	round!(g, a, b, c, d, input[0].wrapping_add(K2), 3);
+	round!(g, d, a, b, c, input[2].wrapping_add(K2), 5);
+	round!(g, c, d, a, b, input[4].wrapping_add(K2), 9);
+	round!(g, b, c, d, a, input[6].wrapping_add(K2), 13);
+
+	round!(h, a, b, c, d, input[3].wrapping_add(K3), 3);
+	round!(h, d, a, b, c, input[7].wrapping_add(K3), 9);
+	round!(h, c, d, a, b, input[2].wrapping_add(K3), 11);
+	round!(h, b, c, d, a, input[6].wrapping_add(K3), 15);
+	round!(h, a, b, c, d, input[1].wrapping_add(K3), 3);
+	round!(h, d, a, b, c, input[5].wrapping_add(K3), 9);
+	round!(h, c, d, a, b, input[0].wrapping_add(K3), 11);
+	round!(h, b, c, d, a, input[4].wrapping_add(K3), 15);
+
+	buf[0] = buf[0].wrapping_add(a);
+	buf[1] = buf[1].wrapping_add(b);
+	buf[2] = buf[2].wrapping_add(c);
+	buf[3] = buf[3].wrapping_add(d);
+}
+
+/// The TEA transform.
+fn tea_transform(buf: &mut [u32; 4], input: &[u32; 4]) {
+	const DELTA: u32 = 0x9e3779b9;
+
+	let mut sum: u32 = 0;
+	let (mut b0, mut b1) = (buf[0], buf[1]);
+	let [a, b, c, d] = *input;
+
+	for _ in 0..16 {
+		sum = sum.wrapping_add(DELTA);
+		b0 = b0.wrapping_add((b1 << 4).wrapping_add(a)
+			^ b1.wrapping_add(sum)
+			^ (b1 >> 5).wrapping_add(b));
+		b1 = b1.wrapping_add((b0 << 4).wrapping_add(c)
+			^ b0.wrapping_add(sum)
+			^ (b0 >> 5).wrapping_add(d));
+	}
+
+	buf[0] = buf[0].wrapping_add(b0);
+	buf[1] = buf[1].wrapping_add(b1);
+}
+
+/// Computes the hash of the name `name`.
+/// `version` is the hash function, including the unsigned offset if name bytes are unsigned.
+/// `seed` is the seed of the hash function. If zero, the default seed is used.
+/// If the hash function is not supported, the function returns None.
+pub fn hash(name: &[u8], version: u8, seed: &[u32; 4]) -> Option<u32> {
+	let signed = version < HASH_UNSIGNED_OFFSET;
+	let mut buf = if seed.iter().any(| s | *s != 0) {
+		*seed
+	} else {
+		DEFAULT_SEED
+	};
+
+	if version > HASH_TEA + HASH_UNSIGNED_OFFSET {
+		return None;
+	}
+
+	let hash = match version % HASH_UNSIGNED_OFFSET {
+		HASH_LEGACY => legacy_hash(name, signed),
+
+		HASH_HALF_MD4 => {
+			let mut input = [0; 8];
+			// Hashing the name in chunks of 32 bytes
+			let mut chunk = name;
+			while !chunk.is_empty() {
+				str_to_hash_buf(chunk, signed, &mut input);
+				half_md4_transform(&mut buf, &input);
+				chunk = &chunk[chunk.len().min(32)..];
+			}
+
+			buf[1]
+		},
+
+		_ => {
+			let mut input = [0; 4];
+			// Hashing the name in chunks of 16 bytes
+			let mut chunk = name;
+			while !chunk.is_empty() {
+				str_to_hash_buf(chunk, signed, &mut input);
+				tea_transform(&mut buf, &input);
+				chunk = &chunk[chunk.len().min(16)..];
+			}
+
+			buf[0]
+		},
+	};
+
+	// The lowest bit is reserved for collisions and the highest value for the end of directory
+	let hash = hash & !1;
+	if hash == 0xfffffffe {
+		Some(0xfffffffc)
+	} else {
+		Some(hash)
+	}
+}
+
+/// Returns the capacity of the root node for blocks of size `blk_size`.
+pub fn root_limit(blk_size: usize) -> usize {
+	(blk_size - ROOT_ENTRIES_OFF) / 8
+}
+
+/// Returns the capacity of an internal node for blocks of size `blk_size`.
+pub fn node_limit(blk_size: usize) -> usize {
+	(blk_size - NODE_ENTRIES_OFF) / 8
+}
+
+/// Reads the information about the index from the root block `blk`.
+/// The function returns the hash function and the number of levels of internal nodes.
+/// If the index is invalid or not supported, the function returns None.
+pub fn get_root_info(blk: &[u8]) -> Option<(u8, u8)> {
+	let version = blk[ROOT_INFO_OFF + 4];
+	let info_len = blk[ROOT_INFO_OFF + 5];
+	let levels = blk[ROOT_INFO_OFF + 6];
+	if read_u32(blk, ROOT_INFO_OFF) != 0 || info_len != ROOT_INFO_LEN
+		|| levels > MAX_INDIRECT_LEVELS || version > HASH_TEA {
+		return None;
+	}
+
+	let count = get_count(blk, ROOT_ENTRIES_OFF);
+	if count == 0 || count > get_limit(blk, ROOT_ENTRIES_OFF)
+		|| get_limit(blk, ROOT_ENTRIES_OFF) != root_limit(blk.len()) {
+		return None;
+	}
+
+	Some((version, levels))
+}
+
+/// Sets the number of levels of internal nodes in the root block `blk`.
+pub fn set_root_levels(blk: &mut [u8], levels: u8) {
+	blk[ROOT_INFO_OFF + 6] = levels;
+}
+
+/// Initializes the index in the root block `blk`, with a single child `child`.
+/// The entries `.` and `..` must already be present at the beginning of the block.
+/// `version` is the hash function to use.
+pub fn init_root(blk: &mut [u8], version: u8, child: u32) {
+	blk[ROOT_INFO_OFF..].fill(0);
+	blk[ROOT_INFO_OFF + 4] = version;
+	blk[ROOT_INFO_OFF + 5] = ROOT_INFO_LEN;
+
+	let limit = root_limit(blk.len());
+	init_node_entries(blk, ROOT_ENTRIES_OFF, limit);
+	set_count(blk, ROOT_ENTRIES_OFF, 1);
+	set_block(blk, ROOT_ENTRIES_OFF, 0, child);
+}
+
+/// Initializes the internal node in the block `blk`, without entries.
+pub fn init_node(blk: &mut [u8]) {
+	blk.fill(0);
+	// The free entry covering the whole block
+	write_u16(blk, 4, blk.len() as _);
+
+	let limit = node_limit(blk.len());
+	init_node_entries(blk, NODE_ENTRIES_OFF, limit);
+}
+
+/// Initializes the entries of a node at offset `off` in `blk`, with the capacity `limit`.
+fn init_node_entries(blk: &mut [u8], off: usize, limit: usize) {
+	write_u16(blk, off, limit as _);
+	write_u16(blk, off + 2, 0);
+}
+
+/// Returns the capacity of the node at offset `off` in `blk`.
+pub fn get_limit(blk: &[u8], off: usize) -> usize {
+	read_u16(blk, off) as _
+}
+
+/// Returns the number of entries of the node at offset `off` in `blk`.
+pub fn get_count(blk: &[u8], off: usize) -> usize {
+	read_u16(blk, off + 2) as _
+}
+
+/// Sets the number of entries of the node at offset `off` in `blk`.
+pub fn set_count(blk: &mut [u8], off: usize, count: usize) {
+	write_u16(blk, off + 2, count as _);
+}
+
+/// Returns the hash of the `i`th entry of the node at offset `off` in `blk`.
+pub fn get_hash(blk: &[u8], off: usize, i: usize) -> u32 {
+	if i == 0 {
+		0
+	} else {
+		read_u32(blk, off + i * 8)
+	}
+}
+
+/// Returns the child block of the `i`th entry of the node at offset `off` in `blk`.
+pub fn get_block(blk: &[u8], off: usize, i: usize) -> u32 {
+	read_u32(blk, off + i * 8 + 4)
+}
+
+/// Sets the child block of the `i`th entry of the node at offset `off` in `blk`.
+pub fn set_block(blk: &mut [u8], off: usize, i: usize, block: u32) {
+	write_u32(blk, off + i * 8 + 4, block);
+}
+
+/// Returns the index of the entry of the node at offset `off` in `blk` whose child may hold names
+/// with the hash `hash`.
+pub fn search(blk: &[u8], off: usize, hash: u32) -> usize {
+	// Looking for the last entry whose hash is lower than or equal to `hash`
+	let mut begin = 1;
+	let mut end = get_count(blk, off);
+	while begin < end {
+		let mid = begin + (end - begin) / 2;
+		if get_hash(blk, off, mid) <= hash {
+			begin = mid + 1;
+		} else {
+			end = mid;
+		}
+	}
+
+	begin - 1
+}
+
+/// Inserts an entry with hash `hash` and child `block` at index `i` in the node at offset `off` in
+/// `blk`. `i` must not be zero.
+/// If the node is full, the behaviour is undefined.
+pub fn insert(blk: &mut [u8], off: usize, i: usize, hash: u32, block: u32) {
+	debug_assert!(i > 0);
+
+	let count = get_count(blk, off);
+	debug_assert!(count < get_limit(blk, off));
+
+	let begin = off + i * 8;
+	blk.copy_within(begin..(off + count * 8), begin + 8);
+	write_u32(blk, begin, hash);
+	write_u32(blk, begin + 4, block);
+	set_count(blk, off, count + 1);
+}
+
+/// Moves the entries of the node at offset `src_off` in `src` starting from index `from` to the
+/// empty node at offset `dst_off` in `dst`.
+/// The hash of the first moved entry becomes implicit, thus the caller must keep it.
+pub fn move_entries(src: &mut [u8], src_off: usize, from: usize, dst: &mut [u8],
+	dst_off: usize) {
+	let count = get_count(src, src_off);
+	debug_assert!(count - from <= get_limit(dst, dst_off) && get_count(dst, dst_off) == 0);
+
+	// The entry whose hash is replaced by the count and limit
+	set_block(dst, dst_off, 0, get_block(src, src_off, from));
+	let len = (count - from - 1) * 8;
+	let begin = src_off + (from + 1) * 8;
+	dst[(dst_off + 8)..(dst_off + 8 + len)].copy_from_slice(&src[begin..(begin + len)]);
+
+	set_count(dst, dst_off, count - from);
+	set_count(src, src_off, from);
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	#[test_case]
+	fn htree_hash0() {
+		let seed = [0; 4];
+		for version in 0..(HASH_TEA + HASH_UNSIGNED_OFFSET + 1) {
+			let a = hash(b"foo", version, &seed).unwrap();
+			let b = hash(b"bar", version, &seed).unwrap();
+
+			assert_eq!(a & 1, 0);
+			assert_ne!(a, b);
+			assert_eq!(a, hash(b"foo", version, &seed).unwrap());
+		}
+
+		assert!(hash(b"foo", HASH_TEA + HASH_UNSIGNED_OFFSET + 1, &seed).is_none());
+	}
+
+	#[test_case]
+	fn htree_node0() {
+		let mut blk = [0u8; 1024];
+		init_node(&mut blk);
+		set_count(&mut blk, NODE_ENTRIES_OFF, 1);
+		set_block(&mut blk, NODE_ENTRIES_OFF, 0, 1);
+		insert(&mut blk, NODE_ENTRIES_OFF, 1, 200, 3);
+		insert(&mut blk, NODE_ENTRIES_OFF, 1, 100, 2);
+
+		assert_eq!(get_count(&blk, NODE_ENTRIES_OFF), 3);
+		assert_eq!(search(&blk, NODE_ENTRIES_OFF, 50), 0);
+		assert_eq!(search(&blk, NODE_ENTRIES_OFF, 100), 1);
+		assert_eq!(search(&blk, NODE_ENTRIES_OFF, 150), 1);
+		assert_eq!(search(&blk, NODE_ENTRIES_OFF, 250), 2);
+		assert_eq!(get_block(&blk, NODE_ENTRIES_OFF, 2), 3);
+	}
+}
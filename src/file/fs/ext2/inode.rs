@@ -17,10 +17,13 @@ use crate::memory::malloc;
 use crate::util::IO;
 use crate::util::boxed::Box;
 use crate::util::container::string::String;
+use crate::util::container::vec::Vec;
 use crate::util::math;
 use super::Superblock;
 use super::block_group_descriptor::BlockGroupDescriptor;
 use super::directory_entry::DirectoryEntry;
+use super::directory_entry;
+use super::htree;
 use super::read;
 use super::read_block;
 use super::write;
@@ -29,6 +32,9 @@ use super::write_block;
 /// The maximum number of direct blocks for each inodes.
 pub const DIRECT_BLOCKS_COUNT: u8 = 12;
 
+/// The maximum number of freed blocks collected before releasing them.
+const FREE_BATCH_SIZE: usize = 4096;
+
 /// INode type: FIFO
 pub const INODE_TYPE_FIFO: u16 = 0x1000;
 /// INode type: Char device
@@ -92,11 +98,11 @@ const INODE_FLAG_NODUMP: u32 = 0x00040;
 /// Last accessed time should not updated
 const INODE_FLAG_ATIME_NOUPDATE: u32 = 0x00080;
 /// Hash indexed directory
-const INODE_FLAG_HASH_INDEXED: u32 = 0x10000;
+const INODE_FLAG_HASH_INDEXED: u32 = 0x01000;
 /// AFS directory
-const INODE_FLAG_AFS_DIRECTORY: u32 = 0x20000;
+const INODE_FLAG_AFS_DIRECTORY: u32 = 0x02000;
 /// Journal file data
-const INODE_FLAG_JOURNAL_FILE: u32 = 0x40000;
+const INODE_FLAG_JOURNAL_FILE: u32 = 0x04000;
 
 /// The size of a sector in bytes.
 const SECTOR_SIZE: u32 = 512;
@@ -111,6 +117,45 @@ pub const ROOT_DIRECTORY_DEFAULT_MODE: u16 = INODE_PERMISSION_IRWXU
 	| INODE_PERMISSION_IRGRP | INODE_PERMISSION_IXGRP
 	| INODE_PERMISSION_IROTH | INODE_PERMISSION_IXOTH;
 
+/// A position in a node of a directory's hash tree.
+#[derive(Clone, Copy)]
+struct DxFrame {
+	/// The directory block containing the node.
+	block: u32,
+	/// The index of the entry in the node.
+	pos: usize,
+	/// The block of the child pointed to by the entry.
+	child: u32,
+}
+
+impl DxFrame {
+	/// Returns the offset of the entries in a node at level `level` of the tree.
+	fn get_entries_off(level: u8) -> usize {
+		if level == 0 {
+			htree::ROOT_ENTRIES_OFF
+		} else {
+			htree::NODE_ENTRIES_OFF
+		}
+	}
+}
+
+/// The path from the root of a directory's hash tree to a leaf.
+struct DxPath {
+	/// The hash of the name being looked up.
+	hash: u32,
+	/// The hash function used by the tree.
+	version: u8,
+	/// The position in each node, from the root.
+	frames: Vec<DxFrame>,
+}
+
+impl DxPath {
+	/// Returns the leaf block the path leads to.
+	fn get_leaf(&self) -> u32 {
+		self.frames[self.frames.len() - 1].child
+	}
+}
+
 /// An inode represents a file in the filesystem. The name of the file is not included in the inode
 /// but in the directory entry associated with it since several entries can refer to the same
 /// inode (hard links).
@@ -377,11 +422,12 @@ impl Ext2INode {
 	/// `n` is the number of indirections to resolve.
 	/// `begin` is the beginning block.
 	/// `off` is the offset of the block relative to the specified beginning block.
+	/// `blk` is the block to use as content, already marked as used.
 	/// `superblock` is the filesystem's superblock.
 	/// `io` is the I/O interface.
 	/// The function returns the the allocated block.
-	fn indirections_alloc(&mut self, n: u8, begin: u32, off: u32, superblock: &mut Superblock,
-		io: &mut dyn IO) -> Result<u32, Errno> {
+	fn indirections_alloc(&mut self, n: u8, begin: u32, off: u32, blk: u32,
+		superblock: &mut Superblock, io: &mut dyn IO) -> Result<u32, Errno> {
 		let blk_size = superblock.get_block_size();
 		let entries_per_blk = blk_size / size_of::<u32>() as u32;
 
@@ -396,31 +442,35 @@ impl Ext2INode {
 				read::<u32>(byte_off, io)?
 			};
 			if b == 0 {
-				let blk = superblock.get_free_block(io)?;
-				superblock.mark_block_used(io, blk)?;
+				let new_blk = if n == 1 {
+					blk
+				} else {
+					superblock.alloc_block(io, blk)?
+				};
 
 				// Incrementing the number of used sectors
 				self.used_sectors += math::ceil_division(blk_size, SECTOR_SIZE);
 
-				write::<u32>(&blk, byte_off, io)?;
-				b = blk;
+				write::<u32>(&new_blk, byte_off, io)?;
+				b = new_blk;
 			}
 
 			let next_off = off - blk_per_blk * inner_index;
-			self.indirections_alloc(n - 1, b, next_off, superblock, io)
+			self.indirections_alloc(n - 1, b, next_off, blk, superblock, io)
 		} else {
 			Ok(begin)
 		}
 	}
 
-	/// Allocates a block for the node's content block at the given offset `i`.
-	/// If the block is already allocated, the function does nothing.
+	/// Uses the block `blk` for the node's content block at the given offset `i`.
+	/// The block must not be already allocated.
 	/// `i` is the block offset in the node's content.
+	/// `blk` is the block to use, already marked as used.
 	/// `superblock` is the filesystem's superblock.
 	/// `io` is the I/O interface.
 	/// On success, the function returns the allocated final block offset.
-	fn alloc_content_block(&mut self, i: u32, superblock: &mut Superblock, io: &mut dyn IO)
-		-> Result<u32, Errno> {
+	fn alloc_content_block(&mut self, i: u32, blk: u32, superblock: &mut Superblock,
+		io: &mut dyn IO) -> Result<u32, Errno> {
 		let blk_size = superblock.get_block_size();
 		let entries_per_blk = blk_size / size_of::<u32>() as u32;
 
@@ -429,9 +479,7 @@ impl Ext2INode {
 
 		// If direct block, handle it directly
 		if level == 0 {
-			let blk = superblock.get_free_block(io)?;
 			self.direct_block_ptrs[i as usize] = blk;
-			superblock.mark_block_used(io, blk)?;
 
 			// Incrementing the number of used sectors
 			self.used_sectors += math::ceil_division(blk_size, SECTOR_SIZE);
@@ -459,9 +507,9 @@ impl Ext2INode {
 		};
 
 		if let Some(begin) = Self::blk_offset_to_option(begin_id) {
-			self.indirections_alloc(level, begin, target, superblock, io)
+			self.indirections_alloc(level, begin, target, blk, superblock, io)
 		} else {
-			let begin = superblock.get_free_block(io)?;
+			let begin = superblock.alloc_block(io, blk)?;
 			match level {
 				1 => self.singly_indirect_block_ptr = begin,
 				2 => self.doubly_indirect_block_ptr = begin,
@@ -469,153 +517,24 @@ impl Ext2INode {
 
 				_ => unreachable!(),
 			}
-			superblock.mark_block_used(io, begin)?;
 
 			// Incrementing the number of used sectors
 			self.used_sectors += math::ceil_division(blk_size, SECTOR_SIZE);
 
-			self.indirections_alloc(level, begin, target, superblock, io)
-		}
-	}
-
-	/// Tells whether the given block has all its entries empty.
-	fn is_blk_empty(blk: &[u8]) -> bool {
-		let ptr = blk.as_ptr() as *const usize;
-		let len = blk.len() / size_of::<usize>();
-
-		// Checking the buffer in bulk with the usize type
-		for i in 0..len {
-			let v = unsafe { // Safe because in range of the slice
-				*ptr.add(i)
-			};
-
-			if v != 0 {
-				return false;
-			}
-		}
-
-		// Remaining bytes to check
-		let remaining = blk.len() % size_of::<usize>();
-		// Checking the remaining bytes
-		for b in &blk[remaining..] {
-			if *b != 0 {
-				return false;
-			}
+			self.indirections_alloc(level, begin, target, blk, superblock, io)
 		}
-
-		true
 	}
 
-	/// Frees a block of the content of the file through block indirections.
-	/// `n` is the number of indirections to resolve.
-	/// `begin` is the beginning block.
-	/// `off` is the offset of the block relative to the specified beginning block.
-	/// `superblock` is the filesystem's superblock.
-	/// `io` is the I/O interface.
-	/// The function returns a boolean telling whether the block at `begin` has been freed.
-	fn indirections_free(&mut self, n: u8, begin: u32, off: u32, superblock: &mut Superblock,
-		io: &mut dyn IO) -> Result<bool, Errno> {
-		let blk_size = superblock.get_block_size();
-		let entries_per_blk = blk_size / size_of::<u32>() as u32;
-
-		if n > 0 {
-			let blk_per_blk = math::pow(entries_per_blk as u32, (n - 1) as _);
-			let inner_index = off / blk_per_blk;
-			let inner_off = inner_index as u64 * size_of::<u32>() as u64;
-			debug_assert!(inner_off < blk_size as u64);
-			let byte_off = (begin as u64 * blk_size as u64) + inner_off as u64;
-
-			let b = unsafe {
-				read::<u32>(byte_off, io)?
-			};
-
-			let next_off = off - blk_per_blk * inner_index;
-			if self.indirections_free(n - 1, b, next_off, superblock, io)? {
-				// Reading the current block
-				let mut buff = malloc::Alloc::<u8>::new_default(blk_size as _)?;
-				read_block(begin as _, superblock, io, buff.as_slice_mut())?;
-
-				// If the current block is empty, free it
-				if Self::is_blk_empty(buff.as_slice()) {
-					superblock.free_block(io, begin)?;
-
-					// Decrementing the number of used sectors
-					self.used_sectors -= math::ceil_division(blk_size, SECTOR_SIZE);
-
-					return Ok(true);
-				}
-			}
-
-			Ok(false)
-		} else {
-			superblock.free_block(io, begin)?;
-			Ok(true)
-		}
-	}
-
-	/// Frees a content block at block offset `i` in file.
-	/// If the block isn't allocated, the function does nothing.
-	/// `i` is the id of the block.
-	/// `superblock` is the filesystem's superblock.
-	/// `io` is the I/O interface.
-	fn free_content_block(&mut self, i: u32, superblock: &mut Superblock, io: &mut dyn IO)
-		-> Result<(), Errno> {
-		let blk_size = superblock.get_block_size();
-		let entries_per_blk = blk_size / size_of::<u32>() as u32;
-
-		// The number of indirections to perform
-		let level = Self::get_content_blk_indirections_count(i, entries_per_blk);
-
-		// If direct block, handle it directly
-		if level == 0 {
-			superblock.free_block(io, self.direct_block_ptrs[i as usize])?;
-			self.direct_block_ptrs[i as usize] = 0;
-
-			// Decrementing the number of used sectors
-			self.used_sectors -= math::ceil_division(blk_size, SECTOR_SIZE);
-
-			return Ok(());
-		}
-
-		// The id on the beginning block to indirect from
-		let begin_id = match level {
-			1 => self.singly_indirect_block_ptr,
-			2 => self.doubly_indirect_block_ptr,
-			3 => self.triply_indirect_block_ptr,
-
-			_ => unreachable!(),
-		};
-
-		let target = i - DIRECT_BLOCKS_COUNT as u32 - {
-			match level {
-				1 => 0,
-				2 => entries_per_blk,
-				3 => entries_per_blk * entries_per_blk,
-
-				_ => unreachable!(),
-			}
-		};
-
-		if let Some(begin) = Self::blk_offset_to_option(begin_id) {
-			let empty = self.indirections_free(level, begin, target, superblock, io)?;
-
-			// If the block has zero entries left, free it
-			if empty {
-				superblock.free_block(io, begin)?;
-				match level {
-					1 => self.singly_indirect_block_ptr = 0,
-					2 => self.doubly_indirect_block_ptr = 0,
-					3 => self.triply_indirect_block_ptr = 0,
-
-					_ => unreachable!(),
-				}
-
-				// Incrementing the number of used sectors
-				self.used_sectors -= math::ceil_division(blk_size, SECTOR_SIZE);
-			}
+	/// Returns the block after which the content block at offset `i` should be allocated to keep
+	/// the content contiguous on the disk. If no previous block is allocated, the function
+	/// returns zero.
+	fn get_alloc_goal(&self, i: u32, superblock: &Superblock, io: &mut dyn IO)
+		-> Result<u32, Errno> {
+		if i == 0 {
+			return Ok(0);
 		}
 
-		Ok(())
+		Ok(self.get_content_block_off(i - 1, superblock, io)?.map(| b | b + 1).unwrap_or(0))
 	}
 
 	/// Reads the content of the inode.
@@ -660,28 +579,64 @@ impl Ext2INode {
 		Ok(min(i, max))
 	}
 
-	/// Writes the content of the inode.
-	/// `off` is the offset at which the inode is written.
-	/// `buff` is the buffer in which the data is to be written.
+	/// Hints the I/O that the content of the inode from offset `off` on `size` bytes is going to
+	/// be read soon. Contiguous blocks on the disk are hinted together.
 	/// `superblock` is the filesystem's superblock.
 	/// `io` is the I/O interface.
-	/// The function returns the number of bytes that have been written.
-	pub fn write_content(&mut self, off: u64, buff: &[u8], superblock: &mut Superblock,
-		io: &mut dyn IO) -> Result<(), Errno> {
-		let curr_size = self.get_size(superblock);
-		if off > curr_size {
-			return Err(errno!(EINVAL));
+	pub fn readahead(&self, off: u64, size: u64, superblock: &Superblock, io: &mut dyn IO)
+		-> Result<(), Errno> {
+		let file_size = self.get_size(superblock);
+		if off >= file_size {
+			return Ok(());
+		}
+
+		let blk_size = superblock.get_block_size() as u64;
+		let begin = off / blk_size;
+		let end = math::ceil_division(min(off + size, file_size), blk_size);
+
+		// The current run of contiguous blocks on the disk, as its first block and length
+		let mut run: Option<(u64, u64)> = None;
+		for i in begin..end {
+			let blk = self.get_content_block_off(i as _, superblock, io)?.map(| b | b as u64);
+
+			run = match (run, blk) {
+				(Some((first, len)), Some(blk)) if first + len == blk => Some((first, len + 1)),
+
+				(run, blk) => {
+					if let Some((first, len)) = run {
+						io.readahead(first * blk_size, len * blk_size);
+					}
+					blk.map(| blk | (blk, 1))
+				},
+			};
+		}
+		if let Some((first, len)) = run {
+			io.readahead(first * blk_size, len * blk_size);
 		}
 
+		Ok(())
+	}
+
+	/// Writes the content of the inode to blocks, allocating missing blocks from the reservation
+	/// `reserved`, which is the next reserved block and the number of remaining reserved blocks.
+	/// When the reservation is exhausted, a new one is made for the remaining blocks of the
+	/// write, contiguous to the previous block of the content when possible.
+	/// `off` is the offset at which the inode is written.
+	/// `buff` is the buffer in which the data is to be written.
+	/// `superblock` is the filesystem's superblock.
+	/// `io` is the I/O interface.
+	fn write_blocks(&mut self, off: u64, buff: &[u8], reserved: &mut (u32, u32),
+		superblock: &mut Superblock, io: &mut dyn IO) -> Result<(), Errno> {
 		let blk_size = superblock.get_block_size();
 		let mut blk_buff = malloc::Alloc::<u8>::new_default(blk_size as usize)?;
+		let last_blk = ((off + buff.len() as u64 - 1) / blk_size as u64) as u32;
 
 		let mut i = 0;
 		while i < buff.len() {
-			let blk_off = (off + i as u64) / blk_size as u64;
+			let blk_off = ((off + i as u64) / blk_size as u64) as u32;
 			let blk_inner_off = ((off + i as u64) % blk_size as u64) as usize;
 			let blk_off = {
-				if let Some(blk_off) = self.get_content_block_off(blk_off as _, superblock, io)? {
+				if let Some(blk_off) = self.get_content_block_off(blk_off, superblock, io)? {
 					// Reading block
 					read_block(blk_off as _, superblock, io, blk_buff.as_slice_mut())?;
 					blk_off
@@ -690,7 +645,17 @@ impl Ext2INode {
 					for b in blk_buff.as_slice_mut() {
 						*b = 0;
 					}
-					self.alloc_content_block(blk_off as u32, superblock, io)?
+
+					if reserved.1 == 0 {
+						let goal = self.get_alloc_goal(blk_off, superblock, io)?;
+						let count = last_blk - blk_off + 1;
+						*reserved = superblock.alloc_blocks(io, goal, count)?;
+					}
+					let blk = self.alloc_content_block(blk_off, reserved.0, superblock, io)?;
+					reserved.0 += 1;
+					reserved.1 -= 1;
+
+					blk
 				}
 			};
 
@@ -707,144 +672,198 @@ impl Ext2INode {
 			i += len;
 		}
 
-		let new_size = max(off + buff.len() as u64, curr_size);
-		self.set_size(superblock, new_size);
 		Ok(())
 	}
 
-	/// Truncates the file to the given size `size`.
+	/// Writes the content of the inode.
+	/// `off` is the offset at which the inode is written.
+	/// `buff` is the buffer in which the data is to be written.
 	/// `superblock` is the filesystem's superblock.
 	/// `io` is the I/O interface.
-	/// `size` is the new size of the inode's content.
-	/// If `size` is greater than or equal to the previous size, the function does nothing.
-	pub fn truncate(&mut self, superblock: &mut Superblock, io: &mut dyn IO, size: u64)
-		-> Result<(), Errno> {
-		let old_size = self.get_size(superblock);
-		if size >= old_size {
+	/// The function returns the number of bytes that have been written.
+	pub fn write_content(&mut self, off: u64, buff: &[u8], superblock: &mut Superblock,
+		io: &mut dyn IO) -> Result<(), Errno> {
+		let curr_size = self.get_size(superblock);
+		if off > curr_size {
+			return Err(errno!(EINVAL));
+		}
+		if buff.is_empty() {
 			return Ok(());
 		}
 
-		// Changing the size
-		self.set_size(superblock, size);
+		let mut reserved = (0, 0);
+		let result = self.write_blocks(off, buff, &mut reserved, superblock, io);
 
-		// The size of a block
-		let blk_size = superblock.get_block_size();
-
-		// The index of the beginning block to free
-		let begin = math::ceil_division(size, blk_size as _) as u32;
-		// The index of the end block to free
-		let end = math::ceil_division(old_size, blk_size as _) as u32;
-		for i in begin..end {
-			// TODO Optimize
-			self.free_content_block(i, superblock, io)?;
+		// Releasing the reserved blocks that have not been used
+		for blk in reserved.0..(reserved.0 + reserved.1) {
+			superblock.free_block(io, blk)?;
 		}
+		result?;
 
+		let new_size = max(off + buff.len() as u64, curr_size);
+		self.set_size(superblock, new_size);
 		Ok(())
 	}
 
-	/// Frees all content blocks by doing redirections.
-	/// `begin` is the beginning block.
-	/// `n` is the number of indicrections.
+	/// Marks the blocks in `freed` available on the filesystem in a single batch, then clears
+	/// the list.
 	/// `superblock` is the filesystem's superblock.
 	/// `io` is the I/O interface.
-	fn indirect_free_all(begin: u32, n: usize, superblock: &mut Superblock, io: &mut dyn IO)
-		-> Result<(), Errno> {
+	fn flush_freed(&mut self, freed: &mut Vec<u32>, superblock: &mut Superblock,
+		io: &mut dyn IO) -> Result<(), Errno> {
 		let blk_size = superblock.get_block_size();
-		let entries_per_blk = blk_size as usize / size_of::<u32>();
+		let sectors = freed.len() as u32 * math::ceil_division(blk_size, SECTOR_SIZE);
+		self.used_sectors = self.used_sectors.saturating_sub(sectors);
 
-		// Reading the block
-		let mut blk_buff = malloc::Alloc::<u32>::new_default(entries_per_blk)?;
-		read_block(begin as _, superblock, io, blk_buff.as_slice_mut())?;
+		let result = superblock.free_blocks(io, freed.as_mut_slice());
+		freed.clear();
+		result
+	}
 
-		// Free every entries recursively
-		for i in 0..entries_per_blk {
-			let b = blk_buff[i];
+	/// Removes the content blocks starting at offset `from` from the indirection tree at block
+	/// `begin`, collecting the removed blocks into `freed`. If too many blocks are collected,
+	/// they are released through `flush_freed`.
+	/// `n` is the number of indirections of the tree, one meaning that entries of `begin` are
+	/// content blocks.
+	/// `superblock` is the filesystem's superblock.
+	/// `io` is the I/O interface.
+	/// The function returns a boolean telling whether the tree is left empty, in which case the
+	/// block `begin` is collected as well.
+	fn indirect_free_all(&mut self, begin: u32, n: u8, from: u32, freed: &mut Vec<u32>,
+		superblock: &mut Superblock, io: &mut dyn IO) -> Result<bool, Errno> {
+		let blk_size = superblock.get_block_size();
+		let entries_per_blk = blk_size / size_of::<u32>() as u32;
+		// The number of content blocks covered by each entry
+		let span = math::pow(entries_per_blk, (n - 1) as _);
+
+		let mut entries = malloc::Alloc::<u32>::new_default(entries_per_blk as _)?;
+		read_block(begin as _, superblock, io, entries.as_slice_mut())?;
+
+		let first = from / span;
+		let mut modified = false;
+		for i in first..entries_per_blk {
+			let b = entries[i as usize];
+			if b == 0 {
+				continue;
+			}
 
-			// If the entry is not empty, free it
-			if b != 0 {
-				// If indirections remain, free entries recursively
-				if n > 0 {
-					Self::indirect_free_all(b, n - 1, superblock, io)?;
+			let sub_from = if i == first {
+				from % span
+			} else {
+				0
+			};
+			let empty = n == 1 || self.indirect_free_all(b, n - 1, sub_from, freed, superblock,
+				io)?;
+			if empty {
+				if n == 1 {
+					freed.push(b)?;
 				}
+				entries[i as usize] = 0;
+				modified = true;
+			}
 
-				superblock.free_block(io, b)?;
+			if freed.len() >= FREE_BATCH_SIZE {
+				self.flush_freed(freed, superblock, io)?;
 			}
 		}
 
-		superblock.free_block(io, begin)
+		if entries.as_slice().iter().all(| e | *e == 0) {
+			freed.push(begin)?;
+			return Ok(true);
+		}
+		if modified {
+			write_block(begin as _, superblock, io, entries.as_slice())?;
+		}
+		Ok(false)
 	}
 
-	/// Frees all the content blocks of the inode.
-	/// `range` is the range on which content blocks will be removed.
+	/// Removes every content blocks starting at offset `begin`, walking each indirection tree
+	/// once and releasing the blocks by batches.
 	/// `superblock` is the filesystem's superblock.
 	/// `io` is the I/O interface.
-	pub fn free_content(&mut self, superblock: &mut Superblock, io: &mut dyn IO)
+	fn free_content_from(&mut self, begin: u32, superblock: &mut Superblock, io: &mut dyn IO)
 		-> Result<(), Errno> {
-		for i in 0..(DIRECT_BLOCKS_COUNT as usize) {
+		let mut freed = Vec::new();
+		for i in (begin as usize)..(DIRECT_BLOCKS_COUNT as usize) {
 			if self.direct_block_ptrs[i] != 0 {
-				superblock.free_block(io, self.direct_block_ptrs[i])?;
+				freed.push(self.direct_block_ptrs[i])?;
 				self.direct_block_ptrs[i] = 0;
 			}
 		}
 
-		if self.singly_indirect_block_ptr != 0 {
-			Self::indirect_free_all(self.singly_indirect_block_ptr, 1, superblock, io)?;
+		let entries_per_blk = superblock.get_block_size() / size_of::<u32>() as u32;
+		let mut base = DIRECT_BLOCKS_COUNT as u32;
+		let mut span = entries_per_blk;
+		for n in 1..=3 {
+			let ptr = match n {
+				1 => self.singly_indirect_block_ptr,
+				2 => self.doubly_indirect_block_ptr,
+				3 => self.triply_indirect_block_ptr,
 
-			superblock.free_block(io, self.singly_indirect_block_ptr)?;
-			self.singly_indirect_block_ptr = 0;
-		}
-		if self.doubly_indirect_block_ptr != 0 {
-			Self::indirect_free_all(self.doubly_indirect_block_ptr, 2, superblock, io)?;
+				_ => unreachable!(),
+			};
 
-			superblock.free_block(io, self.doubly_indirect_block_ptr)?;
-			self.doubly_indirect_block_ptr = 0;
-		}
-		if self.triply_indirect_block_ptr != 0 {
-			Self::indirect_free_all(self.triply_indirect_block_ptr, 3, superblock, io)?;
+			if ptr != 0 && begin < base + span {
+				let from = begin.saturating_sub(base);
+				let result = self.indirect_free_all(ptr, n, from, &mut freed, superblock, io);
 
-			superblock.free_block(io, self.triply_indirect_block_ptr)?;
-			self.triply_indirect_block_ptr = 0;
-		}
+				// Releasing the collected blocks even on failure, since they are unlinked
+				let empty = match result {
+					Ok(empty) => empty,
 
-		// Updating the number of used sectors
-		self.used_sectors = 0;
+					Err(e) => {
+						self.flush_freed(&mut freed, superblock, io)?;
+						return Err(e);
+					},
+				};
+				if empty {
+					match n {
+						1 => self.singly_indirect_block_ptr = 0,
+						2 => self.doubly_indirect_block_ptr = 0,
+						3 => self.triply_indirect_block_ptr = 0,
 
-		Ok(())
+						_ => unreachable!(),
+					}
+				}
+			}
+
+			base += span;
+			span = span.saturating_mul(entries_per_blk);
+		}
+
+		self.flush_freed(&mut freed, superblock, io)
 	}
 
-	/// Reads the directory entry at offset `off` and returns it.
+	/// Truncates the file to the given size `size`.
 	/// `superblock` is the filesystem's superblock.
 	/// `io` is the I/O interface.
-	/// `off` is the offset of the directory entry.
-	/// If the file is not a directory, the behaviour is undefined.
-	fn read_dirent(&self, superblock: &Superblock, io: &mut dyn IO, off: u64)
-		-> Result<Box<DirectoryEntry>, Errno> {
-		let mut buff: [u8; 8] = [0; 8];
-		self.read_content(off as _, &mut buff, superblock, io)?;
-		let entry = unsafe {
-			DirectoryEntry::from(&buff)?
-		};
+	/// `size` is the new size of the inode's content.
+	/// If `size` is greater than or equal to the previous size, the function does nothing.
+	pub fn truncate(&mut self, superblock: &mut Superblock, io: &mut dyn IO, size: u64)
+		-> Result<(), Errno> {
+		let old_size = self.get_size(superblock);
+		if size >= old_size {
+			return Ok(());
+		}
 
-		let mut buff = malloc::Alloc::<u8>::new_default(entry.get_total_size() as _)?;
-		self.read_content(off as _, buff.as_slice_mut(), superblock, io)?;
+		// Changing the size
+		self.set_size(superblock, size);
 
-		unsafe {
-			DirectoryEntry::from(buff.as_slice())
-		}
+		// The index of the beginning block to free
+		let begin = math::ceil_division(size, superblock.get_block_size() as _) as u32;
+		self.free_content_from(begin, superblock, io)
 	}
 
-	/// Writes the directory entry at offset `off`.
+	/// Frees all the content blocks of the inode.
 	/// `superblock` is the filesystem's superblock.
 	/// `io` is the I/O interface.
-	/// `off` is the offset of the directory entry.
-	/// If the file is not a directory, the behaviour is undefined.
-	fn write_dirent(&mut self, superblock: &mut Superblock, io: &mut dyn IO,
-		entry: &DirectoryEntry, off: u64) -> Result<(), Errno> {
-		let buff = unsafe {
-			slice::from_raw_parts(entry as *const _ as *const u8, entry.get_total_size() as _)
-		};
+	pub fn free_content(&mut self, superblock: &mut Superblock, io: &mut dyn IO)
+		-> Result<(), Errno> {
+		self.free_content_from(0, superblock, io)?;
+
+		// Updating the number of used sectors
+		self.used_sectors = 0;
 
-		self.write_content(off, buff, superblock, io)?;
 		Ok(())
 	}
 
@@ -924,6 +943,376 @@ impl Ext2INode {
 		Ok(count)
 	}
 
+	/// Tells whether the directory is indexed by a hash tree (see `htree`).
+	/// `superblock` is the filesystem's superblock.
+	fn is_indexed(&self, superblock: &Superblock) -> bool {
+		superblock.optional_features & super::OPTIONAL_FEATURE_HASH_INDEX != 0
+			&& self.flags & INODE_FLAG_HASH_INDEXED != 0
+	}
+
+	/// Returns the number of content blocks of the directory.
+	/// `superblock` is the filesystem's superblock.
+	fn get_dir_blocks_count(&self, superblock: &Superblock) -> u32 {
+		(self.get_size(superblock) / superblock.get_block_size() as u64) as _
+	}
+
+	/// Reads the `i`th content block of the directory into `buff`.
+	/// `superblock` is the filesystem's superblock.
+	/// `io` is the I/O interface.
+	fn read_dir_block(&self, i: u32, buff: &mut [u8], superblock: &Superblock, io: &mut dyn IO)
+		-> Result<(), Errno> {
+		let blk_size = superblock.get_block_size() as u64;
+		self.read_content(i as u64 * blk_size, buff, superblock, io)?;
+		Ok(())
+	}
+
+	/// Writes `buff` to the `i`th content block of the directory. If `i` is the number of blocks
+	/// of the directory, the block is appended.
+	/// `superblock` is the filesystem's superblock.
+	/// `io` is the I/O interface.
+	fn write_dir_block(&mut self, i: u32, buff: &[u8], superblock: &mut Superblock,
+		io: &mut dyn IO) -> Result<(), Errno> {
+		let blk_size = superblock.get_block_size() as u64;
+		self.write_content(i as u64 * blk_size, buff, superblock, io)
+	}
+
+	/// Walks the hash tree of the directory from the root to the leaf that may contain the entry
+	/// with name `name`.
+	/// `superblock` is the filesystem's superblock.
+	/// `io` is the I/O interface.
+	/// If the index is invalid or not supported, the function returns None.
+	fn dx_lookup(&self, name: &[u8], superblock: &Superblock, io: &mut dyn IO)
+		-> Result<Option<DxPath>, Errno> {
+		let blk_size = superblock.get_block_size();
+		let blocks_count = self.get_dir_blocks_count(superblock);
+		let mut buff = malloc::Alloc::<u8>::new_default(blk_size as _)?;
+
+		self.read_dir_block(0, buff.as_slice_mut(), superblock, io)?;
+		let Some((version, levels)) = htree::get_root_info(buff.as_slice()) else {
+			return Ok(None);
+		};
+		let version = superblock.get_hash_version(version);
+		let seed = superblock.get_hash_seed();
+		let Some(hash) = htree::hash(name, version, &seed) else {
+			return Ok(None);
+		};
+
+		let mut path = DxPath {
+			hash,
+			version,
+			frames: Vec::new(),
+		};
+		let mut block = 0;
+		for level in 0..=levels {
+			let off = DxFrame::get_entries_off(level);
+			if level > 0 {
+				self.read_dir_block(block, buff.as_slice_mut(), superblock, io)?;
+
+				let count = htree::get_count(buff.as_slice(), off);
+				if count == 0 || count > htree::get_limit(buff.as_slice(), off) {
+					return Ok(None);
+				}
+			}
+
+			let pos = htree::search(buff.as_slice(), off, hash);
+			let child = htree::get_block(buff.as_slice(), off, pos);
+			if child == 0 || child >= blocks_count {
+				return Ok(None);
+			}
+
+			path.frames.push(DxFrame {
+				block,
+				pos,
+				child,
+			})?;
+			block = child;
+		}
+
+		Ok(Some(path))
+	}
+
+	/// Moves `path` to the next leaf if it may hold entries with the same hash, which happens
+	/// when a leaf has been split between entries with colliding hashes.
+	/// `superblock` is the filesystem's superblock.
+	/// `io` is the I/O interface.
+	/// If there is no such leaf, the function returns false.
+	fn dx_next_leaf(&self, path: &mut DxPath, superblock: &Superblock, io: &mut dyn IO)
+		-> Result<bool, Errno> {
+		let blk_size = superblock.get_block_size();
+		let mut buff = malloc::Alloc::<u8>::new_default(blk_size as _)?;
+
+		// Going up until a node has a next entry
+		let mut level = path.frames.len();
+		loop {
+			if level == 0 {
+				return Ok(false);
+			}
+			level -= 1;
+
+			let frame = &mut path.frames[level];
+			let off = DxFrame::get_entries_off(level as _);
+			self.read_dir_block(frame.block, buff.as_slice_mut(), superblock, io)?;
+			if frame.pos + 1 >= htree::get_count(buff.as_slice(), off) {
+				continue;
+			}
+
+			let hash = htree::get_hash(buff.as_slice(), off, frame.pos + 1);
+			if hash & !1 != path.hash {
+				return Ok(false);
+			}
+
+			frame.pos += 1;
+			frame.child = htree::get_block(buff.as_slice(), off, frame.pos);
+			break;
+		}
+
+		// Going down to the first leaf of the subtree
+		for level in (level + 1)..path.frames.len() {
+			let block = path.frames[level - 1].child;
+			self.read_dir_block(block, buff.as_slice_mut(), superblock, io)?;
+
+			let off = DxFrame::get_entries_off(level as _);
+			path.frames[level] = DxFrame {
+				block,
+				pos: 0,
+				child: htree::get_block(buff.as_slice(), off, 0),
+			};
+		}
+
+		Ok(true)
+	}
+
+	/// Looks for the entry with name `name` in the leaves of the hash tree.
+	/// `buff` is the buffer in which the leaf containing the entry is read.
+	/// `superblock` is the filesystem's superblock.
+	/// `io` is the I/O interface.
+	/// If the index cannot be used, the function returns None. Else, the function returns the
+	/// leaf and the offset of the entry in it, if it exists.
+	fn dx_find(&self, name: &[u8], buff: &mut [u8], superblock: &Superblock, io: &mut dyn IO)
+		-> Result<Option<Option<(u32, usize)>>, Errno> {
+		let Some(mut path) = self.dx_lookup(name, superblock, io)? else {
+			return Ok(None);
+		};
+
+		loop {
+			let leaf = path.get_leaf();
+			self.read_dir_block(leaf, buff, superblock, io)?;
+			if let Some(off) = directory_entry::blk_find(buff, superblock, name) {
+				return Ok(Some(Some((leaf, off))));
+			}
+
+			if !self.dx_next_leaf(&mut path, superblock, io)? {
+				return Ok(Some(None));
+			}
+		}
+	}
+
+	/// Makes room for a new entry in the deepest node of `path`, either by adding a level to the
+	/// tree or by splitting the node.
+	/// `superblock` is the filesystem's superblock.
+	/// `io` is the I/O interface.
+	/// If the tree is full, the function returns false without modifying it.
+	fn dx_make_room(&mut self, path: &mut DxPath, superblock: &mut Superblock, io: &mut dyn IO)
+		-> Result<bool, Errno> {
+		let blk_size = superblock.get_block_size();
+		let mut node = malloc::Alloc::<u8>::new_default(blk_size as _)?;
+		let mut new = malloc::Alloc::<u8>::new_default(blk_size as _)?;
+
+		let last = path.frames.len() - 1;
+		let off = DxFrame::get_entries_off(last as _);
+		self.read_dir_block(path.frames[last].block, node.as_slice_mut(), superblock, io)?;
+		if htree::get_count(node.as_slice(), off) < htree::get_limit(node.as_slice(), off) {
+			return Ok(true);
+		}
+
+		let new_blk = self.get_dir_blocks_count(superblock);
+		htree::init_node(new.as_slice_mut());
+
+		if last == 0 && htree::MAX_INDIRECT_LEVELS > 0 {
+			// Adding a level by moving the entries of the root to a new node
+			let root = node.as_slice_mut();
+			htree::move_entries(root, off, 0, new.as_slice_mut(), htree::NODE_ENTRIES_OFF);
+			self.write_dir_block(new_blk, new.as_slice(), superblock, io)?;
+
+			htree::set_count(root, off, 1);
+			htree::set_block(root, off, 0, new_blk);
+			htree::set_root_levels(root, 1);
+			self.write_dir_block(0, root, superblock, io)?;
+
+			let frame = path.frames[0];
+			path.frames[0] = DxFrame {
+				block: 0,
+				pos: 0,
+				child: new_blk,
+			};
+			path.frames.push(DxFrame {
+				block: new_blk,
+				..frame
+			})?;
+			return Ok(true);
+		}
+		if last == 0 {
+			return Ok(false);
+		}
+
+		// Splitting the node in two if its parent has room
+		let mut parent = malloc::Alloc::<u8>::new_default(blk_size as _)?;
+		let parent_off = DxFrame::get_entries_off(last as u8 - 1);
+		let parent_frame = path.frames[last - 1];
+		self.read_dir_block(parent_frame.block, parent.as_slice_mut(), superblock, io)?;
+		if htree::get_count(parent.as_slice(), parent_off)
+			>= htree::get_limit(parent.as_slice(), parent_off) {
+			return Ok(false);
+		}
+
+		let split = htree::get_count(node.as_slice(), off) / 2;
+		let split_hash = htree::get_hash(node.as_slice(), off, split);
+		htree::move_entries(node.as_slice_mut(), off, split, new.as_slice_mut(), off);
+		self.write_dir_block(new_blk, new.as_slice(), superblock, io)?;
+		self.write_dir_block(path.frames[last].block, node.as_slice(), superblock, io)?;
+
+		htree::insert(parent.as_slice_mut(), parent_off, parent_frame.pos + 1, split_hash,
+			new_blk);
+		self.write_dir_block(parent_frame.block, parent.as_slice(), superblock, io)?;
+
+		if path.frames[last].pos >= split {
+			path.frames[last].block = new_blk;
+			path.frames[last].pos -= split;
+			path.frames[last - 1].pos += 1;
+			path.frames[last - 1].child = new_blk;
+		}
+		Ok(true)
+	}
+
+	/// Adds an entry to the directory using its hash tree. If the leaf in which the entry belongs
+	/// is full, it is split in two.
+	/// `superblock` is the filesystem's superblock.
+	/// `io` is the I/O interface.
+	/// `entry_inode` is the inode of the entry.
+	/// `name` is the name of the entry.
+	/// `file_type` is the type of the entry.
+	/// If the index cannot be used or is full, the function returns false without adding the
+	/// entry.
+	fn dx_add_dirent(&mut self, superblock: &mut Superblock, io: &mut dyn IO, entry_inode: u32,
+		name: &String, file_type: FileType) -> Result<bool, Errno> {
+		let Some(mut path) = self.dx_lookup(name.as_bytes(), superblock, io)? else {
+			return Ok(false);
+		};
+
+		let blk_size = superblock.get_block_size();
+		let mut leaf = malloc::Alloc::<u8>::new_default(blk_size as _)?;
+		let leaf_blk = path.get_leaf();
+		self.read_dir_block(leaf_blk, leaf.as_slice_mut(), superblock, io)?;
+		if directory_entry::blk_insert(leaf.as_slice_mut(), superblock, entry_inode, name,
+			file_type)? {
+			self.write_dir_block(leaf_blk, leaf.as_slice(), superblock, io)?;
+			return Ok(true);
+		}
+
+		if !self.dx_make_room(&mut path, superblock, io)? {
+			return Ok(false);
+		}
+
+		// Sorting the entries of the leaf by hash
+		let leaf = leaf.as_slice();
+		let seed = superblock.get_hash_seed();
+		let mut entries = Vec::new();
+		for off in directory_entry::blk_used_entries(leaf) {
+			let name = directory_entry::blk_get_name(leaf, off, superblock);
+			let hash = htree::hash(name, path.version, &seed).unwrap_or(0);
+			entries.push((hash, off))?;
+		}
+		entries.sort_unstable();
+
+		// Moving the upper half of the entries to a new leaf. Entries with the same hash as the
+		// first moved entry may remain in the old leaf, which is then marked on the index
+		let split = entries.len() / 2;
+		let (split_hash, continued) = match entries.get(split) {
+			Some((hash, _)) => (*hash, split > 0 && entries[split - 1].0 == *hash),
+			None => (path.hash, false),
+		};
+
+		let mut old = malloc::Alloc::<u8>::new_default(blk_size as _)?;
+		let mut new = malloc::Alloc::<u8>::new_default(blk_size as _)?;
+		directory_entry::blk_fill(old.as_slice_mut(), leaf,
+			entries.as_slice()[..split].iter().map(| (_, off) | *off), superblock);
+		directory_entry::blk_fill(new.as_slice_mut(), leaf,
+			entries.as_slice()[split..].iter().map(| (_, off) | *off), superblock);
+
+		let target = if path.hash >= split_hash {
+			new.as_slice_mut()
+		} else {
+			old.as_slice_mut()
+		};
+		if !directory_entry::blk_insert(target, superblock, entry_inode, name, file_type)? {
+			return Err(errno!(ENOSPC));
+		}
+
+		let new_blk = self.get_dir_blocks_count(superblock);
+		self.write_dir_block(new_blk, new.as_slice(), superblock, io)?;
+		self.write_dir_block(leaf_blk, old.as_slice(), superblock, io)?;
+
+		// Adding the new leaf to the index
+		let frame = path.frames[path.frames.len() - 1];
+		let off = DxFrame::get_entries_off((path.frames.len() - 1) as _);
+		let mut node = malloc::Alloc::<u8>::new_default(blk_size as _)?;
+		self.read_dir_block(frame.block, node.as_slice_mut(), superblock, io)?;
+		htree::insert(node.as_slice_mut(), off, frame.pos + 1, split_hash | continued as u32,
+			new_blk);
+		self.write_dir_block(frame.block, node.as_slice(), superblock, io)?;
+
+		Ok(true)
+	}
+
+	/// Turns the directory into an indexed directory. Its entries, except `.` and `..`, are moved
+	/// to a new block which becomes the only leaf of the tree.
+	/// `superblock` is the filesystem's superblock.
+	/// `io` is the I/O interface.
+	/// If the directory cannot be indexed, the function returns false.
+	fn dx_create(&mut self, superblock: &mut Superblock, io: &mut dyn IO) -> Result<bool, Errno> {
+		if superblock.optional_features & super::OPTIONAL_FEATURE_HASH_INDEX == 0
+			|| self.get_dir_blocks_count(superblock) != 1 {
+			return Ok(false);
+		}
+
+		let blk_size = superblock.get_block_size();
+		let mut root = malloc::Alloc::<u8>::new_default(blk_size as _)?;
+		self.read_dir_block(0, root.as_slice_mut(), superblock, io)?;
+
+		// The root must begin with `.` and `..`
+		let entries = {
+			let mut entries = directory_entry::blk_entries(root.as_slice());
+			(entries.next(), entries.next())
+		};
+		let (Some(dot), Some(dotdot)) = entries else {
+			return Ok(false);
+		};
+		if directory_entry::blk_get_name(root.as_slice(), dot, superblock) != b"."
+			|| directory_entry::blk_get_name(root.as_slice(), dotdot, superblock) != b".." {
+			return Ok(false);
+		}
+		let dotdot_end = dotdot + directory_entry::get_entry_size(2) as usize;
+		if dot != 0 || dotdot != directory_entry::get_entry_size(1) as usize
+			|| dotdot_end > htree::ROOT_ENTRIES_OFF {
+			return Ok(false);
+		}
+
+		let mut leaf = malloc::Alloc::<u8>::new_default(blk_size as _)?;
+		let offs = directory_entry::blk_used_entries(root.as_slice()).skip(2);
+		directory_entry::blk_fill(leaf.as_slice_mut(), root.as_slice(), offs, superblock);
+		self.write_dir_block(1, leaf.as_slice(), superblock, io)?;
+
+		// Making `..` cover the rest of the block
+		let root = root.as_slice_mut();
+		let dotdot_size = ((blk_size as usize - dotdot) as u16).to_le_bytes();
+		root[(dotdot + 4)..(dotdot + 6)].copy_from_slice(&dotdot_size);
+		htree::init_root(root, superblock.get_default_hash_version(), 1);
+		self.write_dir_block(0, root, superblock, io)?;
+
+		self.flags |= INODE_FLAG_HASH_INDEXED;
+		Ok(true)
+	}
+
 	/// Returns the directory entry with the given name `name`.
 	/// `superblock` is the filesystem's superblock.
 	/// `io` is the I/O interface.
@@ -931,40 +1320,25 @@ impl Ext2INode {
 	/// If the file is not a directory, the behaviour is undefined.
 	pub fn get_directory_entry(&self, name: &[u8], superblock: &Superblock, io: &mut dyn IO)
 		-> Result<Option<Box<DirectoryEntry>>, Errno> {
-		let mut entry = None;
+		let blk_size = superblock.get_block_size();
+		let mut buff = malloc::Alloc::<u8>::new_default(blk_size as _)?;
 
-		// TODO If the binary tree feature is enabled, use it
-		self.foreach_directory_entry(| _, e | {
-			if !e.is_free() && e.get_name(superblock) == name {
-				entry = Some(e);
-				Ok(false)
-			} else {
-				Ok(true)
+		if self.is_indexed(superblock) {
+			if let Some(found) = self.dx_find(name, buff.as_slice_mut(), superblock, io)? {
+				return found
+					.map(| (_, off) | directory_entry::blk_read(buff.as_slice(), off))
+					.transpose();
 			}
-		}, superblock, io)?;
-
-		Ok(entry)
-	}
+		}
 
-	/// Looks for a free entry in the inode.
-	/// `superblock` is the filesystem's superblock.
-	/// `io` is the I/O interface.
-	/// `min_size` is the minimum size of the entry in bytes.
-	/// If the function finds an entry, it returns its offset. Else, the function returns None.
-	fn get_free_entry(&self, superblock: &Superblock, io: &mut dyn IO, min_size: u16)
-		-> Result<Option<u64>, Errno> {
-		let mut off_option = None;
-
-		self.foreach_directory_entry(| off, e | {
-			if e.is_free() && e.get_total_size() >= min_size {
-				off_option = Some(off);
-				Ok(false)
-			} else {
-				Ok(true)
+		for i in 0..self.get_dir_blocks_count(superblock) {
+			self.read_dir_block(i, buff.as_slice_mut(), superblock, io)?;
+			if let Some(off) = directory_entry::blk_find(buff.as_slice(), superblock, name) {
+				return Ok(Some(directory_entry::blk_read(buff.as_slice(), off)?));
 			}
-		}, superblock, io)?;
+		}
 
-		Ok(off_option)
+		Ok(None)
 	}
 
 	/// Adds a new entry to the current directory.
@@ -979,32 +1353,43 @@ impl Ext2INode {
 	pub fn add_dirent(&mut self, superblock: &mut Superblock, io: &mut dyn IO, entry_inode: u32,
 		name: &String, file_type: FileType) -> Result<(), Errno> {
 		let blk_size = superblock.get_block_size();
-		let name_length = name.as_bytes().len() as u16;
-		let entry_size = 8 + name_length;
+		let entry_size = directory_entry::get_entry_size(name.as_bytes().len());
 		if entry_size as u32 > blk_size {
 			return Err(errno!(ENAMETOOLONG));
 		}
 
-		if let Some(free_entry_off) = self.get_free_entry(superblock, io, entry_size)? {
-			let mut free_entry = self.read_dirent(superblock, io, free_entry_off)?;
-			let split = free_entry.get_total_size() > entry_size + 8;
-
-			if split {
-				let new_entry = free_entry.split(entry_size)?;
-				self.write_dirent(superblock, io, &new_entry, free_entry_off + entry_size as u64)?;
+		if self.is_indexed(superblock) {
+			if self.dx_add_dirent(superblock, io, entry_inode, name, file_type)? {
+				return Ok(());
+			}
+		}
+		// The index cannot be used. Since it won't be maintained anymore, it is dropped
+		self.flags &= !INODE_FLAG_HASH_INDEXED;
+
+		let mut buff = malloc::Alloc::<u8>::new_default(blk_size as _)?;
+		let blocks_count = self.get_dir_blocks_count(superblock);
+		for i in 0..blocks_count {
+			self.read_dir_block(i, buff.as_slice_mut(), superblock, io)?;
+			if directory_entry::blk_insert(buff.as_slice_mut(), superblock, entry_inode, name,
+				file_type)? {
+				return self.write_dir_block(i, buff.as_slice(), superblock, io);
 			}
+		}
 
-			free_entry.set_inode(entry_inode);
-			free_entry.set_name(superblock, name);
-			free_entry.set_type(superblock, file_type);
-			self.write_dirent(superblock, io, &free_entry, free_entry_off)
-		} else {
-			let entry = DirectoryEntry::new(superblock, entry_inode, blk_size as _, file_type, name)?;
-			self.write_dirent(superblock, io, &entry, self.get_size(superblock))
+		// The directory is growing beyond one block, index it
+		if self.dx_create(superblock, io)?
+			&& self.dx_add_dirent(superblock, io, entry_inode, name, file_type)? {
+			return Ok(());
 		}
+		self.flags &= !INODE_FLAG_HASH_INDEXED;
+
+		let blocks_count = self.get_dir_blocks_count(superblock);
+		directory_entry::blk_init(buff.as_slice_mut());
+		directory_entry::blk_insert(buff.as_slice_mut(), superblock, entry_inode, name,
+			file_type)?;
+		self.write_dir_block(blocks_count, buff.as_slice(), superblock, io)
 	}
 
-	// TODO Clean: Code from `foreach_directory_entry` has been duplicated to avoid borrow errors
 	/// Removes the entry from the current directory.
 	/// `superblock` is the filesystem's superblock.
 	/// `io` is the I/O interface.
@@ -1013,72 +1398,45 @@ impl Ext2INode {
 		-> Result<(), Errno> {
 		debug_assert_eq!(self.get_type(), FileType::Directory);
 
-		// Allocating a buffer
 		let blk_size = superblock.get_block_size();
-		let mut buff = malloc::Alloc::<u8>::new_default(blk_size as usize)?;
-
-		// The previous free entry with its offset
-		let mut prev_free: Option<(u64, Box<DirectoryEntry>)> = None;
-
-		let size = self.get_size(superblock);
-		let mut i = 0;
-		while i < size {
-			let len = min((size - i) as usize, blk_size as usize);
-			self.read_content(i, &mut buff.as_slice_mut()[..len], superblock, io)?;
-
-			let mut j = 0;
-			while j < len {
-				// Safe because the data is block-aligned and an entry cannot be larger than the
-				// size of a block
-				let mut entry = unsafe {
-					DirectoryEntry::from(&buff.as_slice()[j..len])?
-				};
-				// The total size of the entry
-				let total_size = entry.get_total_size() as usize;
-				// The offset of the entry
-				let off = i + j as u64;
-
-				if !entry.is_free() {
-					if entry.get_name(superblock) == name.as_bytes() {
-						// The entry has name `name`, free it
-						entry.set_inode(0);
-						self.write_dirent(superblock, io, &entry, off)?;
-					} else {
-						// The entry is not free, skip it
-						prev_free = None;
-						continue;
-					}
-				}
-
-				if let Some((prev_free_off, prev_free)) = &mut prev_free {
-					// Merging previous entry with the current if they are on the same page
-					if *prev_free_off >= i {
-						prev_free.merge(entry);
-						self.write_dirent(superblock, io, prev_free, *prev_free_off)?;
-					}
-				} else {
-					prev_free = Some((off, entry));
+		let mut buff = malloc::Alloc::<u8>::new_default(blk_size as _)?;
+
+		// In an indexed directory, blocks are never freed since the index refers to them
+		if self.is_indexed(superblock) {
+			let name = name.as_bytes();
+			if let Some(found) = self.dx_find(name, buff.as_slice_mut(), superblock, io)? {
+				if let Some((leaf, off)) = found {
+					directory_entry::blk_remove(buff.as_slice_mut(), off);
+					self.write_dir_block(leaf, buff.as_slice(), superblock, io)?;
 				}
 
-				j += total_size;
+				return Ok(());
 			}
-
-			i += blk_size as u64;
 		}
-
-		// If the last content blocks can be freed, free them
-		if let Some((last_free_off, _)) = prev_free {
-			// The first content block that can be freed
-			let first_free_blk = math::ceil_division(last_free_off, blk_size as u64) as u32;
-			// The number of content blocks in the inode
-			let blk_count = math::ceil_division(self.get_size(superblock), blk_size as u64) as u32;
-
-			for i in first_free_blk..blk_count {
-				self.free_content_block(i, superblock, io)?;
+		self.flags &= !INODE_FLAG_HASH_INDEXED;
+
+		let blocks_count = self.get_dir_blocks_count(superblock);
+		for i in 0..blocks_count {
+			self.read_dir_block(i, buff.as_slice_mut(), superblock, io)?;
+			if let Some(off) = directory_entry::blk_find(buff.as_slice(), superblock,
+				name.as_bytes()) {
+				directory_entry::blk_remove(buff.as_slice_mut(), off);
+				self.write_dir_block(i, buff.as_slice(), superblock, io)?;
+				break;
 			}
 		}
 
-		Ok(())
+		// If the last content blocks don't contain entries anymore, free them
+		let mut count = blocks_count;
+		while count > 1 {
+			self.read_dir_block(count - 1, buff.as_slice_mut(), superblock, io)?;
+			if !directory_entry::blk_is_empty(buff.as_slice()) {
+				break;
+			}
+
+			count -= 1;
+		}
+		self.truncate(superblock, io, count as u64 * blk_size as u64)
 	}
 
 	/// Returns the link target of the inode.
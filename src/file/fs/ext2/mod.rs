@@ -25,6 +25,7 @@
 
 mod block_group_descriptor;
 mod directory_entry;
+mod htree;
 mod inode;
 
 use block_group_descriptor::BlockGroupDescriptor;
@@ -33,6 +34,8 @@ use core::cmp::min;
 use core::mem::MaybeUninit;
 use core::mem::size_of;
 use core::mem::size_of_val;
+use core::ops::Deref;
+use core::ops::DerefMut;
 use core::slice;
 use crate::errno::Errno;
 use crate::errno;
@@ -109,6 +112,11 @@ const OPTIONAL_FEATURE_RESIZE: u32 = 0x10;
 /// Optional feature: Directories use hash index
 const OPTIONAL_FEATURE_HASH_INDEX: u32 = 0x20;
 
+/// Superblock flag: Directory hashes treat name bytes as signed
+const FLAG_SIGNED_HASH: u32 = 0x1;
+/// Superblock flag: Directory hashes treat name bytes as unsigned
+const FLAG_UNSIGNED_HASH: u32 = 0x2;
+
 /// Required feature: Compression
 const REQUIRED_FEATURE_COMPRESSION: u32 = 0x1;
 /// Required feature: Directory entries have a type field
@@ -125,6 +133,9 @@ const WRITE_REQUIRED_64_BITS: u32 = 0x2;
 /// Directory contents are stored in the form of a Binary Tree.
 const WRITE_REQUIRED_DIRECTORY_BINARY_TREE: u32 = 0x4;
 
+/// The number of bytes of a file prefetched past the end of a sequential read.
+const READAHEAD_SIZE: u64 = 32768;
+
 /// Reads an object of the given type on the given device.
 /// `offset` is the offset in bytes on the device.
 /// `io` is the I/O interface of the device.
@@ -190,9 +201,9 @@ fn write_block<T>(i: u64, superblock: &Superblock, io: &mut dyn IO, buff: &[T])
 	Ok(())
 }
 
-/// The ext2 superblock structure.
+/// The ext2 superblock structure, as stored on the disk.
 #[repr(C, packed)]
-pub struct Superblock {
+pub struct RawSuperblock {
 	/// Total number of inodes in the filesystem.
 	total_inodes: u32,
 	/// Total number of blocks in the filesystem.
@@ -280,17 +291,70 @@ pub struct Superblock {
 	journal_device: u32,
 	/// The head of orphan inodes list.
 	orphan_inode_head: u32,
+	/// The seed of the hash function used to index directories.
+	hash_seed: [u32; 4],
+	/// The default hash function used to index directories.
+	default_hash_version: u8,
+	/// Unused.
+	_unused1: [u8; 3],
+	/// Fields that are not supported.
+	_reserved: [u8; 96],
+	/// Miscellaneous flags.
+	flags: u32,
 
 	/// Structure padding.
-	_padding: [u8; 788],
+	_padding: [u8; 668],
+}
+
+/// The in-memory summary of the free space of a block group.
+#[derive(Clone, Copy)]
+struct GroupSummary {
+	/// The number of unallocated blocks in the group.
+	free_blocks: u32,
+	/// The index in the group before which every block is allocated.
+	first_free: u32,
+}
+
+/// The ext2 superblock, along with the in-memory state of the block allocator.
+pub struct Superblock {
+	/// The superblock stored on the disk.
+	raw: RawSuperblock,
+
+	/// The free space summaries of the block groups. Summaries are loaded on the first
+	/// allocation.
+	groups: Vec<GroupSummary>,
+}
+
+impl Deref for Superblock {
+	type Target = RawSuperblock;
+
+	fn deref(&self) -> &Self::Target {
+		&self.raw
+	}
+}
+
+impl DerefMut for Superblock {
+	fn deref_mut(&mut self) -> &mut Self::Target {
+		&mut self.raw
+	}
 }
 
 impl Superblock {
+	/// Creates a new instance from the on-disk superblock `raw`.
+	fn new(raw: RawSuperblock) -> Self {
+		Self {
+			raw,
+
+			groups: Vec::new(),
+		}
+	}
+
 	/// Creates a new instance by reading from the given device.
 	pub fn read(io: &mut dyn IO) -> Result<Self, Errno> {
-		unsafe {
-			read::<Self>(SUPERBLOCK_OFFSET, io)
-		}
+		let raw = unsafe {
+			read::<RawSuperblock>(SUPERBLOCK_OFFSET, io)?
+		};
+		Ok(Self::new(raw))
 	}
 
 	/// Tells whether the superblock is valid.
@@ -313,6 +377,30 @@ impl Superblock {
 		self.total_blocks / self.blocks_per_group
 	}
 
+	/// Returns the seed of the hash function used to index directories.
+	pub fn get_hash_seed(&self) -> [u32; 4] {
+		self.hash_seed
+	}
+
+	/// Returns the hash function to use for the directory index with the given hash function
+	/// `version`, taking into account whether name bytes are signed.
+	pub fn get_hash_version(&self, version: u8) -> u8 {
+		if version <= htree::HASH_TEA && self.flags & FLAG_UNSIGNED_HASH != 0 {
+			version + htree::HASH_UNSIGNED_OFFSET
+		} else {
+			version
+		}
+	}
+
+	/// Returns the hash function to use for newly indexed directories.
+	pub fn get_default_hash_version(&self) -> u8 {
+		if self.default_hash_version <= htree::HASH_TEA {
+			self.default_hash_version
+		} else {
+			htree::HASH_HALF_MD4
+		}
+	}
+
 	/// Returns the size of a fragment.
 	pub fn get_fragment_size(&self) -> usize {
 		math::pow2(self.fragment_size_log + 10) as _
@@ -336,20 +424,25 @@ impl Superblock {
 		}
 	}
 
-	/// Searches in the given bitmap block `bitmap` for the first element that is not set.
+	/// Searches in the given bitmap block `bitmap` for the first element that is not set,
+	/// starting at the element `start`. The bitmap is scanned one word at a time.
 	/// The function returns the index to the element. If every elements are set, the function
 	/// returns None.
-	fn search_bitmap_blk(bitmap: &[u8]) -> Option<u32> {
-		for (i, b) in bitmap.iter().enumerate() {
-			if *b == 0xff {
-				continue;
-			}
-
-			for j in 0..8 {
-				if (*b >> j) & 0b1 == 0 {
-					return Some((i * 8 + j) as _);
-				}
+	fn search_bitmap_blk(bitmap: &[u8], start: u32) -> Option<u32> {
+		const WORD_SIZE: usize = size_of::<usize>();
+		const WORD_BITS: usize = WORD_SIZE * 8;
+
+		let start = start as usize;
+		// Masking the elements before `start` in the first word
+		let mut mask = !0usize << (start % WORD_BITS);
+		for (i, word) in bitmap.chunks_exact(WORD_SIZE).enumerate().skip(start / WORD_BITS) {
+			let word = usize::from_le_bytes(word.try_into().unwrap());
+
+			let free = !word & mask;
+			if free != 0 {
+				return Some((i * WORD_BITS) as u32 + free.trailing_zeros());
 			}
+			mask = !0;
 		}
 
 		None
@@ -368,8 +461,9 @@ impl Superblock {
 			let bitmap_blk_index = start + i;
 			read_block(bitmap_blk_index as _, self, io, buff.as_slice_mut())?;
 
-			if let Some(j) = Self::search_bitmap_blk(buff.as_slice()) {
-				return Ok(Some(i * (blk_size * 8) as u32 + j));
+			if let Some(j) = Self::search_bitmap_blk(buff.as_slice(), 0) {
+				let j = i * (blk_size * 8) as u32 + j;
+				return Ok(Some(j).filter(| j | *j < size));
 			}
 
 			i += 1;
@@ -468,18 +562,124 @@ impl Superblock {
 		Ok(())
 	}
 
-	/// Returns the id of a free block in the filesystem.
+	/// Loads the free space summaries of the block groups.
+	fn load_groups(&mut self, io: &mut dyn IO) -> Result<(), Errno> {
+		let groups_count = self.get_block_groups_count();
+
+		let mut groups = Vec::with_capacity(groups_count as _)?;
+		for i in 0..groups_count {
+			let bgd = BlockGroupDescriptor::read(i, self, io)?;
+			groups.push(GroupSummary {
+				free_blocks: bgd.unallocated_blocks_number as _,
+				first_free: 0,
+			})?;
+		}
+
+		self.groups = groups;
+		Ok(())
+	}
+
+	/// Allocates a run of at most `count` contiguous free blocks in the block group `group`,
+	/// starting the search at the index `start` in the group.
 	/// `io` is the I/O interface.
-	pub fn get_free_block(&self, io: &mut dyn IO) -> Result<u32, Errno> {
-		for i in 0..self.get_block_groups_count() {
-			let bgd = BlockGroupDescriptor::read(i as _, self, io)?;
-			if bgd.unallocated_blocks_number > 0 {
-				if let Some(j) = self.search_bitmap(io, bgd.block_usage_bitmap_addr,
-					self.blocks_per_group)? {
-					let blk = i * self.blocks_per_group + j;
-					debug_assert!((blk as u64) > 2);
+	/// The function returns the first block of the run and the number of blocks in it. If no
+	/// block is free after `start`, the function returns None.
+	fn alloc_in_group(&mut self, io: &mut dyn IO, group: u32, start: u32, count: u32)
+		-> Result<Option<(u32, u32)>, Errno> {
+		let blk_size = self.get_block_size();
+		let bits_per_blk = blk_size * 8;
+		let group_begin = group * self.blocks_per_group;
+		let size = min(self.blocks_per_group, self.total_blocks - group_begin);
+
+		let mut bgd = BlockGroupDescriptor::read(group, self, io)?;
+		let mut buff = malloc::Alloc::<u8>::new_default(blk_size as _)?;
+
+		let mut i = start / bits_per_blk;
+		let mut bit = start % bits_per_blk;
+		while i * bits_per_blk < size {
+			let bitmap_blk_index = bgd.block_usage_bitmap_addr + i;
+			read_block(bitmap_blk_index as _, self, io, buff.as_slice_mut())?;
+			let bitmap = buff.as_slice_mut();
+
+			let Some(j) = Self::search_bitmap_blk(bitmap, bit) else {
+				i += 1;
+				bit = 0;
+				continue;
+			};
+			let first = i * bits_per_blk + j;
+			if first >= size {
+				break;
+			}
 
-					return Ok(blk);
+			// Extending the run over the following free blocks of the bitmap block
+			let max_len = min(count, min(size - first, bits_per_blk - j));
+			let mut len = 0;
+			while len < max_len {
+				let k = (j + len) as usize;
+				if bitmap[k / 8] & (1 << (k % 8)) != 0 {
+					break;
+				}
+
+				bitmap[k / 8] |= 1 << (k % 8);
+				len += 1;
+			}
+			write_block(bitmap_blk_index as _, self, io, buff.as_slice())?;
+
+			bgd.unallocated_blocks_number -= len as u16;
+			bgd.write(group, self, io)?;
+			self.total_unallocated_blocks -= len;
+
+			let summary = &mut self.groups[group as usize];
+			summary.free_blocks -= len;
+			if start <= summary.first_free {
+				summary.first_free = first + len;
+			}
+
+			let blk = group_begin + first;
+			debug_assert!((blk as u64) > 2);
+			return Ok(Some((blk, len)));
+		}
+
+		Ok(None)
+	}
+
+	/// Allocates a run of at most `count` contiguous blocks, placed as close as possible after
+	/// the block `goal`. If `goal` is zero, the run is placed in the first block group with free
+	/// blocks.
+	/// `io` is the I/O interface.
+	/// The function returns the first allocated block and the number of allocated blocks, which
+	/// is at least one.
+	pub fn alloc_blocks(&mut self, io: &mut dyn IO, goal: u32, count: u32)
+		-> Result<(u32, u32), Errno> {
+		if self.groups.is_empty() {
+			self.load_groups(io)?;
+		}
+
+		let groups_count = self.get_block_groups_count();
+		let count = max(count, 1);
+		let goal = if goal < self.total_blocks { goal } else { 0 };
+		let goal_group = goal / self.blocks_per_group;
+
+		for i in 0..groups_count {
+			let group = (goal_group + i) % groups_count;
+			let summary = self.groups[group as usize];
+			if summary.free_blocks == 0 {
+				continue;
+			}
+
+			let start = if i == 0 {
+				max(goal % self.blocks_per_group, summary.first_free)
+			} else {
+				summary.first_free
+			};
+			if let Some(run) = self.alloc_in_group(io, group, start, count)? {
+				return Ok(run);
+			}
+
+			// Falling back to the blocks before the goal
+			if start > summary.first_free {
+				if let Some(run) = self.alloc_in_group(io, group, summary.first_free, count)? {
+					return Ok(run);
 				}
 			}
 		}
@@ -487,6 +687,12 @@ impl Superblock {
 		Err(errno!(ENOSPC))
 	}
 
+	/// Allocates a block, placed as close as possible after the block `goal`.
+	/// `io` is the I/O interface.
+	pub fn alloc_block(&mut self, io: &mut dyn IO, goal: u32) -> Result<u32, Errno> {
+		Ok(self.alloc_blocks(io, goal, 1)?.0)
+	}
+
 	/// Marks the block `blk` used on the filesystem.
 	/// `io` is the I/O interface.
 	/// `blk` is the block number.
@@ -503,6 +709,10 @@ impl Superblock {
 			let bitfield_index = blk % self.blocks_per_group;
 			self.set_bitmap(io, bgd.block_usage_bitmap_addr, bitfield_index, true)?;
 
+			if let Some(summary) = self.groups.as_mut_slice().get_mut(group as usize) {
+				summary.free_blocks -= 1;
+			}
+
 			bgd.write(group, self, io)?;
 		}
 
@@ -525,7 +735,62 @@ impl Superblock {
 			let bitfield_index = blk % self.blocks_per_group;
 			self.set_bitmap(io, bgd.block_usage_bitmap_addr, bitfield_index, false)?;
 
+			if let Some(summary) = self.groups.as_mut_slice().get_mut(group as usize) {
+				summary.free_blocks += 1;
+				summary.first_free = min(summary.first_free, bitfield_index);
+			}
+
+			bgd.write(group, self, io)?;
+		}
+
+		Ok(())
+	}
+
+	/// Marks the blocks `blks` available on the filesystem. Blocks are sorted in place, so that
+	/// each bitmap block and block group descriptor is updated once.
+	/// `io` is the I/O interface.
+	/// Zero entries are ignored. If a block is already marked as free or appears several times,
+	/// the behaviour is undefined.
+	pub fn free_blocks(&mut self, io: &mut dyn IO, blks: &mut [u32]) -> Result<(), Errno> {
+		blks.sort_unstable();
+
+		let blk_size = self.get_block_size();
+		let bits_per_blk = blk_size * 8;
+		let mut buff = malloc::Alloc::<u8>::new_default(blk_size as _)?;
+
+		let mut i = blks.iter().position(| b | *b != 0).unwrap_or(blks.len());
+		while i < blks.len() {
+			debug_assert!((blks[i] as u64) > 2);
+
+			let group = blks[i] / self.blocks_per_group;
+			let mut bgd = BlockGroupDescriptor::read(group, self, io)?;
+			let first = blks[i] % self.blocks_per_group;
+
+			let begin = i;
+			while i < blks.len() && blks[i] / self.blocks_per_group == group {
+				let bitmap_blk = (blks[i] % self.blocks_per_group) / bits_per_blk;
+				let bitmap_blk_index = bgd.block_usage_bitmap_addr + bitmap_blk;
+				read_block(bitmap_blk_index as _, self, io, buff.as_slice_mut())?;
+
+				while i < blks.len() && blks[i] / self.blocks_per_group == group
+					&& (blks[i] % self.blocks_per_group) / bits_per_blk == bitmap_blk {
+					let k = ((blks[i] % self.blocks_per_group) % bits_per_blk) as usize;
+					buff[k / 8] &= !(1 << (k % 8));
+					i += 1;
+				}
+
+				write_block(bitmap_blk_index as _, self, io, buff.as_slice())?;
+			}
+
+			let count = (i - begin) as u32;
+			bgd.unallocated_blocks_number += count as u16;
 			bgd.write(group, self, io)?;
+			self.total_unallocated_blocks += count;
+
+			if let Some(summary) = self.groups.as_mut_slice().get_mut(group as usize) {
+				summary.free_blocks += count;
+				summary.first_free = min(summary.first_free, first);
+			}
 		}
 
 		Ok(())
@@ -533,7 +798,7 @@ impl Superblock {
 
 	/// Writes the superblock on the device.
 	pub fn write(&self, io: &mut dyn IO) -> Result<(), Errno> {
-		write::<Self>(self, SUPERBLOCK_OFFSET, io)
+		write::<RawSuperblock>(&self.raw, SUPERBLOCK_OFFSET, io)
 	}
 }
 
@@ -547,6 +812,9 @@ struct Ext2Fs {
 
 	/// Tells whether the filesystem is mounted in read-only.
 	readonly: bool,
+
+	/// The inode and end offset of the last read, used to detect sequential reads.
+	last_read: Option<(INode, u64)>,
 }
 
 impl Ext2Fs {
@@ -619,6 +887,8 @@ impl Ext2Fs {
 			superblock,
 
 			readonly,
+
+			last_read: None,
 		})
 	}
 }
@@ -901,6 +1171,7 @@ impl Filesystem for Ext2Fs {
 
 		// Removing the directory entry
 		parent.remove_dirent(&mut self.superblock, io, name)?;
+		parent.write(parent_inode as _, &self.superblock, io)?;
 
 		// Decrementing the hard links count
 		inode_.hard_links_count -= 1;
@@ -925,6 +1196,14 @@ impl Filesystem for Ext2Fs {
 		debug_assert!(inode >= 1);
 
 		let inode_ = Ext2INode::read(inode as _, &self.superblock, io)?;
+
+		// On sequential reads, prefetching the content that follows
+		let end = off + buf.len() as u64;
+		if self.last_read == Some((inode, off)) {
+			inode_.readahead(end, READAHEAD_SIZE, &self.superblock, io)?;
+		}
+		self.last_read = Some((inode, end));
+
 		inode_.read_content(off, buf, &self.superblock, io)
 	}
 
@@ -972,7 +1251,7 @@ impl FilesystemType for Ext2FsType {
 			* DEFAULT_INODE_SIZE as u32,
 			(DEFAULT_BLOCK_SIZE * 8) as _);
 
-		let mut superblock = Superblock {
+		let mut superblock = Superblock::new(RawSuperblock {
 			total_inodes: inodes_count,
 			total_blocks: blocks_count,
 			superuser_blocks: 0,
@@ -1017,9 +1296,14 @@ impl FilesystemType for Ext2FsType {
 			journal_inode: 0, // TODO
 			journal_device: 0, // TODO
 			orphan_inode_head: 0, // TODO
+			hash_seed: [0; 4],
+			default_hash_version: 0,
+			_unused1: [0; 3],
+			_reserved: [0; 96],
+			flags: 0,
 
-			_padding: [0; 788],
-		};
+			_padding: [0; 668],
+		});
 		superblock.write(io)?;
 
 		let blk_size = superblock.get_block_size() as u32;
@@ -1125,3 +1409,104 @@ impl FilesystemType for Ext2FsType {
 		Ok(Box::new(fs)? as _)
 	}
 }
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	/// The number of blocks of the test disk.
+	const TEST_BLOCKS_COUNT: usize = 8;
+
+	/// An I/O interface keeping its content in memory and recording the offset of each write.
+	struct TestDisk {
+		/// The content of the disk.
+		data: malloc::Alloc<u8>,
+		/// The offset of each write.
+		writes: Vec<u64>,
+	}
+
+	impl IO for TestDisk {
+		fn get_size(&self) -> u64 {
+			self.data.len() as _
+		}
+
+		fn read(&mut self, offset: u64, buff: &mut [u8]) -> Result<u64, Errno> {
+			let off = offset as usize;
+			buff.copy_from_slice(&self.data.as_slice()[off..(off + buff.len())]);
+			Ok(buff.len() as _)
+		}
+
+		fn write(&mut self, offset: u64, buff: &[u8]) -> Result<u64, Errno> {
+			let off = offset as usize;
+			self.data.as_slice_mut()[off..(off + buff.len())].copy_from_slice(buff);
+			self.writes.push(offset)?;
+			Ok(buff.len() as _)
+		}
+	}
+
+	#[test_case]
+	fn ext2_search_bitmap0() {
+		let mut bitmap = [0xffu8; 64];
+		assert_eq!(Superblock::search_bitmap_blk(&bitmap, 0), None);
+
+		bitmap[13] = 0b11101111;
+		bitmap[40] = 0b11111110;
+		assert_eq!(Superblock::search_bitmap_blk(&bitmap, 0), Some(13 * 8 + 4));
+		assert_eq!(Superblock::search_bitmap_blk(&bitmap, 13 * 8 + 4), Some(13 * 8 + 4));
+		assert_eq!(Superblock::search_bitmap_blk(&bitmap, 13 * 8 + 5), Some(40 * 8));
+	}
+
+	#[test_case]
+	fn ext2_free_blocks0() {
+		// Two groups of 1024 bytes blocks, whose bitmaps are blocks 3 and 4
+		let mut raw: RawSuperblock = unsafe { core::mem::zeroed() };
+		raw.block_size_log = 0;
+		raw.blocks_per_group = 8192;
+		raw.total_blocks = 16384;
+		raw.total_unallocated_blocks = 100;
+		let mut superblock = Superblock::new(raw);
+
+		let mut disk = TestDisk {
+			data: malloc::Alloc::new_default(TEST_BLOCKS_COUNT * 1024).unwrap(),
+			writes: Vec::new(),
+		};
+		disk.data.as_slice_mut()[3072..5120].fill(0xff);
+		for (i, bitmap) in [3, 4].iter().enumerate() {
+			let bgd = BlockGroupDescriptor {
+				block_usage_bitmap_addr: *bitmap,
+				inode_usage_bitmap_addr: 0,
+				inode_table_start_addr: 0,
+				unallocated_blocks_number: 10,
+				unallocated_inodes_number: 0,
+				directories_number: 0,
+
+				_padding: [0; 14],
+			};
+			bgd.write(i as _, &superblock, &mut disk).unwrap();
+		}
+		disk.writes.clear();
+
+		let mut blks = [8200, 5, 0, 7, 9000, 8195];
+		superblock.free_blocks(&mut disk, &mut blks).unwrap();
+
+		let total = superblock.total_unallocated_blocks;
+		assert_eq!(total, 105);
+		for (i, count) in [12, 13].iter().enumerate() {
+			let bgd = BlockGroupDescriptor::read(i as _, &superblock, &mut disk).unwrap();
+			let unallocated = bgd.unallocated_blocks_number;
+			assert_eq!(unallocated, *count);
+		}
+
+		let data = disk.data.as_slice();
+		assert_eq!(data[3072], 0xff & !(1 << 5) & !(1 << 7));
+		assert_eq!(data[4096], 0xff & !(1 << 3));
+		assert_eq!(data[4097], 0xff & !1);
+		assert_eq!(data[4096 + 101], 0xff & !1);
+		assert_eq!(data[4096 + 2], 0xff);
+
+		// Each bitmap block is written once
+		for bitmap in [3072, 4096] {
+			assert_eq!(disk.writes.iter().filter(| off | **off == bitmap).count(), 1);
+		}
+	}
+}
@@ -5,8 +5,11 @@ pub mod node;
 
 use crate::errno::Errno;
 use crate::errno;
+use crate::file::DirEntry;
 use crate::file::File;
 use crate::file::FileContent;
+use crate::file::FileLocation;
+use crate::file::FileType;
 use crate::file::Gid;
 use crate::file::INode;
 use crate::file::Mode;
@@ -29,6 +32,8 @@ pub struct KernFS {
 	name: String,
 	/// Tells whether the filesystem is readonly.
 	readonly: bool,
+	/// The path at which the filesystem is mounted.
+	mountpath: Path,
 
 	/// The list of nodes of the filesystem. The index in this vector is the inode.
 	nodes: Vec<Option<SharedPtr<dyn KernFSNode>>>,
@@ -40,10 +45,12 @@ impl KernFS {
 	/// Creates a new instance.
 	/// `name` is the name of the filesystem.
 	/// `readonly` tells whether the filesystem is readonly.
-	pub fn new(name: String, readonly: bool) -> Self {
+	/// `mountpath` is the path at which the filesystem is mounted.
+	pub fn new(name: String, readonly: bool, mountpath: Path) -> Self {
 		Self {
 			name,
 			readonly,
+			mountpath,
 
 			nodes: Vec::new(),
 			free_nodes: Vec::new(),
@@ -61,6 +68,26 @@ impl KernFS {
 		Ok(())
 	}
 
+	/// Allocates an inode for the node `node` and returns it. The node must then be added to the
+	/// entries of its parent to be reachable.
+	pub fn alloc_inode(&mut self, node: SharedPtr<dyn KernFSNode>) -> Result<INode, Errno> {
+		if let Some(inode) = self.free_nodes.pop() {
+			self.nodes[inode as usize] = Some(node);
+			return Ok(inode);
+		}
+
+		self.nodes.push(Some(node))?;
+		Ok((self.nodes.len() - 1) as _)
+	}
+
+	/// Returns the node with inode `inode`.
+	/// If the node doesn't exist, the function returns an error.
+	fn get_node(&self, inode: INode) -> Result<&SharedPtr<dyn KernFSNode>, Errno> {
+		self.nodes.get(inode as usize)
+			.and_then(| node | node.as_ref())
+			.ok_or_else(|| errno!(ENOENT))
+	}
+
 	/// Adds the given node `node` at the given path `path`.
 	/// The function returns the allocated inode.
 	pub fn add_node(&mut self, path: &Path, _node: SharedPtr<dyn KernFSNode>)
@@ -115,10 +142,44 @@ impl Filesystem for KernFS {
 		parent_node.get_entry(name).map(| (inode, _) | inode)
 	}
 
-	fn load_file(&mut self, _: &mut dyn IO, _inode: INode, _name: String)
+	fn load_file(&mut self, _: &mut dyn IO, inode: INode, name: String)
 		-> Result<File, Errno> {
-		// TODO
-		todo!();
+		let node_mutex = self.get_node(inode)?;
+		let node_guard = node_mutex.lock();
+		let node = node_guard.get();
+
+		let content = match node.get_type() {
+			FileType::Regular => FileContent::Regular,
+
+			FileType::Directory => {
+				let mut entries = Vec::new();
+				for (name, (inode, entry)) in node.get_entries().iter() {
+					entries.push(DirEntry {
+						inode: *inode,
+						entry_type: entry.lock().get().get_type(),
+						name: name.failable_clone()?,
+					})?;
+				}
+
+				FileContent::Directory(entries)
+			},
+
+			FileType::Fifo => FileContent::Fifo,
+			FileType::Socket => FileContent::Socket,
+
+			// Nodes don't provide links' targets nor devices' numbers
+			_ => return Err(errno!(EINVAL)),
+		};
+
+		let location = FileLocation::new(self.mountpath.failable_clone()?, inode);
+		let mut file = File::new(name, node.get_uid(), node.get_gid(), node.get_mode(),
+			location, content)?;
+		file.set_size(node.get_size());
+		file.set_ctime(node.get_ctime());
+		file.set_mtime(node.get_mtime());
+		file.set_atime(node.get_atime());
+
+		Ok(file)
 	}
 
 	fn add_file(&mut self, _io: &mut dyn IO, _parent_inode: INode, _name: String, _uid: Uid,
@@ -160,19 +221,18 @@ impl Filesystem for KernFS {
 		todo!();
 	}
 
-	fn read_node(&mut self, _: &mut dyn IO, _inode: INode, _off: u64, _buf: &mut [u8])
+	fn read_node(&mut self, _: &mut dyn IO, inode: INode, off: u64, buf: &mut [u8])
 		-> Result<u64, Errno> {
-		// TODO
-		todo!();
+		self.get_node(inode)?.lock().get_mut().read(off, buf)
 	}
 
-	fn write_node(&mut self, _: &mut dyn IO, _inode: INode, _off: u64, _buf: &[u8])
+	fn write_node(&mut self, _: &mut dyn IO, inode: INode, off: u64, buf: &[u8])
 		-> Result<(), Errno> {
 		if self.readonly {
 			return Err(errno!(EROFS));
 		}
 
-		// TODO
-		todo!();
+		self.get_node(inode)?.lock().get_mut().write(off, buf)?;
+		Ok(())
 	}
 }
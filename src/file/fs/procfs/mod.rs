@@ -2,6 +2,11 @@
 
 pub mod mount;
 pub mod root;
+pub mod slabinfo;
+#[cfg(config_debug_syscall_stats)]
+pub mod syscalls;
+#[cfg(config_debug_trace)]
+pub mod trace;
 
 use crate::errno::Errno;
 use crate::file::File;
@@ -30,13 +35,15 @@ pub struct ProcFS {
 impl ProcFS {
 	/// Creates a new instance.
 	/// `readonly` tells whether the filesystem is readonly.
-	pub fn new(readonly: bool) -> Result<Self, Errno> {
+	/// `mountpath` is the path at which the filesystem is mounted.
+	pub fn new(readonly: bool, mountpath: Path) -> Result<Self, Errno> {
 		let mut fs = Self {
-			fs: KernFS::new(String::from(b"procfs")?, readonly),
+			fs: KernFS::new(String::from(b"procfs")?, readonly, mountpath),
 		};
 
-		// Adding the root node
-		let root_node = ProcFSRoot::new()?;
+		// Reserving the root inode before allocating the inodes of the root's entries
+		fs.fs.set_root(None)?;
+		let root_node = ProcFSRoot::new(&mut fs.fs)?;
 		fs.fs.set_root(Some(SharedPtr::new(root_node)?))?;
 
 		Ok(fs)
@@ -56,9 +63,8 @@ impl Filesystem for ProcFS {
 		self.fs.must_cache()
 	}
 
-	fn get_root_inode(&self, _io: &mut dyn IO) -> Result<INode, Errno> {
-		// TODO
-		todo!();
+	fn get_root_inode(&self, io: &mut dyn IO) -> Result<INode, Errno> {
+		self.fs.get_root_inode(io)
 	}
 
 	fn get_inode(&mut self, io: &mut dyn IO, parent: Option<INode>, name: &String)
@@ -114,11 +120,62 @@ impl FilesystemType for ProcFsType {
 	}
 
 	fn create_filesystem(&self, _io: &mut dyn IO) -> Result<Box<dyn Filesystem>, Errno> {
-		Ok(Box::new(ProcFS::new(false)?)?)
+		Ok(Box::new(ProcFS::new(false, Path::root())?)?)
 	}
 
-	fn load_filesystem(&self, _io: &mut dyn IO, _mountpath: Path, readonly: bool)
+	fn load_filesystem(&self, _io: &mut dyn IO, mountpath: Path, readonly: bool)
 		-> Result<Box<dyn Filesystem>, Errno> {
-		Ok(Box::new(ProcFS::new(readonly)?)?)
+		Ok(Box::new(ProcFS::new(readonly, mountpath)?)?)
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+	use crate::file::FileType;
+
+	/// An empty I/O interface, since the procfs doesn't use its source.
+	struct NullIO {}
+
+	impl IO for NullIO {
+		fn get_size(&self) -> u64 {
+			0
+		}
+
+		fn read(&mut self, _offset: u64, _buff: &mut [u8]) -> Result<u64, Errno> {
+			Ok(0)
+		}
+
+		fn write(&mut self, _offset: u64, _buff: &[u8]) -> Result<u64, Errno> {
+			Ok(0)
+		}
+	}
+
+	#[test_case]
+	fn procfs_lookup0() {
+		let mut io = NullIO {};
+		let mut fs = ProcFS::new(true, Path::root()).unwrap();
+		let root = fs.get_root_inode(&mut io).unwrap();
+
+		let root_file = fs.load_file(&mut io, root, String::new()).unwrap();
+		assert_eq!(root_file.get_file_type(), FileType::Directory);
+		let FileContent::Directory(entries) = root_file.get_file_content() else {
+			panic!();
+		};
+
+		for name in [&b"syscalls"[..], b"slabinfo", b"trace"] {
+			let name = String::from(name).unwrap();
+			let inode = fs.get_inode(&mut io, Some(root), &name).unwrap();
+			assert_ne!(inode, root);
+			assert!(entries.iter().any(| e | e.inode == inode && e.name == name));
+
+			let file = fs.load_file(&mut io, inode, name).unwrap();
+			assert_eq!(file.get_file_type(), FileType::Regular);
+			let mut buf = [0; 16];
+			assert!(fs.read_node(&mut io, inode, 0, &mut buf).is_ok());
+		}
+
+		let name = String::from(b"nonexistent").unwrap();
+		assert!(fs.get_inode(&mut io, Some(root), &name).is_err());
 	}
 }
@@ -77,8 +77,9 @@ impl IO for ProcFSMount {
 	}
 
 	fn read(&mut self, _offset: u64, _buff: &mut [u8]) -> Result<u64, Errno> {
-		// TODO
-		todo!();
+		// TODO List mountpoints. Until then, reading fails instead of panicking since the node is
+		// reachable from userspace
+		Err(errno!(EINVAL))
 	}
 
 	fn write(&mut self, _offset: u64, _buff: &[u8]) -> Result<u64, Errno> {
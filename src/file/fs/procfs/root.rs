@@ -8,6 +8,7 @@ use crate::file::Mode;
 use crate::file::ROOT_GID;
 use crate::file::ROOT_UID;
 use crate::file::Uid;
+use crate::file::fs::kernfs::KernFS;
 use crate::file::fs::kernfs::node::KernFSNode;
 use crate::time::unit::Timestamp;
 use crate::util::IO;
@@ -15,6 +16,11 @@ use crate::util::container::hashmap::HashMap;
 use crate::util::container::string::String;
 use crate::util::ptr::SharedPtr;
 use super::mount::ProcFSMount;
+use super::slabinfo::ProcFSSlabInfo;
+#[cfg(config_debug_syscall_stats)]
+use super::syscalls::ProcFSSyscalls;
+#[cfg(config_debug_trace)]
+use super::trace::ProcFSTrace;
 
 /// Structure representing the root of the procfs.
 pub struct ProcFSRoot {
@@ -23,16 +29,30 @@ pub struct ProcFSRoot {
 }
 
 impl ProcFSRoot {
-	/// Creates a new instance.
-	pub fn new() -> Result<Self, Errno> {
+	/// Creates a new instance, allocating the inodes of its entries on the kernfs `fs`.
+	pub fn new(fs: &mut KernFS) -> Result<Self, Errno> {
 		let mut entries = HashMap::new();
-		entries.insert(String::from(b"mount")?,
-			(0 /* TODO allocate an inode */, SharedPtr::new(ProcFSMount::new())? as _))?;
+		Self::add_entry(fs, &mut entries, b"mount", SharedPtr::new(ProcFSMount::new())?)?;
+		Self::add_entry(fs, &mut entries, b"slabinfo", SharedPtr::new(ProcFSSlabInfo::new())?)?;
+		#[cfg(config_debug_syscall_stats)]
+		Self::add_entry(fs, &mut entries, b"syscalls", SharedPtr::new(ProcFSSyscalls::new())?)?;
+		#[cfg(config_debug_trace)]
+		Self::add_entry(fs, &mut entries, b"trace", SharedPtr::new(ProcFSTrace::new())?)?;
 
 		Ok(Self {
 			entries,
 		})
 	}
+
+	/// Allocates an inode on `fs` for the node `node`, then inserts it in `entries` with the name
+	/// `name`.
+	fn add_entry(fs: &mut KernFS,
+		entries: &mut HashMap<String, (INode, SharedPtr<dyn KernFSNode>)>, name: &[u8],
+		node: SharedPtr<dyn KernFSNode>) -> Result<(), Errno> {
+		let inode = fs.alloc_inode(node.clone())?;
+		entries.insert(String::from(name)?, (inode, node))?;
+		Ok(())
+	}
 }
 
 impl KernFSNode for ProcFSRoot {
@@ -0,0 +1,109 @@
+//! This module implements a procfs node which allows to get the statistics of the slab
+//! allocator's caches.
+//!
+//! Each line of the file has the format `<name> <size> <objects> <slabs> <allocs> <frees>`. Only
+//! the caches that have been used at least once are listed.
+
+use core::cmp::min;
+use core::fmt::Write;
+use crate::errno::Errno;
+use crate::file::FileType;
+use crate::file::Gid;
+use crate::file::INode;
+use crate::file::Mode;
+use crate::file::ROOT_GID;
+use crate::file::ROOT_UID;
+use crate::file::Uid;
+use crate::file::fs::kernfs::node::KernFSNode;
+use crate::memory::slab;
+use crate::time::unit::Timestamp;
+use crate::util::IO;
+use crate::util::container::hashmap::HashMap;
+use crate::util::container::string::String;
+use crate::util::ptr::SharedPtr;
+
+/// Structure representing the slabinfo node of the procfs.
+pub struct ProcFSSlabInfo {}
+
+impl ProcFSSlabInfo {
+	/// Creates a new instance.
+	pub fn new() -> Self {
+		Self {}
+	}
+}
+
+impl KernFSNode for ProcFSSlabInfo {
+	fn get_type(&self) -> FileType {
+		FileType::Regular
+	}
+
+	fn get_mode(&self) -> Mode {
+		0o444
+	}
+
+	fn set_mode(&mut self, _mode: Mode) {}
+
+	fn get_uid(&self) -> Uid {
+		ROOT_UID
+	}
+
+	fn set_uid(&mut self, _uid: Uid) {}
+
+	fn get_gid(&self) -> Gid {
+		ROOT_GID
+	}
+
+	fn set_gid(&mut self, _gid: Gid) {}
+
+	fn get_atime(&self) -> Timestamp {
+		0
+	}
+
+	fn set_atime(&mut self, _ts: Timestamp) {}
+
+	fn get_ctime(&self) -> Timestamp {
+		0
+	}
+
+	fn set_ctime(&mut self, _ts: Timestamp) {}
+
+	fn get_mtime(&self) -> Timestamp {
+		0
+	}
+
+	fn set_mtime(&mut self, _ts: Timestamp) {}
+
+	fn get_entries(&self) -> &HashMap<String, (INode, SharedPtr<dyn KernFSNode>)> {
+		unreachable!();
+	}
+}
+
+impl IO for ProcFSSlabInfo {
+	fn get_size(&self) -> u64 {
+		0
+	}
+
+	fn read(&mut self, offset: u64, buff: &mut [u8]) -> Result<u64, Errno> {
+		// The counters keep changing, thus the content is generated on each read
+		let mut content = String::new();
+		let mut res = Ok(());
+		slab::foreach_stats(| name, size, stats | {
+			if res.is_ok() {
+				res = writeln!(content, "{} {} {} {} {} {}", name, size, stats.objects,
+					stats.slabs, stats.allocs, stats.frees);
+			}
+		});
+		res.map_err(|_| errno!(ENOMEM))?;
+
+		let content = content.as_bytes();
+		let begin = min(offset, content.len() as u64) as usize;
+		let len = min(buff.len(), content.len() - begin);
+		buff[..len].copy_from_slice(&content[begin..(begin + len)]);
+
+		Ok(len as _)
+	}
+
+	fn write(&mut self, _offset: u64, _buff: &[u8]) -> Result<u64, Errno> {
+		Err(errno!(EINVAL))
+	}
+}
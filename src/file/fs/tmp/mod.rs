@@ -280,12 +280,13 @@ impl TmpFS {
 	/// Creates a new instance.
 	/// `max_size` is the maximum amount of memory the filesystem can use in bytes.
 	/// `readonly` tells whether the filesystem is readonly.
-	pub fn new(max_size: usize, readonly: bool) -> Result<Self, Errno> {
+	/// `mountpath` is the path at which the filesystem is mounted.
+	pub fn new(max_size: usize, readonly: bool, mountpath: Path) -> Result<Self, Errno> {
 		let mut fs = Self {
 			max_size,
 			size: 0,
 
-			fs: KernFS::new(String::from(b"tmpfs")?, readonly),
+			fs: KernFS::new(String::from(b"tmpfs")?, readonly, mountpath),
 		};
 
 		// The current timestamp
@@ -405,11 +406,11 @@ impl FilesystemType for TmpFsType {
 	}
 
 	fn create_filesystem(&self, _io: &mut dyn IO) -> Result<Box<dyn Filesystem>, Errno> {
-		Ok(Box::new(TmpFS::new(DEFAULT_MAX_SIZE, false)?)?)
+		Ok(Box::new(TmpFS::new(DEFAULT_MAX_SIZE, false, Path::root())?)?)
 	}
 
-	fn load_filesystem(&self, _io: &mut dyn IO, _mountpath: Path, readonly: bool)
+	fn load_filesystem(&self, _io: &mut dyn IO, mountpath: Path, readonly: bool)
 		-> Result<Box<dyn Filesystem>, Errno> {
-		Ok(Box::new(TmpFS::new(DEFAULT_MAX_SIZE, readonly)?)?)
+		Ok(Box::new(TmpFS::new(DEFAULT_MAX_SIZE, readonly, mountpath)?)?)
 	}
 }
@@ -3,10 +3,12 @@
 //! mounted into subdirectories.
 
 pub mod fcache;
+pub mod epoll;
 pub mod fd;
 pub mod fs;
 pub mod mountpoint;
 pub mod open_file;
+pub mod page_cache;
 pub mod path;
 pub mod pipe;
 pub mod socket;
@@ -19,6 +21,7 @@ use crate::errno::Errno;
 use crate::errno;
 use crate::file::fcache::FCache;
 use crate::file::mountpoint::MountPoint;
+use crate::file::page_cache::CachedFile;
 use crate::limits;
 use crate::process::mem_space::MemSpace;
 use crate::time::unit::Timestamp;
@@ -592,6 +595,38 @@ impl File {
 		}
 	}
 
+	/// Returns the events currently available on the file, as a mask of epoll events.
+	pub fn poll(&self) -> u32 {
+		if let FileContent::CharDevice {
+			major,
+			minor,
+		} = self.content {
+			match device::get_device(DeviceType::Char, major, minor) {
+				Some(dev) => dev.lock().get_mut().get_handle().poll(),
+				None => epoll::EPOLLERR,
+			}
+		} else {
+			epoll::EPOLLIN | epoll::EPOLLOUT
+		}
+	}
+
+	/// Calls `f` with the queue of the epoll watches registered on the file.
+	/// Only char devices can be watched. For other files, the function returns EPERM.
+	pub fn with_poll_queue(&self, f: &mut dyn FnMut(&mut epoll::PollQueue))
+		-> Result<(), Errno> {
+		if let FileContent::CharDevice {
+			major,
+			minor,
+		} = self.content {
+			let dev = device::get_device(DeviceType::Char, major, minor)
+				.ok_or_else(|| errno!(ENODEV))?;
+			dev.lock().get_mut().get_handle().with_poll_queue(f);
+			Ok(())
+		} else {
+			Err(errno!(EPERM))
+		}
+	}
+
 	/// Synchronizes the file with the device.
 	pub fn sync(&self) -> Result<(), Errno> {
 		let mountpoint_mutex = self.location.get_mountpoint().ok_or_else(|| errno!(EIO))?;
@@ -615,6 +650,10 @@ impl IO for File {
 	fn read(&mut self, off: u64, buff: &mut [u8]) -> Result<u64, Errno> {
 		match &self.content {
 			FileContent::Regular => {
+				if let Some(cached) = CachedFile::new(&self.location, self.size) {
+					return cached.read(off, buff);
+				}
+
 				let mountpoint_mutex = self.location.get_mountpoint().ok_or_else(|| errno!(EIO))?;
 				let mut mountpoint_guard = mountpoint_mutex.lock();
 				let mountpoint = mountpoint_guard.get_mut();
@@ -663,6 +702,12 @@ impl IO for File {
 	fn write(&mut self, off: u64, buff: &[u8]) -> Result<u64, Errno> {
 		match &self.content {
 			FileContent::Regular => {
+				if let Some(mut cached) = CachedFile::new(&self.location, self.size) {
+					cached.write(off, buff)?;
+					self.size = cached.get_size();
+					return Ok(buff.len() as _);
+				}
+
 				let mountpoint_mutex = self.location.get_mountpoint().ok_or_else(|| errno!(EIO))?;
 				let mut mountpoint_guard = mountpoint_mutex.lock();
 				let mountpoint = mountpoint_guard.get_mut();
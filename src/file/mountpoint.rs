@@ -1,5 +1,7 @@
 //! A mount point is a directory in which a filesystem is mounted.
 
+use core::sync::atomic::AtomicU32;
+use core::sync::atomic::Ordering;
 use crate::device::Device;
 use crate::errno::Errno;
 use crate::file::File;
@@ -77,8 +79,14 @@ impl MountSource {
 	}
 }
 
+/// The ID of the next mountpoint to be created.
+static NEXT_ID: AtomicU32 = AtomicU32::new(0);
+
 /// Structure representing a mount point.
 pub struct MountPoint {
+	/// The ID of the mountpoint, unique for the lifetime of the kernel.
+	id: u32,
+
 	/// The source of the mountpoint.
 	source: MountSource,
 
@@ -119,6 +127,8 @@ impl MountPoint {
 		let filesystem = fs_type.load_filesystem(io, path.failable_clone()?, readonly)?;
 
 		Ok(Self {
+			id: NEXT_ID.fetch_add(1, Ordering::Relaxed),
+
 			source,
 
 			flags,
@@ -128,6 +138,12 @@ impl MountPoint {
 		})
 	}
 
+	/// Returns the ID of the mountpoint.
+	#[inline(always)]
+	pub fn get_id(&self) -> u32 {
+		self.id
+	}
+
 	/// Returns the source of the mountpoint.
 	#[inline(always)]
 	pub fn get_source(&self) -> &MountSource {
@@ -5,6 +5,13 @@ use core::ffi::c_void;
 use crate::errno::Errno;
 use crate::errno;
 use crate::file::File;
+use crate::file::epoll::EPOLLERR;
+use crate::file::epoll::EPOLLHUP;
+use crate::file::epoll::EPOLLIN;
+use crate::file::epoll::EPOLLOUT;
+use crate::file::epoll::EPoll;
+use crate::file::epoll::PollQueue;
+use crate::file::epoll::Watch;
 use crate::file::pipe::PipeBuffer;
 use crate::file::socket::SocketSide;
 use crate::process::mem_space::MemSpace;
@@ -56,6 +63,70 @@ pub enum FDTarget {
 	Pipe(SharedPtr<PipeBuffer>),
 	/// Points to a socket.
 	Socket(SharedPtr<SocketSide>),
+	/// Points to an epoll instance.
+	EPoll(SharedPtr<EPoll>),
+}
+
+impl FDTarget {
+	/// Returns the events currently available on the target, as a mask of epoll events.
+	/// `read` and `write` tell whether the target is open for reading and writing.
+	pub fn poll(&self, read: bool, write: bool) -> u32 {
+		match self {
+			Self::File(file) => file.lock().get().poll(),
+
+			Self::Pipe(pipe) => {
+				let guard = pipe.lock();
+				let pipe = guard.get();
+
+				let mut events = 0;
+				if read {
+					if pipe.get_data_len() > 0 {
+						events |= EPOLLIN;
+					}
+					if pipe.eof() {
+						events |= EPOLLHUP;
+					}
+				}
+				if write {
+					if !pipe.has_readers() {
+						events |= EPOLLERR;
+					} else if pipe.get_available_len() > 0 {
+						events |= EPOLLOUT;
+					}
+				}
+				events
+			},
+
+			Self::Socket(sock) => sock.lock().get().poll(),
+
+			// TODO Support nested epoll instances
+			Self::EPoll(_) => 0,
+		}
+	}
+
+	/// Calls `f` with the queue of the watches registered on the target.
+	/// If the target cannot be watched, the function returns EPERM.
+	fn with_poll_queue(&self, f: &mut dyn FnMut(&mut PollQueue)) -> Result<(), Errno> {
+		match self {
+			Self::File(file) => file.lock().get().with_poll_queue(f),
+			Self::Pipe(pipe) => Ok(f(pipe.lock().get_mut().get_poll_queue())),
+			Self::Socket(sock) => Ok(sock.lock().get().with_poll_queue(f)),
+
+			Self::EPoll(_) => Err(errno!(EPERM)),
+		}
+	}
+
+	/// Registers the epoll watch `watch` on the target.
+	pub fn add_watch(&self, watch: &IntSharedPtr<Watch>) -> Result<(), Errno> {
+		let mut res = Ok(());
+		self.with_poll_queue(&mut | queue | res = queue.add(watch))?;
+		res
+	}
+
+	/// Unregisters the epoll watch `watch` from the target.
+	pub fn remove_watch(&self, watch: &IntSharedPtr<Watch>) {
+		let _ = self.with_poll_queue(&mut | queue | queue.remove(watch));
+	}
 }
 
 /// An open file description. This structure is pointed to by file descriptors and point to files.
@@ -151,6 +222,8 @@ impl OpenFile {
 				// TODO If other side is closed, return `true`. Else, `false`
 				todo!();
 			},
+
+			FDTarget::EPoll(_) => true,
 		}
 	}
 
@@ -177,6 +250,8 @@ impl OpenFile {
 				let mut guard = s.lock();
 				guard.get_mut().read(buf) as _
 			},
+
+			FDTarget::EPoll(_) => return Err(errno!(EINVAL)),
 		};
 
 		self.curr_off += len as u64;
@@ -206,6 +281,8 @@ impl OpenFile {
 				let mut guard = s.lock();
 				guard.get_mut().write(buf) as _
 			},
+
+			FDTarget::EPoll(_) => return Err(errno!(EINVAL)),
 		};
 
 		self.curr_off += len as u64;
@@ -230,12 +307,23 @@ impl OpenFile {
 				// TODO
 				todo!();
 			},
+
+			FDTarget::EPoll(_) => Err(errno!(ENOTTY)),
 		}
 	}
+
+	/// Returns the events currently available on the open file, as a mask of epoll events.
+	pub fn poll(&self) -> u32 {
+		self.target.poll(self.can_read(), self.can_write())
+	}
 }
 
 impl Drop for OpenFile {
 	fn drop(&mut self) {
+		// The file is closed, thus the epoll instances must not report events for it anymore
+		let open_file = self as *const _;
+		let _ = self.target.with_poll_queue(&mut | queue | queue.close(open_file));
+
 		if let FDTarget::Pipe(pipe) = &self.target {
 			pipe.lock().get_mut().update_end_count(self.can_write(), true);
 		}
@@ -0,0 +1,715 @@
+//! The page cache keeps the content of regular files in physical pages, indexed by their offset
+//! in the file. Reads on files go through the cache, and file mappings map its pages directly into
+//! memory spaces, allowing processes that map the same file to share physical memory.
+//!
+//! Each page in the cache holds a reference on the physical reference counter. Mappings mapping a
+//! page hold other references, which makes private mappings perform Copy-On-Write on it.
+//!
+//! Writes are forwarded to the filesystem immediately, which keeps the cache coherent with the
+//! files. Pages mapped by writable shared mappings are marked as dirty, since they can be modified
+//! at any time. Dirty pages are written back when the mapping is unmapped, when the process
+//! exits, when they are evicted, or on request with `write_back`. A page stays dirty as long as it
+//! is mapped.
+//! Changes to a file also remove it from the cache of ELF programs.
+//!
+//! When the cache is full, the Least Recently Used (LRU) page that is not mapped anywhere is
+//! evicted.
+//!
+//! Pages are read from the filesystem without holding the lock of the cache, so that an I/O
+//! doesn't stall every other accesses to the cache.
+//!
+//! Locks must be acquired in the following order: files, the page cache, mountpoints, I/O
+//! interfaces, then the physical reference counter.
+
+use core::cmp::min;
+use core::ffi::c_void;
+use core::fmt;
+use core::ptr::null;
+use core::slice;
+use crate::elf;
+use crate::errno::Errno;
+use crate::errno;
+use crate::file::FileLocation;
+use crate::file::INode;
+use crate::file::mountpoint::MountPoint;
+use crate::memory::buddy;
+use crate::memory;
+use crate::process::mem_space::PHYSICAL_REF_COUNTER;
+use crate::util::container::hashmap::HashMap;
+use crate::util::container::map::Map;
+use crate::util::container::vec::Vec;
+use crate::util::lock::Mutex;
+use crate::util::math;
+use crate::util::ptr::SharedPtr;
+use crate::util;
+
+/// The maximum number of pages in the cache. The cache may exceed this number if every pages are
+/// mapped.
+const CAPACITY: usize = 4096;
+/// The maximum number of pages examined from the end of the LRU list to find a page to evict.
+const EVICT_SCAN: usize = 32;
+
+/// The index of a slot in the cache, used as a link for the LRU list.
+type Slot = usize;
+/// The null link of the LRU list.
+const NO_SLOT: Slot = usize::MAX;
+
+/// The key of a file in the cache: the ID of its mountpoint and its inode.
+pub type FileKey = (u32, INode);
+
+/// The cached pages of a file.
+struct FilePages {
+	/// The mountpoint of the file, used to write pages back.
+	mountpoint: SharedPtr<MountPoint>,
+	/// The size of the file in bytes, as last seen by the cache.
+	size: u64,
+	/// The version of the cache at the last modification of the file.
+	version: u64,
+	/// The slots of the pages, by page offset in the file.
+	pages: Map<u64, Slot>,
+}
+
+/// A page in the cache.
+struct CachePage {
+	/// The file the page belongs to.
+	key: FileKey,
+	/// The offset of the page in the file, in pages.
+	off: u64,
+	/// The physical address of the page. If null, the slot is free.
+	phys: *const c_void,
+	/// Tells whether the page may have been modified since it was last written back.
+	dirty: bool,
+
+	/// The previous page in the LRU list, more recently used. For a free slot, the value is
+	/// undefined.
+	prev: Slot,
+	/// The next page in the LRU list, less recently used. For a free slot, this is the next free
+	/// slot.
+	next: Slot,
+}
+
+/// The state of the page cache.
+struct PageCache {
+	/// The cached files.
+	files: HashMap<FileKey, FilePages>,
+
+	/// The pages in the cache, by slot.
+	pages: Vec<CachePage>,
+	/// The first free slot.
+	free_head: Slot,
+	/// The most recently used page.
+	lru_head: Slot,
+	/// The least recently used page.
+	lru_tail: Slot,
+
+	/// The total number of pages in the cache.
+	pages_count: usize,
+	/// Incremented at each modification of a file, to detect modifications happening while a page
+	/// is read with the cache unlocked.
+	version: u64,
+}
+
+/// The page cache.
+static PAGE_CACHE: Mutex<PageCache> = Mutex::new(PageCache {
+	files: HashMap::with_buckets(64),
+
+	pages: Vec::new(),
+	free_head: NO_SLOT,
+	lru_head: NO_SLOT,
+	lru_tail: NO_SLOT,
+
+	pages_count: 0,
+	version: 0,
+});
+
+/// Releases a reference held on the physical page `phys`. If no reference remains, the page is
+/// freed.
+pub fn release(phys: *const c_void) {
+	let mut ref_counter_guard = PHYSICAL_REF_COUNTER.lock();
+	let ref_counter = ref_counter_guard.get_mut();
+
+	ref_counter.decrement(phys);
+	if ref_counter.get_ref_count(phys) == 0 {
+		buddy::free(phys, 0);
+	}
+}
+
+/// Returns a slice to the content of the physical page `phys`, which must be allocated in the
+/// kernel zone.
+pub fn get_page_slice(phys: *const c_void) -> &'static mut [u8] {
+	unsafe { // Safe because the page is allocated in the kernel zone
+		slice::from_raw_parts_mut(memory::kern_to_virt(phys) as *mut u8, memory::PAGE_SIZE)
+	}
+}
+
+/// Writes `buf` to the node `inode` of the filesystem of mountpoint `mountpoint` at offset `off`.
+fn write_node(mountpoint: &SharedPtr<MountPoint>, inode: INode, off: u64, buf: &[u8])
+	-> Result<(), Errno> {
+	let mut mountpoint_guard = mountpoint.lock();
+	let mountpoint = mountpoint_guard.get_mut();
+
+	let io_mutex = mountpoint.get_source().get_io();
+	let mut io_guard = io_mutex.lock();
+	let io = io_guard.get_mut();
+
+	mountpoint.get_filesystem().write_node(io, inode, off, buf)
+}
+
+impl PageCache {
+	/// Removes the page at slot `slot` from the LRU list.
+	fn lru_unlink(&mut self, slot: Slot) {
+		let CachePage {
+			prev,
+			next,
+			..
+		} = self.pages[slot];
+
+		if prev != NO_SLOT {
+			self.pages[prev].next = next;
+		} else {
+			self.lru_head = next;
+		}
+		if next != NO_SLOT {
+			self.pages[next].prev = prev;
+		} else {
+			self.lru_tail = prev;
+		}
+	}
+
+	/// Inserts the page at slot `slot` at the beginning of the LRU list.
+	fn lru_push_front(&mut self, slot: Slot) {
+		let head = self.lru_head;
+
+		self.pages[slot].prev = NO_SLOT;
+		self.pages[slot].next = head;
+		if head != NO_SLOT {
+			self.pages[head].prev = slot;
+		} else {
+			self.lru_tail = slot;
+		}
+		self.lru_head = slot;
+	}
+
+	/// Marks the page at slot `slot` as the most recently used.
+	fn touch(&mut self, slot: Slot) {
+		if self.lru_head != slot {
+			self.lru_unlink(slot);
+			self.lru_push_front(slot);
+		}
+	}
+
+	/// Returns a slot for the page at offset `off` (in pages) of the file with key `key`, whose
+	/// physical address is `phys`. The page is not inserted in the LRU list.
+	fn alloc_slot(&mut self, key: FileKey, off: u64, phys: *const c_void)
+		-> Result<Slot, Errno> {
+		let page = CachePage {
+			key,
+			off,
+			phys,
+			dirty: false,
+
+			prev: NO_SLOT,
+			next: NO_SLOT,
+		};
+
+		if self.free_head != NO_SLOT {
+			let slot = self.free_head;
+			self.free_head = self.pages[slot].next;
+			self.pages[slot] = page;
+			Ok(slot)
+		} else {
+			self.pages.push(page)?;
+			Ok(self.pages.len() - 1)
+		}
+	}
+
+	/// Frees the slot `slot`, which must not be in the LRU list.
+	fn free_slot(&mut self, slot: Slot) {
+		self.pages[slot].phys = null();
+		self.pages[slot].next = self.free_head;
+		self.free_head = slot;
+	}
+
+	/// Returns the slot of the page at offset `off` (in pages) in the file with key `key`.
+	fn lookup(&self, key: &FileKey, off: u64) -> Option<Slot> {
+		self.files.get(key)?.pages.get(off).cloned()
+	}
+
+	/// Returns the entry of the file `file`, creating it if not present.
+	fn get_file(&mut self, file: &CachedFile) -> Result<&mut FilePages, Errno> {
+		if self.files.get(&file.key).is_none() {
+			self.files.insert(file.key, FilePages {
+				mountpoint: file.mountpoint.clone(),
+				size: file.size,
+				version: self.version,
+				pages: Map::new(),
+			})?;
+		}
+
+		Ok(self.files.get_mut(&file.key).unwrap())
+	}
+
+	/// Inserts the page `phys` at offset `off` (in pages) of the file `file` at the beginning of
+	/// the LRU list. The reference held on the page by the cache must have been taken by the
+	/// caller.
+	fn insert(&mut self, file: &CachedFile, off: u64, phys: *const c_void)
+		-> Result<Slot, Errno> {
+		let slot = self.alloc_slot(file.key, off, phys)?;
+		let entry = match self.get_file(file) {
+			Ok(entry) => entry,
+
+			Err(e) => {
+				self.free_slot(slot);
+				return Err(e);
+			},
+		};
+		entry.size = file.size;
+		if let Err(e) = entry.pages.insert(off, slot) {
+			self.free_slot(slot);
+			return Err(e);
+		}
+
+		self.lru_push_front(slot);
+		self.pages_count += 1;
+		Ok(slot)
+	}
+
+	/// Removes the page at slot `slot`, releasing it. The content of the page is discarded even if
+	/// dirty.
+	fn remove(&mut self, slot: Slot) {
+		let CachePage {
+			key,
+			off,
+			phys,
+			..
+		} = self.pages[slot];
+
+		self.lru_unlink(slot);
+		if let Some(file) = self.files.get_mut(&key) {
+			file.pages.remove(off);
+			if file.pages.is_empty() {
+				self.files.remove(&key);
+			}
+		}
+		self.free_slot(slot);
+		self.pages_count -= 1;
+
+		release(phys);
+	}
+
+	/// Writes the page at slot `slot` back to the filesystem if dirty.
+	/// The page remains dirty if it is still mapped, since it may be modified again.
+	/// Data past the end of the file is not written.
+	fn write_back(&mut self, slot: Slot) -> Result<(), Errno> {
+		let CachePage {
+			key,
+			off,
+			phys,
+			dirty,
+			..
+		} = self.pages[slot];
+		if !dirty {
+			return Ok(());
+		}
+		let Some(file) = self.files.get(&key) else {
+			return Ok(());
+		};
+
+		elf::cache::invalidate(&key);
+		let begin = off * memory::PAGE_SIZE as u64;
+		if begin < file.size {
+			let len = min(file.size - begin, memory::PAGE_SIZE as u64) as usize;
+			write_node(&file.mountpoint, key.1, begin, &get_page_slice(phys)[..len])?;
+		}
+
+		if PHYSICAL_REF_COUNTER.lock().get().get_ref_count(phys) <= 1 {
+			self.pages[slot].dirty = false;
+		}
+		Ok(())
+	}
+
+	/// Evicts the least recently used page that isn't mapped anywhere, writing it back first if
+	/// dirty. Pages found mapped are moved to the beginning of the LRU list, since they are in
+	/// use.
+	/// At most `EVICT_SCAN` pages are examined. If no page can be evicted, the function does
+	/// nothing.
+	fn evict(&mut self) {
+		let mut slot = self.lru_tail;
+		for _ in 0..EVICT_SCAN {
+			if slot == NO_SLOT {
+				break;
+			}
+			let prev = self.pages[slot].prev;
+
+			let mapped = PHYSICAL_REF_COUNTER.lock().get()
+				.get_ref_count(self.pages[slot].phys) > 1;
+			// If the page cannot be written back, it is kept to avoid losing data
+			if mapped || self.write_back(slot).is_err() {
+				self.touch(slot);
+			} else {
+				self.remove(slot);
+				break;
+			}
+
+			slot = prev;
+		}
+	}
+
+	/// Removes the pages of the file with key `key` starting from page offset `begin`, releasing
+	/// them.
+	fn remove_from(&mut self, key: &FileKey, begin: u64) {
+		self.version += 1;
+		if let Some(file) = self.files.get_mut(key) {
+			file.version = self.version;
+		}
+
+		while let Some(slot) = self.files.get(key)
+			.and_then(| file | file.pages.get_min(begin))
+			.map(| (_, slot) | *slot) {
+			self.remove(slot);
+		}
+	}
+}
+
+/// A regular file whose content is accessed through the page cache.
+#[derive(Clone)]
+pub struct CachedFile {
+	/// The mountpoint of the file.
+	mountpoint: SharedPtr<MountPoint>,
+	/// The key of the file in the cache.
+	key: FileKey,
+	/// The size of the file in bytes.
+	size: u64,
+}
+
+impl CachedFile {
+	/// Returns an instance for the file at location `location`, with size `size` in bytes.
+	/// If the file's filesystem doesn't allow caching, the function returns None.
+	pub fn new(location: &FileLocation, size: u64) -> Option<Self> {
+		let mountpoint = location.get_mountpoint()?;
+		let (id, must_cache) = {
+			let guard = mountpoint.lock();
+			(guard.get().get_id(), guard.get().must_cache())
+		};
+		if !must_cache {
+			return None;
+		}
+
+		Some(Self {
+			mountpoint,
+			key: (id, location.get_inode()),
+			size,
+		})
+	}
+
+	/// Returns the key of the file in the cache.
+	pub fn get_key(&self) -> &FileKey {
+		&self.key
+	}
+
+	/// Returns the size of the file in bytes.
+	pub fn get_size(&self) -> u64 {
+		self.size
+	}
+
+	/// Reads the node of the file at offset `off` from the filesystem into `buf`.
+	fn read_node(&self, off: u64, buf: &mut [u8]) -> Result<u64, Errno> {
+		let mut mountpoint_guard = self.mountpoint.lock();
+		let mountpoint = mountpoint_guard.get_mut();
+
+		let io_mutex = mountpoint.get_source().get_io();
+		let mut io_guard = io_mutex.lock();
+		let io = io_guard.get_mut();
+
+		mountpoint.get_filesystem().read_node(io, self.key.1, off, buf)
+	}
+
+	/// Reads the page at offset `off` (in pages) of the file from the filesystem, with the cache
+	/// unlocked. The function returns the physical address of the page, on which a reference is
+	/// held.
+	fn load_page(&self, off: u64) -> Result<*const c_void, Errno> {
+		let begin = off * memory::PAGE_SIZE as u64;
+
+		let page = buddy::alloc_kernel(0)?;
+		let phys = memory::kern_to_phys(page);
+		unsafe {
+			util::page_zero(page);
+		}
+		let len = min(self.size - begin, memory::PAGE_SIZE as u64) as usize;
+		let result = self.read_node(begin, &mut get_page_slice(phys)[..len])
+			.and_then(| _ | PHYSICAL_REF_COUNTER.lock().get_mut().increment(phys));
+		if let Err(e) = result {
+			buddy::free(phys, 0);
+			return Err(e);
+		}
+
+		Ok(phys)
+	}
+
+	/// Calls `f` with the cache locked and the slot of the page at offset `off` (in pages) in the
+	/// file. If the page is not in the cache, it is read from the filesystem first.
+	/// If the page is past the end of the file, the function returns None.
+	fn with_page<T, F: FnOnce(&mut PageCache, Slot) -> Result<T, Errno>>(&self, off: u64, f: F)
+		-> Result<Option<T>, Errno> {
+		let begin = off * memory::PAGE_SIZE as u64;
+		if begin >= self.size {
+			return Ok(None);
+		}
+
+		loop {
+			let version = {
+				let mut guard = PAGE_CACHE.lock();
+				let cache = guard.get_mut();
+
+				if let Some(slot) = cache.lookup(&self.key, off) {
+					cache.touch(slot);
+					return f(cache, slot).map(Some);
+				}
+
+				cache.get_file(self)?.version
+			};
+
+			let loaded = self.load_page(off);
+
+			let mut guard = PAGE_CACHE.lock();
+			let cache = guard.get_mut();
+			let phys = match loaded {
+				Ok(phys) => phys,
+
+				Err(e) => {
+					if cache.files.get(&self.key).map_or(false, | f | f.pages.is_empty()) {
+						cache.files.remove(&self.key);
+					}
+					return Err(e);
+				},
+			};
+
+			// If the file has been modified meanwhile, the page may be outdated. If the page has
+			// been loaded by someone else meanwhile, their copy is used
+			let modified = cache.files.get(&self.key).map_or(true, | f | f.version != version);
+			if modified || cache.lookup(&self.key, off).is_some() {
+				drop(guard);
+				release(phys);
+				continue;
+			}
+
+			if cache.pages_count >= CAPACITY {
+				cache.evict();
+			}
+			let slot = match cache.insert(self, off, phys) {
+				Ok(slot) => slot,
+
+				Err(e) => {
+					drop(guard);
+					release(phys);
+					return Err(e);
+				},
+			};
+			return f(cache, slot).map(Some);
+		}
+	}
+
+	/// Reads the content of the file at offset `off` into `buf`.
+	/// The function returns the number of bytes read.
+	pub fn read(&self, off: u64, buf: &mut [u8]) -> Result<u64, Errno> {
+		if off > self.size {
+			return Err(errno!(EINVAL));
+		}
+		let len = min(buf.len() as u64, self.size - off) as usize;
+
+		let mut i = 0;
+		while i < len {
+			let page_off = (off + i as u64) / memory::PAGE_SIZE as u64;
+			let inner_off = ((off + i as u64) % memory::PAGE_SIZE as u64) as usize;
+			let l = min(len - i, memory::PAGE_SIZE - inner_off);
+
+			let dest = &mut buf[i..(i + l)];
+			self.with_page(page_off, | cache, slot | {
+				let page = get_page_slice(cache.pages[slot].phys);
+				dest.copy_from_slice(&page[inner_off..(inner_off + l)]);
+				Ok(())
+			})?;
+
+			i += l;
+		}
+
+		Ok(len as _)
+	}
+
+	/// Writes `buf` to the file at offset `off`. The data is written to the filesystem, then to
+	/// the pages of the cache.
+	pub fn write(&mut self, off: u64, buf: &[u8]) -> Result<(), Errno> {
+		write_node(&self.mountpoint, self.key.1, off, buf)?;
+		elf::cache::invalidate(&self.key);
+
+		let end = off + buf.len() as u64;
+		self.size = self.size.max(end);
+
+		let mut guard = PAGE_CACHE.lock();
+		let cache = guard.get_mut();
+		cache.version += 1;
+		let version = cache.version;
+		let Some(file) = cache.files.get_mut(&self.key) else {
+			return Ok(());
+		};
+		file.size = self.size;
+		file.version = version;
+
+		let mut i = 0;
+		while i < buf.len() {
+			let page_off = (off + i as u64) / memory::PAGE_SIZE as u64;
+			let inner_off = ((off + i as u64) % memory::PAGE_SIZE as u64) as usize;
+			let l = min(buf.len() - i, memory::PAGE_SIZE - inner_off);
+
+			if let Some(slot) = file.pages.get(page_off) {
+				let page = get_page_slice(cache.pages[*slot].phys);
+				page[inner_off..(inner_off + l)].copy_from_slice(&buf[i..(i + l)]);
+			}
+
+			i += l;
+		}
+
+		Ok(())
+	}
+
+	/// Returns the physical address of the page at offset `off` (in pages) in the file, reading it
+	/// if not in the cache. A reference to the page is taken for the caller on the physical
+	/// reference counter.
+	/// `write` tells whether the page is mapped writable by a shared mapping, in which case it is
+	/// marked as dirty.
+	/// If the page is past the end of the file, the function returns None.
+	pub fn map_page(&self, off: u64, write: bool) -> Result<Option<*const c_void>, Errno> {
+		self.with_page(off, | cache, slot | {
+			let phys = cache.pages[slot].phys;
+			PHYSICAL_REF_COUNTER.lock().get_mut().increment(phys)?;
+			if write {
+				cache.pages[slot].dirty = true;
+			}
+
+			Ok(phys)
+		})
+	}
+
+	/// Writes back the page at offset `off` (in pages) to the filesystem, if in the cache and
+	/// dirty.
+	/// Data past the end of the file is not written.
+	pub fn write_back(&self, off: u64) -> Result<(), Errno> {
+		let mut guard = PAGE_CACHE.lock();
+		let cache = guard.get_mut();
+
+		match cache.lookup(&self.key, off) {
+			Some(slot) => cache.write_back(slot),
+			None => Ok(()),
+		}
+	}
+}
+
+impl fmt::Debug for CachedFile {
+	fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+		write!(f, "CachedFile {{ mountpoint: {}, inode: {}, size: {} }}",
+			self.key.0, self.key.1, self.size)
+	}
+}
+
+/// Updates the cache after the file at location `location` has been truncated to `size` bytes.
+/// Pages past the end of the file are removed and the end of the last page is zeroed.
+pub fn truncate(location: &FileLocation, size: u64) {
+	let Some(file) = CachedFile::new(location, size) else {
+		return;
+	};
+	elf::cache::invalidate(&file.key);
+
+	let mut guard = PAGE_CACHE.lock();
+	let cache = guard.get_mut();
+
+	let pages = math::ceil_division(size, memory::PAGE_SIZE as u64);
+	cache.remove_from(&file.key, pages);
+
+	let Some(entry) = cache.files.get_mut(&file.key) else {
+		return;
+	};
+	entry.size = size;
+	let inner_off = (size % memory::PAGE_SIZE as u64) as usize;
+	if inner_off != 0 {
+		if let Some(slot) = entry.pages.get(pages - 1) {
+			get_page_slice(cache.pages[*slot].phys)[inner_off..].fill(0);
+		}
+	}
+}
+
+/// Removes every pages of the file with inode `inode` on the mountpoint with ID `mount_id` from
+/// the cache. Pages that are still mapped remain valid for their mappings.
+pub fn invalidate(mount_id: u32, inode: INode) {
+	elf::cache::invalidate(&(mount_id, inode));
+	PAGE_CACHE.lock().get_mut().remove_from(&(mount_id, inode), 0);
+}
+
+/// Returns the number of pages in the cache.
+pub fn get_pages_count() -> usize {
+	PAGE_CACHE.lock().get().pages_count
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	#[test_case]
+	fn page_cache_release0() {
+		let page = buddy::alloc_kernel(0).unwrap();
+		let phys = memory::kern_to_phys(page);
+
+		PHYSICAL_REF_COUNTER.lock().get_mut().increment(phys).unwrap();
+		PHYSICAL_REF_COUNTER.lock().get_mut().increment(phys).unwrap();
+		release(phys);
+		assert_eq!(PHYSICAL_REF_COUNTER.lock().get().get_ref_count(phys), 1);
+
+		release(phys);
+		assert_eq!(PHYSICAL_REF_COUNTER.lock().get().get_ref_count(phys), 0);
+	}
+
+	/// Returns the offsets of the pages of `cache`, from the most to the least recently used.
+	fn lru_order(cache: &PageCache) -> Vec<u64> {
+		let mut order = Vec::new();
+		let mut slot = cache.lru_head;
+		while slot != NO_SLOT {
+			order.push(cache.pages[slot].off).unwrap();
+			slot = cache.pages[slot].next;
+		}
+		order
+	}
+
+	#[test_case]
+	fn page_cache_lru0() {
+		let mut cache = PageCache {
+			files: HashMap::new(),
+
+			pages: Vec::new(),
+			free_head: NO_SLOT,
+			lru_head: NO_SLOT,
+			lru_tail: NO_SLOT,
+
+			pages_count: 0,
+			version: 0,
+		};
+
+		let mut slots = [NO_SLOT; 3];
+		for (i, slot) in slots.iter_mut().enumerate() {
+			*slot = cache.alloc_slot((0, 0), i as _, memory::PAGE_SIZE as _).unwrap();
+			cache.lru_push_front(*slot);
+		}
+		assert_eq!(lru_order(&cache).as_slice(), &[2, 1, 0]);
+
+		// Accessing a page makes it the most recently used
+		cache.touch(slots[0]);
+		assert_eq!(lru_order(&cache).as_slice(), &[0, 2, 1]);
+		assert_eq!(cache.lru_tail, slots[1]);
+
+		// Freed slots are reused
+		cache.lru_unlink(slots[2]);
+		cache.free_slot(slots[2]);
+		assert_eq!(lru_order(&cache).as_slice(), &[0, 1]);
+		let slot = cache.alloc_slot((0, 0), 3, memory::PAGE_SIZE as _).unwrap();
+		assert_eq!(slot, slots[2]);
+		assert_eq!(cache.pages.len(), 3);
+	}
+}
@@ -13,6 +13,7 @@ use crate::errno::Errno;
 use crate::errno;
 use crate::limits;
 use crate::util::FailableClone;
+use crate::util;
 use crate::util::container::string::String;
 use crate::util::container::vec::Vec;
 
@@ -50,7 +51,14 @@ impl Path {
 		}
 
 		let mut parts = Vec::new();
-		for p in path.split(| c | *c == PATH_SEPARATOR as u8) {
+		let mut remaining = path;
+		loop {
+			// Looking for the next separator using `memchr`
+			let (p, next) = match util::find_byte(remaining, PATH_SEPARATOR as u8) {
+				Some(i) => (&remaining[..i], Some(&remaining[(i + 1)..])),
+				None => (remaining, None),
+			};
+
 			if p.len() + 1 >= limits::NAME_MAX {
 				return Err(errno!(ENAMETOOLONG));
 			}
@@ -58,6 +66,11 @@ impl Path {
 			if !p.is_empty() {
 				parts.push(String::from(p)?)?;
 			}
+
+			match next {
+				Some(next) => remaining = next,
+				None => break,
+			}
 		}
 
 		Ok(Self {
@@ -233,13 +246,7 @@ impl Eq for Path {}
 
 impl PartialEq for Path {
 	fn eq(&self, other: &Self) -> bool {
-		for i in 0..self.parts.len() {
-			if self.parts[i] != other.parts[i] {
-				return false;
-			}
-		}
-
-		true
+		self.parts == other.parts
 	}
 }
 
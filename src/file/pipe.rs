@@ -1,59 +1,274 @@
 //! A pipe is an object that links two file descriptors together. One reading and another writing,
 //! with a buffer in between.
+//!
+//! The buffer of a pipe is a chain of references to parts of physical pages. Data written to the
+//! pipe is copied to pages owned by the pipe, while splicing only adds a reference to an existing
+//! page (for example a page of the page cache), allowing to move data between files without
+//! copying it.
 
+use core::cmp::max;
+use core::cmp::min;
+use core::ffi::c_void;
 use crate::file::Errno;
+use crate::file::epoll::EPOLLERR;
+use crate::file::epoll::EPOLLHUP;
+use crate::file::epoll::EPOLLIN;
+use crate::file::epoll::EPOLLOUT;
+use crate::file::epoll::PollQueue;
+use crate::file::page_cache;
 use crate::limits;
-use crate::util::container::ring_buffer::RingBuffer;
+use crate::memory::buddy;
+use crate::memory;
+use crate::process::mem_space::PHYSICAL_REF_COUNTER;
+use crate::util::container::vec::Vec;
+use crate::util::math;
+
+/// The default capacity of a pipe, in pages.
+const DEFAULT_CAPACITY: usize = 16;
+/// The maximum capacity of a pipe, in bytes.
+const MAX_CAPACITY: usize = 1048576;
+
+/// A part of a physical page holding data of a pipe.
+#[derive(Debug)]
+struct Segment {
+	/// The physical address of the page. The pipe holds a reference to it on the physical
+	/// reference counter.
+	page: *const c_void,
+	/// The offset of the beginning of the data in the page.
+	begin: usize,
+	/// The offset of the end of the data in the page.
+	end: usize,
+
+	/// Tells whether the page has been allocated by the pipe, allowing to append data to it.
+	/// Spliced pages are shared and must not be modified.
+	owned: bool,
+}
 
 /// Structure representing a buffer buffer.
 #[derive(Debug)]
 pub struct PipeBuffer {
-	/// The buffer's buffer.
-	buffer: RingBuffer<u8>,
+	/// The segments of data, in the order in which they are read.
+	segments: Vec<Segment>,
+	/// The total length of the data in the buffer, in bytes.
+	len: usize,
+	/// The maximum number of segments in the buffer.
+	capacity: usize,
 
 	/// The number of reading ends attached to the pipe.
 	read_ends: u32,
 	/// The number of writing ends attached to the pipe.
 	write_ends: u32,
+
+	/// The epoll watches registered on the pipe.
+	poll_queue: PollQueue,
 }
 
 impl PipeBuffer {
 	/// Creates a new instance.
 	pub fn new() -> Result<Self, Errno> {
 		Ok(Self {
-			buffer: RingBuffer::new(limits::PIPE_BUF)?,
+			segments: Vec::new(),
+			len: 0,
+			capacity: DEFAULT_CAPACITY,
 
 			read_ends: 0,
 			write_ends: 0,
+
+			poll_queue: PollQueue::new(),
 		})
 	}
 
+	/// Returns the capacity of the buffer in bytes.
+	pub fn get_capacity(&self) -> usize {
+		self.capacity * memory::PAGE_SIZE
+	}
+
+	/// Sets the capacity of the buffer to at least `size` bytes, rounded up to a number of pages.
+	/// The function returns the new capacity in bytes.
+	/// If the buffer currently holds more data than the new capacity allows, the function
+	/// returns EBUSY.
+	pub fn set_capacity(&mut self, size: usize) -> Result<usize, Errno> {
+		if size > MAX_CAPACITY {
+			return Err(errno!(EPERM));
+		}
+
+		let capacity = max(math::ceil_division(size, memory::PAGE_SIZE), 1);
+		if self.segments.len() > capacity {
+			return Err(errno!(EBUSY));
+		}
+
+		self.capacity = capacity;
+		Ok(self.get_capacity())
+	}
+
 	/// Returns the length of the data to be read in the buffer.
 	pub fn get_data_len(&self) -> usize {
-		self.buffer.get_data_len()
+		self.len
+	}
+
+	/// Returns the last segment of the buffer if data can be appended to it.
+	fn get_appendable(&self) -> Option<&Segment> {
+		self.segments.as_slice().last().filter(| s | s.owned && s.end < memory::PAGE_SIZE)
 	}
 
 	/// Returns the available space in the buffer in bytes.
 	pub fn get_available_len(&self) -> usize {
-		self.buffer.get_available_len()
+		let free = (self.capacity - self.segments.len()) * memory::PAGE_SIZE;
+		let tail = self.get_appendable().map(| s | memory::PAGE_SIZE - s.end).unwrap_or(0);
+		free + tail
+	}
+
+	/// Tells whether no segment can be added to the buffer.
+	pub fn is_full(&self) -> bool {
+		self.segments.len() >= self.capacity
+	}
+
+	/// Allocates a new page owned by the pipe and appends an empty segment for it.
+	fn push_owned(&mut self) -> Result<(), Errno> {
+		let phys = memory::kern_to_phys(buddy::alloc_kernel(0)?);
+		if let Err(e) = PHYSICAL_REF_COUNTER.lock().get_mut().increment(phys) {
+			buddy::free(phys, 0);
+			return Err(e);
+		}
+
+		let seg = Segment {
+			page: phys,
+			begin: 0,
+			end: 0,
+
+			owned: true,
+		};
+		if let Err(e) = self.segments.push(seg) {
+			page_cache::release(phys);
+			return Err(e);
+		}
+		Ok(())
+	}
+
+	/// Removes `len` bytes from the beginning of the buffer, releasing the pages that do not
+	/// hold data anymore.
+	pub fn consume(&mut self, mut len: usize) {
+		if len > 0 && self.len > 0 {
+			self.poll_queue.notify(EPOLLOUT);
+		}
+
+		while len > 0 && !self.segments.is_empty() {
+			let seg = &mut self.segments[0];
+			let l = min(seg.end - seg.begin, len);
+			seg.begin += l;
+			self.len -= l;
+			len -= l;
+
+			if seg.begin >= seg.end {
+				let seg = self.segments.remove(0);
+				page_cache::release(seg.page);
+			}
+		}
+	}
+
+	/// Returns the physical page holding the data at the beginning of the buffer, with the range
+	/// of data in the page, truncated to at most `max` bytes.
+	/// The returned page remains valid until the data is consumed.
+	/// If the buffer is empty, the function returns None.
+	pub fn peek(&self, max: usize) -> Option<(*const c_void, usize, usize)> {
+		let seg = self.segments.as_slice().first()?;
+		Some((seg.page, seg.begin, min(seg.end, seg.begin + max)))
+	}
+
+	/// Appends the range `begin..end` of the physical page `page` to the buffer without copying
+	/// it. The pipe takes its own reference to the page, the caller's reference is not consumed.
+	/// The page must not be modified while the pipe references it.
+	/// If the buffer is full, the function returns EAGAIN.
+	pub fn push_page(&mut self, page: *const c_void, begin: usize, end: usize)
+		-> Result<(), Errno> {
+		if self.read_ends == 0 {
+			return Err(errno!(EPIPE));
+		}
+		if self.is_full() {
+			return Err(errno!(EAGAIN));
+		}
+		if begin >= end {
+			return Ok(());
+		}
+
+		PHYSICAL_REF_COUNTER.lock().get_mut().increment(page)?;
+		let seg = Segment {
+			page,
+			begin,
+			end,
+
+			owned: false,
+		};
+		if let Err(e) = self.segments.push(seg) {
+			page_cache::release(page);
+			return Err(e);
+		}
+
+		self.len += end - begin;
+		self.poll_queue.notify(EPOLLIN);
+		Ok(())
 	}
 
 	/// Reads data from the buffer.
 	/// `buf` is the slice to write to.
 	/// The functions returns the number of bytes that have been read.
 	pub fn read(&mut self, buf: &mut [u8]) -> usize {
-		self.buffer.read(buf)
+		let mut i = 0;
+		while i < buf.len() {
+			let Some((page, begin, end)) = self.peek(buf.len() - i) else {
+				break;
+			};
+			let l = end - begin;
+
+			buf[i..(i + l)].copy_from_slice(&page_cache::get_page_slice(page)[begin..end]);
+			self.consume(l);
+			i += l;
+		}
+
+		i
 	}
 
 	/// Writes data to the buffer.
 	/// `buf` is the slice to read from.
 	/// The functions returns the number of bytes that have been written.
 	pub fn write(&mut self, buf: &[u8]) -> Result<usize, Errno> {
-		if self.read_ends > 0 {
-			Ok(self.buffer.write(buf))
-		} else {
-			Err(errno!(EPIPE))
+		if self.read_ends == 0 {
+			return Err(errno!(EPIPE));
+		}
+		// Writes of at most `PIPE_BUF` bytes are atomic
+		if buf.len() <= limits::PIPE_BUF && self.get_available_len() < buf.len() {
+			return Ok(0);
+		}
+
+		let mut i = 0;
+		while i < buf.len() {
+			if self.get_appendable().is_none() {
+				if self.is_full() {
+					break;
+				}
+
+				match self.push_owned() {
+					Ok(()) => {},
+					Err(e) if i == 0 => return Err(e),
+					Err(_) => break,
+				}
+			}
+
+			let last = self.segments.len() - 1;
+			let seg = &mut self.segments[last];
+			let l = min(memory::PAGE_SIZE - seg.end, buf.len() - i);
+			let page = page_cache::get_page_slice(seg.page);
+			page[seg.end..(seg.end + l)].copy_from_slice(&buf[i..(i + l)]);
+			seg.end += l;
+
+			self.len += l;
+			i += l;
 		}
+
+		if i > 0 {
+			self.poll_queue.notify(EPOLLIN);
+		}
+		Ok(i)
 	}
 
 	/// Tells whether the EOF is reached for the pipe.
@@ -61,6 +276,16 @@ impl PipeBuffer {
 		self.write_ends == 0
 	}
 
+	/// Tells whether the pipe has at least one reading end.
+	pub fn has_readers(&self) -> bool {
+		self.read_ends > 0
+	}
+
+	/// Returns the queue of the epoll watches registered on the pipe.
+	pub fn get_poll_queue(&mut self) -> &mut PollQueue {
+		&mut self.poll_queue
+	}
+
 	/// Updates the number of ends of the pipe.
 	/// `write` tells whether the end is a writing end.
 	/// `decrement` tells whether the decrement or increment the count.
@@ -68,8 +293,14 @@ impl PipeBuffer {
 		if decrement {
 			if write {
 				self.write_ends -= 1;
+				if self.write_ends == 0 {
+					self.poll_queue.notify(EPOLLHUP);
+				}
 			} else {
 				self.read_ends -= 1;
+				if self.read_ends == 0 {
+					self.poll_queue.notify(EPOLLERR);
+				}
 			}
 		} else {
 
@@ -81,3 +312,39 @@ impl PipeBuffer {
 		}
 	}
 }
+
+impl Drop for PipeBuffer {
+	fn drop(&mut self) {
+		for seg in self.segments.iter() {
+			page_cache::release(seg.page);
+		}
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	#[test_case]
+	fn pipe_splice0() {
+		let mut pipe = PipeBuffer::new().unwrap();
+		pipe.update_end_count(false, false);
+		assert_eq!(pipe.write(b"abc").unwrap(), 3);
+
+		let phys = memory::kern_to_phys(buddy::alloc_kernel(0).unwrap());
+		PHYSICAL_REF_COUNTER.lock().get_mut().increment(phys).unwrap();
+		page_cache::get_page_slice(phys)[..4].copy_from_slice(b"defg");
+		pipe.push_page(phys, 0, 3).unwrap();
+		assert_eq!(PHYSICAL_REF_COUNTER.lock().get().get_ref_count(phys), 2);
+
+		// Data written after a spliced page is not appended to it
+		assert_eq!(pipe.write(b"hi").unwrap(), 2);
+		assert_eq!(pipe.get_data_len(), 8);
+
+		let mut buf = [0; 8];
+		assert_eq!(pipe.read(&mut buf), 8);
+		assert_eq!(&buf, b"abcdefhi");
+		assert_eq!(PHYSICAL_REF_COUNTER.lock().get().get_ref_count(phys), 1);
+		page_cache::release(phys);
+	}
+}
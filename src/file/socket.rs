@@ -1,6 +1,9 @@
 //! This file implements sockets.
 
 use crate::errno::Errno;
+use crate::file::epoll::EPOLLIN;
+use crate::file::epoll::EPOLLOUT;
+use crate::file::epoll::PollQueue;
 use crate::util::container::ring_buffer::RingBuffer;
 use crate::util::container::vec::Vec;
 use crate::util::ptr::SharedPtr;
@@ -29,6 +32,8 @@ pub struct Socket {
 
 	/// The list of sides of the socket.
 	sides: Vec<SharedPtr<SocketSide>>,
+	/// The epoll watches registered on each side of the socket.
+	poll_queues: [PollQueue; 2],
 }
 
 impl Socket {
@@ -45,6 +50,7 @@ impl Socket {
 			send_buffer: RingBuffer::new(BUFFER_SIZE)?,
 
 			sides: Vec::new(),
+			poll_queues: [PollQueue::new(), PollQueue::new()],
 		})
 	}
 
@@ -103,11 +109,15 @@ impl SocketSide {
 		let mut guard = self.sock.lock();
 		let sock = guard.get_mut();
 
-		if self.other {
+		let len = if self.other {
 			sock.send_buffer.read(buf)
 		} else {
 			sock.receive_buffer.read(buf)
+		};
+		if len > 0 {
+			sock.poll_queues[!self.other as usize].notify(EPOLLOUT);
 		}
+		len
 	}
 
 	/// Writes data to the socket.
@@ -117,10 +127,41 @@ impl SocketSide {
 		let mut guard = self.sock.lock();
 		let sock = guard.get_mut();
 
-		if self.other {
+		let len = if self.other {
 			sock.receive_buffer.write(buf)
 		} else {
 			sock.send_buffer.write(buf)
+		};
+		if len > 0 {
+			sock.poll_queues[!self.other as usize].notify(EPOLLIN);
 		}
+		len
+	}
+
+	/// Returns the events currently available on the side, as a mask of epoll events.
+	pub fn poll(&self) -> u32 {
+		let guard = self.sock.lock();
+		let sock = guard.get();
+
+		let (read_buffer, write_buffer) = if self.other {
+			(&sock.send_buffer, &sock.receive_buffer)
+		} else {
+			(&sock.receive_buffer, &sock.send_buffer)
+		};
+
+		let mut events = 0;
+		if !read_buffer.is_empty() {
+			events |= EPOLLIN;
+		}
+		if write_buffer.get_available_len() > 0 {
+			events |= EPOLLOUT;
+		}
+		events
+	}
+
+	/// Calls `f` with the queue of the epoll watches registered on the side.
+	pub fn with_poll_queue(&self, f: &mut dyn FnMut(&mut PollQueue)) {
+		let mut guard = self.sock.lock();
+		f(&mut guard.get_mut().poll_queues[self.other as usize]);
 	}
 }
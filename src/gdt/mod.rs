@@ -1,11 +1,17 @@
 //! Under the x86 architecture, the GDT (Global Descriptior Table) is a table of structure that
 //! describes the segments of memory. It is a deprecated structure that still must be used in order
 //! to switch to protected mode, handle protection rings and load the Task State Segment (TSS).
+//!
+//! The bootstrap core uses the GDT located at `PHYS_PTR`. Each other core uses its own copy, so
+//! that it can have its own TSS and TLS entries. The current core is identified by the address of
+//! the GDT it has loaded.
 
 pub mod ldt;
 
 use core::ffi::c_void;
 use core::fmt;
+use core::mem::size_of;
+use crate::cpu::smp;
 use crate::errno::Errno;
 use crate::memory;
 use crate::util::FailableClone;
@@ -25,6 +31,21 @@ pub const USER_DS: usize = 32;
 pub const TSS_OFFSET: usize = 40;
 /// The offset of Thread Local Storage (TLS) entries.
 pub const TLS_OFFSET: usize = 48;
+/// The number of entries in the GDT.
+const ENTRIES_COUNT: usize = 9;
+
+/// The GDTs of the cores other than the bootstrap core, by core index.
+static mut CORE_GDTS: [[u64; ENTRIES_COUNT]; smp::MAX_CORES]
+	= [[0; ENTRIES_COUNT]; smp::MAX_CORES];
+
+/// The value of the GDTR register.
+#[repr(C, packed)]
+struct Descriptor {
+	/// The size of the GDT in bytes, minus 1.
+	size: u16,
+	/// The address of the GDT.
+	offset: u32,
+}
 
 /// Structure representing a GDT entry.
 #[repr(transparent)]
@@ -144,9 +165,66 @@ pub fn make_segment_selector(offset: u32, ring: u32) -> u16 {
 	(offset | ring) as _
 }
 
-/// x86. Returns the pointer to the segment at offset `offset`.
-pub fn get_segment_ptr(offset: usize) -> *mut u64 {
+/// Returns the address of the GDT loaded on the current core.
+#[inline(always)]
+fn get_current() -> usize {
+	let mut desc = Descriptor {
+		size: 0,
+		offset: 0,
+	};
+
 	unsafe {
-		memory::kern_to_virt(PHYS_PTR.add(offset as _)) as _
+		core::arch::asm!("sgdt [{}]", in(reg) &mut desc, options(nostack, preserves_flags));
+	}
+	desc.offset as _
+}
+
+/// Returns the index of the current core.
+#[inline(always)]
+pub fn get_current_core() -> usize {
+	let gdts_begin = unsafe {
+		CORE_GDTS.as_ptr() as usize
+	};
+	let off = get_current().wrapping_sub(gdts_begin);
+
+	if off < size_of::<[[u64; ENTRIES_COUNT]; smp::MAX_CORES]>() {
+		off / size_of::<[u64; ENTRIES_COUNT]>()
+	} else {
+		0
 	}
 }
+
+/// x86. Returns the pointer to the segment at offset `offset` in the GDT of the current core.
+pub fn get_segment_ptr(offset: usize) -> *mut u64 {
+	match get_current_core() {
+		0 => unsafe {
+			memory::kern_to_virt(PHYS_PTR.add(offset as _)) as _
+		},
+
+		core => unsafe {
+			(CORE_GDTS[core].as_mut_ptr() as *mut u8).add(offset) as _
+		},
+	}
+}
+
+/// Initializes the GDT of the core with index `core`, copying the bootstrap core's GDT, and loads
+/// it on the current core.
+///
+/// # Safety
+///
+/// The function must be called only once per core, when the core starts.
+pub unsafe fn init_core(core: usize) {
+	debug_assert!(core > 0 && core < smp::MAX_CORES);
+
+	let gdt = &mut CORE_GDTS[core];
+	let bsp_gdt = memory::kern_to_virt(PHYS_PTR) as *const u64;
+	for (i, e) in gdt.iter_mut().enumerate() {
+		*e = *bsp_gdt.add(i);
+	}
+
+	let desc = Descriptor {
+		size: (size_of::<[u64; ENTRIES_COUNT]>() - 1) as _,
+		offset: gdt.as_ptr() as _,
+	};
+	core::arch::asm!("lgdt [{}]", in(reg) &desc, options(nostack, preserves_flags));
+}
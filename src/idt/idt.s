@@ -84,6 +84,11 @@ GET_REGS \n
 	call event_handler
 	add $16, %esp
 
+	# Writing back the instruction pointer, which may have been changed by the handler to jump to
+	# a fixup location
+	mov 0x8(%esp), %eax
+	mov %eax, 4(%ebp)
+
 RESTORE_REGS
 
 	# Freeing the space allocated for the error code
@@ -135,6 +140,51 @@ RESTORE_REGS
 .endm
 
 
+/*
+ * This macro creates a function to handle an Inter-Processor Interrupt (IPI), issued by the Local
+ * APIC of the current core.
+ * `n` is the id in the interrupt vector.
+ */
+.macro IPI	n
+.global ipi\n
+
+ipi\n:
+	push %ebp
+	mov %esp, %ebp
+
+	# Allocating space for registers and retrieving them
+GET_REGS ipi_\n
+
+	# Getting the ring
+	mov 8(%ebp), %eax
+	and $0b11, %eax
+
+	# Pushing arguments to call event_handler
+	push %esp # regs
+	push %eax # ring
+	push $0 # code
+	push $\n # id
+	call event_handler
+	add $16, %esp
+
+	call apic_end_of_interrupt
+
+RESTORE_REGS
+
+	# Restoring the context
+	mov %ebp, %esp
+	pop %ebp
+	iret
+.endm
+
+/*
+ * The handler for spurious interrupts of the Local APIC. These interrupts must not be
+ * acknowledged.
+ */
+.global apic_spurious
+
+apic_spurious:
+	iret
 
 /*
  * Creating the handlers for every errors.
@@ -192,6 +242,13 @@ IRQ 13
 IRQ 14
 IRQ 15
 
+/*
+ * Creating the handlers for every IPIs.
+ */
+IPI 48
+IPI 49
+IPI 50
+
 
 
 /*
@@ -5,6 +5,16 @@ pub mod pic;
 
 use core::ffi::c_void;
 use core::mem::MaybeUninit;
+use core::ptr::addr_of;
+use core::ptr;
+use crate::cpu::smp;
+use crate::cpu;
+use crate::errno::Errno;
+use crate::gdt;
+use crate::memory::buddy;
+use crate::memory::vmem;
+use crate::memory;
+use crate::process::tss;
 use crate::util;
 
 /// Makes the interrupt switch to ring 0.
@@ -18,11 +28,31 @@ const ID_PRIVILEGE_RING_3: u8 = 0b00000110;
 /// Flag telling that the interrupt is present.
 const ID_PRESENT: u8 = 0b00000001;
 
+/// The IDT vector index for the IPI telling other cores to tick their scheduler.
+pub const TICK_IPI: usize = 0x30;
+/// The IDT vector index for the IPI telling other cores to invalidate their TLB.
+pub const TLB_SHOOTDOWN_IPI: usize = 0x31;
+/// The IDT vector index for the timer of the Local APIC.
+pub const APIC_TIMER: usize = 0x32;
+/// The IDT vector index for spurious interrupts of the Local APIC.
+pub const APIC_SPURIOUS: usize = 0x3f;
 /// The IDT vector index for system calls.
 pub const SYSCALL_ENTRY: usize = 0x80;
 /// The number of entries into the IDT.
 pub const ENTRIES_COUNT: usize = 0x81;
 
+/// The Model Specific Register holding the code segment selector used by `sysenter`.
+const MSR_SYSENTER_CS: u32 = 0x174;
+/// The Model Specific Register holding the stack pointer used by `sysenter`.
+const MSR_SYSENTER_ESP: u32 = 0x175;
+/// The Model Specific Register holding the instruction pointer used by `sysenter`.
+const MSR_SYSENTER_EIP: u32 = 0x176;
+
+/// The size of the stack used on `sysenter` in words. The stack is used only until switching
+/// to the kernel stack of the current process, thus it only needs to hold the frame of a
+/// non-maskable interrupt.
+const SYSENTER_STACK_SIZE: usize = 32;
+
 /// Disables interruptions.
 #[macro_export]
 macro_rules! cli {
@@ -103,6 +133,11 @@ extern "C" {
 	fn irq14();
 	fn irq15();
 
+	fn ipi48();
+	fn ipi49();
+	fn ipi50();
+	fn apic_spurious();
+
 	fn error0();
 	fn error1();
 	fn error2();
@@ -137,8 +172,21 @@ extern "C" {
 	fn error31();
 
 	fn syscall();
+	fn syscall_sysenter();
+	fn vsyscall();
+	fn vsyscall_landing();
+	fn vsyscall_end();
+
+	static mut vsyscall_landing_addr: u32;
 }
 
+/// The stacks used on `sysenter`, by core index. The top word of each stack holds the address
+/// of the kernel stack pointer in the TSS of the core.
+static mut SYSENTER_STACKS: [[u32; SYSENTER_STACK_SIZE]; smp::MAX_CORES]
+	= [[0; SYSENTER_STACK_SIZE]; smp::MAX_CORES];
+/// The page containing the copy of the `vsyscall` routine executed by userspace.
+static mut VSYSCALL_PAGE: Option<*const c_void> = None;
+
 /// The list of IDT entries.
 static mut ID: MaybeUninit<[InterruptDescriptor; ENTRIES_COUNT]> = MaybeUninit::uninit();
 
@@ -220,9 +268,19 @@ pub fn init() {
 		id[0x2e] = create_id(get_c_fn_ptr(irq14), 0x8, 0x8e);
 		id[0x2f] = create_id(get_c_fn_ptr(irq15), 0x8, 0x8e);
 
+		id[TICK_IPI] = create_id(get_c_fn_ptr(ipi48), 0x8, 0x8e);
+		id[TLB_SHOOTDOWN_IPI] = create_id(get_c_fn_ptr(ipi49), 0x8, 0x8e);
+		id[APIC_TIMER] = create_id(get_c_fn_ptr(ipi50), 0x8, 0x8e);
+		id[APIC_SPURIOUS] = create_id(get_c_fn_ptr(apic_spurious), 0x8, 0x8e);
+
 		id[SYSCALL_ENTRY] = create_id(get_c_fn_ptr(syscall), 0x8, 0xee);
 	}
 
+	load();
+}
+
+/// Loads the IDT on the current core. The IDT must have been initialized with `init`.
+pub fn load() {
 	let idt = InterruptDescriptorTable {
 		size: (core::mem::size_of::<InterruptDescriptor>() * ENTRIES_COUNT - 1) as u16,
 		offset: unsafe {
@@ -234,6 +292,75 @@ pub fn init() {
 	}
 }
 
+/// Enables system calls through the `sysenter` instruction on the current core, if supported.
+/// The TSS of the core must have been initialized.
+pub fn init_sysenter() {
+	if !cpu::has_sep() {
+		return;
+	}
+
+	let core = smp::get_core_id();
+	unsafe {
+		let stack = &mut SYSENTER_STACKS[core];
+		stack[SYSENTER_STACK_SIZE - 1] = addr_of!(tss::get().esp0) as _;
+		let stack_top = &stack[SYSENTER_STACK_SIZE - 1] as *const u32;
+
+		cpu::wrmsr(MSR_SYSENTER_CS, gdt::KERNEL_CS as _);
+		cpu::wrmsr(MSR_SYSENTER_ESP, stack_top as u32 as _);
+		cpu::wrmsr(MSR_SYSENTER_EIP, get_c_fn_ptr(syscall_sysenter) as u32 as _);
+	}
+}
+
+/// Copies the `vsyscall` routine to a page readable and executable from userspace.
+///
+/// The page is mapped in kernelspace, whose page tables are shared by every memory spaces.
+/// Thus, it is available to every processes without exposing the kernel image itself.
+///
+/// If the `sysenter` instruction is not supported or if the page is already mapped, the function
+/// does nothing.
+pub fn init_vsyscall() -> Result<(), Errno> {
+	if !cpu::has_sep() || unsafe { VSYSCALL_PAGE.is_some() } {
+		return Ok(());
+	}
+
+	let begin = get_c_fn_ptr(vsyscall);
+	let len = get_c_fn_ptr(vsyscall_end) as usize - begin as usize;
+	let landing_off = get_c_fn_ptr(vsyscall_landing) as usize - begin as usize;
+
+	let page = buddy::alloc_kernel(0)?;
+	unsafe {
+		ptr::copy_nonoverlapping(begin as *const u8, page as *mut u8, len);
+	}
+
+	{
+		let mut vmem_guard = crate::get_vmem().lock();
+		let vmem = vmem_guard.get_mut().as_mut().unwrap();
+
+		let phys = memory::kern_to_phys(page);
+		let flags = vmem::x86::FLAG_USER | vmem::x86::FLAG_GLOBAL;
+		if let Err(e) = vmem.map(phys, page, flags) {
+			buddy::free_kernel(page, 0);
+			return Err(e);
+		}
+	}
+
+	unsafe {
+		vsyscall_landing_addr = (page as usize + landing_off) as _;
+		VSYSCALL_PAGE = Some(page);
+	}
+	Ok(())
+}
+
+/// Returns the address of the routine allowing userspace to issue system calls with the
+/// `sysenter` instruction. If the instruction is not supported, the function returns None.
+///
+/// The routine must have been mapped with `init_vsyscall`.
+pub fn get_vsyscall() -> Option<*const c_void> {
+	unsafe {
+		VSYSCALL_PAGE
+	}
+}
+
 /// Tells whether interruptions are enabled.
 pub fn is_interrupt_enabled() -> bool {
 	unsafe {
@@ -260,3 +387,37 @@ pub fn wrap_disable_interrupts<T, F: FnOnce() -> T>(f: F) -> T {
 
 	result
 }
+
+#[cfg(test)]
+mod test {
+	use super::*;
+	use core::slice;
+	use crate::memory::vmem::x86::X86VMem;
+
+	#[test_case]
+	fn vsyscall_page0() {
+		init_vsyscall().unwrap();
+		let Some(page) = get_vsyscall() else {
+			return;
+		};
+
+		let begin = get_c_fn_ptr(vsyscall);
+		let len = get_c_fn_ptr(vsyscall_end) as usize - begin as usize;
+		let landing = unsafe {
+			vsyscall_landing_addr
+		} as usize;
+		assert!(landing > page as usize && landing < page as usize + len);
+		unsafe {
+			let routine = slice::from_raw_parts(begin as *const u8, len);
+			let copy = slice::from_raw_parts(page as *const u8, len);
+			assert_eq!(routine, copy);
+		}
+
+		// The page is readable from the userspace of any memory space, but not writable
+		let vmem = X86VMem::new().unwrap();
+		let flags = vmem.get_flags(page).unwrap();
+		assert_ne!(flags & vmem::x86::FLAG_USER, 0);
+		assert_eq!(flags & vmem::x86::FLAG_WRITE, 0);
+		assert_eq!(vmem.get_flags(begin).unwrap() & vmem::x86::FLAG_USER, 0);
+	}
+}
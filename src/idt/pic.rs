@@ -65,6 +65,39 @@ pub fn init(offset1: u8, offset2: u8) {
 	}
 }
 
+/// Unmasks the interrupt `irq`, allowing it to be received.
+pub fn enable_irq(irq: u8) {
+	let (port, bit) = if irq >= 0x8 {
+		(SLAVE_DATA, irq - 0x8)
+	} else {
+		(MASTER_DATA, irq)
+	};
+
+	unsafe {
+		let mask = io::inb(port);
+		io::outb(port, mask & !(1 << bit));
+		if irq >= 0x8 {
+			// Unmasking the cascade
+			let mask = io::inb(MASTER_DATA);
+			io::outb(MASTER_DATA, mask & !(1 << 2));
+		}
+	}
+}
+
+/// Masks the interrupt `irq`, preventing it from being received.
+pub fn disable_irq(irq: u8) {
+	let (port, bit) = if irq >= 0x8 {
+		(SLAVE_DATA, irq - 0x8)
+	} else {
+		(MASTER_DATA, irq)
+	};
+
+	unsafe {
+		let mask = io::inb(port);
+		io::outb(port, mask | (1 << bit));
+	}
+}
+
 /// Sends an End-Of-Interrupt message to the PIC for the given interrupt `irq`.
 #[no_mangle]
 pub extern "C" fn end_of_interrupt(irq: u8) {
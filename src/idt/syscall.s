@@ -1,10 +1,27 @@
 /*
- * This file implements the function that handles the system calls.
+ * This file implements the functions that handle the system calls.
+ *
+ * System calls are issued either with the `int $0x80` instruction or, if the CPU supports it,
+ * with the `sysenter` instruction through the `vsyscall` routine. The routine is copied to a
+ * page readable from userspace, whose address is given to programs in the auxilary vector.
  */
 
 .include "src/process/regs/regs.s"
 
 .global syscall
+.global syscall_sysenter
+.global vsyscall
+.global vsyscall_landing
+.global vsyscall_end
+.global vsyscall_landing_addr
+
+.section .data
+
+/*
+ * The address of `vsyscall_landing` in the userspace copy of the `vsyscall` routine.
+ */
+vsyscall_landing_addr:
+	.long 0
 
 .section .text
 
@@ -44,3 +61,99 @@ RESTORE_REGS
 	mov %ebp, %esp
 	pop %ebp
 	iret
+
+/*
+ * The routine allowing userspace to issue a system call with `sysenter`. The routine takes the
+ * same registers as `int $0x80` and must be called with `call`.
+ *
+ * Since `sysenter` doesn't save the stack and instruction pointers, the userspace stack pointer
+ * is passed in %ebp, whose value is saved on the stack with the registers clobbered by
+ * `sysexit`. The kernel then resumes at `vsyscall_landing`, which restores them.
+ *
+ * This code is executed in userspace, from its copy in the vsyscall page. Thus, it must be
+ * position independent.
+ */
+vsyscall:
+	push %ecx
+	push %edx
+	push %ebp
+	mov %esp, %ebp
+	sysenter
+vsyscall_landing:
+	pop %ebp
+	pop %edx
+	pop %ecx
+	ret
+vsyscall_end:
+
+/*
+ * The function handling system calls issued with `sysenter`.
+ *
+ * On entry, the stack pointer points to the top of the sysenter stack of the current core,
+ * which holds the address of the kernel stack pointer in the core's TSS. Interruptions are
+ * disabled.
+ */
+syscall_sysenter:
+	# Switching to the kernel stack of the current process. The stack pointer is changed with a
+	# single instruction so that a non-maskable interrupt cannot clobber the TSS
+	# Until the flags are saved, only instructions that leave them untouched are used
+	lea -8(%esp), %esp
+	mov %eax, 4(%esp)
+	mov 8(%esp), %eax
+	mov (%eax), %eax
+	mov %eax, (%esp)
+	mov 4(%esp), %eax
+	mov (%esp), %esp
+
+	# Building the same stack frame as an interruption coming from ring 3, returning to
+	# `vsyscall_landing` in the vsyscall page. The userspace flags are saved first
+	lea -8(%esp), %esp
+	pushf
+	movl $GDT_USER_DS, 8(%esp)
+	orl $3, 8(%esp)
+	mov %ebp, 4(%esp)
+	orl $0x200, (%esp)
+	push $GDT_USER_CS
+	orl $3, (%esp)
+	pushl vsyscall_landing_addr
+
+	push %ebp
+	mov %esp, %ebp
+
+	# Storing registers state
+GET_REGS sysenter
+
+	# Setting data segment
+	mov $GDT_KERNEL_DS, %ax
+	mov %ax, %ds
+	mov %ax, %es
+
+	# Calling the system call handler
+	push %esp
+	sti
+	call sysenter_handler
+	cli
+	add $4, %esp
+
+	# Restoring data segment
+	xor %ebx, %ebx
+	mov $GDT_USER_DS, %bx
+	or $3, %bx
+	mov %bx, %ds
+	mov %bx, %es
+
+RESTORE_REGS
+
+	mov %ebp, %esp
+	pop %ebp
+
+	# Returning to the landing address with `sysexit`, which takes the instruction pointer in %edx
+	# and the stack pointer in %ecx. Interruptions are enabled only once the instruction is
+	# executed
+	mov (%esp), %edx
+	mov 12(%esp), %ecx
+	andl $~0x200, 8(%esp)
+	add $8, %esp
+	popf
+	sti
+	sysexit
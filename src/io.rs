@@ -76,3 +76,35 @@ pub unsafe fn outw(port: u16, value: u16) {
 pub unsafe fn outl(port: u16, value: u32) {
 	asm!("out dx, eax", in("eax") value, in("dx") port);
 }
+
+/// Inputs `count` words from the specified port to the buffer `buf`.
+///
+/// # Safety
+///
+/// Reading from an invalid port has an undefined behaviour.
+/// `buf` must be valid for `count` words.
+/// This function is not thread safe.
+#[inline(always)]
+pub unsafe fn insw(port: u16, buf: *mut u16, count: usize) {
+	asm!("rep insw", in("dx") port, inout("edi") buf => _, inout("ecx") count => _);
+}
+
+/// Outputs `count` words from the buffer `buf` to the specified port.
+///
+/// # Safety
+///
+/// Writing to an invalid port has an undefined behaviour.
+/// `buf` must be valid for `count` words.
+/// This function is not thread safe.
+#[inline(always)]
+pub unsafe fn outsw(port: u16, buf: *const u16, count: usize) {
+	// `esi` cannot be used as an operand since LLVM reserves it
+	asm!(
+		"xchg esi, {buf}",
+		"rep outsw",
+		"xchg esi, {buf}",
+		buf = inout(reg) buf => _,
+		in("dx") port,
+		inout("ecx") count => _,
+	);
+}
@@ -31,6 +31,8 @@
 #![reexport_test_harness_main = "kernel_selftest"]
 
 pub mod acpi;
+#[cfg(config_debug_bench)]
+pub mod bench;
 pub mod cmdline;
 pub mod cpu;
 pub mod crypto;
@@ -59,6 +61,7 @@ pub mod process;
 pub mod selftest;
 pub mod syscall;
 pub mod time;
+pub mod trace;
 pub mod tty;
 pub mod types;
 #[macro_use]
@@ -97,7 +100,13 @@ extern "C" {
 
 /// Makes the kernel wait for an interrupt, then returns.
 /// This function enables interrupts.
+/// Since callers usually poll for an event, the current core is guaranteed to be interrupted
+/// within a time slice even if timers replaced the periodic tick.
 pub fn wait() {
+	// Interrupts remain disabled until the core halts, so that the timer cannot fire before
+	cli!();
+	time::timer::arm_poll();
+
 	unsafe {
 		kernel_wait();
 	}
@@ -133,9 +142,8 @@ fn init_vmem() -> Result<(), Errno> {
 	// TODO If Meltdown mitigation is enabled, only allow read access to a stub of the
 	// kernel for interrupts
 
-	// TODO Enable GLOBAL in cr4
-
-	// Mapping the kernelspace
+	// Mapping the kernelspace. Since the mapping is permanent and the same in every contexts, it
+	// uses global large blocks
 	kernel_vmem.map_range(null::<c_void>(),
 		memory::PROCESS_END,
 		memory::get_kernelspace_size() / memory::PAGE_SIZE,
@@ -154,6 +162,7 @@ fn init_vmem() -> Result<(), Errno> {
 
 	// Binding the kernel virtual memory context
 	bind_vmem();
+	cpu::enable_pge();
 	Ok(())
 }
 
@@ -251,6 +260,7 @@ pub extern "C" fn kernel_main(magic: u32, multiboot_ptr: *const c_void) -> ! {
 	// Initializing IDT, PIT and events handler
 	idt::init();
 	pit::init();
+	time::tsc::init();
 	event::init();
 
 	// Ensuring the CPU has SSE
@@ -258,6 +268,8 @@ pub extern "C" fn kernel_main(magic: u32, multiboot_ptr: *const c_void) -> ! {
 		kernel_panic!("SSE support is required to run this kernel :(");
 	}
 	cpu::sse::enable();
+	// Selecting the fastest memory functions for the CPU
+	util::init();
 
 	// Reading multiboot informations
 	multiboot::read_tags(multiboot_ptr);
@@ -273,6 +285,8 @@ pub extern "C" fn kernel_main(magic: u32, multiboot_ptr: *const c_void) -> ! {
 	if init_vmem().is_err() {
 		kernel_panic!("Cannot initialize kernel virtual memory!");
 	}
+	elf::symbols::init()
+		.unwrap_or_else(| e | kernel_panic!("Failed to index kernel symbols! ({})", e));
 
 	// From here, the kernel considers that memory management has been fully initialized
 
@@ -295,6 +309,11 @@ pub extern "C" fn kernel_main(magic: u32, multiboot_ptr: *const c_void) -> ! {
 
 	println!("Initializing ACPI...");
 	acpi::init();
+	println!("Starting CPU cores...");
+	cpu::smp::init()
+		.unwrap_or_else(| e | kernel_panic!("Failed to start CPU cores! ({})", e));
+	time::timer::init();
+	trace::init().unwrap_or_else(| e | kernel_panic!("Failed to initialize tracing! ({})", e));
 
 	println!("Initializing ramdisks...");
 	device::storage::ramdisk::create()
@@ -314,6 +333,19 @@ pub extern "C" fn kernel_main(magic: u32, multiboot_ptr: *const c_void) -> ! {
 	println!("Initializing processes...");
 	process::init().unwrap_or_else(| e | kernel_panic!("Failed to init processes! ({})", e));
 
+	#[cfg(config_debug_bench)]
+	{
+		bench::run_all();
+
+		#[cfg(config_debug_qemu)]
+		selftest::qemu::exit(selftest::qemu::SUCCESS);
+		#[cfg(not(config_debug_qemu))]
+		halt();
+	}
+
+	device::storage::cache::init_flush()
+		.unwrap_or_else(| e | kernel_panic!("Failed to start the buffer cache flush! ({})", e));
+
 	let init_path = args_parser.get_init_path().as_ref()
 		.map(| s | s.as_bytes())
 		.unwrap_or(INIT_PATH);
@@ -6,14 +6,21 @@
 //!
 //! The order of a frame is the `n` in the expression `2^^n` that represents the size of a frame in
 //! pages.
+//!
+//! Small frames are cached in magazines, which are stacks of free frames refilled from and drained
+//! to the zones in batches. This avoids locking a zone and splitting or coalescing frames on every
+//! allocation of a single page.
 
 use core::cmp::min;
 use core::ffi::c_void;
 use core::mem::MaybeUninit;
 use core::mem::size_of;
+use crate::cpu::smp;
 use crate::errno::Errno;
 use crate::errno;
 use crate::memory;
+use crate::trace::EventType;
+use crate::trace;
 use crate::util::lock::*;
 use crate::util::math;
 use crate::util;
@@ -42,6 +49,13 @@ pub const FLAG_ZONE_TYPE_KERNEL: Flags = 0b10;
 /// Value indicating that the frame is used.
 pub const FRAME_STATE_USED: FrameID = !0_u32;
 
+/// The maximum order of frames cached in magazines. Larger frames are always allocated from the
+/// zones.
+pub const MAGAZINE_MAX_ORDER: FrameOrder = 3;
+/// The capacity of a magazine of order `0`, in frames. The capacity of magazines for higher orders
+/// is divided by two for each order, so that every magazine holds the same number of pages.
+const MAGAZINE_CAPACITY: usize = 64;
+
 /// Structure representing an allocatable zone of memory.
 pub struct Zone {
 	/// The type of the zone, defining the priority
@@ -75,8 +89,91 @@ struct Frame {
 	order: FrameOrder,
 }
 
+/// Informations about a zone that don't change after initialization. Those are stored outside of
+/// the zone's mutex so that finding the zone for an allocation doesn't require locking.
+#[derive(Clone, Copy)]
+struct ZoneInfo {
+	/// The type of the zone.
+	type_: Flags,
+	/// The physical address of the beginning of the zone's allocatable memory.
+	begin: usize,
+	/// The size of the zone's allocatable memory in bytes.
+	size: usize,
+}
+
+/// A stack of free frames of a given order, taken from a zone in batches.
+#[derive(Clone, Copy)]
+struct Magazine {
+	/// The frames, as physical addresses.
+	frames: [*mut c_void; MAGAZINE_CAPACITY],
+	/// The number of frames in the magazine.
+	len: usize,
+}
+
+/// Statistics of the buddy allocator.
+#[derive(Clone, Copy, Debug, Default)]
+pub struct Stats {
+	/// The number of allocations served by a magazine.
+	pub magazine_hits: usize,
+	/// The number of allocations that required refilling a magazine.
+	pub magazine_misses: usize,
+	/// The number of times a full magazine has been drained to its zone.
+	pub magazine_drains: usize,
+	/// The number of allocations and frees done directly on a zone, without going through a
+	/// magazine.
+	pub zone_ops: usize,
+	/// The number of pages currently cached in magazines.
+	pub cached_pages: usize,
+}
+
+/// The magazines of a CPU, for each zone and order.
+struct CpuMagazines {
+	/// The magazines, by zone slot and order.
+	magazines: [[Magazine; (MAGAZINE_MAX_ORDER + 1) as usize]; ZONES_COUNT],
+
+	/// The statistics of the allocator.
+	stats: Stats,
+}
+
 /// The array of buddy allocator zones.
 static mut ZONES: MaybeUninit<[IntMutex<Zone>; ZONES_COUNT]> = MaybeUninit::uninit();
+/// Informations about the zones, by slot.
+static mut ZONES_INFO: [ZoneInfo; ZONES_COUNT] = [ZoneInfo {
+	type_: 0,
+	begin: 0,
+	size: 0,
+}; ZONES_COUNT];
+
+/// An empty magazine.
+const EMPTY_MAGAZINE: Magazine = Magazine {
+	frames: [core::ptr::null_mut(); MAGAZINE_CAPACITY],
+	len: 0,
+};
+/// The empty magazines of a zone.
+const EMPTY_ZONE_MAGAZINES: [Magazine; (MAGAZINE_MAX_ORDER + 1) as usize]
+	= [EMPTY_MAGAZINE; (MAGAZINE_MAX_ORDER + 1) as usize];
+
+/// The magazines of each CPU core, by core index. Allocations and frees of small frames go through
+/// the magazines so that the zones' locks are taken only once per batch.
+static MAGAZINES: [IntMutex<CpuMagazines>; smp::MAX_CORES] = {
+	const INIT: IntMutex<CpuMagazines> = IntMutex::new(CpuMagazines {
+		magazines: [EMPTY_ZONE_MAGAZINES; ZONES_COUNT],
+
+		stats: Stats {
+			magazine_hits: 0,
+			magazine_misses: 0,
+			magazine_drains: 0,
+			zone_ops: 0,
+			cached_pages: 0,
+		},
+	});
+	[INIT; smp::MAX_CORES]
+};
+
+/// Returns the magazines of the current CPU core.
+fn get_cpu_magazines() -> &'static IntMutex<CpuMagazines> {
+	&MAGAZINES[smp::get_core_id()]
+}
 
 /// Prepares the buddy allocator. Calling this function is required before setting the zone slots.
 ///
@@ -97,6 +194,13 @@ pub fn set_zone_slot(slot: usize, zone: Zone) {
 	};
 
 	debug_assert!(slot < z.len());
+	unsafe {
+		ZONES_INFO[slot] = ZoneInfo {
+			type_: zone.type_,
+			begin: zone.begin as _,
+			size: zone.get_size(),
+		};
+	}
 	z[slot] = IntMutex::new(zone);
 }
 
@@ -123,75 +227,148 @@ pub fn get_order(pages: usize) -> FrameOrder {
 	order
 }
 
-/// Returns a mutable reference to a zone suitable for an allocation with the given type `type_`.
-fn get_suitable_zone(type_: usize) -> Option<&'static mut IntMutex<Zone>> {
-	let zones = unsafe {
-		ZONES.assume_init_mut()
+/// Returns the zone at slot `slot`.
+fn get_zone(slot: usize) -> &'static IntMutex<Zone> {
+	unsafe {
+		&ZONES.assume_init_ref()[slot]
+	}
+}
+
+/// Returns the slot of a zone suitable for an allocation with the given type `type_`.
+fn get_suitable_zone_slot(type_: usize) -> Option<usize> {
+	let zones_info = unsafe {
+		&ZONES_INFO
 	};
 
-	#[allow(clippy::needless_range_loop)]
-	for i in 0..zones.len() {
-		let is_valid = {
-			let guard = zones[i].lock();
-			let zone = guard.get();
-			zone.type_ == type_ as _
-		};
-		if is_valid {
-			return Some(&mut zones[i]);
+	zones_info.iter().position(| info | info.type_ == type_ as _)
+}
+
+/// Returns the slot of the zone that contains the given pointer.
+fn get_zone_slot_for_pointer(ptr: *const c_void) -> Option<usize> {
+	let zones_info = unsafe {
+		&ZONES_INFO
+	};
+	let ptr = ptr as usize;
+
+	zones_info.iter().position(| info | ptr >= info.begin && ptr < info.begin + info.size)
+}
+
+/// Returns the capacity of a magazine of frames of order `order`.
+#[inline(always)]
+fn get_magazine_capacity(order: FrameOrder) -> usize {
+	MAGAZINE_CAPACITY >> order
+}
+
+impl Magazine {
+	/// Refills the magazine with frames of order `order` from the zone `zone`, until half the
+	/// capacity is reached or the zone is out of memory.
+	fn refill(&mut self, zone: &mut Zone, order: FrameOrder) {
+		let target = get_magazine_capacity(order) / 2;
+
+		while self.len < target {
+			if let Some(ptr) = zone.alloc_frame(order) {
+				self.frames[self.len] = ptr;
+				self.len += 1;
+			} else {
+				break;
+			}
+		}
+	}
+
+	/// Gives the frames of order `order` back to the zone `zone` until `len` frames remain in the
+	/// magazine. The oldest frames are given back first.
+	fn drain(&mut self, zone: &mut Zone, order: FrameOrder, len: usize) {
+		if len >= self.len {
+			return;
+		}
+
+		let count = self.len - len;
+		for ptr in &self.frames[..count] {
+			zone.free_frame(*ptr, order);
 		}
+
+		self.frames.copy_within(count..self.len, 0);
+		self.len = len;
 	}
-	None
 }
 
-/// Returns a mutable reference to the zone that contains the given pointer.
-fn get_zone_for_pointer(ptr: *const c_void) -> Option<&'static mut IntMutex<Zone>> {
-	let zones = unsafe {
-		ZONES.assume_init_mut()
-	};
+/// Allocates a frame of order `order` from the zone at slot `slot`, going through the magazine if
+/// the order is small enough.
+fn alloc_from_zone(slot: usize, order: FrameOrder) -> Option<*mut c_void> {
+	if order > MAGAZINE_MAX_ORDER {
+		get_cpu_magazines().lock().get_mut().stats.zone_ops += 1;
+		return get_zone(slot).lock().get_mut().alloc_frame(order);
+	}
 
-	#[allow(clippy::needless_range_loop)]
-	for i in 0..zones.len() {
-		let is_valid = {
-			let guard = zones[i].lock();
-			let zone = guard.get();
-			ptr >= zone.begin && (ptr as usize) < (zone.begin as usize) + zone.get_size()
-		};
-		if is_valid {
-			return Some(&mut zones[i]);
+	let mut guard = get_cpu_magazines().lock();
+	let cpu_magazines = guard.get_mut();
+	let magazine = &mut cpu_magazines.magazines[slot][order as usize];
+	let stats = &mut cpu_magazines.stats;
+
+	if magazine.len == 0 {
+		stats.magazine_misses += 1;
+
+		magazine.refill(get_zone(slot).lock().get_mut(), order);
+		if magazine.len == 0 {
+			return None;
+		}
+		stats.cached_pages += magazine.len << order;
+	} else {
+		stats.magazine_hits += 1;
+	}
+
+	magazine.len -= 1;
+	stats.cached_pages -= math::pow2(order as usize);
+	Some(magazine.frames[magazine.len])
+}
+
+/// Gives every frames cached in the magazines of every CPU cores back to their zone, allowing them
+/// to be coalesced.
+fn drain_magazines() {
+	for cpu_magazines in MAGAZINES.iter() {
+		let mut guard = cpu_magazines.lock();
+		let cpu_magazines = guard.get_mut();
+
+		for (slot, zone_magazines) in cpu_magazines.magazines.iter_mut().enumerate() {
+			let mut zone_guard = get_zone(slot).lock();
+			let zone = zone_guard.get_mut();
+
+			for (order, magazine) in zone_magazines.iter_mut().enumerate() {
+				if magazine.len > 0 {
+					cpu_magazines.stats.cached_pages -= magazine.len << order;
+					cpu_magazines.stats.magazine_drains += 1;
+					magazine.drain(zone, order as _, 0);
+				}
+			}
 		}
 	}
-	None
 }
 
 /// Allocates a frame of memory using the buddy allocator. `order` is the order of the frame to be
 /// allocated. The given frame shall fit the flags `flags`. If no suitable frame is found, the
 /// function returns an Err.
+///
+/// Frames of order up to `MAGAZINE_MAX_ORDER` are taken from the CPU's magazines, which are
+/// refilled in batches.
 pub fn alloc(order: FrameOrder, flags: Flags) -> Result<*mut c_void, Errno> {
 	debug_assert!(order <= MAX_ORDER);
 
 	let begin_zone = (flags & ZONE_TYPE_MASK) as usize;
-	for i in begin_zone..ZONES_COUNT {
-		let z = get_suitable_zone(i);
-
-		if let Some(z) = z {
-			let mut guard = z.lock();
-			let zone = guard.get_mut();
-
-			let frame = zone.get_available_frame(order);
-			if let Some(f) = frame {
-				f.split(zone, order);
-				f.mark_used();
-				zone.allocated_pages += math::pow2(order as usize);
-
-				let ptr = f.get_ptr(zone);
-				debug_assert!(util::is_aligned(ptr, memory::PAGE_SIZE));
-				debug_assert!(ptr >= zone.begin
-					&& ptr < (zone.begin as usize + zone.get_size()) as _);
-				return Ok(ptr);
-			}
-		}
-	}
-	Err(errno!(ENOMEM))
+	let try_alloc = || {
+		(begin_zone..ZONES_COUNT)
+			.filter_map(get_suitable_zone_slot)
+			.find_map(| slot | alloc_from_zone(slot, order))
+	};
+
+	let ptr = try_alloc().or_else(|| {
+		// The frames cached in magazines might be coalesced into a suitable frame
+		drain_magazines();
+		try_alloc()
+	}).ok_or_else(|| errno!(ENOMEM))?;
+
+	debug_assert!(util::is_aligned(ptr, memory::PAGE_SIZE));
+	trace::record(EventType::BuddyAlloc, ptr as _, order as _);
+	Ok(ptr)
 }
 
 /// Calls `alloc` with order `order`. The allocated frame is in the kernel zone.
@@ -206,22 +383,37 @@ pub fn alloc_kernel(order: FrameOrder) -> Result<*mut c_void, Errno> {
 
 /// Frees the given memory frame that was allocated using the buddy allocator. The given order must
 /// be the same as the one given to allocate the frame.
+///
+/// Frames of order up to `MAGAZINE_MAX_ORDER` are put in the CPU's magazines. When a magazine is
+/// full, half of it is given back to the zone.
 pub fn free(ptr: *const c_void, order: FrameOrder) {
 	debug_assert!(util::is_aligned(ptr, memory::PAGE_SIZE));
 	debug_assert!(order <= MAX_ORDER);
+	trace::record(EventType::BuddyFree, ptr as _, order as _);
 
-	let z = get_zone_for_pointer(ptr).unwrap();
-	let mut guard = z.lock();
-	let zone = guard.get_mut();
+	let slot = get_zone_slot_for_pointer(ptr).unwrap();
+	if order > MAGAZINE_MAX_ORDER {
+		get_cpu_magazines().lock().get_mut().stats.zone_ops += 1;
+		get_zone(slot).lock().get_mut().free_frame(ptr, order);
+		return;
+	}
 
-	let frame_id = zone.get_frame_id_from_ptr(ptr);
-	debug_assert!(frame_id < zone.get_pages_count());
-	let frame = zone.get_frame(frame_id);
-	unsafe {
-		(*frame).mark_free(zone);
-		(*frame).coalesce(zone);
+	let mut guard = get_cpu_magazines().lock();
+	let cpu_magazines = guard.get_mut();
+	let magazine = &mut cpu_magazines.magazines[slot][order as usize];
+	let stats = &mut cpu_magazines.stats;
+
+	let capacity = get_magazine_capacity(order);
+	if magazine.len >= capacity {
+		stats.magazine_drains += 1;
+		stats.cached_pages -= (capacity / 2) << order;
+
+		magazine.drain(get_zone(slot).lock().get_mut(), order, capacity / 2);
 	}
-	zone.allocated_pages -= math::pow2(order as usize);
+
+	magazine.frames[magazine.len] = ptr as _;
+	magazine.len += 1;
+	stats.cached_pages += math::pow2(order as usize);
 }
 
 /// Frees the given memory frame. `ptr` is the *virtual* address to the beginning of the frame and
@@ -230,19 +422,50 @@ pub fn free_kernel(ptr: *const c_void, order: FrameOrder) {
 	free(memory::kern_to_phys(ptr), order);
 }
 
+/// Splits the allocated frame of order `order` at physical address `ptr` into frames of order
+/// `0`. Each page of the frame can then be freed independently with an order of `0`.
+pub fn split_frame(ptr: *const c_void, order: FrameOrder) {
+	debug_assert!(util::is_aligned(ptr, memory::PAGE_SIZE));
+	debug_assert!(order <= MAX_ORDER);
+
+	let slot = get_zone_slot_for_pointer(ptr).unwrap();
+	let guard = get_zone(slot).lock();
+	let zone = guard.get();
+
+	let id = zone.get_frame_id_from_ptr(ptr);
+	for i in 0..(math::pow2(order as usize) as FrameID) {
+		let frame = unsafe {
+			&mut *zone.get_frame(id + i)
+		};
+		frame.order = 0;
+		frame.mark_used();
+	}
+}
+
 /// Returns the total number of pages allocated by the buddy allocator.
+/// Pages cached in magazines are not considered allocated.
 pub fn allocated_pages_count() -> usize {
 	let mut n = 0;
 
-	let z = unsafe {
-		ZONES.assume_init_mut()
-	};
-	#[allow(clippy::needless_range_loop)]
-	for i in 0..z.len() {
-		let guard = z[i].lock();
-		n += guard.get().get_allocated_pages();
+	for slot in 0..ZONES_COUNT {
+		n += get_zone(slot).lock().get().get_allocated_pages();
 	}
-	n
+	n - get_stats().cached_pages
+}
+
+/// Returns the statistics of the buddy allocator, summed over every CPU cores.
+pub fn get_stats() -> Stats {
+	MAGAZINES.iter().fold(Stats::default(), | total, cpu_magazines | {
+		let stats = cpu_magazines.lock().get().stats;
+
+		Stats {
+			magazine_hits: total.magazine_hits + stats.magazine_hits,
+			magazine_misses: total.magazine_misses + stats.magazine_misses,
+			magazine_drains: total.magazine_drains + stats.magazine_drains,
+			zone_ops: total.zone_ops + stats.zone_ops,
+			cached_pages: total.cached_pages + stats.cached_pages,
+		}
+	})
 }
 
 impl Zone {
@@ -309,6 +532,33 @@ impl Zone {
 		(self.pages_count as usize) * memory::PAGE_SIZE
 	}
 
+	/// Allocates a frame of order `order` in the zone. If no frame is available, the function
+	/// returns None.
+	/// The function returns the physical address of the frame.
+	fn alloc_frame(&mut self, order: FrameOrder) -> Option<*mut c_void> {
+		let frame = self.get_available_frame(order)?;
+		frame.split(self, order);
+		frame.mark_used();
+		self.allocated_pages += math::pow2(order as usize);
+
+		let ptr = frame.get_ptr(self);
+		debug_assert!(util::is_aligned(ptr, memory::PAGE_SIZE));
+		debug_assert!(ptr >= self.begin && ptr < (self.begin as usize + self.get_size()) as _);
+		Some(ptr)
+	}
+
+	/// Frees the frame of order `order` at physical address `ptr` in the zone.
+	fn free_frame(&mut self, ptr: *const c_void, order: FrameOrder) {
+		let frame_id = self.get_frame_id_from_ptr(ptr);
+		debug_assert!(frame_id < self.get_pages_count());
+		let frame = self.get_frame(frame_id);
+		unsafe {
+			(*frame).mark_free(self);
+			(*frame).coalesce(self);
+		}
+		self.allocated_pages -= math::pow2(order as usize);
+	}
+
 	/// Returns an available frame owned by this zone, with an order of at least `order`.
 	fn get_available_frame(&self, order: FrameOrder) -> Option<&'static mut Frame> {
 		for i in (order as usize)..self.free_list.len() {
@@ -681,6 +931,43 @@ mod test {
 		debug_assert_eq!(allocated_pages_count(), alloc_pages);
 	}
 
+	#[test_case]
+	fn buddy_magazine() {
+		let alloc_pages = allocated_pages_count();
+
+		// Ensures the magazine is not empty
+		let p = alloc_kernel(0).unwrap();
+		free_kernel(p, 0);
+
+		let hits = get_stats().magazine_hits;
+		let p = alloc_kernel(0).unwrap();
+		assert_eq!(get_stats().magazine_hits, hits + 1);
+		free_kernel(p, 0);
+
+		debug_assert_eq!(allocated_pages_count(), alloc_pages);
+	}
+
+	#[test_case]
+	fn buddy_orders() {
+		let alloc_pages = allocated_pages_count();
+
+		let mut frames: [*mut c_void; 100] = [null::<c_void>() as _; 100];
+		for order in 0..=(MAGAZINE_MAX_ORDER + 1) {
+			for f in frames.iter_mut() {
+				*f = alloc_kernel(order).unwrap();
+				unsafe {
+					util::memset(*f, -1, get_frame_size(order));
+				}
+			}
+			assert_eq!(allocated_pages_count(), alloc_pages + (frames.len() << order));
+
+			for f in frames.iter() {
+				free_kernel(*f, order);
+			}
+			assert_eq!(allocated_pages_count(), alloc_pages);
+		}
+	}
+
 	fn get_dangling(order: FrameOrder) -> *mut c_void {
 		if let Ok(p) = alloc_kernel(order) {
 			unsafe {
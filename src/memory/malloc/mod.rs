@@ -40,8 +40,12 @@ pub fn init() {
 /// Allocated pointer must always be freed. Failure to do so results in a memory leak.
 /// Writing outside of the allocated range (buffer overflow) results in an undefined behaviour.
 pub unsafe fn alloc(n: usize) -> Result<*mut c_void, Errno> {
-	let _ = MUTEX.lock();
+	let _guard = MUTEX.lock();
+	alloc_(n)
+}
 
+/// Same as `alloc`, but without locking the allocator's mutex, which must be held by the caller.
+unsafe fn alloc_(n: usize) -> Result<*mut c_void, Errno> {
 	if n == 0 {
 		return Err(errno!(EINVAL));
 	}
@@ -68,7 +72,7 @@ pub unsafe fn alloc(n: usize) -> Result<*mut c_void, Errno> {
 ///
 /// The pointer `ptr` **must** point to the beginning of a valid, used chunk of memory.
 pub unsafe fn get_size(ptr: *const c_void) -> usize {
-	let _ = MUTEX.lock();
+	let _guard = MUTEX.lock();
 
 	let chunk = Chunk::from_ptr(ptr as *mut _);
 	#[cfg(config_debug_malloc_check)]
@@ -82,7 +86,7 @@ pub unsafe fn get_size(ptr: *const c_void) -> usize {
 /// `n` is the new size of the chunk of memory.
 /// If the reallocation fails, the chunk is left untouched and the function returns an error.
 pub unsafe fn realloc(ptr: *mut c_void, n: usize) -> Result<*mut c_void, Errno> {
-	let _ = MUTEX.lock();
+	let _guard = MUTEX.lock();
 
 	if n == 0 {
 		return Err(errno!(EINVAL));
@@ -102,9 +106,9 @@ pub unsafe fn realloc(ptr: *mut c_void, n: usize) -> Result<*mut c_void, Errno>
 
 		Ordering::Greater => {
 			if !chunk.grow(n - chunk_size) {
-				let new_ptr = alloc(n)?;
+				let new_ptr = alloc_(n)?;
 				util::memcpy(new_ptr, ptr, min(chunk.get_size(), n));
-				free(ptr);
+				free_(ptr);
 				Ok(new_ptr)
 			} else {
 				Ok(ptr)
@@ -125,8 +129,12 @@ pub unsafe fn realloc(ptr: *mut c_void, n: usize) -> Result<*mut c_void, Errno>
 /// behaviour is undefined.
 /// Using memory after it was freed causes an undefined behaviour.
 pub unsafe fn free(ptr: *mut c_void) {
-	let _ = MUTEX.lock();
+	let _guard = MUTEX.lock();
+	free_(ptr);
+}
 
+/// Same as `free`, but without locking the allocator's mutex, which must be held by the caller.
+unsafe fn free_(ptr: *mut c_void) {
 	let chunk = Chunk::from_ptr(ptr);
 	#[cfg(config_debug_malloc_check)]
 	chunk.check();
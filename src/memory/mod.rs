@@ -12,6 +12,7 @@ pub mod buddy;
 pub mod malloc;
 pub mod memmap;
 pub mod mmio;
+pub mod slab;
 pub mod stack;
 pub mod vmem;
 
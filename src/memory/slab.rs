@@ -0,0 +1,502 @@
+//! This module implements the slab allocator, which allocates fixed-size objects.
+//!
+//! A cache allocates objects of a single size. Objects are stored in slabs, which are pages
+//! allocated with the buddy allocator. Each slab begins with a header, followed by the objects.
+//! Free objects of a slab are linked together in a free list, so allocating or freeing an object
+//! doesn't require any splitting or coalescing.
+//!
+//! Each cache keeps, for each CPU core, with a lock for each core:
+//! - The CPU slab, from which objects are allocated first
+//! - A list of partial slabs, which have both used and free objects
+//! - At most one empty slab, to avoid freeing and allocating a page back and forth
+//!
+//! A slab belongs to the core that allocated it. Objects are allocated from the slabs of the
+//! current core, so that cores don't contend on the same lock. An object freed by another core is
+//! put back in the slab it comes from, under the lock of the slab's core.
+//!
+//! Full slabs are not referenced by the cache. Since slabs are pages, the slab of an object is
+//! found by aligning down the object's address.
+//!
+//! Objects of types that are known only at compile time, such as the inner structure of
+//! `SharedPtr` or the nodes of `Map`, cannot have a cache for each type. Instead, they are
+//! allocated from caches for a set of sizes with `alloc` and `free`.
+//!
+//! The statistics of each cache are given by the file `slabinfo` of the procfs.
+
+use core::cell::UnsafeCell;
+use core::ffi::c_void;
+use core::mem::size_of;
+use core::ptr::NonNull;
+use core::ptr::null_mut;
+use core::sync::atomic::AtomicBool;
+use core::sync::atomic::Ordering;
+use crate::cpu::smp;
+use crate::errno::Errno;
+use crate::memory::buddy;
+use crate::memory::malloc;
+use crate::memory;
+use crate::util::lock::IntMutex;
+use crate::util;
+
+/// The size of a slab's header in bytes. Objects begin right after it.
+const SLAB_HEADER_SIZE: usize = 32;
+/// The alignment of objects in bytes.
+pub const OBJECT_ALIGN: usize = 16;
+
+/// The sizes of objects allocated by the size caches, in increasing order. Each size is a multiple
+/// of `OBJECT_ALIGN`. The largest sizes are chosen so that three and two objects fit in a slab.
+const SIZES: [usize; 14] = [
+	16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1344, 2032
+];
+
+/// The header of a slab.
+#[repr(C)]
+struct Slab {
+	/// The previous slab in the list of partial slabs.
+	prev: *mut Slab,
+	/// The next slab in the list of partial slabs.
+	next: *mut Slab,
+	/// The first free object of the slab.
+	free: *mut FreeObject,
+	/// The number of used objects in the slab.
+	used: usize,
+	/// The index of the core the slab belongs to. Set once when the slab is allocated.
+	core: usize,
+}
+
+/// A free object, linked to the other free objects of its slab.
+struct FreeObject {
+	/// The next free object in the slab.
+	next: *mut FreeObject,
+}
+
+/// Statistics of a cache.
+#[derive(Clone, Copy, Debug, Default)]
+pub struct CacheStats {
+	/// The number of objects currently in use.
+	pub objects: usize,
+	/// The number of slabs currently held by the cache.
+	pub slabs: usize,
+	/// The total number of allocations.
+	pub allocs: usize,
+	/// The total number of frees.
+	pub frees: usize,
+}
+
+/// The mutable state of a cache for a CPU core.
+struct CacheState {
+	/// The slab objects are allocated from first.
+	cpu_slab: *mut Slab,
+	/// The list of partial slabs.
+	partial: *mut Slab,
+	/// An empty slab kept to be reused.
+	empty: *mut Slab,
+
+	/// The statistics of the slabs of the core.
+	stats: CacheStats,
+}
+
+/// The state of a cache for a core before its first allocation.
+const EMPTY_STATE: IntMutex<CacheState> = IntMutex::new(CacheState {
+	cpu_slab: null_mut(),
+	partial: null_mut(),
+	empty: null_mut(),
+
+	stats: CacheStats {
+		objects: 0,
+		slabs: 0,
+		allocs: 0,
+		frees: 0,
+	},
+});
+
+/// A cache allocating objects of a given size.
+pub struct Cache {
+	/// The name of the cache.
+	name: &'static str,
+	/// The size of an object in bytes.
+	size: usize,
+
+	/// The state of the cache for each core, by core index.
+	cores: [IntMutex<CacheState>; smp::MAX_CORES],
+
+	/// Tells whether the cache has been added to the list of caches.
+	registered: AtomicBool,
+	/// The next cache in the list of caches. Set once when the cache is registered.
+	next: UnsafeCell<Option<&'static Cache>>,
+}
+
+// Safe because states are protected by mutexes and `next` is written only once, while holding the
+// lock of the list of caches
+unsafe impl Sync for Cache {}
+
+/// The list of caches that have been used at least once.
+static CACHES: IntMutex<Option<&'static Cache>> = IntMutex::new(None);
+
+impl Slab {
+	/// Returns the slab containing the object at `ptr`.
+	fn from_object(ptr: *const c_void) -> *mut Self {
+		util::down_align(ptr, memory::PAGE_SIZE) as _
+	}
+}
+
+impl Cache {
+	/// Creates a new cache with the given name `name` for objects of size `size` in bytes.
+	pub const fn new(name: &'static str, size: usize) -> Self {
+		assert!(size >= size_of::<FreeObject>());
+		assert!(size <= memory::PAGE_SIZE - SLAB_HEADER_SIZE);
+
+		Self {
+			name,
+			// Rounding up to keep objects aligned
+			size: (size + OBJECT_ALIGN - 1) & !(OBJECT_ALIGN - 1),
+
+			cores: [EMPTY_STATE; smp::MAX_CORES],
+
+			registered: AtomicBool::new(false),
+			next: UnsafeCell::new(None),
+		}
+	}
+
+	/// Returns the name of the cache.
+	pub fn get_name(&self) -> &'static str {
+		self.name
+	}
+
+	/// Returns the size of an object in bytes.
+	pub fn get_size(&self) -> usize {
+		self.size
+	}
+
+	/// Returns the number of objects in a slab.
+	fn get_objects_per_slab(&self) -> usize {
+		(memory::PAGE_SIZE - SLAB_HEADER_SIZE) / self.size
+	}
+
+	/// Returns the statistics of the cache, summed over every cores.
+	pub fn get_stats(&self) -> CacheStats {
+		self.cores.iter()
+			.map(| state | state.lock().get().stats)
+			.fold(CacheStats::default(), | acc, stats | CacheStats {
+				objects: acc.objects + stats.objects,
+				slabs: acc.slabs + stats.slabs,
+				allocs: acc.allocs + stats.allocs,
+				frees: acc.frees + stats.frees,
+			})
+	}
+
+	/// Adds the cache to the list of caches if not already done.
+	fn register(&'static self) {
+		let mut guard = CACHES.lock();
+		if self.registered.swap(true, Ordering::AcqRel) {
+			return;
+		}
+
+		let head = guard.get_mut();
+		unsafe {
+			*self.next.get() = *head;
+		}
+		*head = Some(self);
+	}
+
+	/// Allocates a new slab for the core with index `core` and fills its free list.
+	fn alloc_slab(&self, core: usize) -> Result<*mut Slab, Errno> {
+		let slab = buddy::alloc_kernel(0)? as *mut Slab;
+		let objects_begin = slab as usize + SLAB_HEADER_SIZE;
+
+		let mut free = null_mut();
+		for i in (0..self.get_objects_per_slab()).rev() {
+			let obj = (objects_begin + i * self.size) as *mut FreeObject;
+			unsafe {
+				(*obj).next = free;
+			}
+			free = obj;
+		}
+
+		unsafe {
+			slab.write(Slab {
+				prev: null_mut(),
+				next: null_mut(),
+				free,
+				used: 0,
+				core,
+			});
+		}
+		Ok(slab)
+	}
+
+	/// Removes the slab `slab` from the list of partial slabs of the state `state`.
+	unsafe fn unlink_partial(state: &mut CacheState, slab: *mut Slab) {
+		if (*slab).prev.is_null() {
+			state.partial = (*slab).next;
+		} else {
+			(*(*slab).prev).next = (*slab).next;
+		}
+		if !(*slab).next.is_null() {
+			(*(*slab).next).prev = (*slab).prev;
+		}
+
+		(*slab).prev = null_mut();
+		(*slab).next = null_mut();
+	}
+
+	/// Inserts the slab `slab` in the list of partial slabs of the state `state`.
+	unsafe fn link_partial(state: &mut CacheState, slab: *mut Slab) {
+		(*slab).prev = null_mut();
+		(*slab).next = state.partial;
+		if !state.partial.is_null() {
+			(*state.partial).prev = slab;
+		}
+		state.partial = slab;
+	}
+
+	/// Allocates an object from the slabs of the current core. The content of the object is
+	/// undefined.
+	/// If the allocation fails, the function returns an error.
+	pub fn alloc(&'static self) -> Result<NonNull<c_void>, Errno> {
+		if !self.registered.load(Ordering::Acquire) {
+			self.register();
+		}
+
+		// The process may move to another core before locking, which doesn't matter since a core
+		// can allocate from the slabs of any core
+		let core = smp::get_core_id();
+		let mut guard = self.cores[core].lock();
+		let state = guard.get_mut();
+
+		unsafe {
+			if state.cpu_slab.is_null() || (*state.cpu_slab).free.is_null() {
+				// The CPU slab is full. It remains referenced only by its objects
+				state.cpu_slab = if !state.partial.is_null() {
+					let slab = state.partial;
+					Self::unlink_partial(state, slab);
+					slab
+				} else if !state.empty.is_null() {
+					let slab = state.empty;
+					state.empty = null_mut();
+					slab
+				} else {
+					let slab = self.alloc_slab(core)?;
+					state.stats.slabs += 1;
+					slab
+				};
+			}
+
+			let slab = state.cpu_slab;
+			let obj = (*slab).free;
+			(*slab).free = (*obj).next;
+			(*slab).used += 1;
+
+			state.stats.objects += 1;
+			state.stats.allocs += 1;
+			Ok(NonNull::new_unchecked(obj as _))
+		}
+	}
+
+	/// Frees the object at `ptr`.
+	///
+	/// # Safety
+	///
+	/// The object must have been allocated with this cache and must not be used after this call.
+	pub unsafe fn free(&self, ptr: *mut c_void) {
+		let slab = Slab::from_object(ptr);
+
+		// The core of a slab never changes, thus it can be read before locking
+		let mut guard = self.cores[(*slab).core].lock();
+		let state = guard.get_mut();
+
+		let was_full = (*slab).free.is_null();
+
+		let obj = ptr as *mut FreeObject;
+		(*obj).next = (*slab).free;
+		(*slab).free = obj;
+		(*slab).used -= 1;
+
+		state.stats.objects -= 1;
+		state.stats.frees += 1;
+
+		if slab == state.cpu_slab {
+			return;
+		}
+
+		if (*slab).used == 0 {
+			if !was_full {
+				Self::unlink_partial(state, slab);
+			}
+
+			if state.empty.is_null() {
+				state.empty = slab;
+			} else {
+				buddy::free_kernel(slab as _, 0);
+				state.stats.slabs -= 1;
+			}
+		} else if was_full {
+			Self::link_partial(state, slab);
+		}
+	}
+}
+
+/// Declares the caches for each size in `SIZES`.
+macro_rules! size_caches {
+	($($size:literal),*) => {
+		[$(Cache::new(concat!("size-", stringify!($size)), $size)),*]
+	}
+}
+
+/// The caches for each size in `SIZES`.
+static SIZE_CACHES: [Cache; SIZES.len()] = size_caches!(
+	16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1344, 2032
+);
+
+/// Returns the size cache to be used for objects of size `size`. If the size is too large for
+/// every cache, the function returns None.
+fn get_size_cache(size: usize) -> Option<&'static Cache> {
+	SIZES.iter()
+		.position(| s | *s >= size)
+		.map(| i | &SIZE_CACHES[i])
+}
+
+/// Allocates an object of size `size` in bytes and alignment `align`.
+/// If no size cache is suitable, the object is allocated with `malloc`.
+/// If the allocation fails, the function returns an error.
+///
+/// # Safety
+///
+/// The object must be freed with `free`, with the same size and alignment.
+pub unsafe fn alloc(size: usize, align: usize) -> Result<NonNull<c_void>, Errno> {
+	match get_size_cache(size) {
+		Some(cache) if align <= OBJECT_ALIGN => cache.alloc(),
+		_ => Ok(NonNull::new_unchecked(malloc::alloc(size)?)),
+	}
+}
+
+/// Frees the object at `ptr`, which has size `size` in bytes and alignment `align`.
+///
+/// # Safety
+///
+/// The object must have been allocated with `alloc`, with the same size and alignment.
+pub unsafe fn free(ptr: *mut c_void, size: usize, align: usize) {
+	match get_size_cache(size) {
+		Some(cache) if align <= OBJECT_ALIGN => cache.free(ptr),
+		_ => malloc::free(ptr),
+	}
+}
+
+/// Calls `f` for each cache that has been used at least once, with its name, the size of an
+/// object in bytes and its statistics.
+pub fn foreach_stats<F: FnMut(&'static str, usize, CacheStats)>(mut f: F) {
+	let mut cache = *CACHES.lock().get();
+	while let Some(c) = cache {
+		f(c.get_name(), c.get_size(), c.get_stats());
+
+		cache = unsafe {
+			*c.next.get()
+		};
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	/// Object used to test caches.
+	struct TestObject {
+		/// Some data.
+		data: [u32; 10],
+	}
+
+	/// Cache used for tests.
+	static TEST_CACHE: Cache = Cache::new("test", size_of::<TestObject>());
+
+	/// Allocates an object from the test cache and fills it with `val`.
+	fn alloc_test(val: u32) -> NonNull<TestObject> {
+		let ptr = TEST_CACHE.alloc().unwrap().as_ptr() as *mut TestObject;
+		unsafe {
+			ptr.write(TestObject {
+				data: [val; 10],
+			});
+			NonNull::new_unchecked(ptr)
+		}
+	}
+
+	#[test_case]
+	fn slab_alloc_free() {
+		let stats = TEST_CACHE.get_stats();
+
+		let obj = alloc_test(42);
+		assert!(util::is_aligned(obj.as_ptr(), OBJECT_ALIGN));
+		assert_eq!(unsafe { obj.as_ref() }.data, [42; 10]);
+		// The slab belongs to the core that allocated it
+		assert_eq!(unsafe { (*Slab::from_object(obj.as_ptr() as _)).core }, smp::get_core_id());
+		unsafe {
+			TEST_CACHE.free(obj.as_ptr() as _);
+		}
+
+		let new_stats = TEST_CACHE.get_stats();
+		assert_eq!(new_stats.objects, stats.objects);
+		assert_eq!(new_stats.allocs, stats.allocs + 1);
+		assert_eq!(new_stats.frees, stats.frees + 1);
+	}
+
+	#[test_case]
+	fn slab_many() {
+		let pages = buddy::allocated_pages_count();
+
+		// Enough objects to span several slabs
+		let mut objs: [Option<NonNull<TestObject>>; 500] = [None; 500];
+		for (i, o) in objs.iter_mut().enumerate() {
+			*o = Some(alloc_test(i as _));
+		}
+		for (i, o) in objs.iter().enumerate() {
+			assert_eq!(unsafe { o.unwrap().as_ref() }.data, [i as _; 10]);
+		}
+
+		// Freeing every other object first to have partial slabs
+		for o in objs.iter_mut().step_by(2) {
+			unsafe {
+				TEST_CACHE.free(o.take().unwrap().as_ptr() as _);
+			}
+		}
+		for o in objs.iter_mut() {
+			if let Some(o) = o.take() {
+				unsafe {
+					TEST_CACHE.free(o.as_ptr() as _);
+				}
+			}
+		}
+
+		assert_eq!(TEST_CACHE.get_stats().objects, 0);
+		// At most the CPU slab and an empty slab remain
+		assert!(buddy::allocated_pages_count() <= pages + 2);
+	}
+
+	#[test_case]
+	fn slab_sizes() {
+		for size in [1, 16, 17, 100, 1000, 2032, 2033, 8000] {
+			unsafe {
+				let ptr = alloc(size, 8).unwrap();
+				util::memset(ptr.as_ptr(), -1, size);
+				free(ptr.as_ptr(), size, 8);
+			}
+		}
+	}
+
+	#[test_case]
+	fn slab_stats0() {
+		let obj = alloc_test(0);
+
+		let mut found = false;
+		foreach_stats(| name, size, stats | {
+			if name == "test" {
+				assert_eq!(size, TEST_CACHE.get_size());
+				assert!(stats.objects >= 1);
+				found = true;
+			}
+		});
+		assert!(found);
+
+		unsafe {
+			TEST_CACHE.free(obj.as_ptr() as _);
+		}
+	}
+}
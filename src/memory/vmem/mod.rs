@@ -3,6 +3,7 @@
 
 // TODO Make this file fully cross-platform
 
+pub mod tlb;
 #[cfg(config_general_arch = "x86")]
 pub mod x86;
 
@@ -50,6 +51,17 @@ pub trait VMem: FailableClone {
 	/// This function automaticaly invalidates the page(s) in the cache.
 	fn unmap_range(&mut self, virtaddr: *const c_void, pages: usize) -> Result<(), Errno>;
 
+	/// Tells whether the page table holding the mapping of the virtual address `ptr` is shared
+	/// with other contexts. The physical pages of a shared table are referenced once by the table
+	/// itself, no matter how many contexts share it.
+	fn is_shared(&self, ptr: *const c_void) -> bool;
+	/// Makes the page table holding the mapping of the virtual address `ptr` private to the
+	/// context, copying it if it is shared with other contexts.
+	fn unshare(&mut self, ptr: *const c_void) -> Result<(), Errno>;
+	/// Removes the context's references to the page tables it shares with other contexts. The
+	/// pages mapped by those tables are not mapped in the context anymore.
+	fn release_shared(&mut self);
+
 	/// Binds the virtual memory context handler.
 	fn bind(&self);
 	/// Tells whether the handler is bound or not.
@@ -98,6 +110,7 @@ pub fn new() -> Result::<Box::<dyn VMem>, Errno> {
 }
 
 /// Clones the virtual memory context handler `vmem`.
+/// The tables of the userspace are shared by both contexts until one of them modifies them.
 pub fn clone(vmem: &Box::<dyn VMem>) -> Result::<Box::<dyn VMem>, Errno> {
 	let vmem = unsafe {
 		&*(vmem.as_ptr() as *const x86::X86VMem)
@@ -174,6 +187,7 @@ pub unsafe fn switch<F: FnOnce() -> T, T>(vmem: &dyn VMem, f: F) -> T {
 
 			// Restoring the previous vmem
 			x86::paging_enable(cr3 as _);
+			tlb::set_current_page_dir(cr3 as _);
 
 			result
 		}
@@ -0,0 +1,111 @@
+//! When a mapping is modified, the Translation Lookaside Buffer (TLB) of each core that might have
+//! cached it must be invalidated. A core can only invalidate its own TLB, so it has to ask the
+//! other cores to do it by sending them an IPI. This is called a TLB shootdown.
+//!
+//! Only one shootdown can be issued at a time. The issuing core waits until every targeted core
+//! has served the request. Since a targeted core might be spinning on a lock held by the issuing
+//! core with interrupts disabled, spinlocks serve pending requests while waiting (see `serve`).
+
+use core::ffi::c_void;
+use core::mem::ManuallyDrop;
+use core::sync::atomic::AtomicU32;
+use core::sync::atomic::AtomicUsize;
+use core::sync::atomic::Ordering;
+use crate::cpu::smp;
+use crate::errno::Errno;
+use crate::event::InterruptResult;
+use crate::event::InterruptResultAction;
+use crate::event;
+use crate::idt;
+use crate::memory;
+use crate::memory::vmem::x86;
+use crate::process::regs::Regs;
+use crate::util::lock::IntMutex;
+
+/// The value of `REQUEST_ADDR` telling that the whole TLB must be invalidated.
+const FULL_FLUSH: usize = usize::MAX;
+
+/// The physical address of the page directory bound on each core, by core index.
+static CURRENT_PAGE_DIRS: [AtomicUsize; smp::MAX_CORES] = {
+	const INIT: AtomicUsize = AtomicUsize::new(0);
+	[INIT; smp::MAX_CORES]
+};
+
+/// Lock held by the core issuing a shootdown.
+static LOCK: IntMutex<()> = IntMutex::new(());
+/// The address of the page to invalidate for the current request, or `FULL_FLUSH`.
+static REQUEST_ADDR: AtomicUsize = AtomicUsize::new(0);
+/// Bitmask of cores that have not served the current request yet.
+static PENDING: AtomicU32 = AtomicU32::new(0);
+
+/// Registers the handler of the shootdown IPI. This function must be called before starting the
+/// other cores.
+pub fn init() -> Result<(), Errno> {
+	let callback = | _id: u32, _code: u32, _regs: &mut Regs, _ring: u32 | {
+		serve();
+		InterruptResult::new(false, InterruptResultAction::Resume)
+	};
+	let _ = ManuallyDrop::new(event::register_callback(idt::TLB_SHOOTDOWN_IPI, 0, callback)?);
+
+	Ok(())
+}
+
+/// Records that the page directory at physical address `page_dir` is bound on the current core.
+pub fn set_current_page_dir(page_dir: *const c_void) {
+	CURRENT_PAGE_DIRS[smp::get_core_id()].store(page_dir as _, Ordering::Release);
+}
+
+/// Serves the pending shootdown request for the current core, if any.
+pub fn serve() {
+	let bit = 1 << smp::get_core_id();
+	if PENDING.load(Ordering::Acquire) & bit == 0 {
+		return;
+	}
+
+	let addr = REQUEST_ADDR.load(Ordering::Acquire);
+	idt::wrap_disable_interrupts(|| unsafe {
+		if addr == FULL_FLUSH {
+			x86::tlb_reload();
+		} else {
+			x86::invlpg(addr as _);
+		}
+	});
+
+	PENDING.fetch_and(!bit, Ordering::AcqRel);
+}
+
+/// Invalidates the TLB entries of the page directory at physical address `page_dir` on the other
+/// cores.
+/// If `addr` is not None, only the page at this address is invalidated. Else, the whole TLB is.
+///
+/// Kernel space being shared by every page directories, invalidating a kernel page targets every
+/// cores. Else, only the cores on which the page directory is bound are targeted.
+pub fn shootdown(page_dir: *const c_void, addr: Option<*const c_void>) {
+	if !smp::is_multicore() {
+		return;
+	}
+
+	let kernel = matches!(addr, Some(addr) if addr >= memory::PROCESS_END);
+	let curr = smp::get_core_id();
+	let targets = (0..smp::cores_count())
+		.filter(| c | *c != curr)
+		.filter(| c | smp::get_online_mask() & (1 << c) != 0)
+		.filter(| c | {
+			kernel || CURRENT_PAGE_DIRS[*c].load(Ordering::Acquire) == page_dir as usize
+		})
+		.fold(0, | mask, c | mask | (1 << c));
+	if targets == 0 {
+		return;
+	}
+
+	let _guard = LOCK.lock();
+	REQUEST_ADDR.store(addr.map(| a | a as usize).unwrap_or(FULL_FLUSH), Ordering::Release);
+	PENDING.store(targets, Ordering::Release);
+
+	for c in (0..smp::cores_count()).filter(| c | targets & (1 << c) != 0) {
+		smp::send_ipi(c, idt::TLB_SHOOTDOWN_IPI as _);
+	}
+	while PENDING.load(Ordering::Acquire) != 0 {
+		core::hint::spin_loop();
+	}
+}
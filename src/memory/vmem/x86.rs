@@ -16,6 +16,16 @@
 //! the element can be freed.
 //!
 //! The Page Size Extension (PSE) allows to map 4MB large blocks without using a page table.
+//!
+//! The entries of the page directory for the kernel space are the same in every contexts. When
+//! one of them changes, for example when a large block of the kernel space is split into a page
+//! table, the change is applied to every existing contexts.
+//!
+//! When a context is cloned (on fork), the page tables of the userspace are not copied but shared
+//! between both contexts and made read-only. A shared table is copied only when one of the
+//! contexts modifies it, which usually happens on the first write fault in the table. The copy
+//! takes a reference to each physical page it maps, since the pages are then referenced by one
+//! more table.
 
 use core::ffi::c_void;
 use core::ptr;
@@ -24,11 +34,18 @@ use crate::cpu;
 use crate::errno::Errno;
 use crate::memory::buddy;
 use crate::memory::vmem::VMem;
+use crate::memory::vmem::tlb;
 use crate::memory;
+use crate::process::mem_space::PHYSICAL_REF_COUNTER;
 use crate::util::FailableClone;
+use crate::util::container::map::Map;
 use crate::util::lock::Mutex;
 use crate::util;
 
+/// x86 paging flag, ignored by the CPU. If set on a page directory entry, the page table might be
+/// shared with other contexts. Such a table is read-only and must be made private before being
+/// modified.
+pub const FLAG_SHARED: u32 = 0b1000000000;
 /// x86 paging flag. If set, prevents the CPU from updating the associated addresses when the TLB
 /// is flushed.
 pub const FLAG_GLOBAL: u32 = 0b100000000;
@@ -76,7 +93,7 @@ extern "C" {
 	pub fn paging_disable();
 
 	/// Executes the `invlpg` instruction for the address `addr`.
-	fn invlpg(addr: *const c_void);
+	pub fn invlpg(addr: *const c_void);
 	/// Reloads the TLB (Translation Lookaside Buffer).
 	pub fn tlb_reload();
 }
@@ -87,18 +104,39 @@ extern "C" {
 /// To prevent this issue, this mutex has to be locked whenever modifying kernel space mappings.
 static GLOBAL_MUTEX: Mutex<()> = Mutex::new(());
 
+/// The number of page directories referencing each shared page table, by physical address of the
+/// table. A table marked as shared which is not in the map is referenced only once.
+static SHARED_TABLES: Mutex<Map<u32, usize>> = Mutex::new(Map::new());
+
+/// The physical addresses of the page directories of every existing contexts, which receive the
+/// modifications of the kernel space entries.
+/// When locked along with `GLOBAL_MUTEX`, `GLOBAL_MUTEX` must be locked first.
+static CONTEXTS: Mutex<Map<u32, ()>> = Mutex::new(Map::new());
+
+/// The number of pages in a large block (PSE).
+pub const PSE_PAGES: usize = 1024;
+/// The flags of the page directory entries referencing kernel space tables. Access rights are
+/// given by the entries of the tables.
+const KERNEL_TABLE_FLAGS: u32 = FLAG_PRESENT | FLAG_WRITE | FLAG_USER;
+
 /// Tells whether the kernel tables are initialized.
 static mut KERNEL_TABLES_INIT: bool = false;
 /// Array storing kernel space paging tables.
 static mut KERNEL_TABLES: [*mut u32; 256] = [0 as _; 256];
+/// The entries of the page directory for the kernel space, copied in every new context.
+/// An entry is either a kernel space table or a large block (PSE). Large blocks are created only
+/// for the permanent mappings of the kernel.
+/// Modifications are protected by `GLOBAL_MUTEX` and must be done with `set_kernel_dir_entry`.
+static mut KERNEL_DIR_ENTRIES: [u32; 256] = [0; 256];
 
 /// Returns the array of kernel space paging tables. If the table is not initialized, the function
 /// initializes it.
 /// The first time this function is called, it is **not** thread safe.
 unsafe fn get_kernel_tables() -> Result<&'static [*mut u32; 256], Errno> {
 	if !KERNEL_TABLES_INIT {
-		for table in &mut KERNEL_TABLES {
+		for (table, entry) in KERNEL_TABLES.iter_mut().zip(KERNEL_DIR_ENTRIES.iter_mut()) {
 			*table = alloc_obj()?;
+			*entry = memory::kern_to_phys(*table as _) as u32 | KERNEL_TABLE_FLAGS;
 		}
 
 		KERNEL_TABLES_INIT = true;
@@ -116,12 +154,26 @@ unsafe fn get_kernel_table(n: usize) -> Result<*mut u32, Errno> {
 	Ok(memory::kern_to_phys(tables[n] as _) as _)
 }
 
+/// Sets the entry at index `index` of the page directory, in the kernel space, to `value` in the
+/// template for new contexts and in every existing context.
+/// `GLOBAL_MUTEX` must be locked.
+fn set_kernel_dir_entry(index: usize, value: u32) {
+	debug_assert!((768..1024).contains(&index));
+
+	unsafe { // Safe because protected by `GLOBAL_MUTEX`
+		KERNEL_DIR_ENTRIES[index - 768] = value;
+	}
+	for (page_dir, _) in CONTEXTS.lock().get().iter() {
+		obj_set(*page_dir as _, index, value);
+	}
+}
+
 /// Allocates a paging object and returns its virtual address.
 /// Returns Err if the allocation fails.
 fn alloc_obj() -> Result<*mut u32, Errno> {
 	let ptr = buddy::alloc_kernel(0)? as *mut c_void;
 	unsafe {
-		util::bzero(ptr as _, buddy::get_frame_size(0));
+		util::page_zero(ptr);
 	}
 	Ok(ptr as _)
 }
@@ -187,28 +239,33 @@ mod table {
 	use super::*;
 
 	/// Creates an empty page table at index `index` of the page directory.
+	/// In the kernel space, the table is the kernel space table shared by every contexts, with
+	/// the flags `KERNEL_TABLE_FLAGS` instead of `flags`. It is not cleared.
+	/// `GLOBAL_MUTEX` must be locked.
 	pub fn create(vmem: *mut u32, index: usize, flags: u32) -> Result<(), Errno> {
 		debug_assert!(index < 1024);
 		debug_assert!(flags & ADDR_MASK == 0);
 		debug_assert!(flags & FLAG_PAGE_SIZE == 0);
 
-		let v = {
-			if index < 768 {
-				alloc_obj()?
-			} else {
-				// Safe because only one thread is running the first time this function is called
-				unsafe {
-					get_kernel_table(index - 768)?
-				}
-			}
-		};
-
-		obj_set(vmem, index, (memory::kern_to_phys(v as _) as u32) | (flags | FLAG_PRESENT));
+		if index < 768 {
+			let v = alloc_obj()?;
+			let dir_entry_value = (memory::kern_to_phys(v as _) as u32) | (flags | FLAG_PRESENT);
+			obj_set(vmem, index, dir_entry_value);
+		} else {
+			// Safe because only one thread is running the first time this function is called
+			let v = unsafe {
+				get_kernel_table(index - 768)?
+			};
+			let dir_entry_value = (v as u32) | KERNEL_TABLE_FLAGS;
+			obj_set(vmem, index, dir_entry_value);
+			set_kernel_dir_entry(index, dir_entry_value);
+		}
 		Ok(())
 	}
 
 	/// Expands a large block into a page table. This function allocates a new page table and fills
 	/// it so that the memory mapping keeps the same behavior.
+	/// `GLOBAL_MUTEX` must be locked.
 	pub fn expand(vmem: *mut u32, index: usize) -> Result<(), Errno> {
 		let mut dir_entry_value = obj_get(vmem, index);
 		debug_assert!(dir_entry_value & FLAG_PRESENT != 0);
@@ -219,7 +276,7 @@ mod table {
 		table::create(vmem, index, flags)?;
 		dir_entry_value = obj_get(vmem, index);
 		let table_addr = (dir_entry_value & ADDR_MASK) as *mut u32;
-		for i in 0..1024 {
+		for i in 0..PSE_PAGES {
 			let addr = base_addr + (i * memory::PAGE_SIZE) as u32;
 			obj_set(table_addr, i, addr | flags);
 		}
@@ -246,13 +303,137 @@ mod table {
 	}
 
 	/// Deletes the table at index `index` in the page directory.
+	/// If the table is shared with other contexts, only the reference to it is removed.
 	pub fn delete(vmem: *mut u32, index: usize) {
 		debug_assert!(index < 1024);
 		let dir_entry_value = obj_get(vmem, index);
-		let dir_entry_addr = (dir_entry_value & ADDR_MASK) as _;
-		buddy::free(dir_entry_addr, 0);
+		let dir_entry_addr = dir_entry_value & ADDR_MASK;
+
+		let shared = dir_entry_value & FLAG_SHARED != 0;
+		if !shared || !release(SHARED_TABLES.lock().get_mut(), dir_entry_addr) {
+			buddy::free(dir_entry_addr as _, 0);
+		}
 		obj_set(vmem, index, 0);
 	}
+
+	/// Removes a reference to the shared table at physical address `table`.
+	/// `shared` is the map of shared tables.
+	/// If the table is referenced only once, the function does nothing and returns `false`.
+	pub fn release(shared: &mut Map<u32, usize>, table: u32) -> bool {
+		let Some(refs) = shared.get_mut(table) else {
+			return false;
+		};
+
+		if *refs > 2 {
+			*refs -= 1;
+		} else {
+			shared.remove(table);
+		}
+		true
+	}
+
+	/// Shares the table at index `index` of the page directory `src` with the page directory
+	/// `dest`. The table becomes read-only in both directories.
+	/// `shared` is the map of shared tables.
+	/// The function doesn't flush the modifications.
+	pub fn share(src: *mut u32, dest: *mut u32, index: usize, shared: &mut Map<u32, usize>)
+		-> Result<(), Errno> {
+		debug_assert!(index < 768);
+
+		let dir_entry_value = obj_get(src, index);
+		let table = dir_entry_value & ADDR_MASK;
+		if let Some(refs) = shared.get_mut(table) {
+			*refs += 1;
+		} else {
+			shared.insert(table, 2)?;
+		}
+
+		let dir_entry_value = (dir_entry_value | FLAG_SHARED) & !FLAG_WRITE;
+		obj_set(src, index, dir_entry_value);
+		obj_set(dest, index, dir_entry_value);
+		Ok(())
+	}
+
+	/// Takes a reference to every physical page mapped by the table `table`.
+	fn ref_pages(table: *const u32) -> Result<(), Errno> {
+		let mut ref_counter_guard = PHYSICAL_REF_COUNTER.lock();
+		let ref_counter = ref_counter_guard.get_mut();
+
+		for i in 0..1024 {
+			let entry_value = obj_get(table, i);
+			if entry_value & FLAG_PRESENT == 0 {
+				continue;
+			}
+
+			if let Err(errno) = ref_counter.increment((entry_value & ADDR_MASK) as _) {
+				for j in 0..i {
+					let entry_value = obj_get(table, j);
+					if entry_value & FLAG_PRESENT != 0 {
+						ref_counter.decrement((entry_value & ADDR_MASK) as _);
+					}
+				}
+
+				return Err(errno);
+			}
+		}
+
+		Ok(())
+	}
+
+	/// Makes the table at index `index` of the page directory private to the directory so that it
+	/// can be modified. If the table is still referenced by other contexts, it is copied.
+	/// Since the pages of a shared table might be waiting for Copy-On-Write, writing is disabled
+	/// on every entry of the private table. It is enabled again page by page on write faults.
+	/// The function returns `true` if the directory has been modified. In this case, the context
+	/// has to be flushed.
+	pub fn unshare(vmem: *mut u32, index: usize) -> Result<bool, Errno> {
+		debug_assert!(index < 768);
+
+		let dir_entry_value = obj_get(vmem, index);
+		if dir_entry_value & FLAG_PRESENT == 0 || dir_entry_value & FLAG_SHARED == 0 {
+			return Ok(false);
+		}
+		let src = dir_entry_value & ADDR_MASK;
+
+		let mut shared_guard = SHARED_TABLES.lock();
+		let shared = shared_guard.get_mut();
+		let table = if shared.get(src).is_some() {
+			let dest = alloc_obj()?;
+			unsafe { // Safe because pointers are valid
+				let src = memory::kern_to_virt(src as _) as *const u32;
+				ptr::copy_nonoverlapping::<u32>(src, dest, 1024);
+			}
+			if let Err(errno) = ref_pages(dest) {
+				free_obj(dest);
+				return Err(errno);
+			}
+
+			release(shared, src);
+			memory::kern_to_phys(dest as _) as u32
+		} else {
+			src
+		};
+
+		let table_ptr = table as *mut u32;
+		for i in 0..1024 {
+			obj_set(table_ptr, i, obj_get(table_ptr, i) & !FLAG_WRITE);
+		}
+		let flags = (dir_entry_value & FLAGS_MASK & !FLAG_SHARED) | FLAG_WRITE;
+		obj_set(vmem, index, table | flags);
+
+		Ok(true)
+	}
+
+	/// Tells whether the table at index `index` of the page directory is shared with other
+	/// contexts.
+	pub fn is_shared(vmem: *const u32, index: usize) -> bool {
+		let dir_entry_value = obj_get(vmem, index);
+		if dir_entry_value & FLAG_PRESENT == 0 || dir_entry_value & FLAG_SHARED == 0 {
+			return false;
+		}
+
+		SHARED_TABLES.lock().get().get(dir_entry_value & ADDR_MASK).is_some()
+	}
 }
 
 impl X86VMem {
@@ -322,17 +503,31 @@ impl X86VMem {
 			page_dir: alloc_obj()?,
 		};
 
-		let flags = FLAG_PRESENT | FLAG_WRITE | FLAG_USER;
+		// Safe because only one thread is running when the first vmem is created
+		unsafe {
+			get_kernel_tables()?;
+		}
+
+		let _guard = GLOBAL_MUTEX.lock();
+		vmem.copy_kernel_entries()?;
+
+		Ok(vmem)
+	}
+
+	/// Copies the entries of the page directory for the kernel space into the context, then
+	/// registers the context to receive their modifications.
+	/// `GLOBAL_MUTEX` must be locked.
+	fn copy_kernel_entries(&self) -> Result<(), Errno> {
 		for i in 0..256 {
-			// Safe because only one thread is running when the first vmem is created
-			let ptr = unsafe {
-				get_kernel_table(i)?
+			let dir_entry_value = unsafe { // Safe because protected by `GLOBAL_MUTEX`
+				KERNEL_DIR_ENTRIES[i]
 			};
-
-			obj_set(vmem.page_dir, 768 + i, ptr as u32 | flags);
+			obj_set(self.page_dir, 768 + i, dir_entry_value);
 		}
 
-		Ok(vmem)
+		let page_dir = memory::kern_to_phys(self.page_dir as _) as u32;
+		CONTEXTS.lock().get_mut().insert(page_dir, ())?;
+		Ok(())
 	}
 
 	/// Returns the index of the element corresponding to the given virtual address `ptr` for
@@ -376,51 +571,94 @@ impl X86VMem {
 		})
 	}
 
-	/// Tells whether to use PSE mapping for the given virtual address `addr` and remaining pages
-	/// `pages`.
-	fn use_pse(addr: *const c_void, pages: usize) -> bool {
-		// The end address of the hypothetical PSE block
-		let pse_end = unsafe {
-			addr.add(1024 * memory::PAGE_SIZE)
+	/// Tells whether to use PSE mapping for the given physical address `physaddr`, virtual
+	/// address `virtaddr`, remaining pages `pages` and flags `flags`.
+	/// In the kernel space, large blocks are used only for the permanent mappings of the kernel,
+	/// marked as global.
+	fn use_pse(physaddr: *const c_void, virtaddr: *const c_void, pages: usize, flags: u32)
+		-> bool {
+		let pse_size = PSE_PAGES * memory::PAGE_SIZE;
+		// The address of the last byte of the hypothetical PSE block
+		let Some(pse_last) = (virtaddr as usize).checked_add(pse_size - 1) else {
+			return false;
 		};
 
-		// Ensuring no PSE block is created in kernel space
-		pse_end < memory::PROCESS_END
-		// Ensuring the virtual address doesn't overflow
-			&& pse_end >= addr
-		// Checking the address is aligned on the PSE boundary
-			&& util::is_aligned(addr, 1024 * memory::PAGE_SIZE)
+		let range_ok = if virtaddr >= memory::PROCESS_END {
+			flags & FLAG_GLOBAL != 0
+		} else {
+			pse_last < memory::PROCESS_END as usize
+		};
+
+		range_ok
+		// Checking the addresses are aligned on the PSE boundary
+			&& util::is_aligned(physaddr, pse_size)
+			&& util::is_aligned(virtaddr, pse_size)
 		// Checking that there remain enough pages to make a PSE block
-			&& pages >= 1024
+			&& pages >= PSE_PAGES
 	}
 
 	/// Maps the given physical address `physaddr` to the given virtual address `virtaddr` with the
 	/// given flags using blocks of 1024 pages (PSE).
 	fn map_pse(&mut self, physaddr: *const c_void, virtaddr: *const c_void, mut flags: u32) {
-		debug_assert!(util::is_aligned(physaddr, memory::PAGE_SIZE));
-		debug_assert!(util::is_aligned(virtaddr, memory::PAGE_SIZE));
+		debug_assert!(util::is_aligned(physaddr, PSE_PAGES * memory::PAGE_SIZE));
+		debug_assert!(util::is_aligned(virtaddr, PSE_PAGES * memory::PAGE_SIZE));
 		debug_assert!(flags & ADDR_MASK == 0);
 
 		flags |= FLAG_PRESENT | FLAG_PAGE_SIZE;
+		if virtaddr < memory::PROCESS_END {
+			flags &= !FLAG_GLOBAL;
+		}
+
+		// Locking the global mutex to avoid data races while modifying kernel space entries
+		let _guard = GLOBAL_MUTEX.lock();
 
 		let dir_entry_index = Self::get_addr_element_index(virtaddr, 1);
 		let dir_entry_value = obj_get(self.page_dir, dir_entry_index);
-		if dir_entry_value & FLAG_PRESENT != 0 && dir_entry_value & FLAG_PAGE_SIZE == 0 {
-			table::delete(self.page_dir, dir_entry_index);
+		let new_value = (physaddr as u32) | flags;
+		if dir_entry_index < 768 {
+			if dir_entry_value & FLAG_PRESENT != 0 && dir_entry_value & FLAG_PAGE_SIZE == 0 {
+				table::delete(self.page_dir, dir_entry_index);
+			}
+			obj_set(self.page_dir, dir_entry_index, new_value);
+		} else {
+			// Kernel space tables are kept since they are reused if the block is split
+			set_kernel_dir_entry(dir_entry_index, new_value);
 		}
+	}
 
-		obj_set(self.page_dir, dir_entry_index, (physaddr as u32) | flags);
+	/// Makes the table at index `index` of the page directory private, flushing the context if
+	/// it changed.
+	fn unshare_table(&mut self, index: usize) -> Result<(), Errno> {
+		if table::unshare(self.page_dir, index)? {
+			self.flush();
+		}
+		Ok(())
 	}
 
 	/// Unmaps the large block (PSE) at the given virtual address `virtaddr`.
-	fn unmap_pse(&mut self, virtaddr: *const c_void) {
+	/// In the kernel space, the block is replaced by the empty kernel space table.
+	fn unmap_pse(&mut self, virtaddr: *const c_void) -> Result<(), Errno> {
+		let _guard = GLOBAL_MUTEX.lock();
+
 		let dir_entry_index = Self::get_addr_element_index(virtaddr, 1);
 		let dir_entry_value = obj_get(self.page_dir, dir_entry_index);
 		if dir_entry_value & FLAG_PRESENT == 0 || dir_entry_value & FLAG_PAGE_SIZE == 0 {
-			return;
+			return Ok(());
 		}
 
-		obj_set(self.page_dir, dir_entry_index, 0);
+		if dir_entry_index < 768 {
+			obj_set(self.page_dir, dir_entry_index, 0);
+		} else {
+			// Safe because the kernel tables are initialized when a context exists
+			let table = unsafe {
+				get_kernel_table(dir_entry_index - 768)?
+			};
+			for i in 0..1024 {
+				obj_set(table, i, 0);
+			}
+			set_kernel_dir_entry(dir_entry_index, table as u32 | KERNEL_TABLE_FLAGS);
+		}
+		Ok(())
 	}
 }
 
@@ -430,15 +668,19 @@ impl VMem for X86VMem {
 			let entry_value = unsafe {
 				*e
 			};
-			let remain_mask = if entry_value & FLAG_GLOBAL == 0 {
+
+			// The entry is a large block if it belongs to the page directory
+			let dir_entry_index = Self::get_addr_element_index(ptr, 1);
+			let dir_entry_value = obj_get(self.page_dir, dir_entry_index);
+			let remain_mask = if dir_entry_value & FLAG_PAGE_SIZE == 0 {
 				memory::PAGE_SIZE - 1
 			} else {
-				1024 * memory::PAGE_SIZE - 1
+				PSE_PAGES * memory::PAGE_SIZE - 1
 			};
 
-			let mut virtptr = (entry_value & ADDR_MASK) as usize;
-			virtptr |= ptr as usize & remain_mask;
-			Some(virtptr as _)
+			let mut physptr = entry_value as usize & !remain_mask;
+			physptr |= ptr as usize & remain_mask;
+			Some(physptr as _)
 		} else {
 			None
 		}
@@ -454,9 +696,14 @@ impl VMem for X86VMem {
 		debug_assert_eq!(flags & ADDR_MASK, 0);
 
 		flags |= FLAG_PRESENT;
+		// Global pages remain in the TLB across context switches, which is valid only for the
+		// kernel space
+		if virtaddr < memory::PROCESS_END {
+			flags &= !FLAG_GLOBAL;
+		}
 
 		// Locking the global mutex to avoid data races while modifying kernel space tables
-		let _ = GLOBAL_MUTEX.lock();
+		let _guard = GLOBAL_MUTEX.lock();
 
 		let dir_entry_index = Self::get_addr_element_index(virtaddr, 1);
 		let mut dir_entry_value = obj_get(self.page_dir, dir_entry_index);
@@ -464,11 +711,14 @@ impl VMem for X86VMem {
 			table::create(self.page_dir, dir_entry_index, flags)?;
 		} else if dir_entry_value & FLAG_PAGE_SIZE != 0 {
 			table::expand(self.page_dir, dir_entry_index)?;
+		} else if dir_entry_index < 768 {
+			self.unshare_table(dir_entry_index)?;
 		}
 
+		// The entry changes if a table has been created or copied
+		dir_entry_value = obj_get(self.page_dir, dir_entry_index);
 		if dir_entry_index < 768 {
 			// Setting the table's flags
-			dir_entry_value = obj_get(self.page_dir, dir_entry_index);
 			dir_entry_value |= flags;
 			obj_set(self.page_dir, dir_entry_index, dir_entry_value);
 		}
@@ -497,12 +747,12 @@ impl VMem for X86VMem {
 			let next_physaddr = ((physaddr as usize) + off) as *const c_void;
 			let next_virtaddr = ((virtaddr as usize) + off) as *const c_void;
 
-			if Self::use_pse(next_virtaddr, pages - i) {
+			if Self::use_pse(next_physaddr, next_virtaddr, pages - i, flags) {
 				#[cfg(config_debug_debug)]
 				self.check_map(next_virtaddr, next_physaddr, true);
 
 				self.map_pse(next_physaddr, next_virtaddr, flags);
-				i += 1024;
+				i += PSE_PAGES;
 
 				// Invalidating the pages
 				self.invalidate_page(next_virtaddr); // TODO Check if invalidating the whole table
@@ -522,15 +772,18 @@ impl VMem for X86VMem {
 		debug_assert!(util::is_aligned(virtaddr, memory::PAGE_SIZE));
 
 		// Locking the global mutex to avoid data races while modifying kernel space tables
-		let _ = GLOBAL_MUTEX.lock();
+		let _guard = GLOBAL_MUTEX.lock();
 
 		let dir_entry_index = Self::get_addr_element_index(virtaddr, 1);
-		let dir_entry_value = obj_get(self.page_dir, dir_entry_index);
+		let mut dir_entry_value = obj_get(self.page_dir, dir_entry_index);
 		if dir_entry_value & FLAG_PRESENT == 0 {
 			return Ok(());
 		} else if dir_entry_value & FLAG_PAGE_SIZE != 0 {
 			table::expand(self.page_dir, dir_entry_index)?;
+		} else if dir_entry_index < 768 {
+			self.unshare_table(dir_entry_index)?;
 		}
+		dir_entry_value = obj_get(self.page_dir, dir_entry_index);
 
 		let table = (dir_entry_value & ADDR_MASK) as *mut u32;
 		let table_entry_index = Self::get_addr_element_index(virtaddr, 0);
@@ -556,15 +809,17 @@ impl VMem for X86VMem {
 			let off = i * memory::PAGE_SIZE;
 			let next_virtaddr = ((virtaddr as usize) + off) as *const c_void;
 
-			// Checking whether the page is mapped in PSE
-			let dir_entry_index = Self::get_addr_element_index(virtaddr, 1);
+			// Checking whether the whole large block (PSE) containing the page is unmapped
+			let dir_entry_index = Self::get_addr_element_index(next_virtaddr, 1);
 			let dir_entry_value = obj_get(self.page_dir, dir_entry_index);
-			let is_pse = (dir_entry_value & FLAG_PAGE_SIZE != 0)
-				&& Self::use_pse(next_virtaddr, pages - i);
+			let is_pse = (dir_entry_value & FLAG_PRESENT != 0)
+				&& (dir_entry_value & FLAG_PAGE_SIZE != 0)
+				&& util::is_aligned(next_virtaddr, PSE_PAGES * memory::PAGE_SIZE)
+				&& pages - i >= PSE_PAGES;
 
 			if is_pse {
-				self.unmap_pse(next_virtaddr);
-				i += 1024;
+				self.unmap_pse(next_virtaddr)?;
+				i += PSE_PAGES;
 
 				// Invalidating the pages
 				self.invalidate_page(next_virtaddr); // TODO Check if invalidating the whole table
@@ -577,11 +832,54 @@ impl VMem for X86VMem {
 		Ok(())
 	}
 
+	fn is_shared(&self, ptr: *const c_void) -> bool {
+		let dir_entry_index = Self::get_addr_element_index(ptr, 1);
+		dir_entry_index < 768 && table::is_shared(self.page_dir, dir_entry_index)
+	}
+
+	fn unshare(&mut self, ptr: *const c_void) -> Result<(), Errno> {
+		let dir_entry_index = Self::get_addr_element_index(ptr, 1);
+		if dir_entry_index >= 768 {
+			return Ok(());
+		}
+
+		let _guard = GLOBAL_MUTEX.lock();
+		self.unshare_table(dir_entry_index)
+	}
+
+	fn release_shared(&mut self) {
+		let _guard = GLOBAL_MUTEX.lock();
+
+		let mut released = false;
+		{
+			let mut shared_guard = SHARED_TABLES.lock();
+			let shared = shared_guard.get_mut();
+
+			for i in 0..768 {
+				let dir_entry_value = obj_get(self.page_dir, i);
+				if dir_entry_value & FLAG_PRESENT == 0 || dir_entry_value & FLAG_SHARED == 0 {
+					continue;
+				}
+
+				if table::release(shared, dir_entry_value & ADDR_MASK) {
+					obj_set(self.page_dir, i, 0);
+					released = true;
+				}
+			}
+		}
+
+		if released {
+			self.flush();
+		}
+	}
+
 	fn bind(&self) {
 		if !self.is_bound() {
+			let page_dir = memory::kern_to_phys(self.page_dir as _);
 			unsafe {
-				paging_enable(memory::kern_to_phys(self.page_dir as _) as _);
+				paging_enable(page_dir as _);
 			}
+			tlb::set_current_page_dir(page_dir);
 		}
 	}
 
@@ -592,65 +890,59 @@ impl VMem for X86VMem {
 	}
 
 	fn invalidate_page(&self, addr: *const c_void) {
-		// TODO Also invalidate on other CPU core (TLB shootdown)
-
 		unsafe {
 			invlpg(addr);
 		}
+		tlb::shootdown(memory::kern_to_phys(self.page_dir as _), Some(addr));
 	}
 
 	fn flush(&self) {
-		// TODO Also invalidate on other CPU core (TLB shootdown)
-
 		if self.is_bound() {
 			unsafe {
 				tlb_reload();
 			}
 		}
+		tlb::shootdown(memory::kern_to_phys(self.page_dir as _), None);
 	}
 }
 
 impl FailableClone for X86VMem {
+	/// Clones the context, sharing the tables of the userspace instead of copying them. Shared
+	/// tables are made read-only, making the cost of the operation independent of the number of
+	/// mapped pages.
 	fn failable_clone(&self) -> Result<Self, Errno> {
 		let s = Self {
 			page_dir: alloc_obj()?,
 		};
 
-		for i in 0..1024 {
-			let src_dir_entry_value = obj_get(self.page_dir, i);
-			if src_dir_entry_value & FLAG_PRESENT == 0 {
-				continue;
-			}
+		// Locking the global mutex to avoid data races while modifying the tables
+		let guard = GLOBAL_MUTEX.lock();
 
-			if src_dir_entry_value & FLAG_PAGE_SIZE == 0 {
-				let src_table = (src_dir_entry_value & ADDR_MASK) as *const u32;
-				let src_table = memory::kern_to_virt(src_table as _) as _;
-
-				let dest_table = {
-					if i < 768 {
-						let dest_table = alloc_obj()?;
-
-						unsafe { // Safe because pointers are valid
-							ptr::copy_nonoverlapping::<u32>(src_table, dest_table, 1024);
-						}
-						dest_table
-					} else {
-						// Safe because only one thread is running the first time this function is
-						// called
-						unsafe {
-							get_kernel_table(i - 768)?
-						}
-					}
-				};
+		let result = {
+			let mut shared_guard = SHARED_TABLES.lock();
+			let shared = shared_guard.get_mut();
 
-				obj_set(s.page_dir, i, (memory::kern_to_phys(dest_table as _) as u32)
-					| (src_dir_entry_value & FLAGS_MASK));
-			} else {
-				obj_set(s.page_dir, i, src_dir_entry_value);
-			}
-		}
+			(0..768).try_for_each(| i | {
+				let dir_entry_value = obj_get(self.page_dir, i);
+				if dir_entry_value & FLAG_PRESENT == 0 {
+					return Ok(());
+				}
+
+				// Copy-On-Write works on single pages, so large blocks are split to be shared
+				if dir_entry_value & FLAG_PAGE_SIZE != 0 {
+					table::expand(self.page_dir, i)?;
+				}
+				table::share(self.page_dir, s.page_dir, i, shared)
+			})
+		};
+		// Kernel space entries are the same in every contexts
+		let result = result.and_then(| _ | s.copy_kernel_entries());
+
+		// A single flush applies every downgrades of the current context
+		self.flush();
+		drop(guard);
 
-		Ok(s)
+		result.map(| _ | s)
 	}
 }
 
@@ -662,12 +954,14 @@ impl Drop for X86VMem {
 			crate::kernel_panic!("Dropping virtual memory context handler while in use!");
 		}
 
+		let page_dir = memory::kern_to_phys(self.page_dir as _) as u32;
+		CONTEXTS.lock().get_mut().remove(page_dir);
+
 		for i in 0..768 {
 			let dir_entry_value = obj_get(self.page_dir, i);
 
 			if (dir_entry_value & FLAG_PRESENT) != 0 && (dir_entry_value & FLAG_PAGE_SIZE) == 0 {
-				let table = (dir_entry_value & ADDR_MASK) as *mut u32;
-				free_obj(memory::kern_to_virt(table as _) as _);
+				table::delete(self.page_dir, i);
 			}
 		}
 
@@ -687,4 +981,70 @@ mod test {
 			assert!(vmem.translate(((vga::get_buffer_virt() as usize) + i) as _) != None);
 		}
 	}
+
+	#[test_case]
+	fn vmem_x86_share0() {
+		let mut vmem = X86VMem::new().unwrap();
+		vmem.map(0x100000 as _, 0x100000 as _, FLAG_WRITE).unwrap();
+
+		let mut clone = vmem.failable_clone().unwrap();
+		assert!(vmem.is_shared(0x100000 as _));
+		assert_eq!(vmem.get_flags(0x100000 as _).unwrap() & FLAG_WRITE, FLAG_WRITE);
+
+		// Modifying the clone copies the table, leaving the original untouched
+		clone.map(0x200000 as _, 0x101000 as _, 0).unwrap();
+		assert!(!vmem.is_shared(0x100000 as _));
+		assert!(!clone.is_shared(0x100000 as _));
+		assert_eq!(clone.translate(0x100000 as _), Some(0x100000 as _));
+		assert_eq!(clone.get_flags(0x100000 as _).unwrap() & FLAG_WRITE, 0);
+		assert_eq!(vmem.translate(0x101000 as _), None);
+
+		PHYSICAL_REF_COUNTER.lock().get_mut().decrement(0x100000 as _);
+	}
+
+	#[test_case]
+	fn vmem_x86_kernel_split0() {
+		let mut vmem = X86VMem::new().unwrap();
+		let other = X86VMem::new().unwrap();
+		let Some(index) = (768..1024).find(| i | obj_get(vmem.page_dir, *i) & FLAG_PAGE_SIZE != 0)
+		else {
+			return;
+		};
+
+		// Mapping a page of a kernel space large block with the same mapping splits the block
+		let block = (index * PSE_PAGES * memory::PAGE_SIZE) as *const c_void;
+		let phys = vmem.translate(block).unwrap();
+		let flags = vmem.get_flags(block).unwrap() & (FLAG_WRITE | FLAG_GLOBAL);
+		vmem.map(phys, block, flags).unwrap();
+
+		// The split applies to every contexts and user access rights are given by the table
+		for v in [&vmem, &other] {
+			let dir_entry_value = obj_get(v.page_dir, index);
+			assert_eq!(dir_entry_value & FLAG_PAGE_SIZE, 0);
+			assert_ne!(dir_entry_value & FLAG_USER, 0);
+			assert_eq!(v.translate(block), Some(phys));
+			assert_eq!(v.get_flags(block).unwrap() & FLAG_USER, 0);
+		}
+		let kernel_vmem = crate::get_vmem().lock();
+		let kernel_vmem = kernel_vmem.get().as_ref().unwrap();
+		assert_eq!(kernel_vmem.translate(block), Some(phys));
+	}
+
+	#[test_case]
+	fn vmem_x86_pse0() {
+		let mut vmem = X86VMem::new().unwrap();
+		let block = PSE_PAGES * memory::PAGE_SIZE;
+		vmem.map_range(block as _, block as _, PSE_PAGES, FLAG_WRITE).unwrap();
+		assert_ne!(vmem.get_flags(block as _).unwrap() & FLAG_PAGE_SIZE, 0);
+		assert_eq!(vmem.translate((block + 0x1234) as _), Some((block + 0x1234) as _));
+
+		// Unmapping a single page splits the block
+		let page = block + memory::PAGE_SIZE;
+		vmem.unmap(page as _).unwrap();
+		assert_eq!(vmem.get_flags(block as _).unwrap() & FLAG_PAGE_SIZE, 0);
+		assert_eq!(vmem.translate(block as _), Some(block as _));
+		assert_eq!(vmem.translate(page as _), None);
+		let next = page + memory::PAGE_SIZE;
+		assert_eq!(vmem.translate(next as _), Some(next as _));
+	}
 }
@@ -12,15 +12,15 @@ use core::cmp::max;
 use core::cmp::min;
 use core::mem::transmute;
 use core::ptr;
+use crate::elf::ELF32SectionHeader;
 use crate::elf::ELF32Sym;
 use crate::elf::parser::ELFParser;
 use crate::elf::relocation::Relocation;
+use crate::elf::relocation;
 use crate::elf;
 use crate::errno::Errno;
 use crate::errno;
 use crate::memory::malloc;
-use crate::memory;
-use crate::multiboot;
 use crate::util::container::string::String;
 use crate::util::container::vec::Vec;
 use crate::util::lock::Mutex;
@@ -83,16 +83,69 @@ impl Module {
 	/// the function returns None.
 	/// `name` is the name of the symbol to look for.
 	fn resolve_symbol(name: &[u8]) -> Option<&ELF32Sym> {
-		let boot_info = multiboot::get_boot_info();
 		// The symbol on the kernel side
-		let kernel_sym = elf::get_kernel_symbol(memory::kern_to_virt(boot_info.elf_sections),
-			boot_info.elf_num as usize, boot_info.elf_shndx as usize,
-			boot_info.elf_entsize as usize, name)?;
+		let kernel_sym = elf::symbols::get(name)?;
 
 		// TODO Check other modules
 		Some(kernel_sym)
 	}
 
+	/// Returns the values of the symbols in the symbol table `symtab`, by index. Undefined
+	/// symbols are resolved from the kernel or other modules. If a symbol cannot be resolved, its
+	/// value is None.
+	/// `parser` is the module's parser.
+	/// `load_base` is the address at which the module is loaded.
+	fn resolve_table(parser: &ELFParser, symtab: &ELF32SectionHeader, load_base: u32)
+		-> Result<Vec<Option<u32>>, Errno> {
+		if symtab.sh_entsize == 0 {
+			return Ok(Vec::new());
+		}
+
+		let strtab = parser.get_section_by_index(symtab.sh_link);
+		let count = symtab.sh_size / symtab.sh_entsize;
+
+		let mut values = Vec::with_capacity(count as _)?;
+		for i in 0..count {
+			let value = parser.get_symbol_by_index(symtab, i).and_then(| sym | {
+				if sym.is_defined() {
+					return Some(load_base + sym.st_value);
+				}
+
+				// Looking inside of the kernel image or other modules
+				let name = parser.get_symbol_name(strtab?, sym)?;
+				Some(Self::resolve_symbol(name)?.st_value)
+			});
+			values.push(value)?;
+		}
+
+		Ok(values)
+	}
+
+	/// Returns the values of the symbols of the module, for each symbol table along with the
+	/// index of its section.
+	/// Resolving every symbols before performing relocations allows to look up each external
+	/// symbol only once, instead of once per relocation.
+	/// `parser` is the module's parser.
+	/// `load_base` is the address at which the module is loaded.
+	fn resolve_symbols(parser: &ELFParser, load_base: u32)
+		-> Result<Vec<(u32, Vec<Option<u32>>)>, Errno> {
+		let mut tables = Vec::new();
+		let mut res = Ok(());
+		let mut index = 0;
+		parser.foreach_sections(| _, section | {
+			if section.sh_type == elf::SHT_SYMTAB {
+				res = Self::resolve_table(parser, section, load_base)
+					.and_then(| values | tables.push((index, values)));
+			}
+
+			index += 1;
+			res.is_ok()
+		});
+		res?;
+
+		Ok(tables)
+	}
+
 	// TODO Print a warning when a symbol cannot be resolved
 	/// Loads a kernel module from the given image.
 	pub fn load(image: &[u8]) -> Result<Self, Errno> {
@@ -126,24 +179,25 @@ impl Module {
 			true
 		});
 
+		// The GOT is looked up once for every relocations
+		let got_sym = parser.get_symbol_by_name(relocation::GOT_SYM);
 		// Closure returning a symbol from its name
-		let get_sym = | name: &str | parser.get_symbol_by_name(name);
+		let get_sym = | name: &str | {
+			if name == relocation::GOT_SYM {
+				got_sym
+			} else {
+				parser.get_symbol_by_name(name)
+			}
+		};
 
+		let sym_values = Self::resolve_symbols(&parser, load_base)?;
 		// Closure returning the value of the given symbol
 		let get_sym_val = | sym_section: u32, sym: u32 | {
-			let section = parser.get_section_by_index(sym_section)?;
-			let sym = parser.get_symbol_by_index(section, sym)?;
-
-			if !sym.is_defined() {
-				let strtab = parser.get_section_by_index(section.sh_link)?;
-
-				// Looking inside of the kernel image or other modules
-				let name = parser.get_symbol_name(strtab, sym)?;
-				let other_sym = Self::resolve_symbol(name)?;
-				Some(other_sym.st_value)
-			} else {
-				Some(load_base + sym.st_value)
-			}
+			sym_values.iter()
+				.find(| (section, _) | *section == sym_section)?
+				.1.get(sym as usize)
+				.copied()
+				.flatten()
 		};
 
 		parser.foreach_rel(| section, rel | {
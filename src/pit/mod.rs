@@ -21,6 +21,15 @@ const PIT_COMMAND: u16 = 0x43;
 /// The command to enable the PC speaker.
 const BEEPER_ENABLE_COMMAND: u8 = 0x61;
 
+/// The port controlling the gate of channel 2 and reporting the state of its output.
+const PORT_CHANNEL_2_GATE: u16 = 0x61;
+/// Gate port flag: enables channel 2.
+const GATE_ENABLE: u8 = 0b01;
+/// Gate port flag: connects the output of channel 2 to the PC speaker.
+const GATE_SPEAKER: u8 = 0b10;
+/// Gate port flag: the output of channel 2 is high.
+const GATE_OUTPUT: u8 = 1 << 5;
+
 /// Select PIT channel 0.
 const SELECT_CHANNEL_0: u8 = 0b00 << 6;
 /// Select PIT channel 1.
@@ -104,6 +113,30 @@ pub fn set_frequency(frequency: Frequency) {
 	set_value(c as u16);
 }
 
+/// Busy-waits for `us` microseconds using channel 2 of the PIT, without relying on interrupts.
+/// This function is meant to calibrate other timers. `us` is clamped to the longest delay the
+/// channel can count, about 54 milliseconds.
+pub fn udelay(us: u32) {
+	let count = (BASE_FREQUENCY as u64 * us as u64 / 1000000).clamp(1, 0xffff) as u16;
+
+	unsafe {
+		// Stopping the channel, with the speaker disconnected
+		let gate = io::inb(PORT_CHANNEL_2_GATE) & !(GATE_ENABLE | GATE_SPEAKER);
+		io::outb(PORT_CHANNEL_2_GATE, gate);
+
+		io::outb(PIT_COMMAND, SELECT_CHANNEL_2 | ACCESS_LOBYTE_HIBYTE | MODE_0);
+		io::outb(CHANNEL_2, (count & 0xff) as u8);
+		io::outb(CHANNEL_2, ((count >> 8) & 0xff) as u8);
+
+		// The output goes high when the count reaches zero
+		io::outb(PORT_CHANNEL_2_GATE, gate | GATE_ENABLE);
+		while io::inb(PORT_CHANNEL_2_GATE) & GATE_OUTPUT == 0 {
+			core::hint::spin_loop();
+		}
+		io::outb(PORT_CHANNEL_2_GATE, gate);
+	}
+}
+
 /// Makes PC speaker ring the bell.
 pub fn beep() {
 	// TODO
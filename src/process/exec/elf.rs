@@ -9,16 +9,17 @@ use core::slice;
 use core::str;
 use crate::cpu;
 use crate::elf::ELF32ProgramHeader;
+use crate::elf::cache::ELFInfo;
 use crate::elf::parser::ELFParser;
 use crate::elf::relocation::Relocation;
 use crate::elf;
 use crate::errno::Errno;
 use crate::errno;
 use crate::file::File;
-use crate::file::Gid;
-use crate::file::Uid;
 use crate::file::fcache;
+use crate::file::page_cache::CachedFile;
 use crate::file::path::Path;
+use crate::idt;
 use crate::memory::malloc;
 use crate::memory::vmem;
 use crate::memory;
@@ -81,6 +82,8 @@ const AT_RANDOM: i32 = 25;
 const AT_HWCAP2: i32 = 26;
 /// A pointer to the filename of the executed program.
 const AT_EXECFN: i32 = 31;
+/// The address of the routine allowing to issue system calls without using interruptions.
+const AT_SYSINFO: i32 = 32;
 
 /// Informations returned after loading an ELF program used to finish initialization.
 #[derive(Debug)]
@@ -93,6 +96,10 @@ struct ELFLoadInfo {
 	phdr: Option<*const c_void>,
 	/// The pointer to the entry point
 	entry_point: *const c_void,
+	/// The size of one entry in the program header table
+	phentsize: u16,
+	/// The number of entries in the program header table
+	phnum: u16,
 
 	/// The load base of the interpreter program
 	interp_load_base: Option<*const c_void>,
@@ -137,17 +144,16 @@ impl AuxEntryDesc {
 
 /// Builds an auxilary vector with execution informations `exec_info` and load informations
 /// `load_info`.
-/// `parser` is a reference to the ELF parser.
-fn build_auxilary(exec_info: &ExecInfo, load_info: &ELFLoadInfo, parser: &ELFParser)
+fn build_auxilary(exec_info: &ExecInfo, load_info: &ELFLoadInfo)
 	-> Result<Vec<AuxEntryDesc>, Errno> {
 	let mut aux = Vec::new();
 
 	if let Some(phdr) = load_info.phdr {
 		aux.push(AuxEntryDesc::new(AT_PHDR, AuxEntryDescValue::Number(phdr as _)))?;
 		aux.push(AuxEntryDesc::new(AT_PHENT,
-			AuxEntryDescValue::Number(parser.get_header().get_phentsize() as _)))?;
+			AuxEntryDescValue::Number(load_info.phentsize as _)))?;
 		aux.push(AuxEntryDesc::new(AT_PHNUM,
-			AuxEntryDescValue::Number(parser.get_header().get_phnum() as _)))?;
+			AuxEntryDescValue::Number(load_info.phnum as _)))?;
 	}
 
 	aux.push(AuxEntryDesc::new(AT_PAGESZ, AuxEntryDescValue::Number(memory::PAGE_SIZE as _)))?;
@@ -170,6 +176,10 @@ fn build_auxilary(exec_info: &ExecInfo, load_info: &ELFLoadInfo, parser: &ELFPar
 	let hwcap = unsafe { cpu::get_hwcap() };
 	aux.push(AuxEntryDesc::new(AT_HWCAP, AuxEntryDescValue::Number(hwcap as _)))?;
 
+	if let Some(vsyscall) = idt::get_vsyscall() {
+		aux.push(AuxEntryDesc::new(AT_SYSINFO, AuxEntryDescValue::Number(vsyscall as _)))?;
+	}
+
 	aux.push(AuxEntryDesc::new(AT_SECURE, AuxEntryDescValue::Number(0)))?; // TODO
 	aux.push(AuxEntryDesc::new(AT_BASE_PLATFORM,
 		AuxEntryDescValue::String(crate::NAME.as_bytes())))?;
@@ -181,16 +191,8 @@ fn build_auxilary(exec_info: &ExecInfo, load_info: &ELFLoadInfo, parser: &ELFPar
 	Ok(aux)
 }
 
-/// Reads the file `file`. If the file is not executable, the function returns an
-/// error.
-/// `uid` is the User ID of the executing user.
-/// `gid` is the Group ID of the executing user.
-fn read_exec_file(file: &mut File, uid: Uid, gid: Gid) -> Result<malloc::Alloc<u8>, Errno> {
-	// Check that the file can be executed by the user
-	if !file.can_execute(uid, gid) {
-		return Err(errno!(ENOEXEC));
-	}
-
+/// Reads the content of the executable file `file`.
+fn read_exec_file(file: &mut File) -> Result<malloc::Alloc<u8>, Errno> {
 	// Allocating memory for the file's content
 	let len = file.get_size();
 	let mut image = malloc::Alloc::new_default(len as usize)?;
@@ -201,6 +203,15 @@ fn read_exec_file(file: &mut File, uid: Uid, gid: Gid) -> Result<malloc::Alloc<u
 	Ok(image)
 }
 
+/// The source from which the content of segments is read.
+#[derive(Clone, Copy)]
+enum SegmentSource<'a> {
+	/// The file in the page cache. Segments are mapped from it when possible.
+	File(&'a CachedFile),
+	/// The image of the file, read in memory.
+	Image(&'a [u8]),
+}
+
 /// The program executor for ELF files.
 pub struct ELFExecutor<'a> {
 	/// Execution informations.
@@ -362,14 +373,45 @@ impl<'a> ELFExecutor<'a> {
 		}
 	}
 
+	/// Returns the size of the padding before the segment `seg` in memory.
+	fn get_segment_pad(seg: &ELF32ProgramHeader) -> usize {
+		seg.p_vaddr as usize % max(seg.p_align as usize, memory::PAGE_SIZE)
+	}
+
+	/// Returns the number of pages at the beginning of the segment `seg` in memory that can be
+	/// mapped directly from the page cache, along with the offset of the first of them in the
+	/// file.
+	///
+	/// Read-only pages are shared with other processes executing the same file, while writable
+	/// pages are copied on the first write.
+	/// If the segment has uninitialized data, the page on which its data ends is not counted since
+	/// the rest of the page must be zeroed.
+	///
+	/// If the segment cannot be mapped from the file, the function returns None.
+	fn get_file_pages(seg: &ELF32ProgramHeader) -> Option<(u64, usize)> {
+		let pad = Self::get_segment_pad(seg);
+		let off = (seg.p_offset as usize).checked_sub(pad)?;
+		if off % memory::PAGE_SIZE != 0 {
+			return None;
+		}
+
+		let pages = if seg.p_memsz <= seg.p_filesz {
+			math::ceil_division(pad + seg.p_memsz as usize, memory::PAGE_SIZE)
+		} else {
+			(pad + seg.p_filesz as usize) / memory::PAGE_SIZE
+		};
+		Some((off as _, pages))
+	}
+
 	/// Allocates memory in userspace for an ELF segment.
 	/// If the segment isn't loadable, the function does nothing.
 	/// `load_base` is the address at which the executable is loaded.
 	/// `mem_space` is the memory space to allocate into.
 	/// `seg` is the segment for which the memory is allocated.
+	/// `src` is the source of the segment's data.
 	/// If loaded, the function return the pointer to the end of the segment in virtual memory.
-	fn alloc_segment(load_base: *const u8, mem_space: &mut MemSpace, seg: &ELF32ProgramHeader)
-		-> Result<Option<*const c_void>, Errno> {
+	fn alloc_segment(load_base: *const u8, mem_space: &mut MemSpace, seg: &ELF32ProgramHeader,
+		src: SegmentSource) -> Result<Option<*const c_void>, Errno> {
 		// Loading only loadable segments
 		if seg.p_type != elf::PT_LOAD {
 			return Ok(None);
@@ -381,21 +423,45 @@ impl<'a> ELFExecutor<'a> {
 		}
 
 		// The size of the padding before the segment
-		let pad = seg.p_vaddr as usize % max(seg.p_align as usize, memory::PAGE_SIZE);
+		let pad = Self::get_segment_pad(seg);
 		// The pointer to the beginning of the segment in memory
 		let mem_begin = unsafe {
 			load_base.add(seg.p_vaddr as usize - pad)
 		};
 		// The length of the memory to allocate in pages
 		let pages = math::ceil_division(pad + seg.p_memsz as usize, memory::PAGE_SIZE);
+		let flags = seg.get_mem_space_flags();
+
+		// Mapping pages from the file
+		let mut file_pages = 0;
+		if let SegmentSource::File(file) = src {
+			if let Some((off, count)) = Self::get_file_pages(seg) {
+				file_pages = min(count, pages);
+				if file_pages > 0 {
+					mem_space.map(MapConstraint::Fixed(mem_begin as _), file_pages, flags,
+						Some(file.clone()), off)?;
+				}
+			}
+		}
 
-		if pages > 0 {
-			mem_space.map(MapConstraint::Fixed(mem_begin as _), pages, seg.get_mem_space_flags(),
-				None, 0)?;
+		if pages > file_pages {
+			let begin = unsafe {
+				mem_begin.add(file_pages * memory::PAGE_SIZE)
+			};
+			mem_space.map(MapConstraint::Fixed(begin as _), pages - file_pages, flags, None, 0)?;
+
+			// Pre-allocating the pages receiving data to make them writable. Relocations may
+			// write anywhere in the image, in which case every pages are allocated. Other pages
+			// are allocated on the first write
+			let alloc_end = match src {
+				SegmentSource::File(_) => {
+					let len = min(seg.p_memsz, seg.p_filesz) as usize;
+					math::ceil_division(pad + len, memory::PAGE_SIZE)
+				},
 
-			// TODO Lazy allocation
-			// Pre-allocating the pages to make them writable
-			for i in 0..pages {
+				SegmentSource::Image(_) => pages,
+			};
+			for i in file_pages..alloc_end {
 				mem_space.alloc((mem_begin as usize + i * memory::PAGE_SIZE) as *const u8)?;
 			}
 		}
@@ -407,69 +473,105 @@ impl<'a> ELFExecutor<'a> {
 		Ok(Some(mem_end as _))
 	}
 
-	/// Copies the segment's data into memory.
+	/// Copies the segment's data that isn't mapped from the file into memory.
 	/// If the segment isn't loadable, the function does nothing.
 	/// `load_base` is the address at which the executable is loaded.
+	/// `mem_space` is the memory space in which the segment is allocated.
 	/// `seg` is the segment.
-	/// `image` is the ELF file image.
-	fn copy_segment(load_base: *const u8, seg: &ELF32ProgramHeader, image: &[u8]) {
+	/// `src` is the source of the segment's data.
+	fn copy_segment(load_base: *const u8, mem_space: &mut MemSpace, seg: &ELF32ProgramHeader,
+		src: SegmentSource) -> Result<(), Errno> {
 		// Loading only loadable segments
 		if seg.p_type != elf::PT_LOAD {
-			return;
+			return Ok(());
 		}
 
-		// The pointer to the beginning of the segment in the virtual memory
-		let begin = unsafe {
-			load_base.add(seg.p_vaddr as usize) as *mut _
-		};
-		// The length of the segment in bytes
+		// The length of the segment's data in bytes
 		let len = min(seg.p_memsz, seg.p_filesz) as usize;
-		// A slice to the beginning of the segment's data in the file
-		let file_begin = &image[seg.p_offset as usize];
+		// The offset in the segment of the data that isn't mapped from the file
+		let skip = match src {
+			SegmentSource::File(_) => Self::get_file_pages(seg)
+				.map(| (_, pages) | pages * memory::PAGE_SIZE)
+				.unwrap_or(0)
+				.saturating_sub(Self::get_segment_pad(seg)),
+
+			SegmentSource::Image(_) => 0,
+		};
+		if skip >= len {
+			return Ok(());
+		}
 
-		// Copying the segment's data
-		unsafe { // Safe because the module ELF image is valid at this point
-			vmem::write_lock_wrap(|| {
-				util::memcpy(begin, file_begin as *const _ as _, len);
+		// The pointer to the beginning of the data to copy in the virtual memory
+		let begin = unsafe {
+			load_base.add(seg.p_vaddr as usize + skip) as *mut c_void
+		};
+		let file_off = seg.p_offset as usize + skip;
+		let len = len - skip;
+
+		// Closure writing the data to the process's memory
+		let proc_vmem = &**mem_space.get_vmem();
+		let write = | data: &[u8] | unsafe { // Safe because the pages are allocated
+			vmem::switch(proc_vmem, || {
+				vmem::write_lock_wrap(|| {
+					util::memcpy(begin, data.as_ptr() as _, data.len());
+				});
 			});
+		};
+
+		match src {
+			SegmentSource::File(file) => {
+				// The data is read before switching since it may require waiting for I/O
+				let mut buf = malloc::Alloc::<u8>::new_default(len)?;
+				file.read(file_off as _, buf.as_slice_mut())?;
+				write(buf.as_slice());
+			},
+
+			SegmentSource::Image(image) => write(&image[file_off..(file_off + len)]),
 		}
+
+		Ok(())
 	}
 
-	/// Loads the ELF file parsed by `elf` into the memory space `mem_space`.
+	/// Loads the ELF program described by `info` into the memory space `mem_space`.
+	/// `elf` is the parser of the ELF image. It is required if the file is not in the page cache
+	/// or if the program has to be relocated.
 	/// `load_base` is the base address at which the ELF is loaded.
+	/// `file` is the ELF file in the page cache. If None, the file's content is copied.
 	/// `interp` tells whether the function loads an interpreter.
-	fn load_elf(&self, elf: &ELFParser, mem_space: &mut MemSpace, load_base: *const u8,
-		interp: bool)
+	fn load_elf(&self, info: &ELFInfo, elf: Option<&ELFParser>, mem_space: &mut MemSpace,
+		load_base: *const u8, file: Option<&CachedFile>, interp: bool)
 		-> Result<ELFLoadInfo, Errno> {
-		let interp_path = elf.get_interpreter_path();
+		let interp_path = info.get_interpreter_path();
+
+		// Relocations are performed on the segments in memory, in which case the segments cannot
+		// be mapped from the file
+		let relocation = info.needs_relocation();
+		let src = match (file.filter(| _ | !relocation), elf) {
+			(Some(file), _) => SegmentSource::File(file),
+			(None, Some(elf)) => SegmentSource::Image(elf.get_image()),
+			(None, None) => return Err(errno!(EINVAL)),
+		};
 
-		let mut entry_point = (load_base as usize + elf.get_header().e_entry as usize)
+		let mut entry_point = (load_base as usize + info.get_header().e_entry as usize)
 			as *const c_void;
 
 		let mut interp_load_base = None;
 		let mut interp_entry = None;
 
 		// Allocating memory for segments
-		let mut load_end: Result<*const c_void, Errno> = Ok(load_base as _);
+		let mut load_end = load_base as *const c_void;
 		// The pointer to the program header table in memory
 		let mut phdr: Option<*const c_void> = None;
-		elf.foreach_segments(| seg | {
-			load_end = Self::alloc_segment(load_base, mem_space, seg).map(| end | {
-				if let Some(end) = end {
-					max(end, load_end.unwrap())
-				} else {
-					load_end.unwrap()
-				}
-			});
+		for seg in info.get_segments() {
+			if let Some(end) = Self::alloc_segment(load_base, mem_space, seg, src)? {
+				load_end = max(end, load_end);
+			}
 
 			// If PHDR, keep the pointer
 			if seg.p_type == elf::PT_PHDR {
 				phdr = Some((load_base as usize + seg.p_vaddr as usize) as _);
 			}
-
-			load_end.is_ok()
-		});
-		let mut load_end = load_end?;
+		}
 
 		// Loading the interpreter, if present
 		if let Some(interp_path) = interp_path {
@@ -489,31 +591,28 @@ impl<'a> ELFExecutor<'a> {
 				fcache.get_file_from_path(&interp_path, self.info.euid, self.info.egid, true)?
 			};
 			let mut interp_file_guard = interp_file_mutex.lock();
+			let interp_file = interp_file_guard.get_mut();
 
-			let interp_image = read_exec_file(interp_file_guard.get_mut(), self.info.euid,
-				self.info.egid)?;
-			let interp_elf = ELFParser::new(interp_image.as_slice())?;
 			let i_load_base = load_end as _; // TODO ASLR
-			let load_info = self.load_elf(&interp_elf, mem_space, i_load_base, true)?;
+			let load_info = self.load_file(interp_file, mem_space, i_load_base, true)?;
 
 			interp_load_base = Some(i_load_base as _);
-			interp_entry = Some((load_base as usize + elf.get_header().e_entry as usize)
+			interp_entry = Some((load_base as usize + info.get_header().e_entry as usize)
 				as *const c_void);
 			load_end = load_info.load_end;
 			entry_point = load_info.entry_point;
 		}
 
-		// Switching to the process's vmem to write onto the virtual memory
-		unsafe {
-			vmem::switch(mem_space.get_vmem().as_ref(), move || {
-				// Copying segments' data
-				elf.foreach_segments(| seg | {
-					Self::copy_segment(load_base, seg, elf.get_image());
-					true
-				});
+		// Copying segments' data
+		for seg in info.get_segments() {
+			Self::copy_segment(load_base, mem_space, seg, src)?;
+		}
 
-				// Performing relocations if no interpreter is present
-				if interp_path.is_none() {
+		// Performing relocations if no interpreter is present
+		if let (true, Some(elf)) = (relocation, elf) {
+			// Switching to the process's vmem to write onto the virtual memory
+			unsafe {
+				vmem::switch(mem_space.get_vmem().as_ref(), move || {
 					// Closure returning a symbol from its name
 					let get_sym = | name: &str | elf.get_symbol_by_name(name);
 
@@ -537,8 +636,8 @@ impl<'a> ELFExecutor<'a> {
 						rela.perform(load_base as _, section, get_sym, get_sym_val);
 						true
 					});
-				}
-			});
+				});
+			}
 		}
 
 		Ok(ELFLoadInfo {
@@ -546,11 +645,53 @@ impl<'a> ELFExecutor<'a> {
 			load_end,
 			phdr,
 			entry_point,
+			phentsize: info.get_header().get_phentsize(),
+			phnum: info.get_header().get_phnum(),
 
 			interp_load_base,
 			interp_entry,
 		})
 	}
+
+	/// Loads the ELF program in the file `file` into the memory space `mem_space`.
+	/// If the file is not executable, the function returns an error.
+	///
+	/// The informations on programs that are not relocated by the kernel are kept in a cache, in
+	/// which case the file's image doesn't have to be read.
+	///
+	/// `load_base` is the base address at which the ELF is loaded.
+	/// `interp` tells whether the function loads an interpreter.
+	fn load_file(&self, file: &mut File, mem_space: &mut MemSpace, load_base: *const u8,
+		interp: bool) -> Result<ELFLoadInfo, Errno> {
+		// Check that the file can be executed by the user
+		if !file.can_execute(self.info.euid, self.info.egid) {
+			return Err(errno!(ENOEXEC));
+		}
+
+		let size = file.get_size();
+		let mtime = file.get_mtime();
+		let cached = CachedFile::new(file.get_location(), size);
+
+		if let Some(cached) = &cached {
+			if let Some(info) = elf::cache::get(cached.get_key(), size, mtime)? {
+				return self.load_elf(&info, None, mem_space, load_base, Some(cached), interp);
+			}
+		}
+
+		// The ELF file image
+		let image = read_exec_file(file)?;
+		// Parsing the ELF file
+		let parser = ELFParser::new(image.as_slice())?;
+		let info = ELFInfo::new(&parser, size, mtime)?;
+
+		if let Some(cached) = &cached {
+			if !info.needs_relocation() {
+				elf::cache::insert(*cached.get_key(), &info)?;
+			}
+		}
+
+		self.load_elf(&info, Some(&parser), mem_space, load_base, cached.as_ref(), interp)
+	}
 }
 
 impl<'a> Executor<'a> for ELFExecutor<'a> {
@@ -558,22 +699,17 @@ impl<'a> Executor<'a> for ELFExecutor<'a> {
 	// relocations)
 	// TODO Handle suid and sgid
 	fn build_image(&'a self, file: &mut File) -> Result<ProgramImage, Errno> {
-		// The ELF file image
-		let image = read_exec_file(file, self.info.euid, self.info.egid)?;
-		// Parsing the ELF file
-		let parser = ELFParser::new(image.as_slice())?;
-
 		// The process's new memory space
 		let mut mem_space = MemSpace::new()?;
 
 		// Loading the ELF
-		let load_info = self.load_elf(&parser, &mut mem_space, null::<u8>(), false)?;
+		let load_info = self.load_file(file, &mut mem_space, null::<u8>(), false)?;
 
 		// The user stack
 		let user_stack = mem_space.map_stack(process::USER_STACK_SIZE, process::USER_STACK_FLAGS)?;
 
 		// The auxilary vector
-		let aux = build_auxilary(&self.info, &load_info, &parser)?;
+		let aux = build_auxilary(&self.info, &load_info)?;
 
 		// The size in bytes of the initial data on the stack
 		let total_size = Self::get_init_stack_size(self.info.argv, self.info.envp, &aux).1;
@@ -621,3 +757,44 @@ impl<'a> Executor<'a> for ELFExecutor<'a> {
 		})
 	}
 }
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	/// Returns a loadable segment at offset `offset` in the file and address `vaddr` in memory,
+	/// with `filesz` bytes in the file and `memsz` bytes in memory.
+	fn test_segment(offset: u32, vaddr: u32, filesz: u32, memsz: u32) -> ELF32ProgramHeader {
+		ELF32ProgramHeader {
+			p_type: elf::PT_LOAD,
+			p_offset: offset,
+			p_vaddr: vaddr,
+			p_paddr: 0,
+			p_filesz: filesz,
+			p_memsz: memsz,
+			p_flags: 0,
+			p_align: 0x1000,
+		}
+	}
+
+	#[test_case]
+	fn elf_file_pages0() {
+		// Every page of a segment without uninitialized data is mapped from the file, including
+		// the last partial page
+		let seg = test_segment(0x1000, 0x8049000, 0x2500, 0x2500);
+		assert_eq!(ELFExecutor::get_file_pages(&seg), Some((0x1000, 3)));
+
+		// The page on which the data of a segment with uninitialized data ends is not mapped
+		let seg = test_segment(0x3f00, 0x804bf00, 0x1200, 0x3000);
+		assert_eq!(ELFExecutor::get_file_pages(&seg), Some((0x3000, 2)));
+		let seg = test_segment(0x3f00, 0x804bf00, 0x100, 0x3000);
+		assert_eq!(ELFExecutor::get_file_pages(&seg), Some((0x3000, 1)));
+
+		// The offset in the file and the address in memory are not congruent
+		let seg = test_segment(0x3e00, 0x804bf00, 0x1200, 0x1200);
+		assert_eq!(ELFExecutor::get_file_pages(&seg), None);
+		// The page of the segment would begin before the beginning of the file
+		let seg = test_segment(0x100, 0x8048f00, 0x1200, 0x1200);
+		assert_eq!(ELFExecutor::get_file_pages(&seg), None);
+	}
+}
@@ -0,0 +1,91 @@
+//! This module implements copies between kernelspace and userspace.
+//!
+//! Instead of checking each page of the userspace buffer before accessing it, the copy is done
+//! directly and relies on the page fault handler: lazily allocated and Copy-On-Write pages are
+//! resolved by the fault itself. If a fault cannot be resolved, the handler resumes execution at
+//! the end of the copy routine, which then reports the number of bytes that have not been
+//! copied.
+//!
+//! Only the permissions of the mappings crossed by the buffer are checked beforehand, since the
+//! memory space may contain mappings that are accessible to the kernel only.
+//!
+//! Since a page fault requires to lock the current process and its memory space, none of those
+//! must be locked while copying.
+
+use core::ffi::c_void;
+use crate::errno::Errno;
+use crate::memory;
+use crate::util::lock::Mutex;
+use super::MemSpace;
+
+extern "C" {
+	fn user_copy(dst: *mut c_void, src: *const c_void, n: usize) -> usize;
+
+	/// The instruction of `user_copy` accessing memory.
+	fn user_copy_fault();
+	/// The location where `user_copy` resumes after a fault that cannot be resolved.
+	fn user_copy_fixup();
+}
+
+/// If `eip` is the address of an instruction accessing userspace memory in the copy routine,
+/// returns the address at which execution must resume after a page fault that cannot be
+/// resolved.
+pub fn get_fixup(eip: *const c_void) -> Option<*const c_void> {
+	if eip == user_copy_fault as *const c_void {
+		Some(user_copy_fixup as *const c_void)
+	} else {
+		None
+	}
+}
+
+/// Checks the range of userspace memory beginning at `ptr` of size `size` in bytes can be
+/// accessed by the process owning the memory space `mem_space`.
+/// `write` tells whether the memory is written.
+fn check_range<const INT: bool>(mem_space: &Mutex<MemSpace, INT>, ptr: *const c_void,
+	size: usize, write: bool) -> Result<(), Errno> {
+	let end = (ptr as usize).checked_add(size).ok_or_else(|| errno!(EFAULT))?;
+	if end > memory::PROCESS_END as usize {
+		return Err(errno!(EFAULT));
+	}
+
+	let guard = mem_space.lock();
+	if guard.get().can_access(ptr as _, size, true, write) {
+		Ok(())
+	} else {
+		Err(errno!(EFAULT))
+	}
+}
+
+/// Copies `buf.len()` bytes from the userspace address `src` to `buf`.
+/// `mem_space` is the memory space of the current process, which must be bound.
+/// If the memory cannot be accessed, the function returns EFAULT.
+pub fn copy_from_user<const INT: bool>(mem_space: &Mutex<MemSpace, INT>, src: *const c_void,
+	buf: &mut [u8]) -> Result<(), Errno> {
+	check_range(mem_space, src, buf.len(), false)?;
+
+	let remaining = unsafe {
+		user_copy(buf.as_mut_ptr() as _, src, buf.len())
+	};
+	if remaining == 0 {
+		Ok(())
+	} else {
+		Err(errno!(EFAULT))
+	}
+}
+
+/// Copies `buf` to the userspace address `dst`.
+/// `mem_space` is the memory space of the current process, which must be bound.
+/// If the memory cannot be accessed, the function returns EFAULT.
+pub fn copy_to_user<const INT: bool>(mem_space: &Mutex<MemSpace, INT>, dst: *mut c_void,
+	buf: &[u8]) -> Result<(), Errno> {
+	check_range(mem_space, dst, buf.len(), true)?;
+
+	let remaining = unsafe {
+		user_copy(dst, buf.as_ptr() as _, buf.len())
+	};
+	if remaining == 0 {
+		Ok(())
+	} else {
+		Err(errno!(EFAULT))
+	}
+}
@@ -0,0 +1,34 @@
+/*
+ * This file implements the routine copying data between kernelspace and userspace.
+ */
+
+.global user_copy
+.global user_copy_fault
+.global user_copy_fixup
+
+.section .text
+
+/*
+ * Copies `n` bytes from `src` to `dst`, where one of the pointers is a userspace pointer.
+ * Arguments: `dst`, `src` and `n`.
+ * The function returns the number of bytes that could not be copied. If a page fault that cannot be resolved occurs
+ * while copying, the page fault handler resumes execution at `user_copy_fixup`, returning the number of remaining
+ * bytes.
+ */
+user_copy:
+	push %esi
+	push %edi
+
+	mov 12(%esp), %edi
+	mov 16(%esp), %esi
+	mov 20(%esp), %ecx
+
+	cld
+user_copy_fault:
+	rep movsb
+user_copy_fixup:
+	mov %ecx, %eax
+
+	pop %edi
+	pop %esi
+	ret
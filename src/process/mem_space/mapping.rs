@@ -6,20 +6,21 @@ use core::fmt;
 use core::ptr::NonNull;
 use core::ptr;
 use crate::errno::Errno;
-use crate::file::open_file::OpenFile;
+use crate::file::page_cache::CachedFile;
 use crate::memory::buddy;
-use crate::memory::malloc;
 use crate::memory::vmem::VMem;
 use crate::memory::vmem;
 use crate::memory;
-use crate::process::mem_space::physical_ref_counter::PhysRefCounter;
 use crate::process::oom;
 use crate::util::lock::*;
-use crate::util::ptr::SharedPtr;
+use crate::util::math;
 use crate::util;
 use super::MemSpace;
 use super::gap::MemGap;
 
+/// The order of the frames backing a large block (PSE) of memory.
+const LARGE_BLOCK_ORDER: buddy::FrameOrder = 10;
+
 /// A pointer to the default physical page of memory. This page is meant to be mapped in read-only
 /// and is a placeholder for pages that are accessed without being allocated nor written.
 static DEFAULT_PAGE: Mutex<Option<*const c_void>> = Mutex::new(None);
@@ -30,9 +31,12 @@ fn get_default_page() -> *const c_void {
 	let default_page = guard.get_mut();
 
 	if default_page.is_none() {
-		let ptr = buddy::alloc(0, buddy::FLAG_ZONE_TYPE_KERNEL);
+		let ptr = buddy::alloc_kernel(0);
 		if let Ok(ptr) = ptr {
-			*default_page = Some(ptr);
+			unsafe {
+				util::page_zero(ptr);
+			}
+			*default_page = Some(memory::kern_to_phys(ptr));
 		} else {
 			kernel_panic!("Cannot allocate default memory page!");
 		}
@@ -41,6 +45,16 @@ fn get_default_page() -> *const c_void {
 	default_page.unwrap()
 }
 
+/// Returns a pointer to the physical page `phys_ptr` through the kernel's mapping of the physical
+/// memory. If the page is located outside of this mapping, the function returns None.
+fn get_kernel_ptr(phys_ptr: *const c_void) -> Option<*mut c_void> {
+	if (phys_ptr as usize) < memory::get_kernelspace_size() {
+		Some(memory::kern_to_virt(phys_ptr) as _)
+	} else {
+		None
+	}
+}
+
 /// A mapping in the memory space.
 #[derive(Clone, Debug)]
 pub struct MemMapping {
@@ -52,9 +66,9 @@ pub struct MemMapping {
 	flags: u8,
 
 	/// The file the mapping points to. If None, the mapping doesn't point to any file.
-	file: Option<SharedPtr<OpenFile>>,
-	/// The offset inside of the file pointed to by the file descriptor. If there is no file
-	/// descriptor, the value is undefined.
+	file: Option<CachedFile>,
+	/// The offset inside of the file the mapping points to. If there is no file, the value is
+	/// undefined.
 	off: u64,
 
 	/// Tells whether the mapping must be unmapped when the structure is dropped.
@@ -70,11 +84,10 @@ impl MemMapping {
 	/// must be page-aligned.
 	/// `size` is the size of the mapping in pages. The size must be greater than 0.
 	/// `flags` the mapping's flags
-	/// `file` is the open file the mapping points to. If None, the mapping doesn't point to any
-	/// file.
-	/// `off` is the offset inside of the file pointed to by the given file descriptor.
+	/// `file` is the file the mapping points to. If None, the mapping doesn't point to any file.
+	/// `off` is the offset inside of the file. It must be page-aligned.
 	/// `vmem` is the virtual memory context handler.
-	pub fn new(begin: *const c_void, size: usize, flags: u8, file: Option<SharedPtr<OpenFile>>,
+	pub fn new(begin: *const c_void, size: usize, flags: u8, file: Option<CachedFile>,
 		off: u64, vmem: NonNull<dyn VMem>) -> Self {
 		debug_assert!(util::is_aligned(begin, memory::PAGE_SIZE));
 		debug_assert!(size > 0);
@@ -111,6 +124,12 @@ impl MemMapping {
 		self.flags
 	}
 
+	/// Sets the mapping's flags. The virtual memory context is not updated, `update_vmem` has to
+	/// be called on each page afterwards.
+	pub fn set_flags(&mut self, flags: u8) {
+		self.flags = flags;
+	}
+
 	/// Returns a reference to the virtual memory context handler associated with the mapping.
 	#[inline(always)]
 	pub fn get_vmem(&self) -> &'static dyn VMem {
@@ -149,8 +168,15 @@ impl MemMapping {
 	}
 
 	/// Tells whether the page at offset `offset` in the mapping is shared or not.
+	/// A page is shared if it is referenced several times or if its page table is shared with
+	/// another memory space.
 	pub fn is_shared(&self, offset: usize) -> bool {
 		if let Some(phys_ptr) = self.get_physical_page(offset) {
+			let virt_ptr = (self.begin as usize + offset * memory::PAGE_SIZE) as *const c_void;
+			if self.get_vmem().is_shared(virt_ptr) {
+				return true;
+			}
+
 			let ref_counter = super::PHYSICAL_REF_COUNTER.lock();
 			ref_counter.get().is_shared(phys_ptr)
 		} else {
@@ -179,17 +205,51 @@ impl MemMapping {
 		flags
 	}
 
+	/// Tells whether the mapping writes to the pages of its file, which is the case of writable
+	/// shared mappings.
+	fn is_file_writer(&self) -> bool {
+		let shared = self.flags & super::MAPPING_FLAG_SHARED != 0;
+		let write = self.flags & super::MAPPING_FLAG_WRITE != 0;
+		self.file.is_some() && shared && write
+	}
+
+	/// Returns the page of the file to be mapped at offset `offset` in the mapping, taking a
+	/// reference to it. If the mapping doesn't point to a file or if the page is past the end of
+	/// the file, the function returns None.
+	fn get_file_page(&self, offset: usize) -> Result<Option<*const c_void>, Errno> {
+		if let Some(file) = &self.file {
+			let file_page = self.off / memory::PAGE_SIZE as u64 + offset as u64;
+			file.map_page(file_page, self.is_file_writer())
+		} else {
+			Ok(None)
+		}
+	}
+
 	/// Maps the mapping to the given virtual memory context with the default page. If the mapping
 	/// is marked as nolazy, the function allocates physical memory and maps it instead of the
 	/// default page.
+	/// If the mapping points to a file, the pages of the file in the page cache are mapped
+	/// instead, writable only if the mapping is shared.
 	pub fn map_default(&mut self) -> Result<(), Errno> {
 		let vmem = self.get_mut_vmem();
 		let nolazy = (self.flags & super::MAPPING_FLAG_NOLAZY) != 0;
+		let shared = (self.flags & super::MAPPING_FLAG_SHARED) != 0;
 		let default_page = get_default_page();
 
 		for i in 0..self.size {
+			let file_page = match self.get_file_page(i) {
+				Ok(page) => page,
+
+				Err(errno) => {
+					self.unmap()?;
+					return Err(errno);
+				},
+			};
+
 			let phys_ptr = {
-				if nolazy {
+				if let Some(page) = file_page {
+					page
+				} else if nolazy {
 					let ptr = buddy::alloc(0, buddy::FLAG_ZONE_TYPE_USER);
 					if let Err(errno) = ptr {
 						self.unmap()?;
@@ -201,9 +261,19 @@ impl MemMapping {
 				}
 			};
 			let virt_ptr = ((self.begin as usize) + (i * memory::PAGE_SIZE)) as *const c_void;
-			let flags = self.get_vmem_flags(nolazy, i);
+			// Private mappings perform Copy-On-Write on the pages of the file
+			let writable = if file_page.is_some() {
+				shared
+			} else {
+				nolazy
+			};
+			let flags = self.get_vmem_flags(writable, i);
 
 			if let Err(errno) = vmem.map(phys_ptr, virt_ptr, flags) {
+				if let Some(page) = file_page {
+					super::PHYSICAL_REF_COUNTER.lock().get_mut().decrement(page);
+				}
+
 				self.unmap()?;
 				return Err(errno);
 			}
@@ -212,89 +282,226 @@ impl MemMapping {
 		Ok(())
 	}
 
-	// TODO Add support for file descriptors
 	/// Maps the page at offset `offset` in the mapping to the virtual memory context. The
 	/// function allocates the physical memory to be mapped.
 	/// If the mapping is in forking state, the function shall apply Copy-On-Write and allocate
 	/// a new physical page with the same data.
 	pub fn map(&mut self, offset: usize) -> Result<(), Errno> {
-		let vmem = self.get_mut_vmem();
 		let virt_ptr = (self.begin as usize + offset * memory::PAGE_SIZE) as *mut c_void;
-		let cow_buffer = {
-			if self.is_cow(offset) {
-				let mut cow_buffer = malloc::Alloc::<u8>::new_default(memory::PAGE_SIZE)?;
+		let cow = self.is_cow(offset);
+
+		let prev_phys_ptr = self.get_physical_page(offset);
+		if !cow && prev_phys_ptr.is_some() {
+			return Ok(());
+		}
+		if !cow && self.map_large(offset) {
+			return Ok(());
+		}
+
+		// If the page to be copied is not accessible from the kernel, its content has to be
+		// buffered before it gets unmapped
+		let cow_buffer = match prev_phys_ptr {
+			Some(prev_phys_ptr) if cow && get_kernel_ptr(prev_phys_ptr).is_none() => {
+				let buffer = buddy::alloc_kernel(0)?;
 				unsafe {
-					ptr::copy_nonoverlapping(virt_ptr, cow_buffer.as_ptr_mut() as _,
-						memory::PAGE_SIZE);
+					ptr::copy_nonoverlapping(virt_ptr, buffer, memory::PAGE_SIZE);
 				}
 
-				Some(cow_buffer)
-			} else {
-				None
+				Some(buffer)
+			},
+
+			_ => None,
+		};
+
+		let result = self.map_new_page(offset, cow, prev_phys_ptr, cow_buffer);
+		if let Some(buffer) = cow_buffer {
+			buddy::free_kernel(buffer, 0);
+		}
+		result
+	}
+
+	/// Tries to back the whole large block (PSE) containing the page at offset `offset` with a
+	/// single frame of physical memory, which reduces the number of TLB misses.
+	/// This is possible only if the block is contained in an anonymous private mapping and if
+	/// none of its pages has been allocated yet.
+	/// Each page of the frame is referenced separately so that the block can be split back into
+	/// pages by any later modification, such as a partial unmap or a fork.
+	/// If the block cannot be mapped, the function returns `false` and the caller falls back to
+	/// mapping a single page.
+	fn map_large(&mut self, offset: usize) -> bool {
+		let block_pages = vmem::x86::PSE_PAGES;
+		let block_size = block_pages * memory::PAGE_SIZE;
+		debug_assert_eq!(math::pow2(LARGE_BLOCK_ORDER as usize), block_pages);
+
+		let eligible = self.file.is_none()
+			&& self.flags & super::MAPPING_FLAG_SHARED == 0
+			&& self.flags & super::MAPPING_FLAG_WRITE != 0
+			&& self.flags & super::MAPPING_FLAG_USER != 0;
+		let virt_ptr = self.begin as usize + offset * memory::PAGE_SIZE;
+		let block = util::down_align(virt_ptr as *const c_void, block_size);
+		let end = self.begin as usize + self.size * memory::PAGE_SIZE;
+		if !eligible || block < self.begin || block as usize + block_size > end {
+			return false;
+		}
+
+		let vmem = self.get_mut_vmem();
+		if vmem.is_shared(block) {
+			return false;
+		}
+		let default_page = get_default_page();
+		let unallocated = (0..block_pages).all(| i | {
+			let page = (block as usize + i * memory::PAGE_SIZE) as *const c_void;
+			vmem.translate(page).map(| p | p == default_page).unwrap_or(true)
+		});
+		if !unallocated {
+			return false;
+		}
+
+		let Ok(phys_ptr) = buddy::alloc(LARGE_BLOCK_ORDER, buddy::FLAG_ZONE_TYPE_USER) else {
+			return false;
+		};
+		if !util::is_aligned(phys_ptr, block_size) {
+			buddy::free(phys_ptr, LARGE_BLOCK_ORDER);
+			return false;
+		}
+		buddy::split_frame(phys_ptr, LARGE_BLOCK_ORDER);
+
+		let page = | i: usize | (phys_ptr as usize + i * memory::PAGE_SIZE) as *const c_void;
+		let release = | refs: usize | {
+			let mut ref_counter_guard = super::PHYSICAL_REF_COUNTER.lock();
+			let ref_counter = ref_counter_guard.get_mut();
+
+			for i in 0..block_pages {
+				if i < refs {
+					ref_counter.decrement(page(i));
+				}
+				buddy::free(page(i), 0);
 			}
 		};
 
-		let prev_phys_ptr = self.get_physical_page(offset);
-		if cow_buffer.is_none() && prev_phys_ptr.is_some() {
-			return Ok(());
+		let refs = {
+			let mut ref_counter_guard = super::PHYSICAL_REF_COUNTER.lock();
+			let ref_counter = ref_counter_guard.get_mut();
+			(0..block_pages).take_while(| i | ref_counter.increment(page(*i)).is_ok()).count()
+		};
+		if refs < block_pages {
+			release(refs);
+			return false;
 		}
 
-		let new_phys_ptr = buddy::alloc(0, buddy::FLAG_ZONE_TYPE_USER)?;
 		let flags = self.get_vmem_flags(true, offset);
+		if vmem.map_range(phys_ptr, block, block_pages, flags).is_err() {
+			release(refs);
+			return false;
+		}
+		// The previous entries of the block are flushed at once
+		vmem.flush();
 
-		{
-			let mut ref_counter = super::PHYSICAL_REF_COUNTER.lock();
-			if let Err(errno) = ref_counter.get_mut().increment(new_phys_ptr) {
-				buddy::free(new_phys_ptr, 0);
-				return Err(errno);
-			}
-			if let Err(errno) = vmem.map(new_phys_ptr, virt_ptr, flags) {
-				ref_counter.get_mut().decrement(new_phys_ptr);
-				buddy::free(new_phys_ptr, 0);
-				return Err(errno);
+		let init_block = move | dest: *mut c_void | unsafe {
+			ptr::write_bytes(dest as *mut u8, 0, block_size);
+		};
+		if phys_ptr as usize + block_size <= memory::get_kernelspace_size() {
+			init_block(memory::kern_to_virt(phys_ptr) as _);
+		} else {
+			unsafe {
+				vmem::switch(vmem, move || {
+					vmem::write_lock_wrap(|| init_block(block as _));
+				});
 			}
+		}
 
-			if let Some(prev_phys_ptr) = prev_phys_ptr {
-				ref_counter.get_mut().decrement(prev_phys_ptr);
-			}
+		true
+	}
+
+	/// Allocates a new physical page for the page at offset `offset` in the mapping, then maps
+	/// and initializes it.
+	/// `cow` tells whether the new page is a copy of the previous page `prev_phys_ptr`. If not,
+	/// the new page is zeroed.
+	/// `cow_buffer` is the buffer holding the data of the previous page if it is not accessible
+	/// from the kernel.
+	fn map_new_page(&mut self, offset: usize, cow: bool, prev_phys_ptr: Option<*const c_void>,
+		cow_buffer: Option<*mut c_void>) -> Result<(), Errno> {
+		let vmem = self.get_mut_vmem();
+		let virt_ptr = (self.begin as usize + offset * memory::PAGE_SIZE) as *mut c_void;
+
+		let new_phys_ptr = buddy::alloc(0, buddy::FLAG_ZONE_TYPE_USER)?;
+		let flags = self.get_vmem_flags(true, offset);
+
+		if let Err(errno) = super::PHYSICAL_REF_COUNTER.lock().get_mut().increment(new_phys_ptr) {
+			buddy::free(new_phys_ptr, 0);
+			return Err(errno);
+		}
+		// The reference counter must not be locked while mapping since a shared page table
+		// might be copied, taking references to its pages
+		if let Err(errno) = vmem.map(new_phys_ptr, virt_ptr, flags) {
+			super::PHYSICAL_REF_COUNTER.lock().get_mut().decrement(new_phys_ptr);
+			buddy::free(new_phys_ptr, 0);
+			return Err(errno);
+		}
+		if let Some(prev_phys_ptr) = prev_phys_ptr {
+			super::PHYSICAL_REF_COUNTER.lock().get_mut().decrement(prev_phys_ptr);
 		}
 
-		// Copying data if necessary
-		unsafe {
-			vmem::switch(vmem, move || {
-				vmem::write_lock_wrap(|| {
-					if let Some(buffer) = cow_buffer {
-						ptr::copy_nonoverlapping(buffer.as_ptr() as *const c_void,
-							virt_ptr as *mut c_void, memory::PAGE_SIZE);
-					} else {
-						util::bzero(virt_ptr, memory::PAGE_SIZE);
-					}
+		// The data to be copied to the new page. If None, the page is zeroed
+		let src = if cow {
+			cow_buffer.or_else(|| prev_phys_ptr.and_then(get_kernel_ptr))
+				.map(| ptr | ptr as *const c_void)
+		} else {
+			None
+		};
+
+		// Initializing the page's content through the kernel's mapping if possible, which avoids
+		// switching the virtual memory context
+		let init_page = move | dest: *mut c_void | unsafe {
+			if let Some(src) = src {
+				util::page_copy(dest, src);
+			} else {
+				util::page_zero(dest);
+			}
+		};
+		if let Some(dest) = get_kernel_ptr(new_phys_ptr) {
+			init_page(dest);
+		} else {
+			unsafe {
+				vmem::switch(vmem, move || {
+					vmem::write_lock_wrap(|| init_page(virt_ptr));
 				});
-			});
+			}
 		}
 
 		Ok(())
 	}
 
 	/// Frees the physical page at offset `offset` of the mapping.
-	/// If the page is shared, it is not freed but the reference counter is decreased.
+	/// If the page is still referenced elsewhere (by another mapping or by the page cache), it is
+	/// not freed but the reference counter is decreased.
+	/// If the page table is shared with another memory space, it is copied first since the page
+	/// remains referenced by the shared table.
+	/// If the mapping writes to its file, the page is written back to it. On failure, the page
+	/// remains dirty in the page cache, which writes it back later.
 	fn free_phys_page(&mut self, offset: usize) {
 		let vmem = self.get_mut_vmem();
 		let virt_ptr = (self.begin as usize + offset * memory::PAGE_SIZE) as *const c_void;
 
-		if let Some(phys_ptr) = vmem.translate(virt_ptr) {
-			{
-				let mut ref_counter = super::PHYSICAL_REF_COUNTER.lock();
-				ref_counter.get_mut().decrement(phys_ptr);
-			}
+		oom::wrap(|| vmem.unshare(virt_ptr));
+		let Some(phys_ptr) = vmem.translate(virt_ptr) else {
+			return;
+		};
+		{
+			let mut ref_counter_guard = super::PHYSICAL_REF_COUNTER.lock();
+			let ref_counter = ref_counter_guard.get_mut();
+			ref_counter.decrement(phys_ptr);
 
-			if !self.is_shared(offset) {
-				let allocated = phys_ptr != get_default_page();
-				if allocated {
-					buddy::free(phys_ptr, 0);
-				}
+			let allocated = phys_ptr != get_default_page();
+			if allocated && ref_counter.get_ref_count(phys_ptr) == 0 {
+				buddy::free(phys_ptr, 0);
 			}
 		}
+
+		if let Some(file) = self.file.as_ref().filter(| _ | self.is_file_writer()) {
+			let file_page = self.off / memory::PAGE_SIZE as u64 + offset as u64;
+			let _ = file.write_back(file_page);
+		}
 	}
 
 	/// Unmaps the mapping from the given virtual memory context.
@@ -371,6 +578,80 @@ impl MemMapping {
 		(prev, gap, next)
 	}
 
+	/// Splits the mapping at page offset `off`, which must be strictly between zero and the size
+	/// of the mapping. The physical pages are left untouched and now belong to the returned
+	/// mappings, located respectively before and after the offset.
+	pub fn split(mut self, off: usize) -> (Self, Self) {
+		debug_assert!(off > 0 && off < self.size);
+
+		let next_begin = unsafe {
+			self.begin.add(off * memory::PAGE_SIZE)
+		};
+		let next_off = self.off + (off * memory::PAGE_SIZE) as u64;
+
+		let prev = Self::new(self.begin, off, self.flags, self.file.clone(), self.off, self.vmem);
+		let next = Self::new(next_begin, self.size - off, self.flags, self.file.clone(), next_off,
+			self.vmem);
+		self.unmap_on_drop = false;
+
+		(prev, next)
+	}
+
+	/// Creates a mapping of `size` pages located right after the current one, with the same flags
+	/// and pointing to the rest of the same file, if any.
+	/// The returned mapping is not mapped in the virtual memory context.
+	pub fn new_after(&self, size: usize) -> Self {
+		let begin = unsafe {
+			self.begin.add(self.size * memory::PAGE_SIZE)
+		};
+		let off = self.off + (self.size * memory::PAGE_SIZE) as u64;
+
+		Self::new(begin, size, self.flags, self.file.clone(), off, self.vmem)
+	}
+
+	/// Tells whether the mapping `next` can be merged into the current one. Only adjacent
+	/// anonymous mappings with the same flags are merged, to keep the number of mappings low.
+	pub fn can_merge(&self, next: &Self) -> bool {
+		let end = self.begin as usize + self.size * memory::PAGE_SIZE;
+		end == next.begin as usize && self.flags == next.flags
+			&& self.file.is_none() && next.file.is_none()
+	}
+
+	/// Merges the mapping `next`, which must begin right after the current one, into the current
+	/// one. The physical pages of `next` now belong to the current mapping.
+	pub fn merge(&mut self, mut next: Self) {
+		debug_assert_eq!(self.begin as usize + self.size * memory::PAGE_SIZE,
+			next.begin as usize);
+
+		self.size += next.size;
+		next.unmap_on_drop = false;
+	}
+
+	/// Moves the mapping to the virtual address `begin`, moving its physical pages without copying
+	/// them. The destination range must not be mapped.
+	/// The function doesn't flush the virtual memory context.
+	pub fn relocate(&mut self, begin: *const c_void) {
+		let vmem = self.get_mut_vmem();
+
+		for i in 0..self.size {
+			let old_ptr = (self.begin as usize + i * memory::PAGE_SIZE) as *const c_void;
+			let new_ptr = (begin as usize + i * memory::PAGE_SIZE) as *const c_void;
+
+			// The reference to the page must be owned by the context's table before moving it
+			oom::wrap(|| vmem.unshare(old_ptr));
+			let Some(phys_ptr) = vmem.translate(old_ptr) else {
+				continue;
+			};
+			let allocated = phys_ptr != get_default_page();
+			let flags = self.get_vmem_flags(allocated, i);
+
+			oom::wrap(|| vmem.map(phys_ptr, new_ptr, flags));
+			oom::wrap(|| vmem.unmap(old_ptr));
+		}
+
+		self.begin = begin;
+	}
+
 	/// Updates the virtual memory context according to the mapping for the page at offset
 	/// `offset`.
 	pub fn update_vmem(&mut self, offset: usize) {
@@ -385,22 +666,13 @@ impl MemMapping {
 		}
 	}
 
-	/// After a fork operation failed, frees the pages that were already allocated.
-	/// `n` is the number of pages to free from the beginning.
-	pub fn fork_fail_clean(&self, ref_counter: &mut PhysRefCounter, n: usize) {
-		for i in 0..n {
-			if let Some(phys_ptr) = self.get_physical_page(i) {
-				ref_counter.decrement(phys_ptr);
-			}
-		}
-	}
-
 	/// Clones the mapping for the fork operation. The other mapping is sharing the same physical
 	/// memory for Copy-On-Write.
 	/// `container` is the container in which the new mapping is to be inserted.
-	/// The virtual memory context has to be updated after calling this function.
+	/// The virtual memory context of `mem_space` must be a clone of the mapping's context. Since
+	/// page tables are shared by both contexts, the physical pages need no additional reference.
 	/// The function returns a mutable reference to the newly created mapping.
-	pub fn fork<'a>(&mut self, mem_space: &'a mut MemSpace) -> Result<&'a mut Self, Errno> {
+	pub fn fork<'a>(&self, mem_space: &'a mut MemSpace) -> Result<&'a mut Self, Errno> {
 		let mut new_mapping = Self {
 			begin: self.begin,
 			size: self.size,
@@ -418,32 +690,45 @@ impl MemMapping {
 		if nolazy {
 			for i in 0..self.size {
 				let virt_ptr = (self.begin as usize + i * memory::PAGE_SIZE) as *const c_void;
+				new_mapping.free_phys_page(i);
 				new_mapping.get_mut_vmem().unmap(virt_ptr)?;
 				new_mapping.map(i)?;
 			}
-		} else {
-			let mut ref_counter_guard = super::PHYSICAL_REF_COUNTER.lock();
-			let ref_counter = ref_counter_guard.get_mut();
-
-			for i in 0..self.size {
-				if let Some(phys_ptr) = self.get_physical_page(i) {
-					if let Err(errno) = ref_counter.increment(phys_ptr) {
-						self.fork_fail_clean(ref_counter, i);
-						return Err(errno);
-					}
-				}
-			}
 		}
 
 		mem_space.mappings.insert(new_mapping.get_begin(), new_mapping)
 	}
 
+	/// Makes the pages of the mapping writable again after the memory space has been forked, if
+	/// the mapping is nolazy.
+	/// Forking makes the page tables read-only until the first write fault. Nolazy mappings, such
+	/// as kernel stacks, must remain writable since they are written without expecting faults.
+	/// Their pages are not shared since the new mapping has its own copy.
+	pub fn restore_nolazy(&mut self) -> Result<(), Errno> {
+		if self.flags & super::MAPPING_FLAG_NOLAZY == 0 {
+			return Ok(());
+		}
+
+		for i in 0..self.size {
+			let virt_ptr = (self.begin as usize + i * memory::PAGE_SIZE) as *const c_void;
+			self.get_mut_vmem().unshare(virt_ptr)?;
+			self.update_vmem(i);
+		}
+
+		Ok(())
+	}
+
 	/// Synchronizes the data on the memory mapping back to the filesystem. If the mapping is not
-	/// associated with a file, the function does nothing.
+	/// associated with a file or is private, the function does nothing.
 	pub fn fs_sync(&mut self) -> Result<(), Errno> {
-		if let Some(_file) = &self.file {
-			// TODO
-			todo!();
+		let Some(file) = self.file.as_ref().filter(| _ | self.is_file_writer()) else {
+			return Ok(());
+		};
+
+		// Pages of a shared mapping are the pages of the page cache
+		let begin = self.off / memory::PAGE_SIZE as u64;
+		for i in 0..self.size {
+			file.write_back(begin + i as u64)?;
 		}
 
 		Ok(())
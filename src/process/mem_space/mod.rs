@@ -4,13 +4,18 @@
 //! The memory space contains two types of structures:
 //! - Mapping: A chunk of virtual memory that is allocated
 //! - Gap: A chunk of virtual memory that is available to be allocated
+//!
+//! Gaps are stored in an interval tree augmented with the size of the largest gap of each
+//! subtree, which allows to find a gap for a new mapping in logarithmic time.
 
 mod gap;
 mod mapping;
 mod physical_ref_counter;
+pub mod copy;
 pub mod ptr;
 
 use core::cmp::Ordering;
+use core::cmp::max;
 use core::cmp::min;
 use core::ffi::c_void;
 use core::fmt;
@@ -19,7 +24,7 @@ use core::ptr::NonNull;
 use core::ptr::null;
 use crate::errno::Errno;
 use crate::errno;
-use crate::file::open_file::OpenFile;
+use crate::file::page_cache::CachedFile;
 use crate::memory::stack;
 use crate::memory::vmem::VMem;
 use crate::memory::vmem;
@@ -27,10 +32,10 @@ use crate::memory;
 use crate::process::oom;
 use crate::util::FailableClone;
 use crate::util::boxed::Box;
+use crate::util::container::interval_tree::IntervalTree;
 use crate::util::container::map::Map;
 use crate::util::lock::Mutex;
 use crate::util::math;
-use crate::util::ptr::SharedPtr;
 use crate::util;
 use gap::MemGap;
 use mapping::MemMapping;
@@ -69,11 +74,9 @@ pub enum MapConstraint {
 
 /// Structure representing the virtual memory space of a context.
 pub struct MemSpace {
-	/// Binary tree storing the list of memory gaps, ready for new mappings. Sorted by pointer to
-	/// the beginning of the mapping on the virtual memory.
-	gaps: Map<*const c_void, MemGap>,
-	/// Binary tree storing the list of memory gaps, sorted by size and then by beginning address.
-	gaps_size: Map<(usize, *const c_void), ()>,
+	/// Interval tree storing the list of memory gaps, ready for new mappings. Intervals are in
+	/// pages.
+	gaps: IntervalTree<MemGap>,
 
 	/// Binary tree storing the list of memory mappings. Sorted by pointer to the beginning of the
 	/// mapping on the virtual memory.
@@ -91,58 +94,47 @@ pub struct MemSpace {
 impl MemSpace {
 	/// Inserts the given gap into the memory space's structures.
 	fn gap_insert(&mut self, gap: MemGap) -> Result<(), Errno> {
-		let gap_ptr = gap.get_begin();
-		let g = self.gaps.insert(gap_ptr, gap)?;
-
-		if let Err(e) = self.gaps_size.insert((g.get_size(), gap_ptr), ()) {
-			self.gaps.remove(gap_ptr);
-			return Err(e);
-		}
-
-		Ok(())
+		let begin = gap.get_begin() as usize / memory::PAGE_SIZE;
+		self.gaps.insert(begin, gap.get_size(), gap)
 	}
 
 	/// Removes the given gap from the memory space's structures.
 	/// The function returns the removed gap. If the gap didn't exist, the function returns None.
 	fn gap_remove(&mut self, gap_begin: *const c_void) -> Option<MemGap> {
-		let g = self.gaps.remove(gap_begin)?;
-		self.gaps_size.remove((g.get_size(), gap_begin));
-
-		Some(g)
+		self.gaps.remove(gap_begin as usize / memory::PAGE_SIZE)
 	}
 
-	/// Returns a reference to a gap with at least size `size`.
-	/// `gaps` is the binary tree storing gaps, sorted by pointer to their respective beginnings.
-	/// `gaps_size` is the binary tree storing pointers to gaps, sorted by gap sizes.
+	/// Returns a reference to the gap with the lowest address with at least size `size`.
+	/// `gaps` is the tree storing gaps.
 	/// `size` is the minimum size of the gap.
 	/// If no gap large enough is available, the function returns None.
-	fn gap_get<'a>(gaps: &'a Map<*const c_void, MemGap>,
-		gaps_size: &Map<(usize, *const c_void), ()>, size: usize) -> Option<&'a MemGap> {
-		let (_, ptr) = gaps_size.get_min((size, 0 as _))?.0;
-		let gap = gaps.get(*ptr).unwrap();
+	fn gap_get(gaps: &IntervalTree<MemGap>, size: usize) -> Option<&MemGap> {
+		let gap = gaps.get_first_fit(size)?;
 		debug_assert!(gap.get_size() >= size);
 
 		Some(gap)
 	}
 
 	/// Returns a reference to the gap containing the pointer `ptr`.
-	/// `gaps` is the binary tree storing gaps, sorted by pointer to their respective beginnings.
+	/// `gaps` is the tree storing gaps.
 	/// `ptr` is the pointer.
 	/// If no gap contain the pointer, the function returns None.
-	fn gap_by_ptr<'a>(gaps: &'a Map<*const c_void, MemGap>, ptr: *const c_void)
-		-> Option<&'a MemGap> {
-		gaps.cmp_get(| key, value | {
-			let begin = *key;
-			let end = (begin as usize + value.get_size() * memory::PAGE_SIZE) as *const c_void;
+	fn gap_by_ptr(gaps: &IntervalTree<MemGap>, ptr: *const c_void) -> Option<&MemGap> {
+		gaps.get_containing(ptr as usize / memory::PAGE_SIZE)
+	}
 
-			if ptr >= begin && ptr < end {
-				Ordering::Equal
-			} else if ptr < begin {
-				Ordering::Less
-			} else {
-				Ordering::Greater
-			}
-		})
+	/// Removes `size` pages at offset `off` from the gap beginning at `gap_begin`, which must
+	/// exist. The remaining parts of the gap are inserted back.
+	fn gap_consume(&mut self, gap_begin: *const c_void, off: usize, size: usize) {
+		let gap = self.gap_remove(gap_begin).unwrap();
+		let (left_gap, right_gap) = gap.consume(off, size);
+
+		if let Some(new_gap) = left_gap {
+			oom::wrap(|| self.gap_insert(new_gap.clone()));
+		}
+		if let Some(new_gap) = right_gap {
+			oom::wrap(|| self.gap_insert(new_gap.clone()));
+		}
 	}
 
 	/// Returns a new binary tree containing the default gaps for a memory space.
@@ -152,22 +144,11 @@ impl MemSpace {
 		self.gap_insert(MemGap::new(begin, size))
 	}
 
-	/// Clones the `gaps_size` field.
-	fn gaps_size_clone(&self) -> Result<Map<(usize, *const c_void), ()>, Errno> {
-		let mut gaps_size = Map::new();
-		for (g, _) in &self.gaps_size {
-			gaps_size.insert(g.clone(), ())?;
-		}
-
-		Ok(gaps_size)
-	}
-
 	/// Creates a new virtual memory object.
 	/// `brk_ptr` is the initial pointer for the `brk` syscall.
 	pub fn new() -> Result::<Self, Errno> {
 		let mut s = Self {
-			gaps: Map::new(),
-			gaps_size: Map::new(),
+			gaps: IntervalTree::new(),
 
 			mappings: Map::new(),
 
@@ -190,7 +171,7 @@ impl MemSpace {
 	/// `map_constraint` is the constraint to fullfill for the allocation.
 	/// `size` represents the size of the mapping in number of memory pages.
 	/// `flags` represents the flags for the mapping.
-	/// `file` is the open file to map to.
+	/// `file` is the file to map to. Its pages are mapped directly from the page cache.
 	/// `file_off` is the offset in bytes into the file.
 	/// The underlying physical memory is not allocated directly but only when an attempt to write
 	/// the memory is detected.
@@ -198,7 +179,7 @@ impl MemSpace {
 	/// The function has complexity `O(log n)`.
 	/// If the given pointer is not page-aligned, the function returns an error.
 	pub fn map(&mut self, map_constraint: MapConstraint, size: usize, flags: u8,
-		file: Option<SharedPtr<OpenFile>>, file_off: u64) -> Result<*mut c_void, Errno> {
+		file: Option<CachedFile>, file_off: u64) -> Result<*mut c_void, Errno> {
 		// Checking arguments are valid
 		match map_constraint {
 			MapConstraint::Fixed(ptr) | MapConstraint::Hint(ptr) => {
@@ -223,7 +204,16 @@ impl MemSpace {
 			MapConstraint::Fixed(ptr) => {
 				self.unmap(ptr, size, false)?;
 
-				MappingInfo::Addr(ptr as _)
+				// After unmapping, the range is part of a gap unless it is out of the space
+				// available for allocations
+				let gap = Self::gap_by_ptr(&self.gaps, ptr).and_then(| gap | {
+					let off = (ptr as usize - gap.get_begin() as usize) / memory::PAGE_SIZE;
+					(off + size <= gap.get_size()).then_some((gap, off))
+				});
+				match gap {
+					Some((gap, off)) => MappingInfo::GapPosition(gap, off),
+					None => MappingInfo::Addr(ptr as _),
+				}
 			},
 
 			MapConstraint::Hint(ptr) => {
@@ -240,11 +230,26 @@ impl MemSpace {
 			},
 
 			MapConstraint::None => {
-				// Getting a gap large enough
-				let gap = Self::gap_get(&self.gaps, &self.gaps_size, size)
-					.ok_or_else(|| errno!(ENOMEM))?;
-
-				MappingInfo::GapPosition(gap, 0)
+				// Large anonymous mappings are aligned on the boundary of large blocks (PSE) so
+				// that their memory can be backed by large frames
+				let block_pages = vmem::x86::PSE_PAGES;
+				let aligned = if file.is_none() && size >= block_pages {
+					Self::gap_get(&self.gaps, size + block_pages - 1).map(| gap | {
+						let begin = gap.get_begin() as usize / memory::PAGE_SIZE;
+						(gap, (block_pages - begin % block_pages) % block_pages)
+					})
+				} else {
+					None
+				};
+
+				if let Some((gap, off)) = aligned {
+					MappingInfo::GapPosition(gap, off)
+				} else {
+					// Getting a gap large enough
+					let gap = Self::gap_get(&self.gaps, size).ok_or_else(|| errno!(ENOMEM))?;
+
+					MappingInfo::GapPosition(gap, 0)
+				}
 			}
 		};
 
@@ -269,24 +274,9 @@ impl MemSpace {
 		}
 
 		// Splitting the old gap to fit the mapping if needed
-		match mapping_infos {
-			MappingInfo::GapPosition(gap, off) => {
-				let (left_gap, right_gap) = gap.consume(off, size);
-
-				// Removing the old gap
-				let gap_begin = gap.get_begin();
-				self.gap_remove(gap_begin);
-
-				// Inserting the new gaps
-				if let Some(new_gap) = left_gap {
-					oom::wrap(|| self.gap_insert(new_gap.clone()));
-				}
-				if let Some(new_gap) = right_gap {
-					oom::wrap(|| self.gap_insert(new_gap.clone()));
-				}
-			},
-
-			_ => {},
+		if let MappingInfo::GapPosition(gap, off) = mapping_infos {
+			let gap_begin = gap.get_begin();
+			self.gap_consume(gap_begin, off, size);
 		}
 
 		Ok(addr)
@@ -356,7 +346,85 @@ impl MemSpace {
 		Self::get_mapping_mut_for_(&mut self.mappings, ptr)
 	}
 
-	// TODO Optimize (currently O(n log n))
+	/// Returns the mapping containing the virtual address `ptr` or, if no mapping contains it, the
+	/// first mapping after it.
+	/// `mappings` is the container of mappings.
+	fn get_mapping_from_(mappings: &Map<*const c_void, MemMapping>, ptr: *const c_void)
+		-> Option<&MemMapping> {
+		Self::get_mapping_for_(mappings, ptr).or_else(|| mappings.get_min(ptr).map(| (_, m) | m))
+	}
+
+	/// Inserts the gap `gap` after unmapping memory, merging it with the adjacent gaps.
+	fn gap_insert_merge(&mut self, mut gap: MemGap) {
+		// Merging previous gap
+		if !gap.get_begin().is_null() {
+			let prev_gap = Self::gap_by_ptr(&self.gaps, unsafe {
+				gap.get_begin().sub(1)
+			});
+
+			if let Some(p) = prev_gap {
+				let begin = p.get_begin();
+				let p = self.gap_remove(begin).unwrap();
+
+				gap.merge(p);
+			}
+		}
+
+		// Merging next gap
+		let next_gap = Self::gap_by_ptr(&self.gaps, gap.get_end());
+		if let Some(n) = next_gap {
+			let begin = n.get_begin();
+			let n = self.gap_remove(begin).unwrap();
+
+			gap.merge(n);
+		}
+
+		oom::wrap(|| self.gap_insert(gap.clone()));
+	}
+
+	/// Inserts the mapping `mapping`, which has been taken out of the memory space to be split or
+	/// modified.
+	fn mapping_insert_split(&mut self, mut mapping: MemMapping) {
+		// TODO Clean (the set_unmap_on_drop is used to avoid double unmapping because of the call
+		// to drop if the insertion fails)
+		oom::wrap(|| {
+			let mut val = mapping.clone();
+			val.set_unmap_on_drop(false);
+			let val = self.mappings.insert(val.get_begin(), val)?;
+			val.set_unmap_on_drop(true);
+			mapping.set_unmap_on_drop(false);
+
+			Ok(())
+		});
+	}
+
+	/// Same as `mapping_insert_split`, except the mapping is merged with the adjacent mappings if
+	/// possible.
+	fn mapping_insert_merge(&mut self, mut mapping: MemMapping) {
+		// Merging previous mapping
+		let prev = Self::get_mapping_for_(&self.mappings, (mapping.get_begin() as usize)
+			.wrapping_sub(1) as _)
+			.filter(| p | p.can_merge(&mapping))
+			.map(| p | p.get_begin());
+		if let Some(begin) = prev {
+			let mut p = self.mappings.remove(begin).unwrap();
+			p.merge(mapping);
+			mapping = p;
+		}
+
+		// Merging next mapping
+		let end = mapping.get_begin() as usize + mapping.get_size() * memory::PAGE_SIZE;
+		let next = Self::get_mapping_for_(&self.mappings, end as _)
+			.filter(| n | mapping.can_merge(n))
+			.map(| n | n.get_begin());
+		if let Some(begin) = next {
+			let n = self.mappings.remove(begin).unwrap();
+			mapping.merge(n);
+		}
+
+		self.mapping_insert_split(mapping);
+	}
+
 	/// Unmaps the given mapping of memory.
 	/// `ptr` represents the aligned address of the beginning of the chunk to unmap.
 	/// `size` represents the size of the mapping in number of memory pages.
@@ -365,6 +433,8 @@ impl MemSpace {
 	/// several other memory mappings.
 	/// After this function returns, the access to the mapping of memory shall be revoked and
 	/// further attempts to access it shall result in a page fault.
+	/// The function has complexity `O(k log n)`, where `k` is the number of mappings in the
+	/// range.
 	pub fn unmap(&mut self, ptr: *const c_void, size: usize, brk: bool) -> Result<(), Errno> {
 		if !util::is_aligned(ptr, memory::PAGE_SIZE) {
 			return Err(errno!(EINVAL));
@@ -372,92 +442,48 @@ impl MemSpace {
 		if size == 0 {
 			return Ok(());
 		}
+		let end = (ptr as usize).checked_add(size * memory::PAGE_SIZE)
+			.ok_or_else(|| errno!(EINVAL))?;
 
 		// Removing every mappings in the chunk to unmap
-		let mut i = 0;
-		while i < size {
-			// The pointer of the page
-			let page_ptr = (ptr as usize + i * memory::PAGE_SIZE) as *const _;
-
-			// The mapping containing the page
-			if let Some(mapping) = Self::get_mapping_mut_for_(&mut self.mappings, page_ptr) {
-				// The pointer to the beginning of the mapping
-				let mapping_ptr = mapping.get_begin();
-
-				// The offset in the mapping of the beginning of pages to unmap
-				let begin = (page_ptr as usize - mapping_ptr as usize)
-					/ memory::PAGE_SIZE;
-				// The number of pages to unmap in the mapping
-				let pages = min(size - i, mapping.get_size() - begin);
-
-				// Removing the mapping
-				let mapping = self.mappings.remove(mapping_ptr).unwrap();
-
-				// Newly created mappings and gap after removing parts of the previous one
-				let (prev, gap, next) = mapping.partial_unmap(begin, pages);
-
-				if let Some(mut p) = prev {
-					// TODO Clean (the set_unmap_on_drop is used to avoid double unmapping because
-					// of the call to drop if the insertion fails)
-					oom::wrap(|| {
-						let mut val = p.clone();
-						val.set_unmap_on_drop(false);
-						let val = self.mappings.insert(val.get_begin(), val)?;
-						val.set_unmap_on_drop(true);
-						p.set_unmap_on_drop(false);
-
-						Ok(())
-					});
-				}
+		let mut cur = ptr as usize;
+		while cur < end {
+			// The mapping containing the current page or the next one
+			let Some(mapping) = Self::get_mapping_from_(&self.mappings, cur as _) else {
+				break;
+			};
+			// The pointer to the beginning of the mapping
+			let mapping_ptr = mapping.get_begin();
+			if mapping_ptr as usize >= end {
+				break;
+			}
 
-				if !brk {
-					// Inserting gap
-					if let Some(mut gap) = gap {
-						// Merging previous gap
-						if !gap.get_begin().is_null() {
-							let prev_gap = Self::gap_by_ptr(&self.gaps, unsafe {
-								gap.get_begin().sub(1)
-							});
-
-							if let Some(p) = prev_gap {
-								let begin = p.get_begin();
-								let p = self.gap_remove(begin).unwrap();
-
-								gap.merge(p);
-							}
-						}
-
-						// Merging next gap
-						let next_gap = Self::gap_by_ptr(&self.gaps, gap.get_end());
-						if let Some(n) = next_gap {
-							let begin = n.get_begin();
-							let n = self.gap_remove(begin).unwrap();
-
-							gap.merge(n);
-						}
-
-						oom::wrap(|| self.gap_insert(gap.clone()));
-					}
-				}
+			// The pointer to the first page to unmap in the mapping
+			let page_ptr = max(cur, mapping_ptr as usize);
+			// The offset in the mapping of the beginning of pages to unmap
+			let begin = (page_ptr - mapping_ptr as usize) / memory::PAGE_SIZE;
+			// The number of pages to unmap in the mapping
+			let pages = min((end - page_ptr) / memory::PAGE_SIZE, mapping.get_size() - begin);
 
-				if let Some(mut n) = next {
-					// TODO Clean (the set_unmap_on_drop is used to avoid double unmapping because
-					// of the call to drop if the insertion fails)
-					oom::wrap(|| {
-						let mut val = n.clone();
-						val.set_unmap_on_drop(false);
-						let val = self.mappings.insert(val.get_begin(), val)?;
-						val.set_unmap_on_drop(true);
-						n.set_unmap_on_drop(false);
-
-						Ok(())
-					});
-				}
+			// Removing the mapping
+			let mapping = self.mappings.remove(mapping_ptr).unwrap();
 
-				i += pages;
-			} else {
-				i += 1;
+			// Newly created mappings and gap after removing parts of the previous one
+			let (prev, gap, next) = mapping.partial_unmap(begin, pages);
+
+			if let Some(p) = prev {
+				self.mapping_insert_split(p);
 			}
+			if !brk {
+				if let Some(gap) = gap {
+					self.gap_insert_merge(gap);
+				}
+			}
+			if let Some(n) = next {
+				self.mapping_insert_split(n);
+			}
+
+			cur = page_ptr + pages * memory::PAGE_SIZE;
 		}
 
 		// Unmapping the chunk from virtual memory
@@ -467,38 +493,188 @@ impl MemSpace {
 		Ok(())
 	}
 
-	// TODO Optimize (use MMU)
+	/// Changes the access flags of the memory beginning at `ptr` of size `size` in pages.
+	/// `flags` is the new value of the flags `MAPPING_FLAG_WRITE`, `MAPPING_FLAG_EXEC` and
+	/// `MAPPING_FLAG_USER`. The other flags of the mappings are left untouched.
+	/// Mappings are split at the boundaries of the range, then merged back with their neighbours
+	/// when they end up with the same flags.
+	/// If a page in the range is not mapped, the function returns an error and the memory space
+	/// is left unchanged.
+	/// The function has complexity `O(k log n + p)`, where `k` is the number of mappings in the
+	/// range and `p` the number of pages.
+	pub fn protect(&mut self, ptr: *const c_void, size: usize, flags: u8) -> Result<(), Errno> {
+		if !util::is_aligned(ptr, memory::PAGE_SIZE) {
+			return Err(errno!(EINVAL));
+		}
+		let end = size.checked_mul(memory::PAGE_SIZE)
+			.and_then(| len | (ptr as usize).checked_add(len))
+			.ok_or_else(|| errno!(ENOMEM))?;
+
+		// Checking the whole range is mapped
+		let mut cur = ptr as usize;
+		while cur < end {
+			let mapping = Self::get_mapping_for_(&self.mappings, cur as _)
+				.ok_or_else(|| errno!(ENOMEM))?;
+			cur = mapping.get_begin() as usize + mapping.get_size() * memory::PAGE_SIZE;
+		}
+
+		let mask = MAPPING_FLAG_WRITE | MAPPING_FLAG_EXEC | MAPPING_FLAG_USER;
+		let mut cur = ptr as usize;
+		while cur < end {
+			let mapping = Self::get_mapping_for_(&self.mappings, cur as _).unwrap();
+			let mapping_ptr = mapping.get_begin();
+			let mapping_end = mapping_ptr as usize + mapping.get_size() * memory::PAGE_SIZE;
+			let next = min(end, mapping_end);
+
+			if mapping.get_flags() & mask == flags {
+				cur = next;
+				continue;
+			}
+
+			// The offset in the mapping of the beginning of the range
+			let begin = (cur - mapping_ptr as usize) / memory::PAGE_SIZE;
+			// The number of pages of the range in the mapping
+			let pages = (next - cur) / memory::PAGE_SIZE;
+
+			let mut mapping = self.mappings.remove(mapping_ptr).unwrap();
+			if begin > 0 {
+				let (prev, m) = mapping.split(begin);
+				self.mapping_insert_split(prev);
+				mapping = m;
+			}
+			if pages < mapping.get_size() {
+				let (m, next) = mapping.split(pages);
+				self.mapping_insert_split(next);
+				mapping = m;
+			}
+
+			mapping.set_flags((mapping.get_flags() & !mask) | flags);
+			for i in 0..pages {
+				mapping.update_vmem(i);
+			}
+			self.mapping_insert_merge(mapping);
+
+			cur = next;
+		}
+
+		Ok(())
+	}
+
+	/// Resizes the memory beginning at `ptr` of size `size` in pages to `new_size` pages. The
+	/// range must be contained in a single mapping.
+	/// If the range cannot grow in place and `may_move` is set, the range is moved to another
+	/// place in the memory space by moving its physical pages, without copying them.
+	/// The function returns the new address of the range.
+	pub fn remap(&mut self, ptr: *const c_void, size: usize, new_size: usize, may_move: bool)
+		-> Result<*const c_void, Errno> {
+		if !util::is_aligned(ptr, memory::PAGE_SIZE) || size == 0 || new_size == 0 {
+			return Err(errno!(EINVAL));
+		}
+		let end = size.checked_mul(memory::PAGE_SIZE)
+			.and_then(| len | (ptr as usize).checked_add(len))
+			.ok_or_else(|| errno!(EFAULT))?;
+
+		let mapping = Self::get_mapping_for_(&self.mappings, ptr).ok_or_else(|| errno!(EFAULT))?;
+		let mapping_ptr = mapping.get_begin();
+		let mapping_end = mapping_ptr as usize + mapping.get_size() * memory::PAGE_SIZE;
+		if end > mapping_end {
+			return Err(errno!(EFAULT));
+		}
+
+		// Shrinking
+		if new_size <= size {
+			let tail = (ptr as usize + new_size * memory::PAGE_SIZE) as *const c_void;
+			self.unmap(tail, size - new_size, false)?;
+			return Ok(ptr);
+		}
+		let extra = new_size - size;
+
+		// Growing in place if the pages following the mapping are free
+		if end == mapping_end {
+			let gap = Self::gap_by_ptr(&self.gaps, end as _).and_then(| gap | {
+				let off = (end - gap.get_begin() as usize) / memory::PAGE_SIZE;
+				(off + extra <= gap.get_size()).then_some((gap.get_begin(), off))
+			});
+
+			if let Some((gap_begin, off)) = gap {
+				let mut ext = mapping.new_after(extra);
+				ext.map_default()?;
+
+				self.gap_consume(gap_begin, off, extra);
+				self.mappings.get_mut(mapping_ptr).unwrap().merge(ext);
+				return Ok(ptr);
+			}
+		}
+		if !may_move {
+			return Err(errno!(ENOMEM));
+		}
+
+		// Moving the range to a gap large enough
+		let new_ptr = Self::gap_get(&self.gaps, new_size).ok_or_else(|| errno!(ENOMEM))?
+			.get_begin();
+		self.gap_consume(new_ptr, 0, new_size);
+
+		// Isolating the range from the rest of the mapping
+		let mut mapping = self.mappings.remove(mapping_ptr).unwrap();
+		if ptr > mapping_ptr {
+			let off = (ptr as usize - mapping_ptr as usize) / memory::PAGE_SIZE;
+			let (prev, m) = mapping.split(off);
+			self.mapping_insert_split(prev);
+			mapping = m;
+		}
+		if size < mapping.get_size() {
+			let (m, next) = mapping.split(size);
+			self.mapping_insert_split(next);
+			mapping = m;
+		}
+
+		mapping.relocate(new_ptr);
+		let mut ext = mapping.new_after(extra);
+		if let Err(e) = ext.map_default() {
+			mapping.relocate(ptr);
+			self.mapping_insert_merge(mapping);
+			self.gap_insert_merge(MemGap::new(new_ptr, new_size));
+			return Err(e);
+		}
+		mapping.merge(ext);
+		self.mapping_insert_split(mapping);
+
+		self.gap_insert_merge(MemGap::new(ptr, size));
+		Ok(new_ptr)
+	}
+
 	/// Tells whether the given mapping of memory `ptr` of size `size` in bytes can be accessed.
 	/// `user` tells whether the memory must be accessible from userspace or just kernelspace.
 	/// `write` tells whether to check for write permission.
+	/// The function has complexity `O(k log n)`, where `k` is the number of mappings in the
+	/// range.
 	pub fn can_access(&self, ptr: *const u8, size: usize, user: bool, write: bool) -> bool {
 		// TODO Allow reading kernelspace data that is available to userspace
 
-		let mut i = 0;
-
-		while i < size {
-			// The beginning of the current page
-			let page_begin = util::down_align((ptr as usize + i) as _, memory::PAGE_SIZE);
+		let Some(end) = (ptr as usize).checked_add(size) else {
+			return false;
+		};
 
-			if let Some(mapping) = Self::get_mapping_for_(&self.mappings, page_begin) {
-				let flags = mapping.get_flags();
-				if write && (flags & MAPPING_FLAG_WRITE == 0) {
-					return false;
-				}
-				if user && (flags & MAPPING_FLAG_USER == 0) {
-					return false;
-				}
+		let mut cur = ptr as usize;
+		while cur < end {
+			let Some(mapping) = Self::get_mapping_for_(&self.mappings, cur as _) else {
+				return false;
+			};
 
-				i += mapping.get_size() * memory::PAGE_SIZE;
-			} else {
+			let flags = mapping.get_flags();
+			if write && (flags & MAPPING_FLAG_WRITE == 0) {
 				return false;
 			}
+			if user && (flags & MAPPING_FLAG_USER == 0) {
+				return false;
+			}
+
+			cur = mapping.get_begin() as usize + mapping.get_size() * memory::PAGE_SIZE;
 		}
 
 		true
 	}
 
-	// TODO Optimize (use MMU)
 	/// Tells whether the given zero-terminated string beginning at `ptr` can be accessed.
 	/// `user` tells whether the memory must be accessible from userspace or just kernelspace.
 	/// `write` tells whether to check for write permission.
@@ -510,39 +686,31 @@ impl MemSpace {
 		unsafe {
 			vmem::switch(self.vmem.as_ref(), move || {
 				let mut i = 0;
-				'outer: loop {
+				loop {
 					// Safe because not dereferenced before checking if accessible
 					let curr_ptr = ptr.add(i);
 
-					if let Some(mapping) = Self::get_mapping_for_(&self.mappings, curr_ptr as _) {
-						let flags = mapping.get_flags();
-						if write && (flags & MAPPING_FLAG_WRITE == 0) {
-							return None;
-						}
-						if user && (flags & MAPPING_FLAG_USER == 0) {
-							return None;
-						}
-
-						// The beginning of the current page
-						let page_begin = util::down_align(curr_ptr as _, memory::PAGE_SIZE);
-						// The offset of the current pointer in its page
-						let inner_off = curr_ptr as usize - page_begin as usize;
-						let check_size = memory::PAGE_SIZE - inner_off;
-
-						// Looking for the null byte
-						for j in 0..check_size {
-							let c = *curr_ptr.add(j);
-
-							// TODO Optimize by checking several bytes at a time
-							if c == b'\0' {
-								break 'outer;
-							}
-
-							i += 1;
-						}
-					} else {
+					let mapping = Self::get_mapping_for_(&self.mappings, curr_ptr as _)?;
+					let flags = mapping.get_flags();
+					if write && (flags & MAPPING_FLAG_WRITE == 0) {
 						return None;
 					}
+					if user && (flags & MAPPING_FLAG_USER == 0) {
+						return None;
+					}
+
+					// The end of the mapping
+					let mapping_end = mapping.get_begin() as usize
+						+ mapping.get_size() * memory::PAGE_SIZE;
+					let check_size = mapping_end - curr_ptr as usize;
+
+					// Looking for the null byte in the rest of the mapping. `strnlen` doesn't
+					// read pages past the one containing the null byte
+					let len = util::strnlen(curr_ptr, check_size);
+					i += len;
+					if len < check_size {
+						break;
+					}
 				}
 
 				Some(i)
@@ -564,7 +732,6 @@ impl MemSpace {
 	fn do_fork(&mut self) -> Result<Self, Errno> {
 		let mut mem_space = Self {
 			gaps: self.gaps.failable_clone()?,
-			gaps_size: self.gaps_size_clone()?,
 
 			mappings: Map::new(),
 
@@ -574,16 +741,17 @@ impl MemSpace {
 			vmem: vmem::clone(&self.vmem)?,
 		};
 
-		for (_, m) in self.mappings.iter_mut() {
-			let new_mapping = m.fork(&mut mem_space)?;
+		// The page tables are shared, so the pages are not remapped one by one
+		let result = self.mappings.iter()
+			.try_for_each(| (_, m) | m.fork(&mut mem_space).map(| _ | ()));
 
-			for i in 0..new_mapping.get_size() {
-				m.update_vmem(i);
-				new_mapping.update_vmem(i);
-			}
+		// The tables of nolazy mappings must not remain read-only in the current memory space,
+		// even if the fork failed
+		for (_, m) in self.mappings.iter_mut() {
+			m.restore_nolazy()?;
 		}
 
-		Ok(mem_space)
+		result.map(| _ | mem_space)
 	}
 
 	/// Clones the current memory space for process forking.
@@ -689,6 +857,16 @@ impl MemSpace {
 		}
 
 		if let Some(mapping) = Self::get_mapping_mut_for_(&mut self.mappings, virt_addr) {
+			// Checking the mapping allows writing
+			let write = code & vmem::x86::PAGE_FAULT_WRITE != 0;
+			if write && mapping.get_flags() & MAPPING_FLAG_WRITE == 0 {
+				return false;
+			}
+			let user = code & vmem::x86::PAGE_FAULT_USER != 0;
+			if user && mapping.get_flags() & MAPPING_FLAG_USER == 0 {
+				return false;
+			}
+
 			let page_offset = (virt_addr as usize - mapping.get_begin() as usize)
 				/ memory::PAGE_SIZE;
 			oom::wrap(|| {
@@ -701,6 +879,25 @@ impl MemSpace {
 			false
 		}
 	}
+
+	/// Writes back the pages modified through the shared mappings of files to the filesystem.
+	/// Pages that cannot be written back remain dirty in the page cache, which writes them back
+	/// later.
+	pub fn sync(&mut self) {
+		for (_, mapping) in self.mappings.iter_mut() {
+			let _ = mapping.fs_sync();
+		}
+	}
+}
+
+impl Drop for MemSpace {
+	fn drop(&mut self) {
+		self.sync();
+
+		// The pages of the tables shared with other memory spaces remain referenced by the tables,
+		// so they must not be freed by the mappings
+		self.vmem.release_shared();
+	}
 }
 
 impl fmt::Display for MemSpace {
@@ -711,10 +908,43 @@ impl fmt::Display for MemSpace {
 		}
 
 		write!(f, "\nGaps:\n")?;
-		for (_, g) in self.gaps.iter() {
-			write!(f, "- {}\n", g)?;
-		}
+		let mut result = Ok(());
+		self.gaps.foreach(| _, _, g | {
+			if result.is_ok() {
+				result = write!(f, "- {}\n", g);
+			}
+		});
 
-		Ok(())
+		result
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use core::ptr;
+	use super::*;
+
+	#[test_case]
+	fn mem_space_fork_nolazy0() {
+		let mut mem_space = MemSpace::new().unwrap();
+		let pages = 4;
+		let stack = mem_space.map_stack(pages, MAPPING_FLAG_WRITE | MAPPING_FLAG_NOLAZY).unwrap();
+		let child = mem_space.fork().unwrap();
+
+		let page = unsafe {
+			stack.sub(memory::PAGE_SIZE)
+		};
+		assert_ne!(mem_space.vmem.translate(page), child.vmem.translate(page));
+
+		// Writing through the stack of the parent, then running on it as interrupts do
+		unsafe {
+			vmem::switch(mem_space.vmem.as_ref(), || {
+				ptr::write_volatile(page as *mut u32, 42);
+				stack::switch(Some(stack), || {
+					let buf = [0u8; 256];
+					core::hint::black_box(&buf);
+				}).unwrap();
+			});
+		}
 	}
 }
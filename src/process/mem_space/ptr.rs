@@ -5,11 +5,14 @@
 //! Those structure are especially useful in the cases where several processes share the same
 //! memory space, making it possible to revoke the access to the pointer while it is being used.
 
+use core::mem::MaybeUninit;
 use core::mem::size_of;
 use core::slice;
 use crate::errno::Errno;
+use crate::util::lock::Mutex;
 use crate::util::lock::MutexGuard;
 use super::MemSpace;
+use super::copy;
 
 /// Wrapper for a pointer to a simple data.
 pub struct SyscallPtr<T: Sized> {
@@ -76,6 +79,43 @@ impl<T: Sized> SyscallPtr<T> {
 			Err(errno!(EFAULT))
 		}
 	}
+
+	/// Copies the value of the pointer from userspace. Contrary to `get`, the memory space must
+	/// not be locked. See the `copy` module for details.
+	/// If the pointer is null, the function returns None.
+	/// If the value is not accessible, the function returns an error.
+	pub fn copy_from_user<const INT: bool>(&self, mem_space: &Mutex<MemSpace, INT>)
+		-> Result<Option<T>, Errno> where T: Copy {
+		if self.is_null() {
+			return Ok(None);
+		}
+
+		let mut val = MaybeUninit::<T>::uninit();
+		let buf = unsafe {
+			slice::from_raw_parts_mut(val.as_mut_ptr() as *mut u8, size_of::<T>())
+		};
+		copy::copy_from_user(mem_space, self.ptr as _, buf)?;
+
+		Ok(Some(unsafe { // Safe because the value has been fully written
+			val.assume_init()
+		}))
+	}
+
+	/// Copies the value `val` to the pointer in userspace. Contrary to `get_mut`, the memory
+	/// space must not be locked. See the `copy` module for details.
+	/// If the pointer is null, the function does nothing.
+	/// If the value is not accessible, the function returns an error.
+	pub fn copy_to_user<const INT: bool>(&self, mem_space: &Mutex<MemSpace, INT>, val: &T)
+		-> Result<(), Errno> where T: Copy {
+		if self.is_null() {
+			return Ok(());
+		}
+
+		let buf = unsafe {
+			slice::from_raw_parts(val as *const T as *const u8, size_of::<T>())
+		};
+		copy::copy_to_user(mem_space, self.ptr as _, buf)
+	}
 }
 
 /// Wrapper for a slice. Internally, the structure contains only a pointer. The size of the slice
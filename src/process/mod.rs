@@ -9,12 +9,14 @@ pub mod mem_space;
 pub mod oom;
 pub mod pid;
 pub mod regs;
+pub mod run_queue;
 pub mod rusage;
 pub mod scheduler;
 pub mod semaphore;
 pub mod signal;
 pub mod tss;
 pub mod user_desc;
+pub mod wait_queue;
 
 use core::cmp::max;
 use core::ffi::c_void;
@@ -22,6 +24,7 @@ use core::mem::ManuallyDrop;
 use core::mem::MaybeUninit;
 use core::mem::size_of;
 use core::ptr::NonNull;
+use crate::cpu::smp;
 use crate::cpu;
 use crate::errno::Errno;
 use crate::errno;
@@ -41,8 +44,13 @@ use crate::file::path::Path;
 use crate::file;
 use crate::gdt::ldt::LDT;
 use crate::gdt;
+use crate::idt;
+use crate::idt::pic;
 use crate::limits;
 use crate::process::open_file::O_CLOEXEC;
+use crate::time;
+use crate::trace::EventType;
+use crate::trace;
 use crate::tty::TTYHandle;
 use crate::tty;
 use crate::util::FailableClone;
@@ -252,14 +260,20 @@ static mut SCHEDULER: MaybeUninit<IntSharedPtr<Scheduler>> = MaybeUninit::uninit
 pub fn init() -> Result<(), Errno> {
 	tss::init();
 	tss::flush();
+	idt::init_vsyscall()?;
+	idt::init_sysenter();
 
-	let cores_count = 1; // TODO
+	let cores_count = smp::cores_count();
 	unsafe {
 		PID_MANAGER.write(Mutex::new(PIDManager::new()?));
 		SCHEDULER.write(Scheduler::new(cores_count)?);
 	}
+	// The periodic tick is not needed anymore if cores can be ticked by their own timer
+	if time::timer::enable() {
+		pic::disable_irq(0);
+	}
 
-	let callback = | id: u32, _code: u32, regs: &Regs, ring: u32 | {
+	let callback = | id: u32, _code: u32, regs: &mut Regs, ring: u32 | {
 		if ring < 3 {
 			return InterruptResult::new(true, InterruptResultAction::Panic);
 		}
@@ -326,7 +340,7 @@ pub fn init() -> Result<(), Errno> {
 			InterruptResult::new(true, InterruptResultAction::Panic)
 		}
 	};
-	let page_fault_callback = | _id: u32, code: u32, _regs: &Regs, ring: u32 | {
+	let page_fault_callback = | _id: u32, code: u32, regs: &mut Regs, ring: u32 | {
 		let mut guard = unsafe {
 			SCHEDULER.assume_init_mut()
 		}.lock();
@@ -339,6 +353,7 @@ pub fn init() -> Result<(), Errno> {
 			let accessed_ptr = unsafe {
 				cpu::cr2_get()
 			};
+			trace::record(EventType::PageFault, accessed_ptr as _, code);
 
 			// Handling page fault
 			let success = {
@@ -351,6 +366,13 @@ pub fn init() -> Result<(), Errno> {
 
 			if !success {
 				if ring < 3 {
+					// If the fault happened while copying from or to userspace, jumping to the
+					// fixup location, which reports the failure to the caller
+					if let Some(fixup) = mem_space::copy::get_fixup(regs.eip as _) {
+						regs.eip = fixup as _;
+						return InterruptResult::new(true, InterruptResultAction::Resume);
+					}
+
 					return InterruptResult::new(true, InterruptResultAction::Panic);
 				} else {
 					curr_proc.kill(&Signal::SIGSEGV, true);
@@ -500,6 +522,94 @@ impl Process {
 		guard.get_mut().add_process(process)
 	}
 
+	/// Creates a kernel thread, a process running the function `entry` in kernelspace, and places
+	/// it into the scheduler's queue.
+	///
+	/// The thread runs on its kernel stack and never returns to userspace. Thus, signals are never
+	/// delivered to it.
+	pub fn new_kernel_thread(entry: fn() -> !) -> Result<IntSharedPtr<Self>, Errno> {
+		let pid = {
+			let mutex = unsafe {
+				PID_MANAGER.assume_init_mut()
+			};
+			let mut guard = mutex.lock();
+			guard.get_mut().get_unique_pid()
+		}?;
+		let process = Self::kernel_thread(pid, entry)?;
+
+		let mut guard = unsafe {
+			SCHEDULER.assume_init_mut()
+		}.lock();
+		guard.get_mut().add_process(process)
+	}
+
+	/// Creates the structure of a kernel thread with PID `pid`, running the function `entry`.
+	/// The thread is not placed into the scheduler's queue.
+	fn kernel_thread(pid: Pid, entry: fn() -> !) -> Result<Self, Errno> {
+		let mut mem_space = MemSpace::new()?;
+		let kernel_stack = mem_space.map_stack(KERNEL_STACK_SIZE, KERNEL_STACK_FLAGS)?;
+
+		Ok(Self {
+			pid,
+			pgid: pid,
+			tid: pid,
+
+			tty: tty::get(None).unwrap(),
+
+			uid: 0,
+			gid: 0,
+
+			euid: 0,
+			egid: 0,
+
+			umask: DEFAULT_UMASK,
+
+			state: State::Running,
+			vfork_state: VForkState::None,
+
+			priority: 0,
+			quantum_count: 0,
+
+			parent: None,
+			children: Vec::new(),
+			process_group: Vec::new(),
+
+			regs: Regs {
+				esp: kernel_stack as _,
+				eip: entry as usize as _,
+				..Default::default()
+			},
+			// Resuming the thread in kernelspace
+			syscalling: true,
+
+			handled_signal: None,
+			saved_regs: Regs::default(),
+			waitable: false,
+
+			mem_space: Some(IntSharedPtr::new(mem_space)?),
+			user_stack: None,
+			kernel_stack: Some(kernel_stack),
+
+			cwd: Path::root(),
+			file_descriptors: Some(SharedPtr::new(Vec::new())?),
+
+			sigmask: Bitfield::new(signal::SIGNALS_COUNT)?,
+			sigpending: Bitfield::new(signal::SIGNALS_COUNT)?,
+			signal_handlers: SharedPtr::new([SignalHandler::Default; signal::SIGNALS_COUNT])?,
+
+			tls_entries: [gdt::Entry::default(); TLS_ENTRIES_COUNT],
+			ldt: None,
+
+			set_child_tid: None,
+			clear_child_tid: None,
+
+			rusage: RUsage::default(),
+
+			exit_status: 0,
+			termsig: 0,
+		})
+	}
+
 	/// Tells whether the process is the init process.
 	#[inline(always)]
 	pub fn is_init(&self) -> bool {
@@ -648,6 +758,7 @@ impl Process {
 		}
 
 		self.state = new_state;
+		self.update_run_queue();
 
 		if self.state == State::Zombie {
 			if self.is_init() {
@@ -686,6 +797,12 @@ impl Process {
 			&& self.vfork_state != VForkState::Waiting
 	}
 
+	/// Inserts the process into the run queue or removes it, according to whether it can run.
+	/// This function must be called each time the result of `can_run` may change.
+	pub fn update_run_queue(&self) {
+		run_queue::RUN_QUEUE.update(self.pid, self.priority, self.can_run());
+	}
+
 	/// Tells whether the current process has informations to be retrieved by the `waitpid` system
 	/// call.
 	#[inline(always)]
@@ -713,6 +830,7 @@ impl Process {
 
 		if self.state == State::Sleeping {
 			self.state = State::Running;
+			self.update_run_queue();
 		}
 	}
 
@@ -1078,6 +1196,7 @@ impl Process {
 		// Handling vfork
 		let vfork_state = if fork_options.vfork {
 			self.vfork_state = VForkState::Waiting; // TODO Cancel if the following code fails
+			self.update_run_queue();
 			VForkState::Executing
 		} else {
 			VForkState::None
@@ -1123,7 +1242,7 @@ impl Process {
 		let process = Self {
 			pid,
 			pgid: self.pgid,
-			tid: self.pid,
+			tid: pid,
 
 			tty: self.tty.clone(),
 
@@ -1376,12 +1495,16 @@ impl Process {
 		}
 
 		self.vfork_state = VForkState::None;
+		self.update_run_queue();
 
 		// Resetting the parent's vfork state if needed
 		if let Some(parent) = self.get_parent() {
 			let parent = parent.get_mut().unwrap();
 			let mut guard = parent.lock();
-			guard.get_mut().vfork_state = VForkState::None;
+			let parent = guard.get_mut();
+
+			parent.vfork_state = VForkState::None;
+			parent.update_run_queue();
 		}
 	}
 
@@ -1389,6 +1512,9 @@ impl Process {
 	/// `Zombie`.
 	pub fn exit(&mut self, status: u32) {
 		self.exit_status = (status & 0xff) as ExitStatus;
+		if let Some(mem_space) = &self.mem_space {
+			mem_space.lock().get_mut().sync();
+		}
 		self.set_state(State::Zombie);
 
 		self.reset_vfork();
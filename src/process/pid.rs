@@ -9,7 +9,7 @@ use crate::util::container::id_allocator::IDAllocator;
 pub type Pid = u16;
 
 /// The maximum possible PID.
-const MAX_PID: Pid = 32768;
+pub const MAX_PID: Pid = 32768;
 /// The PID of the init process.
 pub const INIT_PID: Pid = 1;
 
@@ -0,0 +1,420 @@
+//! The run queue holds the processes that can run, so that the scheduler can pick the next
+//! process without going through every process.
+//!
+//! Each CPU core has its own queue, so that cores don't contend on a single lock when picking
+//! their next process. A process becoming runnable is queued on the current core. When a core's
+//! queue is empty, the core steals a process from the queue of the busiest core.
+//!
+//! Runnable processes are sorted by priority level. Each level has a FIFO list of processes, and
+//! a bitmap tells which levels are not empty. Picking the next process, inserting or removing a
+//! process are done in constant time.
+//!
+//! Lists are intrusive: links are stored in arrays indexed by PID instead of being allocated, so
+//! that updating the queue cannot fail. PID `0` is never allocated and is used as a null link.
+//! The links of a process are accessed only while holding the lock of the queue it is on.
+//!
+//! A process that is running on a core is not in any queue. Until that core puts it back (see
+//! `put_prev`), updating it has no effect, so that it cannot be picked by another core while its
+//! registers are not saved yet.
+//!
+//! Queues have their own locks, under which no other lock is taken. Thus, they can be updated
+//! while holding the scheduler's lock or a process's lock.
+//!
+//! When a process is queued, the core is kicked so that the process doesn't wait for the next
+//! periodic tick, which may never come when timers are enabled (see `time::timer`).
+
+use core::cell::UnsafeCell;
+use core::cmp::min;
+use core::sync::atomic::AtomicU8;
+use core::sync::atomic::AtomicUsize;
+use core::sync::atomic::Ordering;
+use crate::cpu::smp;
+use crate::process::pid::MAX_PID;
+use crate::process::pid::Pid;
+use crate::time::timer;
+use crate::util::lock::IntMutex;
+
+/// The number of priority levels.
+const LEVELS_COUNT: usize = 32;
+/// The number of slots in the arrays indexed by PID.
+const SLOTS_COUNT: usize = MAX_PID as usize + 1;
+
+/// The state of a process that is neither queued nor running.
+const STATE_NONE: u8 = u8::MAX;
+/// State flag: the process is running on the core whose index is in the lower bits. If not set,
+/// the process is queued on the core whose index is in the lower bits.
+const STATE_RUNNING: u8 = 0x80;
+
+/// The intrusive links of a process.
+#[derive(Clone, Copy)]
+struct Link {
+	/// The next process in the same level.
+	next: Pid,
+	/// The previous process in the same level.
+	prev: Pid,
+	/// The level the process is queued on.
+	level: u8,
+}
+
+/// The queue of runnable processes of a core.
+pub struct CoreQueue {
+	/// Bitmap of levels that contain at least one process. Bit `n` corresponds to level `n`.
+	bitmap: u32,
+	/// The first process of each level.
+	heads: [Pid; LEVELS_COUNT],
+	/// The last process of each level.
+	tails: [Pid; LEVELS_COUNT],
+}
+
+/// The set of run queues, one per core.
+pub struct RunQueue {
+	/// The queue of each core.
+	queues: [IntMutex<CoreQueue>; smp::MAX_CORES],
+	/// The number of processes in the queue of each core.
+	lens: [AtomicUsize; smp::MAX_CORES],
+
+	/// For each PID, the state of the process.
+	states: [AtomicU8; SLOTS_COUNT],
+	/// For each PID, the links of the process.
+	links: UnsafeCell<[Link; SLOTS_COUNT]>,
+}
+
+/// The queues of runnable processes.
+pub static RUN_QUEUE: RunQueue = RunQueue::new();
+
+impl CoreQueue {
+	/// Creates a new empty queue.
+	const fn new() -> Self {
+		Self {
+			bitmap: 0,
+			heads: [0; LEVELS_COUNT],
+			tails: [0; LEVELS_COUNT],
+		}
+	}
+
+	/// Inserts the process with PID `pid` at the end of the level `level`.
+	fn insert(&mut self, links: &mut [Link; SLOTS_COUNT], pid: Pid, level: usize) {
+		let tail = self.tails[level];
+
+		links[pid as usize] = Link {
+			next: 0,
+			prev: tail,
+			level: level as _,
+		};
+		if tail != 0 {
+			links[tail as usize].next = pid;
+		} else {
+			self.heads[level] = pid;
+		}
+		self.tails[level] = pid;
+
+		self.bitmap |= 1 << level;
+	}
+
+	/// Removes the process with PID `pid` from its level.
+	fn remove(&mut self, links: &mut [Link; SLOTS_COUNT], pid: Pid) {
+		let Link {
+			next,
+			prev,
+			level,
+		} = links[pid as usize];
+		let level = level as usize;
+
+		if prev != 0 {
+			links[prev as usize].next = next;
+		} else {
+			self.heads[level] = next;
+		}
+		if next != 0 {
+			links[next as usize].prev = prev;
+		} else {
+			self.tails[level] = prev;
+		}
+
+		if self.heads[level] == 0 {
+			self.bitmap &= !(1 << level);
+		}
+	}
+
+	/// Returns the first process of the highest non-empty level, if any.
+	fn first(&self) -> Option<Pid> {
+		if self.bitmap == 0 {
+			return None;
+		}
+
+		let level = (u32::BITS - 1 - self.bitmap.leading_zeros()) as usize;
+		Some(self.heads[level])
+	}
+}
+
+impl RunQueue {
+	/// Creates a new empty set of queues.
+	const fn new() -> Self {
+		const QUEUE_INIT: IntMutex<CoreQueue> = IntMutex::new(CoreQueue::new());
+		const LEN_INIT: AtomicUsize = AtomicUsize::new(0);
+		const STATE_INIT: AtomicU8 = AtomicU8::new(STATE_NONE);
+		const LINK_INIT: Link = Link {
+			next: 0,
+			prev: 0,
+			level: 0,
+		};
+
+		Self {
+			queues: [QUEUE_INIT; smp::MAX_CORES],
+			lens: [LEN_INIT; smp::MAX_CORES],
+
+			states: [STATE_INIT; SLOTS_COUNT],
+			links: UnsafeCell::new([LINK_INIT; SLOTS_COUNT]),
+		}
+	}
+
+	/// Returns the level for the given priority `priority`.
+	fn get_level(priority: usize) -> usize {
+		min(priority, LEVELS_COUNT - 1)
+	}
+
+	/// Returns the links array. The caller must hold the lock of the queue on which the processes
+	/// whose links are accessed are queued.
+	#[allow(clippy::mut_from_ref)]
+	unsafe fn get_links(&self) -> &mut [Link; SLOTS_COUNT] {
+		&mut *self.links.get()
+	}
+
+	/// Returns the number of processes in the queue of the core `core`.
+	pub fn len(&self, core: usize) -> usize {
+		self.lens[core].load(Ordering::Relaxed)
+	}
+
+	/// Tells whether the process with PID `pid` is in a queue.
+	pub fn contains(&self, pid: Pid) -> bool {
+		let state = self.states[pid as usize].load(Ordering::Acquire);
+		state != STATE_NONE && state & STATE_RUNNING == 0
+	}
+
+	/// Inserts the process with PID `pid` at the end of the level `level` of the queue of core
+	/// `core`, whose guard is `queue`.
+	fn insert_locked(&self, queue: &mut CoreQueue, core: usize, pid: Pid, level: usize) {
+		queue.insert(unsafe { self.get_links() }, pid, level);
+		self.states[pid as usize].store(core as _, Ordering::Release);
+		self.lens[core].fetch_add(1, Ordering::Relaxed);
+	}
+
+	/// Removes the process with PID `pid` from the queue of core `core`, whose guard is `queue`.
+	/// `state` is the new state of the process.
+	fn remove_locked(&self, queue: &mut CoreQueue, core: usize, pid: Pid, state: u8) {
+		queue.remove(unsafe { self.get_links() }, pid);
+		self.states[pid as usize].store(state, Ordering::Release);
+		self.lens[core].fetch_sub(1, Ordering::Relaxed);
+	}
+
+	/// Inserts or removes the process with PID `pid` and priority `priority` according to
+	/// `runnable`.
+	/// A process that is not queued yet is inserted in the queue of the current core.
+	/// If the process is running, the function does nothing.
+	pub fn update(&self, pid: Pid, priority: usize, runnable: bool) {
+		debug_assert_ne!(pid, 0);
+		let level = Self::get_level(priority);
+
+		loop {
+			let state = self.states[pid as usize].load(Ordering::Acquire);
+			if state != STATE_NONE && state & STATE_RUNNING != 0 {
+				return;
+			}
+
+			let core = if state == STATE_NONE {
+				if !runnable {
+					return;
+				}
+				smp::get_core_id()
+			} else {
+				state as usize
+			};
+
+			let mut guard = self.queues[core].lock();
+			let queue = guard.get_mut();
+			// The state might have changed before locking
+			if self.states[pid as usize].load(Ordering::Acquire) != state {
+				continue;
+			}
+
+			if state == STATE_NONE {
+				self.insert_locked(queue, core, pid, level);
+				drop(guard);
+				timer::kick(core);
+			} else if !runnable {
+				self.remove_locked(queue, core, pid, STATE_NONE);
+			} else if unsafe { self.get_links() }[pid as usize].level as usize != level {
+				// The priority changed
+				self.remove_locked(queue, core, pid, STATE_NONE);
+				self.insert_locked(queue, core, pid, level);
+			}
+			return;
+		}
+	}
+
+	/// Removes the process with PID `pid` from the queues, or forgets it if it is running.
+	pub fn remove(&self, pid: Pid) {
+		loop {
+			let state = self.states[pid as usize].load(Ordering::Acquire);
+			if state == STATE_NONE {
+				return;
+			}
+
+			if state & STATE_RUNNING != 0 {
+				let result = self.states[pid as usize].compare_exchange(state, STATE_NONE,
+					Ordering::AcqRel, Ordering::Acquire);
+				if result.is_ok() {
+					return;
+				}
+				continue;
+			}
+
+			let core = state as usize;
+			let mut guard = self.queues[core].lock();
+			if self.states[pid as usize].load(Ordering::Acquire) == state {
+				self.remove_locked(guard.get_mut(), core, pid, STATE_NONE);
+				return;
+			}
+		}
+	}
+
+	/// Puts back the process with PID `pid` and priority `priority`, which was running on the core
+	/// `core`, at the end of its level in this core's queue if `runnable` is true.
+	/// This function must be called by the core `core`, once the process's registers are saved.
+	/// If the process has been removed in the meantime, the function does nothing.
+	pub fn put_prev(&self, core: usize, pid: Pid, priority: usize, runnable: bool) {
+		let running = STATE_RUNNING | core as u8;
+		if self.states[pid as usize].load(Ordering::Acquire) != running {
+			return;
+		}
+
+		let mut guard = self.queues[core].lock();
+		let queue = guard.get_mut();
+		// The process might have been removed before locking
+		let result = self.states[pid as usize].compare_exchange(running, STATE_NONE,
+			Ordering::AcqRel, Ordering::Acquire);
+		if result.is_ok() && runnable {
+			self.insert_locked(queue, core, pid, Self::get_level(priority));
+		}
+	}
+
+	/// Takes the first process of the highest non-empty level of the queue of `victim` to run it
+	/// on the core `core`.
+	fn take(&self, victim: usize, core: usize) -> Option<Pid> {
+		let mut guard = self.queues[victim].lock();
+		let queue = guard.get_mut();
+
+		let pid = queue.first()?;
+		self.remove_locked(queue, victim, pid, STATE_RUNNING | core as u8);
+		Some(pid)
+	}
+
+	/// Returns the next process to run on the core `core`, which is the first process of the
+	/// highest non-empty level of its queue. The process is marked as running until put back with
+	/// `put_prev`.
+	/// If the core's queue is empty, a process is stolen from the core with the most processes.
+	/// If every queues are empty, the function returns None.
+	pub fn pick(&self, core: usize) -> Option<Pid> {
+		if let Some(pid) = self.take(core, core) {
+			return Some(pid);
+		}
+
+		// Work stealing
+		loop {
+			let victim = (0..smp::cores_count())
+				.filter(| c | *c != core)
+				.max_by_key(| c | self.len(*c))
+				.filter(| c | self.len(*c) > 0)?;
+			// The victim's queue might have been emptied in the meantime
+			if let Some(pid) = self.take(victim, core) {
+				return Some(pid);
+			}
+		}
+	}
+}
+
+unsafe impl Sync for RunQueue {}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	/// The queues used for tests. They are too large to be placed on the stack.
+	static TEST_QUEUE: RunQueue = RunQueue::new();
+
+	#[test_case]
+	fn run_queue_round_robin() {
+		let queue = &TEST_QUEUE;
+		let core = smp::get_core_id();
+		assert_eq!(queue.pick(core), None);
+
+		queue.update(1, 0, true);
+		queue.update(2, 0, true);
+		queue.update(3, 0, true);
+		assert_eq!(queue.len(core), 3);
+
+		for pid in [1, 2, 3, 1, 2] {
+			assert_eq!(queue.pick(core), Some(pid));
+			queue.put_prev(core, pid, 0, true);
+		}
+
+		assert_eq!(queue.pick(core), Some(3));
+		queue.remove(2);
+		queue.put_prev(core, 3, 0, true);
+		assert_eq!(queue.pick(core), Some(1));
+		queue.put_prev(core, 1, 0, true);
+		assert_eq!(queue.pick(core), Some(3));
+		queue.put_prev(core, 3, 0, true);
+
+		queue.remove(1);
+		queue.remove(3);
+		assert_eq!(queue.len(core), 0);
+		assert_eq!(queue.pick(core), None);
+	}
+
+	#[test_case]
+	fn run_queue_priority() {
+		let queue = &TEST_QUEUE;
+		let core = smp::get_core_id();
+
+		queue.update(1, 0, true);
+		queue.update(2, 5, true);
+		queue.update(3, 1000, true);
+		assert_eq!(queue.pick(core), Some(3));
+		queue.put_prev(core, 3, 1000, true);
+		assert_eq!(queue.pick(core), Some(3));
+
+		// Updating a running process has no effect until it is put back
+		queue.update(3, 1000, false);
+		queue.put_prev(core, 3, 1000, false);
+		assert!(!queue.contains(3));
+		assert_eq!(queue.pick(core), Some(2));
+
+		queue.put_prev(core, 2, 0, true);
+		assert_eq!(queue.pick(core), Some(1));
+		queue.put_prev(core, 1, 0, true);
+		assert_eq!(queue.pick(core), Some(2));
+		queue.put_prev(core, 2, 0, true);
+
+		queue.remove(1);
+		queue.remove(2);
+		assert_eq!(queue.len(core), 0);
+	}
+
+	#[test_case]
+	fn run_queue_steal() {
+		let queue = &TEST_QUEUE;
+		let core = smp::get_core_id();
+		let other = (core + 1) % smp::MAX_CORES;
+
+		queue.update(1, 0, true);
+		assert_eq!(queue.take(core, other), Some(1));
+		// The process is running on `other`, so it cannot be picked
+		assert_eq!(queue.pick(core), None);
+
+		queue.put_prev(other, 1, 0, true);
+		assert_eq!(queue.len(other), 1);
+		queue.remove(1);
+		assert_eq!(queue.len(other), 0);
+	}
+}
@@ -1,8 +1,16 @@
 //! The role of the process scheduler is to interrupt the currently running process periodicaly
 //! to switch to another process that is in running state. The interruption is fired by the PIT
-//! on IDT0.
+//! on IDT0, on the bootstrap core. This core then ticks the other cores with an IPI.
+//!
+//! When timers are enabled (see `time::timer`), the PIT doesn't tick anymore. Instead, each core
+//! is ticked by its Local APIC timer, only when a timer expires or when the time slice of the
+//! running process ends.
+//!
+//! Each core runs its own process, picked from its own run queue.
 //!
 //! A scheduler cycle is a period during which the scheduler iterates through every processes.
+//! Processes that can run are kept in the run queue (see `run_queue`), so that the cost of
+//! picking the next process doesn't depend on the number of processes.
 //! The scheduler works by assigning a number of quantum for each process, based on the number of
 //! running processes and their priority.
 //! This number represents the number of ticks during which the process keeps running until
@@ -10,19 +18,26 @@
 
 use core::cmp::max;
 use core::ffi::c_void;
+use crate::cpu::apic;
+use crate::cpu::smp;
 use crate::errno::Errno;
 use crate::event::CallbackHook;
 use crate::event;
 use crate::idt::pic;
+use crate::idt;
 use crate::memory::malloc;
 use crate::memory::stack;
 use crate::memory;
 use crate::process::Process;
 use crate::process::pid::Pid;
 use crate::process::regs::Regs;
+use crate::process::run_queue::RUN_QUEUE;
 use crate::process;
+use crate::time::timer;
+use crate::time;
+use crate::trace::EventType;
+use crate::trace;
 use crate::util::container::map::Map;
-use crate::util::container::map::MapIterator;
 use crate::util::container::map::TraversalType;
 use crate::util::container::vec::Vec;
 use crate::util::lock::*;
@@ -43,13 +58,18 @@ pub struct Scheduler {
 
 	/// The ticking callback hook, called at a regular interval to make the scheduler work.
 	tick_callback_hook: CallbackHook,
+	/// The callback hook for the tick IPI, sent by the bootstrap core to the other cores.
+	ipi_callback_hook: CallbackHook,
+	/// The callback hook for the Local APIC timer, used instead of the PIT when timers are
+	/// enabled.
+	timer_callback_hook: CallbackHook,
 	/// The total number of ticks since the instanciation of the scheduler.
 	total_ticks: u64,
 
 	/// A binary tree containing all processes registered to the current scheduler.
 	processes: Map<Pid, IntSharedPtr<Process>>,
-	/// The currently running process with its PID.
-	curr_proc: Option<(Pid, IntSharedPtr<Process>)>,
+	/// The process running on each core with its PID, by core index.
+	curr_procs: Vec<Option<(Pid, IntSharedPtr<Process>)>>,
 
 	/// The sum of all priorities, used to compute the average priority.
 	priority_sum: usize,
@@ -61,23 +81,29 @@ impl Scheduler {
 	/// Creates a new instance of scheduler.
 	pub fn new(cores_count: usize) -> Result<IntSharedPtr<Self>, Errno> {
 		let mut tmp_stacks = Vec::new();
+		let mut curr_procs = Vec::new();
 		for _ in 0..cores_count {
 			tmp_stacks.push(malloc::Alloc::new_default(TMP_STACK_SIZE)?)?;
+			curr_procs.push(None)?;
 		}
 
-		let callback = | _id: u32, _code: u32, regs: &Regs, ring: u32 | {
-			Scheduler::tick(process::get_scheduler(), regs, ring);
+		let callback = | id: u32, _code: u32, regs: &mut Regs, ring: u32 | {
+			Scheduler::tick(process::get_scheduler(), id, regs, ring);
 		};
 		let tick_callback_hook = event::register_callback(0x20, 0, callback)?;
+		let ipi_callback_hook = event::register_callback(idt::TICK_IPI, 0, callback)?;
+		let timer_callback_hook = event::register_callback(idt::APIC_TIMER, 0, callback)?;
 
 		IntSharedPtr::new(Self {
 			tmp_stacks,
 
 			tick_callback_hook,
+			ipi_callback_hook,
+			timer_callback_hook,
 			total_ticks: 0,
 
 			processes: Map::new(),
-			curr_proc: None,
+			curr_procs,
 
 			priority_sum: 0,
 			priority_max: 0,
@@ -109,14 +135,16 @@ impl Scheduler {
 
 	/// Returns the process with TID `tid`. If the process doesn't exist, the function returns
 	/// None.
-	pub fn get_by_tid(&self, _tid: Pid) -> Option<IntSharedPtr<Process>> {
-		// TODO
-		todo!();
+	///
+	/// Each thread is a process with its own PID, which is also its TID.
+	pub fn get_by_tid(&self, tid: Pid) -> Option<IntSharedPtr<Process>> {
+		self.get_by_pid(tid)
 	}
 
-	/// Returns the current running process. If no process is running, the function returns None.
+	/// Returns the process running on the current core. If no process is running, the function
+	/// returns None.
 	pub fn get_current_process(&mut self) -> Option<IntSharedPtr<Process>> {
-		Some(self.curr_proc.as_ref().cloned()?.1)
+		Some(self.curr_procs[smp::get_core_id()].as_ref().cloned()?.1)
 	}
 
 	/// Updates the scheduler's heuristic with the new priority of a process.
@@ -138,9 +166,11 @@ impl Scheduler {
 	pub fn add_process(&mut self, process: Process) -> Result<IntSharedPtr<Process>, Errno> {
 		let pid = process.get_pid();
 		let priority = process.get_priority();
+		let runnable = process.can_run();
 		let ptr = IntSharedPtr::new(process)?;
 		self.processes.insert(pid, ptr.clone())?;
 		self.update_priority(0, priority);
+		RUN_QUEUE.update(pid, priority, runnable);
 
 		Ok(ptr)
 	}
@@ -154,6 +184,7 @@ impl Scheduler {
 			let priority = process.get_priority();
 			self.processes.remove(pid);
 			self.update_priority(priority, 0);
+			RUN_QUEUE.remove(pid);
 		}
 	}
 
@@ -181,98 +212,37 @@ impl Scheduler {
 		max(1, n) as _
 	}
 
-	// TODO Clean
-	/// Tells whether the given process `process` can run.
-	fn can_run(process: &Process, _priority_sum: usize, _priority_max: usize,
-		_processes_count: usize) -> bool {
-		if process.can_run() {
-			// TODO fix
-			//process.quantum_count < Self::get_quantum_count(process.get_priority(), priority_sum,
-			//	priority_max, processes_count)
-			true
-		} else {
-			false
-		}
-	}
-
-	// TODO Clean
-	/// Returns the next process to run with its PID. If the process is changed, the quantum count
-	/// of the previous process is reset.
-	fn get_next_process(&self) -> Option<(Pid, IntSharedPtr<Process>)> {
-		let priority_sum = self.priority_sum;
-		let priority_max = self.priority_max;
-		let processes_count = self.processes.count();
-		// If no process exist, nothing to run
-		if processes_count == 0 {
-			return None;
-		}
-
-		// Getting the current process, or take the first process in the list if no process is
-		// running
-		let (curr_pid, curr_proc) = self.curr_proc.clone().or_else(|| {
-			let (pid, proc) = self.processes.get_min(0)?;
-			Some((*pid, proc.clone()))
-		})?;
-
-		// Closure iterating the tree to find an available process
-		let next = | iter: MapIterator<Pid, IntSharedPtr<Process>> | {
-			let mut proc: Option<(Pid, IntSharedPtr<Process>)> = None;
-
-			// Iterating over processes
-			for (pid, process) in iter {
-				let runnable = {
-					let guard = process.lock();
-					Self::can_run(guard.get(), priority_sum, priority_max, processes_count)
-				};
-
-				// FIXME Potenial race condition? (checking if runnable, then unlocking and using
-				// the result of the check)
-				if runnable {
-					proc = Some((*pid, process.clone()));
-					break;
-				}
-			}
-
-			proc
-		};
-
-		let mut iter = self.processes.iter();
-		// Setting the iterator next to the current running process
-		iter.jump(&curr_pid);
-		iter.next();
-
-		// Running the loop to reach the end of processes list
-		let mut next_proc = next(iter);
-		// If no suitable process is found, going back to the beginning to check the processes
-		// located before the previous process
-		if next_proc.is_none() {
-			next_proc = next(self.processes.iter());
-		}
-
-		let (next_pid, next_proc) = next_proc?;
-
-		if next_pid != curr_pid || processes_count == 1 {
-			curr_proc.lock().get_mut().quantum_count = 0;
-		}
-		Some((next_pid, next_proc))
-	}
-
-	/// Ticking the scheduler. This function saves the data of the currently running process, then
-	/// switches to the next process to run.
+	/// Ticking the scheduler. This function saves the data of the process running on the current
+	/// core, then switches to the next process to run.
 	/// `mutex` is the scheduler's mutex.
+	/// `id` is the ID of the interrupt that ticked the scheduler.
 	/// `regs` is the state of the registers from the paused context.
 	/// `ring` is the ring of the paused context.
-	fn tick(mutex: &mut IntMutex<Self>, regs: &Regs, ring: u32) -> ! {
+	fn tick(mutex: &mut IntMutex<Self>, id: u32, regs: &Regs, ring: u32) -> ! {
 		// Disabling interrupts to avoid getting one right after unlocking mutexes
 		cli!();
 
-		let mut guard = mutex.lock();
-		let scheduler = guard.get_mut();
+		let core = smp::get_core_id();
+		if id == idt::APIC_TIMER as u32 {
+			timer::expire();
+		}
+
+		let (prev, tmp_stack) = {
+			let mut guard = mutex.lock();
+			let scheduler = guard.get_mut();
 
-		scheduler.total_ticks += 1;
+			if id == 0x20 {
+				scheduler.total_ticks += 1;
+				time::tick();
+			}
+			(scheduler.curr_procs[core].clone(), scheduler.get_tmp_stack(core as _))
+		};
+		if id == 0x20 && !timer::is_enabled() {
+			smp::broadcast_ipi(idt::TICK_IPI as _);
+		}
 
 		// If a process is running, save its registers
-		if let Some(curr_proc) = scheduler.get_current_process() {
+		if let Some((_, curr_proc)) = &prev {
 			let mut guard = curr_proc.lock();
 			let curr_proc = guard.get_mut();
 
@@ -280,46 +250,88 @@ impl Scheduler {
 			curr_proc.syscalling = ring < 3;
 		}
 
-		// The current core ID
-		let core_id = 0; // TODO
-		// Getting the temporary stack
-		let tmp_stack = scheduler.get_tmp_stack(core_id);
-
-		if let Some(next_proc) = scheduler.get_next_process() {
-			// Set the process as current
-			scheduler.curr_proc = Some(next_proc.clone());
-
-			drop(guard);
+		let running = prev.is_some();
+		let switch = move || {
+			Self::switch_next(core, id, prev, tmp_stack);
+		};
+		if running {
+			// Leaving the stack of the previous process before it can be picked by another core
 			unsafe {
-				event::unlock_callbacks(0x20);
+				stack::switch(Some(tmp_stack), switch).unwrap();
 			}
-			pic::end_of_interrupt(0x0);
+			unreachable!();
+		} else {
+			switch();
+			unreachable!();
+		}
+	}
 
-			unsafe {
-				stack::switch(Some(tmp_stack), move || {
-					let (syscalling, regs) = {
-						let mut guard = next_proc.1.lock();
-						let proc = guard.get_mut();
+	/// Puts back the previous process `prev` of the core `core` into the run queue, then switches
+	/// to the next process to run.
+	/// `id` is the ID of the interrupt that ticked the scheduler.
+	/// `tmp_stack` is the temporary stack of the core.
+	fn switch_next(core: usize, id: u32, prev: Option<(Pid, IntSharedPtr<Process>)>,
+		tmp_stack: *mut c_void) -> ! {
+		if let Some((pid, proc)) = &prev {
+			let guard = proc.lock();
+			let proc = guard.get();
+
+			// Done while the process is locked so that no change of state can be missed
+			RUN_QUEUE.put_prev(core, *pid, proc.get_priority(), proc.can_run());
+		}
 
-						proc.prepare_switch();
-						(proc.is_syscalling(), proc.regs)
-					};
+		let next_proc = {
+			let mut guard = process::get_scheduler().lock();
+			let scheduler = guard.get_mut();
 
-					drop(next_proc);
+			let next_proc = RUN_QUEUE.pick(core).and_then(| pid | {
+				Some((pid, scheduler.processes.get(pid)?.clone()))
+			});
+			scheduler.curr_procs[core] = next_proc.clone();
+			next_proc
+		};
+		trace::record(EventType::ContextSwitch,
+			prev.as_ref().map(| (pid, _) | *pid as _).unwrap_or(0),
+			next_proc.as_ref().map(| (pid, _) | *pid as _).unwrap_or(0));
+
+		if timer::is_enabled() {
+			// Preempting the next process only if another one is waiting for this core
+			let shared = next_proc.is_some() && RUN_QUEUE.len(core) > 0;
+			timer::program(next_proc.is_none(), shared.then_some(timer::TICK_PERIOD));
+		}
 
-					// Resuming execution
-					regs.switch(!syscalling);
-				}).unwrap();
+		// If the process changed, reset the quantum count of the previous process
+		if let Some((prev_pid, prev_proc)) = prev {
+			if next_proc.as_ref().map(| (pid, _) | *pid) != Some(prev_pid) {
+				prev_proc.lock().get_mut().quantum_count = 0;
 			}
+		}
 
-			unreachable!();
+		unsafe {
+			event::unlock_callbacks(id as _);
+		}
+		if id == 0x20 {
+			pic::end_of_interrupt(0x0);
 		} else {
-			drop(guard);
+			apic::apic_end_of_interrupt();
+		}
+
+		if let Some((_, next_proc)) = next_proc {
+			let (syscalling, regs) = {
+				let mut guard = next_proc.lock();
+				let proc = guard.get_mut();
+
+				proc.prepare_switch();
+				(proc.is_syscalling(), proc.regs)
+			};
+
+			drop(next_proc);
+
+			// Resuming execution
 			unsafe {
-				event::unlock_callbacks(0x20);
+				regs.switch(!syscalling);
 			}
-			pic::end_of_interrupt(0x0);
-
+		} else {
 			unsafe {
 				crate::loop_reset(tmp_stack);
 			}
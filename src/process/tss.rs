@@ -4,10 +4,19 @@
 //! requires switching the protection ring, and thus the stack.
 //! The structure has to be registered into the GDT into the TSS segment, and must be loaded using
 //! instruction `ltr`.
+//!
+//! Each core has its own TSS. The bootstrap core's TSS is defined in `tss.s`.
 
 use core::mem::size_of;
+use crate::cpu::smp;
 use crate::gdt;
 
+/// The size of the TSS structure in bytes.
+const TSS_SIZE: usize = 104;
+
+/// The TSS of the cores other than the bootstrap core, by core index.
+static mut CORE_TSS: [[u32; TSS_SIZE / 4]; smp::MAX_CORES] = [[0; TSS_SIZE / 4]; smp::MAX_CORES];
+
 /// The TSS structure.
 #[repr(C, packed)]
 pub struct TSSEntry {
@@ -45,14 +54,12 @@ extern "C" {
 	fn tss_flush();
 }
 
-/// x86. Initializes the TSS.
+/// x86. Initializes the TSS of the current core.
 pub fn init() {
 	let tss_ptr = gdt::get_segment_ptr(gdt::TSS_OFFSET);
 
 	let limit = size_of::<TSSEntry>() as u64;
-	let base = unsafe {
-		tss_get() as u64
-	};
+	let base = get() as *mut TSSEntry as u64;
 	let flags = 0b0100000010001001_u64;
 	let tss_value = (limit & 0xffff)
 		| ((base & 0xffffff) << 16)
@@ -65,18 +72,31 @@ pub fn init() {
 	}
 }
 
-/// x86. Updates the TSS into the GDT.
+/// x86. Updates the TSS of the current core into the GDT.
 #[inline(always)]
 pub fn flush() {
-	unsafe {
-		tss_flush();
+	if smp::get_core_id() == 0 {
+		unsafe {
+			tss_flush();
+		}
+	} else {
+		unsafe {
+			core::arch::asm!("ltr {:x}", in(reg) gdt::TSS_OFFSET as u16,
+				options(nostack, preserves_flags));
+		}
 	}
 }
 
-/// Returns a reference to the TSS structure.
+/// Returns a reference to the TSS structure of the current core.
 #[inline(always)]
 pub fn get() -> &'static mut TSSEntry {
+	let core = smp::get_core_id();
+
 	unsafe {
-		&mut *tss_get()
+		if core == 0 {
+			&mut *tss_get()
+		} else {
+			&mut *(CORE_TSS[core].as_mut_ptr() as *mut TSSEntry)
+		}
 	}
 }
@@ -0,0 +1,294 @@
+//! A wait queue allows processes to sleep until an event happens, such as the completion of an
+//! I/O operation signalled by an interrupt.
+
+use crate::cpu::smp;
+use crate::errno::Errno;
+use crate::errno;
+use crate::idt;
+use crate::time::timer;
+use crate::time;
+use crate::util::container::vec::Vec;
+use crate::util::lock::IntMutex;
+use crate::util::ptr::IntSharedPtr;
+use crate::util::ptr::IntWeakPtr;
+use super::Pid;
+use super::Process;
+use super::State;
+
+/// A queue of processes waiting for an event.
+///
+/// The queue keeps weak pointers to its processes, so that waking them up doesn't require a
+/// lookup in the scheduler and never drops the last reference to a process from an interrupt
+/// handler.
+pub struct WaitQueue {
+	/// The PIDs of the waiting processes, with a pointer to each process.
+	waiters: IntMutex<Vec<(Pid, IntWeakPtr<Process>)>>,
+}
+
+impl WaitQueue {
+	/// Creates a new instance.
+	pub const fn new() -> Self {
+		Self {
+			waiters: IntMutex::new(Vec::new()),
+		}
+	}
+
+	/// Registers the process `proc`, with PID `pid`, on the queue.
+	/// If the allocation of the queue's entry fails, the function returns `false`.
+	fn register(&self, pid: Pid, proc: &IntSharedPtr<Process>) -> bool {
+		self.waiters.lock().get_mut().push((pid, proc.new_weak())).is_ok()
+	}
+
+	/// Removes the process with PID `pid` from the queue.
+	fn remove(&self, pid: Pid) {
+		let mut guard = self.waiters.lock();
+		let waiters = guard.get_mut();
+
+		if let Some(i) = waiters.iter().position(| (p, _) | *p == pid) {
+			waiters.remove(i);
+		}
+	}
+
+	/// Waits for the next interrupt without sleeping, when no process can be put to sleep.
+	/// If interrupts are disabled or cannot be received by the current core, the function only
+	/// spins once.
+	/// `cond` is checked before halting to avoid missing the interrupt.
+	fn idle<F: FnMut() -> bool>(cond: &mut F) {
+		// PIC interrupts are received by the bootstrap core only
+		if !idt::is_interrupt_enabled() || smp::get_core_id() != 0 {
+			core::hint::spin_loop();
+			return;
+		}
+
+		// `sti` takes effect after the next instruction, thus the interrupt cannot be received
+		// between the check and `hlt`
+		crate::cli!();
+		if !cond() {
+			unsafe {
+				core::arch::asm!("sti", "hlt");
+			}
+		} else {
+			crate::sti!();
+		}
+	}
+
+	/// Makes the current process sleep until `cond` returns true. The condition is checked again
+	/// each time the queue is woken up.
+	/// If no process is running or if interrupts are disabled, the function waits for `cond`
+	/// without sleeping.
+	pub fn wait_until<F: FnMut() -> bool>(&self, mut cond: F) {
+		while !cond() {
+			let proc = if idt::is_interrupt_enabled() {
+				Process::get_current()
+			} else {
+				None
+			};
+			let Some(proc) = proc else {
+				Self::idle(&mut cond);
+				continue;
+			};
+			let pid = proc.lock().get().get_pid();
+
+			// Registering before checking the condition again, so that a wake up happening
+			// meanwhile is not lost
+			if !self.register(pid, &proc) {
+				Self::idle(&mut cond);
+				continue;
+			}
+			proc.lock().get_mut().set_state(State::Sleeping);
+
+			if !cond() {
+				crate::wait();
+			}
+
+			self.remove(pid);
+			let mut guard = proc.lock();
+			if guard.get().get_state() == State::Sleeping {
+				guard.get_mut().set_state(State::Running);
+			}
+		}
+	}
+
+	/// Makes the current process sleep until `cond` returns true or until the monotonic clock
+	/// reaches `deadline`, in nanoseconds. If `deadline` is None, the process waits without time
+	/// limit.
+	/// If `interruptible` is true, the process also stops waiting when a signal is pending.
+	/// The process is woken up at the deadline by a timer. Without timers, the process is woken
+	/// up by the periodic tick instead.
+	/// If no process is running or if interrupts are disabled, the function waits without
+	/// sleeping and signals are not checked.
+	///
+	/// The function returns `true` if `cond` returned true and `false` if the deadline has been
+	/// reached. If a signal is pending, the function returns EINTR.
+	fn wait_deadline<F: FnMut() -> bool>(&self, mut cond: F, deadline: Option<u64>,
+		interruptible: bool) -> Result<bool, Errno> {
+		let expired = || {
+			deadline.map_or(false, | deadline | {
+				time::get_clock(time::CLOCK_MONOTONIC).unwrap_or(0) >= deadline
+			})
+		};
+
+		// The PID for which the timer is armed
+		let mut timer_pid = None;
+		// Tells whether the process is woken up at the deadline
+		let mut with_timer = deadline.is_none();
+		let result = loop {
+			if cond() {
+				break Ok(true);
+			}
+
+			let proc = if idt::is_interrupt_enabled() {
+				Process::get_current()
+			} else {
+				None
+			};
+			let Some(proc) = proc else {
+				if expired() {
+					break Ok(false);
+				}
+				Self::idle(&mut cond);
+				continue;
+			};
+			let pid = proc.lock().get().get_pid();
+
+			// Registering before checking the condition again, so that a wake up happening
+			// meanwhile is not lost
+			if !self.register(pid, &proc) {
+				if expired() {
+					break Ok(false);
+				}
+				Self::idle(&mut cond);
+				continue;
+			}
+
+			{
+				let mut guard = proc.lock();
+				let proc = guard.get_mut();
+
+				// Checked while the process is locked so that neither a signal nor the expiration
+				// of the timer can be missed
+				if interruptible && proc.has_signal_pending() {
+					drop(guard);
+					self.remove(pid);
+					break Err(errno!(EINTR));
+				}
+				if expired() {
+					drop(guard);
+					self.remove(pid);
+					break Ok(false);
+				}
+
+				if let (Some(deadline), None) = (deadline, timer_pid) {
+					with_timer = timer::add(pid, deadline).is_ok();
+					timer_pid = Some(pid);
+				}
+				if with_timer {
+					proc.set_state(State::Sleeping);
+				}
+			}
+
+			if !cond() {
+				crate::wait();
+			}
+
+			self.remove(pid);
+			let mut guard = proc.lock();
+			if guard.get().get_state() == State::Sleeping {
+				guard.get_mut().set_state(State::Running);
+			}
+		};
+
+		if let Some(pid) = timer_pid {
+			timer::cancel(pid);
+		}
+		result
+	}
+
+	/// Makes the current process sleep until `cond` returns true, until a signal is pending or
+	/// until the monotonic clock reaches `deadline`, in nanoseconds. If `deadline` is None, the
+	/// process waits without time limit.
+	///
+	/// The function returns `true` if `cond` returned true and `false` if the deadline has been
+	/// reached. If a signal is pending, the function returns EINTR.
+	pub fn wait_until_interruptible<F: FnMut() -> bool>(&self, cond: F, deadline: Option<u64>)
+		-> Result<bool, Errno> {
+		self.wait_deadline(cond, deadline, true)
+	}
+
+	/// Makes the current process sleep until `cond` returns true or until the monotonic clock
+	/// reaches `deadline`, in nanoseconds. Signals don't interrupt the wait.
+	///
+	/// The function returns `true` if `cond` returned true and `false` if the deadline has been
+	/// reached.
+	pub fn wait_until_deadline<F: FnMut() -> bool>(&self, cond: F, deadline: u64) -> bool {
+		self.wait_deadline(cond, Some(deadline), false).unwrap_or(false)
+	}
+
+	/// Wakes up every process waiting on the queue.
+	/// This function can be called from an interrupt handler.
+	pub fn wake_all(&self) {
+		let waiters = {
+			let mut guard = self.waiters.lock();
+			let waiters = guard.get_mut();
+			if waiters.is_empty() {
+				return;
+			}
+
+			let mut woken = Vec::new();
+			core::mem::swap(waiters, &mut woken);
+			woken
+		};
+
+		for (_, proc) in waiters.iter() {
+			let Some(proc) = proc.get() else {
+				continue;
+			};
+
+			let mut guard = proc.lock();
+			if guard.get().get_state() == State::Sleeping {
+				guard.get_mut().set_state(State::Running);
+			}
+		}
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+	use crate::process::pid::MAX_PID;
+	use crate::process::run_queue::RUN_QUEUE;
+
+	/// The PID of the process used for tests, which is not allocated during selftests.
+	const TEST_PID: Pid = MAX_PID;
+
+	/// The entry of the test process, which never runs.
+	fn test_entry() -> ! {
+		crate::halt();
+	}
+
+	#[test_case]
+	fn wait_queue_wake0() {
+		let queue = WaitQueue::new();
+		let proc = IntSharedPtr::new(Process::kernel_thread(TEST_PID, test_entry).unwrap())
+			.unwrap();
+
+		// Putting the process to sleep the way `wait_until` does
+		assert!(queue.register(TEST_PID, &proc));
+		proc.lock().get_mut().set_state(State::Sleeping);
+		assert!(!RUN_QUEUE.contains(TEST_PID));
+
+		queue.wake_all();
+		assert_eq!(proc.lock().get().get_state(), State::Running);
+		assert!(RUN_QUEUE.contains(TEST_PID));
+		assert!(queue.waiters.lock().get().is_empty());
+
+		// Waking up again has no effect once the process has left the queue
+		proc.lock().get_mut().set_state(State::Sleeping);
+		queue.wake_all();
+		assert_eq!(proc.lock().get().get_state(), State::Sleeping);
+
+		RUN_QUEUE.remove(TEST_PID);
+		// Dropping a process releases its PID, which requires the PID manager
+		core::mem::forget(proc);
+	}
+}
@@ -9,12 +9,10 @@ use crate::time;
 
 /// The implementation of the `clock_gettime64` syscall.
 pub fn clock_gettime64(regs: &Regs) -> Result<i32, Errno> {
-	let _clock_id = regs.ebx as i32;
+	let clock_id = regs.ebx as i32;
 	let tp: SyscallPtr<Timespec> = (regs.ecx as usize).into();
 
-	// TODO Get clock according to param
-	let clk = b"TODO";
-	let curr_time = time::get_struct::<Timespec>(clk).ok_or(errno!(EINVAL))?;
+	let curr_time = time::get_struct::<Timespec>(clock_id).ok_or(errno!(EINVAL))?;
 
 	{
 		let proc_mutex = Process::get_current().unwrap();
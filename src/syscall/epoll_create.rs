@@ -0,0 +1,17 @@
+//! The `epoll_create` system call creates an epoll instance.
+
+use crate::errno::Errno;
+use crate::errno;
+use crate::process::regs::Regs;
+use super::epoll_create1::do_epoll_create1;
+
+/// The implementation of the `epoll_create` syscall.
+pub fn epoll_create(regs: &Regs) -> Result<i32, Errno> {
+	// The size is ignored since the interest list grows dynamically, but it must be positive
+	let size = regs.ebx as i32;
+	if size <= 0 {
+		return Err(errno!(EINVAL));
+	}
+
+	do_epoll_create1(0)
+}
@@ -0,0 +1,30 @@
+//! The `epoll_create1` system call creates an epoll instance with the given flags.
+
+use crate::errno::Errno;
+use crate::errno;
+use crate::file::epoll::EPOLL_CLOEXEC;
+use crate::file::epoll::EPoll;
+use crate::file::open_file::FDTarget;
+use crate::file::open_file::O_RDWR;
+use crate::process::Process;
+use crate::process::regs::Regs;
+use crate::util::ptr::SharedPtr;
+
+/// Creates an epoll instance with the flags `flags` and returns its file descriptor.
+pub fn do_epoll_create1(flags: i32) -> Result<i32, Errno> {
+	if flags & !EPOLL_CLOEXEC != 0 {
+		return Err(errno!(EINVAL));
+	}
+
+	let epoll = SharedPtr::new(EPoll::new()?)?;
+
+	let mutex = Process::get_current().unwrap();
+	let mut guard = mutex.lock();
+	let fd = guard.get_mut().create_fd(O_RDWR | flags, FDTarget::EPoll(epoll))?;
+	Ok(fd.get_id() as _)
+}
+
+/// The implementation of the `epoll_create1` syscall.
+pub fn epoll_create1(regs: &Regs) -> Result<i32, Errno> {
+	do_epoll_create1(regs.ebx as _)
+}
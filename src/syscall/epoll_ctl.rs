@@ -0,0 +1,64 @@
+//! The `epoll_ctl` system call adds, modifies or removes file descriptors in the interest list of
+//! an epoll instance.
+
+use core::ptr;
+use crate::errno::Errno;
+use crate::errno;
+use crate::file::epoll::EPOLL_CTL_ADD;
+use crate::file::epoll::EPOLL_CTL_DEL;
+use crate::file::epoll::EPOLL_CTL_MOD;
+use crate::file::epoll::EPollEvent;
+use crate::file::open_file::FDTarget;
+use crate::process::Process;
+use crate::process::mem_space::ptr::SyscallPtr;
+use crate::process::regs::Regs;
+
+/// The implementation of the `epoll_ctl` syscall.
+pub fn epoll_ctl(regs: &Regs) -> Result<i32, Errno> {
+	let epfd = regs.ebx as u32;
+	let op = regs.ecx as i32;
+	let fd = regs.edx as u32;
+	let event: SyscallPtr<EPollEvent> = (regs.esi as usize).into();
+
+	let (mem_space, epoll_file, open_file) = {
+		let mutex = Process::get_current().unwrap();
+		let guard = mutex.lock();
+		let proc = guard.get();
+
+		let epoll_file = proc.get_fd(epfd).ok_or_else(|| errno!(EBADF))?.get_open_file();
+		let open_file = proc.get_fd(fd).ok_or_else(|| errno!(EBADF))?.get_open_file();
+		(proc.get_mem_space().unwrap(), epoll_file, open_file)
+	};
+	// An instance cannot watch itself
+	if ptr::eq(epoll_file.as_ref(), open_file.as_ref()) {
+		return Err(errno!(EINVAL));
+	}
+
+	let FDTarget::EPoll(epoll) = epoll_file.lock().get().get_target().clone() else {
+		return Err(errno!(EINVAL));
+	};
+	let event = if op != EPOLL_CTL_DEL {
+		event.copy_from_user(&mem_space)?.ok_or_else(|| errno!(EFAULT))?
+	} else {
+		EPollEvent {
+			events: 0,
+			data: 0,
+		}
+	};
+
+	let mut guard = epoll.lock();
+	let epoll = guard.get_mut();
+	match op {
+		EPOLL_CTL_ADD => {
+			let open_file_guard = open_file.lock();
+			epoll.add(fd, open_file_guard.get(), event.events, event.data)?;
+		},
+
+		EPOLL_CTL_MOD => epoll.modify(fd, event.events, event.data)?,
+		EPOLL_CTL_DEL => epoll.remove(fd)?,
+
+		_ => return Err(errno!(EINVAL)),
+	}
+
+	Ok(0)
+}
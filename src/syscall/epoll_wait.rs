@@ -0,0 +1,62 @@
+//! The `epoll_wait` system call waits for events on the interest list of an epoll instance.
+
+use core::cmp::min;
+use core::mem::size_of;
+use core::slice;
+use crate::errno::Errno;
+use crate::errno;
+use crate::file::epoll::EPollEvent;
+use crate::file::epoll;
+use crate::file::open_file::FDTarget;
+use crate::process::Process;
+use crate::process::mem_space::copy;
+use crate::process::regs::Regs;
+
+/// The maximum number of events reported by one call. Reporting fewer events than requested is
+/// allowed, the remaining events are reported on the next call.
+const MAX_EVENTS: usize = 64;
+
+/// The implementation of the `epoll_wait` syscall.
+pub fn epoll_wait(regs: &Regs) -> Result<i32, Errno> {
+	let epfd = regs.ebx as u32;
+	let events_ptr = regs.ecx as usize;
+	let maxevents = regs.edx as i32;
+	let timeout = regs.esi as i32;
+
+	if maxevents <= 0 {
+		return Err(errno!(EINVAL));
+	}
+
+	let (mem_space, epoll_file) = {
+		let mutex = Process::get_current().unwrap();
+		let guard = mutex.lock();
+		let proc = guard.get();
+
+		let epoll_file = proc.get_fd(epfd).ok_or_else(|| errno!(EBADF))?.get_open_file();
+		(proc.get_mem_space().unwrap(), epoll_file)
+	};
+	let FDTarget::EPoll(epoll) = epoll_file.lock().get().get_target().clone() else {
+		return Err(errno!(EINVAL));
+	};
+	// The file descriptor can be closed while waiting
+	drop(epoll_file);
+
+	let timeout = if timeout >= 0 {
+		Some(timeout as _)
+	} else {
+		None
+	};
+
+	let mut events = [EPollEvent {
+		events: 0,
+		data: 0,
+	}; MAX_EVENTS];
+	let events = &mut events[..min(maxevents as usize, MAX_EVENTS)];
+	let n = epoll::wait(&epoll, events, timeout)?;
+
+	let buf = unsafe {
+		slice::from_raw_parts(events.as_ptr() as *const u8, n * size_of::<EPollEvent>())
+	};
+	copy::copy_to_user(&mem_space, events_ptr as _, buf)?;
+	Ok(n as _)
+}
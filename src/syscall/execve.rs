@@ -1,5 +1,6 @@
 //! The `execve` system call allows to execute a program from a file.
 
+use crate::cpu::smp;
 use crate::errno::Errno;
 use crate::errno;
 use crate::file::File;
@@ -155,8 +156,8 @@ pub fn execve(regs: &Regs) -> Result<i32, Errno> {
 	// disabled
 	// A temporary stack cannot be allocated since it wouldn't be possible to free it on success
 	let tmp_stack = {
-		let core = 0; // TODO Get current core ID
-		process::get_scheduler().lock().get_mut().get_tmp_stack(core)
+		let core = smp::get_core_id();
+		process::get_scheduler().lock().get_mut().get_tmp_stack(core as _)
 	};
 
 	// Switching to another stack in order to avoid crashing when switching to the new memory
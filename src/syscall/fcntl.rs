@@ -3,8 +3,11 @@
 use core::ffi::c_void;
 use crate::errno::Errno;
 use crate::file::fd::NewFDConstraint;
+use crate::file::open_file::FDTarget;
+use crate::file::pipe::PipeBuffer;
 use crate::process::Process;
 use crate::process::regs::Regs;
+use crate::util::ptr::SharedPtr;
 
 /// TODO doc
 const F_DUPFD: i32 = 0;
@@ -97,6 +100,18 @@ const F_SEAL_SHRINK: i32 = 2;
 /// TODO doc
 const F_SEAL_WRITE: i32 = 8;
 
+/// Returns the pipe pointed to by the file descriptor `fd` of the process `proc`.
+/// If the file descriptor doesn't point to a pipe, the function returns EBADF.
+fn get_pipe(proc: &Process, fd: i32) -> Result<SharedPtr<PipeBuffer>, Errno> {
+	let open_file_mutex = proc.get_fd(fd as _).ok_or_else(|| errno!(EBADF))?.get_open_file();
+	let open_file_guard = open_file_mutex.lock();
+
+	match open_file_guard.get().get_target() {
+		FDTarget::Pipe(pipe) => Ok(pipe.clone()),
+		_ => Err(errno!(EBADF)),
+	}
+}
+
 /// Performs the fcntl system call.
 /// `fcntl64` tells whether this is the fcntl64 system call.
 pub fn do_fcntl(fd: i32, cmd: i32, arg: *mut c_void, _fcntl64: bool) -> Result<i32, Errno> {
@@ -225,13 +240,15 @@ pub fn do_fcntl(fd: i32, cmd: i32, arg: *mut c_void, _fcntl64: bool) -> Result<i
 		},
 
 		F_SETPIPE_SZ => {
-			// TODO
-			Ok(0)
+			let pipe = get_pipe(proc, fd)?;
+			let mut pipe_guard = pipe.lock();
+			Ok(pipe_guard.get_mut().set_capacity(arg as _)? as _)
 		},
 
 		F_GETPIPE_SZ => {
-			// TODO
-			Ok(0)
+			let pipe = get_pipe(proc, fd)?;
+			let pipe_guard = pipe.lock();
+			Ok(pipe_guard.get().get_capacity() as _)
 		},
 
 		F_ADD_SEALS => {
@@ -0,0 +1,12 @@
+//! The `fdatasync` system call allows to write the cached data of a file to its storage device,
+//! without necessarily writing its metadata.
+
+use crate::errno::Errno;
+use crate::process::regs::Regs;
+use super::fsync::fsync;
+
+/// The implementation of the `fdatasync` syscall.
+/// Since syncing is done for the whole device, this is the same as `fsync`.
+pub fn fdatasync(regs: &Regs) -> Result<i32, Errno> {
+	fsync(regs)
+}
@@ -0,0 +1,44 @@
+//! The `fsync` system call allows to write the cached data of a file to its storage device.
+
+use crate::errno::Errno;
+use crate::errno;
+use crate::file::open_file::FDTarget;
+use crate::process::Process;
+use crate::process::regs::Regs;
+
+/// The implementation of the `fsync` syscall.
+pub fn fsync(regs: &Regs) -> Result<i32, Errno> {
+	let fd = regs.ebx as i32;
+
+	if fd < 0 {
+		return Err(errno!(EBADF));
+	}
+
+	let open_file_mutex = {
+		let mutex = Process::get_current().unwrap();
+		let guard = mutex.lock();
+		let proc = guard.get();
+
+		proc.get_fd(fd as _).ok_or_else(|| errno!(EBADF))?.get_open_file()
+	};
+	let open_file_guard = open_file_mutex.lock();
+	let open_file = open_file_guard.get();
+
+	let FDTarget::File(file_mutex) = open_file.get_target() else {
+		return Err(errno!(EINVAL));
+	};
+	let mountpoint_mutex = {
+		let file_guard = file_mutex.lock();
+		file_guard.get().get_location().get_mountpoint()
+	};
+	// Files that are not on a mountpoint don't have data to sync
+	let Some(mountpoint_mutex) = mountpoint_mutex else {
+		return Ok(0);
+	};
+
+	let io_mutex = mountpoint_mutex.lock().get().get_source().get_io();
+	let mut io_guard = io_mutex.lock();
+	io_guard.get_mut().sync()?;
+
+	Ok(0)
+}
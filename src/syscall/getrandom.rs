@@ -0,0 +1,81 @@
+//! The `getrandom` system call allows to get random bytes.
+
+use core::cmp::min;
+use crate::crypto::rand;
+use crate::errno::Errno;
+use crate::errno;
+use crate::process::Process;
+use crate::process::mem_space::ptr::SyscallSlice;
+use crate::process::regs::Regs;
+
+/// If set, the function doesn't block when not enough entropy is available.
+const GRND_NONBLOCK: u32 = 0b001;
+/// If set, bytes are taken from the random source instead of the urandom source. Both sources are
+/// the same CSPRNG.
+const GRND_RANDOM: u32 = 0b010;
+/// If set, bytes are returned even if not enough entropy has been collected yet.
+const GRND_INSECURE: u32 = 0b100;
+
+/// The implementation of the `getrandom` syscall.
+pub fn getrandom(regs: &Regs) -> Result<i32, Errno> {
+	let buf: SyscallSlice<u8> = (regs.ebx as usize).into();
+	let buflen = regs.ecx as usize;
+	let flags = regs.edx as u32;
+
+	if flags & !(GRND_NONBLOCK | GRND_RANDOM | GRND_INSECURE) != 0 {
+		return Err(errno!(EINVAL));
+	}
+	if flags & GRND_RANDOM != 0 && flags & GRND_INSECURE != 0 {
+		return Err(errno!(EINVAL));
+	}
+
+	let max_len = if flags & GRND_RANDOM != 0 {
+		rand::RANDOM_MAX_REQUEST_SIZE
+	} else {
+		rand::MAX_REQUEST_SIZE
+	};
+	let len = min(buflen, max_len);
+	if len == 0 {
+		return Ok(0);
+	}
+
+	let mem_space = {
+		let mutex = Process::get_current().unwrap();
+		let guard = mutex.lock();
+		guard.get().get_mem_space().unwrap()
+	};
+
+	// Bytes are produced by chunks, locking the memory space for each chunk only, since
+	// interrupts are disabled while it is locked
+	let mut off = 0;
+	while off < len {
+		let chunk_len = min(len - off, rand::CHUNK_SIZE);
+		let produced = {
+			let chunk: SyscallSlice<u8> = (buf.as_ptr() as usize + off).into();
+			let mem_space_guard = mem_space.lock();
+			let chunk = chunk.get_mut(&mem_space_guard, chunk_len)?.ok_or(errno!(EFAULT))?;
+
+			if flags & GRND_INSECURE != 0 {
+				rand::rand_insecure(chunk);
+				true
+			} else {
+				rand::rand(chunk).is_some()
+			}
+		};
+		if produced {
+			off += chunk_len;
+			continue;
+		}
+
+		// The current core's generator may not be seeded after moving to another core
+		if off > 0 {
+			break;
+		}
+		if flags & GRND_NONBLOCK != 0 {
+			return Err(errno!(EAGAIN));
+		}
+		rand::wait_ready()?;
+	}
+
+	Ok(off as _)
+}
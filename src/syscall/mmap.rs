@@ -4,19 +4,23 @@ use core::ffi::c_void;
 use core::intrinsics::wrapping_add;
 use crate::errno::Errno;
 use crate::errno;
+use crate::file::FileType;
+use crate::file::open_file::FDTarget;
+use crate::file::page_cache::CachedFile;
 use crate::memory;
 use crate::process::Process;
 use crate::process::mem_space;
 use crate::process::regs::Regs;
 use crate::syscall::mmap::mem_space::MapConstraint;
+use crate::util::IO;
 use crate::util;
 
 /// Data can be read.
-const PROT_READ: i32 = 0b001;
+pub const PROT_READ: i32 = 0b001;
 /// Data can be written.
-const PROT_WRITE: i32 = 0b010;
+pub const PROT_WRITE: i32 = 0b010;
 /// Data can be executed.
-const PROT_EXEC: i32 = 0b100;
+pub const PROT_EXEC: i32 = 0b100;
 
 /// Changes are shared.
 const MAP_SHARED: i32 = 0b001;
@@ -74,8 +78,8 @@ pub fn do_mmap(addr: *mut c_void, length: usize, prot: i32, flags: i32, fd: i32,
 	let mut guard = mutex.lock();
 	let proc = guard.get_mut();
 
-	// The file the mapping points to
-	let file = if fd >= 0 {
+	// The open file the mapping points to
+	let open_file = if fd >= 0 {
 		if let Some(fd) = proc.get_fd(fd as _) {
 			Some(fd.get_open_file())
 		} else {
@@ -85,16 +89,34 @@ pub fn do_mmap(addr: *mut c_void, length: usize, prot: i32, flags: i32, fd: i32,
 		None
 	};
 
-	if let Some(_file) = &file {
+	// The file the mapping points to. Files that cannot be cached, such as devices, are mapped
+	// as anonymous memory
+	let file = if let Some(open_file) = &open_file {
 		// Checking the alignment of the offset
 		if offset as usize % memory::PAGE_SIZE != 0 {
 			return Err(errno!(EINVAL));
 		}
 
 		// TODO Check the read/write state of the open file matches the mapping
+		let open_file_guard = open_file.lock();
+		match open_file_guard.get().get_target() {
+			FDTarget::File(file_mutex) => {
+				let file_guard = file_mutex.lock();
+				let file = file_guard.get();
+
+				if file.get_file_type() == FileType::Regular {
+					CachedFile::new(file.get_location(), file.get_size())
+				} else {
+					None
+				}
+			},
+
+			_ => None,
+		}
 	} else {
 		// TODO If the mapping requires a fd, return an error
-	}
+		None
+	};
 
 	// The process's memory space
 	let mem_space = proc.get_mem_space().unwrap();
@@ -19,6 +19,10 @@ mod creat;
 mod delete_module;
 mod dup2;
 mod dup;
+mod epoll_create1;
+mod epoll_create;
+mod epoll_ctl;
+mod epoll_wait;
 mod execve;
 mod exit_group;
 mod faccessat2;
@@ -26,8 +30,10 @@ mod faccessat;
 mod fchdir;
 mod fcntl64;
 mod fcntl;
+mod fdatasync;
 mod finit_module;
 mod fork;
+mod fsync;
 mod getcwd;
 mod getdents64;
 mod getdents;
@@ -40,6 +46,7 @@ mod getgid;
 mod getpgid;
 mod getpid;
 mod getppid;
+mod getrandom;
 mod getrusage;
 mod gettid;
 mod getuid32;
@@ -54,6 +61,8 @@ mod mmap2;
 mod mmap;
 mod modify_ldt;
 mod mount;
+mod mprotect;
+mod mremap;
 mod msync;
 mod munmap;
 mod nanosleep;
@@ -71,6 +80,8 @@ mod reboot;
 mod rt_sigaction;
 mod rt_sigprocmask;
 mod select;
+mod sendfile64;
+mod sendfile;
 mod set_thread_area;
 mod set_tid_address;
 mod setgid;
@@ -79,7 +90,9 @@ mod setuid;
 mod signal;
 mod sigreturn;
 mod socketpair;
+mod splice;
 mod statx;
+mod sync;
 mod time;
 mod tkill;
 mod truncate;
@@ -89,6 +102,7 @@ mod uname;
 mod unlink;
 mod util;
 mod vfork;
+mod vmsplice;
 mod wait4;
 mod wait;
 mod waitpid;
@@ -96,10 +110,20 @@ mod write;
 mod writev;
 pub mod ioctl;
 
+#[cfg(config_debug_syscall_stats)]
+use core::sync::atomic;
+#[cfg(config_debug_syscall_stats)]
+use core::sync::atomic::AtomicU64;
+#[cfg(config_debug_syscall_stats)]
+use crate::cpu;
 use crate::errno::Errno;
+use crate::errno;
 use crate::process::Process;
+use crate::process::mem_space::ptr::SyscallPtr;
 use crate::process::regs::Regs;
 use crate::process::signal::Signal;
+use crate::trace::EventType;
+use crate::trace;
 
 //use modify_ldt::modify_ldt;
 //use wait::wait;
@@ -118,6 +142,10 @@ use creat::creat;
 use delete_module::delete_module;
 use dup2::dup2;
 use dup::dup;
+use epoll_create1::epoll_create1;
+use epoll_create::epoll_create;
+use epoll_ctl::epoll_ctl;
+use epoll_wait::epoll_wait;
 use execve::execve;
 use exit_group::exit_group;
 use faccessat2::faccessat2;
@@ -125,8 +153,10 @@ use faccessat::faccessat;
 use fchdir::fchdir;
 use fcntl64::fcntl64;
 use fcntl::fcntl;
+use fdatasync::fdatasync;
 use finit_module::finit_module;
 use fork::fork;
+use fsync::fsync;
 use getcwd::getcwd;
 use getdents64::getdents64;
 use getdents::getdents;
@@ -139,6 +169,7 @@ use getgid::getgid;
 use getpgid::getpgid;
 use getpid::getpid;
 use getppid::getppid;
+use getrandom::getrandom;
 use getrusage::getrusage;
 use gettid::gettid;
 use getuid32::getuid32;
@@ -153,6 +184,8 @@ use mknod::mknod;
 use mmap2::mmap2;
 use mmap::mmap;
 use mount::mount;
+use mprotect::mprotect;
+use mremap::mremap;
 use msync::msync;
 use munmap::munmap;
 use nanosleep::nanosleep;
@@ -170,6 +203,8 @@ use reboot::reboot;
 use rt_sigaction::rt_sigaction;
 use rt_sigprocmask::rt_sigprocmask;
 use select::select;
+use sendfile64::sendfile64;
+use sendfile::sendfile;
 use set_thread_area::set_thread_area;
 use set_tid_address::set_tid_address;
 use setgid::setgid;
@@ -178,7 +213,9 @@ use setuid::setuid;
 use signal::signal;
 use sigreturn::sigreturn;
 use socketpair::socketpair;
+use splice::splice;
 use statx::statx;
+use sync::sync;
 use time::time;
 use tkill::tkill;
 use truncate::truncate;
@@ -187,541 +224,521 @@ use umount::umount;
 use uname::uname;
 use unlink::unlink;
 use vfork::vfork;
+use vmsplice::vmsplice;
 use wait4::wait4;
 use waitpid::waitpid;
 use write::write;
 use writev::writev;
 
+/// The number of entries in the system calls table.
+const SYSCALLS_COUNT: usize = 0x1c3;
+
 /// Structure representing a system call.
+#[derive(Clone, Copy)]
 struct Syscall {
 	/// The syscall's handler.
-	pub handler: &'static dyn Fn(&Regs) -> Result<i32, Errno>,
+	pub handler: fn(&Regs) -> Result<i32, Errno>,
 
 	/// The syscall's name.
 	pub name: &'static str,
-
-	/// The syscall's arguments names.
-	pub args: &'static [&'static str],
 }
 
-/// Returns the system call associated with the given ID `id`.
-/// If the syscall doesn't exist, the function returns None.
-fn get_syscall(id: u32) -> Option<Syscall> {
-	// TODO Fill arguments for each
-	match id {
-		// TODO 0x000 => Some(Syscall { handler: &restart_syscall, name: "restart_syscall", args: &[] }),
-		0x001 => Some(Syscall { handler: &_exit, name: "_exit", args: &[] }),
-		0x002 => Some(Syscall { handler: &fork, name: "fork", args: &[] }),
-		0x003 => Some(Syscall { handler: &read, name: "read", args: &[] }),
-		0x004 => Some(Syscall { handler: &write, name: "write", args: &[] }),
-		0x005 => Some(Syscall { handler: &open, name: "open", args: &[] }),
-		0x006 => Some(Syscall { handler: &close, name: "close", args: &[] }),
-		0x007 => Some(Syscall { handler: &waitpid, name: "waitpid", args: &[] }),
-		0x008 => Some(Syscall { handler: &creat, name: "creat", args: &[] }),
-		0x009 => Some(Syscall { handler: &link, name: "link", args: &[] }),
-		0x00a => Some(Syscall { handler: &unlink, name: "unlink", args: &[] }),
-		0x00b => Some(Syscall { handler: &execve, name: "execve", args: &[] }),
-		0x00c => Some(Syscall { handler: &chdir, name: "chdir", args: &[] }),
-		0x00d => Some(Syscall { handler: &time, name: "time", args: &[] }),
-		0x00e => Some(Syscall { handler: &mknod, name: "mknod", args: &[] }),
-		// TODO 0x00f => Some(Syscall { handler: &chmod, name: "chmod", args: &[] }),
-		// TODO 0x010 => Some(Syscall { handler: &lchown, name: "lchown", args: &[] }),
-		0x011 => Some(Syscall { handler: &r#break, name: "break", args: &[] }),
-		// TODO 0x012 => Some(Syscall { handler: &oldstat, name: "oldstat", args: &[] }),
-		// TODO 0x013 => Some(Syscall { handler: &lseek, name: "lseek", args: &[] }),
-		0x014 => Some(Syscall { handler: &getpid, name: "getpid", args: &[] }),
-		0x015 => Some(Syscall { handler: &mount, name: "mount", args: &[] }),
-		0x016 => Some(Syscall { handler: &umount, name: "umount", args: &[] }),
-		0x017 => Some(Syscall { handler: &setuid, name: "setuid", args: &[] }),
-		0x018 => Some(Syscall { handler: &getuid, name: "getuid", args: &[] }),
-		// TODO 0x019 => Some(Syscall { handler: &stime, name: "stime", args: &[] }),
-		// TODO 0x01a => Some(Syscall { handler: &ptrace, name: "ptrace", args: &[] }),
-		// TODO 0x01b => Some(Syscall { handler: &alarm, name: "alarm", args: &[] }),
-		// TODO 0x01c => Some(Syscall { handler: &oldfstat, name: "oldfstat", args: &[] }),
-		// TODO 0x01d => Some(Syscall { handler: &pause, name: "pause", args: &[] }),
-		// TODO 0x01e => Some(Syscall { handler: &utime, name: "utime", args: &[] }),
-		// TODO 0x01f => Some(Syscall { handler: &stty, name: "stty", args: &[] }),
-		// TODO 0x020 => Some(Syscall { handler: &gtty, name: "gtty", args: &[] }),
-		0x021 => Some(Syscall { handler: &access, name: "access", args: &[] }),
-		// TODO 0x022 => Some(Syscall { handler: &nice, name: "nice", args: &[] }),
-		// TODO 0x023 => Some(Syscall { handler: &ftime, name: "ftime", args: &[] }),
-		// TODO 0x024 => Some(Syscall { handler: &sync, name: "sync", args: &[] }),
-		0x025 => Some(Syscall { handler: &kill, name: "kill", args: &[] }),
-		// TODO 0x026 => Some(Syscall { handler: &rename, name: "rename", args: &[] }),
-		0x027 => Some(Syscall { handler: &mkdir, name: "mkdir", args: &[] }),
-		// TODO 0x028 => Some(Syscall { handler: &rmdir, name: "rmdir", args: &[] }),
-		0x029 => Some(Syscall { handler: &dup, name: "dup", args: &[] }),
-		0x02a => Some(Syscall { handler: &pipe, name: "pipe", args: &[] }),
-		// TODO 0x02b => Some(Syscall { handler: &times, name: "times", args: &[] }),
-		// TODO 0x02c => Some(Syscall { handler: &prof, name: "prof", args: &[] }),
-		0x02d => Some(Syscall { handler: &brk, name: "brk", args: &[] }),
-		0x02e => Some(Syscall { handler: &setgid, name: "setgid", args: &[] }),
-		0x02f => Some(Syscall { handler: &getgid, name: "getgid", args: &[] }),
-		0x030 => Some(Syscall { handler: &signal, name: "signal", args: &[] }),
-		0x031 => Some(Syscall { handler: &geteuid, name: "geteuid", args: &[] }),
-		0x032 => Some(Syscall { handler: &getegid, name: "getegid", args: &[] }),
-		// TODO 0x033 => Some(Syscall { handler: &acct, name: "acct", args: &[] }),
-		// TODO 0x034 => Some(Syscall { handler: &umount2, name: "umount2", args: &[] }),
-		// TODO 0x035 => Some(Syscall { handler: &lock, name: "lock", args: &[] }),
-		0x036 => Some(Syscall { handler: &ioctl, name: "ioctl", args: &[] }),
-		0x037 => Some(Syscall { handler: &fcntl, name: "fcntl", args: &[] }),
-		// TODO 0x038 => Some(Syscall { handler: &mpx, name: "mpx", args: &[] }),
-		0x039 => Some(Syscall { handler: &setpgid, name: "setpgid", args: &[] }),
-		// TODO 0x03a => Some(Syscall { handler: &ulimit, name: "ulimit", args: &[] }),
-		// TODO 0x03b => Some(Syscall { handler: &oldolduname, name: "oldolduname", args: &[] }),
-		0x03c => Some(Syscall { handler: &umask, name: "umask", args: &[] }),
-		0x03d => Some(Syscall { handler: &chroot, name: "chroot", args: &[] }),
-		// TODO 0x03e => Some(Syscall { handler: &ustat, name: "ustat", args: &[] }),
-		0x03f => Some(Syscall { handler: &dup2, name: "dup2", args: &[] }),
-		0x040 => Some(Syscall { handler: &getppid, name: "getppid", args: &[] }),
-		// TODO 0x041 => Some(Syscall { handler: &getpgrp, name: "getpgrp", args: &[] }),
-		// TODO 0x042 => Some(Syscall { handler: &setsid, name: "setsid", args: &[] }),
-		// TODO 0x043 => Some(Syscall { handler: &sigaction, name: "sigaction", args: &[] }),
-		// TODO 0x044 => Some(Syscall { handler: &sgetmask, name: "sgetmask", args: &[] }),
-		// TODO 0x045 => Some(Syscall { handler: &ssetmask, name: "ssetmask", args: &[] }),
-		// TODO 0x046 => Some(Syscall { handler: &setreuid, name: "setreuid", args: &[] }),
-		// TODO 0x047 => Some(Syscall { handler: &setregid, name: "setregid", args: &[] }),
-		// TODO 0x048 => Some(Syscall { handler: &sigsuspend, name: "sigsuspend", args: &[] }),
-		// TODO 0x049 => Some(Syscall { handler: &sigpending, name: "sigpending", args: &[] }),
-		// TODO 0x04a => Some(Syscall { handler: &sethostname, name: "sethostname", args: &[] }),
-		// TODO 0x04b => Some(Syscall { handler: &setrlimit, name: "setrlimit", args: &[] }),
-		// TODO 0x04c => Some(Syscall { handler: &getrlimit, name: "getrlimit", args: &[] }),
-		0x04d => Some(Syscall { handler: &getrusage, name: "getrusage", args: &[] }),
-		// TODO 0x04e => Some(Syscall { handler: &gettimeofday, name: "gettimeofday", args: &[] }),
-		// TODO 0x04f => Some(Syscall { handler: &settimeofday, name: "settimeofday", args: &[] }),
-		// TODO 0x050 => Some(Syscall { handler: &getgroups, name: "getgroups", args: &[] }),
-		// TODO 0x051 => Some(Syscall { handler: &setgroups, name: "setgroups", args: &[] }),
-		0x052 => Some(Syscall { handler: &select, name: "select", args: &[] }),
-		// TODO 0x053 => Some(Syscall { handler: &symlink, name: "symlink", args: &[] }),
-		// TODO 0x054 => Some(Syscall { handler: &oldlstat, name: "oldlstat", args: &[] }),
-		// TODO 0x055 => Some(Syscall { handler: &readlink, name: "readlink", args: &[] }),
-		// TODO 0x056 => Some(Syscall { handler: &uselib, name: "uselib", args: &[] }),
-		// TODO 0x057 => Some(Syscall { handler: &swapon, name: "swapon", args: &[] }),
-		0x058 => Some(Syscall { handler: &reboot, name: "reboot", args: &[] }),
-		// TODO 0x059 => Some(Syscall { handler: &readdir, name: "readdir", args: &[] }),
-		0x05a => Some(Syscall { handler: &mmap, name: "mmap", args: &["addr", "length", "prot", "flags", "fd", "offset"] }),
-		0x05b => Some(Syscall { handler: &munmap, name: "munmap", args: &[] }),
-		0x05c => Some(Syscall { handler: &truncate, name: "truncate", args: &[] }),
-		// TODO 0x05d => Some(Syscall { handler: &ftruncate, name: "ftruncate", args: &[] }),
-		// TODO 0x05e => Some(Syscall { handler: &fchmod, name: "fchmod", args: &[] }),
-		// TODO 0x05f => Some(Syscall { handler: &fchown, name: "fchown", args: &[] }),
-		// TODO 0x060 => Some(Syscall { handler: &getpriority, name: "getpriority", args: &[] }),
-		// TODO 0x061 => Some(Syscall { handler: &setpriority, name: "setpriority", args: &[] }),
-		// TODO 0x062 => Some(Syscall { handler: &profil, name: "profil", args: &[] }),
-		// TODO 0x063 => Some(Syscall { handler: &statfs, name: "statfs", args: &[] }),
-		// TODO 0x064 => Some(Syscall { handler: &fstatfs, name: "fstatfs", args: &[] }),
-		// TODO 0x065 => Some(Syscall { handler: &ioperm, name: "ioperm", args: &[] }),
-		// TODO 0x066 => Some(Syscall { handler: &socketcall, name: "socketcall", args: &[] }),
-		// TODO 0x067 => Some(Syscall { handler: &syslog, name: "syslog", args: &[] }),
-		// TODO 0x068 => Some(Syscall { handler: &setitimer, name: "setitimer", args: &[] }),
-		// TODO 0x069 => Some(Syscall { handler: &getitimer, name: "getitimer", args: &[] }),
-		// TODO 0x06a => Some(Syscall { handler: &stat, name: "stat", args: &[] }),
-		// TODO 0x06b => Some(Syscall { handler: &lstat, name: "lstat", args: &[] }),
-		// TODO 0x06c => Some(Syscall { handler: &fstat, name: "fstat", args: &[] }),
-		// TODO 0x06d => Some(Syscall { handler: &olduname, name: "olduname", args: &[] }),
-		// TODO 0x06e => Some(Syscall { handler: &iopl, name: "iopl", args: &[] }),
-		// TODO 0x06f => Some(Syscall { handler: &vhangup, name: "vhangup", args: &[] }),
-		// TODO 0x070 => Some(Syscall { handler: &idle, name: "idle", args: &[] }),
-		// TODO 0x071 => Some(Syscall { handler: &vm86old, name: "vm86old", args: &[] }),
-		0x072 => Some(Syscall { handler: &wait4, name: "wait4", args: &[] }),
-		// TODO 0x073 => Some(Syscall { handler: &swapoff, name: "swapoff", args: &[] }),
-		// TODO 0x074 => Some(Syscall { handler: &sysinfo, name: "sysinfo", args: &[] }),
-		// TODO 0x075 => Some(Syscall { handler: &ipc, name: "ipc", args: &[] }),
-		// TODO 0x076 => Some(Syscall { handler: &fsync, name: "fsync", args: &[] }),
-		0x077 => Some(Syscall { handler: &sigreturn, name: "sigreturn", args: &[] }),
-		0x078 => Some(Syscall { handler: &clone, name: "clone", args: &[] }),
-		// TODO 0x079 => Some(Syscall { handler: &setdomainname, name: "setdomainname", args: &[] }),
-		0x07a => Some(Syscall { handler: &uname, name: "uname", args: &[] }),
-		// TODO 0x07c => Some(Syscall { handler: &adjtimex, name: "adjtimex", args: &[] }),
-		// TODO 0x07d => Some(Syscall { handler: &mprotect, name: "mprotect", args: &[] }),
-		// TODO 0x07e => Some(Syscall { handler: &sigprocmask, name: "sigprocmask", args: &[] }),
-		// TODO 0x07f => Some(Syscall { handler: &create_module, name: "create_module", args: &[] }),
-		0x080 => Some(Syscall { handler: &init_module, name: "init_module", args: &[] }),
-		0x081 => Some(Syscall { handler: &delete_module, name: "delete_module", args: &[] }),
-		// TODO 0x083 => Some(Syscall { handler: &quotactl, name: "quotactl", args: &[] }),
-		0x084 => Some(Syscall { handler: &getpgid, name: "getpgid", args: &[] }),
-		0x085 => Some(Syscall { handler: &fchdir, name: "fchdir", args: &[] }),
-		// TODO 0x086 => Some(Syscall { handler: &bdflush, name: "bdflush", args: &[] }),
-		// TODO 0x087 => Some(Syscall { handler: &sysfs, name: "sysfs", args: &[] }),
-		// TODO 0x088 => Some(Syscall { handler: &personality, name: "personality", args: &[] }),
-		// TODO 0x089 => Some(Syscall { handler: &afs_syscall, name: "afs_syscall", args: &[] }),
-		// TODO 0x08a => Some(Syscall { handler: &setfsuid, name: "setfsuid", args: &[] }),
-		// TODO 0x08b => Some(Syscall { handler: &setfsgid, name: "setfsgid", args: &[] }),
-		0x08c => Some(Syscall { handler: &_llseek, name: "_llseek", args: &[] }),
-		0x08d => Some(Syscall { handler: &getdents, name: "getdents", args: &[] }),
-		0x08e => Some(Syscall { handler: &_newselect, name: "_newselect", args: &[] }),
-		// TODO 0x08f => Some(Syscall { handler: &flock, name: "flock", args: &[] }),
-		0x090 => Some(Syscall { handler: &msync, name: "msync", args: &[] }),
-		// TODO 0x091 => Some(Syscall { handler: &readv, name: "readv", args: &[] }),
-		0x092 => Some(Syscall { handler: &writev, name: "writev", args: &[] }),
-		// TODO 0x093 => Some(Syscall { handler: &getsid, name: "getsid", args: &[] }),
-		// TODO 0x094 => Some(Syscall { handler: &fdatasync, name: "fdatasync", args: &[] }),
-		// TODO 0x095 => Some(Syscall { handler: &_sysctl, name: "_sysctl", args: &[] }),
-		// TODO 0x096 => Some(Syscall { handler: &mlock, name: "mlock", args: &[] }),
-		// TODO 0x097 => Some(Syscall { handler: &munlock, name: "munlock", args: &[] }),
-		// TODO 0x098 => Some(Syscall { handler: &mlockall, name: "mlockall", args: &[] }),
-		// TODO 0x099 => Some(Syscall { handler: &munlockall, name: "munlockall", args: &[] }),
-		// TODO 0x09a => Some(Syscall { handler: &sched_setparam, name: "sched_setparam", args: &[] }),
-		// TODO 0x09b => Some(Syscall { handler: &sched_getparam, name: "sched_getparam", args: &[] }),
-		// TODO 0x09c => Some(Syscall { handler: &sched_setscheduler, name: "sched_setscheduler", args: &[] }),
-		// TODO 0x09d => Some(Syscall { handler: &sched_getscheduler, name: "sched_getscheduler", args: &[] }),
-		// TODO 0x09e => Some(Syscall { handler: &sched_yield, name: "sched_yield", args: &[] }),
-		// TODO 0x09f => Some(Syscall { handler: &sched_get_priority_max, name: "sched_get_priority_max", args: &[] }),
-		// TODO 0x0a0 => Some(Syscall { handler: &sched_get_priority_min, name: "sched_get_priority_min", args: &[] }),
-		// TODO 0x0a1 => Some(Syscall { handler: &sched_rr_get_interval, name: "sched_rr_get_interval", args: &[] }),
-		0x0a2 => Some(Syscall { handler: &nanosleep, name: "nanosleep", args: &[] }),
-		// TODO 0x0a3 => Some(Syscall { handler: &mremap, name: "mremap", args: &[] }),
-		// TODO 0x0a4 => Some(Syscall { handler: &setresuid, name: "setresuid", args: &[] }),
-		// TODO 0x0a5 => Some(Syscall { handler: &getresuid, name: "getresuid", args: &[] }),
-		// TODO 0x0a6 => Some(Syscall { handler: &vm86, name: "vm86", args: &[] }),
-		// TODO 0x0a7 => Some(Syscall { handler: &query_module, name: "query_module", args: &[] }),
-		0x0a8 => Some(Syscall { handler: &poll, name: "poll", args: &[] }),
-		// TODO 0x0a9 => Some(Syscall { handler: &nfsservctl, name: "nfsservctl", args: &[] }),
-		// TODO 0x0aa => Some(Syscall { handler: &setresgid, name: "setresgid", args: &[] }),
-		// TODO 0x0ab => Some(Syscall { handler: &getresgid, name: "getresgid", args: &[] }),
-		// TODO 0x0ac => Some(Syscall { handler: &prctl, name: "prctl", args: &[] }),
-		// TODO 0x0ad => Some(Syscall { handler: &rt_sigreturn, name: "rt_sigreturn", args: &[] }),
-		0x0ae => Some(Syscall { handler: &rt_sigaction, name: "rt_sigaction", args: &[] }),
-		0x0af => Some(Syscall { handler: &rt_sigprocmask, name: "rt_sigprocmask", args: &[] }),
-		// TODO 0x0b0 => Some(Syscall { handler: &rt_sigpending, name: "rt_sigpending", args: &[] }),
-		// TODO 0x0b1 => Some(Syscall { handler: &rt_sigtimedwait, name: "rt_sigtimedwait", args: &[] }),
-		// TODO 0x0b2 => Some(Syscall { handler: &rt_sigqueueinfo, name: "rt_sigqueueinfo", args: &[] }),
-		// TODO 0x0b3 => Some(Syscall { handler: &rt_sigsuspend, name: "rt_sigsuspend", args: &[] }),
-		// TODO 0x0b4 => Some(Syscall { handler: &pread64, name: "pread64", args: &[] }),
-		// TODO 0x0b5 => Some(Syscall { handler: &pwrite64, name: "pwrite64", args: &[] }),
-		// TODO 0x0b6 => Some(Syscall { handler: &chown, name: "chown", args: &[] }),
-		0x0b7 => Some(Syscall { handler: &getcwd, name: "getcwd", args: &[] }),
-		// TODO 0x0b8 => Some(Syscall { handler: &capget, name: "capget", args: &[] }),
-		// TODO 0x0b9 => Some(Syscall { handler: &capset, name: "capset", args: &[] }),
-		// TODO 0x0ba => Some(Syscall { handler: &sigaltstack, name: "sigaltstack", args: &[] }),
-		// TODO 0x0bb => Some(Syscall { handler: &sendfile, name: "sendfile", args: &[] }),
-		// TODO 0x0bc => Some(Syscall { handler: &getpmsg, name: "getpmsg", args: &[] }),
-		// TODO 0x0bd => Some(Syscall { handler: &putpmsg, name: "putpmsg", args: &[] }),
-		0x0be => Some(Syscall { handler: &vfork, name: "vfork", args: &[] }),
-		// TODO 0x0bf => Some(Syscall { handler: &ugetrlimit, name: "ugetrlimit", args: &[] }),
-		0x0c0 => Some(Syscall { handler: &mmap2, name: "mmap2", args: &["addr", "length", "prot", "flags", "fd", "offset"] }),
-		// TODO 0x0c1 => Some(Syscall { handler: &truncate64, name: "truncate64", args: &[] }),
-		// TODO 0x0c2 => Some(Syscall { handler: &ftruncate64, name: "ftruncate64", args: &[] }),
-		// TODO 0x0c3 => Some(Syscall { handler: &stat64, name: "stat64", args: &[] }),
-		// TODO 0x0c4 => Some(Syscall { handler: &lstat64, name: "lstat64", args: &[] }),
-		// TODO 0x0c5 => Some(Syscall { handler: &fstat64, name: "fstat64", args: &[] }),
-		// TODO 0x0c6 => Some(Syscall { handler: &lchown32, name: "lchown32", args: &[] }),
-		0x0c7 => Some(Syscall { handler: &getuid32, name: "getuid32", args: &[] }),
-		0x0c8 => Some(Syscall { handler: &getgid32, name: "getgid32", args: &[] }),
-		0x0c9 => Some(Syscall { handler: &geteuid32, name: "geteuid32", args: &[] }),
-		0x0ca => Some(Syscall { handler: &getegid32, name: "getegid32", args: &[] }),
-		// TODO 0x0cb => Some(Syscall { handler: &setreuid32, name: "setreuid32", args: &[] }),
-		// TODO 0x0cc => Some(Syscall { handler: &setregid32, name: "setregid32", args: &[] }),
-		// TODO 0x0cd => Some(Syscall { handler: &getgroups32, name: "getgroups32", args: &[] }),
-		// TODO 0x0ce => Some(Syscall { handler: &setgroups32, name: "setgroups32", args: &[] }),
-		// TODO 0x0cf => Some(Syscall { handler: &fchown32, name: "fchown32", args: &[] }),
-		// TODO 0x0d0 => Some(Syscall { handler: &setresuid32, name: "setresuid32", args: &[] }),
-		// TODO 0x0d1 => Some(Syscall { handler: &getresuid32, name: "getresuid32", args: &[] }),
-		// TODO 0x0d2 => Some(Syscall { handler: &setresgid32, name: "setresgid32", args: &[] }),
-		// TODO 0x0d3 => Some(Syscall { handler: &getresgid32, name: "getresgid32", args: &[] }),
-		// TODO 0x0d4 => Some(Syscall { handler: &chown32, name: "chown32", args: &[] }),
-		// TODO 0x0d5 => Some(Syscall { handler: &setuid32, name: "setuid32", args: &[] }),
-		// TODO 0x0d6 => Some(Syscall { handler: &setgid32, name: "setgid32", args: &[] }),
-		// TODO 0x0d7 => Some(Syscall { handler: &setfsuid32, name: "setfsuid32", args: &[] }),
-		// TODO 0x0d8 => Some(Syscall { handler: &setfsgid32, name: "setfsgid32", args: &[] }),
-		// TODO 0x0d9 => Some(Syscall { handler: &pivot_root, name: "pivot_root", args: &[] }),
-		// TODO 0x0da => Some(Syscall { handler: &mincore, name: "mincore", args: &[] }),
-		0x0db => Some(Syscall { handler: &madvise, name: "madvise", args: &[] }),
-		0x0dc => Some(Syscall { handler: &getdents64, name: "getdents64", args: &[] }),
-		0x0dd => Some(Syscall { handler: &fcntl64, name: "fcntl64", args: &[] }),
-		0x0e0 => Some(Syscall { handler: &gettid, name: "gettid", args: &[] }),
-		// TODO 0x0e1 => Some(Syscall { handler: &readahead, name: "readahead", args: &[] }),
-		// TODO 0x0e2 => Some(Syscall { handler: &setxattr, name: "setxattr", args: &[] }),
-		// TODO 0x0e3 => Some(Syscall { handler: &lsetxattr, name: "lsetxattr", args: &[] }),
-		// TODO 0x0e4 => Some(Syscall { handler: &fsetxattr, name: "fsetxattr", args: &[] }),
-		// TODO 0x0e5 => Some(Syscall { handler: &getxattr, name: "getxattr", args: &[] }),
-		// TODO 0x0e6 => Some(Syscall { handler: &lgetxattr, name: "lgetxattr", args: &[] }),
-		// TODO 0x0e7 => Some(Syscall { handler: &fgetxattr, name: "fgetxattr", args: &[] }),
-		// TODO 0x0e8 => Some(Syscall { handler: &listxattr, name: "listxattr", args: &[] }),
-		// TODO 0x0e9 => Some(Syscall { handler: &llistxattr, name: "llistxattr", args: &[] }),
-		// TODO 0x0ea => Some(Syscall { handler: &flistxattr, name: "flistxattr", args: &[] }),
-		// TODO 0x0eb => Some(Syscall { handler: &removexattr, name: "removexattr", args: &[] }),
-		// TODO 0x0ec => Some(Syscall { handler: &lremovexattr, name: "lremovexattr", args: &[] }),
-		// TODO 0x0ed => Some(Syscall { handler: &fremovexattr, name: "fremovexattr", args: &[] }),
-		0x0ee => Some(Syscall { handler: &tkill, name: "tkill", args: &[] }),
-		// TODO 0x0ef => Some(Syscall { handler: &sendfile64, name: "sendfile64", args: &[] }),
-		// TODO 0x0f0 => Some(Syscall { handler: &futex, name: "futex", args: &[] }),
-		// TODO 0x0f1 => Some(Syscall { handler: &sched_setaffinity, name: "sched_setaffinity", args: &[] }),
-		// TODO 0x0f2 => Some(Syscall { handler: &sched_getaffinity, name: "sched_getaffinity", args: &[] }),
-		0x0f3 => Some(Syscall { handler: &set_thread_area, name: "set_thread_area", args: &[] }),
-		// TODO 0x0f4 => Some(Syscall { handler: &get_thread_area, name: "get_thread_area", args: &[] }),
-		// TODO 0x0f5 => Some(Syscall { handler: &io_setup, name: "io_setup", args: &[] }),
-		// TODO 0x0f6 => Some(Syscall { handler: &io_destroy, name: "io_destroy", args: &[] }),
-		// TODO 0x0f7 => Some(Syscall { handler: &io_getevents, name: "io_getevents", args: &[] }),
-		// TODO 0x0f8 => Some(Syscall { handler: &io_submit, name: "io_submit", args: &[] }),
-		// TODO 0x0f9 => Some(Syscall { handler: &io_cancel, name: "io_cancel", args: &[] }),
-		// TODO 0x0fa => Some(Syscall { handler: &fadvise64, name: "fadvise64", args: &[] }),
-		0x0fc => Some(Syscall { handler: &exit_group, name: "exit_group", args: &[] }),
-		// TODO 0x0fd => Some(Syscall { handler: &lookup_dcookie, name: "lookup_dcookie", args: &[] }),
-		// TODO 0x0fe => Some(Syscall { handler: &epoll_create, name: "epoll_create", args: &[] }),
-		// TODO 0x0ff => Some(Syscall { handler: &epoll_ctl, name: "epoll_ctl", args: &[] }),
-		// TODO 0x100 => Some(Syscall { handler: &epoll_wait, name: "epoll_wait", args: &[] }),
-		// TODO 0x101 => Some(Syscall { handler: &remap_file_pages, name: "remap_file_pages", args: &[] }),
-		0x102 => Some(Syscall { handler: &set_tid_address, name: "set_tid_address", args: &[] }),
-		// TODO 0x103 => Some(Syscall { handler: &timer_create, name: "timer_create", args: &[] }),
-		// TODO 0x104 => Some(Syscall { handler: &timer_settime, name: "timer_settime", args: &[] }),
-		// TODO 0x105 => Some(Syscall { handler: &timer_gettime, name: "timer_gettime", args: &[] }),
-		// TODO 0x106 => Some(Syscall { handler: &timer_getoverrun, name: "timer_getoverrun", args: &[] }),
-		// TODO 0x107 => Some(Syscall { handler: &timer_delete, name: "timer_delete", args: &[] }),
-		// TODO 0x108 => Some(Syscall { handler: &clock_settime, name: "clock_settime", args: &[] }),
-		0x109 => Some(Syscall { handler: &clock_gettime, name: "clock_gettime", args: &[] }),
-		// TODO 0x10a => Some(Syscall { handler: &clock_getres, name: "clock_getres", args: &[] }),
-		// TODO 0x10b => Some(Syscall { handler: &clock_nanosleep, name: "clock_nanosleep", args: &[] }),
-		// TODO 0x10c => Some(Syscall { handler: &statfs64, name: "statfs64", args: &[] }),
-		// TODO 0x10d => Some(Syscall { handler: &fstatfs64, name: "fstatfs64", args: &[] }),
-		// TODO 0x10e => Some(Syscall { handler: &tgkill, name: "tgkill", args: &[] }),
-		// TODO 0x10f => Some(Syscall { handler: &utimes, name: "utimes", args: &[] }),
-		// TODO 0x110 => Some(Syscall { handler: &fadvise64_64, name: "fadvise64_64", args: &[] }),
-		// TODO 0x111 => Some(Syscall { handler: &vserver, name: "vserver", args: &[] }),
-		// TODO 0x112 => Some(Syscall { handler: &mbind, name: "mbind", args: &[] }),
-		// TODO 0x113 => Some(Syscall { handler: &get_mempolicy, name: "get_mempolicy", args: &[] }),
-		// TODO 0x114 => Some(Syscall { handler: &set_mempolicy, name: "set_mempolicy", args: &[] }),
-		// TODO 0x115 => Some(Syscall { handler: &mq_open, name: "mq_open", args: &[] }),
-		// TODO 0x116 => Some(Syscall { handler: &mq_unlink, name: "mq_unlink", args: &[] }),
-		// TODO 0x117 => Some(Syscall { handler: &mq_timedsend, name: "mq_timedsend", args: &[] }),
-		// TODO 0x118 => Some(Syscall { handler: &mq_timedreceive, name: "mq_timedreceive", args: &[] }),
-		// TODO 0x119 => Some(Syscall { handler: &mq_notify, name: "mq_notify", args: &[] }),
-		// TODO 0x11a => Some(Syscall { handler: &mq_getsetattr, name: "mq_getsetattr", args: &[] }),
-		// TODO 0x11b => Some(Syscall { handler: &kexec_load, name: "kexec_load", args: &[] }),
-		// TODO 0x11c => Some(Syscall { handler: &waitid, name: "waitid", args: &[] }),
-		// TODO 0x11e => Some(Syscall { handler: &add_key, name: "add_key", args: &[] }),
-		// TODO 0x11f => Some(Syscall { handler: &request_key, name: "request_key", args: &[] }),
-		// TODO 0x120 => Some(Syscall { handler: &keyctl, name: "keyctl", args: &[] }),
-		// TODO 0x121 => Some(Syscall { handler: &ioprio_set, name: "ioprio_set", args: &[] }),
-		// TODO 0x122 => Some(Syscall { handler: &ioprio_get, name: "ioprio_get", args: &[] }),
-		// TODO 0x123 => Some(Syscall { handler: &inotify_init, name: "inotify_init", args: &[] }),
-		// TODO 0x124 => Some(Syscall { handler: &inotify_add_watch, name: "inotify_add_watch", args: &[] }),
-		// TODO 0x125 => Some(Syscall { handler: &inotify_rm_watch, name: "inotify_rm_watch", args: &[] }),
-		// TODO 0x126 => Some(Syscall { handler: &migrate_pages, name: "migrate_pages", args: &[] }),
-		// TODO 0x127 => Some(Syscall { handler: &openat, name: "openat", args: &[] }),
-		// TODO 0x128 => Some(Syscall { handler: &mkdirat, name: "mkdirat", args: &[] }),
-		// TODO 0x129 => Some(Syscall { handler: &mknodat, name: "mknodat", args: &[] }),
-		// TODO 0x12a => Some(Syscall { handler: &fchownat, name: "fchownat", args: &[] }),
-		// TODO 0x12b => Some(Syscall { handler: &futimesat, name: "futimesat", args: &[] }),
-		// TODO 0x12c => Some(Syscall { handler: &fstatat64, name: "fstatat64", args: &[] }),
-		// TODO 0x12d => Some(Syscall { handler: &unlinkat, name: "unlinkat", args: &[] }),
-		// TODO 0x12e => Some(Syscall { handler: &renameat, name: "renameat", args: &[] }),
-		// TODO 0x12f => Some(Syscall { handler: &linkat, name: "linkat", args: &[] }),
-		// TODO 0x130 => Some(Syscall { handler: &symlinkat, name: "symlinkat", args: &[] }),
-		// TODO 0x131 => Some(Syscall { handler: &readlinkat, name: "readlinkat", args: &[] }),
-		// TODO 0x132 => Some(Syscall { handler: &fchmodat, name: "fchmodat", args: &[] }),
-		0x133 => Some(Syscall { handler: &faccessat, name: "faccessat", args: &[] }),
-		0x134 => Some(Syscall { handler: &pselect6, name: "pselect6", args: &[] }),
-		// TODO 0x135 => Some(Syscall { handler: &ppoll, name: "ppoll", args: &[] }),
-		// TODO 0x136 => Some(Syscall { handler: &unshare, name: "unshare", args: &[] }),
-		// TODO 0x137 => Some(Syscall { handler: &set_robust_list, name: "set_robust_list", args: &[] }),
-		// TODO 0x138 => Some(Syscall { handler: &get_robust_list, name: "get_robust_list", args: &[] }),
-		// TODO 0x139 => Some(Syscall { handler: &splice, name: "splice", args: &[] }),
-		// TODO 0x13a => Some(Syscall { handler: &sync_file_range, name: "sync_file_range", args: &[] }),
-		// TODO 0x13b => Some(Syscall { handler: &tee, name: "tee", args: &[] }),
-		// TODO 0x13c => Some(Syscall { handler: &vmsplice, name: "vmsplice", args: &[] }),
-		// TODO 0x13d => Some(Syscall { handler: &move_pages, name: "move_pages", args: &[] }),
-		// TODO 0x13e => Some(Syscall { handler: &getcpu, name: "getcpu", args: &[] }),
-		// TODO 0x13f => Some(Syscall { handler: &epoll_pwait, name: "epoll_pwait", args: &[] }),
-		// TODO 0x140 => Some(Syscall { handler: &utimensat, name: "utimensat", args: &[] }),
-		// TODO 0x141 => Some(Syscall { handler: &signalfd, name: "signalfd", args: &[] }),
-		// TODO 0x142 => Some(Syscall { handler: &timerfd_create, name: "timerfd_create", args: &[] }),
-		// TODO 0x143 => Some(Syscall { handler: &eventfd, name: "eventfd", args: &[] }),
-		// TODO 0x144 => Some(Syscall { handler: &fallocate, name: "fallocate", args: &[] }),
-		// TODO 0x145 => Some(Syscall { handler: &timerfd_settime, name: "timerfd_settime", args: &[] }),
-		// TODO 0x146 => Some(Syscall { handler: &timerfd_gettime, name: "timerfd_gettime", args: &[] }),
-		// TODO 0x147 => Some(Syscall { handler: &signalfd4, name: "signalfd4", args: &[] }),
-		// TODO 0x148 => Some(Syscall { handler: &eventfd2, name: "eventfd2", args: &[] }),
-		// TODO 0x149 => Some(Syscall { handler: &epoll_create1, name: "epoll_create1", args: &[] }),
-		// TODO 0x14a => Some(Syscall { handler: &dup3, name: "dup3", args: &[] }),
-		0x14b => Some(Syscall { handler: &pipe2, name: "pipe2", args: &[] }),
-		// TODO 0x14c => Some(Syscall { handler: &inotify_init1, name: "inotify_init1", args: &[] }),
-		// TODO 0x14d => Some(Syscall { handler: &preadv, name: "preadv", args: &[] }),
-		0x14e => Some(Syscall { handler: &pwritev, name: "pwritev", args: &[] }),
-		// TODO 0x14f => Some(Syscall { handler: &rt_tgsigqueueinfo, name: "rt_tgsigqueueinfo", args: &[] }),
-		// TODO 0x150 => Some(Syscall { handler: &perf_event_open, name: "perf_event_open", args: &[] }),
-		// TODO 0x151 => Some(Syscall { handler: &recvmmsg, name: "recvmmsg", args: &[] }),
-		// TODO 0x152 => Some(Syscall { handler: &fanotify_init, name: "fanotify_init", args: &[] }),
-		// TODO 0x153 => Some(Syscall { handler: &fanotify_mark, name: "fanotify_mark", args: &[] }),
-		0x154 => Some(Syscall { handler: &prlimit64, name: "prlimit64", args: &[] }),
-		// TODO 0x155 => Some(Syscall { handler: &name_to_handle_at, name: "name_to_handle_at", args: &[] }),
-		// TODO 0x156 => Some(Syscall { handler: &open_by_handle_at, name: "open_by_handle_at", args: &[] }),
-		// TODO 0x157 => Some(Syscall { handler: &clock_adjtime, name: "clock_adjtime", args: &[] }),
-		// TODO 0x158 => Some(Syscall { handler: &syncfs, name: "syncfs", args: &[] }),
-		// TODO 0x159 => Some(Syscall { handler: &sendmmsg, name: "sendmmsg", args: &[] }),
-		// TODO 0x15a => Some(Syscall { handler: &setns, name: "setns", args: &[] }),
-		// TODO 0x15b => Some(Syscall { handler: &process_vm_readv, name: "process_vm_readv", args: &[] }),
-		// TODO 0x15c => Some(Syscall { handler: &process_vm_writev, name: "process_vm_writev", args: &[] }),
-		// TODO 0x15d => Some(Syscall { handler: &kcmp, name: "kcmp", args: &[] }),
-		0x15e => Some(Syscall { handler: &finit_module, name: "finit_module", args: &[] }),
-		// TODO 0x15f => Some(Syscall { handler: &sched_setattr, name: "sched_setattr", args: &[] }),
-		// TODO 0x160 => Some(Syscall { handler: &sched_getattr, name: "sched_getattr", args: &[] }),
-		// TODO 0x161 => Some(Syscall { handler: &renameat2, name: "renameat2", args: &[] }),
-		// TODO 0x162 => Some(Syscall { handler: &seccomp, name: "seccomp", args: &[] }),
-		// TODO 0x163 => Some(Syscall { handler: &getrandom, name: "getrandom", args: &[] }),
-		// TODO 0x164 => Some(Syscall { handler: &memfd_create, name: "memfd_create", args: &[] }),
-		// TODO 0x165 => Some(Syscall { handler: &bpf, name: "bpf", args: &[] }),
-		// TODO 0x166 => Some(Syscall { handler: &execveat, name: "execveat", args: &[] }),
-		// TODO 0x167 => Some(Syscall { handler: &socket, name: "socket", args: &[] }),
-		0x168 => Some(Syscall { handler: &socketpair, name: "socketpair", args: &[] }),
-		// TODO 0x169 => Some(Syscall { handler: &bind, name: "bind", args: &[] }),
-		// TODO 0x16a => Some(Syscall { handler: &connect, name: "connect", args: &[] }),
-		// TODO 0x16b => Some(Syscall { handler: &listen, name: "listen", args: &[] }),
-		// TODO 0x16c => Some(Syscall { handler: &accept4, name: "accept4", args: &[] }),
-		// TODO 0x16d => Some(Syscall { handler: &getsockopt, name: "getsockopt", args: &[] }),
-		// TODO 0x16e => Some(Syscall { handler: &setsockopt, name: "setsockopt", args: &[] }),
-		// TODO 0x16f => Some(Syscall { handler: &getsockname, name: "getsockname", args: &[] }),
-		// TODO 0x170 => Some(Syscall { handler: &getpeername, name: "getpeername", args: &[] }),
-		// TODO 0x171 => Some(Syscall { handler: &sendto, name: "sendto", args: &[] }),
-		// TODO 0x172 => Some(Syscall { handler: &sendmsg, name: "sendmsg", args: &[] }),
-		// TODO 0x173 => Some(Syscall { handler: &recvfrom, name: "recvfrom", args: &[] }),
-		// TODO 0x174 => Some(Syscall { handler: &recvmsg, name: "recvmsg", args: &[] }),
-		// TODO 0x175 => Some(Syscall { handler: &shutdown, name: "shutdown", args: &[] }),
-		// TODO 0x176 => Some(Syscall { handler: &userfaultfd, name: "userfaultfd", args: &[] }),
-		// TODO 0x177 => Some(Syscall { handler: &membarrier, name: "membarrier", args: &[] }),
-		// TODO 0x178 => Some(Syscall { handler: &mlock2, name: "mlock2", args: &[] }),
-		// TODO 0x179 => Some(Syscall { handler: &copy_file_range, name: "copy_file_range", args: &[] }),
-		// TODO 0x17a => Some(Syscall { handler: &preadv2, name: "preadv2", args: &[] }),
-		0x17b => Some(Syscall { handler: &pwritev2, name: "pwritev2", args: &[] }),
-		// TODO 0x17c => Some(Syscall { handler: &pkey_mprotect, name: "pkey_mprotect", args: &[] }),
-		// TODO 0x17d => Some(Syscall { handler: &pkey_alloc, name: "pkey_alloc", args: &[] }),
-		// TODO 0x17e => Some(Syscall { handler: &pkey_free, name: "pkey_free", args: &[] }),
-		0x17f => Some(Syscall { handler: &statx, name: "statx", args: &[] }),
-		// TODO 0x180 => Some(Syscall { handler: &arch_prctl, name: "arch_prctl", args: &[] }),
-		// TODO 0x181 => Some(Syscall { handler: &io_pgetevents, name: "io_pgetevents", args: &[] }),
-		// TODO 0x182 => Some(Syscall { handler: &rseq, name: "rseq", args: &[] }),
-		// TODO 0x189 => Some(Syscall { handler: &semget, name: "semget", args: &[] }),
-		// TODO 0x18a => Some(Syscall { handler: &semctl, name: "semctl", args: &[] }),
-		// TODO 0x18b => Some(Syscall { handler: &shmget, name: "shmget", args: &[] }),
-		// TODO 0x18c => Some(Syscall { handler: &shmctl, name: "shmctl", args: &[] }),
-		// TODO 0x18d => Some(Syscall { handler: &shmat, name: "shmat", args: &[] }),
-		// TODO 0x18e => Some(Syscall { handler: &shmdt, name: "shmdt", args: &[] }),
-		// TODO 0x18f => Some(Syscall { handler: &msgget, name: "msgget", args: &[] }),
-		// TODO 0x190 => Some(Syscall { handler: &msgsnd, name: "msgsnd", args: &[] }),
-		// TODO 0x191 => Some(Syscall { handler: &msgrcv, name: "msgrcv", args: &[] }),
-		// TODO 0x192 => Some(Syscall { handler: &msgctl, name: "msgctl", args: &[] }),
-		0x193 => Some(Syscall { handler: &clock_gettime64, name: "clock_gettime64", args: &[] }),
-		// TODO 0x194 => Some(Syscall { handler: &clock_settime64, name: "clock_settime64", args: &[] }),
-		// TODO 0x195 => Some(Syscall { handler: &clock_adjtime64, name: "clock_adjtime64", args: &[] }),
-		// TODO 0x196 => Some(Syscall { handler: &clock_getres_time64, name: "clock_getres_time64", args: &[] }),
-		// TODO 0x197 => Some(Syscall { handler: &clock_nanosleep_time64, name: "clock_nanosleep_time64", args: &[] }),
-		// TODO 0x198 => Some(Syscall { handler: &timer_gettime64, name: "timer_gettime64", args: &[] }),
-		// TODO 0x199 => Some(Syscall { handler: &timer_settime64, name: "timer_settime64", args: &[] }),
-		// TODO 0x19a => Some(Syscall { handler: &timerfd_gettime64, name: "timerfd_gettime64", args: &[] }),
-		// TODO 0x19b => Some(Syscall { handler: &timerfd_settime64, name: "timerfd_settime64", args: &[] }),
-		// TODO 0x19c => Some(Syscall { handler: &utimensat_time64, name: "utimensat_time64", args: &[] }),
-		// TODO 0x19d => Some(Syscall { handler: &pselect6_time64, name: "pselect6_time64", args: &[] }),
-		// TODO 0x19e => Some(Syscall { handler: &ppoll_time64, name: "ppoll_time64", args: &[] }),
-		// TODO 0x1a0 => Some(Syscall { handler: &io_pgetevents_time64, name: "io_pgetevents_time64", args: &[] }),
-		// TODO 0x1a1 => Some(Syscall { handler: &recvmmsg_time64, name: "recvmmsg_time64", args: &[] }),
-		// TODO 0x1a2 => Some(Syscall { handler: &mq_timedsend_time64, name: "mq_timedsend_time64", args: &[] }),
-		// TODO 0x1a3 => Some(Syscall { handler: &mq_timedreceive_time64, name: "mq_timedreceive_time64", args: &[] }),
-		// TODO 0x1a4 => Some(Syscall { handler: &semtimedop_time64, name: "semtimedop_time64", args: &[] }),
-		// TODO 0x1a5 => Some(Syscall { handler: &rt_sigtimedwait_time64, name: "rt_sigtimedwait_time64", args: &[] }),
-		// TODO 0x1a6 => Some(Syscall { handler: &futex_time64, name: "futex_time64", args: &[] }),
-		// TODO 0x1a7 => Some(Syscall { handler: &sched_rr_get_interval_time64, name: "sched_rr_get_interval_time64", args: &[] }),
-		// TODO 0x1a8 => Some(Syscall { handler: &pidfd_send_signal, name: "pidfd_send_signal", args: &[] }),
-		// TODO 0x1a9 => Some(Syscall { handler: &io_uring_setup, name: "io_uring_setup", args: &[] }),
-		// TODO 0x1aa => Some(Syscall { handler: &io_uring_enter, name: "io_uring_enter", args: &[] }),
-		// TODO 0x1ab => Some(Syscall { handler: &io_uring_register, name: "io_uring_register", args: &[] }),
-		// TODO 0x1ac => Some(Syscall { handler: &open_tree, name: "open_tree", args: &[] }),
-		// TODO 0x1ad => Some(Syscall { handler: &move_mount, name: "move_mount", args: &[] }),
-		// TODO 0x1ae => Some(Syscall { handler: &fsopen, name: "fsopen", args: &[] }),
-		// TODO 0x1af => Some(Syscall { handler: &fsconfig, name: "fsconfig", args: &[] }),
-		// TODO 0x1b0 => Some(Syscall { handler: &fsmount, name: "fsmount", args: &[] }),
-		// TODO 0x1b1 => Some(Syscall { handler: &fspick, name: "fspick", args: &[] }),
-		// TODO 0x1b2 => Some(Syscall { handler: &pidfd_open, name: "pidfd_open", args: &[] }),
-		// TODO 0x1b3 => Some(Syscall { handler: &clone3, name: "clone3", args: &[] }),
-		// TODO 0x1b4 => Some(Syscall { handler: &close_range, name: "close_range", args: &[] }),
-		// TODO 0x1b5 => Some(Syscall { handler: &openat2, name: "openat2", args: &[] }),
-		// TODO 0x1b6 => Some(Syscall { handler: &pidfd_getfd, name: "pidfd_getfd", args: &[] }),
-		0x1b7 => Some(Syscall { handler: &faccessat2, name: "faccessat2", args: &[] }),
-		// TODO 0x1b8 => Some(Syscall { handler: &process_madvise, name: "process_madvise", args: &[] }),
-		// TODO 0x1b9 => Some(Syscall { handler: &epoll_pwait2, name: "epoll_pwait2", args: &[] }),
-		// TODO 0x1ba => Some(Syscall { handler: &mount_setattr, name: "mount_setattr", args: &[] }),
-		// TODO 0x1bb => Some(Syscall { handler: &quotactl_fd, name: "quotactl_fd", args: &[] }),
-		// TODO 0x1bc => Some(Syscall { handler: &landlock_create_ruleset, name: "landlock_create_ruleset", args: &[] }),
-		// TODO 0x1bd => Some(Syscall { handler: &landlock_add_rule, name: "landlock_add_rule", args: &[] }),
-		// TODO 0x1be => Some(Syscall { handler: &landlock_restrict_self, name: "landlock_restrict_self", args: &[] }),
-		// TODO 0x1bf => Some(Syscall { handler: &memfd_secret, name: "memfd_secret", args: &[] }),
-		// TODO 0x1c0 => Some(Syscall { handler: &process_mrelease, name: "process_mrelease", args: &[] }),
-		// TODO 0x1c1 => Some(Syscall { handler: &futex_waitv, name: "futex_waitv", args: &[] }),
-		// TODO 0x1c2 => Some(Syscall { handler: &set_mempolicy_home_node, name: "set_mempolicy_home_node", args: &[] }),
-
-		_ => None,
-	}
+/// Builds the table of system calls, indexed by ID.
+const fn build_table() -> [Option<Syscall>; SYSCALLS_COUNT] {
+	let mut table = [None; SYSCALLS_COUNT];
+
+	// TODO 0x000: restart_syscall
+	table[0x001] = Some(Syscall { handler: _exit, name: "_exit" });
+	table[0x002] = Some(Syscall { handler: fork, name: "fork" });
+	table[0x003] = Some(Syscall { handler: read, name: "read" });
+	table[0x004] = Some(Syscall { handler: write, name: "write" });
+	table[0x005] = Some(Syscall { handler: open, name: "open" });
+	table[0x006] = Some(Syscall { handler: close, name: "close" });
+	table[0x007] = Some(Syscall { handler: waitpid, name: "waitpid" });
+	table[0x008] = Some(Syscall { handler: creat, name: "creat" });
+	table[0x009] = Some(Syscall { handler: link, name: "link" });
+	table[0x00a] = Some(Syscall { handler: unlink, name: "unlink" });
+	table[0x00b] = Some(Syscall { handler: execve, name: "execve" });
+	table[0x00c] = Some(Syscall { handler: chdir, name: "chdir" });
+	table[0x00d] = Some(Syscall { handler: time, name: "time" });
+	table[0x00e] = Some(Syscall { handler: mknod, name: "mknod" });
+	// TODO 0x00f: chmod
+	// TODO 0x010: lchown
+	table[0x011] = Some(Syscall { handler: r#break, name: "break" });
+	// TODO 0x012: oldstat
+	// TODO 0x013: lseek
+	table[0x014] = Some(Syscall { handler: getpid, name: "getpid" });
+	table[0x015] = Some(Syscall { handler: mount, name: "mount" });
+	table[0x016] = Some(Syscall { handler: umount, name: "umount" });
+	table[0x017] = Some(Syscall { handler: setuid, name: "setuid" });
+	table[0x018] = Some(Syscall { handler: getuid, name: "getuid" });
+	// TODO 0x019: stime
+	// TODO 0x01a: ptrace
+	// TODO 0x01b: alarm
+	// TODO 0x01c: oldfstat
+	// TODO 0x01d: pause
+	// TODO 0x01e: utime
+	// TODO 0x01f: stty
+	// TODO 0x020: gtty
+	table[0x021] = Some(Syscall { handler: access, name: "access" });
+	// TODO 0x022: nice
+	// TODO 0x023: ftime
+	table[0x024] = Some(Syscall { handler: sync, name: "sync" });
+	table[0x025] = Some(Syscall { handler: kill, name: "kill" });
+	// TODO 0x026: rename
+	table[0x027] = Some(Syscall { handler: mkdir, name: "mkdir" });
+	// TODO 0x028: rmdir
+	table[0x029] = Some(Syscall { handler: dup, name: "dup" });
+	table[0x02a] = Some(Syscall { handler: pipe, name: "pipe" });
+	// TODO 0x02b: times
+	// TODO 0x02c: prof
+	table[0x02d] = Some(Syscall { handler: brk, name: "brk" });
+	table[0x02e] = Some(Syscall { handler: setgid, name: "setgid" });
+	table[0x02f] = Some(Syscall { handler: getgid, name: "getgid" });
+	table[0x030] = Some(Syscall { handler: signal, name: "signal" });
+	table[0x031] = Some(Syscall { handler: geteuid, name: "geteuid" });
+	table[0x032] = Some(Syscall { handler: getegid, name: "getegid" });
+	// TODO 0x033: acct
+	// TODO 0x034: umount2
+	// TODO 0x035: lock
+	table[0x036] = Some(Syscall { handler: ioctl, name: "ioctl" });
+	table[0x037] = Some(Syscall { handler: fcntl, name: "fcntl" });
+	// TODO 0x038: mpx
+	table[0x039] = Some(Syscall { handler: setpgid, name: "setpgid" });
+	// TODO 0x03a: ulimit
+	// TODO 0x03b: oldolduname
+	table[0x03c] = Some(Syscall { handler: umask, name: "umask" });
+	table[0x03d] = Some(Syscall { handler: chroot, name: "chroot" });
+	// TODO 0x03e: ustat
+	table[0x03f] = Some(Syscall { handler: dup2, name: "dup2" });
+	table[0x040] = Some(Syscall { handler: getppid, name: "getppid" });
+	// TODO 0x041: getpgrp
+	// TODO 0x042: setsid
+	// TODO 0x043: sigaction
+	// TODO 0x044: sgetmask
+	// TODO 0x045: ssetmask
+	// TODO 0x046: setreuid
+	// TODO 0x047: setregid
+	// TODO 0x048: sigsuspend
+	// TODO 0x049: sigpending
+	// TODO 0x04a: sethostname
+	// TODO 0x04b: setrlimit
+	// TODO 0x04c: getrlimit
+	table[0x04d] = Some(Syscall { handler: getrusage, name: "getrusage" });
+	// TODO 0x04e: gettimeofday
+	// TODO 0x04f: settimeofday
+	// TODO 0x050: getgroups
+	// TODO 0x051: setgroups
+	table[0x052] = Some(Syscall { handler: select, name: "select" });
+	// TODO 0x053: symlink
+	// TODO 0x054: oldlstat
+	// TODO 0x055: readlink
+	// TODO 0x056: uselib
+	// TODO 0x057: swapon
+	table[0x058] = Some(Syscall { handler: reboot, name: "reboot" });
+	// TODO 0x059: readdir
+	table[0x05a] = Some(Syscall { handler: mmap, name: "mmap" });
+	table[0x05b] = Some(Syscall { handler: munmap, name: "munmap" });
+	table[0x05c] = Some(Syscall { handler: truncate, name: "truncate" });
+	// TODO 0x05d: ftruncate
+	// TODO 0x05e: fchmod
+	// TODO 0x05f: fchown
+	// TODO 0x060: getpriority
+	// TODO 0x061: setpriority
+	// TODO 0x062: profil
+	// TODO 0x063: statfs
+	// TODO 0x064: fstatfs
+	// TODO 0x065: ioperm
+	// TODO 0x066: socketcall
+	// TODO 0x067: syslog
+	// TODO 0x068: setitimer
+	// TODO 0x069: getitimer
+	// TODO 0x06a: stat
+	// TODO 0x06b: lstat
+	// TODO 0x06c: fstat
+	// TODO 0x06d: olduname
+	// TODO 0x06e: iopl
+	// TODO 0x06f: vhangup
+	// TODO 0x070: idle
+	// TODO 0x071: vm86old
+	table[0x072] = Some(Syscall { handler: wait4, name: "wait4" });
+	// TODO 0x073: swapoff
+	// TODO 0x074: sysinfo
+	// TODO 0x075: ipc
+	table[0x076] = Some(Syscall { handler: fsync, name: "fsync" });
+	table[0x077] = Some(Syscall { handler: sigreturn, name: "sigreturn" });
+	table[0x078] = Some(Syscall { handler: clone, name: "clone" });
+	// TODO 0x079: setdomainname
+	table[0x07a] = Some(Syscall { handler: uname, name: "uname" });
+	// TODO 0x07c: adjtimex
+	table[0x07d] = Some(Syscall { handler: mprotect, name: "mprotect" });
+	// TODO 0x07e: sigprocmask
+	// TODO 0x07f: create_module
+	table[0x080] = Some(Syscall { handler: init_module, name: "init_module" });
+	table[0x081] = Some(Syscall { handler: delete_module, name: "delete_module" });
+	// TODO 0x083: quotactl
+	table[0x084] = Some(Syscall { handler: getpgid, name: "getpgid" });
+	table[0x085] = Some(Syscall { handler: fchdir, name: "fchdir" });
+	// TODO 0x086: bdflush
+	// TODO 0x087: sysfs
+	// TODO 0x088: personality
+	// TODO 0x089: afs_syscall
+	// TODO 0x08a: setfsuid
+	// TODO 0x08b: setfsgid
+	table[0x08c] = Some(Syscall { handler: _llseek, name: "_llseek" });
+	table[0x08d] = Some(Syscall { handler: getdents, name: "getdents" });
+	table[0x08e] = Some(Syscall { handler: _newselect, name: "_newselect" });
+	// TODO 0x08f: flock
+	table[0x090] = Some(Syscall { handler: msync, name: "msync" });
+	// TODO 0x091: readv
+	table[0x092] = Some(Syscall { handler: writev, name: "writev" });
+	// TODO 0x093: getsid
+	table[0x094] = Some(Syscall { handler: fdatasync, name: "fdatasync" });
+	// TODO 0x095: _sysctl
+	// TODO 0x096: mlock
+	// TODO 0x097: munlock
+	// TODO 0x098: mlockall
+	// TODO 0x099: munlockall
+	// TODO 0x09a: sched_setparam
+	// TODO 0x09b: sched_getparam
+	// TODO 0x09c: sched_setscheduler
+	// TODO 0x09d: sched_getscheduler
+	// TODO 0x09e: sched_yield
+	// TODO 0x09f: sched_get_priority_max
+	// TODO 0x0a0: sched_get_priority_min
+	// TODO 0x0a1: sched_rr_get_interval
+	table[0x0a2] = Some(Syscall { handler: nanosleep, name: "nanosleep" });
+	table[0x0a3] = Some(Syscall { handler: mremap, name: "mremap" });
+	// TODO 0x0a4: setresuid
+	// TODO 0x0a5: getresuid
+	// TODO 0x0a6: vm86
+	// TODO 0x0a7: query_module
+	table[0x0a8] = Some(Syscall { handler: poll, name: "poll" });
+	// TODO 0x0a9: nfsservctl
+	// TODO 0x0aa: setresgid
+	// TODO 0x0ab: getresgid
+	// TODO 0x0ac: prctl
+	// TODO 0x0ad: rt_sigreturn
+	table[0x0ae] = Some(Syscall { handler: rt_sigaction, name: "rt_sigaction" });
+	table[0x0af] = Some(Syscall { handler: rt_sigprocmask, name: "rt_sigprocmask" });
+	// TODO 0x0b0: rt_sigpending
+	// TODO 0x0b1: rt_sigtimedwait
+	// TODO 0x0b2: rt_sigqueueinfo
+	// TODO 0x0b3: rt_sigsuspend
+	// TODO 0x0b4: pread64
+	// TODO 0x0b5: pwrite64
+	// TODO 0x0b6: chown
+	table[0x0b7] = Some(Syscall { handler: getcwd, name: "getcwd" });
+	// TODO 0x0b8: capget
+	// TODO 0x0b9: capset
+	// TODO 0x0ba: sigaltstack
+	table[0x0bb] = Some(Syscall { handler: sendfile, name: "sendfile" });
+	// TODO 0x0bc: getpmsg
+	// TODO 0x0bd: putpmsg
+	table[0x0be] = Some(Syscall { handler: vfork, name: "vfork" });
+	// TODO 0x0bf: ugetrlimit
+	table[0x0c0] = Some(Syscall { handler: mmap2, name: "mmap2" });
+	// TODO 0x0c1: truncate64
+	// TODO 0x0c2: ftruncate64
+	// TODO 0x0c3: stat64
+	// TODO 0x0c4: lstat64
+	// TODO 0x0c5: fstat64
+	// TODO 0x0c6: lchown32
+	table[0x0c7] = Some(Syscall { handler: getuid32, name: "getuid32" });
+	table[0x0c8] = Some(Syscall { handler: getgid32, name: "getgid32" });
+	table[0x0c9] = Some(Syscall { handler: geteuid32, name: "geteuid32" });
+	table[0x0ca] = Some(Syscall { handler: getegid32, name: "getegid32" });
+	// TODO 0x0cb: setreuid32
+	// TODO 0x0cc: setregid32
+	// TODO 0x0cd: getgroups32
+	// TODO 0x0ce: setgroups32
+	// TODO 0x0cf: fchown32
+	// TODO 0x0d0: setresuid32
+	// TODO 0x0d1: getresuid32
+	// TODO 0x0d2: setresgid32
+	// TODO 0x0d3: getresgid32
+	// TODO 0x0d4: chown32
+	// TODO 0x0d5: setuid32
+	// TODO 0x0d6: setgid32
+	// TODO 0x0d7: setfsuid32
+	// TODO 0x0d8: setfsgid32
+	// TODO 0x0d9: pivot_root
+	// TODO 0x0da: mincore
+	table[0x0db] = Some(Syscall { handler: madvise, name: "madvise" });
+	table[0x0dc] = Some(Syscall { handler: getdents64, name: "getdents64" });
+	table[0x0dd] = Some(Syscall { handler: fcntl64, name: "fcntl64" });
+	table[0x0e0] = Some(Syscall { handler: gettid, name: "gettid" });
+	// TODO 0x0e1: readahead
+	// TODO 0x0e2: setxattr
+	// TODO 0x0e3: lsetxattr
+	// TODO 0x0e4: fsetxattr
+	// TODO 0x0e5: getxattr
+	// TODO 0x0e6: lgetxattr
+	// TODO 0x0e7: fgetxattr
+	// TODO 0x0e8: listxattr
+	// TODO 0x0e9: llistxattr
+	// TODO 0x0ea: flistxattr
+	// TODO 0x0eb: removexattr
+	// TODO 0x0ec: lremovexattr
+	// TODO 0x0ed: fremovexattr
+	table[0x0ee] = Some(Syscall { handler: tkill, name: "tkill" });
+	table[0x0ef] = Some(Syscall { handler: sendfile64, name: "sendfile64" });
+	// TODO 0x0f0: futex
+	// TODO 0x0f1: sched_setaffinity
+	// TODO 0x0f2: sched_getaffinity
+	table[0x0f3] = Some(Syscall { handler: set_thread_area, name: "set_thread_area" });
+	// TODO 0x0f4: get_thread_area
+	// TODO 0x0f5: io_setup
+	// TODO 0x0f6: io_destroy
+	// TODO 0x0f7: io_getevents
+	// TODO 0x0f8: io_submit
+	// TODO 0x0f9: io_cancel
+	// TODO 0x0fa: fadvise64
+	table[0x0fc] = Some(Syscall { handler: exit_group, name: "exit_group" });
+	// TODO 0x0fd: lookup_dcookie
+	table[0x0fe] = Some(Syscall { handler: epoll_create, name: "epoll_create" });
+	table[0x0ff] = Some(Syscall { handler: epoll_ctl, name: "epoll_ctl" });
+	table[0x100] = Some(Syscall { handler: epoll_wait, name: "epoll_wait" });
+	// TODO 0x101: remap_file_pages
+	table[0x102] = Some(Syscall { handler: set_tid_address, name: "set_tid_address" });
+	// TODO 0x103: timer_create
+	// TODO 0x104: timer_settime
+	// TODO 0x105: timer_gettime
+	// TODO 0x106: timer_getoverrun
+	// TODO 0x107: timer_delete
+	// TODO 0x108: clock_settime
+	table[0x109] = Some(Syscall { handler: clock_gettime, name: "clock_gettime" });
+	// TODO 0x10a: clock_getres
+	// TODO 0x10b: clock_nanosleep
+	// TODO 0x10c: statfs64
+	// TODO 0x10d: fstatfs64
+	// TODO 0x10e: tgkill
+	// TODO 0x10f: utimes
+	// TODO 0x110: fadvise64_64
+	// TODO 0x111: vserver
+	// TODO 0x112: mbind
+	// TODO 0x113: get_mempolicy
+	// TODO 0x114: set_mempolicy
+	// TODO 0x115: mq_open
+	// TODO 0x116: mq_unlink
+	// TODO 0x117: mq_timedsend
+	// TODO 0x118: mq_timedreceive
+	// TODO 0x119: mq_notify
+	// TODO 0x11a: mq_getsetattr
+	// TODO 0x11b: kexec_load
+	// TODO 0x11c: waitid
+	// TODO 0x11e: add_key
+	// TODO 0x11f: request_key
+	// TODO 0x120: keyctl
+	// TODO 0x121: ioprio_set
+	// TODO 0x122: ioprio_get
+	// TODO 0x123: inotify_init
+	// TODO 0x124: inotify_add_watch
+	// TODO 0x125: inotify_rm_watch
+	// TODO 0x126: migrate_pages
+	// TODO 0x127: openat
+	// TODO 0x128: mkdirat
+	// TODO 0x129: mknodat
+	// TODO 0x12a: fchownat
+	// TODO 0x12b: futimesat
+	// TODO 0x12c: fstatat64
+	// TODO 0x12d: unlinkat
+	// TODO 0x12e: renameat
+	// TODO 0x12f: linkat
+	// TODO 0x130: symlinkat
+	// TODO 0x131: readlinkat
+	// TODO 0x132: fchmodat
+	table[0x133] = Some(Syscall { handler: faccessat, name: "faccessat" });
+	table[0x134] = Some(Syscall { handler: pselect6, name: "pselect6" });
+	// TODO 0x135: ppoll
+	// TODO 0x136: unshare
+	// TODO 0x137: set_robust_list
+	// TODO 0x138: get_robust_list
+	table[0x139] = Some(Syscall { handler: splice, name: "splice" });
+	// TODO 0x13a: sync_file_range
+	// TODO 0x13b: tee
+	table[0x13c] = Some(Syscall { handler: vmsplice, name: "vmsplice" });
+	// TODO 0x13d: move_pages
+	// TODO 0x13e: getcpu
+	// TODO 0x13f: epoll_pwait
+	// TODO 0x140: utimensat
+	// TODO 0x141: signalfd
+	// TODO 0x142: timerfd_create
+	// TODO 0x143: eventfd
+	// TODO 0x144: fallocate
+	// TODO 0x145: timerfd_settime
+	// TODO 0x146: timerfd_gettime
+	// TODO 0x147: signalfd4
+	// TODO 0x148: eventfd2
+	table[0x149] = Some(Syscall { handler: epoll_create1, name: "epoll_create1" });
+	// TODO 0x14a: dup3
+	table[0x14b] = Some(Syscall { handler: pipe2, name: "pipe2" });
+	// TODO 0x14c: inotify_init1
+	// TODO 0x14d: preadv
+	table[0x14e] = Some(Syscall { handler: pwritev, name: "pwritev" });
+	// TODO 0x14f: rt_tgsigqueueinfo
+	// TODO 0x150: perf_event_open
+	// TODO 0x151: recvmmsg
+	// TODO 0x152: fanotify_init
+	// TODO 0x153: fanotify_mark
+	table[0x154] = Some(Syscall { handler: prlimit64, name: "prlimit64" });
+	// TODO 0x155: name_to_handle_at
+	// TODO 0x156: open_by_handle_at
+	// TODO 0x157: clock_adjtime
+	// TODO 0x158: syncfs
+	// TODO 0x159: sendmmsg
+	// TODO 0x15a: setns
+	// TODO 0x15b: process_vm_readv
+	// TODO 0x15c: process_vm_writev
+	// TODO 0x15d: kcmp
+	table[0x15e] = Some(Syscall { handler: finit_module, name: "finit_module" });
+	// TODO 0x15f: sched_setattr
+	// TODO 0x160: sched_getattr
+	// TODO 0x161: renameat2
+	// TODO 0x162: seccomp
+	table[0x163] = Some(Syscall { handler: getrandom, name: "getrandom" });
+	// TODO 0x164: memfd_create
+	// TODO 0x165: bpf
+	// TODO 0x166: execveat
+	// TODO 0x167: socket
+	table[0x168] = Some(Syscall { handler: socketpair, name: "socketpair" });
+	// TODO 0x169: bind
+	// TODO 0x16a: connect
+	// TODO 0x16b: listen
+	// TODO 0x16c: accept4
+	// TODO 0x16d: getsockopt
+	// TODO 0x16e: setsockopt
+	// TODO 0x16f: getsockname
+	// TODO 0x170: getpeername
+	// TODO 0x171: sendto
+	// TODO 0x172: sendmsg
+	// TODO 0x173: recvfrom
+	// TODO 0x174: recvmsg
+	// TODO 0x175: shutdown
+	// TODO 0x176: userfaultfd
+	// TODO 0x177: membarrier
+	// TODO 0x178: mlock2
+	// TODO 0x179: copy_file_range
+	// TODO 0x17a: preadv2
+	table[0x17b] = Some(Syscall { handler: pwritev2, name: "pwritev2" });
+	// TODO 0x17c: pkey_mprotect
+	// TODO 0x17d: pkey_alloc
+	// TODO 0x17e: pkey_free
+	table[0x17f] = Some(Syscall { handler: statx, name: "statx" });
+	// TODO 0x180: arch_prctl
+	// TODO 0x181: io_pgetevents
+	// TODO 0x182: rseq
+	// TODO 0x189: semget
+	// TODO 0x18a: semctl
+	// TODO 0x18b: shmget
+	// TODO 0x18c: shmctl
+	// TODO 0x18d: shmat
+	// TODO 0x18e: shmdt
+	// TODO 0x18f: msgget
+	// TODO 0x190: msgsnd
+	// TODO 0x191: msgrcv
+	// TODO 0x192: msgctl
+	table[0x193] = Some(Syscall { handler: clock_gettime64, name: "clock_gettime64" });
+	// TODO 0x194: clock_settime64
+	// TODO 0x195: clock_adjtime64
+	// TODO 0x196: clock_getres_time64
+	// TODO 0x197: clock_nanosleep_time64
+	// TODO 0x198: timer_gettime64
+	// TODO 0x199: timer_settime64
+	// TODO 0x19a: timerfd_gettime64
+	// TODO 0x19b: timerfd_settime64
+	// TODO 0x19c: utimensat_time64
+	// TODO 0x19d: pselect6_time64
+	// TODO 0x19e: ppoll_time64
+	// TODO 0x1a0: io_pgetevents_time64
+	// TODO 0x1a1: recvmmsg_time64
+	// TODO 0x1a2: mq_timedsend_time64
+	// TODO 0x1a3: mq_timedreceive_time64
+	// TODO 0x1a4: semtimedop_time64
+	// TODO 0x1a5: rt_sigtimedwait_time64
+	// TODO 0x1a6: futex_time64
+	// TODO 0x1a7: sched_rr_get_interval_time64
+	// TODO 0x1a8: pidfd_send_signal
+	// TODO 0x1a9: io_uring_setup
+	// TODO 0x1aa: io_uring_enter
+	// TODO 0x1ab: io_uring_register
+	// TODO 0x1ac: open_tree
+	// TODO 0x1ad: move_mount
+	// TODO 0x1ae: fsopen
+	// TODO 0x1af: fsconfig
+	// TODO 0x1b0: fsmount
+	// TODO 0x1b1: fspick
+	// TODO 0x1b2: pidfd_open
+	// TODO 0x1b3: clone3
+	// TODO 0x1b4: close_range
+	// TODO 0x1b5: openat2
+	// TODO 0x1b6: pidfd_getfd
+	table[0x1b7] = Some(Syscall { handler: faccessat2, name: "faccessat2" });
+	// TODO 0x1b8: process_madvise
+	// TODO 0x1b9: epoll_pwait2
+	// TODO 0x1ba: mount_setattr
+	// TODO 0x1bb: quotactl_fd
+	// TODO 0x1bc: landlock_create_ruleset
+	// TODO 0x1bd: landlock_add_rule
+	// TODO 0x1be: landlock_restrict_self
+	// TODO 0x1bf: memfd_secret
+	// TODO 0x1c0: process_mrelease
+	// TODO 0x1c1: futex_waitv
+	// TODO 0x1c2: set_mempolicy_home_node
+
+	table
 }
 
-/// Prints the trace for a syscall.
-/// `regs` are the registers passed to the syscall.
-/// `result` is the result of the syscall.
-fn print_strace(regs: &Regs, result: Option<Result<i32, Errno>>) {
-	let pid = {
-		let mutex = Process::get_current().unwrap();
-		let mut guard = mutex.lock();
-		let proc = guard.get_mut();
-		proc.get_pid()
-	};
+/// The table of system calls, indexed by ID. The holes are the system calls that are not
+/// implemented.
+static SYSCALLS: [Option<Syscall>; SYSCALLS_COUNT] = build_table();
 
-	// Getting syscall name
-	let id = regs.eax;
+/// The counters of calls to a system call.
+#[cfg(config_debug_syscall_stats)]
+struct SyscallStats {
+	/// The number of calls.
+	count: AtomicU64,
+	/// The cumulative number of CPU cycles spent in the system call, measured with the Time
+	/// Stamp Counter. The time during which the process is sleeping in the system call is
+	/// counted as well.
+	cycles: AtomicU64,
+}
 
-	// TODO Optimize (holes in the syscall table)
-	let syscall = match get_syscall(id) {
-		Some(syscall) => syscall,
-		None => {
-			println!("invalid syscall (pid: {}): {:x}", pid, id);
-			return;
-		},
-	};
+/// The initial value of the counters of a system call.
+#[cfg(config_debug_syscall_stats)]
+const STATS_INIT: SyscallStats = SyscallStats {
+	count: AtomicU64::new(0),
+	cycles: AtomicU64::new(0),
+};
 
-	if let Some(result) = result {
-		match result {
-			Ok(val) => println!("strace end (pid: {}): {} -> Ok(0x{:x})", pid, syscall.name,
-				val as usize),
-			Err(errno) => println!("strace end (pid: {}): {} -> Errno({})", pid, syscall.name,
-				errno),
-		}
-	} else {
-		println!("strace start (pid: {}): {}", pid, syscall.name);
-
-		// TODO Make everything print at once (becomes unreadable when several processes are
-		// running)
-		/*for i in 0..syscall.args.len() {
-			let val = match i {
-				0 => regs.ebx,
-				1 => regs.ecx,
-				2 => regs.edx,
-				3 => regs.esi,
-				4 => regs.edi,
-				5 => regs.ebp,
-
-				_ => 0,
-			};
-
-			if i + 1 < syscall.args.len() {
-				print!("{} = 0x{:x}, ", syscall.args[i], val);
-			} else {
-				print!("{} = 0x{:x}", syscall.args[i], val);
-			}
-		}
+/// The counters of calls to each system call, indexed by ID.
+#[cfg(config_debug_syscall_stats)]
+static STATS: [SyscallStats; SYSCALLS_COUNT] = [STATS_INIT; SYSCALLS_COUNT];
 
-		println!(")");*/
+/// Calls `f` for each implemented system call with its ID, its name, its number of calls and
+/// the cumulative number of CPU cycles spent in it.
+///
+/// The system calls that do not return, such as `_exit`, are only counted.
+#[cfg(config_debug_syscall_stats)]
+pub fn foreach_stats<F: FnMut(u32, &'static str, u64, u64)>(mut f: F) {
+	for (id, (syscall, stats)) in SYSCALLS.iter().zip(STATS.iter()).enumerate() {
+		if let Some(syscall) = syscall {
+			let count = stats.count.load(atomic::Ordering::Relaxed);
+			let cycles = stats.cycles.load(atomic::Ordering::Relaxed);
+			f(id as _, syscall.name, count, cycles);
+		}
 	}
 }
 
 /// This function is called whenever a system call is triggered.
 #[no_mangle]
 pub extern "C" fn syscall_handler(regs: &mut Regs) {
-	// TODO Add switch to disable
-	//print_strace(regs, None);
-
-	let id = regs.eax;
-	let result = match get_syscall(id) {
-		Some(syscall) => (syscall.handler)(regs),
+	let id = regs.eax as usize;
+	let syscall = match SYSCALLS.get(id) {
+		Some(Some(syscall)) => syscall,
 
 		// The system call doesn't exist. Kill the process with SIGSYS
-		None => {
+		_ => {
 			{
 				let mutex = Process::get_current().unwrap();
 				let mut guard = mutex.lock();
@@ -735,8 +752,18 @@ pub extern "C" fn syscall_handler(regs: &mut Regs) {
 		}
 	};
 
-	// TODO Add switch to disable
-	//print_strace(regs, Some(result));
+	trace::record(EventType::SyscallEnter, id as _, regs.ebx);
+
+	#[cfg(config_debug_syscall_stats)]
+	let begin = {
+		STATS[id].count.fetch_add(1, atomic::Ordering::Relaxed);
+		cpu::rdtsc()
+	};
+
+	let result = (syscall.handler)(regs);
+
+	#[cfg(config_debug_syscall_stats)]
+	STATS[id].cycles.fetch_add(cpu::rdtsc() - begin, atomic::Ordering::Relaxed);
 
 	// Setting the return value
 	let retval = {
@@ -747,4 +774,66 @@ pub extern "C" fn syscall_handler(regs: &mut Regs) {
 		}
 	};
 	regs.eax = retval;
+
+	trace::record(EventType::SyscallExit, id as _, retval);
+}
+
+/// This function is called whenever a system call is triggered with the `sysenter` instruction
+/// by the `vsyscall` routine.
+///
+/// Since the routine passes the userspace stack pointer in %ebp, the sixth argument of the
+/// system call is retrieved from the top of the userspace stack.
+#[no_mangle]
+pub extern "C" fn sysenter_handler(regs: &mut Regs) {
+	let mem_space = {
+		let mutex = Process::get_current().unwrap();
+		let guard = mutex.lock();
+		guard.get().get_mem_space().unwrap()
+	};
+
+	let arg: SyscallPtr<u32> = (regs.esp as usize).into();
+	match arg.copy_from_user(&mem_space) {
+		Ok(Some(ebp)) => regs.ebp = ebp,
+
+		_ => {
+			regs.eax = (-errno::EFAULT) as _;
+			return;
+		},
+	}
+
+	syscall_handler(regs);
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	#[test_case]
+	fn syscall_table0() {
+		for (id, syscall) in SYSCALLS.iter().enumerate() {
+			if let Some(syscall) = syscall {
+				assert!(!syscall.name.is_empty(), "unnamed system call {:#x}", id);
+			}
+		}
+		assert_eq!(SYSCALLS[0x011].unwrap().name, "break");
+		assert_eq!(SYSCALLS[0x0db].unwrap().name, "madvise");
+		assert!(SYSCALLS[0x000].is_none());
+	}
+
+	#[test_case]
+	fn syscall_dispatch0() {
+		let mut regs = Regs::default();
+
+		// The return value of the handler is given in %eax
+		regs.eax = 0x0db;
+		syscall_handler(&mut regs);
+		let eax = regs.eax;
+		assert_eq!(eax, 0);
+
+		// Errors are returned as negative numbers
+		regs.eax = 0x011;
+		syscall_handler(&mut regs);
+		let eax = regs.eax;
+		assert_eq!(eax as i32, -errno::ENOSYS);
+	}
 }
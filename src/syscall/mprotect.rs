@@ -0,0 +1,64 @@
+//! The `mprotect` system call allows the process to change the access protection of a range of
+//! its memory.
+
+use core::ffi::c_void;
+use crate::errno::Errno;
+use crate::errno;
+use crate::memory;
+use crate::process::Process;
+use crate::process::mem_space;
+use crate::process::regs::Regs;
+use crate::util::math;
+use crate::util;
+use super::mmap::PROT_EXEC;
+use super::mmap::PROT_READ;
+use super::mmap::PROT_WRITE;
+
+/// Converts mprotect's `prot` to mem space mapping flags.
+/// Memory that cannot be accessed at all is not accessible from userspace.
+fn get_flags(prot: i32) -> u8 {
+	let mut mem_flags = 0;
+
+	if prot & (PROT_READ | PROT_WRITE | PROT_EXEC) != 0 {
+		mem_flags |= mem_space::MAPPING_FLAG_USER;
+	}
+	if prot & PROT_WRITE != 0 {
+		mem_flags |= mem_space::MAPPING_FLAG_WRITE;
+	}
+	if prot & PROT_EXEC != 0 {
+		mem_flags |= mem_space::MAPPING_FLAG_EXEC;
+	}
+
+	mem_flags
+}
+
+/// The implementation of the `mprotect` syscall.
+pub fn mprotect(regs: &Regs) -> Result<i32, Errno> {
+	let addr = regs.ebx as *const c_void;
+	let len = regs.ecx as usize;
+	let prot = regs.edx as i32;
+
+	if !util::is_aligned(addr, memory::PAGE_SIZE) {
+		return Err(errno!(EINVAL));
+	}
+	if prot & !(PROT_READ | PROT_WRITE | PROT_EXEC) != 0 {
+		return Err(errno!(EINVAL));
+	}
+
+	let pages = math::ceil_division(len, memory::PAGE_SIZE);
+	// Prevent from changing the protection of kernel memory
+	let end = (addr as usize).checked_add(pages * memory::PAGE_SIZE);
+	if end.map(| end | end > memory::PROCESS_END as usize).unwrap_or(true) {
+		return Err(errno!(ENOMEM));
+	}
+
+	let mem_space = {
+		let mutex = Process::get_current().unwrap();
+		let guard = mutex.lock();
+		guard.get().get_mem_space().unwrap()
+	};
+	let mut mem_space_guard = mem_space.lock();
+	mem_space_guard.get_mut().protect(addr, pages, get_flags(prot))?;
+
+	Ok(0)
+}
@@ -0,0 +1,58 @@
+//! The `mremap` system call allows the process to resize a range of its memory, possibly moving
+//! it to another address.
+
+use core::ffi::c_void;
+use crate::errno::Errno;
+use crate::errno;
+use crate::memory;
+use crate::process::Process;
+use crate::process::regs::Regs;
+use crate::util::math;
+use crate::util;
+
+/// Flag: the range may be moved to another address if it cannot be resized in place.
+const MREMAP_MAYMOVE: i32 = 0b01;
+/// Flag: the range is moved to the address given as argument.
+const MREMAP_FIXED: i32 = 0b10;
+
+/// The implementation of the `mremap` syscall.
+pub fn mremap(regs: &Regs) -> Result<i32, Errno> {
+	let old_address = regs.ebx as *const c_void;
+	let old_size = regs.ecx as usize;
+	let new_size = regs.edx as usize;
+	let flags = regs.esi as i32;
+	let _new_address = regs.edi as *const c_void;
+
+	if !util::is_aligned(old_address, memory::PAGE_SIZE) || new_size == 0 {
+		return Err(errno!(EINVAL));
+	}
+	if flags & !(MREMAP_MAYMOVE | MREMAP_FIXED) != 0 {
+		return Err(errno!(EINVAL));
+	}
+	// TODO Support moving to a fixed address
+	if flags & MREMAP_FIXED != 0 {
+		return Err(errno!(EINVAL));
+	}
+
+	let old_pages = math::ceil_division(old_size, memory::PAGE_SIZE);
+	let new_pages = math::ceil_division(new_size, memory::PAGE_SIZE);
+	// Prevent from remapping kernel memory
+	let end = (old_address as usize).checked_add(old_pages * memory::PAGE_SIZE);
+	if end.map(| end | end > memory::PROCESS_END as usize).unwrap_or(true) {
+		return Err(errno!(EFAULT));
+	}
+	if new_pages > memory::PROCESS_END as usize / memory::PAGE_SIZE {
+		return Err(errno!(ENOMEM));
+	}
+
+	let mem_space = {
+		let mutex = Process::get_current().unwrap();
+		let guard = mutex.lock();
+		guard.get().get_mem_space().unwrap()
+	};
+	let mut mem_space_guard = mem_space.lock();
+	let may_move = flags & MREMAP_MAYMOVE != 0;
+	let ptr = mem_space_guard.get_mut().remap(old_address, old_pages, new_pages, may_move)?;
+
+	Ok(ptr as _)
+}
@@ -42,7 +42,8 @@ pub fn msync(regs: &Regs) -> Result<i32, Errno> {
 
 	let mut i = 0;
 	while i < length {
-		let mapping = mem_space.get_mapping_mut_for(addr).ok_or(errno!(ENOMEM))?;
+		let ptr = (addr as usize + i) as *const c_void;
+		let mapping = mem_space.get_mapping_mut_for(ptr).ok_or(errno!(ENOMEM))?;
 		mapping.fs_sync()?; // TODO Use flags
 
 		i += mapping.get_size() * memory::PAGE_SIZE;
@@ -1,15 +1,72 @@
-//! The `nanosleep` system call allows to TODO.
+//! The `nanosleep` system call allows to make the current process sleep for a given duration.
 
 use crate::errno::Errno;
+use crate::process::Process;
+use crate::process::State;
 use crate::process::mem_space::ptr::SyscallPtr;
 use crate::process::regs::Regs;
+use crate::time::timer;
+use crate::time::unit::TimeUnit;
 use crate::time::unit::Timespec;
+use crate::time;
 
 /// The implementation of the `nanosleep` syscall.
 pub fn nanosleep(regs: &Regs) -> Result<i32, Errno> {
-	let _req: SyscallPtr<Timespec> = (regs.ebx as usize).into();
-	let _rem: SyscallPtr<Timespec> = (regs.ecx as usize).into();
+	let req: SyscallPtr<Timespec> = (regs.ebx as usize).into();
+	let rem: SyscallPtr<Timespec> = (regs.ecx as usize).into();
 
-	// TODO
+	let (pid, mem_space) = {
+		let mutex = Process::get_current().unwrap();
+		let guard = mutex.lock();
+		let proc = guard.get();
+
+		(proc.get_pid(), proc.get_mem_space().unwrap())
+	};
+
+	let req = req.copy_from_user(&mem_space)?.ok_or_else(|| errno!(EFAULT))?;
+	if req.tv_nsec >= 1000000000 {
+		return Err(errno!(EINVAL));
+	}
+	// If no clock is available, the duration cannot be measured
+	let Some(start) = time::get_clock(time::CLOCK_MONOTONIC) else {
+		return Ok(0);
+	};
+	let deadline = start.saturating_add(req.to_nano());
+
+	// Tells whether the timer is armed. Without timers, the process is woken up by the periodic
+	// tick instead
+	let mut with_timer = None;
+
+	loop {
+		{
+			let mutex = Process::get_current().unwrap();
+			let mut guard = mutex.lock();
+			let proc = guard.get_mut();
+
+			// The clock is read and the timer is armed while the process is locked so that the
+			// timer cannot expire before the process is asleep, which would leave it sleeping
+			// forever
+			let now = time::get_clock(time::CLOCK_MONOTONIC).unwrap_or(u64::MAX);
+			if now >= deadline {
+				break;
+			}
+			if proc.has_signal_pending() {
+				drop(guard);
+				timer::cancel(pid);
+
+				let remaining = Timespec::from_nano(deadline - now);
+				rem.copy_to_user(&mem_space, &remaining)?;
+				return Err(errno!(EINTR));
+			}
+
+			if *with_timer.get_or_insert_with(|| timer::add(pid, deadline).is_ok()) {
+				proc.set_state(State::Sleeping);
+			}
+		}
+
+		crate::wait();
+	}
+
+	timer::cancel(pid);
 	Ok(0)
 }
@@ -4,7 +4,6 @@ use crate::errno::Errno;
 use crate::process::Process;
 use crate::process::mem_space::ptr::SyscallSlice;
 use crate::process::regs::Regs;
-use crate::time::unit::Timestamp;
 use crate::time;
 
 /// There is data to read.
@@ -45,20 +44,20 @@ pub fn poll(regs: &Regs) -> Result<i32, Errno> {
 	let nfds = regs.ecx as usize;
 	let timeout = regs.edx as i32;
 
-	// The timeout. None means no timeout
-	let to: Option<Timestamp> = if timeout >= 0 {
-		Some(timeout as _)
+	// The timeout in nanoseconds. None means no timeout
+	let to: Option<u64> = if timeout >= 0 {
+		Some(timeout as u64 * 1000000)
 	} else {
 		None
 	};
 
 	// The start timestamp
-	let start_ts = time::get().unwrap_or(0);
+	let start_ts = time::get_clock(time::CLOCK_MONOTONIC).unwrap_or(0);
 
 	loop {
 		// Checking whether the system call timed out
 		if let Some(timeout) = to {
-			if time::get().unwrap_or(0) >= start_ts + timeout {
+			if time::get_clock(time::CLOCK_MONOTONIC).unwrap_or(0) >= start_ts + timeout {
 				return Ok(0);
 			}
 		}
@@ -59,7 +59,7 @@ pub fn do_select<T: TimeUnit>(nfds: u32,
 	_sigmask: Option<SyscallSlice<u8>>
 ) -> Result<i32, Errno> {
 	// Getting start timestamp
-	let start = time::get_struct::<T>(b"TODO").unwrap(); // TODO Select a clock
+	let start = time::get_struct::<T>(time::CLOCK_MONOTONIC).unwrap_or_default();
 
 	// Getting timeout
 	let timeout = {
@@ -154,8 +154,7 @@ pub fn do_select<T: TimeUnit>(nfds: u32,
 			return Ok(events_count);
 		}
 
-		// TODO Select a clock
-		let curr = time::get_struct::<T>(b"TODO").unwrap();
+		let curr = time::get_struct::<T>(time::CLOCK_MONOTONIC).unwrap_or_default();
 		// On timeout, return 0
 		if curr >= end {
 			return Ok(0);
@@ -0,0 +1,194 @@
+//! The `sendfile` system call copies data from a file to another file descriptor without going
+//! through userspace.
+
+use core::cmp::min;
+use core::ptr;
+use crate::errno::Errno;
+use crate::errno;
+use crate::file::File;
+use crate::file::FileType;
+use crate::file::open_file::FDTarget;
+use crate::file::open_file::O_NONBLOCK;
+use crate::file::open_file::OpenFile;
+use crate::file::page_cache::CachedFile;
+use crate::file::page_cache;
+use crate::memory;
+use crate::process::Process;
+use crate::process::mem_space::ptr::SyscallPtr;
+use crate::process::regs::Regs;
+use crate::syscall::Signal;
+use crate::util::IO;
+
+/// Writes up to `count` bytes of the file `file` at offset `off` to the open file `out`, mapping
+/// the pages of the page cache directly instead of copying them to an intermediate buffer.
+/// The function returns the number of bytes written.
+fn file_to_open_file(file: &File, off: u64, out: &mut OpenFile, count: usize)
+	-> Result<usize, Errno> {
+	let cached = if file.get_file_type() == FileType::Regular {
+		CachedFile::new(file.get_location(), file.get_size())
+	} else {
+		None
+	};
+	let cached = cached.ok_or_else(|| errno!(EINVAL))?;
+
+	let size = cached.get_size();
+	let mut i = 0;
+	while i < count {
+		let cur = off + i as u64;
+		if cur >= size {
+			break;
+		}
+
+		let inner_off = (cur % memory::PAGE_SIZE as u64) as usize;
+		let l = min(memory::PAGE_SIZE - inner_off, count - i);
+		let l = min(l as u64, size - cur) as usize;
+
+		let page = match cached.map_page(cur / memory::PAGE_SIZE as u64, false) {
+			Ok(Some(page)) => page,
+			Ok(None) => break,
+
+			Err(e) if i == 0 => return Err(e),
+			Err(_) => break,
+		};
+		let data = &page_cache::get_page_slice(page)[inner_off..(inner_off + l)];
+		let res = out.write(data);
+		page_cache::release(page);
+
+		let l = match res {
+			Ok(l) => l,
+
+			Err(e) if i == 0 => return Err(e),
+			Err(_) => break,
+		};
+		i += l;
+
+		if l < data.len() {
+			break;
+		}
+	}
+
+	Ok(i)
+}
+
+/// Performs one attempt at sending up to `count` bytes from `in_fd` at offset `off` to `out_fd`.
+/// The function returns the number of bytes sent, whether the operation would block, the flags
+/// of the output open file and the offset following the last byte read.
+fn send(out_fd: u32, in_fd: u32, off: Option<u64>, count: usize)
+	-> Result<(usize, bool, i32, u64), Errno> {
+	let (in_mutex, out_mutex) = {
+		let mutex = Process::get_current().unwrap();
+		let guard = mutex.lock();
+		let proc = guard.get();
+
+		let in_mutex = proc.get_fd(in_fd).ok_or_else(|| errno!(EBADF))?.get_open_file();
+		let out_mutex = proc.get_fd(out_fd).ok_or_else(|| errno!(EBADF))?.get_open_file();
+		(in_mutex, out_mutex)
+	};
+	// Both ends cannot be locked at the same time
+	if ptr::eq(in_mutex.as_ref(), out_mutex.as_ref()) {
+		return Err(errno!(EINVAL));
+	}
+
+	let mut in_guard = in_mutex.lock();
+	let in_file = in_guard.get_mut();
+	let mut out_guard = out_mutex.lock();
+	let out_file = out_guard.get_mut();
+	if !in_file.can_read() || !out_file.can_write() {
+		return Err(errno!(EBADF));
+	}
+	let flags = out_file.get_flags();
+
+	let FDTarget::File(file) = in_file.get_target().clone() else {
+		return Err(errno!(EINVAL));
+	};
+	let begin = off.unwrap_or(in_file.get_offset());
+
+	let (l, blocked) = match out_file.get_target().clone() {
+		FDTarget::Pipe(pipe) => {
+			let mut file_guard = file.lock();
+			let mut pipe_guard = pipe.lock();
+			let pipe = pipe_guard.get_mut();
+
+			let l = super::splice::file_to_pipe(file_guard.get_mut(), begin, pipe, count)?;
+			(l, pipe.is_full())
+		},
+
+		_ => {
+			let file_guard = file.lock();
+			(file_to_open_file(file_guard.get(), begin, out_file, count)?, false)
+		},
+	};
+
+	let end = begin + l as u64;
+	if off.is_none() {
+		in_file.set_offset(end);
+	}
+	Ok((l, blocked, flags, end))
+}
+
+/// Performs the sendfile operation.
+/// `out_fd` is the file descriptor to write to.
+/// `in_fd` is the file descriptor of the file to read from.
+/// `offset` is the offset to read from. If not None, the offset of `in_fd` is left untouched and
+/// `offset` is updated to the offset following the last byte read instead.
+/// `count` is the number of bytes to send.
+pub fn do_sendfile(out_fd: u32, in_fd: u32, mut offset: Option<&mut u64>, count: usize)
+	-> Result<i32, Errno> {
+	let count = min(count, i32::MAX as usize);
+	if count == 0 {
+		return Ok(0);
+	}
+
+	loop {
+		let off = offset.as_deref().cloned();
+		let (l, blocked, flags, end) = match send(out_fd, in_fd, off, count) {
+			Ok(r) => r,
+
+			Err(e) => {
+				// If the pipe is broken, kill with SIGPIPE
+				if e.as_int() == errno::EPIPE {
+					let mutex = Process::get_current().unwrap();
+					let mut guard = mutex.lock();
+					guard.get_mut().kill(&Signal::SIGPIPE, false);
+				}
+
+				return Err(e);
+			},
+		};
+
+		if l > 0 || !blocked {
+			if let Some(offset) = offset.as_mut() {
+				**offset = end;
+			}
+			return Ok(l as _);
+		}
+		if flags & O_NONBLOCK != 0 {
+			return Err(errno!(EAGAIN));
+		}
+
+		// TODO Mark the process as Sleeping and wake it up when the pipe is ready?
+		crate::wait();
+	}
+}
+
+/// The implementation of the `sendfile` syscall.
+pub fn sendfile(regs: &Regs) -> Result<i32, Errno> {
+	let out_fd = regs.ebx as u32;
+	let in_fd = regs.ecx as u32;
+	let offset: SyscallPtr<u32> = (regs.edx as usize).into();
+	let count = regs.esi as usize;
+
+	let mem_space = {
+		let mutex = Process::get_current().unwrap();
+		let guard = mutex.lock();
+		guard.get().get_mem_space().unwrap()
+	};
+
+	let mut off = offset.copy_from_user(&mem_space)?.map(| off | off as u64);
+	let len = do_sendfile(out_fd, in_fd, off.as_mut(), count)?;
+
+	if let Some(off) = off {
+		offset.copy_to_user(&mem_space, &(off as _))?;
+	}
+	Ok(len)
+}
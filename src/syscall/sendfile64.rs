@@ -0,0 +1,29 @@
+//! The `sendfile64` system call copies data from a file to another file descriptor without going
+//! through userspace, using a 64 bits offset.
+
+use crate::errno::Errno;
+use crate::process::Process;
+use crate::process::mem_space::ptr::SyscallPtr;
+use crate::process::regs::Regs;
+
+/// The implementation of the `sendfile64` syscall.
+pub fn sendfile64(regs: &Regs) -> Result<i32, Errno> {
+	let out_fd = regs.ebx as u32;
+	let in_fd = regs.ecx as u32;
+	let offset: SyscallPtr<u64> = (regs.edx as usize).into();
+	let count = regs.esi as usize;
+
+	let mem_space = {
+		let mutex = Process::get_current().unwrap();
+		let guard = mutex.lock();
+		guard.get().get_mem_space().unwrap()
+	};
+
+	let mut off = offset.copy_from_user(&mem_space)?;
+	let len = super::sendfile::do_sendfile(out_fd, in_fd, off.as_mut(), count)?;
+
+	if let Some(off) = off {
+		offset.copy_to_user(&mem_space, &off)?;
+	}
+	Ok(len)
+}
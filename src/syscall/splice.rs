@@ -0,0 +1,286 @@
+//! The `splice` system call moves data between two file descriptors without copying it through
+//! userspace. At least one of the file descriptors must refer to a pipe.
+
+use core::cmp::min;
+use core::ptr;
+use crate::errno::Errno;
+use crate::errno;
+use crate::file::File;
+use crate::file::FileType;
+use crate::file::open_file::FDTarget;
+use crate::file::open_file::O_NONBLOCK;
+use crate::file::page_cache::CachedFile;
+use crate::file::page_cache;
+use crate::file::pipe::PipeBuffer;
+use crate::memory::malloc;
+use crate::memory;
+use crate::process::Process;
+use crate::process::mem_space::ptr::SyscallPtr;
+use crate::process::regs::Regs;
+use crate::syscall::Signal;
+use crate::util::IO;
+
+/// Flag: the operation does not block on pipes.
+const SPLICE_F_NONBLOCK: u32 = 2;
+
+/// Moves up to `len` bytes of the file `file` at offset `off` to the pipe `pipe`.
+/// Regular files are read through the page cache and their pages are referenced by the pipe
+/// instead of being copied. Other files are copied through a kernel buffer.
+/// The function returns the number of bytes moved, which is zero if the pipe is full or if the
+/// end of the file is reached.
+pub fn file_to_pipe(file: &mut File, off: u64, pipe: &mut PipeBuffer, len: usize)
+	-> Result<usize, Errno> {
+	if !pipe.has_readers() {
+		return Err(errno!(EPIPE));
+	}
+
+	let cached = if file.get_file_type() == FileType::Regular {
+		CachedFile::new(file.get_location(), file.get_size())
+	} else {
+		None
+	};
+	let Some(cached) = cached else {
+		let len = min(len, min(pipe.get_available_len(), memory::PAGE_SIZE));
+		if len == 0 {
+			return Ok(0);
+		}
+
+		let mut buf = malloc::Alloc::<u8>::new_default(len)?;
+		let l = file.read(off, buf.as_slice_mut())? as usize;
+		return pipe.write(&buf.as_slice()[..l]);
+	};
+
+	let size = cached.get_size();
+	let mut i = 0;
+	while i < len && !pipe.is_full() {
+		let cur = off + i as u64;
+		if cur >= size {
+			break;
+		}
+
+		let inner_off = (cur % memory::PAGE_SIZE as u64) as usize;
+		let l = min(memory::PAGE_SIZE - inner_off, len - i);
+		let l = min(l as u64, size - cur) as usize;
+
+		let res = cached.map_page(cur / memory::PAGE_SIZE as u64, false).and_then(| page | {
+			let Some(page) = page else {
+				return Ok(false);
+			};
+
+			let res = pipe.push_page(page, inner_off, inner_off + l);
+			page_cache::release(page);
+			res.map(| _ | true)
+		});
+		match res {
+			Ok(true) => i += l,
+			Ok(false) => break,
+
+			Err(e) if i == 0 => return Err(e),
+			Err(_) => break,
+		}
+	}
+
+	Ok(i)
+}
+
+/// Moves up to `len` bytes from the pipe `pipe` to the file `file` at offset `off`.
+/// The function returns the number of bytes moved.
+pub fn pipe_to_file(pipe: &mut PipeBuffer, file: &mut File, off: u64, len: usize)
+	-> Result<usize, Errno> {
+	let mut i = 0;
+	while i < len {
+		let Some((page, begin, end)) = pipe.peek(len - i) else {
+			break;
+		};
+
+		let data = &page_cache::get_page_slice(page)[begin..end];
+		let l = match file.write(off + i as u64, data) {
+			Ok(l) => l as usize,
+
+			Err(e) if i == 0 => return Err(e),
+			Err(_) => break,
+		};
+		pipe.consume(l);
+		i += l;
+
+		if l < data.len() {
+			break;
+		}
+	}
+
+	Ok(i)
+}
+
+/// Moves up to `len` bytes from the pipe `src` to the pipe `dst`, referencing the pages of `src`
+/// in `dst` instead of copying them.
+/// The function returns the number of bytes moved.
+fn pipe_to_pipe(src: &mut PipeBuffer, dst: &mut PipeBuffer, len: usize)
+	-> Result<usize, Errno> {
+	if !dst.has_readers() {
+		return Err(errno!(EPIPE));
+	}
+
+	let mut i = 0;
+	while i < len {
+		let Some((page, begin, end)) = src.peek(len - i) else {
+			break;
+		};
+
+		match dst.push_page(page, begin, end) {
+			Ok(()) => {},
+
+			Err(e) if i == 0 && e.as_int() != errno::EAGAIN => return Err(e),
+			Err(_) => break,
+		}
+		src.consume(end - begin);
+		i += end - begin;
+	}
+
+	Ok(i)
+}
+
+/// Reads the offset pointed to by `ptr`. If the pointer is null, the function returns None.
+fn read_offset(ptr: &SyscallPtr<u64>) -> Result<Option<u64>, Errno> {
+	let mutex = Process::get_current().unwrap();
+	let mem_space = mutex.lock().get().get_mem_space().unwrap();
+
+	ptr.copy_from_user(&mem_space)
+}
+
+/// Writes the offset `off` to the location pointed to by `ptr`, if not null.
+fn write_offset(ptr: &SyscallPtr<u64>, off: u64) -> Result<(), Errno> {
+	let mutex = Process::get_current().unwrap();
+	let mem_space = mutex.lock().get().get_mem_space().unwrap();
+
+	ptr.copy_to_user(&mem_space, &off)
+}
+
+/// Performs one attempt at moving up to `len` bytes from `fd_in` to `fd_out`.
+/// The function returns the number of bytes moved, whether the operation would block and the
+/// union of the flags of both open files.
+fn do_splice(fd_in: u32, off_in: &SyscallPtr<u64>, fd_out: u32, off_out: &SyscallPtr<u64>,
+	len: usize) -> Result<(usize, bool, i32), Errno> {
+	let (in_mutex, out_mutex) = {
+		let mutex = Process::get_current().unwrap();
+		let guard = mutex.lock();
+		let proc = guard.get();
+
+		let in_mutex = proc.get_fd(fd_in).ok_or_else(|| errno!(EBADF))?.get_open_file();
+		let out_mutex = proc.get_fd(fd_out).ok_or_else(|| errno!(EBADF))?.get_open_file();
+		(in_mutex, out_mutex)
+	};
+	// Both ends cannot be locked at the same time
+	if ptr::eq(in_mutex.as_ref(), out_mutex.as_ref()) {
+		return Err(errno!(EINVAL));
+	}
+
+	let mut in_guard = in_mutex.lock();
+	let in_file = in_guard.get_mut();
+	let mut out_guard = out_mutex.lock();
+	let out_file = out_guard.get_mut();
+	if !in_file.can_read() || !out_file.can_write() {
+		return Err(errno!(EBADF));
+	}
+	let flags = in_file.get_flags() | out_file.get_flags();
+
+	match (in_file.get_target().clone(), out_file.get_target().clone()) {
+		(FDTarget::Pipe(src), FDTarget::Pipe(dst)) => {
+			if !off_in.is_null() || !off_out.is_null() {
+				return Err(errno!(ESPIPE));
+			}
+			if ptr::eq(src.as_ref(), dst.as_ref()) {
+				return Err(errno!(EINVAL));
+			}
+
+			let mut src_guard = src.lock();
+			let src = src_guard.get_mut();
+			let mut dst_guard = dst.lock();
+			let dst = dst_guard.get_mut();
+
+			let l = pipe_to_pipe(src, dst, len)?;
+			let blocked = (src.get_data_len() == 0 && !src.eof()) || dst.is_full();
+			Ok((l, blocked, flags))
+		},
+
+		(FDTarget::File(file), FDTarget::Pipe(pipe)) => {
+			if !off_out.is_null() {
+				return Err(errno!(ESPIPE));
+			}
+			let off = read_offset(off_in)?.unwrap_or(in_file.get_offset());
+
+			let mut file_guard = file.lock();
+			let mut pipe_guard = pipe.lock();
+			let pipe = pipe_guard.get_mut();
+
+			let l = file_to_pipe(file_guard.get_mut(), off, pipe, len)?;
+			if off_in.is_null() {
+				in_file.set_offset(off + l as u64);
+			} else {
+				write_offset(off_in, off + l as u64)?;
+			}
+			Ok((l, pipe.is_full(), flags))
+		},
+
+		(FDTarget::Pipe(pipe), FDTarget::File(file)) => {
+			if !off_in.is_null() {
+				return Err(errno!(ESPIPE));
+			}
+			let off = read_offset(off_out)?.unwrap_or(out_file.get_offset());
+
+			let mut pipe_guard = pipe.lock();
+			let pipe = pipe_guard.get_mut();
+			let mut file_guard = file.lock();
+
+			let l = pipe_to_file(pipe, file_guard.get_mut(), off, len)?;
+			if off_out.is_null() {
+				out_file.set_offset(off + l as u64);
+			} else {
+				write_offset(off_out, off + l as u64)?;
+			}
+			Ok((l, pipe.get_data_len() == 0 && !pipe.eof(), flags))
+		},
+
+		_ => Err(errno!(EINVAL)),
+	}
+}
+
+/// The implementation of the `splice` syscall.
+pub fn splice(regs: &Regs) -> Result<i32, Errno> {
+	let fd_in = regs.ebx as u32;
+	let off_in: SyscallPtr<u64> = (regs.ecx as usize).into();
+	let fd_out = regs.edx as u32;
+	let off_out: SyscallPtr<u64> = (regs.esi as usize).into();
+	let len = min(regs.edi as usize, i32::MAX as usize);
+	let flags = regs.ebp as u32;
+
+	if len == 0 {
+		return Ok(0);
+	}
+
+	loop {
+		let (l, blocked, fd_flags) = match do_splice(fd_in, &off_in, fd_out, &off_out, len) {
+			Ok(r) => r,
+
+			Err(e) => {
+				// If the pipe is broken, kill with SIGPIPE
+				if e.as_int() == errno::EPIPE {
+					let mutex = Process::get_current().unwrap();
+					let mut guard = mutex.lock();
+					guard.get_mut().kill(&Signal::SIGPIPE, false);
+				}
+
+				return Err(e);
+			},
+		};
+
+		if l > 0 || !blocked {
+			return Ok(l as _);
+		}
+		if flags & SPLICE_F_NONBLOCK != 0 || fd_flags & O_NONBLOCK != 0 {
+			return Err(errno!(EAGAIN));
+		}
+
+		// TODO Mark the process as Sleeping and wake it up when the pipe is ready?
+		crate::wait();
+	}
+}
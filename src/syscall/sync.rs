@@ -0,0 +1,12 @@
+//! The `sync` system call allows to write every cached data to the storage devices.
+
+use crate::device::storage::cache;
+use crate::errno::Errno;
+use crate::process::regs::Regs;
+
+/// The implementation of the `sync` syscall.
+pub fn sync(_: &Regs) -> Result<i32, Errno> {
+	// The system call cannot fail
+	let _ = cache::sync(None);
+	Ok(0)
+}
@@ -2,6 +2,7 @@
 
 use crate::errno::Errno;
 use crate::file::fcache;
+use crate::file::page_cache;
 use crate::file::path::Path;
 use crate::process::Process;
 use crate::process::mem_space::ptr::SyscallString;
@@ -29,6 +30,7 @@ pub fn truncate(regs: &Regs) -> Result<i32, Errno> {
 	let mut file_guard = file_mutex.lock();
 	let file = file_guard.get_mut();
 	file.set_size(length as _);
+	page_cache::truncate(file.get_location(), length as _);
 
 	Ok(0)
 }
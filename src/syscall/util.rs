@@ -1,13 +1,16 @@
 /// This module implements utility functions for system calls.
 
+use core::ffi::c_void;
 use core::mem::size_of;
 use crate::errno::Errno;
 use crate::errno;
 use crate::file::path::Path;
+use crate::memory;
 use crate::process::Process;
 use crate::process::mem_space::ptr::SyscallString;
 use crate::util::container::string::String;
 use crate::util::container::vec::Vec;
+use crate::util;
 
 /// Returns the absolute path according to the process's current working directory.
 /// `process` is the process.
@@ -34,14 +37,24 @@ pub unsafe fn get_str_array(process: &Process, ptr: *const *const u8)
 	let mem_space = process.get_mem_space().unwrap();
 	let mem_space_guard = mem_space.lock();
 
-	// Checking every elements of the array and counting the number of elements
+	// Checking every elements of the array and counting the number of elements. The access is
+	// checked only once per page of the array
 	let mut len = 0;
+	let mut checked_end = ptr as usize;
 	loop {
 		let elem_ptr = ptr.add(len);
 
 		// Checking access on elem_ptr
-		if !mem_space_guard.get().can_access(elem_ptr as _, size_of::<*const u8>(), true, false) {
-			return Err(errno!(EFAULT));
+		let elem_end = elem_ptr as usize + size_of::<*const u8>();
+		if elem_end > checked_end {
+			let begin = util::down_align(elem_ptr as *const c_void, memory::PAGE_SIZE);
+			let end = util::align(elem_end as *const c_void, memory::PAGE_SIZE);
+			let size = end as usize - begin as usize;
+			if !mem_space_guard.get().can_access(begin as _, size, true, false) {
+				return Err(errno!(EFAULT));
+			}
+
+			checked_end = end as usize;
 		}
 
 		// Safe because the access is checked before
@@ -0,0 +1,111 @@
+//! The `vmsplice` system call writes the content of userspace buffers to a pipe.
+
+use core::cmp::min;
+use crate::errno::Errno;
+use crate::errno;
+use crate::file::open_file::FDTarget;
+use crate::file::open_file::O_NONBLOCK;
+use crate::limits;
+use crate::process::Process;
+use crate::process::iovec::IOVec;
+use crate::process::mem_space::ptr::SyscallSlice;
+use crate::process::regs::Regs;
+use crate::syscall::Signal;
+
+/// Flag: the operation does not block on the pipe.
+const SPLICE_F_NONBLOCK: u32 = 2;
+
+/// Performs one attempt at writing the buffers `iov` to the pipe `fd`.
+/// The function returns the number of bytes written, whether the operation would block and the
+/// flags of the open file.
+fn do_vmsplice(fd: u32, iov: &SyscallSlice<IOVec>, nr_segs: usize)
+	-> Result<(usize, bool, i32), Errno> {
+	let (mem_space, open_file_mutex) = {
+		let mutex = Process::get_current().unwrap();
+		let guard = mutex.lock();
+		let proc = guard.get();
+
+		let open_file_mutex = proc.get_fd(fd).ok_or_else(|| errno!(EBADF))?.get_open_file();
+		(proc.get_mem_space().unwrap(), open_file_mutex)
+	};
+
+	let open_file_guard = open_file_mutex.lock();
+	let open_file = open_file_guard.get();
+	if !open_file.can_write() {
+		return Err(errno!(EBADF));
+	}
+	let FDTarget::Pipe(pipe) = open_file.get_target() else {
+		return Err(errno!(EBADF));
+	};
+
+	let mem_space_guard = mem_space.lock();
+	let iov_slice = iov.get(&mem_space_guard, nr_segs)?.ok_or_else(|| errno!(EFAULT))?;
+
+	let mut pipe_guard = pipe.lock();
+	let pipe = pipe_guard.get_mut();
+
+	let mut total_len = 0;
+	let mut blocked = false;
+	for i in iov_slice {
+		// The size to write. This is limited to avoid an overflow on the total length
+		let l = min(i.iov_len, i32::MAX as usize - total_len);
+		let ptr = SyscallSlice::<u8>::from(i.iov_base as usize);
+		let Some(slice) = ptr.get(&mem_space_guard, l)? else {
+			continue;
+		};
+
+		let len = match pipe.write(slice) {
+			Ok(len) => len,
+
+			Err(e) if total_len == 0 => return Err(e),
+			Err(_) => break,
+		};
+		total_len += len;
+
+		if len < slice.len() {
+			blocked = total_len == 0;
+			break;
+		}
+	}
+
+	Ok((total_len, blocked, open_file.get_flags()))
+}
+
+/// The implementation of the `vmsplice` syscall.
+pub fn vmsplice(regs: &Regs) -> Result<i32, Errno> {
+	let fd = regs.ebx as u32;
+	let iov: SyscallSlice<IOVec> = (regs.ecx as usize).into();
+	let nr_segs = regs.edx as usize;
+	let flags = regs.esi as u32;
+
+	if nr_segs > limits::IOV_MAX {
+		return Err(errno!(EINVAL));
+	}
+
+	loop {
+		let (len, blocked, fd_flags) = match do_vmsplice(fd, &iov, nr_segs) {
+			Ok(r) => r,
+
+			Err(e) => {
+				// If the pipe is broken, kill with SIGPIPE
+				if e.as_int() == errno::EPIPE {
+					let mutex = Process::get_current().unwrap();
+					let mut guard = mutex.lock();
+					guard.get_mut().kill(&Signal::SIGPIPE, false);
+				}
+
+				return Err(e);
+			},
+		};
+
+		if len > 0 || !blocked {
+			return Ok(len as _);
+		}
+		if flags & SPLICE_F_NONBLOCK != 0 || fd_flags & O_NONBLOCK != 0 {
+			return Err(errno!(EAGAIN));
+		}
+
+		// TODO Mark the process as Sleeping and wake it up when the pipe is ready?
+		crate::wait();
+	}
+}
@@ -1,9 +1,16 @@
 //! This module handles time-releated features.
 //! The kernel stores a list of clock sources. A clock source is an object that allow to get the
 //! current timestamp.
+//!
+//! Clocks with nanosecond precision are derived from the TSC (see `tsc`), and timers are handled
+//! by the `timer` module.
 
+pub mod timer;
+pub mod tsc;
 pub mod unit;
 
+use core::sync::atomic::AtomicU32;
+use core::sync::atomic::Ordering;
 use crate::errno::Errno;
 use crate::util::boxed::Box;
 use crate::util::container::vec::Vec;
@@ -11,6 +18,19 @@ use crate::util::lock::*;
 use unit::TimeUnit;
 use unit::Timestamp;
 
+/// Clock: the wall clock time.
+pub const CLOCK_REALTIME: i32 = 0;
+/// Clock: the time elapsed since boot, which cannot go backwards.
+pub const CLOCK_MONOTONIC: i32 = 1;
+/// Clock: same as `CLOCK_MONOTONIC`, without adjustments.
+pub const CLOCK_MONOTONIC_RAW: i32 = 4;
+/// Clock: a faster but less precise version of `CLOCK_REALTIME`.
+pub const CLOCK_REALTIME_COARSE: i32 = 5;
+/// Clock: a faster but less precise version of `CLOCK_MONOTONIC`.
+pub const CLOCK_MONOTONIC_COARSE: i32 = 6;
+/// Clock: same as `CLOCK_MONOTONIC`, including the time the system is suspended.
+pub const CLOCK_BOOTTIME: i32 = 7;
+
 /// Trait representing a source able to provide the current timestamp.
 pub trait ClockSource {
 	/// The name of the source.
@@ -23,6 +43,9 @@ pub trait ClockSource {
 /// Vector containing all the clock sources.
 static CLOCK_SOURCES: Mutex<Vec<Box<dyn ClockSource>>> = Mutex::new(Vec::new());
 
+/// The number of ticks of the system timer since boot.
+static TICKS: AtomicU32 = AtomicU32::new(0);
+
 /// Returns a reference to the list of clock sources.
 pub fn get_clock_sources() -> &'static Mutex<Vec<Box<dyn ClockSource>>> {
 	&CLOCK_SOURCES
@@ -65,10 +88,47 @@ pub fn get() -> Option<Timestamp> {
 	}
 }
 
+/// Increments the number of ticks of the system timer. This function must be called on each tick.
+pub fn tick() {
+	TICKS.fetch_add(1, Ordering::Relaxed);
+}
+
+/// Returns the number of ticks of the system timer since boot. The value wraps around on
+/// overflow.
+/// When the timer doesn't tick periodically (see `timer`), the number of ticks is derived from
+/// the monotonic clock, with one tick per time slice.
+pub fn get_ticks() -> u32 {
+	if timer::is_enabled() {
+		if let Some(ns) = tsc::get_ns() {
+			return (ns / timer::TICK_PERIOD) as _;
+		}
+	}
+
+	TICKS.load(Ordering::Relaxed)
+}
+
+/// Returns the current time of the clock `clk` in nanoseconds.
+/// If the clock doesn't exist or is not available, the function returns None.
+pub fn get_clock(clk: i32) -> Option<u64> {
+	match clk {
+		CLOCK_MONOTONIC
+		| CLOCK_MONOTONIC_RAW
+		| CLOCK_MONOTONIC_COARSE
+		| CLOCK_BOOTTIME => tsc::get_ns(),
+
+		CLOCK_REALTIME | CLOCK_REALTIME_COARSE => {
+			// The clock sources have a precision of one second. The monotonic clock provides the
+			// subsecond part
+			let base = get()?.saturating_mul(1000000000);
+			Some(base + tsc::get_ns().unwrap_or(0) % 1000000000)
+		},
+
+		_ => None,
+	}
+}
+
 /// Returns the current timestamp from the given clock `clk`.
 /// If the clock doesn't exist, the function returns None.
-pub fn get_struct<T: TimeUnit>(_clk: &[u8]) -> Option<T> {
-	// TODO use the given clock
-	// TODO use the correct unit
-	Some(T::from_nano(get()?))
+pub fn get_struct<T: TimeUnit>(clk: i32) -> Option<T> {
+	Some(T::from_nano(get_clock(clk)?))
 }
@@ -0,0 +1,401 @@
+//! Timers allow to wake up processes at a given time, with a precision below the period of the
+//! system timer.
+//!
+//! When the Local APIC and the TSC are available, the PIT stops ticking periodically. Instead,
+//! the timer of the Local APIC of each core is programmed in one-shot mode to fire at the next
+//! event of the core, which can be:
+//! - the first expiring timer of the core
+//! - the end of the time slice of the running process, if other processes are waiting to run on
+//! the core
+//!
+//! Thus, a core that is idle or that has a single process to run isn't interrupted for nothing.
+//!
+//! The pending timers of each core are stored in a binary min-heap sorted by deadline, so that
+//! adding a timer or getting the next one to expire is done in logarithmic time.
+//!
+//! Deadlines are in nanoseconds of the monotonic clock (see `tsc`).
+
+use core::cmp::min;
+use core::sync::atomic::AtomicBool;
+use core::sync::atomic::AtomicU32;
+use core::sync::atomic::AtomicU64;
+use core::sync::atomic::Ordering;
+use crate::cpu::apic;
+use crate::cpu::smp;
+use crate::cpu;
+use crate::errno::Errno;
+use crate::idt;
+use crate::pit;
+use crate::process::Process;
+use crate::process::State;
+use crate::process::pid::Pid;
+use crate::util::container::vec::Vec;
+use crate::util::lock::IntMutex;
+use super::tsc;
+
+/// The length of a time slice in nanoseconds, after which the running process is preempted if
+/// other processes are waiting to run.
+pub const TICK_PERIOD: u64 = 10000000;
+
+/// The duration of the calibration of the timer of the Local APIC, in microseconds.
+const CALIBRATION_US: u64 = 10000;
+/// The maximum delay the timer is armed for in one-shot mode, in nanoseconds. A later deadline
+/// makes the timer fire early, then be armed again.
+const MAX_ONESHOT_DELAY: u64 = 1000000000;
+
+/// A pending timer.
+#[derive(Clone, Copy)]
+struct Timer {
+	/// The time at which the timer expires.
+	deadline: u64,
+	/// The PID of the process to wake up.
+	pid: Pid,
+}
+
+/// The timers of a core.
+struct CoreTimers {
+	/// The min-heap of pending timers.
+	heap: Vec<Timer>,
+	/// The deadline the timer of the Local APIC is armed for. `u64::MAX` if not armed.
+	armed: u64,
+}
+
+impl CoreTimers {
+	/// Creates a new instance without any timer.
+	const fn new() -> Self {
+		Self {
+			heap: Vec::new(),
+			armed: u64::MAX,
+		}
+	}
+
+	/// Moves the timer at index `i` up until the heap is ordered.
+	fn sift_up(&mut self, mut i: usize) {
+		while i > 0 {
+			let parent = (i - 1) / 2;
+			if self.heap[parent].deadline <= self.heap[i].deadline {
+				break;
+			}
+
+			self.heap.swap(parent, i);
+			i = parent;
+		}
+	}
+
+	/// Moves the timer at index `i` down until the heap is ordered.
+	fn sift_down(&mut self, mut i: usize) {
+		loop {
+			let left = i * 2 + 1;
+			let right = left + 1;
+
+			let len = self.heap.len();
+			let mut smallest = i;
+			if left < len && self.heap[left].deadline < self.heap[smallest].deadline {
+				smallest = left;
+			}
+			if right < len && self.heap[right].deadline < self.heap[smallest].deadline {
+				smallest = right;
+			}
+			if smallest == i {
+				break;
+			}
+
+			self.heap.swap(smallest, i);
+			i = smallest;
+		}
+	}
+
+	/// Returns the deadline of the first timer to expire. If no timer is pending, the function
+	/// returns `u64::MAX`.
+	fn next_deadline(&self) -> u64 {
+		self.heap.as_slice().first().map(| t | t.deadline).unwrap_or(u64::MAX)
+	}
+
+	/// Adds the timer `timer`.
+	fn push(&mut self, timer: Timer) -> Result<(), Errno> {
+		self.heap.push(timer)?;
+		self.sift_up(self.heap.len() - 1);
+		Ok(())
+	}
+
+	/// Removes the timer at index `i` and returns it.
+	fn remove(&mut self, i: usize) -> Timer {
+		let last = self.heap.len() - 1;
+		self.heap.swap(i, last);
+		let timer = self.heap.pop().unwrap();
+
+		if i < self.heap.len() {
+			self.sift_down(i);
+			self.sift_up(i);
+		}
+		timer
+	}
+
+	/// Arms the timer of the Local APIC of the current core to fire at `deadline`. `now` is the
+	/// current time. If `deadline` is `u64::MAX`, the timer is stopped.
+	fn arm(&mut self, deadline: u64, now: u64) {
+		self.armed = deadline;
+
+		if DEADLINE_MODE.load(Ordering::Relaxed) {
+			let tsc = if deadline != u64::MAX {
+				// Zero would stop the timer
+				tsc::ns_to_tsc(deadline).max(1)
+			} else {
+				0
+			};
+			apic::timer_deadline(tsc);
+		} else {
+			let count = if deadline != u64::MAX {
+				let delay = min(deadline.saturating_sub(now), MAX_ONESHOT_DELAY);
+				let count = delay * APIC_FREQUENCY.load(Ordering::Relaxed) / 1000000000;
+				count.clamp(1, u32::MAX as _) as u32
+			} else {
+				0
+			};
+			apic::timer_oneshot(count);
+		}
+	}
+}
+
+/// The timers of each core.
+static TIMERS: [IntMutex<CoreTimers>; smp::MAX_CORES] = {
+	const INIT: IntMutex<CoreTimers> = IntMutex::new(CoreTimers::new());
+	[INIT; smp::MAX_CORES]
+};
+
+/// Tells whether timers are enabled. If not, the PIT ticks periodically.
+static ENABLED: AtomicBool = AtomicBool::new(false);
+/// Tells whether the timer of the Local APIC is used in TSC-deadline mode.
+static DEADLINE_MODE: AtomicBool = AtomicBool::new(false);
+/// The frequency of the timer of the Local APIC in one-shot mode, in Hertz.
+static APIC_FREQUENCY: AtomicU64 = AtomicU64::new(0);
+/// Bitmask of cores whose Local APIC timer has been set up.
+static SETUP: AtomicU32 = AtomicU32::new(0);
+/// Bitmask of cores that have no process to run.
+static IDLE: AtomicU32 = AtomicU32::new(!0);
+
+/// Measures the frequency of the timer of the Local APIC, if necessary.
+/// This function must be called once at boot on the bootstrap core, after the Local APIC and the
+/// TSC have been initialized.
+pub fn init() {
+	if !apic::is_enabled() || !tsc::is_calibrated() {
+		return;
+	}
+	if cpu::has_tsc_deadline() {
+		DEADLINE_MODE.store(true, Ordering::Relaxed);
+		return;
+	}
+
+	let elapsed = idt::wrap_disable_interrupts(|| {
+		apic::timer_setup(idt::APIC_TIMER as _, false);
+		apic::timer_oneshot(u32::MAX);
+		pit::udelay(CALIBRATION_US as _);
+		let elapsed = u32::MAX - apic::timer_current();
+		apic::timer_oneshot(0);
+		elapsed
+	});
+
+	APIC_FREQUENCY.store(elapsed as u64 * 1000000 / CALIBRATION_US, Ordering::Relaxed);
+}
+
+/// Enables timers, stopping the periodic tick of the PIT. If timers cannot be used on the
+/// current hardware, the function returns false.
+pub fn enable() -> bool {
+	let usable = DEADLINE_MODE.load(Ordering::Relaxed)
+		|| APIC_FREQUENCY.load(Ordering::Relaxed) != 0;
+	if usable {
+		ENABLED.store(true, Ordering::Release);
+	}
+	usable
+}
+
+/// Tells whether timers are enabled.
+pub fn is_enabled() -> bool {
+	ENABLED.load(Ordering::Acquire)
+}
+
+/// Returns the timers of the current core, setting up its Local APIC timer if not done yet.
+/// Interrupts must be disabled.
+fn get_core_timers() -> &'static IntMutex<CoreTimers> {
+	let core = smp::get_core_id();
+	if SETUP.fetch_or(1 << core, Ordering::Relaxed) & (1 << core) == 0 {
+		apic::timer_setup(idt::APIC_TIMER as _, DEADLINE_MODE.load(Ordering::Relaxed));
+	}
+
+	&TIMERS[core]
+}
+
+/// Adds a timer on the current core, waking up the process with PID `pid` at time `deadline`.
+/// The process is woken up only if it is sleeping. Thus, the process must check by itself that
+/// the deadline has been reached.
+pub fn add(pid: Pid, deadline: u64) -> Result<(), Errno> {
+	if !is_enabled() {
+		return Err(errno!(ENOSYS));
+	}
+
+	idt::wrap_disable_interrupts(|| {
+		let mut guard = get_core_timers().lock();
+		let timers = guard.get_mut();
+		timers.push(Timer {
+			deadline,
+			pid,
+		})?;
+
+		if deadline < timers.armed {
+			timers.arm(deadline, tsc::get_ns().unwrap_or(0));
+		}
+		Ok(())
+	})
+}
+
+/// Removes every pending timers of the process with PID `pid`.
+pub fn cancel(pid: Pid) {
+	if !is_enabled() {
+		return;
+	}
+
+	// The timer may be on any core since the process may have been moved after adding it
+	for core in TIMERS.iter() {
+		let mut guard = core.lock();
+		let timers = guard.get_mut();
+
+		let mut i = 0;
+		while i < timers.heap.len() {
+			if timers.heap[i].pid == pid {
+				timers.remove(i);
+			} else {
+				i += 1;
+			}
+		}
+	}
+}
+
+/// Wakes up the processes whose timer expired on the current core.
+/// This function must be called from the interrupt of the Local APIC timer, before the timer is
+/// programmed again.
+pub fn expire() {
+	let Some(now) = tsc::get_ns() else {
+		return;
+	};
+
+	loop {
+		// Not keeping the lock while waking up the process, which might kick the current core
+		let timer = {
+			let mut guard = get_core_timers().lock();
+			let timers = guard.get_mut();
+			timers.armed = u64::MAX;
+
+			if timers.next_deadline() > now {
+				break;
+			}
+			timers.remove(0)
+		};
+
+		if let Some(proc_mutex) = Process::get_by_pid(timer.pid) {
+			let mut guard = proc_mutex.lock();
+			let proc = guard.get_mut();
+			if proc.get_state() == State::Sleeping {
+				proc.set_state(State::Running);
+			}
+		}
+	}
+}
+
+/// Programs the timer of the current core for its next event.
+/// `idle` tells whether the core has no process to run.
+/// `slice` is the remaining time slice of the running process. If None, the process runs until
+/// it blocks or another event happens.
+/// This function must be called with interrupts disabled each time the scheduler switched
+/// processes.
+pub fn program(idle: bool, slice: Option<u64>) {
+	let core = smp::get_core_id();
+	if idle {
+		IDLE.fetch_or(1 << core, Ordering::Release);
+	} else {
+		IDLE.fetch_and(!(1 << core), Ordering::Release);
+	}
+
+	let now = tsc::get_ns().unwrap_or(0);
+	let mut guard = get_core_timers().lock();
+	let timers = guard.get_mut();
+
+	let mut deadline = timers.next_deadline();
+	if let Some(slice) = slice {
+		deadline = min(deadline, now.saturating_add(slice));
+	}
+	timers.arm(deadline, now);
+}
+
+/// Makes sure the timer of the current core fires at `deadline` or earlier.
+/// Interrupts must be disabled.
+fn ensure(deadline: u64) {
+	let mut guard = get_core_timers().lock();
+	let timers = guard.get_mut();
+
+	if deadline < timers.armed {
+		timers.arm(deadline, tsc::get_ns().unwrap_or(0));
+	}
+}
+
+/// Makes sure the current core is interrupted within a time slice, for code that waits for an
+/// event by polling.
+/// Interrupts must be disabled, and must remain so until the core halts.
+pub fn arm_poll() {
+	if !is_enabled() {
+		return;
+	}
+
+	ensure(tsc::get_ns().unwrap_or(0).saturating_add(TICK_PERIOD));
+}
+
+/// Notifies that a process has been inserted in the run queue of the core `core`, which is the
+/// current core, so that it runs without waiting for the next event of a core.
+/// If the core is idle, the scheduler is ticked as soon as possible. Else, the running process is
+/// given a time slice and another idle core is notified to take the new process.
+pub fn kick(core: usize) {
+	if !is_enabled() {
+		return;
+	}
+
+	idt::wrap_disable_interrupts(|| {
+		let now = tsc::get_ns().unwrap_or(0);
+		let idle = IDLE.load(Ordering::Acquire);
+		if idle & (1 << core) != 0 {
+			ensure(now);
+			return;
+		}
+		ensure(now.saturating_add(TICK_PERIOD));
+
+		let others = idle & smp::get_online_mask() & !(1 << core);
+		if others != 0 {
+			smp::send_ipi(others.trailing_zeros() as _, idt::TICK_IPI as _);
+		}
+	});
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	#[test_case]
+	fn timer_heap0() {
+		let mut timers = CoreTimers::new();
+		for i in 0..32u64 {
+			let deadline = (i * 7919) % 32;
+			timers.push(Timer {
+				deadline,
+				pid: deadline as _,
+			}).unwrap();
+		}
+		// Removing an arbitrary timer must keep the heap ordered
+		let removed = timers.remove(5);
+
+		let mut prev = 0;
+		while !timers.heap.is_empty() {
+			let timer = timers.remove(0);
+			assert!(timer.deadline >= prev);
+			assert_ne!(timer.deadline, removed.deadline);
+			prev = timer.deadline;
+		}
+	}
+}
@@ -0,0 +1,101 @@
+//! The Time Stamp Counter (TSC) is a counter of each CPU core, incremented at a constant rate.
+//! Reading it is cheap, which makes it the source of the monotonic clock.
+//!
+//! Its frequency is not reported by every CPU, thus it is measured at boot against the PIT.
+//!
+//! The counters of all cores are assumed to be synchronized, which is the case on CPUs having an
+//! invariant TSC.
+
+use core::sync::atomic::AtomicU64;
+use core::sync::atomic::Ordering;
+use crate::cpu;
+use crate::pit;
+
+/// The duration of the calibration of the TSC, in microseconds.
+const CALIBRATION_US: u64 = 20000;
+
+/// The number of nanoseconds in a second.
+const NANOS_PER_SEC: u64 = 1000000000;
+
+/// The frequency of the TSC in Hertz. If zero, the TSC is not calibrated.
+static FREQUENCY: AtomicU64 = AtomicU64::new(0);
+/// The value of the TSC at the moment it has been calibrated, considered as the boot time.
+static BASE: AtomicU64 = AtomicU64::new(0);
+
+/// Measures the frequency of the TSC.
+/// This function must be called once at boot, on the bootstrap core, with interrupts disabled.
+pub fn init() {
+	let begin = cpu::rdtsc();
+	pit::udelay(CALIBRATION_US as _);
+	let end = cpu::rdtsc();
+
+	let frequency = (end - begin) * 1000000 / CALIBRATION_US;
+	if frequency == 0 {
+		return;
+	}
+
+	BASE.store(begin, Ordering::Relaxed);
+	FREQUENCY.store(frequency, Ordering::Release);
+}
+
+/// Tells whether the TSC is calibrated. If not, the clocks relying on it are not available.
+pub fn is_calibrated() -> bool {
+	FREQUENCY.load(Ordering::Acquire) != 0
+}
+
+/// Returns the frequency of the TSC in Hertz, or zero if not calibrated.
+pub fn get_frequency() -> u64 {
+	FREQUENCY.load(Ordering::Acquire)
+}
+
+/// Converts the number of TSC cycles `cycles` to nanoseconds.
+/// The TSC must be calibrated.
+pub fn cycles_to_ns(cycles: u64) -> u64 {
+	let frequency = get_frequency();
+	// Splitting the computation to avoid overflows
+	(cycles / frequency) * NANOS_PER_SEC + (cycles % frequency) * NANOS_PER_SEC / frequency
+}
+
+/// Converts the number of nanoseconds `ns` to TSC cycles.
+/// The TSC must be calibrated.
+pub fn ns_to_cycles(ns: u64) -> u64 {
+	let frequency = get_frequency();
+	// Splitting the computation to avoid overflows
+	(ns / NANOS_PER_SEC) * frequency + (ns % NANOS_PER_SEC) * frequency / NANOS_PER_SEC
+}
+
+/// Returns the value the TSC has at `ns` nanoseconds since boot.
+/// The TSC must be calibrated.
+pub fn ns_to_tsc(ns: u64) -> u64 {
+	BASE.load(Ordering::Relaxed) + ns_to_cycles(ns)
+}
+
+/// Returns the number of nanoseconds elapsed since boot. If the TSC is not calibrated, the
+/// function returns None.
+pub fn get_ns() -> Option<u64> {
+	if !is_calibrated() {
+		return None;
+	}
+
+	let cycles = cpu::rdtsc().saturating_sub(BASE.load(Ordering::Relaxed));
+	Some(cycles_to_ns(cycles))
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	#[test_case]
+	fn tsc_conversion0() {
+		if !is_calibrated() {
+			return;
+		}
+
+		for ns in [0, 1000, 999999999, 1000000000, 123456789012] {
+			let cycles = ns_to_cycles(ns);
+			let back = cycles_to_ns(cycles);
+			// The round trip loses at most one cycle
+			assert!(ns - back <= NANOS_PER_SEC / get_frequency() + 1);
+		}
+	}
+}
@@ -0,0 +1,410 @@
+//! Tracing records events happening in the kernel at static tracepoints, in a ring buffer of each
+//! CPU core. Tracepoints are compiled only with the `debug_trace` option.
+//!
+//! Recording an event doesn't take any lock nor allocate memory, which allows to place
+//! tracepoints anywhere, including in interrupt handlers and in the memory allocators:
+//! - the slot of an event is reserved atomically, which handles events recorded by interrupts
+//! preempting the recording of another event on the same core
+//! - each slot has a sequence number, which is cleared while the event is being written. Readers
+//! check it before and after copying an event, discarding the events being overwritten
+//!
+//! Each event is timestamped with the Time Stamp Counter. When the CPU has an architectural
+//! Performance Monitoring Unit, events also sample its first counter, programmed to count retired
+//! instructions.
+//!
+//! Events are read in the file `trace` of the procfs, which consumes them, or dumped on the serial
+//! port.
+
+use core::cell::UnsafeCell;
+use core::fmt::Write;
+use core::fmt;
+use core::mem::size_of;
+use core::ptr::null_mut;
+use core::ptr;
+use core::sync::atomic::AtomicBool;
+use core::sync::atomic::AtomicPtr;
+use core::sync::atomic::AtomicU32;
+use core::sync::atomic::Ordering;
+use core::sync::atomic;
+use crate::cpu::smp;
+use crate::cpu;
+use crate::device::serial;
+use crate::errno::Errno;
+use crate::memory::buddy;
+use crate::memory;
+use crate::util::lock::Mutex;
+use crate::util::math;
+
+/// The number of events in the ring buffer of each core. Must be a power of two.
+const RING_SIZE: usize = 4096;
+
+/// The Model Specific Register selecting the event counted by the first performance counter.
+const MSR_PERFEVTSEL0: u32 = 0x186;
+/// The Model Specific Register of the first performance counter.
+const MSR_PMC0: u32 = 0xc1;
+/// Performance event: instructions retired.
+const PERFEVT_INST_RETIRED: u64 = 0xc0;
+/// Performance event select flag: count in userspace.
+const PERFEVTSEL_USR: u64 = 1 << 16;
+/// Performance event select flag: count in kernelspace.
+const PERFEVTSEL_OS: u64 = 1 << 17;
+/// Performance event select flag: enable the counter.
+const PERFEVTSEL_EN: u64 = 1 << 22;
+
+/// The length of a line describing an event, when read.
+const LINE_MAX: usize = 96;
+
+/// The type of an event.
+#[derive(Clone, Copy, Debug, Eq, PartialEq)]
+#[repr(u32)]
+pub enum EventType {
+	/// A core switched to another process. Arguments: the PIDs of the previous and next processes
+	/// (zero if idle).
+	ContextSwitch,
+	/// A page fault happened. Arguments: the accessed address and the error code.
+	PageFault,
+	/// A process entered a system call. Arguments: the ID of the system call and its first
+	/// argument.
+	SyscallEnter,
+	/// A process returned from a system call. Arguments: the ID of the system call and its
+	/// return value.
+	SyscallExit,
+	/// A frame has been allocated by the buddy allocator. Arguments: the physical address and the
+	/// order.
+	BuddyAlloc,
+	/// A frame has been freed to the buddy allocator. Arguments: the physical address and the
+	/// order.
+	BuddyFree,
+	/// A request has been submitted to a storage device. Arguments: the offset of the first
+	/// block and the number of blocks, with the highest bit set for writes.
+	BlockSubmit,
+	/// A request to a storage device completed. Arguments: the offset of the first block and
+	/// whether the request failed.
+	BlockComplete,
+}
+
+impl EventType {
+	/// Returns the type for the given value. If invalid, the function returns None.
+	fn from_u32(val: u32) -> Option<Self> {
+		match val {
+			0 => Some(Self::ContextSwitch),
+			1 => Some(Self::PageFault),
+			2 => Some(Self::SyscallEnter),
+			3 => Some(Self::SyscallExit),
+			4 => Some(Self::BuddyAlloc),
+			5 => Some(Self::BuddyFree),
+			6 => Some(Self::BlockSubmit),
+			7 => Some(Self::BlockComplete),
+
+			_ => None,
+		}
+	}
+
+	/// Returns the name of the event type.
+	pub fn get_name(&self) -> &'static str {
+		match self {
+			Self::ContextSwitch => "context_switch",
+			Self::PageFault => "page_fault",
+			Self::SyscallEnter => "syscall_enter",
+			Self::SyscallExit => "syscall_exit",
+			Self::BuddyAlloc => "buddy_alloc",
+			Self::BuddyFree => "buddy_free",
+			Self::BlockSubmit => "block_submit",
+			Self::BlockComplete => "block_complete",
+		}
+	}
+}
+
+/// A recorded event.
+#[derive(Clone, Copy, Debug)]
+#[repr(C)]
+pub struct Event {
+	/// The value of the Time Stamp Counter when the event happened.
+	pub tsc: u64,
+	/// The value of the performance counter when the event happened, or zero if not available.
+	pub pmc: u64,
+	/// The type of the event.
+	pub kind: u32,
+	/// The first argument.
+	pub a: u32,
+	/// The second argument.
+	pub b: u32,
+}
+
+impl fmt::Display for Event {
+	fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+		let name = EventType::from_u32(self.kind)
+			.map(| kind | kind.get_name())
+			.unwrap_or("unknown");
+		write!(f, "{} {} {} {:x} {:x}", self.tsc, self.pmc, name, self.a, self.b)
+	}
+}
+
+/// A slot of a ring buffer.
+#[repr(C)]
+struct Slot {
+	/// The sequence number of the event in the slot plus one. If zero, the slot is empty or being
+	/// written.
+	seq: AtomicU32,
+	/// The event.
+	event: UnsafeCell<Event>,
+}
+
+/// The ring buffer of a core.
+#[repr(C)]
+struct Ring {
+	/// The sequence number of the next event to be recorded.
+	head: AtomicU32,
+	/// The sequence number of the next event to be read.
+	tail: AtomicU32,
+	/// The number of events overwritten before being read.
+	lost: AtomicU32,
+	/// The slots.
+	slots: [Slot; RING_SIZE],
+}
+
+/// The initial value of the pointer to a ring buffer.
+const RING_INIT: AtomicPtr<Ring> = AtomicPtr::new(null_mut());
+
+/// The ring buffer of each core. If null, the core doesn't record events.
+static RINGS: [AtomicPtr<Ring>; smp::MAX_CORES] = [RING_INIT; smp::MAX_CORES];
+
+/// Tells whether the CPU has a performance counter that can be sampled.
+static PMU: AtomicBool = AtomicBool::new(false);
+/// The bitmask of cores on which the performance counter has been programmed.
+static PMU_SETUP: AtomicU32 = AtomicU32::new(0);
+
+/// Lock ensuring that events are consumed by one reader at a time.
+static READ_LOCK: Mutex<()> = Mutex::new(());
+
+/// Returns the order of the frame holding a ring buffer.
+fn get_ring_order() -> buddy::FrameOrder {
+	let pages = math::ceil_division(size_of::<Ring>(), memory::PAGE_SIZE);
+	buddy::get_order(pages)
+}
+
+/// Allocates the ring buffers of the started cores, which enables tracing.
+/// If tracing is not compiled in, the function does nothing.
+pub fn init() -> Result<(), Errno> {
+	if !cfg!(config_debug_trace) {
+		return Ok(());
+	}
+
+	PMU.store(cpu::pmu_version() > 0, Ordering::Relaxed);
+
+	let order = get_ring_order();
+	for ring in RINGS.iter().take(smp::cores_count()) {
+		let ptr = buddy::alloc_kernel(order)? as *mut Ring;
+		unsafe { // Safe because the frame is large enough
+			ptr::write_bytes(ptr as *mut u8, 0, size_of::<Ring>());
+		}
+
+		ring.store(ptr, Ordering::Release);
+	}
+
+	Ok(())
+}
+
+/// Returns the value of the performance counter of the current core. If not available, the
+/// function returns zero.
+#[inline]
+fn sample_pmc(core: usize) -> u64 {
+	if !PMU.load(Ordering::Relaxed) {
+		return 0;
+	}
+
+	// The counter is programmed on the first event of each core
+	let mask = 1 << core;
+	if PMU_SETUP.load(Ordering::Relaxed) & mask == 0 {
+		PMU_SETUP.fetch_or(mask, Ordering::Relaxed);
+
+		unsafe { // Safe because the CPU has an architectural PMU
+			cpu::wrmsr(MSR_PMC0, 0);
+			cpu::wrmsr(MSR_PERFEVTSEL0,
+				PERFEVT_INST_RETIRED | PERFEVTSEL_USR | PERFEVTSEL_OS | PERFEVTSEL_EN);
+		}
+	}
+
+	cpu::rdpmc(0)
+}
+
+/// Records an event of type `kind` with the arguments `a` and `b` on the current core.
+/// If tracing is not compiled in or not initialized, the function does nothing.
+#[inline]
+pub fn record(kind: EventType, a: u32, b: u32) {
+	if !cfg!(config_debug_trace) {
+		return;
+	}
+
+	let core = smp::get_core_id();
+	let Some(ring) = RINGS.get(core) else {
+		return;
+	};
+	let ring = ring.load(Ordering::Acquire);
+	if ring.is_null() {
+		return;
+	}
+	let ring = unsafe { // Safe because ring buffers are never freed
+		&*ring
+	};
+
+	let seq = ring.head.fetch_add(1, Ordering::Relaxed);
+	let slot = &ring.slots[seq as usize % RING_SIZE];
+
+	slot.seq.store(0, Ordering::Relaxed);
+	atomic::fence(Ordering::Release);
+	unsafe { // Safe because the pointer is valid
+		ptr::write_volatile(slot.event.get(), Event {
+			tsc: cpu::rdtsc(),
+			pmc: sample_pmc(core),
+			kind: kind as _,
+			a,
+			b,
+		});
+	}
+	slot.seq.store(seq.wrapping_add(1), Ordering::Release);
+}
+
+/// Consumes the next event of the ring buffer `ring`. If no event is available, the function
+/// returns None.
+fn consume(ring: &Ring) -> Option<Event> {
+	loop {
+		let head = ring.head.load(Ordering::Acquire);
+		let mut tail = ring.tail.load(Ordering::Relaxed);
+		if tail == head {
+			return None;
+		}
+
+		// Skipping the events that have been overwritten
+		if head.wrapping_sub(tail) as usize > RING_SIZE {
+			let new_tail = head.wrapping_sub(RING_SIZE as _);
+			ring.lost.fetch_add(new_tail.wrapping_sub(tail), Ordering::Relaxed);
+			tail = new_tail;
+		}
+		ring.tail.store(tail.wrapping_add(1), Ordering::Relaxed);
+
+		let slot = &ring.slots[tail as usize % RING_SIZE];
+		let expected = tail.wrapping_add(1);
+		if slot.seq.load(Ordering::Acquire) != expected {
+			// The event is being written or has been overwritten
+			ring.lost.fetch_add(1, Ordering::Relaxed);
+			continue;
+		}
+		let event = unsafe { // Safe because the pointer is valid
+			ptr::read_volatile(slot.event.get())
+		};
+		atomic::fence(Ordering::Acquire);
+		if slot.seq.load(Ordering::Relaxed) != expected {
+			ring.lost.fetch_add(1, Ordering::Relaxed);
+			continue;
+		}
+
+		return Some(event);
+	}
+}
+
+/// Writer formatting into a fixed buffer, failing if the buffer is too small.
+struct LineWriter<'a> {
+	/// The buffer.
+	buf: &'a mut [u8],
+	/// The number of bytes written.
+	len: usize,
+}
+
+impl<'a> Write for LineWriter<'a> {
+	fn write_str(&mut self, s: &str) -> fmt::Result {
+		let end = self.len + s.len();
+		if end > self.buf.len() {
+			return Err(fmt::Error);
+		}
+
+		self.buf[self.len..end].copy_from_slice(s.as_bytes());
+		self.len = end;
+		Ok(())
+	}
+}
+
+/// Consumes events and writes them to `buf`, one per line with the format
+/// `<core> <tsc> <pmc> <event> <a> <b>`, where the arguments are in hexadecimal.
+/// Events are read core after core. Only whole lines are written.
+/// The function returns the number of bytes written. If no event is left, the function returns
+/// zero.
+pub fn read(buf: &mut [u8]) -> usize {
+	let _guard = READ_LOCK.lock();
+
+	let mut off = 0;
+	for (core, ring) in RINGS.iter().enumerate() {
+		let ring = ring.load(Ordering::Acquire);
+		if ring.is_null() {
+			continue;
+		}
+		let ring = unsafe { // Safe because ring buffers are never freed
+			&*ring
+		};
+
+		while buf.len() - off >= LINE_MAX {
+			let Some(event) = consume(ring) else {
+				break;
+			};
+
+			let mut line = LineWriter {
+				buf: &mut buf[off..(off + LINE_MAX)],
+				len: 0,
+			};
+			if writeln!(line, "{} {}", core, event).is_ok() {
+				off += line.len;
+			}
+		}
+	}
+
+	off
+}
+
+/// Returns the number of events that have been overwritten before being read, on every cores.
+pub fn get_lost_count() -> u32 {
+	RINGS.iter()
+		.map(| ring | ring.load(Ordering::Acquire))
+		.filter(| ring | !ring.is_null())
+		.map(| ring | unsafe { // Safe because ring buffers are never freed
+			(*ring).lost.load(Ordering::Relaxed)
+		})
+		.sum()
+}
+
+/// Consumes every events and writes them to the serial port COM1, each line prefixed with
+/// `trace `. If the port doesn't exist, the function does nothing.
+pub fn dump_serial() {
+	let Some(port) = serial::get(serial::COM1) else {
+		return;
+	};
+
+	let mut buf = [0; 1024];
+	loop {
+		let len = read(&mut buf);
+		if len == 0 {
+			break;
+		}
+
+		let mut guard = port.lock();
+		let serial = guard.get_mut();
+		for line in buf[..len].split_inclusive(| b | *b == b'\n') {
+			serial.write(b"trace ");
+			serial.write(line);
+		}
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	#[test_case]
+	fn trace_event_type0() {
+		let mut i = 0;
+		while let Some(kind) = EventType::from_u32(i) {
+			assert_eq!(kind as u32, i);
+			i += 1;
+		}
+		assert_eq!(i, EventType::BlockComplete as u32 + 1);
+	}
+}
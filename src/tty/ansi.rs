@@ -298,7 +298,6 @@ fn parse_csi(tty: &mut TTY) -> (ANSIState, usize) {
 		_ => ANSIState::Invalid,
 	};
 
-	tty.update();
 	(status, 2 + nbr_len + 1)
 }
 
@@ -322,33 +321,41 @@ fn parse(tty: &mut TTY) -> (ANSIState, usize) {
 }
 
 /// Handles an ANSI escape code stored into buffer `buffer` on the TTY `tty`.
-/// If the buffer doesn't begin with the ANSI escape character, the behaviour is undefined.
+/// If the ANSI buffer is empty and `buffer` doesn't begin with the ANSI escape character, the
+/// behaviour is undefined.
+/// The screen is not updated, the caller is responsible for it.
 /// The function returns the new state of the ANSI buffer and the number of bytes consumed by the
 /// function.
 pub fn handle(tty: &mut TTY, buffer: &[u8]) -> (ANSIState, usize) {
 	debug_assert!(!tty.ansi_buffer.is_empty() || buffer[0] == ESCAPE_CHAR as _);
+	let prev_len = tty.ansi_buffer.len();
 	let n = tty.ansi_buffer.push(buffer);
 
-	let (state, len) = parse(tty);
+	let (mut state, len) = parse(tty);
+	// A sequence that doesn't fit in the buffer cannot be valid
+	if matches!(state, ANSIState::Incomplete) && tty.ansi_buffer.is_full() {
+		state = ANSIState::Invalid;
+	}
+
 	match state {
 		ANSIState::Valid => {
-			for b in buffer.iter().skip(len) {
-				tty.putchar(*b);
-			}
-			tty.update();
 			tty.ansi_buffer.clear();
+			// The bytes following the sequence are left to the caller
+			(state, len.saturating_sub(prev_len))
 		},
 
 		ANSIState::Invalid => {
-			for b in buffer.iter() {
-				tty.putchar(*b);
-			}
-			tty.update();
+			// Printing the sequence as normal characters
+			let seq = tty.ansi_buffer.buffer;
+			let seq_len = tty.ansi_buffer.len();
 			tty.ansi_buffer.clear();
+
+			for c in &seq[..seq_len] {
+				tty.putchar(*c);
+			}
+			(state, n)
 		},
 
-		ANSIState::Incomplete => {},
+		ANSIState::Incomplete => (state, n),
 	}
-
-	(state, n)
 }
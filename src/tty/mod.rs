@@ -3,6 +3,12 @@
 //!
 //! At startup, the kernel has one TTY: the init TTY, which is stored separately because at the
 //! time of creation, memory management isn't initialized yet.
+//!
+//! The history of a TTY is a shadow of the screen. Writes update the history, then only the lines
+//! that changed are copied to the VGA buffer, once per write.
+//!
+//! The history is a ring of lines: when it is full, the oldest line is recycled as the new last
+//! line instead of moving the whole history.
 
 mod ansi;
 pub mod termios;
@@ -11,6 +17,8 @@ use core::cmp::*;
 use core::mem::MaybeUninit;
 use core::ptr;
 use crate::device::serial;
+use crate::file::epoll::EPOLLIN;
+use crate::file::epoll::PollQueue;
 use crate::memory::vmem;
 use crate::pit;
 use crate::process::Process;
@@ -60,13 +68,6 @@ pub struct WinSize {
 	pub ws_ypixel: u16,
 }
 
-/// Returns the position of the cursor in the history array from `x` and `y` position.
-fn get_history_offset(x: vga::Pos, y: vga::Pos) -> usize {
-	let off = (y * vga::WIDTH + x) as usize;
-	debug_assert!(off < HISTORY_SIZE);
-	off
-}
-
 /// Returns the position of a tab character for the given cursor X position.
 fn get_tab_size(cursor_x: vga::Pos) -> usize {
 	TAB_SIZE - ((cursor_x as usize) % TAB_SIZE)
@@ -89,9 +90,23 @@ pub struct TTY {
 
 	/// The content of the TTY's history
 	history: [vga::Char; HISTORY_SIZE],
+	/// The line of the history array at which the history begins.
+	history_begin: vga::Pos,
 	/// Tells whether TTY updates are enabled or not
 	update: bool,
 
+	/// The first line of the history that changed since the last update of the screen.
+	dirty_begin: vga::Pos,
+	/// The line following the last line of the history that changed since the last update of the
+	/// screen.
+	dirty_end: vga::Pos,
+	/// Tells whether the whole screen has to be updated.
+	redraw: bool,
+	/// The position of the cursor on screen at the last update.
+	shown_cursor: (vga::Pos, vga::Pos),
+	/// The value of `screen_y` at the last update of the screen.
+	shown_screen_y: vga::Pos,
+
 	/// The buffer containing characters from TTY input.
 	input_buffer: [u8; INPUT_MAX],
 	/// The current size of the input buffer.
@@ -110,6 +125,9 @@ pub struct TTY {
 
 	/// The size of the TTY.
 	winsize: WinSize,
+
+	/// The epoll watches registered on the TTY.
+	poll_queue: PollQueue,
 }
 
 /// The initialization TTY.
@@ -207,8 +225,15 @@ impl TTY {
 		self.current_color = vga::DEFAULT_COLOR;
 
 		self.history = [(vga::DEFAULT_COLOR as vga::Char) << 8; HISTORY_SIZE];
+		self.history_begin = 0;
 		self.update = true;
 
+		self.dirty_begin = HISTORY_LINES;
+		self.dirty_end = 0;
+		self.redraw = true;
+		self.shown_cursor = (-1, -1);
+		self.shown_screen_y = 0;
+
 		self.ansi_buffer = ansi::ANSIBuffer::new();
 
 		self.termios = Termios::default();
@@ -219,6 +244,8 @@ impl TTY {
 			ws_xpixel: vga::PIXEL_WIDTH as _,
 			ws_ypixel: vga::PIXEL_HEIGHT as _,
 		};
+
+		self.poll_queue = PollQueue::new();
 	}
 
 	/// Returns the id of the TTY.
@@ -226,33 +253,69 @@ impl TTY {
 		self.id
 	}
 
+	/// Returns the offset in the history array of the character at position `x` and `y` in the
+	/// history.
+	fn get_history_offset(&self, x: vga::Pos, y: vga::Pos) -> usize {
+		let off = (y * vga::WIDTH + x) as usize;
+		debug_assert!(off < HISTORY_SIZE);
+		(self.history_begin as usize * vga::WIDTH as usize + off) % HISTORY_SIZE
+	}
+
+	/// Marks the lines from `begin` to `end` (exclusive) of the history as changed, so that they
+	/// are copied to the screen on the next update.
+	fn mark_dirty(&mut self, begin: vga::Pos, end: vga::Pos) {
+		self.dirty_begin = min(self.dirty_begin, begin);
+		self.dirty_end = max(self.dirty_end, end);
+	}
+
 	/// Updates the TTY to the screen.
+	/// Only the lines that changed since the last update are copied.
 	pub fn update(&mut self) {
 		let current_tty = *CURRENT_TTY.lock().get();
 		if self.id != current_tty || !self.update {
 			return;
 		}
 
-		let buff = &self.history[get_history_offset(0, self.screen_y)];
-		unsafe {
-			vmem::write_lock_wrap(|| {
-				ptr::copy_nonoverlapping(buff as *const vga::Char,
-					vga::get_buffer_virt() as *mut vga::Char,
-					(vga::WIDTH as usize) * (vga::HEIGHT as usize));
-			});
+		// If the screen scrolled, every line moved
+		let (begin, end) = if self.redraw || self.screen_y != self.shown_screen_y {
+			(0, vga::HEIGHT)
+		} else {
+			(max(self.dirty_begin - self.screen_y, 0), min(self.dirty_end - self.screen_y,
+				vga::HEIGHT))
+		};
+		if begin < end {
+			unsafe {
+				vmem::write_lock_wrap(|| {
+					for y in begin..end {
+						let off = self.get_history_offset(0, self.screen_y + y);
+						ptr::copy_nonoverlapping(&self.history[off] as *const vga::Char,
+							vga::get_buffer_virt().add((y * vga::WIDTH) as usize),
+							vga::WIDTH as usize);
+					}
+				});
+			}
+		}
+		self.dirty_begin = HISTORY_LINES;
+		self.dirty_end = 0;
+		self.redraw = false;
+		self.shown_screen_y = self.screen_y;
+
+		let cursor = (self.cursor_x, self.cursor_y - self.screen_y);
+		if cursor != self.shown_cursor {
+			vga::move_cursor(cursor.0, cursor.1);
+			self.shown_cursor = cursor;
 		}
-
-		let y = self.cursor_y - self.screen_y;
-		vga::move_cursor(self.cursor_x, y);
 	}
 
 	/// Shows the TTY on screen.
 	pub fn show(&mut self) {
 		// Updating cursor
 		vga::move_cursor(self.cursor_x, self.cursor_y - self.screen_y);
+		self.shown_cursor = (self.cursor_x, self.cursor_y - self.screen_y);
 		vga::enable_cursor();
 
-		// Updating text
+		// Updating text. Another TTY might have been displayed in the meantime
+		self.redraw = true;
 		self.update();
 	}
 
@@ -306,9 +369,10 @@ impl TTY {
 		self.cursor_x = 0;
 		self.cursor_y = 0;
 		self.screen_y = 0;
-		for i in 0..self.history.len() {
-			self.history[i] = (vga::DEFAULT_COLOR as vga::Char) << 8;
-		}
+		self.history.fill(EMPTY_CHAR);
+		self.history_begin = 0;
+
+		self.redraw = true;
 		self.update();
 	}
 
@@ -343,16 +407,16 @@ impl TTY {
 		}
 
 		if self.screen_y + vga::HEIGHT > HISTORY_LINES {
-			let diff = ((self.screen_y + vga::HEIGHT - HISTORY_LINES) * vga::WIDTH) as usize;
-			let size = self.history.len() - diff;
-			for i in 0..size {
-				self.history[i] = self.history[diff + i];
-			}
-			for i in size..self.history.len() {
-				self.history[i] = (vga::DEFAULT_COLOR as vga::Char) << 8;
+			let diff = min(self.screen_y + vga::HEIGHT - HISTORY_LINES, HISTORY_LINES);
+			// Recycling the oldest lines as the new last lines
+			for _ in 0..diff {
+				let off = self.get_history_offset(0, 0);
+				self.history[off..(off + vga::WIDTH as usize)].fill(EMPTY_CHAR);
+				self.history_begin = (self.history_begin + 1) % HISTORY_LINES;
 			}
 
 			self.screen_y = HISTORY_LINES - vga::HEIGHT;
+			self.redraw = true;
 		}
 
 		debug_assert!(self.cursor_x >= 0);
@@ -426,26 +490,36 @@ impl TTY {
 
 			_ => {
 				let tty_char = (c as vga::Char) | ((self.current_color as vga::Char) << 8);
-				let pos = get_history_offset(self.cursor_x, self.cursor_y);
+				let pos = self.get_history_offset(self.cursor_x, self.cursor_y);
 				self.history[pos] = tty_char;
+				self.mark_dirty(self.cursor_y, self.cursor_y + 1);
 				self.cursor_forward(1, 0);
 			}
 		}
 	}
 
 	/// Writes string `buffer` to TTY.
+	/// The screen is updated once, after the whole buffer has been processed.
 	pub fn write(&mut self, buffer: &[u8]) {
 		let mut i = 0;
 
 		while i < buffer.len() {
-			let c = buffer[i];
-			if c == ansi::ESCAPE_CHAR {
-				let (_, j) = ansi::handle(self, &buffer[i..buffer.len()]);
+			// An escape sequence might have been split across writes
+			if buffer[i] == ansi::ESCAPE_CHAR || !self.ansi_buffer.is_empty() {
+				let (_, j) = ansi::handle(self, &buffer[i..]);
 				i += j;
-			} else {
-				self.putchar(c);
-				i += 1;
+				continue;
 			}
+
+			// Printing the run of characters preceding the next escape sequence
+			let end = buffer[i..].iter()
+				.position(| c | *c == ansi::ESCAPE_CHAR)
+				.map(| j | i + j)
+				.unwrap_or(buffer.len());
+			for c in &buffer[i..end] {
+				self.putchar(*c);
+			}
+			i = end;
 		}
 
 		// TODO Add a compilation and/or runtime option for this
@@ -456,6 +530,11 @@ impl TTY {
 		self.update();
 	}
 
+	/// Returns the queue of the epoll watches registered on the TTY.
+	pub fn get_poll_queue(&mut self) -> &mut PollQueue {
+		&mut self.poll_queue
+	}
+
 	/// Returns the number of bytes available to be read from the TTY.
 	pub fn get_available_size(&self) -> usize {
 		self.available_size
@@ -489,6 +568,7 @@ impl TTY {
 	// TODO Implement IUTF8
 	/// Takes the given string `buffer` as input, making it available from the terminal input.
 	pub fn input(&mut self, buffer: &[u8]) {
+		let prev_available = self.available_size;
 		// The length to write to the input buffer
 		let len = min(buffer.len(), self.input_buffer.len() - self.input_size);
 		// The slice containing the input
@@ -567,6 +647,9 @@ impl TTY {
 			// Making the input available for reading
 			self.available_size = self.input_size;
 		}
+		if self.available_size > prev_available {
+			self.poll_queue.notify(EPOLLIN);
+		}
 
 		// Sending signals if enabled
 		if self.termios.c_lflag & termios::ISIG != 0 {
@@ -596,10 +679,12 @@ impl TTY {
 				// TODO Handle tab characters
 				self.cursor_backward(count, 0);
 
-				let begin = get_history_offset(self.cursor_x, self.cursor_y);
+				let begin = self.get_history_offset(self.cursor_x, self.cursor_y);
 				for i in begin..(begin + count) {
-					self.history[i] = EMPTY_CHAR;
+					self.history[i % HISTORY_SIZE] = EMPTY_CHAR;
 				}
+				let end = self.cursor_y + (self.cursor_x + count as vga::Pos) / vga::WIDTH + 1;
+				self.mark_dirty(self.cursor_y, end);
 				self.update();
 			}
 
@@ -672,3 +757,85 @@ impl TTY {
 		self.send_signal(Signal::SIGWINCH);
 	}
 }
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	/// The TTY used by tests. It is too large to be placed on the stack.
+	static mut TEST_TTY: MaybeUninit<TTY> = MaybeUninit::uninit();
+
+	/// Returns the test TTY, reinitialized. The TTY is never shown, thus updates don't write to
+	/// the screen.
+	fn get_test_tty() -> &'static mut TTY {
+		let tty = unsafe {
+			TEST_TTY.assume_init_mut()
+		};
+		tty.init(Some(usize::MAX));
+		tty
+	}
+
+	/// Returns the character at position `x` and `y` of the history of `tty`.
+	fn get_char(tty: &TTY, x: vga::Pos, y: vga::Pos) -> u8 {
+		(tty.history[tty.get_history_offset(x, y)] & 0xff) as _
+	}
+
+	#[test_case]
+	fn tty_scroll_history0() {
+		let tty = get_test_tty();
+		tty.redraw = false;
+
+		// Each line begins with a different letter
+		let count = HISTORY_LINES as usize + 10;
+		for i in 0..count {
+			tty.write(&[b'a' + (i % 26) as u8, b'\n']);
+		}
+
+		assert_eq!(tty.cursor_x, 0);
+		assert_eq!(tty.cursor_y, HISTORY_LINES - 1);
+		assert_eq!(tty.screen_y, HISTORY_LINES - vga::HEIGHT);
+		// Since every line moved, the whole screen has to be redrawn
+		assert!(tty.redraw);
+
+		// The oldest lines have been recycled, and the last line is empty
+		let first = count - (HISTORY_LINES as usize - 1);
+		for y in 0..(HISTORY_LINES - 1) {
+			assert_eq!(get_char(tty, 0, y), b'a' + ((first + y as usize) % 26) as u8);
+		}
+		let off = tty.get_history_offset(0, HISTORY_LINES - 1);
+		assert!(tty.history[off..(off + vga::WIDTH as usize)].iter().all(| c | *c == EMPTY_CHAR));
+	}
+
+	#[test_case]
+	fn tty_ansi_split0() {
+		let tty = get_test_tty();
+
+		tty.write(b"\x1b[3");
+		assert_eq!(tty.ansi_buffer.len(), 3);
+		assert_eq!(tty.cursor_x, 0);
+		// Nothing changed on screen
+		assert!(tty.dirty_begin >= tty.dirty_end);
+
+		tty.write(b"1mX");
+		assert!(tty.ansi_buffer.is_empty());
+		assert_eq!(tty.current_color & 0x7f, vga::COLOR_RED);
+		assert_eq!(tty.cursor_x, 1);
+		let c = tty.history[tty.get_history_offset(0, 0)];
+		assert_eq!(c, (b'X' as vga::Char) | ((tty.current_color as vga::Char) << 8));
+		assert_eq!((tty.dirty_begin, tty.dirty_end), (0, 1));
+	}
+
+	#[test_case]
+	fn tty_ansi_invalid0() {
+		let tty = get_test_tty();
+
+		// `q` is not a valid final byte
+		tty.write(b"\x1b[5qX");
+		assert!(tty.ansi_buffer.is_empty());
+		assert_eq!(tty.current_color, vga::DEFAULT_COLOR);
+		assert_eq!(tty.cursor_x, 5);
+		for (x, c) in b"\x1b[5qX".iter().enumerate() {
+			assert_eq!(get_char(tty, x as _, 0), *c);
+		}
+	}
+}
@@ -0,0 +1,332 @@
+//! An interval tree stores disjoint intervals of integers, each associated with a value. The tree
+//! is an AVL tree sorted by the beginning of the intervals.
+//!
+//! Each node is augmented with the size of the largest interval in its subtree, which allows to
+//! find the first interval that is large enough in logarithmic time.
+
+use core::cmp::Ordering;
+use core::cmp::max;
+use crate::errno::Errno;
+use crate::util::FailableClone;
+use crate::util::boxed::Box;
+
+/// A node of the interval tree.
+struct Node<V> {
+	/// The beginning of the interval.
+	begin: usize,
+	/// The size of the interval.
+	size: usize,
+	/// The value associated with the interval.
+	value: V,
+
+	/// The height of the subtree.
+	height: usize,
+	/// The size of the largest interval in the subtree.
+	max_size: usize,
+
+	/// The left child.
+	left: Option<Box<Node<V>>>,
+	/// The right child.
+	right: Option<Box<Node<V>>>,
+}
+
+impl<V> Node<V> {
+	/// Returns the height of the subtree `node`.
+	fn height(node: &Option<Box<Self>>) -> usize {
+		node.as_ref().map(| n | n.height).unwrap_or(0)
+	}
+
+	/// Returns the size of the largest interval in the subtree `node`.
+	fn max_size(node: &Option<Box<Self>>) -> usize {
+		node.as_ref().map(| n | n.max_size).unwrap_or(0)
+	}
+
+	/// Updates the height and largest interval size of the node from its children.
+	fn update(&mut self) {
+		self.height = max(Self::height(&self.left), Self::height(&self.right)) + 1;
+		self.max_size = max(self.size, max(Self::max_size(&self.left),
+			Self::max_size(&self.right)));
+	}
+
+	/// Clones the subtree `node`.
+	fn clone_subtree(node: &Option<Box<Self>>) -> Result<Option<Box<Self>>, Errno>
+		where V: FailableClone {
+		let Some(n) = node else {
+			return Ok(None);
+		};
+
+		Ok(Some(Box::new(Self {
+			begin: n.begin,
+			size: n.size,
+			value: n.value.failable_clone()?,
+
+			height: n.height,
+			max_size: n.max_size,
+
+			left: Self::clone_subtree(&n.left)?,
+			right: Self::clone_subtree(&n.right)?,
+		})?))
+	}
+}
+
+/// Rotates the subtree `slot` to the left.
+fn rotate_left<V>(slot: &mut Option<Box<Node<V>>>) {
+	let mut n = slot.take().unwrap();
+	let mut r = n.right.take().unwrap();
+	n.right = r.left.take();
+	n.update();
+	r.left = Some(n);
+	r.update();
+	*slot = Some(r);
+}
+
+/// Rotates the subtree `slot` to the right.
+fn rotate_right<V>(slot: &mut Option<Box<Node<V>>>) {
+	let mut n = slot.take().unwrap();
+	let mut l = n.left.take().unwrap();
+	n.left = l.right.take();
+	n.update();
+	l.right = Some(n);
+	l.update();
+	*slot = Some(l);
+}
+
+/// Updates the root of the subtree `slot` and rebalances it if necessary.
+fn rebalance<V>(slot: &mut Option<Box<Node<V>>>) {
+	let Some(n) = slot.as_mut() else {
+		return;
+	};
+	n.update();
+
+	let left = Node::height(&n.left);
+	let right = Node::height(&n.right);
+	if left > right + 1 {
+		let l = n.left.as_ref().unwrap();
+		if Node::height(&l.left) < Node::height(&l.right) {
+			rotate_left(&mut n.left);
+		}
+		rotate_right(slot);
+	} else if right > left + 1 {
+		let r = n.right.as_ref().unwrap();
+		if Node::height(&r.right) < Node::height(&r.left) {
+			rotate_right(&mut n.right);
+		}
+		rotate_left(slot);
+	}
+}
+
+/// Inserts the node `node` in the subtree `slot`.
+fn insert_node<V>(slot: &mut Option<Box<Node<V>>>, node: Box<Node<V>>) {
+	if let Some(n) = slot {
+		if node.begin < n.begin {
+			insert_node(&mut n.left, node);
+		} else {
+			insert_node(&mut n.right, node);
+		}
+	} else {
+		*slot = Some(node);
+		return;
+	}
+
+	rebalance(slot);
+}
+
+/// Removes the node with the lowest interval from the subtree `slot`, which must not be empty.
+fn remove_min<V>(slot: &mut Option<Box<Node<V>>>) -> Box<Node<V>> {
+	let n = slot.as_mut().unwrap();
+	if n.left.is_some() {
+		let min = remove_min(&mut n.left);
+		rebalance(slot);
+		min
+	} else {
+		let mut n = slot.take().unwrap();
+		*slot = n.right.take();
+		n
+	}
+}
+
+/// Removes the node of the interval beginning at `begin` from the subtree `slot`.
+fn remove_node<V>(slot: &mut Option<Box<Node<V>>>, begin: usize) -> Option<Box<Node<V>>> {
+	let n = slot.as_mut()?;
+	let removed = match begin.cmp(&n.begin) {
+		Ordering::Less => remove_node(&mut n.left, begin),
+		Ordering::Greater => remove_node(&mut n.right, begin),
+
+		Ordering::Equal => {
+			let mut n = slot.take().unwrap();
+			*slot = match (n.left.take(), n.right.take()) {
+				(None, right) => right,
+				(left, None) => left,
+
+				(left, mut right) => {
+					let mut min = remove_min(&mut right);
+					min.left = left;
+					min.right = right;
+					Some(min)
+				},
+			};
+
+			Some(n)
+		},
+	};
+
+	rebalance(slot);
+	removed
+}
+
+/// Returns the node of the interval containing `val` in the subtree `node`.
+fn get_containing<V>(mut node: &Option<Box<Node<V>>>, val: usize) -> Option<&Node<V>> {
+	while let Some(n) = node {
+		if val < n.begin {
+			node = &n.left;
+		} else if val - n.begin < n.size {
+			return Some(n);
+		} else {
+			node = &n.right;
+		}
+	}
+
+	None
+}
+
+/// Calls `f` for each node of the subtree `node`, in order.
+fn foreach<V, F: FnMut(usize, usize, &V)>(node: &Option<Box<Node<V>>>, f: &mut F) {
+	if let Some(n) = node {
+		foreach(&n.left, f);
+		f(n.begin, n.size, &n.value);
+		foreach(&n.right, f);
+	}
+}
+
+/// A tree of disjoint intervals.
+pub struct IntervalTree<V> {
+	/// The root of the tree.
+	root: Option<Box<Node<V>>>,
+	/// The number of intervals in the tree.
+	count: usize,
+}
+
+impl<V> IntervalTree<V> {
+	/// Creates a new empty tree.
+	pub const fn new() -> Self {
+		Self {
+			root: None,
+			count: 0,
+		}
+	}
+
+	/// Returns the number of intervals in the tree.
+	pub fn count(&self) -> usize {
+		self.count
+	}
+
+	/// Tells whether the tree is empty.
+	pub fn is_empty(&self) -> bool {
+		self.root.is_none()
+	}
+
+	/// Inserts the interval beginning at `begin` of size `size` with value `value`.
+	/// The interval must not overlap an interval already in the tree.
+	/// The function has complexity `O(log n)`.
+	pub fn insert(&mut self, begin: usize, size: usize, value: V) -> Result<(), Errno> {
+		debug_assert!(self.get_containing(begin).is_none());
+
+		let node = Box::new(Node {
+			begin,
+			size,
+			value,
+
+			height: 1,
+			max_size: size,
+
+			left: None,
+			right: None,
+		})?;
+		insert_node(&mut self.root, node);
+		self.count += 1;
+
+		Ok(())
+	}
+
+	/// Removes the interval beginning at `begin` and returns its value. If the interval doesn't
+	/// exist, the function returns None.
+	/// The function has complexity `O(log n)`.
+	pub fn remove(&mut self, begin: usize) -> Option<V> {
+		let node = remove_node(&mut self.root, begin)?;
+		self.count -= 1;
+
+		Some(node.take().value)
+	}
+
+	/// Returns the value of the interval containing `val`. If no interval contains it, the
+	/// function returns None.
+	pub fn get_containing(&self, val: usize) -> Option<&V> {
+		get_containing(&self.root, val).map(| n | &n.value)
+	}
+
+	/// Returns the value of the lowest interval whose size is at least `size`. If no interval is
+	/// large enough, the function returns None.
+	/// The function has complexity `O(log n)`.
+	pub fn get_first_fit(&self, size: usize) -> Option<&V> {
+		let mut node = &self.root;
+
+		while let Some(n) = node {
+			if Node::max_size(&n.left) >= size {
+				node = &n.left;
+			} else if n.size >= size {
+				return Some(&n.value);
+			} else if Node::max_size(&n.right) >= size {
+				node = &n.right;
+			} else {
+				break;
+			}
+		}
+
+		None
+	}
+
+	/// Calls `f` for each interval of the tree in order, with the beginning, size and value of the
+	/// interval.
+	pub fn foreach<F: FnMut(usize, usize, &V)>(&self, mut f: F) {
+		foreach(&self.root, &mut f);
+	}
+}
+
+impl<V: FailableClone> FailableClone for IntervalTree<V> {
+	fn failable_clone(&self) -> Result<Self, Errno> {
+		Ok(Self {
+			root: Node::clone_subtree(&self.root)?,
+			count: self.count,
+		})
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	#[test_case]
+	fn interval_tree0() {
+		let mut tree = IntervalTree::new();
+		for i in 0..64 {
+			tree.insert(i * 10, (i % 8) + 1, i).unwrap();
+		}
+		assert_eq!(tree.count(), 64);
+
+		assert_eq!(tree.get_containing(125), Some(&12));
+		assert_eq!(tree.get_containing(129), None);
+		assert_eq!(tree.get_first_fit(8), Some(&7));
+
+		for i in (0..64).step_by(8) {
+			assert_eq!(tree.remove((i + 7) * 10), Some(i + 7));
+		}
+		assert_eq!(tree.get_first_fit(8), None);
+		assert_eq!(tree.get_first_fit(7), Some(&6));
+
+		let mut prev = None;
+		tree.foreach(| begin, _, _ | {
+			assert!(prev.map(| p | p < begin).unwrap_or(true));
+			prev = Some(begin);
+		});
+	}
+}
@@ -4,13 +4,14 @@ use core::cmp::Ordering;
 use core::cmp::max;
 use core::fmt;
 use core::mem::ManuallyDrop;
+use core::mem::align_of;
 use core::mem::size_of;
 use core::mem;
 use core::ptr::NonNull;
 use core::ptr::drop_in_place;
 use core::ptr;
 use crate::errno::Errno;
-use crate::memory::malloc;
+use crate::memory::slab;
 use crate::memory;
 use crate::util::FailableClone;
 
@@ -66,7 +67,7 @@ impl<K: 'static + Ord, V: 'static> Node<K, V> {
 	/// Creates a new node with the given `value`. The node is colored Red by default.
 	pub fn new(key: K, value: V) -> Result<NonNull<Self>, Errno> {
 		let ptr = unsafe {
-			malloc::alloc(size_of::<Self>())? as *mut Self
+			slab::alloc(size_of::<Self>(), align_of::<Self>())?.as_ptr() as *mut Self
 		};
 		let s = Self {
 			parent: None,
@@ -534,20 +535,25 @@ impl<K: 'static + Ord, V: 'static> Map<K, V> {
 		None
 	}
 
-	/// Searches in the tree for a key greater or equal to the given key.
+	/// Searches in the tree for the lowest key greater or equal to the given key.
 	/// `key` is the key to find.
 	pub fn get_min<'a>(&'a self, key: K) -> Option<(&'a K, &'a V)> {
 		let mut node = self.get_root();
+		let mut result = None;
 
 		while let Some(n) = node {
-			if key.cmp(&n.key) == Ordering::Greater {
-				node = n.get_right();
-			} else {
-				return Some((&n.key, &n.value));
+			match key.cmp(&n.key) {
+				Ordering::Greater => node = n.get_right(),
+				Ordering::Equal => return Some((&n.key, &n.value)),
+
+				Ordering::Less => {
+					result = Some((&n.key, &n.value));
+					node = n.get_left();
+				},
 			}
 		}
 
-		None
+		result
 	}
 
 	// TODO get_max?
@@ -703,7 +709,7 @@ impl<K: 'static + Ord, V: 'static> Map<K, V> {
 		drop_in_place(&mut n.color);
 		drop_in_place(&mut n.key);
 
-		malloc::free(ptr);
+		slab::free(ptr, size_of::<Node<K, V>>(), align_of::<Node<K, V>>());
 	}
 
 	/// Returns the leftmost node in the tree.
@@ -1211,7 +1217,8 @@ impl<K: 'static + Ord, V> Drop for Map<K, V> {
 			}, &mut | n | {
 				unsafe {
 					drop_in_place(&mut n.value);
-					malloc::free(n as *mut _ as *mut _);
+					slab::free(n as *mut _ as *mut _, size_of::<Node<K, V>>(),
+						align_of::<Node<K, V>>());
 				}
 			}, TraversalType::PostOrder);
 		}
@@ -4,6 +4,7 @@
 pub mod bitfield;
 pub mod hashmap;
 pub mod id_allocator;
+pub mod interval_tree;
 pub mod map;
 pub mod ring_buffer;
 pub mod string;
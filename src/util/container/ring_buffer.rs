@@ -86,15 +86,11 @@ impl<T: Default + Copy> RingBuffer<T> {
 
 		// The length of the first read, before going back to the beginning of the buffer
 		let l0 = min(cursor + len, buffer_size) - cursor;
-		for i in 0..l0 {
-			buf[i] = buffer[cursor + i];
-		}
+		buf[..l0].copy_from_slice(&buffer[cursor..(cursor + l0)]);
 
 		// The length of the second read, from the beginning of the buffer
 		let l1 = len - l0;
-		for i in 0..l1 {
-			buf[l0 + i] = buffer[i];
-		}
+		buf[l0..len].copy_from_slice(&buffer[..l1]);
 
 		self.read_cursor = (self.read_cursor + len) % buffer_size;
 		len
@@ -110,15 +106,11 @@ impl<T: Default + Copy> RingBuffer<T> {
 
 		// The length of the first read, before going back to the beginning of the buffer
 		let l0 = min(cursor + len, buffer_size) - cursor;
-		for i in 0..l0 {
-			buffer[cursor + i] = buf[i];
-		}
+		buffer[cursor..(cursor + l0)].copy_from_slice(&buf[..l0]);
 
 		// The length of the second read, from the beginning of the buffer
 		let l1 = len - l0;
-		for i in 0..l1 {
-			buffer[i] = buf[l0 + i];
-		}
+		buffer[..l1].copy_from_slice(&buf[l0..len]);
 
 		self.write_cursor = (self.write_cursor + len) % buffer_size;
 		len
@@ -189,18 +189,7 @@ impl PartialEq for String {
 
 impl PartialEq<str> for String {
 	fn eq(&self, other: &str) -> bool {
-		if self.len() != other.len() {
-			return false;
-		}
-
-		let bytes = other.as_bytes();
-		for i in 0..bytes.len() {
-			if self.data[i] != bytes[i] {
-				return false;
-			}
-		}
-
-		true
+		self.as_bytes() == other.as_bytes()
 	}
 }
 
@@ -238,6 +227,16 @@ impl fmt::Display for String {
 	}
 }
 
+impl fmt::Write for String {
+	fn write_str(&mut self, s: &str) -> fmt::Result {
+		for b in s.bytes() {
+			self.push(b).map_err(|_| fmt::Error)?;
+		}
+
+		Ok(())
+	}
+}
+
 #[cfg(test)]
 mod test {
 	use super::*;
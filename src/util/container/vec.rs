@@ -298,6 +298,21 @@ impl<T> Vec<T> {
 		}
 	}
 
+	/// Retains only the elements for which `f` returns true, keeping their order. The other
+	/// elements are dropped.
+	pub fn retain<F: FnMut(&T) -> bool>(&mut self, mut f: F) {
+		let mut len = 0;
+		let slice = self.as_mut_slice();
+		for i in 0..slice.len() {
+			if f(&slice[i]) {
+				slice.swap(i, len);
+				len += 1;
+			}
+		}
+
+		self.truncate(len);
+	}
+
 	/// Clears the vector, removing all values.
 	pub fn clear(&mut self) {
 		for e in self.as_mut_slice() {
@@ -342,17 +357,8 @@ impl<T> DerefMut for Vec<T> {
 
 impl<T: PartialEq> PartialEq for Vec<T> {
 	fn eq(&self, other: &Vec::<T>) -> bool {
-		if self.len() != other.len() {
-			return false;
-		}
-
-		for i in 0..self.len() {
-			if self[i] != other[i] {
-				return false;
-			}
-		}
-
-		true
+		// Comparing slices allows the comparison of bytes to use `memcmp`
+		self.as_slice() == other.as_slice()
 	}
 }
 
@@ -762,6 +768,17 @@ mod test {
 		assert_eq!(v.len(), 0);
 	}
 
+	#[test_case]
+	fn vec_retain0() {
+		let mut v = Vec::<usize>::new();
+		for i in 0..10 {
+			v.push(i).unwrap();
+		}
+
+		v.retain(| i | i % 3 != 0);
+		assert_eq!(v.as_slice(), &[1, 2, 4, 5, 7, 8]);
+	}
+
 	// TODO Test resize
 
 	// TODO Test range functions
@@ -5,26 +5,12 @@
 
 void bzero(void *s, size_t n)
 {
-	// The end of the memory to be written
-	void *end;
-	// The end of the aligned portion of memory to be written
-	void *align_end;
-
-	end = s + n;
-	align_end = DOWN_ALIGN(end, sizeof(long));
-	while (s < end && !IS_ALIGNED(s, sizeof(long)))
-	{
-		*((volatile char *) s) = 0;
-		s += sizeof(char);
-	}
-	while (s < align_end)
-	{
-		*((volatile long *) s) = 0;
-		s += sizeof(long);
-	}
-	while (s < end)
-	{
-		*((volatile char *) s) = 0;
-		s += sizeof(char);
-	}
+	if (n >= nt_threshold)
+		memset_nt(s, 0, n);
+	else if (n >= erms_threshold)
+		memset_erms(s, 0, n);
+	else if (n >= sse2_threshold)
+		memset_sse2(s, 0, n);
+	else
+		memset_word(s, 0, n);
 }
@@ -0,0 +1,43 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libc.h"
+
+/*
+ * The features of the CPU, as a combination of `LIBC_FEATURE_*` flags.
+ */
+uint32_t libc_features = 0;
+
+/*
+ * The size in bytes from which the SSE2 variants are used. Until `libc_init`
+ * is called, the CPU's features are unknown and only the word variants are
+ * used.
+ */
+size_t sse2_threshold = SIZE_MAX;
+/*
+ * The size in bytes from which the ERMS variants are used.
+ */
+size_t erms_threshold = SIZE_MAX;
+/*
+ * The size in bytes from which the non-temporal variants are used.
+ */
+size_t nt_threshold = SIZE_MAX;
+
+/*
+ * Selects the variants of the memory functions according to the given
+ * `features` of the CPU, which is a combination of `LIBC_FEATURE_*` flags.
+ *
+ * This function must be called only once, at boot, after SSE has been
+ * enabled.
+ */
+void libc_init(uint32_t features)
+{
+	libc_features = features;
+	if (features & LIBC_FEATURE_SSE2)
+	{
+		sse2_threshold = SSE2_THRESHOLD;
+		nt_threshold = NT_THRESHOLD;
+	}
+	if (features & LIBC_FEATURE_ERMS)
+		erms_threshold = ERMS_THRESHOLD;
+}
@@ -1,5 +1,10 @@
 // This file implements basic libc functions necessary for the kernel's inner
 // workings.
+//
+// Some functions have several variants, each one using a different set of
+// instructions. The fastest variant for the size of the operation is selected
+// at runtime according to the features of the CPU, which are given once at
+// boot to `libc_init`.
 
 #ifndef LIBC_H
 # define LIBC_H
@@ -16,12 +21,69 @@
 # define DOWN_ALIGN(ptr, n)\
 	(typeof(ptr)) ((intptr_t) (ptr) & ~((intptr_t) ((n) - 1)))
 
-// TODO Add support for SSE instructions if the CPU supports them
+// libc feature flag: the CPU supports SSE2 instructions.
+# define LIBC_FEATURE_SSE2	0b01
+// libc feature flag: the CPU supports Enhanced REP MOVSB/STOSB (ERMS).
+# define LIBC_FEATURE_ERMS	0b10
 
+// The default size in bytes from which the SSE2 variants are used.
+# define SSE2_THRESHOLD	64
+// The default size in bytes from which the ERMS variants are used. Below this
+// size, the startup cost of `rep movsb`/`rep stosb` is higher than the gain.
+# define ERMS_THRESHOLD	2048
+// The default size in bytes from which the non-temporal variants are used.
+// Operations this large would evict most of the caches' content anyways.
+# define NT_THRESHOLD	(1024 * 1024)
+
+// The size of a page of memory in bytes.
+# define PAGE_SIZE	4096
+
+// Attribute for functions that use SSE2 instructions. Such functions must be
+// called only if the CPU supports SSE2.
+# define SSE2_FN	__attribute__((target("sse2")))
+
+// The features of the CPU given to `libc_init`.
+extern uint32_t libc_features;
+
+// The size in bytes from which the SSE2 variants are used.
+extern size_t sse2_threshold;
+// The size in bytes from which the ERMS variants are used.
+extern size_t erms_threshold;
+// The size in bytes from which the non-temporal variants are used.
+extern size_t nt_threshold;
+
+void libc_init(uint32_t features);
+
+void *memcpy_word(void *dest, const void *src, size_t n);
+void *memcpy_sse2(void *dest, const void *src, size_t n);
+void *memcpy_erms(void *dest, const void *src, size_t n);
+void *memcpy_nt(void *dest, const void *src, size_t n);
 void *memcpy(void *dest, const void *src, size_t n);
+
+void *memmove_word_backward(void *dest, const void *src, size_t n);
+void *memmove_sse2_backward(void *dest, const void *src, size_t n);
 void *memmove(void *dest, const void *src, size_t n);
+
+int memcmp_word(const void *s1, const void *s2, size_t n);
+int memcmp_sse2(const void *s1, const void *s2, size_t n);
 int memcmp(const void *s1, const void *s2, size_t n);
 
+void *memchr_word(const void *s, int c, size_t n);
+void *memchr_sse2(const void *s, int c, size_t n);
+void *memchr(const void *s, int c, size_t n);
+
+size_t strnlen(const char *s, size_t n);
+size_t strlen(const char *s);
+
+void *memset_word(void *s, int c, size_t n);
+void *memset_sse2(void *s, int c, size_t n);
+void *memset_erms(void *s, int c, size_t n);
+void *memset_nt(void *s, int c, size_t n);
+void *memset(void *s, int c, size_t n);
+
 void bzero(void *s, size_t n);
 
+void page_zero(void *page);
+void page_copy(void *dest, const void *src);
+
 #endif
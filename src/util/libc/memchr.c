@@ -0,0 +1,93 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "libc.h"
+
+/*
+ * Looks for the byte `c` in the `n` first bytes of `s`, one byte at a time.
+ */
+void *memchr_word(const void *s, int c, size_t n)
+{
+	while (n-- > 0)
+	{
+		if (*((volatile unsigned char *) s) == (unsigned char) c)
+			return (void *) s;
+		s += sizeof(char);
+	}
+	return NULL;
+}
+
+/*
+ * Compares the 16 bytes block at `block`, which must be aligned on 16 bytes,
+ * with the byte `c`, then returns a mask in which each bit is set if the
+ * corresponding byte equals `c`.
+ */
+SSE2_FN
+static inline uint32_t eq16(const void *block, int c)
+{
+	uint32_t mask;
+
+	__asm__ volatile(
+		"movd %2, %%xmm1\n\t"
+		"punpcklbw %%xmm1, %%xmm1\n\t"
+		"punpcklwd %%xmm1, %%xmm1\n\t"
+		"pshufd $0, %%xmm1, %%xmm1\n\t"
+		"movdqa (%1), %%xmm0\n\t"
+		"pcmpeqb %%xmm1, %%xmm0\n\t"
+		"pmovmskb %%xmm0, %0"
+		: "=r"(mask)
+		: "r"(block), "r"((uint32_t) (c & 0xff))
+		: "memory", "xmm0", "xmm1");
+	return mask;
+}
+
+/*
+ * Looks for the byte `c` in the `n` first bytes of `s`, 16 bytes at a time
+ * using SSE2 registers.
+ *
+ * Only blocks aligned on 16 bytes are read. Such a block never crosses a page
+ * boundary, so the function never reads a page that doesn't contain any of
+ * the `n` bytes, even though it might read a few bytes before or after the
+ * range. Matches outside of the range are ignored.
+ */
+SSE2_FN
+void *memchr_sse2(const void *s, int c, size_t n)
+{
+	// The current block
+	const void *block;
+	// The offset of the first byte of the range in the current block
+	size_t first;
+	// The mask of matching bytes in the current block
+	uint32_t mask;
+	// The index of the match in the current block
+	size_t i;
+
+	if (n == 0)
+		return NULL;
+	// `s + n` is not computed since it may overflow
+	block = DOWN_ALIGN(s, 16);
+	first = ALIGN_MASK(s, 16);
+	mask = eq16(block, c) & (0xffff << first);
+	while (1)
+	{
+		if (mask)
+		{
+			i = __builtin_ctz(mask);
+			return (i - first < n ? (void *) (block + i) : NULL);
+		}
+		// `n` is the number of bytes of the range from `first` onwards
+		if (n <= 16 - first)
+			return NULL;
+		n -= 16 - first;
+		first = 0;
+		block += 16;
+		mask = eq16(block, c);
+	}
+}
+
+void *memchr(const void *s, int c, size_t n)
+{
+	if (libc_features & LIBC_FEATURE_SSE2)
+		return memchr_sse2(s, c, n);
+	return memchr_word(s, c, n);
+}
@@ -3,22 +3,29 @@
 
 #include "libc.h"
 
-int memcmp(const void *s1, const void *s2, size_t n)
+/*
+ * Type allowing to read a `long` at an address that is not aligned.
+ */
+typedef long __attribute__((aligned(1), may_alias)) unaligned_long;
+
+/*
+ * Compares memory one `long` at a time. Once the first area is aligned, the
+ * second one is read with unaligned accesses so that the comparison remains
+ * fast when both areas are not co-aligned.
+ */
+int memcmp_word(const void *s1, const void *s2, size_t n)
 {
 	// The index of the current byte
 	size_t i;
-	// The end of the aligned portion of memory
-	size_t align_end;
 
 	i = 0;
-	align_end = (size_t) (DOWN_ALIGN(s1 + n, sizeof(long)) - s1);
-	while (i < n
-		&& !(IS_ALIGNED(s1, sizeof(long)) && IS_ALIGNED(s2, sizeof(long)))
+	while (i < n && !IS_ALIGNED(s1 + i, sizeof(long))
 		&& ((volatile char *) s1)[i] == ((volatile char *) s2)[i])
 		++i;
-	while (i < align_end
-		&& *((volatile long *) (s1 + i)) == *((volatile long *) (s2 + i)))
-		++i;
+	while (i + sizeof(long) <= n
+		&& *((volatile long *) (s1 + i))
+			== *((volatile unaligned_long *) (s2 + i)))
+		i += sizeof(long);
 	while (i < n
 		&& ((volatile char *) s1)[i] == ((volatile char *) s2)[i])
 		++i;
@@ -26,3 +33,55 @@ int memcmp(const void *s1, const void *s2, size_t n)
 		return 0;
 	return (((unsigned char *) s1)[i] - ((unsigned char *) s2)[i]);
 }
+
+/*
+ * Compares 16 bytes at `s1` and `s2`, then returns a mask in which each bit
+ * is set if the corresponding bytes are equal.
+ */
+SSE2_FN
+static inline uint32_t cmp16(const void *s1, const void *s2)
+{
+	uint32_t mask;
+
+	__asm__ volatile(
+		"movdqu (%1), %%xmm0\n\t"
+		"movdqu (%2), %%xmm1\n\t"
+		"pcmpeqb %%xmm1, %%xmm0\n\t"
+		"pmovmskb %%xmm0, %0"
+		: "=r"(mask)
+		: "r"(s1), "r"(s2)
+		: "memory", "xmm0", "xmm1");
+	return mask;
+}
+
+/*
+ * Compares memory 16 bytes at a time using SSE2 registers. When a block
+ * differs, the position of the first differing byte is directly given by the
+ * comparison mask.
+ */
+SSE2_FN
+int memcmp_sse2(const void *s1, const void *s2, size_t n)
+{
+	// The index of the current byte
+	size_t i;
+	// The comparison mask of the current block
+	uint32_t mask;
+
+	for (i = 0; i + 16 <= n; i += 16)
+	{
+		mask = cmp16(s1 + i, s2 + i);
+		if (mask != 0xffff)
+		{
+			i += __builtin_ctz(~mask);
+			return (((unsigned char *) s1)[i] - ((unsigned char *) s2)[i]);
+		}
+	}
+	return memcmp_word(s1 + i, s2 + i, n - i);
+}
+
+int memcmp(const void *s1, const void *s2, size_t n)
+{
+	if (n >= sse2_threshold)
+		return memcmp_sse2(s1, s2, n);
+	return memcmp_word(s1, s2, n);
+}
@@ -3,7 +3,14 @@
 
 #include "libc.h"
 
-void *memcpy(void *dest, const void *src, size_t n)
+/*
+ * Copies memory one `long` at a time. This variant works on every CPU and is
+ * the fastest for small sizes.
+ *
+ * Accesses are volatile to prevent the compiler from replacing the loops with
+ * a call to `memcpy` itself.
+ */
+void *memcpy_word(void *dest, const void *src, size_t n)
 {
 	// The beginning of the destination memory
 	void *begin;
@@ -36,3 +43,131 @@ void *memcpy(void *dest, const void *src, size_t n)
 	}
 	return begin;
 }
+
+/*
+ * Copies memory 64 bytes at a time using SSE2 registers.
+ *
+ * The destination is first aligned on 16 bytes so that stores are aligned.
+ * Loads are unaligned since the source and destination might not be
+ * co-aligned. The remaining bytes are copied with `memcpy_word`.
+ */
+SSE2_FN
+void *memcpy_sse2(void *dest, const void *src, size_t n)
+{
+	// The beginning of the destination memory
+	void *begin;
+	// The number of bytes to copy before the destination is aligned
+	size_t head;
+	// The number of 64 bytes blocks to copy
+	size_t blocks;
+
+	begin = dest;
+	head = (16 - ALIGN_MASK(dest, 16)) & 15;
+	if (head > n)
+		head = n;
+	memcpy_word(dest, src, head);
+	dest += head;
+	src += head;
+	n -= head;
+	blocks = n / 64;
+	if (blocks > 0)
+		__asm__ volatile(
+			"1:\n\t"
+			"movdqu (%1), %%xmm0\n\t"
+			"movdqu 16(%1), %%xmm1\n\t"
+			"movdqu 32(%1), %%xmm2\n\t"
+			"movdqu 48(%1), %%xmm3\n\t"
+			"movdqa %%xmm0, (%0)\n\t"
+			"movdqa %%xmm1, 16(%0)\n\t"
+			"movdqa %%xmm2, 32(%0)\n\t"
+			"movdqa %%xmm3, 48(%0)\n\t"
+			"add $64, %0\n\t"
+			"add $64, %1\n\t"
+			"dec %2\n\t"
+			"jnz 1b"
+			: "+r"(dest), "+r"(src), "+r"(blocks)
+			:
+			: "memory", "cc", "xmm0", "xmm1", "xmm2", "xmm3");
+	memcpy_word(dest, src, n % 64);
+	return begin;
+}
+
+/*
+ * Copies memory using `rep movsb`. On CPUs supporting Enhanced REP MOVSB
+ * (ERMS), the microcode copies whole cache lines at a time, which makes this
+ * variant the fastest for large sizes.
+ */
+void *memcpy_erms(void *dest, const void *src, size_t n)
+{
+	// The beginning of the destination memory
+	void *begin;
+
+	begin = dest;
+	__asm__ volatile("rep movsb"
+		: "+D"(dest), "+S"(src), "+c"(n)
+		:
+		: "memory");
+	return begin;
+}
+
+/*
+ * Copies memory 64 bytes at a time using SSE2 non-temporal stores, which
+ * write directly to memory instead of allocating cache lines. This variant is
+ * useful when the destination is not going to be read soon, since it keeps
+ * the working set in the caches.
+ *
+ * A store fence is issued at the end so that the non-temporal stores are
+ * globally visible when the function returns.
+ */
+SSE2_FN
+void *memcpy_nt(void *dest, const void *src, size_t n)
+{
+	// The beginning of the destination memory
+	void *begin;
+	// The number of bytes to copy before the destination is aligned
+	size_t head;
+	// The number of 64 bytes blocks to copy
+	size_t blocks;
+
+	begin = dest;
+	head = (16 - ALIGN_MASK(dest, 16)) & 15;
+	if (head > n)
+		head = n;
+	memcpy_word(dest, src, head);
+	dest += head;
+	src += head;
+	n -= head;
+	blocks = n / 64;
+	if (blocks > 0)
+		__asm__ volatile(
+			"1:\n\t"
+			"movdqu (%1), %%xmm0\n\t"
+			"movdqu 16(%1), %%xmm1\n\t"
+			"movdqu 32(%1), %%xmm2\n\t"
+			"movdqu 48(%1), %%xmm3\n\t"
+			"movntdq %%xmm0, (%0)\n\t"
+			"movntdq %%xmm1, 16(%0)\n\t"
+			"movntdq %%xmm2, 32(%0)\n\t"
+			"movntdq %%xmm3, 48(%0)\n\t"
+			"add $64, %0\n\t"
+			"add $64, %1\n\t"
+			"dec %2\n\t"
+			"jnz 1b\n\t"
+			"sfence"
+			: "+r"(dest), "+r"(src), "+r"(blocks)
+			:
+			: "memory", "cc", "xmm0", "xmm1", "xmm2", "xmm3");
+	memcpy_word(dest, src, n % 64);
+	return begin;
+}
+
+void *memcpy(void *dest, const void *src, size_t n)
+{
+	if (n >= nt_threshold)
+		return memcpy_nt(dest, src, n);
+	if (n >= erms_threshold)
+		return memcpy_erms(dest, src, n);
+	if (n >= sse2_threshold)
+		return memcpy_sse2(dest, src, n);
+	return memcpy_word(dest, src, n);
+}
@@ -3,18 +3,109 @@
 
 #include "libc.h"
 
-// TODO Optimize
-void *memmove(void *dest, const void *src, size_t n)
+/*
+ * Copies memory backward one `long` at a time, starting from the end of the
+ * areas. This variant works on every CPU and is the fastest for small sizes.
+ *
+ * Accesses are volatile to prevent the compiler from replacing the loops with
+ * a call to `memmove` itself.
+ */
+void *memmove_word_backward(void *dest, const void *src, size_t n)
 {
-	void *begin = dest;
-	size_t i = 0;
+	// The beginning of the destination memory
+	void *begin;
+	// The beginning of the aligned portion of memory to be written
+	void *align_begin;
 
-	if (dest < src)
-		return memcpy(dest, src, n);
-	while (i < n)
+	begin = dest;
+	dest += n;
+	src += n;
+	align_begin = (void *) DOWN_ALIGN(begin + (sizeof(long) - 1), sizeof(long));
+	while (dest > begin
+		&& !(IS_ALIGNED(dest, sizeof(long)) && IS_ALIGNED(src, sizeof(long))))
+	{
+		dest -= sizeof(char);
+		src -= sizeof(char);
+		*((volatile char *) dest) = *((volatile char *) src);
+	}
+	while (dest >= align_begin + sizeof(long))
 	{
-		((char *) dest)[n - i - 1] = ((char *) src)[n - i - 1];
-		++i;
+		dest -= sizeof(long);
+		src -= sizeof(long);
+		*((volatile long *) dest) = *((volatile long *) src);
+	}
+	while (dest > begin)
+	{
+		dest -= sizeof(char);
+		src -= sizeof(char);
+		*((volatile char *) dest) = *((volatile char *) src);
 	}
 	return begin;
 }
+
+/*
+ * Copies memory backward 64 bytes at a time using SSE2 registers, starting
+ * from the end of the areas.
+ *
+ * The end of the destination is first aligned on 16 bytes so that stores are
+ * aligned. Every block is entirely loaded before being stored, so that the
+ * copy remains correct when the areas overlap. The remaining bytes at the
+ * beginning are copied with `memmove_word_backward`.
+ */
+SSE2_FN
+void *memmove_sse2_backward(void *dest, const void *src, size_t n)
+{
+	// The number of bytes to copy before the end of the destination is aligned
+	size_t tail;
+	// The number of 64 bytes blocks to copy
+	size_t blocks;
+	// The end of the destination memory
+	void *dest_end;
+	// The end of the source memory
+	const void *src_end;
+
+	tail = ALIGN_MASK(dest + n, 16);
+	if (tail > n)
+		tail = n;
+	memmove_word_backward(dest + n - tail, src + n - tail, tail);
+	n -= tail;
+	dest_end = dest + n;
+	src_end = src + n;
+	blocks = n / 64;
+	if (blocks > 0)
+		__asm__ volatile(
+			"1:\n\t"
+			"sub $64, %0\n\t"
+			"sub $64, %1\n\t"
+			"movdqu 48(%1), %%xmm3\n\t"
+			"movdqu 32(%1), %%xmm2\n\t"
+			"movdqu 16(%1), %%xmm1\n\t"
+			"movdqu (%1), %%xmm0\n\t"
+			"movdqa %%xmm3, 48(%0)\n\t"
+			"movdqa %%xmm2, 32(%0)\n\t"
+			"movdqa %%xmm1, 16(%0)\n\t"
+			"movdqa %%xmm0, (%0)\n\t"
+			"dec %2\n\t"
+			"jnz 1b"
+			: "+r"(dest_end), "+r"(src_end), "+r"(blocks)
+			:
+			: "memory", "cc", "xmm0", "xmm1", "xmm2", "xmm3");
+	memmove_word_backward(dest, src, n % 64);
+	return dest;
+}
+
+/*
+ * Copying memory forward is correct when the destination is located before
+ * the source, or when both areas don't overlap. Otherwise, the copy is done
+ * backward so that the source is not overwritten before being read.
+ */
+void *memmove(void *dest, const void *src, size_t n)
+{
+	if (dest == src || n == 0)
+		return dest;
+	if (dest < src || dest >= src + n)
+		return memcpy(dest, src, n);
+	if (n >= sse2_threshold)
+		return memmove_sse2_backward(dest, src, n);
+	return memmove_word_backward(dest, src, n);
+}
@@ -1,6 +1,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "libc.h"
+
 /*
  * Fills a field with the given value to write several bytes at a time.
  */
@@ -14,19 +16,147 @@ static long make_field(const int c)
 	return field;
 }
 
-void *memset(void *s, int c, size_t n)
+/*
+ * Fills memory one `long` at a time. This variant works on every CPU and is
+ * the fastest for small sizes.
+ *
+ * Accesses are volatile to prevent the compiler from replacing the loops with
+ * a call to `memset` itself.
+ */
+void *memset_word(void *s, int c, size_t n)
 {
 	void *begin = s;
 	void *end = begin + n;
+	void *align_end = DOWN_ALIGN(end, sizeof(long));
 	long field;
 
-	while(s < end && (((intptr_t) s & (sizeof(long) - 1)) != 0))
-		*((char *) s++) = c;
+	while(s < end && !IS_ALIGNED(s, sizeof(long)))
+	{
+		*((volatile char *) s) = c;
+		s += sizeof(char);
+	}
 	field = make_field(c);
-	while(s < (void *) ((intptr_t) end & ~((intptr_t) 7))
-		&& (((intptr_t) s & (sizeof(long) - 1)) == 0))
-		*((long *) s++) = field;
+	while(s < align_end)
+	{
+		*((volatile long *) s) = field;
+		s += sizeof(long);
+	}
 	while(s < end)
-		*((char *) s++) = c;
+	{
+		*((volatile char *) s) = c;
+		s += sizeof(char);
+	}
+	return begin;
+}
+
+/*
+ * Fills memory 64 bytes at a time using SSE2 registers.
+ *
+ * The destination is first aligned on 16 bytes so that stores are aligned.
+ * The remaining bytes are written with `memset_word`.
+ */
+SSE2_FN
+void *memset_sse2(void *s, int c, size_t n)
+{
+	void *begin = s;
+	// The number of bytes to write before the destination is aligned
+	size_t head;
+	// The number of 64 bytes blocks to write
+	size_t blocks;
+
+	head = (16 - ALIGN_MASK(s, 16)) & 15;
+	if (head > n)
+		head = n;
+	memset_word(s, c, head);
+	s += head;
+	n -= head;
+	blocks = n / 64;
+	if (blocks > 0)
+		__asm__ volatile(
+			"movd %2, %%xmm0\n\t"
+			"pshufd $0, %%xmm0, %%xmm0\n\t"
+			"1:\n\t"
+			"movdqa %%xmm0, (%0)\n\t"
+			"movdqa %%xmm0, 16(%0)\n\t"
+			"movdqa %%xmm0, 32(%0)\n\t"
+			"movdqa %%xmm0, 48(%0)\n\t"
+			"add $64, %0\n\t"
+			"dec %1\n\t"
+			"jnz 1b"
+			: "+r"(s), "+r"(blocks)
+			: "r"((uint32_t) make_field(c))
+			: "memory", "cc", "xmm0");
+	memset_word(s, c, n % 64);
+	return begin;
+}
+
+/*
+ * Fills memory using `rep stosb`. On CPUs supporting Enhanced REP STOSB
+ * (ERMS), this variant is the fastest for large sizes.
+ */
+void *memset_erms(void *s, int c, size_t n)
+{
+	void *begin = s;
+
+	__asm__ volatile("rep stosb"
+		: "+D"(s), "+c"(n)
+		: "a"(c)
+		: "memory");
+	return begin;
+}
+
+/*
+ * Fills memory 64 bytes at a time using SSE2 non-temporal stores, which write
+ * directly to memory instead of allocating cache lines. This variant is useful
+ * when the memory is not going to be read soon, since it keeps the working
+ * set in the caches.
+ *
+ * A store fence is issued at the end so that the non-temporal stores are
+ * globally visible when the function returns.
+ */
+SSE2_FN
+void *memset_nt(void *s, int c, size_t n)
+{
+	void *begin = s;
+	// The number of bytes to write before the destination is aligned
+	size_t head;
+	// The number of 64 bytes blocks to write
+	size_t blocks;
+
+	head = (16 - ALIGN_MASK(s, 16)) & 15;
+	if (head > n)
+		head = n;
+	memset_word(s, c, head);
+	s += head;
+	n -= head;
+	blocks = n / 64;
+	if (blocks > 0)
+		__asm__ volatile(
+			"movd %2, %%xmm0\n\t"
+			"pshufd $0, %%xmm0, %%xmm0\n\t"
+			"1:\n\t"
+			"movntdq %%xmm0, (%0)\n\t"
+			"movntdq %%xmm0, 16(%0)\n\t"
+			"movntdq %%xmm0, 32(%0)\n\t"
+			"movntdq %%xmm0, 48(%0)\n\t"
+			"add $64, %0\n\t"
+			"dec %1\n\t"
+			"jnz 1b\n\t"
+			"sfence"
+			: "+r"(s), "+r"(blocks)
+			: "r"((uint32_t) make_field(c))
+			: "memory", "cc", "xmm0");
+	memset_word(s, c, n % 64);
 	return begin;
 }
+
+void *memset(void *s, int c, size_t n)
+{
+	if (n >= nt_threshold)
+		return memset_nt(s, c, n);
+	if (n >= erms_threshold)
+		return memset_erms(s, c, n);
+	if (n >= sse2_threshold)
+		return memset_sse2(s, c, n);
+	return memset_word(s, c, n);
+}
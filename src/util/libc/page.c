@@ -0,0 +1,36 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libc.h"
+
+/*
+ * Zeroes the page of memory `page`.
+ *
+ * If the CPU supports SSE2, non-temporal stores are used so that filling the
+ * page doesn't evict the working set from the caches.
+ *
+ * `page` must be aligned on `PAGE_SIZE`.
+ */
+void page_zero(void *page)
+{
+	if (libc_features & LIBC_FEATURE_SSE2)
+		memset_nt(page, 0, PAGE_SIZE);
+	else
+		memset_word(page, 0, PAGE_SIZE);
+}
+
+/*
+ * Copies the page of memory `src` to `dest`.
+ *
+ * If the CPU supports SSE2, non-temporal stores are used so that filling the
+ * page doesn't evict the working set from the caches.
+ *
+ * `dest` and `src` must be aligned on `PAGE_SIZE` and must not overlap.
+ */
+void page_copy(void *dest, const void *src)
+{
+	if (libc_features & LIBC_FEATURE_SSE2)
+		memcpy_nt(dest, src, PAGE_SIZE);
+	else
+		memcpy_word(dest, src, PAGE_SIZE);
+}
@@ -0,0 +1,45 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "libc.h"
+
+/*
+ * Returns the length of the string `s`, limited to `n` bytes.
+ */
+size_t strnlen(const char *s, size_t n)
+{
+	// The pointer to the terminating null byte
+	const char *end;
+
+	end = memchr(s, '\0', n);
+	if (!end)
+		return n;
+	return end - s;
+}
+
+/*
+ * Returns the length of the string `s`.
+ *
+ * The string is searched one page at a time. Since `memchr` doesn't read pages
+ * that are not part of the range, no page after the one containing the
+ * terminating null byte is accessed.
+ */
+size_t strlen(const char *s)
+{
+	// The pointer to the beginning of the current chunk
+	const char *chunk;
+	// The pointer to the terminating null byte
+	const char *end;
+	// The size of the current chunk
+	size_t size;
+
+	chunk = s;
+	while (1)
+	{
+		size = PAGE_SIZE - ALIGN_MASK(chunk, PAGE_SIZE);
+		end = memchr(chunk, '\0', size);
+		if (end)
+			return end - s;
+		chunk += size;
+	}
+}
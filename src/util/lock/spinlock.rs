@@ -1,8 +1,12 @@
 //! This module contains the Spinlock structure, which is considered as being a low level feature.
 //! Unless for special cases, other locks should be used instead.
 
+use core::hint;
+use crate::memory::vmem::tlb;
+
 extern "C" {
 	pub fn spin_lock(lock: *mut i32);
+	pub fn spin_trylock(lock: *mut i32) -> i32;
 	pub fn spin_unlock(lock: *mut i32);
 }
 
@@ -36,10 +40,14 @@ impl Spinlock {
 		self.locked != 0
 	}
 
-	/// Wrapper for `spin_lock`. Locks the spinlock.
+	/// Locks the spinlock.
+	///
+	/// While waiting, the function serves TLB shootdown requests since the core holding the lock
+	/// might be waiting for the current core to do so, with interrupts disabled.
 	pub fn lock(&mut self) {
-		unsafe {
-			spin_lock(&mut self.locked);
+		while unsafe { spin_trylock(&mut self.locked) } == 0 {
+			tlb::serve();
+			hint::spin_loop();
 		}
 	}
 
@@ -1,4 +1,5 @@
 .global spin_lock
+.global spin_trylock
 .global spin_unlock
 
 /*
@@ -26,6 +27,16 @@ spin:
 	pop %ebp
 	ret
 
+/*
+ * Tries to lock the given spinlock. Returns 1 if the spinlock has been locked, or 0 if it was already locked.
+ */
+spin_trylock:
+	mov 4(%esp), %edx
+	mov $1, %eax
+	xchg %eax, (%edx)
+	xor $1, %eax
+	ret
+
 /*
  * Unlocks the given spinlock. Does nothing if the spinlock is already unlocked.
  */
@@ -15,6 +15,7 @@ use core::cmp::min;
 use core::ffi::c_void;
 use core::mem::size_of;
 use core::slice;
+use crate::cpu;
 use crate::errno::Errno;
 
 /// Tells if pointer `ptr` is aligned on boundary `n`.
@@ -85,7 +86,16 @@ macro_rules! register_get {
 	}};
 }
 
+/// libc feature flag: the CPU supports SSE2 instructions.
+const LIBC_FEATURE_SSE2: u32 = 0b01;
+/// libc feature flag: the CPU supports Enhanced REP MOVSB/STOSB (ERMS).
+const LIBC_FEATURE_ERMS: u32 = 0b10;
+
 extern "C" {
+	/// Selects the variants of the memory functions to be used according to the given features
+	/// of the CPU.
+	fn libc_init(features: u32);
+
 	/// Copies the given memory area `src` to `dest` with size `n`.
 	/// If the given memory areas are overlapping, the behaviour is undefined.
 	pub fn memcpy(dest: *mut c_void, src: *const c_void, n: usize) -> *mut c_void;
@@ -94,12 +104,51 @@ extern "C" {
 	/// Compares strings of byte `s1` and `s2` with length `n` and returns the
 	/// diffence between the first bytes that differ.
 	pub fn memcmp(s1: *const c_void, s2: *const c_void, n: usize) -> i32;
+	/// Returns a pointer to the first occurrence of the byte `c` in the `n` first bytes of the
+	/// memory area pointed to by `s`. If not found, the function returns NULL.
+	pub fn memchr(s: *const c_void, c: i32, n: usize) -> *mut c_void;
 	/// Fills the `n` first bytes of the memory area pointed to by `s`, with the
 	/// value `c`.
 	pub fn memset(s: *mut c_void, c: i32, n: usize) -> *mut c_void;
 
 	/// Zeros the given chunk of memory `s` with the given size `n`.
 	pub fn bzero(s: *mut c_void, n: usize);
+
+	/// Returns the length of the string `s`.
+	/// If the pointer or the string is invalid, the behaviour is undefined.
+	pub fn strlen(s: *const u8) -> usize;
+	/// Like `strlen`, but limited to the first `n` bytes.
+	/// If the pointer or the string is invalid, the behaviour is undefined.
+	pub fn strnlen(s: *const u8, n: usize) -> usize;
+
+	/// Zeros the page of memory `page`, which must be page-aligned.
+	/// If the CPU supports it, non-temporal stores are used so that filling the page doesn't
+	/// evict the working set from the caches.
+	pub fn page_zero(page: *mut c_void);
+	/// Copies the page of memory `src` to `dest`, which must both be page-aligned and must not
+	/// overlap.
+	/// If the CPU supports it, non-temporal stores are used so that filling the page doesn't
+	/// evict the working set from the caches.
+	pub fn page_copy(dest: *mut c_void, src: *const c_void);
+}
+
+/// Selects the fastest implementations of the memory functions (`memcpy`, `memset`, `bzero`,
+/// ...) for the current CPU.
+///
+/// This function must be called only once, at boot, after SSE has been enabled. Before that, the
+/// memory functions use only general purpose registers.
+pub fn init() {
+	let mut features = 0;
+	if cpu::sse::is_present() && cpu::sse::has_sse2() {
+		features |= LIBC_FEATURE_SSE2;
+	}
+	if cpu::has_erms() {
+		features |= LIBC_FEATURE_ERMS;
+	}
+
+	unsafe {
+		libc_init(features);
+	}
 }
 
 /// Zeroes the given object.
@@ -112,29 +161,18 @@ pub unsafe fn zero_object<T>(obj: &mut T) {
 	bzero(ptr, size);
 }
 
-/// Returns the length of the string `s`.
-/// If the pointer or the string is invalid, the behaviour is undefined.
-#[no_mangle]
-pub unsafe extern "C" fn strlen(s: *const u8) -> usize {
-	let mut i = 0;
-
-	while *s.add(i) != b'\0' {
-		i += 1;
-	}
+/// Returns the offset of the first occurrence of the byte `c` in the slice `s`.
+/// If not found, the function returns None.
+pub fn find_byte(s: &[u8], c: u8) -> Option<usize> {
+	let ptr = unsafe {
+		memchr(s.as_ptr() as _, c as _, s.len())
+	};
 
-	i
-}
-
-/// Like `strlen`, but limited to the first `n` bytes.
-/// If the pointer or the string is invalid, the behaviour is undefined.
-pub unsafe fn strnlen(s: *const u8, n: usize) -> usize {
-	let mut i = 0;
-
-	while i < n && *s.add(i) != b'\0' {
-		i += 1;
+	if !ptr.is_null() {
+		Some(ptr as usize - s.as_ptr() as usize)
+	} else {
+		None
 	}
-
-	i
 }
 
 /// Returns a slice representing a C string beginning at the given pointer.
@@ -222,6 +260,16 @@ pub trait IO {
 	/// `offset` is the offset in the I/O to the beginning of the data to write.
 	/// The function returns the number of bytes written.
 	fn write(&mut self, offset: u64, buff: &[u8]) -> Result<u64, Errno>;
+
+	/// Hints that the range of `size` bytes at offset `offset` is going to be read soon, allowing
+	/// the I/O to prefetch it. By default, the function does nothing.
+	fn readahead(&mut self, _offset: u64, _size: u64) {}
+
+	/// Writes to the underlying storage the data that has been written to the I/O but is still
+	/// held in memory. By default, the function does nothing.
+	fn sync(&mut self) -> Result<(), Errno> {
+		Ok(())
+	}
 }
 
 #[cfg(test)]
@@ -297,7 +345,63 @@ mod test {
 		}
 	}
 
-	// TODO More tests on memmove
+	/// Reference implementation of `memmove`, copying one byte at a time.
+	fn memmove_ref(buff: &mut [u8], dest: usize, src: usize, n: usize) {
+		if dest < src {
+			for i in 0..n {
+				buff[dest + i] = buff[src + i];
+			}
+		} else {
+			for i in (0..n).rev() {
+				buff[dest + i] = buff[src + i];
+			}
+		}
+	}
+
+	/// Tests `memmove` on overlapping ranges of size `n`, at every alignment of the source and
+	/// for destinations located up to `max_dist` bytes before or after the source.
+	fn memmove_overlap(n: usize, max_dist: usize) {
+		const BUFF_SIZE: usize = 4096;
+		let mut buff: [u8; BUFF_SIZE] = [0; BUFF_SIZE];
+		let mut expected: [u8; BUFF_SIZE] = [0; BUFF_SIZE];
+
+		for src_off in 0..16 {
+			let src = max_dist + src_off;
+			for dest in (src - max_dist)..=(src + max_dist) {
+				for (i, b) in buff.iter_mut().enumerate() {
+					*b = (i % 251) as _;
+				}
+				expected.copy_from_slice(&buff);
+
+				memmove_ref(&mut expected, dest, src, n);
+				unsafe {
+					memmove(buff.as_mut_ptr().add(dest) as _, buff.as_ptr().add(src) as _, n);
+				}
+				assert_eq!(buff, expected);
+			}
+		}
+	}
+
+	#[test_case]
+	fn memmove_overlap_small() {
+		for n in 0..32 {
+			memmove_overlap(n, 20);
+		}
+	}
+
+	#[test_case]
+	fn memmove_overlap_medium() {
+		for n in [63, 64, 65, 100, 127, 128, 129, 255, 256, 257, 1000] {
+			memmove_overlap(n, 70);
+		}
+	}
+
+	#[test_case]
+	fn memmove_overlap_large() {
+		for n in [2047, 2048, 2049, 3000] {
+			memmove_overlap(n, 70);
+		}
+	}
 
 	#[test_case]
 	fn memcmp0() {
@@ -329,7 +433,78 @@ mod test {
 		assert_eq!(val, 1);
 	}
 
-	// TODO More tests on memcmp
+	#[test_case]
+	fn memcmp_align() {
+		let mut b0: [u8; 300] = [0; 300];
+		let mut b1: [u8; 300] = [0; 300];
+
+		for off0 in 0..16 {
+			for off1 in 0..16 {
+				for (i, b) in b0[off0..].iter_mut().enumerate() {
+					*b = (i % 251) as _;
+				}
+				for (i, b) in b1[off1..].iter_mut().enumerate() {
+					*b = (i % 251) as _;
+				}
+
+				for diff in [0, 1, 15, 16, 17, 63, 64, 100, 255] {
+					let s0 = unsafe { b0.as_ptr().add(off0) };
+					let s1 = unsafe { b1.as_mut_ptr().add(off1) };
+					assert_eq!(unsafe { memcmp(s0 as _, s1 as _, 256) }, 0);
+
+					unsafe {
+						*s1.add(diff) += 1;
+					}
+					assert!(unsafe { memcmp(s0 as _, s1 as _, 256) } < 0);
+					assert!(unsafe { memcmp(s1 as _, s0 as _, 256) } > 0);
+					assert_eq!(unsafe { memcmp(s0 as _, s1 as _, diff) }, 0);
+					unsafe {
+						*s1.add(diff) -= 1;
+					}
+				}
+			}
+		}
+	}
+
+	#[test_case]
+	fn memchr0() {
+		let mut buff: [u8; 128] = [0; 128];
+
+		for off in 0..16 {
+			for pos in 0..64 {
+				buff.fill(0);
+				buff[off + pos] = 0x42;
+
+				for n in [0, pos, pos + 1, 64] {
+					let s = &buff[off..(off + n)];
+					let expected = if pos < n { Some(pos) } else { None };
+					assert_eq!(find_byte(s, 0x42), expected);
+				}
+
+				// A size that makes the end of the range overflow
+				let s = unsafe { buff.as_ptr().add(off) };
+				let ptr = unsafe { memchr(s as _, 0x42, usize::MAX) };
+				assert_eq!(ptr as usize, s as usize + pos);
+			}
+		}
+	}
+
+	#[test_case]
+	fn strlen0() {
+		let mut buff: [u8; 128] = [b'a'; 128];
+
+		for off in 0..16 {
+			for len in 0..64 {
+				buff.fill(b'a');
+				buff[off + len] = b'\0';
+
+				let s = unsafe { buff.as_ptr().add(off) };
+				assert_eq!(unsafe { strlen(s) }, len);
+				assert_eq!(unsafe { strnlen(s, 64) }, len);
+				assert_eq!(unsafe { strnlen(s, len / 2) }, len / 2);
+			}
+		}
+	}
 
 	// TODO Test `memset`
 
@@ -349,4 +524,153 @@ mod test {
 	}
 
 	// TODO More tests on memmove
+
+	/// Signature of the variants of `memcpy`.
+	type MemcpyFn = unsafe extern "C" fn(*mut c_void, *const c_void, usize) -> *mut c_void;
+	/// Signature of the variants of `memset`.
+	type MemsetFn = unsafe extern "C" fn(*mut c_void, i32, usize) -> *mut c_void;
+
+	extern "C" {
+		fn memcpy_word(dest: *mut c_void, src: *const c_void, n: usize) -> *mut c_void;
+		fn memcpy_sse2(dest: *mut c_void, src: *const c_void, n: usize) -> *mut c_void;
+		fn memcpy_erms(dest: *mut c_void, src: *const c_void, n: usize) -> *mut c_void;
+		fn memcpy_nt(dest: *mut c_void, src: *const c_void, n: usize) -> *mut c_void;
+
+		fn memset_word(s: *mut c_void, c: i32, n: usize) -> *mut c_void;
+		fn memset_sse2(s: *mut c_void, c: i32, n: usize) -> *mut c_void;
+		fn memset_erms(s: *mut c_void, c: i32, n: usize) -> *mut c_void;
+		fn memset_nt(s: *mut c_void, c: i32, n: usize) -> *mut c_void;
+	}
+
+	/// The sizes in bytes at which the variants of memory functions are benchmarked.
+	const BENCH_SIZES: [usize; 3] = [64, 4096, 1024 * 1024];
+	/// The order of the buddy frames used as benchmark buffers. The frames must be large enough
+	/// to hold the largest size in `BENCH_SIZES`.
+	const BENCH_ORDER: crate::memory::buddy::FrameOrder = 8;
+	/// The number of runs for each benchmark.
+	const BENCH_RUNS: u64 = 16;
+
+	/// Returns the average number of CPU cycles taken by a call to `f`.
+	fn bench<F: FnMut()>(mut f: F) -> u64 {
+		// Warming up caches
+		f();
+
+		let begin = cpu::rdtsc();
+		for _ in 0..BENCH_RUNS {
+			f();
+		}
+		(cpu::rdtsc() - begin) / BENCH_RUNS
+	}
+
+	/// Returns the list of variants of `memcpy` and `memset` that can run on the current CPU.
+	fn bench_variants() -> ([Option<(&'static str, MemcpyFn)>; 4],
+		[Option<(&'static str, MemsetFn)>; 4]) {
+		let sse2 = cpu::sse::is_present() && cpu::sse::has_sse2();
+
+		let memcpy_variants: [Option<(&'static str, MemcpyFn)>; 4] = [
+			Some(("word", memcpy_word)),
+			if sse2 { Some(("sse2", memcpy_sse2)) } else { None },
+			Some(("erms", memcpy_erms)),
+			if sse2 { Some(("nt", memcpy_nt)) } else { None },
+		];
+		let memset_variants: [Option<(&'static str, MemsetFn)>; 4] = [
+			Some(("word", memset_word)),
+			if sse2 { Some(("sse2", memset_sse2)) } else { None },
+			Some(("erms", memset_erms)),
+			if sse2 { Some(("nt", memset_nt)) } else { None },
+		];
+
+		(memcpy_variants, memset_variants)
+	}
+
+	#[test_case]
+	fn mem_variants() {
+		let (memcpy_variants, memset_variants) = bench_variants();
+		let mut src: [u8; 300] = [0; 300];
+		let mut dest: [u8; 300] = [0; 300];
+
+		for (i, b) in src.iter_mut().enumerate() {
+			*b = i as _;
+		}
+
+		for (_, f) in memcpy_variants.iter().flatten() {
+			for off in 0..16 {
+				dest.fill(0);
+				unsafe {
+					f(dest.as_mut_ptr().add(off) as _, src.as_ptr() as _, 256);
+				}
+
+				assert!(dest[..off].iter().all(| b | *b == 0));
+				assert_eq!(&dest[off..(off + 256)], &src[..256]);
+				assert!(dest[(off + 256)..].iter().all(| b | *b == 0));
+			}
+		}
+
+		for (_, f) in memset_variants.iter().flatten() {
+			for off in 0..16 {
+				dest.fill(0);
+				unsafe {
+					f(dest.as_mut_ptr().add(off) as _, 0x42, 256);
+				}
+
+				assert!(dest[..off].iter().all(| b | *b == 0));
+				assert!(dest[off..(off + 256)].iter().all(| b | *b == 0x42));
+				assert!(dest[(off + 256)..].iter().all(| b | *b == 0));
+			}
+		}
+	}
+
+	#[test_case]
+	fn page_zero_copy() {
+		let src = crate::memory::buddy::alloc_kernel(0).unwrap();
+		let dest = crate::memory::buddy::alloc_kernel(0).unwrap();
+
+		unsafe {
+			let src_slice = slice::from_raw_parts_mut(src as *mut u8, crate::memory::PAGE_SIZE);
+			let dest_slice = slice::from_raw_parts_mut(dest as *mut u8, crate::memory::PAGE_SIZE);
+			for (i, b) in src_slice.iter_mut().enumerate() {
+				*b = i as _;
+			}
+
+			page_copy(dest, src);
+			assert_eq!(dest_slice, src_slice);
+
+			page_zero(dest);
+			assert!(dest_slice.iter().all(| b | *b == 0));
+		}
+
+		crate::memory::buddy::free_kernel(dest, 0);
+		crate::memory::buddy::free_kernel(src, 0);
+	}
+
+	#[test_case]
+	fn mem_bench() {
+		let (memcpy_variants, memset_variants) = bench_variants();
+		let src = crate::memory::buddy::alloc_kernel(BENCH_ORDER).unwrap();
+		let dest = crate::memory::buddy::alloc_kernel(BENCH_ORDER).unwrap();
+
+		crate::println!();
+		for size in BENCH_SIZES {
+			crate::print!("memcpy {} bytes:", size);
+			for (name, f) in memcpy_variants.iter().flatten() {
+				let cycles = bench(|| unsafe {
+					f(dest, src, size);
+				});
+				crate::print!(" {}={}", name, cycles);
+			}
+			crate::println!(" (cycles)");
+
+			crate::print!("memset {} bytes:", size);
+			for (name, f) in memset_variants.iter().flatten() {
+				let cycles = bench(|| unsafe {
+					f(dest, 0, size);
+				});
+				crate::print!(" {}={}", name, cycles);
+			}
+			crate::println!(" (cycles)");
+		}
+
+		crate::memory::buddy::free_kernel(dest, BENCH_ORDER);
+		crate::memory::buddy::free_kernel(src, BENCH_ORDER);
+	}
 }
@@ -1,7 +1,10 @@
 //! This module contains pointer-like structures.
 
 use core::marker::Unsize;
+use core::mem::align_of;
+use core::mem::align_of_val;
 use core::mem::size_of;
+use core::mem::size_of_val;
 use core::ops::CoerceUnsized;
 use core::ops::DispatchFromDyn;
 use core::ops::{Deref, DerefMut};
@@ -9,7 +12,7 @@ use core::ptr::NonNull;
 use core::ptr::drop_in_place;
 use core::ptr;
 use crate::errno::Errno;
-use crate::memory::malloc;
+use crate::memory::slab;
 use crate::util::lock::Mutex;
 
 /// Structure holding the number of pointers to a resource.
@@ -73,7 +76,8 @@ impl<T, const INT: bool> SharedPtr<T, INT> {
 	/// Creates a new shared pointer for the given Mutex `obj` containing the object.
 	pub fn new(obj: T) -> Result<Self, Errno> {
 		let inner = unsafe {
-			malloc::alloc(size_of::<SharedPtrInner<T, INT>>())? as *mut SharedPtrInner<T, INT>
+			slab::alloc(size_of::<SharedPtrInner<T, INT>>(), align_of::<SharedPtrInner<T, INT>>())?
+				.as_ptr() as *mut SharedPtrInner<T, INT>
 		};
 		unsafe { // Safe because the pointer is valid
 			ptr::write_volatile(inner, SharedPtrInner::<T, INT>::new(obj));
@@ -179,8 +183,11 @@ impl<T: ?Sized, const INT: bool> Drop for SharedPtr<T, INT> {
 
 		// Dropping inner structure
 		unsafe {
+			let size = size_of_val(inner);
+			let align = align_of_val(inner);
+
 			drop_in_place(inner);
-			malloc::free(inner as *mut _ as *mut _);
+			slab::free(inner as *mut _ as *mut _, size, align);
 		}
 	}
 }
@@ -267,8 +274,11 @@ impl<T: ?Sized, const INT: bool> Drop for WeakPtr<T, INT> {
 
 		// Dropping inner structure
 		unsafe {
+			let size = size_of_val(inner);
+			let align = align_of_val(inner);
+
 			drop_in_place(inner);
-			malloc::free(inner as *mut _ as *mut _);
+			slab::free(inner as *mut _ as *mut _, size, align);
 		}
 
 	}